@@ -60,6 +60,14 @@ void accScriptSource(ACCscript* script,
     const ACCchar** string,
     const ACCint* length);
 
+/* Optional. Keep compiled copies of scripts in the directory at path, and
+ * reuse them when the same source is compiled again. Must be called before
+ * accCompileScript. The directory is created with mode 0700 if needed, and
+ * is not used unless it, like each file in it, belongs to the effective uid
+ * and is not writable by group or others.
+ */
+void accScriptCacheDir(ACCscript* script, const ACCchar* path);
+
 void accCompileScript(ACCscript* script);
 
 void accGetScriptiv(ACCscript* script,
@@ -71,6 +79,11 @@ void accGetScriptInfoLog(ACCscript* script,
     ACCsizei* length,
     ACCchar* infoLog);
 
+/* On x86-64, scripts written for 32-bit targets keep pointers in ints, so
+ * their code, globals and malloc() heap are placed in the low 2GB. Their
+ * stack is the caller's: call the returned functions on a stack in the low
+ * 2GB too. Converting a pointer outside it to an int traps (SIGILL).
+ */
 void accGetScriptLabel(ACCscript* script, const ACCchar * name,
                        ACCvoid** address);
 
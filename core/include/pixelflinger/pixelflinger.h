@@ -315,6 +315,20 @@ extern "C" {
 ssize_t gglInit(GGLContext** context);
 ssize_t gglUninit(GGLContext* context);
 
+// splits large primitives and clears in horizontal bands, rendered by
+// 'count' threads (including the calling one). The result is the same
+// as with a single thread. Returns the number of threads in use.
+ssize_t gglSetRasterThreads(GGLContext* context, int count);
+
+// draws 'count' rectangles (l, t, r, b) or triangles (3 x, y vertices
+// each) sharing the current state, which is validated only once per call.
+// If 'texcoords' isn't NULL, it holds one (s, t) pair per rectangle, as
+// passed to texCoord2i() for the active TMU: with GGL_ONE_TO_ONE texture
+// generation, pixel (x, y) gets texel (x+s, y+t) (e.g. glyphs from an atlas).
+void gglRectsi(GGLContext* c,
+        const GGLint* rects, const GGLint* texcoords, GGLsizei count);
+void gglTrianglesx(GGLContext* c, const GGLcoord* vertices, GGLsizei count);
+
 GGLint gglBitBlti(
         GGLContext* c,
         int tmu,
@@ -101,7 +101,7 @@ template<bool> struct CTA;
 template<> struct CTA<true> { };
 
 #define GGL_CONTEXT(con, c)         context_t *con = static_cast<context_t *>(c)
-#define GGL_OFFSETOF(field)         int(&(((context_t*)0)->field))
+#define GGL_OFFSETOF(field)         int(intptr_t(&(((context_t*)0)->field)))
 #define GGL_INIT_PROC(p, f)         p.f = ggl_ ## f;
 #define GGL_BETWEEN(x, L, H)        (uint32_t((x)-(L)) <= ((H)-(L)))
 
@@ -253,6 +253,7 @@ int needs_t::match(const needs_filter_t& filter) {
 
 struct context_t;
 class Assembly;
+struct bands_t;
 
 struct blend_state_t {
 	uint32_t			src;
@@ -460,7 +461,7 @@ struct generated_tex_vars_t {
     uint32_t    width;
     uint32_t    height;
     uint32_t    stride;
-    int32_t     data;
+    uintptr_t   data;
     int32_t     dsdx;
     int32_t     dtdx;
     int32_t     spill[2];
@@ -473,7 +474,7 @@ struct generated_vars_t {
     } argb[4];
     int32_t     aref;
     int32_t     dzdx;
-    int32_t     zbase;
+    uintptr_t   zbase;
     int32_t     f;
     int32_t     dfdx;
     int32_t     spill[3];
@@ -525,6 +526,7 @@ struct context_t {
     
     void*               base;
     Assembly*           scanline_as;
+    bands_t*            bands;
     GGLenum             error;
 };
 
@@ -13,7 +13,9 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -21,9 +23,9 @@
 #include <string.h>
 #include <unistd.h>
 
-#include <cutils/hashmap.h>
 
 #include <sys/mman.h>
+#include <sys/stat.h>
 
 #if defined(MAP_ANON) && !defined(MAP_ANONYMOUS)
 #define MAP_ANONYMOUS MAP_ANON
@@ -54,6 +56,9 @@
 
 // #define PROVIDE_TRACE_CODEGEN
 
+// Comment out to disable constant folding
+#define PROVIDE_FOLDING_CODEGEN
+
 // Uncomment to disable ARM peephole optimizations
 // #define DISABLE_ARM_PEEPHOLE
 
@@ -144,6 +149,88 @@ private:
     size_t mSize;
 };
 
+#if defined(DEFAULT_X64_CODEGEN) && defined(MAP_32BIT)
+// Scripts written for 32-bit targets keep what malloc() returns in ints,
+// so on x86-64 they are linked against this heap in the low 2GB instead of
+// the system one. It only grows: what they free is given back at exit.
+
+static const size_t kScriptHeapSize = 256 * 1024 * 1024;
+static const size_t kScriptHeapHeader = 16;
+
+static pthread_mutex_t gScriptHeapLock = PTHREAD_MUTEX_INITIALIZER;
+static char* gScriptHeap;
+static char* gScriptHeapTop;
+
+static bool inScriptHeap(void* ptr) {
+    return gScriptHeap && (char*) ptr >= gScriptHeap
+            && (char*) ptr < gScriptHeap + kScriptHeapSize;
+}
+
+static void* scriptMalloc(size_t size) {
+    size_t block = (kScriptHeapHeader + size + 15) & ~15;
+    if (size > kScriptHeapSize) {
+        return NULL;
+    }
+    char* p = NULL;
+    pthread_mutex_lock(&gScriptHeapLock);
+    if (!gScriptHeap) {
+        void* heap = mmap(NULL, kScriptHeapSize, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_32BIT,
+                -1, 0);
+        if (heap != MAP_FAILED) {
+            gScriptHeap = gScriptHeapTop = (char*) heap;
+        }
+    }
+    if (gScriptHeap
+            && block <= size_t(gScriptHeap + kScriptHeapSize - gScriptHeapTop)) {
+        p = gScriptHeapTop;
+        gScriptHeapTop += block;
+    }
+    pthread_mutex_unlock(&gScriptHeapLock);
+    if (!p) {
+        return NULL;
+    }
+    *(size_t*) p = size;
+    return p + kScriptHeapHeader;
+}
+
+static void scriptFree(void* ptr) {
+    if (!inScriptHeap(ptr)) {
+        free(ptr);
+    }
+}
+
+static void* scriptCalloc(size_t count, size_t size) {
+    // The heap is never reused, so it is still zero.
+    if (size && count > (size_t) -1 / size) {
+        return NULL;
+    }
+    return scriptMalloc(count * size);
+}
+
+static void* scriptRealloc(void* ptr, size_t size) {
+    if (ptr && !inScriptHeap(ptr)) {
+        return realloc(ptr, size);
+    }
+    void* result = scriptMalloc(size);
+    if (result && ptr) {
+        size_t old = *(size_t*) ((char*) ptr - kScriptHeapHeader);
+        memcpy(result, ptr, old < size ? old : size);
+    }
+    return result;
+}
+
+static const struct {
+    const char* name;
+    void* pAddress;
+} kScriptHeap[] = {
+    { "malloc", (void*) scriptMalloc },
+    { "free", (void*) scriptFree },
+    { "calloc", (void*) scriptCalloc },
+    { "realloc", (void*) scriptRealloc },
+};
+#endif
+
 class ErrorSink {
 public:
     void error(const char *fmt, ...) {
@@ -220,6 +307,8 @@ class Compiler : public ErrorSink {
         virtual intptr_t getPC() = 0;
         // Call this before trying to modify code in the buffer.
         virtual void flush() = 0;
+        // Throw away the code emitted since getPC() returned pc.
+        virtual void rewind(intptr_t pc) = 0;
     };
 
     class CodeBuf : public ICodeBuf {
@@ -264,9 +353,14 @@ class Compiler : public ErrorSink {
         virtual void init(int size) {
             release();
             mSize = size;
+            int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(PROVIDE_X64_CODEGEN) && defined(MAP_32BIT)
+            // Branch chains and function addresses are kept in 32-bit ints.
+            flags |= MAP_32BIT;
+#endif
             pProgramBase = (char*) mmap(NULL, size, 
                 PROT_EXEC | PROT_READ | PROT_WRITE, 
-                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                flags, -1, 0);
             ind = pProgramBase;
         }
 
@@ -305,6 +399,10 @@ class Compiler : public ErrorSink {
         }
 
         virtual void flush() {}
+
+        virtual void rewind(intptr_t pc) {
+            ind = (char*) pc;
+        }
     };
 
     /**
@@ -353,7 +451,7 @@ class Compiler : public ErrorSink {
          * operations like gcmp.
          */
 
-        void setTypes(Type* pInt) {
+        virtual void setTypes(Type* pInt) {
             mkpInt = pInt;
         }
 
@@ -382,11 +480,28 @@ class Compiler : public ErrorSink {
         virtual void functionExit(Type* pDecl, int localVariableAddress,
                                   int localVariableSize) = 0;
 
+        /* Offer to keep the argument or local variable at address ea in a
+         * register. The front end only offers variables whose address is
+         * never taken. Arguments are offered before functionEntry() is
+         * called, locals right after they are declared.
+         * Returns true if the variable now lives in a register.
+         */
+        virtual bool allocRegisterVariable(int ea, Type* pType) {
+            return false;
+        }
+
+        /* Enter and leave a nested block. Register variables allocated
+         * inside the block are released when it is left.
+         */
+        virtual void pushScope() {}
+
+        virtual void popScope() {}
+
         /* load immediate value to R0 */
         virtual void li(int i) = 0;
 
         /* Load floating point value from global address. */
-        virtual void loadFloat(int address, Type* pType) = 0;
+        virtual void loadFloat(intptr_t address, Type* pType) = 0;
 
         /* Add the struct offset in bytes to R0, change the type to pType */
         virtual void addStructOffsetR0(int offset, Type* pType) = 0;
@@ -403,6 +518,14 @@ class Compiler : public ErrorSink {
          */
         virtual int gtst(bool l, int t) = 0;
 
+        /* Return true if R0 is a constant known at compile time, and set
+         * *pIsTrue to whether it is nonzero. The front end uses this to
+         * drop statements that can never run.
+         */
+        virtual bool isR0Constant(bool* pIsTrue) {
+            return false;
+        }
+
         /* Compare TOS against R0, and store the boolean result in R0.
          * Pops TOS.
          * op specifies the comparison.
@@ -454,13 +577,13 @@ class Compiler : public ErrorSink {
          * et is ET_RVALUE for things like string constants, ET_LVALUE for
          * variables.
          */
-        virtual void leaR0(int ea, Type* pPointerType, ExpressionType et) = 0;
+        virtual void leaR0(intptr_t ea, Type* pPointerType, ExpressionType et) = 0;
 
         /* Load the pc-relative address of a forward-referenced variable to R0.
          * Return the address of the 4-byte constant so that it can be filled
          * in later.
          */
-        virtual int leaForward(int ea, Type* pPointerType) = 0;
+        virtual intptr_t leaForward(intptr_t ea, Type* pPointerType) = 0;
 
         /**
          * Convert R0 to the given type.
@@ -528,7 +651,7 @@ class Compiler : public ErrorSink {
          * linked list of addresses to patch.
          * (Like gsym, but using absolute address, not PC relative address.)
          */
-        virtual void resolveForward(int t) = 0;
+        virtual void resolveForward(intptr_t t) = 0;
 
         /*
          * Do any cleanup work required at the end of a compile.
@@ -557,6 +680,10 @@ class Compiler : public ErrorSink {
             return mExpressionStack.back().pType;
         }
 
+        virtual Type* getTOSType() {
+            return mExpressionStack[mExpressionStack.size()-2].pType;
+        }
+
         virtual ExpressionType getR0ExpressionType() {
             return mExpressionStack.back().et;
         }
@@ -630,10 +757,6 @@ class Compiler : public ErrorSink {
             mExpressionStack.back().et = et;
         }
 
-        Type* getTOSType() {
-            return mExpressionStack[mExpressionStack.size()-2].pType;
-        }
-
         void pushType() {
             if (mExpressionStack.size()) {
                 mExpressionStack.push_back(mExpressionStack.back());
@@ -972,6 +1095,11 @@ class Compiler : public ErrorSink {
             flush();
             return mpBase->getPC();
         }
+
+        void rewind(intptr_t pc) {
+            flush();
+            mpBase->rewind(pc);
+        }
     };
 
     class ARMCodeGenerator : public CodeGenerator {
@@ -1062,7 +1190,7 @@ class Compiler : public ErrorSink {
             setR0Type(mkpInt);
         }
 
-        virtual void loadFloat(int address, Type* pType) {
+        virtual void loadFloat(intptr_t address, Type* pType) {
             setR0Type(pType);
             // Global, absolute address
             o4(0xE59F0000); //        ldr r0, .L1
@@ -1733,7 +1861,7 @@ class Compiler : public ErrorSink {
             setR0Type(pNewType);
         }
 
-        virtual void leaR0(int ea, Type* pPointerType, ExpressionType et) {
+        virtual void leaR0(intptr_t ea, Type* pPointerType, ExpressionType et) {
             if (ea > -LOCAL && ea < LOCAL) {
                 // Local, fp relative
 
@@ -1759,10 +1887,10 @@ class Compiler : public ErrorSink {
             setR0Type(pPointerType, et);
         }
 
-        virtual int leaForward(int ea, Type* pPointerType) {
+        virtual intptr_t leaForward(intptr_t ea, Type* pPointerType) {
             setR0Type(pPointerType);
-            int result = ea;
-            int pc = getPC();
+            intptr_t result = ea;
+            intptr_t pc = getPC();
             int offset = 0;
             if (ea) {
                 offset = (pc - ea - 8) >> 2;
@@ -2042,7 +2170,7 @@ class Compiler : public ErrorSink {
         }
 
         /* output a symbol and patch all calls to it */
-        virtual void resolveForward(int t) {
+        virtual void resolveForward(intptr_t t) {
             if (t) {
                 int pc = getPC();
                 *(int *) t = pc;
@@ -2487,7 +2615,7 @@ class Compiler : public ErrorSink {
             setR0Type(mkpInt);
         }
 
-        virtual void loadFloat(int address, Type* pType) {
+        virtual void loadFloat(intptr_t address, Type* pType) {
             setR0Type(pType);
             switch (pType->tag) {
             case TY_FLOAT:
@@ -2898,12 +3026,12 @@ class Compiler : public ErrorSink {
             setR0Type(pNewType);
         }
 
-        virtual void leaR0(int ea, Type* pPointerType, ExpressionType et) {
+        virtual void leaR0(intptr_t ea, Type* pPointerType, ExpressionType et) {
             gmov(10, ea); /* leal EA, %eax */
             setR0Type(pPointerType, et);
         }
 
-        virtual int leaForward(int ea, Type* pPointerType) {
+        virtual intptr_t leaForward(intptr_t ea, Type* pPointerType) {
             oad(0xb8, ea); /* mov $xx, %eax */
             setR0Type(pPointerType);
             return getPC() - 4;
@@ -3031,7 +3159,7 @@ class Compiler : public ErrorSink {
         }
 
         /* output a symbol and patch all calls to it, using absolute address */
-        virtual void resolveForward(int t) {
+        virtual void resolveForward(intptr_t t) {
             int n;
             int pc = getPC();
             while (t) {
@@ -3181,223 +3309,2856 @@ class Compiler : public ErrorSink {
 
 #endif // PROVIDE_X86_CODEGEN
 
-#ifdef PROVIDE_TRACE_CODEGEN
-    class TraceCodeGenerator : public CodeGenerator {
-    private:
-        CodeGenerator* mpBase;
+#ifdef PROVIDE_X64_CODEGEN
+
+    /* Holds back each push until the next instruction is known, so that a
+     * push that is popped again straight away turns into a register move,
+     * or into nothing. Anything that reads the PC gets the push emitted
+     * first, so no jump target can fall between the two.
+     */
+    class X64CodeBuf : public ICodeBuf {
+        ICodeBuf* mpBase;
+        int mPendingPush; // The register to push, or -1
+
+        void emitPush() {
+            if (mPendingPush >= 0) {
+                int reg = mPendingPush;
+                mPendingPush = -1;
+                if (reg & 8) {
+                    mpBase->ob(0x41);
+                }
+                mpBase->ob(0x50 + (reg & 7)); // push reg
+            }
+        }
 
     public:
-        TraceCodeGenerator(CodeGenerator* pBase) {
+        X64CodeBuf(ICodeBuf* pBase) {
             mpBase = pBase;
+            mPendingPush = -1;
         }
 
-        virtual ~TraceCodeGenerator() {
+        virtual ~X64CodeBuf() {
             delete mpBase;
         }
 
-        virtual void init(ICodeBuf* pCodeBuf) {
-            mpBase->init(pCodeBuf);
+        void init(int size) {
+            mpBase->init(size);
         }
 
         void setErrorSink(ErrorSink* pErrorSink) {
             mpBase->setErrorSink(pErrorSink);
         }
 
-        /* returns address to patch with local variable size
-        */
-        virtual int functionEntry(Type* pDecl) {
-            int result = mpBase->functionEntry(pDecl);
-            fprintf(stderr, "functionEntry(pDecl) -> %d\n", result);
-            return result;
-        }
-
-        virtual void functionExit(Type* pDecl, int localVariableAddress, int localVariableSize) {
-            fprintf(stderr, "functionExit(pDecl, %d, %d)\n",
-                    localVariableAddress, localVariableSize);
-            mpBase->functionExit(pDecl, localVariableAddress, localVariableSize);
-        }
-
-        /* load immediate value */
-        virtual void li(int t) {
-            fprintf(stderr, "li(%d)\n", t);
-            mpBase->li(t);
-        }
-
-        virtual void loadFloat(int address, Type* pType) {
-            fprintf(stderr, "loadFloat(%d, type=%d)\n", address, pType->tag);
-            mpBase->loadFloat(address, pType);
-        }
-
-        virtual void addStructOffsetR0(int offset, Type* pType) {
-            fprintf(stderr, "addStructOffsetR0(%d, type=%d)\n", offset, pType->tag);
-            mpBase->addStructOffsetR0(offset, pType);
-        }
-
-        virtual int gjmp(int t) {
-            int result = mpBase->gjmp(t);
-            fprintf(stderr, "gjmp(%d) = %d\n", t, result);
-            return result;
-        }
-
-        /* l = 0: je, l == 1: jne */
-        virtual int gtst(bool l, int t) {
-            int result = mpBase->gtst(l, t);
-            fprintf(stderr, "gtst(%d,%d) = %d\n", l, t, result);
-            return result;
-        }
-
-        virtual void gcmp(int op) {
-            fprintf(stderr, "gcmp(%d)\n", op);
-            mpBase->gcmp(op);
+        void o4(int n) {
+            emitPush();
+            mpBase->o4(n);
         }
 
-        virtual void genOp(int op) {
-            fprintf(stderr, "genOp(%d)\n", op);
-            mpBase->genOp(op);
+        void ob(int n) {
+            emitPush();
+            mpBase->ob(n);
         }
 
-
-        virtual void gUnaryCmp(int op) {
-            fprintf(stderr, "gUnaryCmp(%d)\n", op);
-            mpBase->gUnaryCmp(op);
+        void* getBase() {
+            emitPush();
+            return mpBase->getBase();
         }
 
-        virtual void genUnaryOp(int op) {
-            fprintf(stderr, "genUnaryOp(%d)\n", op);
-            mpBase->genUnaryOp(op);
+        intptr_t getSize() {
+            emitPush();
+            return mpBase->getSize();
         }
 
-        virtual void pushR0() {
-            fprintf(stderr, "pushR0()\n");
-            mpBase->pushR0();
+        intptr_t getPC() {
+            emitPush();
+            return mpBase->getPC();
         }
 
-        virtual void over() {
-            fprintf(stderr, "over()\n");
-            mpBase->over();
+        void flush() {
+            emitPush();
+            mpBase->flush();
         }
 
-        virtual void popR0() {
-            fprintf(stderr, "popR0()\n");
-            mpBase->popR0();
+        void rewind(intptr_t pc) {
+            emitPush();
+            mpBase->rewind(pc);
         }
 
-        virtual void storeR0ToTOS() {
-            fprintf(stderr, "storeR0ToTOS()\n");
-            mpBase->storeR0ToTOS();
+        void push(int reg) {
+            emitPush();
+            mPendingPush = reg;
         }
 
-        virtual void loadR0FromR0() {
-            fprintf(stderr, "loadR0FromR0()\n");
-            mpBase->loadR0FromR0();
+        void pop(int reg) {
+            if (mPendingPush < 0) {
+                if (reg & 8) {
+                    mpBase->ob(0x41);
+                }
+                mpBase->ob(0x58 + (reg & 7)); // pop reg
+                return;
+            }
+            // push source; pop reg ==> mov source, reg
+            int source = mPendingPush;
+            mPendingPush = -1;
+            if (source != reg) {
+                mpBase->ob(0x48 | ((source & 8) >> 1) | ((reg & 8) >> 3));
+                mpBase->ob(0x89);
+                mpBase->ob(0xc0 | ((source & 7) << 3) | (reg & 7));
+            }
         }
+    };
 
-        virtual void leaR0(int ea, Type* pPointerType, ExpressionType et) {
-            fprintf(stderr, "leaR0(%d, %d, %d)\n", ea,
-                    pPointerType->pHead->tag, et);
-            mpBase->leaR0(ea, pPointerType, et);
+    /* Code generator for x86-64, using the System V calling convention and
+     * SSE for floating point.
+     *
+     * Rather than keeping the expression stack on the machine stack the way
+     * the x86 code generator does, R0 and each expression stack entry are
+     * described by a Value, which is either held lazily (a constant, an
+     * address, a condition code) or lives in a register. Intermediate
+     * results are allocated from a small pool of caller-saved registers,
+     * in stack order, and only spill to the machine stack when the pool is
+     * exhausted, so most push / op / pop sequences of the abstract machine
+     * turn into a single instruction. Integer and pointer variables whose
+     * address is never taken live in the callee-saved registers.
+     *
+     * The front end keeps code addresses in ints, so the code buffer has to
+     * be mapped into the low 2GB of the address space.
+     */
+    class X64CodeGenerator : public CodeGenerator {
+    public:
+        X64CodeGenerator() {
+            mpCodeBuf = 0;
+            mValues.push_back(regValue(RAX));
+            mPushed = 0;
+            mFrameBase = 0;
+            mSaveSlots = 0;
+            mUsedCalleeSaved = 0;
+            mScopeDepth = 0;
         }
 
-        virtual int leaForward(int ea, Type* pPointerType) {
-            fprintf(stderr, "leaForward(%d)\n", ea);
-            return mpBase->leaForward(ea, pPointerType);
-        }
+        virtual ~X64CodeGenerator() {}
 
-        virtual void convertR0Imp(Type* pType, bool isCast){
-            fprintf(stderr, "convertR0(pType tag=%d, %d)\n",  pType->tag, isCast);
-            mpBase->convertR0Imp(pType, isCast);
+        virtual void init(ICodeBuf* pCodeBuf) {
+            CodeGenerator::init(pCodeBuf);
+            // Compiler::setArchitecture() always gives us an X64CodeBuf.
+            mpCodeBuf = static_cast<X64CodeBuf*>(pCodeBuf);
+            uintptr_t base = (uintptr_t) pCodeBuf->getBase();
+            if (base + ALLOC_SIZE > 0x80000000UL) {
+                error("Could not allocate code below 2GB.");
+            }
         }
 
-        virtual int beginFunctionCallArguments() {
-            int result = mpBase->beginFunctionCallArguments();
-            fprintf(stderr, "beginFunctionCallArguments() = %d\n", result);
+        /* returns address to patch with local variable size
+        */
+        virtual int functionEntry(Type* pDecl) {
+            mPushed = 0;
+            r0() = regValue(RAX);
+            mFrameBase = SAVE_AREA_SIZE + argumentAreaSize(pDecl);
+            ob(0x55); // push %rbp
+            opRR(0, S64, 0x89, RSP, RBP); // mov %rsp, %rbp
+            opRR(0, S64, 0x81, 5, RSP); // sub $xxx, %rsp
+            int result = getPC();
+            o4(0);
+            // Room to save the callee-saved registers we end up using.
+            mSaveSlots = getPC();
+            for (int i = 0; i < CALLEE_SAVED_COUNT; i++) {
+                o4(0x00401f0f); // nopl 0(%rax)
+            }
+            homeArguments(pDecl);
             return result;
         }
 
-        virtual size_t storeR0ToArg(int l, Type* pArgType) {
-            fprintf(stderr, "storeR0ToArg(%d, pArgType=%d)\n", l,
-                    pArgType->tag);
-            return mpBase->storeR0ToArg(l, pArgType);
-        }
-
-        virtual void endFunctionCallArguments(Type* pDecl, int a, int l) {
-            fprintf(stderr, "endFunctionCallArguments(%d, %d)\n", a, l);
-            mpBase->endFunctionCallArguments(pDecl, a, l);
+        virtual void functionExit(Type* pDecl, int localVariableAddress, int localVariableSize) {
+            for (int i = 0; i < CALLEE_SAVED_COUNT; i++) {
+                if (mUsedCalleeSaved & (1 << i)) {
+                    int reg = calleeSavedRegisters[i];
+                    opRM(0, S64, 0x8b, reg, RBP, saveSlotOffset(i)); // mov x(%rbp), reg
+                    // mov reg, x(%rbp)
+                    char* pSlot = (char*) (intptr_t) (mSaveSlots + 4 * i);
+                    pSlot[0] = 0x48 | ((reg & 8) >> 1);
+                    pSlot[1] = 0x89;
+                    pSlot[2] = 0x45 | ((reg & 7) << 3);
+                    pSlot[3] = saveSlotOffset(i);
+                }
+            }
+            ob(0xc9); // leave
+            ob(0xc3); // ret
+            *(int*) (intptr_t) localVariableAddress =
+                    (mFrameBase + localVariableSize + 15) & ~15;
+            mRegisterVariables.clear();
+            mUsedCalleeSaved = 0;
+            mScopeDepth = 0;
         }
 
-        virtual int callForward(int symbol, Type* pFunc) {
-            int result = mpBase->callForward(symbol, pFunc);
-            fprintf(stderr, "callForward(%d) = %d\n", symbol, result);
-            return result;
+        virtual bool allocRegisterVariable(int ea, Type* pType) {
+            switch (pType->tag) {
+                case TY_INT:
+                case TY_SHORT:
+                case TY_CHAR:
+                case TY_POINTER:
+                    break;
+                default:
+                    return false;
+            }
+            for (int i = 0; i < CALLEE_SAVED_COUNT; i++) {
+                int reg = calleeSavedRegisters[i];
+                if (findRegisterVariableByRegister(reg) < 0) {
+                    RegisterVariable variable;
+                    variable.ea = ea;
+                    variable.reg = reg;
+                    variable.depth = mScopeDepth;
+                    mRegisterVariables.push_back(variable);
+                    mUsedCalleeSaved |= 1 << i;
+                    return true;
+                }
+            }
+            return false;
         }
 
-        virtual void callIndirect(int l, Type* pFunc) {
-            fprintf(stderr, "callIndirect(%d returntype = %d)\n", l,
-                    pFunc->pHead->tag);
-            mpBase->callIndirect(l, pFunc);
+        virtual void pushScope() {
+            mScopeDepth++;
         }
 
-        virtual void adjustStackAfterCall(Type* pDecl, int l, bool isIndirect) {
-            fprintf(stderr, "adjustStackAfterCall(pType, %d, %d)\n", l, isIndirect);
-            mpBase->adjustStackAfterCall(pDecl, l, isIndirect);
+        virtual void popScope() {
+            while (mRegisterVariables.size()
+                    && mRegisterVariables.back().depth == mScopeDepth) {
+                mRegisterVariables.pop_back();
+            }
+            mScopeDepth--;
         }
 
-        virtual int jumpOffset() {
-            return mpBase->jumpOffset();
+        /* load immediate value */
+        virtual void li(int i) {
+            r0() = immValue(i);
+            setR0Type(mkpInt);
         }
 
-        /* output a symbol and patch all calls to it */
-        virtual void gsym(int t) {
-            fprintf(stderr, "gsym(%d)\n", t);
-            mpBase->gsym(t);
+        virtual void loadFloat(intptr_t address, Type* pType) {
+            loadFrom(pType->tag, XMM0, absValue(address));
+            r0() = regValue(XMM0);
+            setR0Type(pType);
         }
 
-        virtual void resolveForward(int t) {
-            mpBase->resolveForward(t);
+        virtual void addStructOffsetR0(int offset, Type* pType) {
+            Value& v = r0();
+            switch (v.kind) {
+                case VK_IMM:
+                case VK_LOCAL:
+                case VK_ABS:
+                    v.imm += offset;
+                    break;
+                case VK_REG:
+                    if (offset) {
+                        opRM(0, S64, 0x8d, RAX, v.reg, offset); // lea offset(reg), %rax
+                        v = regValue(RAX);
+                    }
+                    break;
+                default:
+                    error("addStructOffsetR0: unsupported value %d", v.kind);
+                    break;
+            }
+            setR0Type(pType, ET_LVALUE);
         }
 
-        virtual int finishCompile() {
-            int result = mpBase->finishCompile();
-            fprintf(stderr, "finishCompile() = %d\n", result);
-            return result;
+        virtual int gjmp(int t) {
+            if (t >= 0) {
+                // Forward jumps join other code paths at a label, where R0
+                // is expected in %rax or %xmm0.
+                materializeR0();
+            }
+            return psym(0xe9, t);
         }
 
-        /**
-         * Alignment (in bytes) for this type of data
-         */
-        virtual size_t alignmentOf(Type* pType){
-            return mpBase->alignmentOf(pType);
+        /* l = 0: je, l == 1: jne */
+        virtual int gtst(bool l, int t) {
+            Type* pR0Type = getR0Type();
+            Value v = r0();
+            if (v.kind == VK_FLAGS) {
+                // The flags are consumed by the jump.
+                r0() = regValue(RAX);
+                return jcc(l ? v.imm : v.imm ^ 1, t);
+            }
+            if (v.kind == VK_IMM && (v.imm != 0) == l) {
+                return psym(0xe9, t); // jmp xxx
+            }
+            // A test that can never jump still has to return a jump, as
+            // the front end uses that to tell whether && or || was seen,
+            // so that case gets the general treatment.
+
+            if (isFloatType(pR0Type)) {
+                int prefix = floatPrefix(pR0Type->tag) == 0xf2 ? 0x66 : 0;
+                opRR(0, S32, 0x0f57, XMM1, XMM1); // xorps %xmm1, %xmm1
+                opRR(prefix, S32, 0x0f2e, v.reg, XMM1); // ucomis %xmm1, reg
+                if (l) {
+                    // Unordered counts as non-zero.
+                    return jcc(CC_NE, jcc(CC_P, t));
+                }
+                ob(0x7a); // jp .+6
+                ob(0x06);
+                return jcc(CC_E, t);
+            }
+            bool wide = isWide(pR0Type);
+            int reg = operandReg(v, pR0Type, wide, RAX);
+            opRR(0, wide ? S64 : S32, 0x85, reg, reg); // test reg, reg
+            return jcc(l ? CC_NE : CC_E, t);
         }
 
-        /**
-         * Array element alignment (in bytes) for this type of data.
-         */
-        virtual size_t sizeOf(Type* pType){
-            return mpBase->sizeOf(pType);
+        virtual void gcmp(int op) {
+            flushFlags();
+            Type* pR0Type = getR0Type();
+            Type* pTOSType = getTOSType();
+            if (isFloatType(pR0Type) || isFloatType(pTOSType)) {
+                floatCompare(op);
+            } else {
+                intCompare(op);
+            }
+            setR0Type(mkpInt);
         }
 
-        virtual Type* getR0Type() {
+        virtual void genOp(int op) {
+            flushFlags();
+            Type* pR0Type = getR0Type();
+            Type* pTOSType = getTOSType();
+            TypeTag tagR0 = pR0Type->tag;
+            TypeTag tagTOS = pTOSType->tag;
+            bool isFloatR0 = isFloatTag(tagR0);
+            bool isFloatTOS = isFloatTag(tagTOS);
+            if (!isFloatR0 && !isFloatTOS) {
+                bool isPtrR0 = isPointerTag(tagR0);
+                bool isPtrTOS = isPointerTag(tagTOS);
+                if (isPtrR0 || isPtrTOS) {
+                    if (isPtrR0 && isPtrTOS) {
+                        if (op != OP_MINUS) {
+                            error("Unsupported pointer-pointer operation %d.", op);
+                        }
+                        if (! typeEqual(pR0Type, pTOSType)) {
+                            error("Incompatible pointer types for subtraction.");
+                        }
+                        pointerDifference(sizeOf(pR0Type->pHead));
+                        setR0Type(mkpInt);
+                    } else {
+                        if (! (op == OP_PLUS || (op == OP_MINUS && isPtrR0))) {
+                            error("Unsupported pointer-scalar operation %d", op);
+                        }
+                        Type* pPtrType = getPointerArithmeticResultType(
+                                pR0Type, pTOSType);
+                        pointerOffset(op, isPtrR0, sizeOf(pPtrType->pHead));
+                        setR0Type(pPtrType);
+                    }
+                } else {
+                    intOp(op);
+                }
+            } else {
+                Type* pResultType = tagR0 > tagTOS ? pR0Type : pTOSType;
+                int opcode = 0;
+                switch (op) {
+                    case OP_MUL:
+                        opcode = 0x0f59; // muls
+                        break;
+                    case OP_DIV:
+                        opcode = 0x0f5e; // divs
+                        break;
+                    case OP_PLUS:
+                        opcode = 0x0f58; // adds
+                        break;
+                    case OP_MINUS:
+                        opcode = 0x0f5c; // subs
+                        break;
+                    default:
+                        error("Unsupported binary floating operation.");
+                        break;
+                }
+                int reg = setupFloatOperands(pResultType->tag);
+                if (opcode) {
+                    opRR(floatPrefix(pResultType->tag), S32, opcode, reg, XMM0);
+                }
+                if (reg == XMM1) {
+                    opRR(0, S32, 0x0f28, XMM0, XMM1); // movaps %xmm1, %xmm0
+                    reg = XMM0;
+                }
+                popTOS(regValue(reg));
+                setR0Type(pResultType);
+            }
+        }
+
+        virtual void gUnaryCmp(int op) {
+            if (op != OP_LOGICAL_NOT) {
+                error("Unknown unary cmp %d", op);
+            } else {
+                Type* pR0Type = getR0Type();
+                Value& v = r0();
+                TypeTag tag = collapseType(pR0Type->tag);
+                if (v.kind == VK_FLAGS) {
+                    v.imm ^= 1;
+                } else if (v.kind == VK_IMM) {
+                    v.imm = !v.imm;
+                } else if (tag == TY_FLOAT || tag == TY_DOUBLE) {
+                    int prefix = tag == TY_DOUBLE ? 0x66 : 0;
+                    opRR(0, S32, 0x0f57, XMM1, XMM1); // xorps %xmm1, %xmm1
+                    opRR(prefix, S32, 0x0f2e, v.reg, XMM1); // ucomis %xmm1, reg
+                    setcc(CC_E, RAX);
+                    setcc(CC_NP, RCX);
+                    opRR(0, S8, 0x20, RCX, RAX); // and %cl, %al
+                    opRR(0, S32, 0x0fb6, RAX, RAX); // movzbl %al, %eax
+                    v = regValue(RAX);
+                } else {
+                    bool wide = isWide(pR0Type);
+                    int reg = operandReg(v, pR0Type, wide, RAX);
+                    opRR(0, wide ? S64 : S32, 0x85, reg, reg); // test reg, reg
+                    v = flagsValue(CC_E);
+                }
+            }
+            setR0Type(mkpInt);
+        }
+
+        virtual void genUnaryOp(int op) {
+            flushFlags();
+            Type* pR0Type = getR0Type();
+            TypeTag tag = collapseType(pR0Type->tag);
+            Value& v = r0();
+            switch(tag) {
+                case TY_INT:
+                    if (op != OP_MINUS && op != OP_BIT_NOT) {
+                        error("Unknown unary op %d\n", op);
+                    } else if (v.kind == VK_IMM) {
+                        v.imm = op == OP_MINUS ? - v.imm : ~ v.imm;
+                    } else {
+                        loadValue(v, S32, RAX);
+                        // neg %eax / not %eax
+                        opRR(0, S32, 0xf7, op == OP_MINUS ? 3 : 2, RAX);
+                        v = regValue(RAX);
+                    }
+                    break;
+                case TY_FLOAT:
+                case TY_DOUBLE:
+                    switch (op) {
+                        case OP_MINUS:
+                            // Flip the sign bit.
+                            if (tag == TY_FLOAT) {
+                                opRR(0x66, S32, 0x0f7e, v.reg, RAX); // movd reg, %eax
+                                opRR(0, S32, 0x81, 6, RAX); // xor $0x80000000, %eax
+                                o4(0x80000000);
+                                opRR(0x66, S32, 0x0f6e, XMM0, RAX); // movd %eax, %xmm0
+                            } else {
+                                opRR(0x66, S64, 0x0f7e, v.reg, RAX); // movq reg, %rax
+                                opRR(0, S64, 0x0fba, 7, RAX); // btc $63, %rax
+                                ob(63);
+                                opRR(0x66, S64, 0x0f6e, XMM0, RAX); // movq %rax, %xmm0
+                            }
+                            v = regValue(XMM0);
+                            break;
+                        case OP_BIT_NOT:
+                            error("Can't apply '~' operator to a float or double.");
+                            break;
+                        default:
+                            error("Unknown unary op %d\n", op);
+                            break;
+                        }
+                    break;
+                default:
+                    error("genUnaryOp unsupported type");
+                    break;
+            }
+        }
+
+        virtual void pushR0() {
+            flushFlags();
+            Type* pR0Type = getR0Type();
+            Value v = r0();
+            Value entry = v;
+            if (v.kind == VK_REG) {
+                entry = allocEntry(v.reg, pR0Type);
+                entry.isFull = v.isFull;
+            }
+            // Constants and addresses are pushed as they are.
+            r0() = entry;
+            mValues.push_back(v);
+            pushType();
+        }
+
+        virtual void over() {
+            // We know it's only used for int-ptr ops (++/--)
+
+            Type* pR0Type = getR0Type();
+            TypeTag r0ct = collapseType(pR0Type->tag);
+
+            Type* pTOSType = getTOSType();
+            TypeTag tosct = collapseType(pTOSType->tag);
+
+            assert (r0ct == TY_INT && tosct == TY_INT);
+
+            flushFlags();
+            Value y = r0();
+            Value x = tos();
+            if (x.kind == VK_REG || x.kind == VK_SPILL) {
+                loadValue(x, S64, R11);
+                x = regValue(R11);
+            }
+            if (y.kind == VK_REG) {
+                loadValue(y, S64, RAX);
+                y = regValue(RAX);
+            }
+            // R0, TOS -> R0, TOS, R0
+            mValues.pop_back();
+            r0() = y;
+            if (y.kind == VK_REG) {
+                r0() = allocEntry(RAX, pR0Type);
+            }
+            mValues.push_back(x);
+            if (x.kind == VK_REG) {
+                mValues.back() = allocEntry(R11, pTOSType);
+            }
+            mValues.push_back(y);
+            overType();
+        }
+
+        virtual void popR0() {
+            mValues.pop_back();
+            popType();
+            Value& v = r0();
+            if (v.kind == VK_REG || v.kind == VK_SPILL) {
+                if (isFloatType(getR0Type())) {
+                    loadFloatValue(v, getR0Type()->tag, XMM0);
+                    v = regValue(XMM0);
+                } else {
+                    loadValue(v, S64, RAX);
+                    v = regValue(RAX);
+                }
+            }
+        }
+
+        virtual void storeR0ToTOS() {
+            Type* pPointerType = getTOSType();
+            assert(pPointerType->tag == TY_POINTER);
+            Type* pTargetType = pPointerType->pHead;
+            convertR0(pTargetType);
+            TypeTag tag = storageTag(pTargetType);
+            Value& v = r0();
+            Value address = tos();
+            switch (pTargetType->tag) {
+                case TY_POINTER:
+                case TY_INT:
+                case TY_SHORT:
+                case TY_CHAR:
+                    if (address.kind == VK_REGVAR) {
+                        storeToRegisterVariable(tag, address.reg, v);
+                    } else if (v.kind == VK_IMM) {
+                        storeImmTo(tag, v.imm, address);
+                    } else {
+                        int reg = operandReg(v, pTargetType, tag == TY_POINTER, RAX);
+                        storeTo(tag, reg, address);
+                        v = regValue(reg);
+                    }
+                    break;
+                case TY_FLOAT:
+                case TY_DOUBLE:
+                    storeTo(tag, v.reg, address);
+                    break;
+                case TY_STRUCT:
+                {
+                    int size = sizeOf(pTargetType);
+                    int source = operandReg(v, pTargetType, true, RAX);
+                    int dest = address.kind == VK_REG ? address.reg : RCX;
+                    loadValue(address, S64, dest);
+                    for (int offset = 0; offset < size; ) {
+                        int chunk = size - offset >= 8 ? 8
+                                : size - offset >= 4 ? 4
+                                : size - offset >= 2 ? 2 : 1;
+                        copyChunk(chunk, source, dest, offset);
+                        offset += chunk;
+                    }
+                }
+                    break;
+                default:
+                    error("storeR0ToTOS: unsupported type %d",
+                            pTargetType->tag);
+                    break;
+            }
+            popTOS(r0());
+            setR0Type(pTargetType);
+        }
+
+        virtual void loadR0FromR0() {
+            Type* pPointerType = getR0Type();
+            assert(pPointerType->tag == TY_POINTER);
+            Type* pNewType = pPointerType->pHead;
+            TypeTag tag = pNewType->tag;
+            Value& v = r0();
+            switch (tag) {
+                case TY_POINTER:
+                case TY_INT:
+                case TY_SHORT:
+                case TY_CHAR:
+                    if (v.kind == VK_REGVAR) {
+                        v = regValue(v.reg);
+                    } else {
+                        loadFrom(tag, RAX, v);
+                        v = regValue(RAX);
+                    }
+                    break;
+                case TY_FLOAT:
+                case TY_DOUBLE:
+                    loadFrom(tag, XMM0, v);
+                    v = regValue(XMM0);
+                    break;
+                case TY_ARRAY:
+                    pNewType = pNewType->pTail;
+                    break;
+                case TY_STRUCT:
+                    break;
+                default:
+                    error("loadR0FromR0: unsupported type %d", tag);
+                    break;
+            }
+            setR0Type(pNewType);
+        }
+
+        virtual void leaR0(intptr_t ea, Type* pPointerType, ExpressionType et) {
+            if (ea > -LOCAL && ea < LOCAL) {
+                int i = findRegisterVariable(ea);
+                if (i >= 0) {
+                    r0() = makeValue(VK_REGVAR, mRegisterVariables[i].reg, 0);
+                } else {
+                    r0() = makeValue(VK_LOCAL, RBP, frameOffset(ea));
+                }
+            } else {
+                r0() = absValue(ea);
+            }
+            setR0Type(pPointerType, et);
+        }
+
+        virtual intptr_t leaForward(intptr_t ea, Type* pPointerType) {
+            ob(0xb8); // mov $xx, %eax
+            intptr_t result = getPC();
+            o4(ea);
+            r0() = regValue(RAX);
+            setR0Type(pPointerType);
+            return result;
+        }
+
+        virtual void convertR0Imp(Type* pType, bool isCast){
+            Type* pR0Type = getR0Type();
+            if (pR0Type == NULL) {
+                assert(false);
+                setR0Type(pType);
+                return;
+            }
+            flushFlags();
+            Value& v = r0();
+            if (isPointerType(pType) && isPointerType(pR0Type)) {
+                Type* pA = pR0Type;
+                Type* pB = pType;
+                // Array decays to pointer
+                if (pA->tag == TY_ARRAY && pB->tag == TY_POINTER) {
+                    pA = pA->pTail;
+                }
+                if (! (typeEqual(pA, pB)
+                        || pB->pHead->tag == TY_VOID
+                        || (pA->tag == TY_POINTER && pB->tag == TY_POINTER && isCast)
+                    )) {
+                    error("Incompatible pointer or array types");
+                }
+            } else if (bitsSame(pType, pR0Type)) {
+                if (isWide(pType) && ! isWide(pR0Type) && v.kind != VK_IMM) {
+                    // Sign extend int to pointer.
+                    int reg = operandReg(v, pR0Type, true, RAX);
+                    v = regValue(reg);
+                } else if (! isWide(pType) && isWide(pR0Type)
+                        && v.kind != VK_IMM) {
+                    // Pointer to int. Scripts expect to get the pointer
+                    // back from the int, so trap if it is not in the low
+                    // 2GB rather than silently lose the top half.
+                    int reg = operandReg(v, pR0Type, true, RAX);
+                    opRR(0, S64, 0x63, R11, reg); // movslq reg, %r11
+                    opRR(0, S64, 0x39, reg, R11); // cmp reg, %r11
+                    ob(0x74); // je 1f
+                    ob(2);
+                    ob(0x0f); // ud2
+                    ob(0x0b);
+                    v = regValue(reg); // 1:
+                }
+            } else if (isFloatType(pType) && isFloatType(pR0Type)) {
+                if (pType->tag != pR0Type->tag) {
+                    // cvtss2sd / cvtsd2ss reg, %xmm0
+                    opRR(floatPrefix(pR0Type->tag), S32, 0x0f5a, XMM0, v.reg);
+                    v = regValue(XMM0);
+                }
+            } else {
+                TypeTag r0Tag = collapseType(pR0Type->tag);
+                TypeTag destTag = collapseType(pType->tag);
+                if (r0Tag == TY_INT && isFloatTag(destTag)) {
+                    // cvtsi2ss / cvtsi2sd reg, %xmm0
+                    int reg = operandReg(v, pR0Type, false, RAX);
+                    opRR(floatPrefix(destTag), S32, 0x0f2a, XMM0, reg);
+                    v = regValue(XMM0);
+                } else if (isFloatTag(r0Tag) && destTag == TY_INT) {
+                    // cvttss2si / cvttsd2si reg, %eax
+                    opRR(floatPrefix(r0Tag), S32, 0x0f2c, RAX, v.reg);
+                    v = regValue(RAX);
+                } else {
+                    error("Incompatible types old: %d new: %d",
+                          pR0Type->tag, pType->tag);
+                }
+            }
+            setR0Type(pType);
+        }
+
+        virtual int beginFunctionCallArguments() {
+            flushFlags();
+            CallInfo call;
+            call.argStart = mArgClasses.size();
+            call.savedInt = 0;
+            call.savedFloat = 0;
+            call.padding = 0;
+            call.area = 0;
+            // The function pointer is TOS and is taken care of separately.
+            // Save the other live pool registers.
+            size_t function = mValues.size() - 2;
+            for (size_t i = 0; i < function; i++) {
+                const Value& v = mValues[i];
+                if (v.kind == VK_REG) {
+                    if (v.isFloat) {
+                        call.savedFloat |= 1 << v.reg;
+                    } else {
+                        call.savedInt |= 1 << v.reg;
+                    }
+                }
+            }
+            for (int reg = 0; reg < 16; reg++) {
+                if (call.savedInt & (1 << reg)) {
+                    pushReg(reg);
+                }
+            }
+            for (int reg = 0; reg < 16; reg++) {
+                if (call.savedFloat & (1 << reg)) {
+                    adjustStack(-8);
+                    opRM(0xf2, S32, 0x0f11, reg, RSP, 0); // movsd reg, (%rsp)
+                    mPushed += 8;
+                }
+            }
+            // Keep the stack 16-byte aligned at the call.
+            if (mPushed & 15) {
+                adjustStack(-8);
+                mPushed += 8;
+                call.padding = 8;
+            }
+            call.functionSpilled = mValues[function].kind == VK_SPILL;
+            mCalls.push_back(call);
+            opRR(0, S64, 0x81, 5, RSP); // sub $xxx, %rsp
+            int result = getPC();
+            o4(0);
+            return result;
+        }
+
+        virtual size_t storeR0ToArg(int l, Type* pArgType) {
+            convertR0(pArgType);
+            Type* pR0Type = getR0Type();
+            TypeTag tag = storageTag(pR0Type);
+            Value& v = r0();
+            Value slot = makeValue(VK_LOCAL, RSP, l);
+            switch (tag) {
+                case TY_INT:
+                case TY_SHORT:
+                case TY_CHAR:
+                case TY_POINTER:
+                    // Sign extend ints, so that functions declared
+                    // implicitly can still be passed a size_t or a long.
+                    if (v.kind == VK_IMM) {
+                        storeImmTo(TY_POINTER, v.imm, slot);
+                    } else {
+                        int reg = operandReg(v, pR0Type, true, RAX);
+                        storeTo(TY_POINTER, reg, slot);
+                    }
+                    mArgClasses.push_back(ARG_INT);
+                    break;
+                case TY_FLOAT:
+                case TY_DOUBLE:
+                    storeTo(tag, v.reg, slot);
+                    mArgClasses.push_back(tag == TY_FLOAT ? ARG_FLOAT : ARG_DOUBLE);
+                    break;
+                default:
+                    error("storeR0ToArg: unsupported type %d", pR0Type->tag);
+                    break;
+            }
+            return 8;
+        }
+
+        virtual void endFunctionCallArguments(Type* pDecl, int a, int l) {
+            CallInfo& call = mCalls.back();
+            call.area = (l + 15) & ~15;
+            * (int*) (intptr_t) a = call.area;
+
+            // Move the function pointer out of the way of the arguments.
+            Value function = tos();
+            if (function.kind == VK_SPILL) {
+                // mov xxx(%rsp), %r11
+                opRM(0, S64, 0x8b, R11, RSP,
+                        call.area + mPushed - (int) function.imm);
+            } else if (function.kind != VK_ABS) {
+                loadValue(function, S64, R11);
+            }
+
+            // The first arguments of each class go in registers, the rest
+            // are packed at the bottom of the argument area.
+            int argCount = l / 8;
+            int intCount = 0;
+            int floatCount = 0;
+            for (int i = 0; i < argCount; i++) {
+                int argClass = mArgClasses[call.argStart + i];
+                if (argClass == ARG_INT) {
+                    if (intCount < INT_ARG_REGISTERS) {
+                        // mov xxx(%rsp), reg
+                        opRM(0, S64, 0x8b, argumentRegisters[intCount++],
+                                RSP, i * 8);
+                    }
+                } else if (floatCount < FLOAT_ARG_REGISTERS) {
+                    loadFrom(argClass == ARG_FLOAT ? TY_FLOAT : TY_DOUBLE,
+                            XMM0 + floatCount++, makeValue(VK_LOCAL, RSP, i * 8));
+                }
+            }
+            int stackCount = 0;
+            intCount = 0;
+            floatCount = 0;
+            for (int i = 0; i < argCount; i++) {
+                int argClass = mArgClasses[call.argStart + i];
+                bool inRegister = argClass == ARG_INT
+                        ? intCount++ < INT_ARG_REGISTERS
+                        : floatCount++ < FLOAT_ARG_REGISTERS;
+                if (! inRegister) {
+                    if (i != stackCount) {
+                        opRM(0, S64, 0x8b, RAX, RSP, i * 8); // mov xxx(%rsp), %rax
+                        opRM(0, S64, 0x89, RAX, RSP, stackCount * 8); // mov %rax, xxx(%rsp)
+                    }
+                    stackCount++;
+                }
+            }
+            while (mArgClasses.size() > call.argStart) {
+                mArgClasses.pop_back();
+            }
+            // Variadic functions want the number of vector registers used.
+            if (floatCount > FLOAT_ARG_REGISTERS) {
+                floatCount = FLOAT_ARG_REGISTERS;
+            }
+            movImm(S32, RAX, floatCount);
+        }
+
+        virtual int callForward(int symbol, Type* pFunc) {
+            assert(pFunc->tag == TY_FUNC);
+            setCallResult(pFunc->pHead);
+            return psym(0xe8, symbol); /* call xxx */
+        }
+
+        virtual void callIndirect(int l, Type* pFunc) {
+            assert(pFunc->tag == TY_FUNC);
+            Value function = tos();
+            if (function.kind == VK_ABS && isReachable(function.imm)) {
+                ob(0xe8); // call xxx
+                o4(function.imm - (getPC() + 4));
+            } else {
+                if (function.kind == VK_ABS) {
+                    movImm(S64, R11, function.imm);
+                }
+                opRR(0, S32, 0xff, 2, R11); // call *%r11
+            }
+            mValues.pop_back();
+            popType(); // Get rid of indirect fn pointer type
+            Type* pReturnType = pFunc->pHead;
+            setCallResult(pReturnType);
+            // Only the low bits of a char or short result are defined.
+            if (pReturnType->tag == TY_CHAR) {
+                opRR(0, S32, 0x0fbe, RAX, RAX); // movsbl %al, %eax
+            } else if (pReturnType->tag == TY_SHORT) {
+                opRR(0, S32, 0x0fbf, RAX, RAX); // movswl %ax, %eax
+            }
+        }
+
+        /* R0 is the value returned by a call. Functions that are declared
+         * implicitly, such as malloc(), are typed as returning int, so the
+         * whole of %rax is kept in case the result is made a pointer.
+         */
+        void setCallResult(Type* pReturnType) {
+            r0() = regValue(isFloatType(pReturnType) ? XMM0 : RAX);
+            r0().isFull = pReturnType->tag == TY_INT;
+            setR0Type(pReturnType);
+        }
+
+        virtual void adjustStackAfterCall(Type* pDecl, int l, bool isIndirect) {
+            assert(pDecl->tag == TY_FUNC);
+            CallInfo call = mCalls.back();
+            mCalls.pop_back();
+            adjustStack(call.area + call.padding);
+            mPushed -= call.padding;
+            for (int reg = 15; reg >= 0; reg--) {
+                if (call.savedFloat & (1 << reg)) {
+                    opRM(0xf2, S32, 0x0f10, reg, RSP, 0); // movsd (%rsp), reg
+                    adjustStack(8);
+                    mPushed -= 8;
+                }
+            }
+            for (int reg = 15; reg >= 0; reg--) {
+                if (call.savedInt & (1 << reg)) {
+                    popReg(reg);
+                }
+            }
+            if (call.functionSpilled) {
+                adjustStack(8);
+                mPushed -= 8;
+            }
+        }
+
+        virtual int jumpOffset() {
+            return 5;
+        }
+
+        /* output a symbol and patch all calls to it */
+        virtual void gsym(int t) {
+            if (t) {
+                // Other code paths join here with R0 in %rax or %xmm0.
+                materializeR0();
+            }
+            int n;
+            int pc = getPC();
+            while (t) {
+                n = *(int *) (intptr_t) t; /* next value */
+                *(int *) (intptr_t) t = pc - t - 4;
+                t = n;
+            }
+        }
+
+        /* output a symbol and patch all calls to it, using absolute address */
+        virtual void resolveForward(intptr_t t) {
+            int pc = getPC();
+            while (t) {
+                // The links live in the code's 4-byte immediates.
+                intptr_t n = *(int *) t; /* next value */
+                *(int *) t = pc;
+                t = n;
+            }
+        }
+
+        virtual int finishCompile() {
+            size_t pagesize = 4096;
+            size_t base = (size_t) getBase() & ~ (pagesize - 1);
+            size_t top =  ((size_t) getPC() + pagesize - 1) & ~ (pagesize - 1);
+            int err = mprotect((void*) base, top - base, PROT_READ | PROT_WRITE | PROT_EXEC);
+            if (err) {
+               error("mprotect() failed: %d", errno);
+            }
+            return err;
+        }
+
+        /**
+         * Alignment (in bytes) for this type of data
+         */
+        virtual size_t alignmentOf(Type* pType){
+            switch (pType->tag) {
+            case TY_CHAR:
+                return 1;
+            case TY_SHORT:
+                return 2;
+            case TY_DOUBLE:
+            case TY_POINTER:
+                return 8;
+            case TY_ARRAY:
+                return alignmentOf(pType->pHead);
+            case TY_STRUCT:
+                return pType->pHead->alignment & 0x7fffffff;
+            case TY_FUNC:
+                error("alignment of func not supported");
+                return 1;
+            default:
+                return 4;
+            }
+        }
+
+        /**
+         * Array element alignment (in bytes) for this type of data.
+         */
+        virtual size_t sizeOf(Type* pType){
+            switch(pType->tag) {
+                case TY_INT:
+                    return 4;
+                case TY_SHORT:
+                    return 2;
+                case TY_CHAR:
+                    return 1;
+                case TY_FLOAT:
+                    return 4;
+                case TY_DOUBLE:
+                    return 8;
+                case TY_POINTER:
+                    return 8;
+                case TY_ARRAY:
+                    return pType->length * sizeOf(pType->pHead);
+                case TY_STRUCT:
+                    return pType->pHead->length;
+                default:
+                    error("Unsupported type %d", pType->tag);
+                    return 0;
+            }
+        }
+
+    private:
+
+        // General purpose and SSE registers share numbers.
+        enum {
+            RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+            R8, R9, R10, R11, R12, R13, R14, R15,
+            XMM0 = 0, XMM1 = 1, XMM8 = 8
+        };
+
+        // Operand sizes
+        enum {
+            S8, S16, S32, S64
+        };
+
+        // Condition codes
+        enum {
+            CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7,
+            CC_P = 0xa, CC_NP = 0xb, CC_L = 0xc, CC_GE = 0xd, CC_LE = 0xe,
+            CC_G = 0xf
+        };
+
+        enum ValueKind {
+            VK_REG,     // In register reg
+            VK_IMM,     // The constant imm
+            VK_LOCAL,   // The address reg + imm
+            VK_ABS,     // The absolute address imm
+            VK_REGVAR,  // The address of the register variable in reg
+            VK_FLAGS,   // The result of a comparison, true if condition imm
+            VK_SPILL    // On the machine stack, mPushed was imm after the push
+        };
+
+        struct Value {
+            int kind;
+            int reg;
+            intptr_t imm;
+            bool isFloat;
+            bool isFull;    // An int whose upper 32 bits are meaningful too
+        };
+
+        enum {
+            ARG_INT, ARG_FLOAT, ARG_DOUBLE
+        };
+
+        struct CallInfo {
+            size_t argStart;
+            int savedInt;
+            int savedFloat;
+            int padding;
+            int area;
+            bool functionSpilled;
+        };
+
+        struct RegisterVariable {
+            int ea;
+            int reg;
+            int depth;
+        };
+
+        static const int INT_POOL_SIZE = 5;
+        static const int FLOAT_POOL_SIZE = 8;
+        static const int CALLEE_SAVED_COUNT = 5;
+        static const int SAVE_AREA_SIZE = 8 * CALLEE_SAVED_COUNT;
+        static const int INT_ARG_REGISTERS = 6;
+        static const int FLOAT_ARG_REGISTERS = 8;
+
+        static const int intPoolRegisters[];
+        static const int calleeSavedRegisters[];
+        static const int argumentRegisters[];
+
+        Value makeValue(int kind, int reg, intptr_t imm) {
+            Value v;
+            v.kind = kind;
+            v.reg = reg;
+            v.imm = imm;
+            v.isFloat = false;
+            v.isFull = false;
+            return v;
+        }
+
+        Value regValue(int reg) {
+            return makeValue(VK_REG, reg, 0);
+        }
+
+        Value immValue(intptr_t imm) {
+            return makeValue(VK_IMM, 0, imm);
+        }
+
+        Value absValue(intptr_t address) {
+            return makeValue(VK_ABS, 0, address);
+        }
+
+        Value flagsValue(int cc) {
+            return makeValue(VK_FLAGS, 0, cc);
+        }
+
+        Value& r0() {
+            return mValues.back();
+        }
+
+        Value& tos() {
+            return mValues[mValues.size() - 2];
+        }
+
+        /* Pop TOS, leaving result in R0. */
+        void popTOS(Value result) {
+            mValues.pop_back();
+            r0() = result;
+            popType();
+        }
+
+        static bool isWide(Type* pType) {
+            switch (pType->tag) {
+                case TY_POINTER:
+                case TY_ARRAY:
+                case TY_STRUCT:
+                case TY_FUNC:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        /* The type used to load or store a value of type pType. */
+        TypeTag storageTag(Type* pType) {
+            if (isWide(pType)) {
+                return TY_POINTER;
+            }
+            return pType->tag;
+        }
+
+        static int floatPrefix(TypeTag tag) {
+            return tag == TY_FLOAT ? 0xf3 : 0xf2;
+        }
+
+        Type* passingType(Type* pType) {
+            switch (pType->tag) {
+            case TY_CHAR:
+            case TY_SHORT:
+                return mkpInt;
+            default:
+                return pType;
+            }
+        }
+
+        /* The front end lays out the arguments at positive offsets starting
+         * at 8 and the locals at negative offsets. The arguments arrive in
+         * registers, so we copy them to a home area below the callee-saved
+         * registers, and put the locals below that.
+         */
+        int argumentAreaSize(Type* pDecl) {
+            size_t a = 8;
+            for (Type* pP = pDecl->pTail; pP; pP = pP->pTail) {
+                Type* pPassingType = passingType(pP->pHead);
+                size_t alignment = alignmentOf(pPassingType);
+                a = (a + alignment - 1) & ~ (alignment-1);
+                a = a + sizeOf(pPassingType);
+            }
+            return (a - 8 + 7) & ~7;
+        }
+
+        int frameOffset(int ea) {
+            if (ea > 0) {
+                return ea - 8 - mFrameBase;
+            }
+            return ea - mFrameBase;
+        }
+
+        static int saveSlotOffset(int i) {
+            return -8 * (i + 1);
+        }
+
+        void homeArguments(Type* pDecl) {
+            size_t a = 8;
+            int intCount = 0;
+            int floatCount = 0;
+            int stackCount = 0;
+            for (Type* pP = pDecl->pTail; pP; pP = pP->pTail) {
+                Type* pArg = pP->pHead;
+                Type* pPassingType = passingType(pArg);
+                size_t alignment = alignmentOf(pPassingType);
+                a = (a + alignment - 1) & ~ (alignment-1);
+                TypeTag tag = storageTag(pPassingType);
+                bool isFloat = isFloatTag(tag);
+                int reg;
+                if (isFloat ? floatCount < FLOAT_ARG_REGISTERS
+                        : intCount < INT_ARG_REGISTERS) {
+                    reg = isFloat ? XMM0 + floatCount++
+                            : argumentRegisters[intCount++];
+                } else {
+                    // The rest were passed on the stack, above the return
+                    // address.
+                    reg = isFloat ? XMM1 : RAX;
+                    loadFrom(tag, reg,
+                            makeValue(VK_LOCAL, RBP, 16 + 8 * stackCount++));
+                }
+                int i = findRegisterVariable(a);
+                if (i >= 0) {
+                    storeToRegisterVariable(pArg->tag,
+                            mRegisterVariables[i].reg, regValue(reg));
+                } else {
+                    storeTo(tag, reg, makeValue(VK_LOCAL, RBP, frameOffset(a)));
+                }
+                a = a + sizeOf(pPassingType);
+            }
+        }
+
+        int findRegisterVariable(int ea) {
+            for (size_t i = 0; i < mRegisterVariables.size(); i++) {
+                if (mRegisterVariables[i].ea == ea) {
+                    return i;
+                }
+            }
+            return -1;
+        }
+
+        int findRegisterVariableByRegister(int reg) {
+            for (size_t i = 0; i < mRegisterVariables.size(); i++) {
+                if (mRegisterVariables[i].reg == reg) {
+                    return i;
+                }
+            }
+            return -1;
+        }
+
+        void storeToRegisterVariable(TypeTag tag, int dest, const Value& v) {
+            if (v.kind == VK_IMM) {
+                intptr_t imm = v.imm;
+                if (tag == TY_CHAR) {
+                    imm = (signed char) imm;
+                } else if (tag == TY_SHORT) {
+                    imm = (short) imm;
+                }
+                movImm(tag == TY_POINTER ? S64 : S32, dest, imm);
+                return;
+            }
+            int source = operandReg(v, NULL, tag == TY_POINTER, RAX);
+            switch (tag) {
+                case TY_CHAR:
+                    opRR(0, S8, 0x0fbe, dest, source); // movsbl source, dest
+                    break;
+                case TY_SHORT:
+                    opRR(0, S32, 0x0fbf, dest, source); // movswl source, dest
+                    break;
+                case TY_POINTER:
+                    movRR(S64, dest, source);
+                    break;
+                default:
+                    movRR(S32, dest, source);
+                    break;
+            }
+            r0() = regValue(dest);
+        }
+
+        /* Move the value in reg to a new expression stack entry. */
+        Value allocEntry(int reg, Type* pType) {
+            bool isFloat = isFloatType(pType);
+            int count = 0;
+            for (size_t i = 0; i + 1 < mValues.size(); i++) {
+                if (mValues[i].kind == VK_REG && mValues[i].isFloat == isFloat) {
+                    count++;
+                }
+            }
+            Value entry;
+            if (isFloat) {
+                if (count < FLOAT_POOL_SIZE) {
+                    entry = regValue(XMM8 + count);
+                    if (entry.reg != reg) {
+                        opRR(0, S32, 0x0f28, entry.reg, reg); // movaps reg, entry
+                    }
+                } else {
+                    adjustStack(-8);
+                    opRM(0xf2, S32, 0x0f11, reg, RSP, 0); // movsd reg, (%rsp)
+                    mPushed += 8;
+                    entry = makeValue(VK_SPILL, 0, mPushed);
+                }
+            } else {
+                if (count < INT_POOL_SIZE) {
+                    entry = regValue(intPoolRegisters[count]);
+                    movRR(S64, entry.reg, reg);
+                } else {
+                    pushReg(reg);
+                    entry = makeValue(VK_SPILL, 0, mPushed);
+                }
+            }
+            entry.isFloat = isFloat;
+            return entry;
+        }
+
+        /* Turn a pending comparison into 0 or 1 in %eax. */
+        void flushFlags() {
+            Value& v = r0();
+            if (v.kind == VK_FLAGS) {
+                loadValue(v, S32, RAX);
+                v = regValue(RAX);
+            }
+        }
+
+        /* Put R0 in %rax or %xmm0. */
+        void materializeR0() {
+            Type* pR0Type = getR0Type();
+            Value& v = r0();
+            if (pR0Type == NULL || v.kind == VK_REGVAR) {
+                return;
+            }
+            if (isFloatType(pR0Type)) {
+                loadFloatValue(v, pR0Type->tag, XMM0);
+                v = regValue(XMM0);
+            } else {
+                loadValue(v, isWide(pR0Type) ? S64 : S32, RAX);
+                v = regValue(RAX);
+            }
+        }
+
+        /* Load an integer or pointer value into dest. */
+        void loadValue(const Value& v, int size, int dest) {
+            switch (v.kind) {
+                case VK_REG:
+                    movRR(size, dest, v.reg);
+                    break;
+                case VK_IMM:
+                    movImm(size, dest, v.imm);
+                    break;
+                case VK_LOCAL:
+                    opRM(0, S64, 0x8d, dest, v.reg, v.imm); // lea xxx(reg), dest
+                    break;
+                case VK_ABS:
+                    if ((uintptr_t) v.imm > 0xffffffffUL && isReachable(v.imm)) {
+                        opRip(0, S64, 0x8d, dest, v.imm, 0); // lea xxx(%rip), dest
+                    } else {
+                        movImm(S64, dest, v.imm);
+                    }
+                    break;
+                case VK_FLAGS:
+                    setcc(v.imm, dest);
+                    opRR(0, S8, 0x0fb6, dest, dest); // movzbl dest, dest
+                    break;
+                case VK_SPILL:
+                    assert(v.imm == mPushed);
+                    popReg(dest);
+                    break;
+                default:
+                    error("Can't take the address of a register variable.");
+                    break;
+            }
+        }
+
+        void loadFloatValue(const Value& v, TypeTag tag, int dest) {
+            if (v.kind == VK_SPILL) {
+                assert(v.imm == mPushed);
+                loadFrom(tag, dest, makeValue(VK_LOCAL, RSP, 0));
+                adjustStack(8);
+                mPushed -= 8;
+            } else if (v.reg != dest) {
+                opRR(0, S32, 0x0f28, dest, v.reg); // movaps v, dest
+            }
+        }
+
+        /* Return a register holding v, using scratch if needed. wide means
+         * a 64-bit value is wanted, so ints are sign extended.
+         */
+        int operandReg(const Value& v, Type* pType, bool wide, int scratch) {
+            bool extend = wide && pType && ! isWide(pType) && ! v.isFull;
+            if (v.kind == VK_REG) {
+                if (! extend) {
+                    return v.reg;
+                }
+                opRR(0, S64, 0x63, scratch, v.reg); // movslq v, scratch
+                return scratch;
+            }
+            loadValue(v, wide ? S64 : S32, scratch);
+            if (extend && v.kind == VK_SPILL) {
+                opRR(0, S64, 0x63, scratch, scratch); // movslq scratch, scratch
+            }
+            return scratch;
+        }
+
+        void intCompare(int op) {
+            Type* pLeftType = getTOSType();
+            Type* pRightType = getR0Type();
+            Value l = tos();
+            Value r = r0();
+            bool wide = isWide(pLeftType) || isWide(pRightType);
+            int cc;
+            switch (op) {
+                case OP_LESS: cc = CC_L; break;
+                case OP_LESS_EQUAL: cc = CC_LE; break;
+                case OP_GREATER: cc = CC_G; break;
+                case OP_GREATER_EQUAL: cc = CC_GE; break;
+                case OP_EQUALS: cc = CC_E; break;
+                case OP_NOT_EQUALS: cc = CC_NE; break;
+                default:
+                    error("Unknown comparison op %d", op);
+                    cc = CC_E;
+                    break;
+            }
+            if (l.kind == VK_IMM && r.kind != VK_IMM) {
+                // Compare the other way around, so the constant can be an
+                // immediate operand.
+                Value v = l;
+                l = r;
+                r = v;
+                Type* pType = pLeftType;
+                pLeftType = pRightType;
+                pRightType = pType;
+                switch (cc) {
+                    case CC_L: cc = CC_G; break;
+                    case CC_LE: cc = CC_GE; break;
+                    case CC_G: cc = CC_L; break;
+                    case CC_GE: cc = CC_LE; break;
+                }
+            }
+            int size = wide ? S64 : S32;
+            if (r.kind == VK_IMM && r.imm == (int) r.imm) {
+                int left = operandReg(l, pLeftType, wide, RCX);
+                aluImm(size, 7, left, r.imm); // cmp $xxx, left
+            } else {
+                int right = operandReg(r, pRightType, wide, RAX);
+                int left = operandReg(l, pLeftType, wide, RCX);
+                opRR(0, size, 0x39, right, left); // cmp right, left
+            }
+            popTOS(flagsValue(cc));
+        }
+
+        void floatCompare(int op) {
+            Type* pR0Type = getR0Type();
+            Type* pTOSType = getTOSType();
+            TypeTag tag = pR0Type->tag > pTOSType->tag
+                    ? pR0Type->tag : pTOSType->tag;
+            int prefix = tag == TY_DOUBLE ? 0x66 : 0;
+            int left = setupFloatOperands(tag);
+            Value result;
+            switch (op) {
+                case OP_EQUALS:
+                case OP_NOT_EQUALS:
+                    opRR(prefix, S32, 0x0f2e, left, XMM0); // ucomis %xmm0, left
+                    if (op == OP_EQUALS) {
+                        setcc(CC_E, RAX);
+                        setcc(CC_NP, RCX);
+                        opRR(0, S8, 0x20, RCX, RAX); // and %cl, %al
+                    } else {
+                        setcc(CC_NE, RAX);
+                        setcc(CC_P, RCX);
+                        opRR(0, S8, 0x08, RCX, RAX); // or %cl, %al
+                    }
+                    opRR(0, S32, 0x0fb6, RAX, RAX); // movzbl %al, %eax
+                    result = regValue(RAX);
+                    break;
+                case OP_GREATER:
+                case OP_GREATER_EQUAL:
+                    opRR(prefix, S32, 0x0f2e, left, XMM0); // ucomis %xmm0, left
+                    result = flagsValue(op == OP_GREATER ? CC_A : CC_AE);
+                    break;
+                case OP_LESS:
+                case OP_LESS_EQUAL:
+                    opRR(prefix, S32, 0x0f2e, XMM0, left); // ucomis left, %xmm0
+                    result = flagsValue(op == OP_LESS ? CC_A : CC_AE);
+                    break;
+                default:
+                    error("Unknown comparison op");
+                    result = regValue(RAX);
+                    break;
+            }
+            popTOS(result);
+        }
+
+        /* Convert the operands of a floating point operation to tag. R0,
+         * the right hand side, ends up in %xmm0. Returns the register
+         * holding TOS, the left hand side, which may be overwritten.
+         */
+        int setupFloatOperands(TypeTag tag) {
+            Type* pR0Type = getR0Type();
+            Type* pTOSType = getTOSType();
+            Value r = r0();
+            Value l = tos();
+            convertToFloat(r, pR0Type, tag, XMM0);
+            int left = l.kind == VK_REG && isFloatType(pTOSType) ? l.reg : XMM1;
+            convertToFloat(l, pTOSType, tag, left);
+            return left;
+        }
+
+        void convertToFloat(const Value& v, Type* pType, TypeTag tag, int dest) {
+            if (isFloatType(pType)) {
+                int source = dest;
+                if (v.kind == VK_REG) {
+                    source = v.reg;
+                } else {
+                    loadFloatValue(v, pType->tag, dest);
+                }
+                if (pType->tag != tag) {
+                    // cvtss2sd / cvtsd2ss source, dest
+                    opRR(floatPrefix(pType->tag), S32, 0x0f5a, dest, source);
+                } else if (source != dest) {
+                    opRR(0, S32, 0x0f28, dest, source); // movaps source, dest
+                }
+            } else {
+                int source = operandReg(v, pType, false, RCX);
+                // cvtsi2ss / cvtsi2sd source, dest
+                opRR(floatPrefix(tag), S32, 0x0f2a, dest, source);
+            }
+        }
+
+        void intOp(int op) {
+            Value l = tos();
+            Value r = r0();
+            int dest;
+            switch (op) {
+                case OP_DIV:
+                case OP_MOD: {
+                    int divisor = RCX;
+                    if (r.kind == VK_REG && r.reg != RAX && r.reg != RDX) {
+                        divisor = r.reg;
+                    } else {
+                        loadValue(r, S32, RCX);
+                    }
+                    loadValue(l, S32, RAX);
+                    ob(0x99); // cltd
+                    opRR(0, S32, 0xf7, 7, divisor); // idiv divisor
+                    if (op == OP_MOD) {
+                        movRR(S32, RAX, RDX);
+                    }
+                    dest = RAX;
+                    break;
+                }
+                case OP_SHIFT_LEFT:
+                case OP_SHIFT_RIGHT: {
+                    int ext = op == OP_SHIFT_LEFT ? 4 : 7;
+                    if (r.kind != VK_IMM) {
+                        loadValue(r, S32, RCX);
+                    }
+                    dest = l.kind == VK_REG ? l.reg : RAX;
+                    loadValue(l, S32, dest);
+                    if (r.kind == VK_IMM) {
+                        opRR(0, S32, 0xc1, ext, dest); // shl/sar $xx, dest
+                        ob(r.imm & 31);
+                    } else {
+                        opRR(0, S32, 0xd3, ext, dest); // shl/sar %cl, dest
+                    }
+                    break;
+                }
+                case OP_PLUS:
+                case OP_MINUS:
+                case OP_MUL:
+                case OP_BIT_AND:
+                case OP_BIT_XOR:
+                case OP_BIT_OR: {
+                    bool useImm = r.kind == VK_IMM && r.imm == (int) r.imm;
+                    if (! useImm && r.kind != VK_REG) {
+                        loadValue(r, S32, RAX);
+                        r = regValue(RAX);
+                    }
+                    if (l.kind == VK_REG) {
+                        dest = l.reg;
+                    } else {
+                        dest = ! useImm && r.reg == RAX ? RCX : RAX;
+                        loadValue(l, S32, dest);
+                    }
+                    if (op == OP_MUL) {
+                        if (useImm) {
+                            opRR(0, S32, 0x69, dest, dest); // imul $xxx, dest, dest
+                            o4(r.imm);
+                        } else {
+                            opRR(0, S32, 0x0faf, dest, r.reg); // imul r, dest
+                        }
+                    } else {
+                        int ext, opcode;
+                        switch (op) {
+                            case OP_PLUS: ext = 0; opcode = 0x01; break;
+                            case OP_MINUS: ext = 5; opcode = 0x29; break;
+                            case OP_BIT_AND: ext = 4; opcode = 0x21; break;
+                            case OP_BIT_XOR: ext = 6; opcode = 0x31; break;
+                            default: ext = 1; opcode = 0x09; break;
+                        }
+                        if (useImm) {
+                            aluImm(S32, ext, dest, r.imm);
+                        } else {
+                            opRR(0, S32, opcode, r.reg, dest); // op r, dest
+                        }
+                    }
+                    if (dest == RCX) {
+                        movRR(S32, RAX, RCX);
+                        dest = RAX;
+                    }
+                    break;
+                }
+                default:
+                    error("Unsupported integer operation %d", op);
+                    dest = RAX;
+                    break;
+            }
+            popTOS(regValue(dest));
+        }
+
+        /* TOS - R0 for two pointers to objects of the given size. */
+        void pointerDifference(int size) {
+            Value l = tos();
+            Value r = r0();
+            int right = operandReg(r, NULL, true, RAX);
+            int dest = RAX;
+            if (l.kind == VK_REG) {
+                dest = l.reg;
+            } else if (right == RAX) {
+                dest = RCX;
+            }
+            loadValue(l, S64, dest);
+            opRR(0, S64, 0x29, right, dest); // sub right, dest
+            if (size != 1) {
+                int shift = log2Size(size);
+                if (shift >= 0) {
+                    opRR(0, S64, 0xc1, 7, dest); // sar $xx, dest
+                    ob(shift);
+                } else {
+                    movRR(S64, RAX, dest);
+                    movImm(S64, RCX, size);
+                    ob(0x48); // cqto
+                    ob(0x99);
+                    opRR(0, S64, 0xf7, 7, RCX); // idiv %rcx
+                    dest = RAX;
+                }
+            }
+            if (dest == RCX) {
+                movRR(S32, RAX, RCX);
+                dest = RAX;
+            }
+            popTOS(regValue(dest));
+        }
+
+        /* Add an int to a pointer to objects of the given size. */
+        void pointerOffset(int op, bool isPtrR0, int size) {
+            Value l = tos();
+            Value r = r0();
+            Type* pIndexType = isPtrR0 ? getTOSType() : getR0Type();
+            Value pointer = isPtrR0 ? r : l;
+            Value index = isPtrR0 ? l : r;
+            if (index.kind == VK_IMM && op == OP_PLUS
+                    && (pointer.kind == VK_LOCAL || pointer.kind == VK_ABS
+                            || pointer.kind == VK_IMM)) {
+                pointer.imm += index.imm * size;
+                popTOS(pointer);
+                return;
+            }
+            // Sign extend and scale the index into %rcx.
+            operandReg(index, pIndexType, true, RCX);
+            int scale = log2Size(size);
+            if (scale < 0 || scale > 3) {
+                opRR(0, S64, 0x69, RCX, RCX); // imul $xxx, %rcx, %rcx
+                o4(size);
+                scale = 0;
+            }
+            int dest;
+            if (op == OP_MINUS) {
+                // int - pointer
+                int reg = operandReg(pointer, NULL, true, RAX);
+                opRR(0, S64, 0x29, reg, RCX); // sub reg, %rcx
+                movRR(S64, RAX, RCX);
+                dest = RAX;
+            } else if (pointer.kind == VK_LOCAL) {
+                dest = RAX;
+                opSib(S64, 0x8d, dest, pointer.reg, RCX, scale, pointer.imm); // lea
+            } else if ((pointer.kind == VK_ABS || pointer.kind == VK_IMM)
+                    && pointer.imm == (int) pointer.imm) {
+                dest = RAX;
+                opSib(S64, 0x8d, dest, -1, RCX, scale, pointer.imm); // lea
+            } else {
+                int base = operandReg(pointer, NULL, true, RAX);
+                dest = ! isPtrR0 && l.kind == VK_REG ? l.reg : RAX;
+                opSib(S64, 0x8d, dest, base, RCX, scale, 0); // lea
+            }
+            popTOS(regValue(dest));
+        }
+
+        static int log2Size(int size) {
+            for (int i = 0; i < 31; i++) {
+                if (size == (1 << i)) {
+                    return i;
+                }
+            }
+            return -1;
+        }
+
+        void copyChunk(int chunk, int source, int dest, int offset) {
+            switch (chunk) {
+                case 8:
+                    opRM(0, S64, 0x8b, RDX, source, offset); // mov xx(source), %rdx
+                    opRM(0, S64, 0x89, RDX, dest, offset); // mov %rdx, xx(dest)
+                    break;
+                case 4:
+                    opRM(0, S32, 0x8b, RDX, source, offset); // mov xx(source), %edx
+                    opRM(0, S32, 0x89, RDX, dest, offset); // mov %edx, xx(dest)
+                    break;
+                case 2:
+                    opRM(0, S32, 0x0fb7, RDX, source, offset); // movzwl xx(source), %edx
+                    opRM(0, S16, 0x89, RDX, dest, offset); // mov %dx, xx(dest)
+                    break;
+                default:
+                    opRM(0, S32, 0x0fb6, RDX, source, offset); // movzbl xx(source), %edx
+                    opRM(0, S8, 0x88, RDX, dest, offset); // mov %dl, xx(dest)
+                    break;
+            }
+        }
+
+        /* Load a value of type tag from the address v into reg. */
+        void loadFrom(TypeTag tag, int reg, const Value& v) {
+            switch (tag) {
+                case TY_CHAR:
+                    opAddr(0, S32, 0x0fbe, reg, v, 0); // movsbl
+                    break;
+                case TY_SHORT:
+                    opAddr(0, S32, 0x0fbf, reg, v, 0); // movswl
+                    break;
+                case TY_INT:
+                    opAddr(0, S32, 0x8b, reg, v, 0); // mov
+                    break;
+                case TY_FLOAT:
+                    opAddr(0xf3, S32, 0x0f10, reg, v, 0); // movss
+                    break;
+                case TY_DOUBLE:
+                    opAddr(0xf2, S32, 0x0f10, reg, v, 0); // movsd
+                    break;
+                default:
+                    opAddr(0, S64, 0x8b, reg, v, 0); // mov
+                    break;
+            }
+        }
+
+        /* Store reg, holding a value of type tag, to the address v. */
+        void storeTo(TypeTag tag, int reg, const Value& v) {
+            switch (tag) {
+                case TY_CHAR:
+                    opAddr(0, S8, 0x88, reg, v, 0); // mov
+                    break;
+                case TY_SHORT:
+                    opAddr(0, S16, 0x89, reg, v, 0); // mov
+                    break;
+                case TY_INT:
+                    opAddr(0, S32, 0x89, reg, v, 0); // mov
+                    break;
+                case TY_FLOAT:
+                    opAddr(0xf3, S32, 0x0f11, reg, v, 0); // movss
+                    break;
+                case TY_DOUBLE:
+                    opAddr(0xf2, S32, 0x0f11, reg, v, 0); // movsd
+                    break;
+                default:
+                    opAddr(0, S64, 0x89, reg, v, 0); // mov
+                    break;
+            }
+        }
+
+        void storeImmTo(TypeTag tag, intptr_t imm, const Value& v) {
+            switch (tag) {
+                case TY_CHAR:
+                    opAddr(0, S8, 0xc6, 0, v, 1); // movb $xx
+                    ob(imm);
+                    break;
+                case TY_SHORT:
+                    opAddr(0, S16, 0xc7, 0, v, 2); // movw $xx
+                    ob(imm);
+                    ob(imm >> 8);
+                    break;
+                case TY_INT:
+                    opAddr(0, S32, 0xc7, 0, v, 4); // movl $xx
+                    o4(imm);
+                    break;
+                default:
+                    opAddr(0, S64, 0xc7, 0, v, 4); // movq $xx
+                    o4(imm);
+                    break;
+            }
+        }
+
+        /* Emit an instruction with a memory operand at the address v.
+         * immSize is the number of immediate bytes that will follow.
+         */
+        void opAddr(int prefix, int size, int opcode, int reg, const Value& v,
+                int immSize) {
+            switch (v.kind) {
+                case VK_LOCAL:
+                    opRM(prefix, size, opcode, reg, v.reg, v.imm);
+                    break;
+                case VK_REG:
+                    opRM(prefix, size, opcode, reg, v.reg, 0);
+                    break;
+                case VK_ABS:
+                case VK_IMM:
+                    if (isReachable(v.imm)) {
+                        opRip(prefix, size, opcode, reg, v.imm, immSize);
+                    } else {
+                        movImm(S64, R11, v.imm);
+                        opRM(prefix, size, opcode, reg, R11, 0);
+                    }
+                    break;
+                case VK_SPILL:
+                    loadValue(v, S64, R11);
+                    opRM(prefix, size, opcode, reg, R11, 0);
+                    break;
+                default:
+                    error("opAddr: unsupported address %d", v.kind);
+                    break;
+            }
+        }
+
+        bool isReachable(intptr_t address) {
+            intptr_t distance = address - getPC();
+            return distance > -0x7fff0000L && distance < 0x7fff0000L;
+        }
+
+        void aluImm(int size, int ext, int reg, int imm) {
+            if (imm == (signed char) imm) {
+                opRR(0, size, 0x83, ext, reg);
+                ob(imm);
+            } else {
+                opRR(0, size, 0x81, ext, reg);
+                o4(imm);
+            }
+        }
+
+        void adjustStack(int n) {
+            if (n > 0) {
+                aluImm(S64, 0, RSP, n); // add $xx, %rsp
+            } else if (n < 0) {
+                aluImm(S64, 5, RSP, -n); // sub $xx, %rsp
+            }
+        }
+
+        void pushReg(int reg) {
+            mpCodeBuf->push(reg);
+            mPushed += 8;
+        }
+
+        void popReg(int reg) {
+            mpCodeBuf->pop(reg);
+            mPushed -= 8;
+        }
+
+        void movRR(int size, int dest, int source) {
+            if (dest != source) {
+                opRR(0, size, 0x89, source, dest); // mov source, dest
+            }
+        }
+
+        void movImm(int size, int dest, intptr_t imm) {
+            if (size != S64 || (imm >= 0 && imm <= 0xffffffffL)) {
+                if (dest & 8) {
+                    ob(0x41);
+                }
+                ob(0xb8 + (dest & 7)); // mov $xx, dest
+                o4(imm);
+            } else if (imm == (int) imm) {
+                opRR(0, S64, 0xc7, 0, dest); // mov $xx, dest
+                o4(imm);
+            } else {
+                ob(0x48 | ((dest & 8) >> 3));
+                ob(0xb8 + (dest & 7)); // movabs $xx, dest
+                o4(imm);
+                o4(imm >> 32);
+            }
+        }
+
+        void setcc(int cc, int reg) {
+            opRR(0, S8, 0x0f90 + cc, 0, reg); // setcc reg
+        }
+
+        int jcc(int cc, int t) {
+            ob(0x0f);
+            return psym(0x80 + cc, t); // jcc xxx
+        }
+
+        /* psym is used to put an instruction with a data field which is a
+         reference to a symbol. */
+        int psym(int n, int t) {
+            ob(n);
+            int result = getPC();
+            o4(t);
+            return result;
+        }
+
+        void emitOp(int prefix, int size, int opcode, int reg, int index, int base) {
+            if (size == S16) {
+                ob(0x66);
+            }
+            if (prefix) {
+                ob(prefix);
+            }
+            int rex = (size == S64 ? 8 : 0) | ((reg & 8) >> 1)
+                    | ((index & 8) >> 2) | ((base & 8) >> 3);
+            // Byte operations need a REX prefix to get at %sil and %dil.
+            if (rex || (size == S8 && ((reg & ~3) == 4 || (base & ~3) == 4))) {
+                ob(0x40 | rex);
+            }
+            if (opcode > 0xff) {
+                ob(opcode >> 8);
+            }
+            ob(opcode & 0xff);
+        }
+
+        /* op reg, rm, register direct */
+        void opRR(int prefix, int size, int opcode, int reg, int rm) {
+            emitOp(prefix, size, opcode, reg, 0, rm);
+            ob(0xc0 | ((reg & 7) << 3) | (rm & 7));
+        }
+
+        /* op reg, disp(base) */
+        void opRM(int prefix, int size, int opcode, int reg, int base, int disp) {
+            emitOp(prefix, size, opcode, reg, 0, base);
+            int mod = disp == 0 && (base & 7) != RBP ? 0
+                    : disp == (signed char) disp ? 1 : 2;
+            ob((mod << 6) | ((reg & 7) << 3) | (base & 7));
+            if ((base & 7) == RSP) {
+                ob(0x24); // SIB with no index
+            }
+            if (mod == 1) {
+                ob(disp);
+            } else if (mod == 2) {
+                o4(disp);
+            }
+        }
+
+        /* op reg, disp(base, index, 1 << scale). base -1 means none. */
+        void opSib(int size, int opcode, int reg, int base, int index, int scale,
+                int disp) {
+            emitOp(0, size, opcode, reg, index, base < 0 ? 0 : base);
+            int mod = base < 0 ? 0
+                    : disp == 0 && (base & 7) != RBP ? 0
+                    : disp == (signed char) disp ? 1 : 2;
+            ob((mod << 6) | ((reg & 7) << 3) | 4);
+            ob((scale << 6) | ((index & 7) << 3) | (base < 0 ? 5 : base & 7));
+            if (mod == 1) {
+                ob(disp);
+            } else if (mod == 2 || base < 0) {
+                o4(disp);
+            }
+        }
+
+        /* op reg, address(%rip) */
+        void opRip(int prefix, int size, int opcode, int reg, intptr_t address,
+                int immSize) {
+            emitOp(prefix, size, opcode, reg, 0, 0);
+            ob(((reg & 7) << 3) | 5);
+            o4(address - (getPC() + 4 + immSize));
+        }
+
+        X64CodeBuf* mpCodeBuf;
+        // The expression stack. The back is R0.
+        Vector<Value> mValues;
+        // Bytes pushed on the machine stack since the end of the prologue,
+        // not counting function call argument areas.
+        int mPushed;
+        // Offset from %rbp of the argument home area.
+        int mFrameBase;
+        // Address of the callee-saved register save slots in the prologue.
+        int mSaveSlots;
+        // Bit i is set if calleeSavedRegisters[i] is used.
+        int mUsedCalleeSaved;
+        int mScopeDepth;
+        Vector<RegisterVariable> mRegisterVariables;
+        Vector<CallInfo> mCalls;
+        Vector<int> mArgClasses;
+    };
+
+#endif // PROVIDE_X64_CODEGEN
+
+#ifdef PROVIDE_TRACE_CODEGEN
+    class TraceCodeGenerator : public CodeGenerator {
+    private:
+        CodeGenerator* mpBase;
+
+    public:
+        TraceCodeGenerator(CodeGenerator* pBase) {
+            mpBase = pBase;
+        }
+
+        virtual ~TraceCodeGenerator() {
+            delete mpBase;
+        }
+
+        virtual void init(ICodeBuf* pCodeBuf) {
+            mpBase->init(pCodeBuf);
+        }
+
+        void setErrorSink(ErrorSink* pErrorSink) {
+            mpBase->setErrorSink(pErrorSink);
+        }
+
+        virtual void setTypes(Type* pInt) {
+            mpBase->setTypes(pInt);
+        }
+
+        /* returns address to patch with local variable size
+        */
+        virtual int functionEntry(Type* pDecl) {
+            int result = mpBase->functionEntry(pDecl);
+            fprintf(stderr, "functionEntry(pDecl) -> %d\n", result);
+            return result;
+        }
+
+        virtual void functionExit(Type* pDecl, int localVariableAddress, int localVariableSize) {
+            fprintf(stderr, "functionExit(pDecl, %d, %d)\n",
+                    localVariableAddress, localVariableSize);
+            mpBase->functionExit(pDecl, localVariableAddress, localVariableSize);
+        }
+
+        virtual bool allocRegisterVariable(int ea, Type* pType) {
+            bool result = mpBase->allocRegisterVariable(ea, pType);
+            fprintf(stderr, "allocRegisterVariable(%d, type=%d) -> %d\n",
+                    ea, pType->tag, result);
+            return result;
+        }
+
+        virtual void pushScope() {
+            fprintf(stderr, "pushScope()\n");
+            mpBase->pushScope();
+        }
+
+        virtual void popScope() {
+            fprintf(stderr, "popScope()\n");
+            mpBase->popScope();
+        }
+
+        /* load immediate value */
+        virtual void li(int t) {
+            fprintf(stderr, "li(%d)\n", t);
+            mpBase->li(t);
+        }
+
+        virtual void loadFloat(intptr_t address, Type* pType) {
+            fprintf(stderr, "loadFloat(%p, type=%d)\n", (void*) address, pType->tag);
+            mpBase->loadFloat(address, pType);
+        }
+
+        virtual void addStructOffsetR0(int offset, Type* pType) {
+            fprintf(stderr, "addStructOffsetR0(%d, type=%d)\n", offset, pType->tag);
+            mpBase->addStructOffsetR0(offset, pType);
+        }
+
+        virtual int gjmp(int t) {
+            int result = mpBase->gjmp(t);
+            fprintf(stderr, "gjmp(%d) = %d\n", t, result);
+            return result;
+        }
+
+        /* l = 0: je, l == 1: jne */
+        virtual int gtst(bool l, int t) {
+            int result = mpBase->gtst(l, t);
+            fprintf(stderr, "gtst(%d,%d) = %d\n", l, t, result);
+            return result;
+        }
+
+        virtual bool isR0Constant(bool* pIsTrue) {
+            return mpBase->isR0Constant(pIsTrue);
+        }
+
+        virtual void gcmp(int op) {
+            fprintf(stderr, "gcmp(%d)\n", op);
+            mpBase->gcmp(op);
+        }
+
+        virtual void genOp(int op) {
+            fprintf(stderr, "genOp(%d)\n", op);
+            mpBase->genOp(op);
+        }
+
+
+        virtual void gUnaryCmp(int op) {
+            fprintf(stderr, "gUnaryCmp(%d)\n", op);
+            mpBase->gUnaryCmp(op);
+        }
+
+        virtual void genUnaryOp(int op) {
+            fprintf(stderr, "genUnaryOp(%d)\n", op);
+            mpBase->genUnaryOp(op);
+        }
+
+        virtual void pushR0() {
+            fprintf(stderr, "pushR0()\n");
+            mpBase->pushR0();
+        }
+
+        virtual void over() {
+            fprintf(stderr, "over()\n");
+            mpBase->over();
+        }
+
+        virtual void popR0() {
+            fprintf(stderr, "popR0()\n");
+            mpBase->popR0();
+        }
+
+        virtual void storeR0ToTOS() {
+            fprintf(stderr, "storeR0ToTOS()\n");
+            mpBase->storeR0ToTOS();
+        }
+
+        virtual void loadR0FromR0() {
+            fprintf(stderr, "loadR0FromR0()\n");
+            mpBase->loadR0FromR0();
+        }
+
+        virtual void leaR0(intptr_t ea, Type* pPointerType, ExpressionType et) {
+            fprintf(stderr, "leaR0(%ld, %d, %d)\n", (long) ea,
+                    pPointerType->pHead->tag, et);
+            mpBase->leaR0(ea, pPointerType, et);
+        }
+
+        virtual intptr_t leaForward(intptr_t ea, Type* pPointerType) {
+            fprintf(stderr, "leaForward(%ld)\n", (long) ea);
+            return mpBase->leaForward(ea, pPointerType);
+        }
+
+        virtual void convertR0Imp(Type* pType, bool isCast){
+            fprintf(stderr, "convertR0(pType tag=%d, %d)\n",  pType->tag, isCast);
+            mpBase->convertR0Imp(pType, isCast);
+        }
+
+        virtual int beginFunctionCallArguments() {
+            int result = mpBase->beginFunctionCallArguments();
+            fprintf(stderr, "beginFunctionCallArguments() = %d\n", result);
+            return result;
+        }
+
+        virtual size_t storeR0ToArg(int l, Type* pArgType) {
+            fprintf(stderr, "storeR0ToArg(%d, pArgType=%d)\n", l,
+                    pArgType->tag);
+            return mpBase->storeR0ToArg(l, pArgType);
+        }
+
+        virtual void endFunctionCallArguments(Type* pDecl, int a, int l) {
+            fprintf(stderr, "endFunctionCallArguments(%d, %d)\n", a, l);
+            mpBase->endFunctionCallArguments(pDecl, a, l);
+        }
+
+        virtual int callForward(int symbol, Type* pFunc) {
+            int result = mpBase->callForward(symbol, pFunc);
+            fprintf(stderr, "callForward(%d) = %d\n", symbol, result);
+            return result;
+        }
+
+        virtual void callIndirect(int l, Type* pFunc) {
+            fprintf(stderr, "callIndirect(%d returntype = %d)\n", l,
+                    pFunc->pHead->tag);
+            mpBase->callIndirect(l, pFunc);
+        }
+
+        virtual void adjustStackAfterCall(Type* pDecl, int l, bool isIndirect) {
+            fprintf(stderr, "adjustStackAfterCall(pType, %d, %d)\n", l, isIndirect);
+            mpBase->adjustStackAfterCall(pDecl, l, isIndirect);
+        }
+
+        virtual int jumpOffset() {
+            return mpBase->jumpOffset();
+        }
+
+        /* output a symbol and patch all calls to it */
+        virtual void gsym(int t) {
+            fprintf(stderr, "gsym(%d)\n", t);
+            mpBase->gsym(t);
+        }
+
+        virtual void resolveForward(intptr_t t) {
+            mpBase->resolveForward(t);
+        }
+
+        virtual int finishCompile() {
+            int result = mpBase->finishCompile();
+            fprintf(stderr, "finishCompile() = %d\n", result);
+            return result;
+        }
+
+        /**
+         * Alignment (in bytes) for this type of data
+         */
+        virtual size_t alignmentOf(Type* pType){
+            return mpBase->alignmentOf(pType);
+        }
+
+        /**
+         * Array element alignment (in bytes) for this type of data.
+         */
+        virtual size_t sizeOf(Type* pType){
+            return mpBase->sizeOf(pType);
+        }
+
+        virtual Type* getR0Type() {
+            return mpBase->getR0Type();
+        }
+
+        virtual Type* getTOSType() {
+            return mpBase->getTOSType();
+        }
+
+        virtual ExpressionType getR0ExpressionType() {
+            return mpBase->getR0ExpressionType();
+        }
+
+        virtual void setR0ExpressionType(ExpressionType et) {
+            mpBase->setR0ExpressionType(et);
+        }
+
+        virtual size_t getExpressionStackDepth() {
+            return mpBase->getExpressionStackDepth();
+        }
+
+        virtual void forceR0RVal() {
+            return mpBase->forceR0RVal();
+        }
+    };
+
+#endif // PROVIDE_TRACE_CODEGEN
+
+#ifdef PROVIDE_FOLDING_CODEGEN
+
+    /* Code generator that folds constant expressions before they reach the
+     * real code generator.
+     *
+     * Constants loaded into R0 are held back, and so are pushes of such
+     * constants, until some operation needs them to be in the machine.
+     * Operations whose operands are all held back constants are evaluated
+     * at compile time, tests of constants turn into unconditional jumps
+     * or nothing at all, and arithmetic with a constant right hand side
+     * is strength reduced where the result is the same.
+     *
+     * Floating point constants live in the global data area, where the
+     * front end stored them. A folded floating point result is written
+     * over the storage of one of its operands, which no generated code
+     * refers to yet.
+     */
+    class FoldingCodeGenerator : public CodeGenerator {
+    public:
+        FoldingCodeGenerator(CodeGenerator* pBase) {
+            mpBase = pBase;
+            mbPending = false;
+        }
+
+        virtual ~FoldingCodeGenerator() {
+            delete mpBase;
+        }
+
+        virtual void init(ICodeBuf* pCodeBuf) {
+            CodeGenerator::init(pCodeBuf);
+            mpBase->init(pCodeBuf);
+        }
+
+        virtual void setErrorSink(ErrorSink* pErrorSink) {
+            CodeGenerator::setErrorSink(pErrorSink);
+            mpBase->setErrorSink(pErrorSink);
+        }
+
+        virtual void setTypes(Type* pInt) {
+            CodeGenerator::setTypes(pInt);
+            mpBase->setTypes(pInt);
+        }
+
+        virtual int functionEntry(Type* pDecl) {
+            flushAll();
+            return mpBase->functionEntry(pDecl);
+        }
+
+        virtual void functionExit(Type* pDecl, int localVariableAddress, int localVariableSize) {
+            flushAll();
+            mpBase->functionExit(pDecl, localVariableAddress, localVariableSize);
+        }
+
+        virtual bool allocRegisterVariable(int ea, Type* pType) {
+            return mpBase->allocRegisterVariable(ea, pType);
+        }
+
+        virtual void pushScope() {
+            mpBase->pushScope();
+        }
+
+        virtual void popScope() {
+            mpBase->popScope();
+        }
+
+        /* load immediate value */
+        virtual void li(int t) {
+            mR0.pType = mkpInt;
+            mR0.value = t;
+            mR0.address = 0;
+            mbPending = true;
+        }
+
+        virtual void loadFloat(intptr_t address, Type* pType) {
+            mR0.pType = pType;
+            mR0.value = 0;
+            mR0.address = address;
+            mbPending = true;
+        }
+
+        virtual void addStructOffsetR0(int offset, Type* pType) {
+            flushAll();
+            mpBase->addStructOffsetR0(offset, pType);
+        }
+
+        virtual int gjmp(int t) {
+            if (t < 0) {
+                // A backward jump. The front end computed the offset from
+                // the current PC, so account for anything flushed.
+                int pc = getPC();
+                flushAll();
+                t -= getPC() - pc;
+            } else {
+                flushAll();
+            }
+            return mpBase->gjmp(t);
+        }
+
+        /* l = 0: je, l == 1: jne */
+        virtual int gtst(bool l, int t) {
+            flushStack();
+            bool isTrue;
+            if (isR0Constant(&isTrue)) {
+                mbPending = false;
+                if (isTrue == l) {
+                    return mpBase->gjmp(t);
+                }
+                return t;
+            }
+            return mpBase->gtst(l, t);
+        }
+
+        virtual bool isR0Constant(bool* pIsTrue) {
+            if (! mbPending) {
+                return false;
+            }
+            *pIsTrue = isFloatType(mR0.pType)
+                    ? floatValue(mR0) != 0 : mR0.value != 0;
+            return true;
+        }
+
+        virtual void gcmp(int op) {
+            if (mbPending && mStack.size() && foldCompare(op)) {
+                return;
+            }
+            flushAll();
+            mpBase->gcmp(op);
+        }
+
+        virtual void genOp(int op) {
+            if (mbPending) {
+                if (mStack.size()) {
+                    if (foldOp(op)) {
+                        return;
+                    }
+                } else if (strengthReduce(op)) {
+                    mbPending = false;
+                    return;
+                }
+            }
+            flushAll();
+            mpBase->genOp(op);
+        }
+
+        virtual void gUnaryCmp(int op) {
+            if (mbPending && op == OP_LOGICAL_NOT) {
+                bool isZero = isFloatType(mR0.pType)
+                        ? floatValue(mR0) == 0 : mR0.value == 0;
+                li(isZero);
+                return;
+            }
+            flushAll();
+            mpBase->gUnaryCmp(op);
+        }
+
+        virtual void genUnaryOp(int op) {
+            if (mbPending) {
+                if (! isFloatType(mR0.pType)) {
+                    if (op == OP_MINUS) {
+                        li(- (unsigned) mR0.value);
+                        return;
+                    } else if (op == OP_BIT_NOT) {
+                        li(~ mR0.value);
+                        return;
+                    }
+                } else if (op == OP_MINUS && isWritable(mR0.address)) {
+                    setFloatValue(mR0, mR0.pType, - floatValue(mR0));
+                    return;
+                }
+            }
+            flushAll();
+            mpBase->genUnaryOp(op);
+        }
+
+        virtual void pushR0() {
+            if (mbPending) {
+                mStack.push_back(mR0);
+                return;
+            }
+            mpBase->pushR0();
+        }
+
+        virtual void over() {
+            flushAll();
+            mpBase->over();
+        }
+
+        virtual void popR0() {
+            if (mStack.size()) {
+                mR0 = mStack.back();
+                mStack.pop_back();
+                mbPending = true;
+                return;
+            }
+            mbPending = false;
+            mpBase->popR0();
+        }
+
+        virtual void storeR0ToTOS() {
+            flushAll();
+            mpBase->storeR0ToTOS();
+        }
+
+        virtual void loadR0FromR0() {
+            flushAll();
+            mpBase->loadR0FromR0();
+        }
+
+        virtual void leaR0(intptr_t ea, Type* pPointerType, ExpressionType et) {
+            flushStack();
+            mbPending = false;
+            mpBase->leaR0(ea, pPointerType, et);
+        }
+
+        virtual intptr_t leaForward(intptr_t ea, Type* pPointerType) {
+            flushStack();
+            mbPending = false;
+            return mpBase->leaForward(ea, pPointerType);
+        }
+
+        virtual void convertR0Imp(Type* pType, bool isCast){
+            if (mbPending && foldConversion(pType)) {
+                return;
+            }
+            flushAll();
+            mpBase->convertR0Imp(pType, isCast);
+        }
+
+        virtual int beginFunctionCallArguments() {
+            flushAll();
+            return mpBase->beginFunctionCallArguments();
+        }
+
+        virtual size_t storeR0ToArg(int l, Type* pArgType) {
+            flushAll();
+            return mpBase->storeR0ToArg(l, pArgType);
+        }
+
+        virtual void endFunctionCallArguments(Type* pDecl, int a, int l) {
+            flushAll();
+            mpBase->endFunctionCallArguments(pDecl, a, l);
+        }
+
+        virtual int callForward(int symbol, Type* pFunc) {
+            flushAll();
+            return mpBase->callForward(symbol, pFunc);
+        }
+
+        virtual void callIndirect(int l, Type* pFunc) {
+            flushAll();
+            mpBase->callIndirect(l, pFunc);
+        }
+
+        virtual void adjustStackAfterCall(Type* pDecl, int l, bool isIndirect) {
+            flushAll();
+            mpBase->adjustStackAfterCall(pDecl, l, isIndirect);
+        }
+
+        virtual int jumpOffset() {
+            return mpBase->jumpOffset();
+        }
+
+        /* output a symbol and patch all calls to it */
+        virtual void gsym(int t) {
+            flushAll();
+            mpBase->gsym(t);
+        }
+
+        virtual void resolveForward(intptr_t t) {
+            flushAll();
+            mpBase->resolveForward(t);
+        }
+
+        virtual int finishCompile() {
+            flushAll();
+            return mpBase->finishCompile();
+        }
+
+        /**
+         * Alignment (in bytes) for this type of data
+         */
+        virtual size_t alignmentOf(Type* pType){
+            return mpBase->alignmentOf(pType);
+        }
+
+        /**
+         * Array element alignment (in bytes) for this type of data.
+         */
+        virtual size_t sizeOf(Type* pType){
+            return mpBase->sizeOf(pType);
+        }
+
+        virtual Type* getR0Type() {
+            if (mbPending) {
+                return mR0.pType;
+            }
             return mpBase->getR0Type();
         }
 
+        virtual Type* getTOSType() {
+            if (mStack.size()) {
+                return mStack.back().pType;
+            }
+            return mpBase->getTOSType();
+        }
+
         virtual ExpressionType getR0ExpressionType() {
+            if (mbPending) {
+                return ET_RVALUE;
+            }
             return mpBase->getR0ExpressionType();
         }
 
-        virtual void setR0ExpressionType(ExpressionType et) {
-            mpBase->setR0ExpressionType(et);
+        virtual void setR0ExpressionType(ExpressionType et) {
+            flushAll();
+            mpBase->setR0ExpressionType(et);
+        }
+
+        virtual size_t getExpressionStackDepth() {
+            return mpBase->getExpressionStackDepth() + mStack.size();
+        }
+
+        virtual void forceR0RVal() {
+            if (! mbPending) {
+                mpBase->forceR0RVal();
+            }
+        }
+
+    private:
+
+        /* A constant that hasn't been given to the real code generator.
+         * Ints are held in value, floats and doubles are stored at address.
+         */
+        struct Constant {
+            Type* pType;
+            int value;
+            intptr_t address;
+        };
+
+        static double floatValue(const Constant& c) {
+            switch (c.pType->tag) {
+                case TY_FLOAT:
+                    return * (float*) c.address;
+                case TY_DOUBLE:
+                    return * (double*) c.address;
+                default:
+                    return c.value;
+            }
+        }
+
+        /* Convert c to pType, in place. c must be a float or double. */
+        static void setFloatValue(Constant& c, Type* pType, double value) {
+            if (pType->tag == TY_FLOAT) {
+                * (float*) c.address = (float) value;
+            } else {
+                * (double*) c.address = value;
+            }
+            c.pType = pType;
+        }
+
+        /* The storage of a constant can be reused unless a held back
+         * copy of it is on the stack.
+         */
+        bool isWritable(intptr_t address) {
+            for (size_t i = 0; i < mStack.size(); i++) {
+                if (mStack[i].address == address) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void load(const Constant& c) {
+            if (isFloatType(c.pType)) {
+                mpBase->loadFloat(c.address, c.pType);
+            } else {
+                mpBase->li(c.value);
+                if (c.pType != mkpInt) {
+                    mpBase->convertR0(c.pType);
+                }
+            }
+        }
+
+        static bool sameConstant(const Constant& a, const Constant& b) {
+            return a.pType == b.pType && a.value == b.value
+                    && a.address == b.address;
+        }
+
+        /* Give the held back stack entries to the real code generator. */
+        void flushStack() {
+            if (mStack.size() == 0) {
+                return;
+            }
+            for (size_t i = 0; i < mStack.size(); i++) {
+                load(mStack[i]);
+                mpBase->pushR0();
+            }
+            // Pushing leaves the last entry in R0, too.
+            if (mbPending && sameConstant(mR0, mStack.back())) {
+                mbPending = false;
+            }
+            // Generated code may now refer to the storage of R0, so it
+            // can't be held back and folded in place any more.
+            bool loadR0 = mbPending && isFloatType(mR0.pType)
+                    && ! isWritable(mR0.address);
+            mStack.clear();
+            if (loadR0) {
+                load(mR0);
+                mbPending = false;
+            }
+        }
+
+        void flushAll() {
+            flushStack();
+            if (mbPending) {
+                load(mR0);
+                mbPending = false;
+            }
+        }
+
+        bool isIntConstant(const Constant& c) {
+            return ! isFloatType(c.pType);
+        }
+
+        bool foldOp(int op) {
+            Constant a = mStack.back();
+            Constant b = mR0;
+            if (isIntConstant(a) && isIntConstant(b)) {
+                unsigned x = a.value;
+                unsigned y = b.value;
+                int result;
+                switch (op) {
+                    case OP_MUL: result = x * y; break;
+                    case OP_PLUS: result = x + y; break;
+                    case OP_MINUS: result = x - y; break;
+                    case OP_BIT_AND: result = x & y; break;
+                    case OP_BIT_XOR: result = x ^ y; break;
+                    case OP_BIT_OR: result = x | y; break;
+                    case OP_DIV:
+                    case OP_MOD:
+                        // Leave the run time behaviour of these alone.
+                        if (b.value == 0 || (b.value == -1 && a.value == INT_MIN)) {
+                            return false;
+                        }
+                        result = op == OP_DIV ? a.value / b.value
+                                : a.value % b.value;
+                        break;
+                    case OP_SHIFT_LEFT:
+                    case OP_SHIFT_RIGHT:
+                        // Out of range shifts differ between targets.
+                        if (y >= 32) {
+                            return false;
+                        }
+                        result = op == OP_SHIFT_LEFT ? (int) (x << y)
+                                : a.value >> y;
+                        break;
+                    default:
+                        return false;
+                }
+                mStack.pop_back();
+                li(result);
+                return true;
+            }
+            // At least one is a float or double. The result has the larger
+            // of the two types, and is stored over an operand of that type.
+            Type* pResultType = a.pType->tag > b.pType->tag ? a.pType : b.pType;
+            Constant* pDest = pResultType == b.pType ? &b : &a;
+            mStack.pop_back();
+            if (! isFloatType(pDest->pType) || ! isWritable(pDest->address)
+                    || a.address == b.address) {
+                mStack.push_back(a);
+                return false;
+            }
+            double x = floatValue(a);
+            double y = floatValue(b);
+            if (pResultType->tag == TY_FLOAT) {
+                x = (float) x;
+                y = (float) y;
+            }
+            double result;
+            switch (op) {
+                case OP_MUL: result = x * y; break;
+                case OP_DIV: result = x / y; break;
+                case OP_PLUS: result = x + y; break;
+                case OP_MINUS: result = x - y; break;
+                default:
+                    mStack.push_back(a);
+                    return false;
+            }
+            setFloatValue(*pDest, pResultType, result);
+            mR0 = *pDest;
+            return true;
+        }
+
+        bool foldCompare(int op) {
+            Constant a = mStack.back();
+            Constant b = mR0;
+            bool result;
+            if (isIntConstant(a) && isIntConstant(b)) {
+                int x = a.value;
+                int y = b.value;
+                switch (op) {
+                    case OP_LESS_EQUAL: result = x <= y; break;
+                    case OP_GREATER_EQUAL: result = x >= y; break;
+                    case OP_LESS: result = x < y; break;
+                    case OP_GREATER: result = x > y; break;
+                    case OP_EQUALS: result = x == y; break;
+                    case OP_NOT_EQUALS: result = x != y; break;
+                    default:
+                        return false;
+                }
+            } else {
+                // Compare in the larger of the two types.
+                double x = floatValue(a);
+                double y = floatValue(b);
+                if (a.pType->tag != TY_DOUBLE && b.pType->tag != TY_DOUBLE) {
+                    x = (float) x;
+                    y = (float) y;
+                }
+                switch (op) {
+                    case OP_LESS_EQUAL: result = x <= y; break;
+                    case OP_GREATER_EQUAL: result = x >= y; break;
+                    case OP_LESS: result = x < y; break;
+                    case OP_GREATER: result = x > y; break;
+                    case OP_EQUALS: result = x == y; break;
+                    case OP_NOT_EQUALS: result = x != y; break;
+                    default:
+                        return false;
+                }
+            }
+            mStack.pop_back();
+            li(result);
+            return true;
+        }
+
+        bool foldConversion(Type* pType) {
+            TypeTag tag = pType->tag;
+            if (! isFloatType(mR0.pType)) {
+                // The code generators keep chars and shorts in full
+                // registers, so these only change the type.
+                if (tag == TY_INT || tag == TY_SHORT || tag == TY_CHAR) {
+                    mR0.pType = pType;
+                    return true;
+                }
+                return false;
+            }
+            double value = floatValue(mR0);
+            if (tag == TY_INT || tag == TY_SHORT || tag == TY_CHAR) {
+                if (! (value > INT_MIN - 1.0 && value < INT_MAX + 1.0)) {
+                    return false;
+                }
+                li((int) value);
+                mR0.pType = pType;
+                return true;
+            }
+            if (tag == mR0.pType->tag) {
+                mR0.pType = pType;
+                return true;
+            }
+            // A double has room for a float, but not the other way around.
+            if (tag == TY_FLOAT && isWritable(mR0.address)) {
+                setFloatValue(mR0, pType, value);
+                return true;
+            }
+            return false;
         }
 
-        virtual size_t getExpressionStackDepth() {
-            return mpBase->getExpressionStackDepth();
+        static int log2(int value) {
+            for (int i = 0; i < 31; i++) {
+                if (value == (1 << i)) {
+                    return i;
+                }
+            }
+            return -1;
         }
 
-        virtual void forceR0RVal() {
-            return mpBase->forceR0RVal();
+        /* TOS op R0, where R0 is a constant and TOS is not. Returns false
+         * if nothing cheaper than the plain operation is known.
+         */
+        bool strengthReduce(int op) {
+            if (isFloatType(mR0.pType)) {
+                return false;
+            }
+            TypeTag tosTag = mpBase->getTOSType()->tag;
+            int value = mR0.value;
+            int shift = log2(value);
+            if (value == 0 && (op == OP_PLUS || op == OP_MINUS)
+                    && (tosTag == TY_INT || tosTag == TY_POINTER)) {
+                mpBase->popR0();
+                return true;
+            }
+            if (tosTag != TY_INT) {
+                return false;
+            }
+            switch (op) {
+                case OP_BIT_OR:
+                case OP_BIT_XOR:
+                case OP_SHIFT_LEFT:
+                case OP_SHIFT_RIGHT:
+                    if (value == 0) {
+                        mpBase->popR0();
+                        return true;
+                    }
+                    break;
+                case OP_MUL:
+                    if (value == 1) {
+                        mpBase->popR0();
+                        return true;
+                    } else if (shift > 0) {
+                        mpBase->li(shift);
+                        mpBase->genOp(OP_SHIFT_LEFT);
+                        return true;
+                    }
+                    break;
+                case OP_DIV:
+                    if (value == 1) {
+                        mpBase->popR0();
+                        return true;
+                    } else if (shift > 0) {
+                        // Round towards zero: add value - 1 to negative
+                        // dividends before shifting.
+                        // (x + ((x >> 31) & (value - 1))) >> shift
+                        mpBase->popR0();
+                        mpBase->pushR0();
+                        mpBase->pushR0();
+                        mpBase->li(31);
+                        mpBase->genOp(OP_SHIFT_RIGHT);
+                        mpBase->pushR0();
+                        mpBase->li(value - 1);
+                        mpBase->genOp(OP_BIT_AND);
+                        mpBase->genOp(OP_PLUS);
+                        mpBase->pushR0();
+                        mpBase->li(shift);
+                        mpBase->genOp(OP_SHIFT_RIGHT);
+                        return true;
+                    }
+                    break;
+                default:
+                    break;
+            }
+            return false;
         }
+
+        CodeGenerator* mpBase;
+        // R0, if mbPending is set.
+        Constant mR0;
+        bool mbPending;
+        // Held back pushes. These are always the top of the expression
+        // stack, and R0 is pending whenever there are any.
+        Vector<Constant> mStack;
     };
 
-#endif // PROVIDE_TRACE_CODEGEN
+#endif // PROVIDE_FOLDING_CODEGEN
 
     class Arena {
     public:
@@ -3538,11 +6299,9 @@ class Compiler : public ErrorSink {
 
         static const int TOKEN_BASE = 0x100;
         TokenTable() {
-            mpMap = hashmapCreate(128, hashFn, equalsFn);
-        }
-
-        ~TokenTable() {
-            hashmapFree(mpMap);
+            mpSlots = 0;
+            mCapacity = 0;
+            mpArena = 0;
         }
 
         void setArena(Arena* pArena) {
@@ -3551,20 +6310,22 @@ class Compiler : public ErrorSink {
 
         // Returns a token for a given string of characters.
         tokenid_t intern(const char* pText, size_t length) {
-            Token probe;
-            int hash = hashmapHash((void*) pText, length);
-            {
-                Token probe;
-                probe.hash = hash;
-                probe.length = length;
-                probe.pText = (char*) pText;
-                Token* pValue = (Token*) hashmapGet(mpMap, &probe);
-                if (pValue) {
-                    return pValue->id;
+            if ((mTokens.size() + 1) * 4 > mCapacity * 3) {
+                grow();
+            }
+            int hash = hashText(pText, length);
+            size_t mask = mCapacity - 1;
+            size_t i = hash & mask;
+            Token* pToken;
+            while ((pToken = mpSlots[i]) != NULL) {
+                if (pToken->hash == hash && pToken->length == length
+                        && memcmp(pToken->pText, pText, length) == 0) {
+                    return pToken->id;
                 }
+                i = (i + 1) & mask;
             }
 
-            Token* pToken = (Token*) mpArena->alloc(sizeof(Token));
+            pToken = (Token*) mpArena->alloc(sizeof(Token));
             memset(pToken, 0, sizeof(*pToken));
             pToken->hash = hash;
             pToken->length = length;
@@ -3573,7 +6334,7 @@ class Compiler : public ErrorSink {
             pToken->pText[length] = 0;
             pToken->id = mTokens.size() + TOKEN_BASE;
             mTokens.push_back(pToken);
-            hashmapPut(mpMap, pToken, pToken);
+            mpSlots[i] = pToken;
             return pToken->id;
         }
 
@@ -3588,40 +6349,83 @@ class Compiler : public ErrorSink {
 
     private:
 
-        static int hashFn(void* pKey) {
-            Token* pToken = (Token*) pKey;
-            return pToken->hash;
+        static int hashText(const char* pText, size_t length) {
+            // FNV-1a
+            uint32_t hash = 2166136261u;
+            for (size_t i = 0; i < length; i++) {
+                hash = (hash ^ (unsigned char) pText[i]) * 16777619u;
+            }
+            return hash;
         }
 
-        static bool equalsFn(void* keyA, void* keyB) {
-            Token* pTokenA = (Token*) keyA;
-            Token* pTokenB = (Token*) keyB;
-            // Don't need to compare hash values, they should always be equal
-            return pTokenA->length == pTokenB->length
-                && strcmp(pTokenA->pText, pTokenB->pText) == 0;
+        /* The table is open addressed, with linear probing, and is kept at
+         * most 3/4 full. It lives in the arena along with the tokens, so
+         * outgrown tables are simply abandoned.
+         */
+        void grow() {
+            size_t capacity = mCapacity ? mCapacity * 2 : 256;
+            Token** pSlots = (Token**) mpArena->alloc(capacity * sizeof(Token*));
+            memset(pSlots, 0, capacity * sizeof(Token*));
+            size_t mask = capacity - 1;
+            for (size_t i = 0; i < mTokens.size(); i++) {
+                Token* pToken = mTokens[i];
+                size_t j = pToken->hash & mask;
+                while (pSlots[j]) {
+                    j = (j + 1) & mask;
+                }
+                pSlots[j] = pToken;
+            }
+            mpSlots = pSlots;
+            mCapacity = capacity;
         }
 
-        Hashmap* mpMap;
+        Token** mpSlots;
+        size_t mCapacity;
         Vector<Token*> mTokens;
         Arena* mpArena;
     };
 
-    class InputStream {
-    public:
-        virtual ~InputStream() {}
-        virtual int getChar() = 0;
-    };
-
-    class TextInputStream : public InputStream {
+    /* The source text. The lexer reads it a character at a time, so
+     * this is a plain buffer with inline accessors rather than a stream.
+     */
+    class TextInputStream {
     public:
         TextInputStream(const char* text, size_t textLength)
             : pText(text), mTextLength(textLength), mPosition(0) {
         }
 
-        virtual int getChar() {
+        inline int getChar() {
             return mPosition < mTextLength ? pText[mPosition++] : EOF;
         }
 
+        /* Return the input that hasn't been read yet, without consuming
+         * it.
+         */
+        bool peek(const char** ppText, size_t* pLength) {
+            *ppText = pText + mPosition;
+            *pLength = mTextLength - mPosition;
+            return true;
+        }
+
+        /* If c is the character that was read last, return the length of
+         * the run of identifier characters starting with it, and consume
+         * all but c. Otherwise return 0.
+         */
+        size_t takeIdentifier(int c, const char** ppStart) {
+            if (mPosition == 0 || pText[mPosition - 1] != c) {
+                return 0;
+            }
+            const char* pStart = pText + mPosition - 1;
+            const char* pEnd = pText + mTextLength;
+            const char* p = pStart + 1;
+            while (p < pEnd && (isalnum((unsigned char) *p) || *p == '_')) {
+                p++;
+            }
+            mPosition = p - pText;
+            *ppStart = pStart;
+            return p - pStart;
+        }
+
     private:
         const char* pText;
         size_t mTextLength;
@@ -3687,7 +6491,7 @@ class Compiler : public ErrorSink {
         }
 
         void appendBytes(const char* s, int n) {
-            memcpy(ensure(n), s, n + 1);
+            memcpy(ensure(n), s, n);
         }
 
         void append(char c) {
@@ -3799,7 +6603,7 @@ class Compiler : public ErrorSink {
     }
 
     struct InputState {
-        InputStream* pStream;
+        TextInputStream* pStream;
         int oldCh;
     };
 
@@ -3936,6 +6740,7 @@ class Compiler : public ErrorSink {
     double tokd;     // floating point constant value
     int tokl;         // token operator level
     intptr_t rsym; // return symbol
+    int mForwardCount; // number of forward references patched in later
     Type* pReturnType; // type of the current function's return.
     intptr_t loc; // local variable index
     char* glo;  // global variable index
@@ -3958,6 +6763,10 @@ class Compiler : public ErrorSink {
 
     SymbolStack* mpCurrentSymbolStack;
 
+    // Names that may have their address taken in the current function.
+    Vector<tokenid_t> mAddressTaken;
+    bool mbAllAddressTaken;
+
     // Prebuilt types, makes things slightly faster.
     Type* mkpInt;        // int
     Type* mkpShort;      // short
@@ -3972,7 +6781,7 @@ class Compiler : public ErrorSink {
     Type* mkpDoublePtr;
     Type* mkpPtrIntFn;
 
-    InputStream* file;
+    TextInputStream* file;
     int mLineNumber;
     bool mbBumpLine;
 
@@ -3985,6 +6794,25 @@ class Compiler : public ErrorSink {
     int mPragmaStringCount;
     int mCompileResult;
 
+    struct ExternalSymbol {
+        tokenid_t tok;
+        void* pAddress;
+    };
+
+    // Symbols that were bound by calling back to the caller.
+    Vector<ExternalSymbol> mExternals;
+
+    // Directory for compiled scripts, empty if there's no cache.
+    String mCacheDir;
+    // The program's code, if it came from the cache.
+    char* mpCachedCode;
+    size_t mCachedCodeSize;
+    // The cache file being written.
+    FILE* mpCacheFile;
+
+    // Bump when the format of cache files changes.
+    static const int CACHE_VERSION = 1;
+
     static const int ALLOC_SIZE = 99999;
 
     static const int TOK_DUMMY = 1;
@@ -4386,9 +7214,20 @@ class Compiler : public ErrorSink {
             }
         } else if (isid()) {
             mTokenString.clear();
-            while (isid()) {
-                pdef(ch);
+            const char* pStart;
+            size_t length = 0;
+            if (macroLevel < 0) {
+                // Take the whole identifier straight from the source.
+                length = file->takeIdentifier(ch, &pStart);
+            }
+            if (length) {
+                mTokenString.appendBytes(pStart, length);
                 inp();
+            } else {
+                while (isid()) {
+                    pdef(ch);
+                    inp();
+                }
             }
             tok = mTokenTable.intern(mTokenString.getUnwrapped(), mTokenString.len());
             if (! mbSuppressMacroExpansion) {
@@ -4611,7 +7450,7 @@ class Compiler : public ErrorSink {
 
     bool acceptStringLiteral() {
         if (tok == '"') {
-            pGen->leaR0((int) glo, mkpCharPtr, ET_RVALUE);
+            pGen->leaR0((intptr_t) glo, mkpCharPtr, ET_RVALUE);
             // This while loop merges multiple adjacent string constants.
             while (tok == '"') {
                 while (ch != '"' && ch != EOF) {
@@ -4633,12 +7472,27 @@ class Compiler : public ErrorSink {
         return false;
     }
 
-    void linkGlobal(tokenid_t t, bool isFunction) {
-        VariableInfo* pVI = VI(t);
-        void* n = NULL;
+    void* lookupSymbol(const char* name) {
+#if defined(DEFAULT_X64_CODEGEN) && defined(MAP_32BIT)
+        for (size_t i = 0; i < sizeof(kScriptHeap) / sizeof(kScriptHeap[0]); i++) {
+            if (strcmp(name, kScriptHeap[i].name) == 0) {
+                return kScriptHeap[i].pAddress;
+            }
+        }
+#endif
         if (mpSymbolLookupFn) {
-            n = mpSymbolLookupFn(mpSymbolLookupContext, nameof(t));
+            return mpSymbolLookupFn(mpSymbolLookupContext, name);
         }
+        return NULL;
+    }
+
+    void linkGlobal(tokenid_t t, bool isFunction) {
+        VariableInfo* pVI = VI(t);
+        void* n = lookupSymbol(nameof(t));
+        ExternalSymbol external;
+        external.tok = t;
+        external.pAddress = n;
+        mExternals.push_back(external);
         if (pVI->pType == NULL) {
             if (isFunction) {
                 pVI->pType = mkpIntFn;
@@ -4691,13 +7545,13 @@ class Compiler : public ErrorSink {
                 // Align to 4-byte boundary
                 glo = (char*) (((intptr_t) glo + 3) & -4);
                 * (float*) glo = (float) ad;
-                pGen->loadFloat((int) glo, mkpFloat);
+                pGen->loadFloat((intptr_t) glo, mkpFloat);
                 glo += 4;
             } else if (t == TOK_NUM_DOUBLE) {
                 // Align to 8-byte boundary
                 glo = (char*) (((intptr_t) glo + 7) & -8);
                 * (double*) glo = ad;
-                pGen->loadFloat((int) glo, mkpDouble);
+                pGen->loadFloat((intptr_t) glo, mkpDouble);
                 glo += 8;
             } else if (c == 2) {
                 /* -, +, !, ~ */
@@ -4748,7 +7602,7 @@ class Compiler : public ErrorSink {
                     // printf("Adding new global function %s\n", nameof(t));
                 }
                 VariableInfo* pVI = VI(t);
-                int n = (intptr_t) pVI->pAddress;
+                intptr_t n = (intptr_t) pVI->pAddress;
                 /* forward reference: try our lookup function */
                 if (!n) {
                     linkGlobal(t, tok == '(');
@@ -4785,7 +7639,8 @@ class Compiler : public ErrorSink {
                     pGen->leaR0(n, pVal, et);
                 } else {
                     pVI->pForward = (void*) pGen->leaForward(
-                            (int) pVI->pForward, pVal);
+                            (intptr_t) pVI->pForward, pVal);
+                    mForwardCount++;
                 }
             }
         }
@@ -4960,11 +7815,13 @@ class Compiler : public ErrorSink {
         else {
             binaryOp(level);
             a = 0;
+            bool isLogical = false;
             while (level == tokl) {
                 t = tokc;
                 next();
                 pGen->forceR0RVal();
                 if (level > 8) {
+                    isLogical = true;
                     a = pGen->gtst(t == OP_LOGICAL_OR, a); /* && and || output code generation */
                     binaryOp(level);
                 } else {
@@ -4985,7 +7842,8 @@ class Compiler : public ErrorSink {
                 }
             }
             /* && and || output code generation */
-            if (a && level > 8) {
+            // Can't test a: a constant condition may not emit a jump.
+            if (isLogical) {
                 pGen->forceR0RVal();
                 a = pGen->gtst(t == OP_LOGICAL_OR, a);
                 pGen->li(t != OP_LOGICAL_OR);
@@ -5016,6 +7874,38 @@ class Compiler : public ErrorSink {
         return pGen->gtst(0, 0);
     }
 
+    /* Like test_expr(), but also tells whether the test is a constant.
+     * *pPC is where the code for the jump starts.
+     */
+    int test_expr(bool* pIsConstant, bool* pIsTrue, intptr_t* pPC) {
+        commaExpr();
+        pGen->forceR0RVal();
+        *pIsConstant = pGen->isR0Constant(pIsTrue);
+        *pPC = pCodeBuf->getPC();
+        return pGen->gtst(0, 0);
+    }
+
+    /* Parse a statement that can never run. Its code, and everything
+     * emitted since pc, is thrown away again unless a forward reference
+     * to a global was threaded through it. Returns true if it was.
+     */
+    bool deadBlock(intptr_t pc, intptr_t* breakLabel, intptr_t continueAddress) {
+        intptr_t savedRsym = rsym;
+        intptr_t savedBreak = breakLabel ? *breakLabel : 0;
+        int forwardCount = mForwardCount;
+        block(breakLabel, continueAddress, false);
+        if (mForwardCount != forwardCount) {
+            return false;
+        }
+        // Jumps out of the statement are the newest links of their chains.
+        rsym = savedRsym;
+        if (breakLabel) {
+            *breakLabel = savedBreak;
+        }
+        pCodeBuf->rewind(pc);
+        return true;
+    }
+
     void block(intptr_t* breakLabel, intptr_t continueAddress, bool outermostFunctionBlock) {
         intptr_t a, n, t;
 
@@ -5024,16 +7914,38 @@ class Compiler : public ErrorSink {
             /* declarations */
             localDeclarations(pBaseType);
         } else if (tok == TOK_IF) {
+            bool isConstant, isTrue;
+            bool dropped = false;
+            intptr_t pc;
             next();
             skip('(');
-            a = test_expr();
+            a = test_expr(&isConstant, &isTrue, &pc);
             skip(')');
-            block(breakLabel, continueAddress, false);
+            if (isConstant && !isTrue) {
+                dropped = deadBlock(pc, breakLabel, continueAddress);
+                if (dropped) {
+                    a = 0;
+                }
+            } else {
+                block(breakLabel, continueAddress, false);
+            }
             if (tok == TOK_ELSE) {
                 next();
+                if (dropped) {
+                    // Nothing is left to jump over the else part.
+                    block(breakLabel, continueAddress, false);
+                    return;
+                }
+                pc = pCodeBuf->getPC();
                 n = pGen->gjmp(0); /* jmp */
                 pGen->gsym(a);
-                block(breakLabel, continueAddress, false);
+                if (isConstant && isTrue) {
+                    if (deadBlock(pc, breakLabel, continueAddress)) {
+                        n = 0;
+                    }
+                } else {
+                    block(breakLabel, continueAddress, false);
+                }
                 pGen->gsym(n); /* patch else jmp */
             } else {
                 pGen->gsym(a); /* patch if test */
@@ -5043,8 +7955,20 @@ class Compiler : public ErrorSink {
             next();
             skip('(');
             if (t == TOK_WHILE) {
+                bool isConstant, isTrue;
+                intptr_t pc;
                 n = pCodeBuf->getPC(); // top of loop, target of "next" iteration
-                a = test_expr();
+                a = test_expr(&isConstant, &isTrue, &pc);
+                if (isConstant && !isTrue) {
+                    skip(')');
+                    if (deadBlock(pc, &a, n)) {
+                        a = 0;
+                    } else {
+                        pGen->gjmp(n - pCodeBuf->getPC() - pGen->jumpOffset());
+                    }
+                    pGen->gsym(a);
+                    return;
+                }
             } else {
                 if (tok != ';')
                     commaExpr();
@@ -5069,12 +7993,14 @@ class Compiler : public ErrorSink {
         } else if (tok == '{') {
             if (! outermostFunctionBlock) {
                 mLocals.pushLevel();
+                pGen->pushScope();
             }
             next();
             while (tok != '}' && tok != EOF)
                 block(breakLabel, continueAddress, false);
             skip('}');
             if (! outermostFunctionBlock) {
+                pGen->popScope();
                 mLocals.popLevel();
             }
         } else {
@@ -5757,6 +8683,9 @@ class Compiler : public ErrorSink {
                     loc = loc + alignedSize;
                     variableAddress = -loc;
                     VI(pDecl->id)->pAddress = (void*) variableAddress;
+                    if (! isAddressTaken(pDecl->id)) {
+                        pGen->allocRegisterVariable(variableAddress, pDecl);
+                    }
                     if (accept('=')) {
                         /* assignment */
                         pGen->leaR0(variableAddress, createPtrType(pDecl), ET_LVALUE);
@@ -5904,12 +8833,13 @@ class Compiler : public ErrorSink {
                     mpCurrentSymbolStack = &mLocals;
                     if (name) {
                         /* patch forward references */
-                        pGen->resolveForward((int) name->pForward);
+                        pGen->resolveForward((intptr_t) name->pForward);
                         /* put function address */
                         name->pAddress = (void*) pCodeBuf->getPC();
                     }
                     // Calculate stack offsets for parameters
                     mLocals.pushLevel();
+                    scanAddressTaken();
                     intptr_t a = 8;
                     int argCount = 0;
                     for (Type* pP = pDecl->pTail; pP; pP = pP->pTail) {
@@ -5923,6 +8853,9 @@ class Compiler : public ErrorSink {
                         a = (a + alignment - 1) & ~ (alignment-1);
                         if (pArg->id) {
                             VI(pArg->id)->pAddress = (void*) a;
+                            if (! isAddressTaken(pArg->id)) {
+                                pGen->allocRegisterVariable(a, pArg);
+                            }
                         }
                         a = a + pGen->sizeOf(pPassingType);
                         argCount++;
@@ -5941,6 +8874,141 @@ class Compiler : public ErrorSink {
         }
     }
 
+    /* Look ahead through the body of the function we're about to compile
+     * and remember every name that follows a '&' operator, so that the
+     * code generator can keep the other variables in registers. This is
+     * conservative: binary '&' counts too, and if we can't be sure (the
+     * body isn't plain text we can peek at, or it uses preprocessor
+     * directives, '&(' or macros that contain a '&') every name counts.
+     */
+    void scanAddressTaken() {
+        mAddressTaken.clear();
+        mbAllAddressTaken = true;
+        const char* pText;
+        size_t length;
+        if (macroLevel >= 0 || tok != '{' || ! file->peek(&pText, &length)) {
+            return;
+        }
+        // The character after the '{' has already been read into ch.
+        size_t end = length + 1;
+        size_t i = 0;
+        int depth = 1;
+        bool afterAmpersand = false;
+        while (i < end) {
+            int c = scanChar(pText, length, i);
+            int d = scanChar(pText, length, i + 1);
+            if (c == '"' || c == '\'') {
+                for (i++; i < end && scanChar(pText, length, i) != c; i++) {
+                    if (scanChar(pText, length, i) == '\\') {
+                        i++;
+                    }
+                }
+                i++;
+                afterAmpersand = false;
+            } else if (c == '/' && d == '*') {
+                for (i += 2; i < end; i++) {
+                    if (scanChar(pText, length, i) == '*'
+                            && scanChar(pText, length, i + 1) == '/') {
+                        break;
+                    }
+                }
+                i += 2;
+            } else if (c == '/' && d == '/') {
+                while (i < end && scanChar(pText, length, i) != '\n') {
+                    i++;
+                }
+            } else if (c == '#') {
+                return;
+            } else if (c == '&') {
+                afterAmpersand = d != '&' && d != '=';
+                i += afterAmpersand ? 1 : 2;
+            } else if (isalpha(c) || c == '_') {
+                String name;
+                while (i < end && (isalnum(c = scanChar(pText, length, i))
+                        || c == '_')) {
+                    name.append(c);
+                    i++;
+                }
+                tokenid_t t = mTokenTable.intern(name.getUnwrapped(),
+                        name.len());
+                if (macroMayTakeAddress(t, 0)) {
+                    return;
+                }
+                if (afterAmpersand) {
+                    mAddressTaken.push_back(t);
+                    afterAmpersand = false;
+                }
+            } else if (isdigit(c)) {
+                while (i < end && (isalnum(c = scanChar(pText, length, i))
+                        || c == '.')) {
+                    i++;
+                }
+                afterAmpersand = false;
+            } else if (isspace(c)) {
+                i++;
+            } else {
+                if (afterAmpersand && c == '(') {
+                    return;
+                }
+                afterAmpersand = false;
+                if (c == '{') {
+                    depth++;
+                } else if (c == '}' && --depth == 0) {
+                    mbAllAddressTaken = false;
+                    return;
+                }
+                i++;
+            }
+        }
+    }
+
+    int scanChar(const char* pText, size_t length, size_t i) {
+        if (i == 0) {
+            return ch;
+        }
+        return i <= length ? pText[i - 1] : EOF;
+    }
+
+    bool macroMayTakeAddress(tokenid_t t, int depth) {
+        const char* pDefinition = mTokenTable[t].mpMacroDefinition;
+        if (! pDefinition) {
+            return false;
+        }
+        if (depth >= MACRO_NESTING_MAX || strchr(pDefinition, '&')) {
+            return true;
+        }
+        const char* p = pDefinition;
+        while (*p) {
+            if (isalpha(*p) || *p == '_') {
+                // The token table wants a nul terminated name.
+                String name;
+                while (isalnum(*p) || *p == '_') {
+                    name.append(*p++);
+                }
+                if (macroMayTakeAddress(
+                        mTokenTable.intern(name.getUnwrapped(), name.len()),
+                        depth + 1)) {
+                    return true;
+                }
+            } else {
+                p++;
+            }
+        }
+        return false;
+    }
+
+    bool isAddressTaken(tokenid_t t) {
+        if (mbAllAddressTaken) {
+            return true;
+        }
+        for (size_t i = 0; i < mAddressTaken.size(); i++) {
+            if (mAddressTaken[i] == t) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     Type* passingType(Type* pType) {
         switch (pType->tag) {
         case TY_CHAR:
@@ -5966,9 +9034,13 @@ class Compiler : public ErrorSink {
 
     void cleanup() {
         if (pGlobalBase != 0) {
-            free(pGlobalBase);
+            munmap(pGlobalBase, ALLOC_SIZE);
             pGlobalBase = 0;
         }
+        if (mpCachedCode != 0) {
+            munmap(mpCachedCode, mCachedCodeSize);
+            mpCachedCode = 0;
+        }
         if (pGen) {
             delete pGen;
             pGen = 0;
@@ -5995,6 +9067,7 @@ class Compiler : public ErrorSink {
         tokl = 0;
         ch = 0;
         rsym = 0;
+        mForwardCount = 0;
         loc = 0;
         glo = 0;
         macroLevel = -1;
@@ -6002,11 +9075,17 @@ class Compiler : public ErrorSink {
         pGlobalBase = 0;
         pCodeBuf = 0;
         pGen = 0;
+        mPragmas.clear();
         mPragmaStringCount = 0;
+        mExternals.clear();
+        mpCachedCode = 0;
+        mCachedCodeSize = 0;
+        mpCacheFile = 0;
         mCompileResult = 0;
         mLineNumber = 1;
         mbBumpLine = false;
         mbSuppressMacroExpansion = false;
+        mbAllAddressTaken = true;
     }
 
     void setArchitecture(const char* architecture) {
@@ -6027,6 +9106,12 @@ class Compiler : public ErrorSink {
             if (! pGen && strcmp(architecture, "x86") == 0) {
                 pGen = new X86CodeGenerator();
             }
+#endif
+#ifdef PROVIDE_X64_CODEGEN
+            if (! pGen && strcmp(architecture, "x86_64") == 0) {
+                pGen = new X64CodeGenerator();
+                pCodeBuf = new X64CodeBuf(pCodeBuf);
+            }
 #endif
             if (!pGen ) {
                 error("Unknown architecture %s\n", architecture);
@@ -6039,6 +9124,9 @@ class Compiler : public ErrorSink {
             pCodeBuf = new ARMCodeBuf(pCodeBuf);
 #elif defined(DEFAULT_X86_CODEGEN)
             pGen = new X86CodeGenerator();
+#elif defined(DEFAULT_X64_CODEGEN)
+            pGen = new X64CodeGenerator();
+            pCodeBuf = new X64CodeBuf(pCodeBuf);
 #endif
         }
         if (pGen == NULL) {
@@ -6071,6 +9159,21 @@ public:
         mpSymbolLookupContext = pContext;
     }
 
+    void setCacheDir(const char* path) {
+        mCacheDir.clear();
+        struct stat st;
+        if (mkdir(path, 0700) < 0 && errno != EEXIST) {
+            LOGD("Could not create compiled script cache %s", path);
+        } else if (lstat(path, &st) < 0 || !S_ISDIR(st.st_mode)
+                || !isPrivate(st)) {
+            // lstat() so that a symlink to someone else's directory fails.
+            LOGD("Ignoring compiled script cache %s, it is not a directory "
+                    "private to uid %d", path, (int) geteuid());
+        } else {
+            mCacheDir.appendCStr(path);
+        }
+    }
+
     int compile(const char* text, size_t textLength) {
         int result;
 
@@ -6085,21 +9188,39 @@ public:
         mLocals.setTokenTable(&mTokenTable);
 
         internKeywords();
+
+        String cacheKey;
+        if (mCacheDir.len()) {
+            getCacheKey(cacheKey, text, textLength);
+            if (loadFromCache(cacheKey)) {
+                mCompileResult = 0;
+                return 0;
+            }
+        }
+
         setArchitecture(NULL);
         if (!pGen) {
             return -1;
         }
 #ifdef PROVIDE_TRACE_CODEGEN
             pGen = new TraceCodeGenerator(pGen);
+#endif
+#ifdef PROVIDE_FOLDING_CODEGEN
+            pGen = new FoldingCodeGenerator(pGen);
 #endif
         pGen->setErrorSink(this);
+        pGen->setTypes(mkpInt);
 
         if (pCodeBuf) {
             pCodeBuf->init(ALLOC_SIZE);
         }
         pGen->init(pCodeBuf);
         file = new TextInputStream(text, textLength);
-        pGlobalBase = (char*) calloc(1, ALLOC_SIZE);
+        pGlobalBase = mapGlobals(NULL);
+        if (!pGlobalBase) {
+            error("Could not allocate global space.");
+            return -1;
+        }
         glo = pGlobalBase;
         inp();
         next();
@@ -6112,9 +9233,304 @@ public:
             }
         }
         mCompileResult = result;
+        if (result == 0 && mCacheDir.len()) {
+            saveToCache(cacheKey);
+        }
         return result;
     }
 
+    /* The compiled script cache.
+     *
+     * The generated code refers to globals, to itself and to external
+     * symbols by absolute address, and nothing records where. So rather
+     * than relocating it, a cached script is mapped back at the addresses
+     * it was compiled at, and only used if those addresses are free and
+     * every external symbol still has the address it had then. Processes
+     * forked from the same parent share a layout, which makes that the
+     * usual case.
+     *
+     * A cache file holds a header, the cache key (compiler configuration
+     * and source), the external and global symbols, the pragmas, the
+     * initial contents of the global space and, page aligned so it can
+     * be mapped directly, the code.
+     */
+
+    struct CacheHeader {
+        char magic[4];
+        uint32_t keyLength;
+        uint32_t pragmaCount;
+        uint32_t pragmasLength;
+        uint32_t globalsLength;
+        uint32_t codeLength;
+        uint32_t codeOffset;
+        uintptr_t globalBase;
+        uintptr_t codeBase;
+    };
+
+    static char* mapGlobals(void* address) {
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(PROVIDE_X64_CODEGEN) && defined(MAP_32BIT)
+        if (!address) {
+            flags |= MAP_32BIT;
+        }
+#endif
+        void* result = mmap(address, ALLOC_SIZE, PROT_READ | PROT_WRITE,
+                flags, -1, 0);
+        if (result == MAP_FAILED) {
+            return NULL;
+        }
+        return (char*) result;
+    }
+
+    /* Everything the generated code depends on: the compiler that
+     * generated it and the source.
+     */
+    void getCacheKey(String& key, const char* text, size_t textLength) {
+        key.printf("acc %d %s %s %d", CACHE_VERSION, __DATE__, __TIME__,
+                (int) sizeof(void*));
+#if defined(DEFAULT_ARM_CODEGEN)
+        key.appendCStr(" arm");
+#elif defined(DEFAULT_X86_CODEGEN)
+        key.appendCStr(" x86");
+#elif defined(DEFAULT_X64_CODEGEN)
+        key.appendCStr(" x86_64");
+#endif
+#ifdef ARM_USE_VFP
+        key.appendCStr(" vfp");
+#endif
+#ifdef DISABLE_ARM_PEEPHOLE
+        key.appendCStr(" nopeephole");
+#endif
+#ifdef PROVIDE_FOLDING_CODEGEN
+        key.appendCStr(" fold");
+#endif
+        key.append('\n');
+        key.appendBytes(text, textLength);
+    }
+
+    void getCachePath(String& path, String& key) {
+        uint32_t hash = 2166136261u;
+        const unsigned char* p = (const unsigned char*) key.getUnwrapped();
+        for (size_t i = 0; i < key.len(); i++) {
+            hash = (hash ^ p[i]) * 16777619u;
+        }
+        path.printf("%s/%08x.acc", mCacheDir.getUnwrapped(), hash);
+    }
+
+    /* Returns the name of the symbol at *pp, and its address in pAddress,
+     * and advances *pp. Returns NULL at the end of the list.
+     */
+    static const char* readSymbol(const char** pp, const char* pEnd,
+                                  void** pAddress) {
+        const char* name = *pp;
+        const char* nameEnd = (const char*) memchr(name, 0, pEnd - name);
+        if (!nameEnd || nameEnd == name) {
+            *pp = nameEnd ? nameEnd + 1 : pEnd;
+            return NULL;
+        }
+        const char* p = nameEnd + 1;
+        if ((size_t) (pEnd - p) < sizeof(void*)) {
+            *pp = pEnd;
+            return NULL;
+        }
+        memcpy(pAddress, p, sizeof(void*));
+        *pp = p + sizeof(void*);
+        return name;
+    }
+
+    static void writeSymbol(FILE* f, const char* name, void* address) {
+        fwrite(name, strlen(name) + 1, 1, f);
+        fwrite(&address, sizeof(address), 1, f);
+    }
+
+    static bool static_writeGlobalFn(VariableInfo* value, void* context) {
+        Compiler* pCompiler = (Compiler*) context;
+        if (!value->isStructTag && value->pAddress) {
+            writeSymbol(pCompiler->mpCacheFile,
+                        pCompiler->nameof(value->tok), value->pAddress);
+        }
+        return true;
+    }
+
+    /* The cache holds code we are going to run, so only trust files and
+     * directories that nobody but us could have written.
+     */
+    static bool isPrivate(const struct stat& st) {
+        return st.st_uid == geteuid() && !(st.st_mode & (S_IWGRP | S_IWOTH));
+    }
+
+    bool loadFromCache(String& key) {
+        String path;
+        getCachePath(path, key);
+        int fd = open(path.getUnwrapped(), O_RDONLY | O_NOFOLLOW);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || !isPrivate(st)) {
+            LOGD("Ignoring compiled script cache %s, it is not a regular "
+                    "file private to uid %d", path.getUnwrapped(),
+                    (int) geteuid());
+            close(fd);
+            return false;
+        }
+        FILE* f = fdopen(fd, "rb");
+        if (!f) {
+            close(fd);
+            return false;
+        }
+        CacheHeader header;
+        char* pData = NULL;
+        char* pGlobals = NULL;
+        char* pCode = NULL;
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        size_t dataLength = 0;
+        size_t codeMapLength = 0;
+        const char* p;
+        const char* pEnd;
+        void* address;
+        bool ok = fread(&header, sizeof(header), 1, f) == 1
+                && memcmp(header.magic, "ACCc", 4) == 0
+                && header.keyLength == key.len()
+                && header.codeOffset > sizeof(header)
+                && header.codeLength > 0
+                && header.globalsLength <= (size_t) ALLOC_SIZE;
+        if (!ok) {
+            goto fail;
+        }
+        dataLength = header.codeOffset - sizeof(header);
+        pData = (char*) malloc(dataLength);
+        if (!pData || fread(pData, dataLength, 1, f) != 1
+                || header.keyLength > dataLength
+                || memcmp(pData, key.getUnwrapped(), header.keyLength) != 0) {
+            goto fail;
+        }
+
+        // External symbols must not have moved.
+        p = pData + header.keyLength;
+        pEnd = pData + dataLength;
+        for (;;) {
+            const char* name = readSymbol(&p, pEnd, &address);
+            if (!name) {
+                break;
+            }
+            if (lookupSymbol(name) != address) {
+                goto fail;
+            }
+        }
+
+        // The global space and code must go back where they were.
+        pGlobals = mapGlobals((void*) header.globalBase);
+        if (pGlobals != (char*) header.globalBase) {
+            goto fail;
+        }
+        codeMapLength = (header.codeLength + pageSize - 1) & ~(pageSize - 1);
+        pCode = (char*) mmap((void*) header.codeBase, codeMapLength,
+                PROT_READ | PROT_EXEC, MAP_PRIVATE, fileno(f), header.codeOffset);
+        if (pCode != (char*) header.codeBase) {
+            goto fail;
+        }
+
+        // Global symbols, for lookup.
+        for (;;) {
+            const char* name = readSymbol(&p, pEnd, &address);
+            if (!name) {
+                break;
+            }
+            tokenid_t tok = mTokenTable.intern(name, strlen(name));
+            mGlobals.add(tok)->pAddress = address;
+        }
+        if ((size_t) (pEnd - p) < header.pragmasLength + header.globalsLength) {
+            goto fail;
+        }
+        if (header.pragmasLength) {
+            mPragmas.appendBytes(p, header.pragmasLength);
+            mPragmaStringCount = header.pragmaCount;
+        }
+        p += header.pragmasLength;
+        memcpy(pGlobals, p, header.globalsLength);
+
+        pGlobalBase = pGlobals;
+        mpCachedCode = pCode;
+        mCachedCodeSize = header.codeLength;
+        free(pData);
+        fclose(f);
+        return true;
+
+    fail:
+        if (pCode && pCode != MAP_FAILED) {
+            munmap(pCode, codeMapLength);
+        }
+        if (pGlobals) {
+            munmap(pGlobals, ALLOC_SIZE);
+        }
+        free(pData);
+        fclose(f);
+        return false;
+    }
+
+    void saveToCache(String& key) {
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        String path;
+        getCachePath(path, key);
+        // Scripts may be compiled on several threads at once, so every
+        // save gets a temporary file of its own.
+        String tempPath;
+        tempPath.printf("%s.XXXXXX", path.getUnwrapped());
+        int fd = mkstemp(tempPath.getUnwrapped());
+        if (fd < 0) {
+            return;
+        }
+        FILE* f = fdopen(fd, "wb");
+        if (!f) {
+            close(fd);
+            unlink(tempPath.getUnwrapped());
+            return;
+        }
+        CacheHeader header;
+        memset(&header, 0, sizeof(header));
+        fwrite(&header, sizeof(header), 1, f);
+        fwrite(key.getUnwrapped(), key.len(), 1, f);
+
+        for (size_t i = 0; i < mExternals.size(); i++) {
+            writeSymbol(f, nameof(mExternals[i].tok), mExternals[i].pAddress);
+        }
+        fputc(0, f);
+        mpCacheFile = f;
+        mGlobals.forEach(static_writeGlobalFn, this);
+        mpCacheFile = NULL;
+        fputc(0, f);
+
+        size_t globalsLength = glo - pGlobalBase;
+        fwrite(mPragmas.getUnwrapped(), mPragmas.len(), 1, f);
+        fwrite(pGlobalBase, globalsLength, 1, f);
+        long offset = ftell(f);
+        long codeOffset = (offset + pageSize - 1) & ~(pageSize - 1);
+        while (offset++ < codeOffset) {
+            fputc(0, f);
+        }
+        size_t codeLength = pCodeBuf->getSize();
+        fwrite(pCodeBuf->getBase(), codeLength, 1, f);
+
+        memcpy(header.magic, "ACCc", 4);
+        header.keyLength = key.len();
+        header.pragmaCount = mPragmaStringCount;
+        header.pragmasLength = mPragmas.len();
+        header.globalsLength = globalsLength;
+        header.codeLength = codeLength;
+        header.codeOffset = codeOffset;
+        header.globalBase = (uintptr_t) pGlobalBase;
+        header.codeBase = (uintptr_t) pCodeBuf->getBase();
+        fseek(f, 0, SEEK_SET);
+        fwrite(&header, sizeof(header), 1, f);
+        bool ok = ferror(f) == 0;
+        ok = (fclose(f) == 0) && ok;
+        if (!ok || rename(tempPath.getUnwrapped(), path.getUnwrapped()) != 0) {
+            LOGD("Could not write compiled script cache %s", path.getUnwrapped());
+            unlink(tempPath.getUnwrapped());
+        }
+    }
+
     void createPrimitiveTypes() {
         mkpInt = createType(TY_INT, NULL, NULL);
         mkpShort = createType(TY_SHORT, NULL, NULL);
@@ -6180,6 +9596,11 @@ public:
     }
 
     void getProgramBinary(ACCvoid** base, ACCsizei* length) {
+        if (mpCachedCode) {
+            *base = mpCachedCode;
+            *length = (ACCsizei) mCachedCodeSize;
+            return;
+        }
         *base = pCodeBuf->getBase();
         *length = (ACCsizei) pCodeBuf->getSize();
     }
@@ -6227,6 +9648,20 @@ const int Compiler::X86CodeGenerator::operatorHelper[] = {
 };
 #endif
 
+#ifdef PROVIDE_X64_CODEGEN
+const int Compiler::X64CodeGenerator::intPoolRegisters[] = {
+        RSI, RDI, R8, R9, R10
+};
+
+const int Compiler::X64CodeGenerator::calleeSavedRegisters[] = {
+        RBX, R12, R13, R14, R15
+};
+
+const int Compiler::X64CodeGenerator::argumentRegisters[] = {
+        RDI, RSI, RDX, RCX, R8, R9
+};
+#endif
+
 struct ACCscript {
     ACCscript() {
         text = 0;
@@ -6342,6 +9777,11 @@ void accScriptSource(ACCscript* script,
 #endif
 }
 
+extern "C"
+void accScriptCacheDir(ACCscript* script, const ACCchar* path) {
+    script->compiler.setCacheDir(path);
+}
+
 extern "C"
 void accCompileScript(ACCscript* script) {
     int result = script->compiler.compile(script->text, script->textLength);
@@ -15,11 +15,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 
 #if defined(__arm__)
 #include <unistd.h>
 #endif
 
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#include <ucontext.h>
+#endif
+
 #if defined(__arm__)
 #define PROVIDE_ARM_DISASSEMBLY
 #endif
@@ -32,10 +38,48 @@
 
 
 typedef int (*MainPtr)(int, char**);
+
+#if defined(__x86_64__) && defined(MAP_32BIT)
+// Scripts written for 32-bit targets keep pointers to their locals in
+// ints, so run them on a stack in the low 2GB of the address space.
+
+static const size_t kScriptStackSize = 1024 * 1024;
+
+static MainPtr gMainFunc;
+static int gArgc;
+static char** gArgv;
+static int gResult;
+
+static void runOnScriptStack() {
+    gResult = gMainFunc(gArgc, gArgv);
+}
+
+int run(MainPtr mainFunc, int argc, char** argv) {
+    void* stack = mmap(NULL, kScriptStackSize, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (stack == MAP_FAILED) {
+        return mainFunc(argc, argv);
+    }
+    ucontext_t caller;
+    ucontext_t script;
+    getcontext(&script);
+    script.uc_stack.ss_sp = stack;
+    script.uc_stack.ss_size = kScriptStackSize;
+    script.uc_link = &caller;
+    makecontext(&script, runOnScriptStack, 0);
+    gMainFunc = mainFunc;
+    gArgc = argc;
+    gArgv = argv;
+    swapcontext(&caller, &script);
+    munmap(stack, kScriptStackSize);
+    return gResult;
+}
+#else
 // This is a separate function so it can easily be set by breakpoint in gdb.
 int run(MainPtr mainFunc, int argc, char** argv) {
     return mainFunc(argc, argv);
 }
+#endif
 
 ACCvoid* symbolLookup(ACCvoid* pContext, const ACCchar* name) {
     return (ACCvoid*) dlsym(RTLD_DEFAULT, name);
@@ -88,10 +132,41 @@ static int disassemble(ACCscript* script, FILE* out) {
 
 #endif // PROVIDE_ARM_DISASSEMBLY
 
+static long microseconds(const struct timeval& start, const struct timeval& end) {
+    return (long) ((end.tv_sec - start.tv_sec) * 1000000
+            + (end.tv_usec - start.tv_usec));
+}
+
+// Compile text count times and report the front end's throughput.
+static void benchmark(const ACCchar* text, int count) {
+    int lines = 0;
+    for (const ACCchar* p = text; *p; p++) {
+        lines += *p == '\n';
+    }
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < count; i++) {
+        ACCscript* script = accCreateScript();
+        const ACCchar* scriptSource[] = {text};
+        accScriptSource(script, 1, scriptSource, NULL);
+        accRegisterSymbolCallback(script, symbolLookup, NULL);
+        accCompileScript(script);
+        accDeleteScript(script);
+    }
+    gettimeofday(&end, NULL);
+    long us = microseconds(start, end);
+    fprintf(stderr, "compiled %d lines %d times in %ld us: %lld lines/sec\n",
+            lines, count, us,
+            us ? (long long) lines * count * 1000000 / us : 0LL);
+}
+
 int main(int argc, char** argv) {
     const char* inFile = NULL;
     bool printListing;
     bool runResults = false;
+    bool printCompileTime = false;
+    int benchmarkCount = 0;
+    const char* cacheDir = NULL;
     FILE* in = stdin;
     int i;
     for (i = 1; i < argc; i++) {
@@ -104,6 +179,23 @@ int main(int argc, char** argv) {
                 case 'R':
                     runResults = true;
                     break;
+                case 'C':
+                    if (i + 1 >= argc) {
+                        fprintf(stderr, "-C requires a cache directory\n");
+                        return 3;
+                    }
+                    cacheDir = argv[++i];
+                    break;
+                case 't':
+                    printCompileTime = true;
+                    break;
+                case 'b':
+                    if (i + 1 >= argc) {
+                        fprintf(stderr, "-b requires a repeat count\n");
+                        return 3;
+                    }
+                    benchmarkCount = atoi(argv[++i]);
+                    break;
             default:
                 fprintf(stderr, "Unrecognized flag %s\n", arg);
                 return 3;
@@ -139,6 +231,10 @@ int main(int argc, char** argv) {
 
     text[fileSize] = '\0';
 
+    if (benchmarkCount > 0) {
+        benchmark(text, benchmarkCount);
+    }
+
     ACCscript* script = accCreateScript();
 
     const ACCchar* scriptSource[] = {text};
@@ -146,8 +242,17 @@ int main(int argc, char** argv) {
     delete[] text;
 
     accRegisterSymbolCallback(script, symbolLookup, NULL);
+    if (cacheDir) {
+        accScriptCacheDir(script, cacheDir);
+    }
 
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
     accCompileScript(script);
+    gettimeofday(&end, NULL);
+    if (printCompileTime) {
+        fprintf(stderr, "compile time: %ld us\n", microseconds(start, end));
+    }
     int result = accGetError(script);
     MainPtr mainPointer = 0;
     if (result != 0) {
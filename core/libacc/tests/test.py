@@ -5,6 +5,8 @@ import unittest
 import subprocess
 import os
 import sys
+import shutil
+import tempfile
 
 gArmInitialized = False
 gUseArm = True
@@ -199,6 +201,16 @@ class TestACC(unittest.TestCase):
         self.compileCheck(["-R", "data/continue.c"],
         "Executing compiled code:\nresult: 400\n")
 
+    def testCache(self):
+        cacheDir = tempfile.mkdtemp()
+        try:
+            # The first run fills the cache, the second one may use it.
+            for i in range(2):
+                self.compileCheck(["-C", cacheDir, "-R", "data/continue.c"],
+                "Executing compiled code:\nresult: 400\n", "", ['x86'])
+        finally:
+            shutil.rmtree(cacheDir)
+
     def testStringLiteralConcatenation(self):
         self.compileCheck(["-R", "data/testStringConcat.c"],
         "Executing compiled code:\nresult: 13\n", "Hello, world\n")
@@ -12,6 +12,24 @@ LOCAL_MODULE := libpixelflinger_armv6
 include $(BUILD_STATIC_LIBRARY)
 endif
 
+#
+# x86 SSE2 and AVX2 objects, only called once the CPU has been checked
+#
+
+ifneq ($(filter x86 x86_64,$(TARGET_ARCH)),)
+include $(CLEAR_VARS)
+LOCAL_CFLAGS := -msse2
+LOCAL_SRC_FILES := scanline_sse2.cpp
+LOCAL_MODULE := libpixelflinger_sse2
+include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_CFLAGS := -mavx2
+LOCAL_SRC_FILES := scanline_avx2.cpp
+LOCAL_MODULE := libpixelflinger_avx2
+include $(BUILD_STATIC_LIBRARY)
+endif
+
 #
 # C/C++ and ARMv5 objects
 #
@@ -37,7 +55,8 @@ PIXELFLINGER_SRC_FILES:= \
 	format.cpp \
 	clear.cpp \
 	raster.cpp \
-	buffer.cpp
+	buffer.cpp \
+	bands.cpp
 
 ifeq ($(TARGET_ARCH),arm)
 ifeq ($(TARGET_ARCH_VERSION),armv7-a)
@@ -49,11 +68,20 @@ PIXELFLINGER_SRC_FILES += col32cb16blend.S
 endif
 endif
 
+ifeq ($(TARGET_ARCH),x86_64)
+PIXELFLINGER_SRC_FILES += codeflinger/X86_64Assembler.cpp
+endif
+
 ifeq ($(TARGET_ARCH),arm)
 # special optimization flags for pixelflinger
 PIXELFLINGER_CFLAGS += -fstrict-aliasing -fomit-frame-pointer
 endif
 
+ifneq ($(filter x86 x86_64,$(TARGET_ARCH)),)
+# scanline.cpp calls into libpixelflinger_sse2 and libpixelflinger_avx2
+PIXELFLINGER_CFLAGS += -DANDROID_X86_SIMD=1
+endif
+
 LOCAL_SHARED_LIBRARIES := libcutils
 
 ifneq ($(TARGET_ARCH),arm)
@@ -81,6 +109,9 @@ endif
 ifeq ($(TARGET_ARCH),arm)
 LOCAL_WHOLE_STATIC_LIBRARIES := libpixelflinger_armv6
 endif
+ifneq ($(filter x86 x86_64,$(TARGET_ARCH)),)
+LOCAL_WHOLE_STATIC_LIBRARIES := libpixelflinger_sse2 libpixelflinger_avx2
+endif
 include $(BUILD_SHARED_LIBRARY)
 
 #
@@ -94,6 +125,9 @@ LOCAL_CFLAGS := $(PIXELFLINGER_CFLAGS)
 ifeq ($(TARGET_ARCH),arm)
 LOCAL_WHOLE_STATIC_LIBRARIES := libpixelflinger_armv6
 endif
+ifneq ($(filter x86 x86_64,$(TARGET_ARCH)),)
+LOCAL_WHOLE_STATIC_LIBRARIES := libpixelflinger_sse2 libpixelflinger_avx2
+endif
 include $(BUILD_STATIC_LIBRARY)
 
 
@@ -0,0 +1,255 @@
+/* libs/pixelflinger/bands.cpp
+**
+** Copyright 2010, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License"); 
+** you may not use this file except in compliance with the License. 
+** You may obtain a copy of the License at 
+**
+**     http://www.apache.org/licenses/LICENSE-2.0 
+**
+** Unless required by applicable law or agreed to in writing, software 
+** distributed under the License is distributed on an "AS IS" BASIS, 
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+** See the License for the specific language governing permissions and 
+** limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "bands.h"
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Each band is rendered with a private copy of the context, so that the
+ * iterators (and the coverage buffer, for antialiasing) aren't shared.
+ * The copy only differs by its vertical scissor, and the primitives clip
+ * against it exactly as they would against a user scissor: all iterators
+ * are computed from the absolute y coordinate by init_y() and then stepped
+ * with integer additions, so a row comes out the same whether it is
+ * reached from the top of the primitive or from the top of its band.
+ *
+ * The calling thread renders the first band and waits for the others.
+ */
+
+#define GGL_MAX_BANDS       16
+#define BANDS_MIN_ROWS      8       // per band
+#define BANDS_MIN_PIXELS    16384   // per primitive
+
+struct bands_t;
+
+struct band_t {
+    bands_t*        bands;
+    int             index;
+    pthread_t       thread;
+    void*           base;
+    context_t*      c;
+    int16_t*        coverage;
+    size_t          coverageSize;
+};
+
+struct bands_t {
+    int             count;
+    pthread_mutex_t lock;
+    pthread_cond_t  work;
+    pthread_cond_t  done;
+    uint32_t        generation;
+    int             pending;
+    bool            quit;
+
+    // the job being rendered
+    context_t*      source;
+    band_func_t     func;
+    const void*     arg;
+    int32_t         top;
+    int32_t         rows;
+    int             active;
+
+    band_t          band[GGL_MAX_BANDS];
+};
+
+static void draw_band(bands_t* b, band_t& band)
+{
+    const context_t* src = b->source;
+    const int32_t top    = b->top + (b->rows *  band.index   ) / b->active;
+    const int32_t bottom = b->top + (b->rows * (band.index+1)) / b->active;
+
+    context_t* const c = band.c;
+    memcpy(c, src, sizeof(context_t));
+    c->bands = 0;
+    c->state.scissor.top = top;
+    c->state.scissor.bottom = bottom;
+    if (src->state.buffers.coverage) {
+        c->state.buffers.coverage = band.coverage;
+    }
+    b->func(c, b->arg, top, bottom);
+}
+
+static void* band_thread(void* arg)
+{
+    band_t& band = *(band_t*)arg;
+    bands_t* const b = band.bands;
+    uint32_t generation = 0;
+
+    pthread_mutex_lock(&b->lock);
+    while (true) {
+        while (!b->quit && b->generation == generation)
+            pthread_cond_wait(&b->work, &b->lock);
+        if (b->quit)
+            break;
+        generation = b->generation;
+        if (band.index < b->active) {
+            pthread_mutex_unlock(&b->lock);
+            draw_band(b, band);
+            pthread_mutex_lock(&b->lock);
+            if (--b->pending == 0)
+                pthread_cond_signal(&b->done);
+        }
+    }
+    pthread_mutex_unlock(&b->lock);
+    return 0;
+}
+
+static void free_bands(bands_t* b)
+{
+    pthread_mutex_lock(&b->lock);
+    b->quit = true;
+    pthread_cond_broadcast(&b->work);
+    pthread_mutex_unlock(&b->lock);
+    for (int i=0 ; i<b->count ; i++) {
+        band_t& band = b->band[i];
+        if (i > 0)
+            pthread_join(band.thread, 0);
+        free(band.coverage);
+        free(band.base);
+    }
+    pthread_cond_destroy(&b->done);
+    pthread_cond_destroy(&b->work);
+    pthread_mutex_destroy(&b->lock);
+    free(b);
+}
+
+// ----------------------------------------------------------------------------
+
+void ggl_init_bands(context_t* c)
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.pf.threads", value, "0");
+    c->bands = 0;
+    ggl_set_bands(c, atoi(value));
+}
+
+void ggl_uninit_bands(context_t* c)
+{
+    ggl_set_bands(c, 0);
+}
+
+int ggl_set_bands(context_t* c, int threads)
+{
+    if (c->bands) {
+        free_bands(c->bands);
+        c->bands = 0;
+    }
+    if (threads > GGL_MAX_BANDS)
+        threads = GGL_MAX_BANDS;
+    if (threads <= 1)
+        return 1;
+
+    bands_t* b = (bands_t*)calloc(1, sizeof(bands_t));
+    if (!b)
+        return 1;
+    pthread_mutex_init(&b->lock, 0);
+    pthread_cond_init(&b->work, 0);
+    pthread_cond_init(&b->done, 0);
+
+    // band 0 is rendered by the calling thread
+    for (int i=0 ; i<threads ; i++) {
+        band_t& band = b->band[i];
+        band.bands = b;
+        band.index = i;
+        band.base = malloc(sizeof(context_t) + 32);
+        if (!band.base)
+            break;
+        // same alignment as the context itself, see gglInit()
+        band.c = (context_t*)((ptrdiff_t(band.base)+31) & ~0x1FL);
+        if (i > 0 && pthread_create(&band.thread, 0, band_thread, &band)) {
+            LOGW("can't create rasterizer thread %d", i);
+            free(band.base);
+            break;
+        }
+        b->count++;
+    }
+    if (b->count <= 1) {
+        free_bands(b);
+        return 1;
+    }
+    c->bands = b;
+    return b->count;
+}
+
+bool ggl_draw_bands(context_t* c, int32_t top, int32_t bottom,
+        size_t pixels, band_func_t func, const void* arg)
+{
+    bands_t* const b = c->bands;
+    if (ggl_likely(!b) || pixels < BANDS_MIN_PIXELS)
+        return false;
+
+    if (top < int32_t(c->state.scissor.top))
+        top = c->state.scissor.top;
+    if (bottom > int32_t(c->state.scissor.bottom))
+        bottom = c->state.scissor.bottom;
+    const int32_t rows = bottom - top;
+    int active = rows / BANDS_MIN_ROWS;
+    if (active > b->count)
+        active = b->count;
+    if (active <= 1)
+        return false;
+
+    // the coverage buffers are sized like the context's
+    if (c->state.buffers.coverage) {
+        const size_t size = c->state.buffers.coverageBufferSize;
+        for (int i=0 ; i<active ; i++) {
+            band_t& band = b->band[i];
+            if (band.coverageSize < size) {
+                int16_t* coverage =
+                        (int16_t*)realloc(band.coverage, size * 2);
+                if (!coverage)
+                    return false;
+                band.coverage = coverage;
+                band.coverageSize = size;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&b->lock);
+    b->source = c;
+    b->func = func;
+    b->arg = arg;
+    b->top = top;
+    b->rows = rows;
+    b->active = active;
+    b->pending = active - 1;
+    b->generation++;
+    pthread_cond_broadcast(&b->work);
+    pthread_mutex_unlock(&b->lock);
+
+    draw_band(b, b->band[0]);
+
+    pthread_mutex_lock(&b->lock);
+    while (b->pending)
+        pthread_cond_wait(&b->done, &b->lock);
+    pthread_mutex_unlock(&b->lock);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+}; // namespace android
@@ -0,0 +1,47 @@
+/* libs/pixelflinger/bands.h
+**
+** Copyright 2010, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License"); 
+** you may not use this file except in compliance with the License. 
+** You may obtain a copy of the License at 
+**
+**     http://www.apache.org/licenses/LICENSE-2.0 
+**
+** Unless required by applicable law or agreed to in writing, software 
+** distributed under the License is distributed on an "AS IS" BASIS, 
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+** See the License for the specific language governing permissions and 
+** limitations under the License.
+*/
+
+#ifndef ANDROID_GGL_BANDS_H
+#define ANDROID_GGL_BANDS_H
+
+#include <pixelflinger/pixelflinger.h>
+#include <private/pixelflinger/ggl_context.h>
+
+namespace android {
+
+// renders the part of a primitive that lies in [top, bottom), with a
+// context of its own whose vertical scissor is that band
+typedef void (*band_func_t)(context_t* c, const void* arg,
+        int32_t top, int32_t bottom);
+
+void ggl_init_bands(context_t* c);
+void ggl_uninit_bands(context_t* c);
+
+// sets the number of threads rasterizing for this context, including the
+// calling one; 0 or 1 rasterizes on the calling thread only
+int ggl_set_bands(context_t* c, int threads);
+
+// Splits the rows [top, bottom) in horizontal bands and calls func() for
+// each band, on the context's worker threads. Returns false without doing
+// anything if the context is single-threaded or if 'pixels' (an estimate
+// of the area touched) is too small to be worth it.
+bool ggl_draw_bands(context_t* c, int32_t top, int32_t bottom,
+        size_t pixels, band_func_t func, const void* arg);
+
+}; // namespace android
+
+#endif // ANDROID_GGL_BANDS_H
@@ -17,6 +17,7 @@
 
 #include <cutils/memory.h>
 
+#include "bands.h"
 #include "clear.h"
 #include "buffer.h"
 
@@ -85,6 +86,24 @@ static void memset2d(context_t* c, const surface_t& s, uint32_t packed,
     }    
 }
 
+struct clear_t {
+    GGLbitfield mask;
+    uint32_t    l, w;
+};
+
+static void clear_band(context_t* c, const void* arg, int32_t t, int32_t b)
+{
+    const clear_t& clear = *(const clear_t*)arg;
+    if (clear.mask & GGL_COLOR_BUFFER_BIT) {
+        memset2d(c, c->state.buffers.color, c->state.clear.colorPacked,
+                clear.l, t, clear.w, b - t);
+    }
+    if (clear.mask & GGL_DEPTH_BUFFER_BIT) {
+        memset2d(c, c->state.buffers.depth, c->state.clear.depthPacked,
+                clear.l, t, clear.w, b - t);
+    }
+}
+
 static inline GGLfixed fixedToZ(GGLfixed z) {
     return GGLfixed(((int64_t(z) << 16) - z) >> 16);
 }
@@ -127,8 +146,6 @@ static void ggl_clear(void* con, GGLbitfield mask)
 
             c->state.clear.colorPacked = GGL_HOST_TO_RGBA(colorPacked);
         }
-        const uint32_t packed = c->state.clear.colorPacked;
-        memset2d(c, c->state.buffers.color, packed, l, t, w, h);
     }
     if (mask & GGL_DEPTH_BUFFER_BIT) {
         if (c->state.clear.dirty & GGL_DEPTH_BUFFER_BIT) {
@@ -136,8 +153,11 @@ static void ggl_clear(void* con, GGLbitfield mask)
             uint32_t depth = fixedToZ(c->state.clear.depth);
             c->state.clear.depthPacked = (depth<<16)|depth;
         }
-        const uint32_t packed = c->state.clear.depthPacked;
-        memset2d(c, c->state.buffers.depth, packed, l, t, w, h);
+    }
+
+    const clear_t clear = { mask, l, w };
+    if (!ggl_draw_bands(c, t, t+h, w*h, clear_band, &clear)) {
+        clear_band(c, &clear, t, t+h);
     }
 
     // XXX: do stencil buffer
@@ -32,6 +32,16 @@ ARMAssemblerInterface::~ARMAssemblerInterface()
 {
 }
 
+void ARMAssemblerInterface::ADDR_LDR(int cc, int Rd, int Rn, uint32_t offset)
+{
+    LDR(cc, Rd, Rn, offset);
+}
+
+void ARMAssemblerInterface::ADDR_STR(int cc, int Rd, int Rn, uint32_t offset)
+{
+    STR(cc, Rd, Rn, offset);
+}
+
 int ARMAssemblerInterface::buildImmediate(
         uint32_t immediate, uint32_t& rot, uint32_t& imm)
 {
@@ -160,6 +160,13 @@ public:
     virtual void STRH (int cc, int Rd,
                 int Rn, uint32_t offset = immed8_pre(0)) = 0;
 
+    // pointer-sized data transfer (context fields holding an address),
+    // a plain LDR/STR unless the target has 64-bit pointers
+    virtual void ADDR_LDR(int cc, int Rd,
+                int Rn, uint32_t offset = immed12_pre(0));
+    virtual void ADDR_STR(int cc, int Rd,
+                int Rn, uint32_t offset = immed12_pre(0));
+
     // block data transfer...
     virtual void LDM(int cc, int dir,
                 int Rn, int W, uint32_t reg_list) = 0;
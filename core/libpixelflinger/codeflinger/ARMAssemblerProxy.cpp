@@ -142,6 +142,12 @@ void ARMAssemblerProxy::LDRSH(int cc, int Rd, int Rn, uint32_t offset) {
 void ARMAssemblerProxy::STRH(int cc, int Rd, int Rn, uint32_t offset) {
     mTarget->STRH(cc, Rd, Rn, offset);
 }
+void ARMAssemblerProxy::ADDR_LDR(int cc, int Rd, int Rn, uint32_t offset) {
+    mTarget->ADDR_LDR(cc, Rd, Rn, offset);
+}
+void ARMAssemblerProxy::ADDR_STR(int cc, int Rd, int Rn, uint32_t offset) {
+    mTarget->ADDR_STR(cc, Rd, Rn, offset);
+}
 void ARMAssemblerProxy::LDM(int cc, int dir, int Rn, int W, uint32_t reg_list) {
     mTarget->LDM(cc, dir, Rn, W, reg_list);
 }
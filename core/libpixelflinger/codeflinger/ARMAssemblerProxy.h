@@ -88,6 +88,10 @@ public:
                 int Rn, uint32_t offset = immed8_pre(0));
     virtual void STRH (int cc, int Rd,
                 int Rn, uint32_t offset = immed8_pre(0));
+    virtual void ADDR_LDR(int cc, int Rd,
+                int Rn, uint32_t offset = immed12_pre(0));
+    virtual void ADDR_STR(int cc, int Rd,
+                int Rn, uint32_t offset = immed12_pre(0));
     virtual void LDM(int cc, int dir,
                 int Rn, int W, uint32_t reg_list);
     virtual void STM(int cc, int dir,
@@ -17,10 +17,22 @@
 
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+#ifdef __ARM_ARCH__
+#include <machine/cpu-features.h>
+#endif
 
 #include <cutils/log.h>
 #include <cutils/atomic.h>
@@ -104,26 +116,199 @@ void Assembly::ensureMbaseExecutable()
 
 // ----------------------------------------------------------------------------
 
+// Bump this whenever the generated code changes in any way (GGLAssembler,
+// the assemblers, or the layout of context_t), it invalidates the
+// assemblies stored on disk.
+#define CODE_CACHE_VERSION      1
+
+#define CODE_CACHE_MAGIC        0x43434650  // 'PFCC'
+#define CODE_CACHE_MAX_CODE     (256 * 1024)
+
+struct code_file_header_t {
+    uint32_t    magic;
+    uint32_t    signature;
+    uint32_t    keyLength;
+    uint32_t    codeLength;
+};
+
+// FNV-1a
+static uint32_t hash_bytes(const void* data, size_t length,
+        uint32_t h = 2166136261U)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    while (length--) {
+        h ^= *p++;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+// identifies the code generator and the CPU it generates code for
+static uint32_t code_signature()
+{
+    uint32_t h = hash_bytes(NULL, 0);
+    const uint32_t version[] = { CODE_CACHE_VERSION, sizeof(void*) };
+    h = hash_bytes(version, sizeof(version), h);
+#if defined(__i386__) || defined(__x86_64__)
+    unsigned int cpu[4];
+    if (__get_cpuid(0, &cpu[0], &cpu[1], &cpu[2], &cpu[3]))
+        h = hash_bytes(cpu, sizeof(cpu), h);
+    if (__get_cpuid(1, &cpu[0], &cpu[1], &cpu[2], &cpu[3])) {
+        cpu[1] = 0;     // APIC id, differs from core to core
+        h = hash_bytes(cpu, sizeof(cpu), h);
+    }
+#elif defined(__ARM_ARCH__)
+    const uint32_t arch = __ARM_ARCH__;
+    h = hash_bytes(&arch, sizeof(arch), h);
+#endif
+    return h;
+}
+
+static bool read_fully(int fd, void* data, size_t length)
+{
+    uint8_t* p = (uint8_t*)data;
+    while (length) {
+        ssize_t n = read(fd, p, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        length -= n;
+    }
+    return true;
+}
+
+static bool write_fully(int fd, const void* data, size_t length)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    while (length) {
+        ssize_t n = write(fd, p, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        length -= n;
+    }
+    return true;
+}
+
+// the cache holds code we are going to run, so only trust files and
+// directories that nobody but us could have written
+static bool is_private(const struct stat& st)
+{
+    return st.st_uid == getuid() && !(st.st_mode & (S_IRWXG | S_IRWXO));
+}
+
+// ----------------------------------------------------------------------------
+
 CodeCache::CodeCache(size_t size)
-    : mCacheSize(size), mCacheInUse(0)
+    : mCacheSize(size), mCacheInUse(0), mCount(0),
+      mBuckets(0), mBucketCount(0), mHead(0), mTail(0),
+      mHits(0), mMisses(0), mEvictions(0), mLoads(0), mStores(0),
+      mPath(0), mSignature(code_signature())
 {
     pthread_mutex_init(&mLock, 0);
 }
 
 CodeCache::~CodeCache()
 {
+    cache_entry_t* e = mHead;
+    while (e) {
+        cache_entry_t* next = e->next;
+        delete e;
+        e = next;
+    }
+    free(mBuckets);
+    free(mPath);
     pthread_mutex_destroy(&mLock);
 }
 
+CodeCache::cache_entry_t* CodeCache::find(
+        const AssemblyKeyBase& key, uint32_t hash) const
+{
+    if (!mBucketCount)
+        return 0;
+    cache_entry_t* e = mBuckets[hash & (mBucketCount-1)];
+    while (e) {
+        if (e->hash == hash && !e->key->compare_type(key))
+            return e;
+        e = e->chain;
+    }
+    return 0;
+}
+
+void CodeCache::lruUnlink(cache_entry_t* e) const
+{
+    if (e->prev)    e->prev->next = e->next;
+    else            mHead = e->next;
+    if (e->next)    e->next->prev = e->prev;
+    else            mTail = e->prev;
+}
+
+void CodeCache::lruPushFront(cache_entry_t* e) const
+{
+    e->prev = 0;
+    e->next = mHead;
+    if (mHead)      mHead->prev = e;
+    else            mTail = e;
+    mHead = e;
+}
+
+void CodeCache::remove(cache_entry_t* e)
+{
+    cache_entry_t** p = &mBuckets[e->hash & (mBucketCount-1)];
+    while (*p != e)
+        p = &(*p)->chain;
+    *p = e->chain;
+    lruUnlink(e);
+    mCacheInUse -= e->entry->size();
+    mCount--;
+    delete e;
+}
+
+void CodeCache::evict(size_t needed)
+{
+    // an assembly larger than the whole cache ends up alone in it
+    while (mTail && mCacheInUse + needed > mCacheSize) {
+        remove(mTail);
+        mEvictions++;
+    }
+}
+
+void CodeCache::grow()
+{
+    const size_t count = mBucketCount ? mBucketCount*2 : 16;
+    cache_entry_t** buckets =
+            (cache_entry_t**)calloc(count, sizeof(cache_entry_t*));
+    if (!buckets)
+        return; // keep the current table, the chains just get longer
+    for (cache_entry_t* e = mHead ; e ; e = e->next) {
+        cache_entry_t** b = &buckets[e->hash & (count-1)];
+        e->chain = *b;
+        *b = e;
+    }
+    free(mBuckets);
+    mBuckets = buckets;
+    mBucketCount = count;
+}
+
 sp<Assembly> CodeCache::lookup(const AssemblyKeyBase& keyBase) const
 {
+    const uint32_t hash = hash_bytes(keyBase.data(), keyBase.length());
     pthread_mutex_lock(&mLock);
     sp<Assembly> r;
-    ssize_t index = mCacheData.indexOfKey(key_t(keyBase));
-    if (index >= 0) {
-        const cache_entry_t& e = mCacheData.valueAt(index);
-        e.when = mWhen++;
-        r = e.entry;
+    cache_entry_t* e = find(keyBase, hash);
+    if (e) {
+        if (e != mHead) {
+            lruUnlink(e);
+            lruPushFront(e);
+        }
+        r = e->entry;
+        mHits++;
+    } else {
+        mMisses++;
     }
     pthread_mutex_unlock(&mLock);
     return r;
@@ -132,28 +317,37 @@ sp<Assembly> CodeCache::lookup(const AssemblyKeyBase& keyBase) const
 int CodeCache::cache(  const AssemblyKeyBase& keyBase,
                             const sp<Assembly>& assembly)
 {
+    const uint32_t hash = hash_bytes(keyBase.data(), keyBase.length());
     pthread_mutex_lock(&mLock);
 
-    const ssize_t assemblySize = assembly->size();
-    while (mCacheInUse + assemblySize > mCacheSize) {
-        // evict the LRU
-        size_t lru = 0;
-        size_t count = mCacheData.size();
-        for (size_t i=0 ; i<count ; i++) {
-            const cache_entry_t& e = mCacheData.valueAt(i);
-            if (e.when < mCacheData.valueAt(lru).when) {
-                lru = i;
-            }
-        }
-        const cache_entry_t& e = mCacheData.valueAt(lru);
-        mCacheInUse -= e.entry->size();
-        mCacheData.removeItemsAt(lru);
+    // another thread may have generated the same code in the meantime
+    cache_entry_t* e = find(keyBase, hash);
+    if (e) {
+        remove(e);
+        e = 0;
     }
 
-    ssize_t err = mCacheData.add(key_t(keyBase), cache_entry_t(assembly, mWhen));
-    if (err >= 0) {
+    const ssize_t assemblySize = assembly->size();
+    evict(assemblySize);
+
+    int err = NO_MEMORY;
+    if (mCount >= mBucketCount) {
+        grow();
+    }
+    if (mBucketCount) {
+        e = new cache_entry_t;
+    }
+    if (e) {
+        e->key = &keyBase;
+        e->hash = hash;
+        e->entry = assembly;
+        cache_entry_t** b = &mBuckets[hash & (mBucketCount-1)];
+        e->chain = *b;
+        *b = e;
+        lruPushFront(e);
         mCacheInUse += assemblySize;
-        mWhen++;
+        mCount++;
+        err = NO_ERROR;
         // synchronize caches...
 #if defined(__arm__)
         const long base = long(assembly->base());
@@ -168,6 +362,162 @@ int CodeCache::cache(  const AssemblyKeyBase& keyBase,
     return err;
 }
 
+void CodeCache::setSize(size_t size)
+{
+    pthread_mutex_lock(&mLock);
+    mCacheSize = size;
+    evict(0);
+    pthread_mutex_unlock(&mLock);
+}
+
+void CodeCache::getStats(stats_t* stats) const
+{
+    pthread_mutex_lock(&mLock);
+    stats->size = mCacheSize;
+    stats->inUse = mCacheInUse;
+    stats->entries = mCount;
+    stats->hits = mHits;
+    stats->misses = mMisses;
+    stats->evictions = mEvictions;
+    stats->loads = mLoads;
+    stats->stores = mStores;
+    pthread_mutex_unlock(&mLock);
+}
+
+// ----------------------------------------------------------------------------
+
+void CodeCache::setPersistentPath(const char* path)
+{
+    pthread_mutex_lock(&mLock);
+    free(mPath);
+    mPath = 0;
+    if (path && path[0]) {
+        struct stat st;
+        if (path[0] != '/') {
+            LOGW("code cache directory %s is not an absolute path", path);
+        } else if (mkdir(path, 0700) < 0 && errno != EEXIST) {
+            LOGW("can't create code cache directory %s (%s)",
+                    path, strerror(errno));
+        } else if (lstat(path, &st) < 0 || !S_ISDIR(st.st_mode) ||
+                !is_private(st)) {
+            // lstat() so that a symlink to someone else's directory fails
+            LOGW("code cache directory %s is not a directory private "
+                    "to uid %d", path, int(getuid()));
+        } else {
+            mPath = strdup(path);
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+void CodeCache::fileName(char* name, size_t size, uint32_t hash) const
+{
+    snprintf(name, size, "%s/%08x-%08x", mPath, mSignature, hash);
+}
+
+int CodeCache::load(const AssemblyKeyBase& keyBase,
+        const sp<Assembly>& assembly)
+{
+    char name[PATH_MAX];
+    pthread_mutex_lock(&mLock);
+    const bool enabled = (mPath != 0);
+    if (enabled)
+        fileName(name, sizeof(name),
+                hash_bytes(keyBase.data(), keyBase.length()));
+    pthread_mutex_unlock(&mLock);
+    if (!enabled)
+        return NAME_NOT_FOUND;
+
+    int fd = open(name, O_RDONLY | O_NOFOLLOW);
+    if (fd < 0)
+        return NAME_NOT_FOUND;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || !is_private(st)) {
+        LOGW("ignoring %s, it is not a regular file private to uid %d",
+                name, int(getuid()));
+        close(fd);
+        return NAME_NOT_FOUND;
+    }
+
+    int err = NAME_NOT_FOUND;
+    code_file_header_t header;
+    const size_t keyLength = keyBase.length();
+    uint8_t* key = (uint8_t*)malloc(keyLength);
+    if (key &&
+        read_fully(fd, &header, sizeof(header)) &&
+        header.magic == CODE_CACHE_MAGIC &&
+        header.signature == mSignature &&
+        header.keyLength == keyLength &&
+        header.codeLength > 0 &&
+        header.codeLength <= CODE_CACHE_MAX_CODE &&
+        read_fully(fd, key, keyLength) &&
+        !memcmp(key, keyBase.data(), keyLength))
+    {
+        // the caller generates the code itself if this fails, give it
+        // its buffer back
+        const ssize_t size = assembly->size();
+        if (assembly->resize(header.codeLength) >= 0 &&
+            read_fully(fd, assembly->base(), header.codeLength)) {
+            err = NO_ERROR;
+        } else {
+            assembly->resize(size);
+        }
+    }
+    free(key);
+    close(fd);
+
+    if (err == NO_ERROR) {
+        pthread_mutex_lock(&mLock);
+        mLoads++;
+        pthread_mutex_unlock(&mLock);
+    }
+    return err;
+}
+
+int CodeCache::store(const AssemblyKeyBase& keyBase,
+        const sp<Assembly>& assembly)
+{
+    char name[PATH_MAX];
+    pthread_mutex_lock(&mLock);
+    const bool enabled = (mPath != 0);
+    if (enabled)
+        fileName(name, sizeof(name),
+                hash_bytes(keyBase.data(), keyBase.length()));
+    pthread_mutex_unlock(&mLock);
+    if (!enabled)
+        return NO_ERROR;
+
+    // write to a temporary file first, so that other processes never
+    // see a partial file. mkstemp() gives every thread its own file, and
+    // creates it 0600.
+    char temp[PATH_MAX];
+    snprintf(temp, sizeof(temp), "%s.XXXXXX", name);
+    int fd = mkstemp(temp);
+    if (fd < 0)
+        return -errno;
+
+    code_file_header_t header;
+    header.magic = CODE_CACHE_MAGIC;
+    header.signature = mSignature;
+    header.keyLength = keyBase.length();
+    header.codeLength = assembly->size();
+    bool ok = write_fully(fd, &header, sizeof(header)) &&
+              write_fully(fd, keyBase.data(), header.keyLength) &&
+              write_fully(fd, assembly->base(), header.codeLength);
+    if (close(fd) < 0)
+        ok = false;
+    if (!ok || rename(temp, name) < 0) {
+        int err = -errno;
+        unlink(temp);
+        return err ? err : -EIO;
+    }
+
+    pthread_mutex_lock(&mLock);
+    mStores++;
+    pthread_mutex_unlock(&mLock);
+    return NO_ERROR;
+}
+
 // ----------------------------------------------------------------------------
 
 }; // namespace android
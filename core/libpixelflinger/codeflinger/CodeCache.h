@@ -24,7 +24,8 @@
 #include <sys/types.h>
 #include <cutils/mspace.h>
 
-#include "tinyutils/KeyedVector.h"
+#include "tinyutils/Errors.h"
+#include "tinyutils/TypeHelpers.h"
 #include "tinyutils/smartpointer.h"
 
 namespace android {
@@ -35,8 +36,12 @@ class AssemblyKeyBase {
 public:
     virtual ~AssemblyKeyBase() { }
     virtual int compare_type(const AssemblyKeyBase& key) const = 0;
+    // the key as raw bytes, for hashing and for the persistent cache
+    virtual const void* data() const = 0;
+    virtual size_t length() const = 0;
 };
 
+// T must be a POD type
 template  <typename T>
 class AssemblyKey : public AssemblyKeyBase
 {
@@ -46,6 +51,8 @@ public:
         const T& rhs = static_cast<const AssemblyKey&>(key).mKey;
         return android::compare_type(mKey, rhs);
     }
+    virtual const void* data() const { return &mKey; }
+    virtual size_t length() const { return sizeof(T); }
 private:
     T mKey;
 };
@@ -78,9 +85,32 @@ private:
 
 // ----------------------------------------------------------------------------
 
+/*
+ * CodeCache keeps the most recently used assemblies, up to a total size.
+ * Entries are found through a hash table and kept on a list in LRU order,
+ * so lookups and evictions don't depend on the number of entries.
+ *
+ * Optionally, assemblies are also written to a directory, so that the
+ * next process needing the same code can load it instead of generating
+ * it again. The generated code must be position independent for this.
+ * Files are tagged with a signature of the CPU and of the code generator
+ * (see CODE_CACHE_VERSION), and ignored if they don't match.
+ */
+
 class CodeCache
 {
 public:
+    struct stats_t {
+        size_t      size;           // maximum size in bytes
+        size_t      inUse;          // bytes used by the cached assemblies
+        size_t      entries;
+        uint32_t    hits;
+        uint32_t    misses;
+        uint32_t    evictions;
+        uint32_t    loads;          // assemblies found on disk
+        uint32_t    stores;         // assemblies written to disk
+    };
+
 // pretty simple cache API...
                 CodeCache(size_t size);
                 ~CodeCache();
@@ -90,46 +120,62 @@ public:
             int                 cache(  const AssemblyKeyBase& key,
                                         const sp<Assembly>& assembly);
 
+            // changes the maximum size, evicting entries as needed
+            void                setSize(size_t size);
+
+            void                getStats(stats_t* stats) const;
+
+            // enables the persistent cache in the given directory,
+            // NULL or "" disables it. the directory must be an absolute
+            // path, owned by our uid and closed to group and others.
+            void                setPersistentPath(const char* path);
+
+            // fills 'assembly' with the code stored on disk for 'key'.
+            // returns NO_ERROR, or NAME_NOT_FOUND if there is no usable
+            // copy of it.
+            int                 load(   const AssemblyKeyBase& key,
+                                        const sp<Assembly>& assembly);
+
+            // writes 'assembly' to disk, if the persistent cache is enabled
+            int                 store(  const AssemblyKeyBase& key,
+                                        const sp<Assembly>& assembly);
+
 private:
     // nothing to see here...
     struct cache_entry_t {
-        inline cache_entry_t() { }
-        inline cache_entry_t(const sp<Assembly>& a, int64_t w)
-                : entry(a), when(w) { }
+        const AssemblyKeyBase*  key;    // owned by the assembly
+        uint32_t                hash;
         sp<Assembly>            entry;
-        mutable int64_t         when;
+        cache_entry_t*          prev;   // LRU list, most recent first
+        cache_entry_t*          next;
+        cache_entry_t*          chain;  // next entry in the same bucket
     };
 
-    class key_t {
-        friend int compare_type(
-            const key_value_pair_t<key_t, cache_entry_t>&,
-            const key_value_pair_t<key_t, cache_entry_t>&);
-        const AssemblyKeyBase* mKey;
-    public:
-        key_t() { };
-        key_t(const AssemblyKeyBase& k) : mKey(&k)  { }
-    };
+    cache_entry_t*  find(const AssemblyKeyBase& key, uint32_t hash) const;
+    void            lruUnlink(cache_entry_t* e) const;
+    void            lruPushFront(cache_entry_t* e) const;
+    void            remove(cache_entry_t* e);
+    void            evict(size_t needed);
+    void            grow();
+    void            fileName(char* name, size_t size, uint32_t hash) const;
 
     mutable pthread_mutex_t             mLock;
-    mutable int64_t                     mWhen;
     size_t                              mCacheSize;
     size_t                              mCacheInUse;
-    KeyedVector<key_t, cache_entry_t>   mCacheData;
-
-    friend int compare_type(
-        const key_value_pair_t<key_t, cache_entry_t>&,
-        const key_value_pair_t<key_t, cache_entry_t>&);
+    size_t                              mCount;
+    cache_entry_t**                     mBuckets;
+    size_t                              mBucketCount;   // power of 2
+    mutable cache_entry_t*              mHead;
+    mutable cache_entry_t*              mTail;
+    mutable uint32_t                    mHits;
+    mutable uint32_t                    mMisses;
+    uint32_t                            mEvictions;
+    uint32_t                            mLoads;
+    uint32_t                            mStores;
+    char*                               mPath;
+    uint32_t                            mSignature;
 };
 
-// KeyedVector uses compare_type(), which is more efficient, than
-// just using operator < ()
-inline int compare_type(
-    const key_value_pair_t<CodeCache::key_t, CodeCache::cache_entry_t>& lhs,
-    const key_value_pair_t<CodeCache::key_t, CodeCache::cache_entry_t>& rhs)
-{
-    return lhs.key.mKey->compare_type(*(rhs.key.mKey));
-}
-
 // ----------------------------------------------------------------------------
 
 }; // namespace android
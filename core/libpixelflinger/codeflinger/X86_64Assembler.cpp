@@ -0,0 +1,1576 @@
+/* libs/pixelflinger/codeflinger/X86_64Assembler.cpp
+**
+** Copyright 2010, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#define LOG_TAG "X86_64Assembler"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include <private/pixelflinger/ggl_context.h>
+
+#include "codeflinger/X86_64Assembler.h"
+
+// ----------------------------------------------------------------------------
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+// x86-64 registers
+enum {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    X8, X9, X10, X11, X12, X13, X14, X15
+};
+
+// x86 condition codes
+enum {
+    xO, xNO, xB, xAE, xE, xNE, xBE, xA,
+    xS, xNS, xP, xNP, xL, xGE, xLE, xG
+};
+
+// x86 ALU operations (opcode /digit)
+enum {
+    xADD, xOR, xADC, xSBB, xAND, xSUB, xXOR, xCMP
+};
+
+// x86 shift operations (opcode /digit)
+enum {
+    xROL, xROR, xRCL, xRCR, xSHL, xSHR, xSAL, xSAR
+};
+
+// ARM register to x86 register. R0 is the context and arrives in rdi.
+// R11 lives in the frame, SP and PC are not available.
+static const int8_t gRegisterMap[16] = {
+    RDI, RSI, RDX, X8, X11, RBX, RBP, X12,
+    X13, X14, X15, -1,  X9,  -1, X10,  -1
+};
+
+// callee-saved x86 registers, in push order, and the ARM register they hold
+static const struct {
+    int8_t arm;
+    int8_t x86;
+} gSavedRegisters[] = {
+    { 5, RBX }, { 6, RBP }, { 7, X12 }, { 8, X13 }, { 9, X14 }, { 10, X15 }
+};
+
+// stack frame
+enum {
+    R11_SLOT    = 0,
+    FLAGS_SLOT  = 8,
+    SPILL_SLOT  = 16,
+    SPILL_MAX   = 16,
+    FRAME_SIZE  = SPILL_SLOT + SPILL_MAX*8
+};
+
+// room for the pushes and the frame allocation in the prolog
+enum { PROLOG_SIZE = 6*2 + 7 };
+
+// ARM flags state
+enum {
+    FLAGS_NONE,         // nothing useful in the flags
+    FLAGS_LIVE,         // EFLAGS holds the ARM flags
+    FLAGS_CLOBBERED     // the ARM flags are only in the frame
+};
+
+// x86 computes a borrow where ARM computes a carry
+enum {
+    FLAGS_CARRY,
+    FLAGS_BORROW
+};
+
+// data transfer kinds
+enum {
+    LDR32, LDRB8, LDRH16, LDRSB8, LDRSH16, LDR64,
+    STR32, STRB8, STRH16, STR64
+};
+
+static inline bool isHalfwordForm(int kind) {
+    return kind==LDRH16 || kind==LDRSB8 || kind==LDRSH16 || kind==STRH16;
+}
+
+static inline bool isStore(int kind) {
+    return kind >= STR32;
+}
+
+// ----------------------------------------------------------------------------
+
+#if 0
+#pragma mark -
+#pragma mark X86_64Assembler...
+#endif
+
+X86_64Assembler::X86_64Assembler(const sp<Assembly>& assembly)
+    :   ARMAssemblerInterface(),
+        mAssembly(assembly)
+{
+    reset();
+    mDuration = ggl_system_time();
+}
+
+X86_64Assembler::~X86_64Assembler()
+{
+}
+
+uint8_t* X86_64Assembler::pc() const
+{
+    return mPC;
+}
+
+uint8_t* X86_64Assembler::base() const
+{
+    return mBase;
+}
+
+void X86_64Assembler::reset()
+{
+    mBase = mPC = (uint8_t*)mAssembly->base();
+    mEnd = mBase + mAssembly->size();
+    mPrologPC = 0;
+    mOverflow = false;
+    mBogusRegister = false;
+    mLongBranch = false;
+    mPointers = LR0;
+    mSpillDepth = 0;
+    mSpillPointers = 0;
+    mFlagsState = FLAGS_NONE;
+    mFlagsPolarity = FLAGS_CARRY;
+    mFlagsSave = 0;
+    mInCond = false;
+    mCondSites = 0;
+    mBranchTargets.clear();
+    mLabels.clear();
+    mLabelsInverseMapping.clear();
+    mComments.clear();
+}
+
+// ----------------------------------------------------------------------------
+
+// there is no x86 disassembler in pixelflinger, dump the code as bytes
+// (objdump -D -b binary -mi386:x86-64 can make sense of it)
+void X86_64Assembler::disassemble(const char* name)
+{
+    if (name) {
+        printf("%s:\n", name);
+    }
+    uint8_t* i = base();
+    int column = 0;
+    while (i < pc()) {
+        ssize_t label = mLabelsInverseMapping.indexOfKey(i);
+        ssize_t comment = mComments.indexOfKey(i);
+        if ((label >= 0 || comment >= 0) && column) {
+            printf("\n");
+            column = 0;
+        }
+        if (label >= 0) {
+            printf("%s:\n", mLabelsInverseMapping.valueAt(label));
+        }
+        if (comment >= 0) {
+            printf("; %s\n", mComments.valueAt(comment));
+        }
+        if (column == 0) {
+            printf("%p:   ", i);
+        }
+        printf(" %02x", *i++);
+        if (++column == 16) {
+            printf("\n");
+            column = 0;
+        }
+    }
+    if (column) {
+        printf("\n");
+    }
+}
+
+void X86_64Assembler::comment(const char* string)
+{
+    mComments.add(mPC, string);
+}
+
+void X86_64Assembler::label(const char* theLabel)
+{
+    mLabels.add(theLabel, mPC);
+    mLabelsInverseMapping.add(mPC, theLabel);
+    // this can be reached from elsewhere: flags that were saved on the
+    // way here may not have been saved on the other paths
+    if (mFlagsState == FLAGS_CLOBBERED)
+        mFlagsState = FLAGS_NONE;
+    mFlagsSave = 0;
+}
+
+uint32_t* X86_64Assembler::pcForLabel(const char* label)
+{
+    return (uint32_t*)mLabels.valueFor(label);
+}
+
+#if 0
+#pragma mark -
+#pragma mark Prolog/Epilog & Generate...
+#endif
+
+void X86_64Assembler::prolog()
+{
+    // leave room for the real prolog, which depends on the
+    // registers we end up using
+    mPrologPC = mPC;
+    for (int i=0 ; i<PROLOG_SIZE ; i++)
+        emit8(0x90);
+    mPointers = LR0;
+    mSpillDepth = 0;
+    mFlagsState = FLAGS_NONE;
+    mFlagsSave = 0;
+}
+
+void X86_64Assembler::epilog(uint32_t touched)
+{
+    const int count = sizeof(gSavedRegisters)/sizeof(*gSavedRegisters);
+
+    // write prolog code, padded with nops at the front
+    uint8_t* pc = mPC;
+    int size = 7;
+    for (int i=0 ; i<count ; i++) {
+        if (touched & (1<<gSavedRegisters[i].arm))
+            size += (gSavedRegisters[i].x86 & 8) ? 2 : 1;
+    }
+    mPC = mPrologPC;
+    static const uint8_t nops[][4] = {
+        { 0 }, { 0x90 }, { 0x66, 0x90 }, { 0x0F, 0x1F, 0x00 },
+        { 0x0F, 0x1F, 0x40, 0x00 }
+    };
+    for (int pad = PROLOG_SIZE - size ; pad > 0 ; ) {
+        const int n = pad > 4 ? 4 : pad;
+        for (int i=0 ; i<n ; i++)
+            emit8(nops[n][i]);
+        pad -= n;
+    }
+    for (int i=0 ; i<count ; i++) {
+        if (touched & (1<<gSavedRegisters[i].arm)) {
+            const int r = gSavedRegisters[i].x86;
+            if (r & 8) emit8(0x41);
+            emit8(0x50 | (r & 7));
+        }
+    }
+    emit8(0x48); emit8(0x81); emit8(0xEC);      // sub rsp, FRAME_SIZE
+    emit32(FRAME_SIZE);
+    mPC = pc;
+
+    // write epilog code
+    emit8(0x48); emit8(0x81); emit8(0xC4);      // add rsp, FRAME_SIZE
+    emit32(FRAME_SIZE);
+    for (int i=count-1 ; i>=0 ; i--) {
+        if (touched & (1<<gSavedRegisters[i].arm)) {
+            const int r = gSavedRegisters[i].x86;
+            if (r & 8) emit8(0x41);
+            emit8(0x58 | (r & 7));
+        }
+    }
+    emit8(0xC3);                                // ret
+    mFlagsState = FLAGS_NONE;
+    mFlagsSave = 0;
+}
+
+int X86_64Assembler::generate(const char* name)
+{
+    if (mOverflow) {
+        LOGE("%s doesn't fit in %d bytes", name, int(mEnd-mBase));
+        return NO_MEMORY;
+    }
+    if (mBogusRegister) {
+        // the register allocator ran out of registers and handed out SP,
+        // GGLAssembler should have retried at a lower optimization level
+        LOGE("%s uses unavailable registers", name);
+        return NO_MEMORY;
+    }
+    if (mLongBranch) {
+        LOGE("%s has a short branch over more than 127 bytes", name);
+        return NO_MEMORY;
+    }
+
+    // fixup all the branches
+    size_t count = mBranchTargets.size();
+    while (count--) {
+        const branch_target_t& bt = mBranchTargets[count];
+        uint8_t* target_pc = mLabels.valueFor(bt.label);
+        LOG_ALWAYS_FATAL_IF(!target_pc,
+                "error resolving branch targets, target_pc is null");
+        int32_t offset = int32_t(target_pc - (bt.pc+4));
+        memcpy(bt.pc, &offset, 4);
+    }
+
+    mAssembly->resize( int(pc()-base()) );
+
+    const int64_t duration = ggl_system_time() - mDuration;
+    const char * const format = "generated %s (%d bytes) at [%p:%p] in %lld ns\n";
+    LOGI(format, name, int(pc()-base()), base(), pc(), (long long)duration);
+
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.pf.disasm", value, "0");
+    if (atoi(value) != 0) {
+        printf(format, name, int(pc()-base()), base(), pc(), (long long)duration);
+        disassemble(name);
+    }
+
+    return NO_ERROR;
+}
+
+#if 0
+#pragma mark -
+#pragma mark Encoding...
+#endif
+
+void X86_64Assembler::emit8(uint32_t b)
+{
+    if (mPC >= mEnd) {
+        mOverflow = true;
+        return;
+    }
+    *mPC++ = uint8_t(b);
+}
+
+void X86_64Assembler::emit32(uint32_t w)
+{
+    emit8(w);
+    emit8(w >> 8);
+    emit8(w >> 16);
+    emit8(w >> 24);
+}
+
+void X86_64Assembler::patch_rel8(uint8_t* site)
+{
+    if (mOverflow)
+        return;
+    const int32_t offset = int32_t(mPC - (site+1));
+    if (offset > 127) {
+        // only used over short fixed sequences, but don't take the
+        // process down if one grows; generate() reports it
+        mLongBranch = true;
+        return;
+    }
+    *site = uint8_t(offset);
+}
+
+void X86_64Assembler::patch_rel32(uint8_t* site)
+{
+    if (mOverflow)
+        return;
+    const int32_t offset = int32_t(mPC - (site+4));
+    memcpy(site, &offset, 4);
+}
+
+void X86_64Assembler::prefix(int size, int reg, int index, int base,
+        bool byteRegs)
+{
+    if (size == 16)
+        emit8(0x66);
+    uint32_t rex = 0x40;
+    if (size == 64)                 rex |= 8;
+    if (reg & 8)                    rex |= 4;
+    if (index >= 0 && (index & 8))  rex |= 2;
+    if (base & 8)                   rex |= 1;
+    // a bare REX turns ah/ch/dh/bh into spl/bpl/sil/dil
+    if (rex != 0x40 || byteRegs)
+        emit8(rex);
+}
+
+void X86_64Assembler::opcode(uint32_t op)
+{
+    if (op > 0xFFFF)    emit8(op >> 16);
+    if (op > 0xFF)      emit8(op >> 8);
+    emit8(op);
+}
+
+void X86_64Assembler::op_rr(int size, uint32_t op, int reg, int rm,
+        bool byteRegs)
+{
+    prefix(size, reg, -1, rm, byteRegs);
+    opcode(op);
+    emit8(0xC0 | ((reg & 7)<<3) | (rm & 7));
+}
+
+void X86_64Assembler::op_rm(int size, uint32_t op, int reg, const mem_t& m,
+        bool byteReg)
+{
+    prefix(size, reg, m.index, m.base, byteReg);
+    opcode(op);
+    const bool sib = (m.index >= 0) || ((m.base & 7) == RSP);
+    int mod;
+    if (m.disp == 0 && (m.base & 7) != RBP)     mod = 0;
+    else if (m.disp >= -128 && m.disp <= 127)   mod = 1;
+    else                                        mod = 2;
+    emit8((mod<<6) | ((reg & 7)<<3) | (sib ? 4 : (m.base & 7)));
+    if (sib) {
+        const int index = (m.index >= 0) ? (m.index & 7) : 4;
+        emit8((m.scale<<6) | (index<<3) | (m.base & 7));
+    }
+    if (mod == 1)   emit8(m.disp);
+    if (mod == 2)   emit32(m.disp);
+}
+
+void X86_64Assembler::mov_rr(int size, int d, int s)
+{
+    if (d != s)
+        op_rr(size, 0x89, s, d);
+}
+
+void X86_64Assembler::mov_ri(int d, uint32_t imm)
+{
+    prefix(32, 0, -1, d, false);
+    emit8(0xB8 | (d & 7));
+    emit32(imm);
+}
+
+void X86_64Assembler::mov_rm(int size, int d, const mem_t& m)
+{
+    op_rm(size, 0x8B, d, m);
+}
+
+void X86_64Assembler::mov_mr(int size, const mem_t& m, int s)
+{
+    if (size == 8)  op_rm(32, 0x88, s, m, true);
+    else            op_rm(size, 0x89, s, m);
+}
+
+void X86_64Assembler::lea(int size, int d, const mem_t& m)
+{
+    op_rm(size, 0x8D, d, m);
+}
+
+void X86_64Assembler::alu_rr(int size, int op, int d, int s)
+{
+    flags_clobbered();
+    op_rr(size, (op<<3) | 1, s, d);
+}
+
+void X86_64Assembler::alu_ri(int size, int op, int d, uint32_t imm)
+{
+    flags_clobbered();
+    if (int32_t(imm) >= -128 && int32_t(imm) <= 127) {
+        op_rr(size, 0x83, op, d);
+        emit8(imm);
+    } else {
+        op_rr(size, 0x81, op, d);
+        emit32(imm);
+    }
+}
+
+void X86_64Assembler::alu(int size, int op, int d, const operand_t& o)
+{
+    if (o.imm)  alu_ri(size, op, d, o.value);
+    else        alu_rr(size, op, d, o.reg);
+}
+
+void X86_64Assembler::shift_ri(int size, int op, int d, int amount)
+{
+    flags_clobbered();
+    if (amount == 1) {
+        op_rr(size, 0xD1, op, d);
+    } else {
+        op_rr(size, 0xC1, op, d);
+        emit8(amount);
+    }
+}
+
+void X86_64Assembler::movsxd(int d, int s)
+{
+    op_rr(64, 0x63, d, s);
+}
+
+uint8_t* X86_64Assembler::jcc8(int cc)
+{
+    emit8(0x70 | cc);
+    emit8(0);
+    return mPC-1;
+}
+
+// forward jcc with a 32-bit displacement, patched by patch_rel32()
+uint8_t* X86_64Assembler::jcc32(int cc)
+{
+    emit8(0x0F);
+    emit8(0x80 | cc);
+    emit32(0);
+    return mPC-4;
+}
+
+void X86_64Assembler::jcc32(int cc, const char* label)
+{
+    if (cc < 0) {
+        emit8(0xE9);
+    } else {
+        emit8(0x0F);
+        emit8(0x80 | cc);
+    }
+    if (mPC+4 <= mEnd)
+        mBranchTargets.add(branch_target_t(label, mPC));
+    emit32(0);
+}
+
+#if 0
+#pragma mark -
+#pragma mark Registers...
+#endif
+
+X86_64Assembler::mem_t X86_64Assembler::slot(int Rn)
+{
+    (void)Rn;
+    return mem_t(RSP, -1, 0, R11_SLOT);
+}
+
+// returns the x86 register holding Rn, loading it in tmp if needed
+int X86_64Assembler::src(int Rn, int tmp)
+{
+    if (Rn == R11) {
+        mov_rm(64, tmp, slot(Rn));
+        return tmp;
+    }
+    const int r = gRegisterMap[Rn & 0xF];
+    if (r < 0) {
+        mBogusRegister = true;
+        return tmp;
+    }
+    return r;
+}
+
+// returns the x86 register where Rd must be computed, commit() puts it
+// in place afterwards
+int X86_64Assembler::dst(int Rd)
+{
+    if (Rd == R11)
+        return RAX;
+    const int r = gRegisterMap[Rd & 0xF];
+    if (r < 0) {
+        mBogusRegister = true;
+        return RAX;
+    }
+    return r;
+}
+
+void X86_64Assembler::commit(int Rd, int r)
+{
+    if (Rd == R11)
+        mov_mr(64, slot(Rd), r);
+}
+
+// d = Rn, so that "op d, o" computes "Rn op o", even when o is in d
+void X86_64Assembler::load_first(int size, int d, int Rn, operand_t& o)
+{
+    if (!o.imm && o.reg == d && Rn != d) {
+        mov_rr(64, RCX, o.reg);
+        o.reg = RCX;
+    }
+    mov_rr(size, d, Rn);
+}
+
+bool X86_64Assembler::is_pointer(int Rn) const
+{
+    return (mPointers & (1<<Rn)) != 0;
+}
+
+void X86_64Assembler::set_pointer(int Rd, bool pointer)
+{
+    if (pointer)    mPointers |= 1<<Rd;
+    else            mPointers &= ~(1<<Rd);
+}
+
+// decodes an ARM shifter operand. Shifted registers are computed in rcx,
+// except LSL #1-3 which are left to the caller when 'scaled' is set.
+X86_64Assembler::operand_t X86_64Assembler::operand(uint32_t Op2, bool scaled)
+{
+    operand_t o;
+    o.imm = false;
+    o.value = 0;
+    o.reg = RCX;
+    o.arm = -1;
+    o.scale = 0;
+
+    if (Op2 & (1<<25)) {
+        const uint32_t rot = ((Op2>>8) & 0xF) * 2;
+        const uint32_t imm = Op2 & 0xFF;
+        o.imm = true;
+        o.value = rot ? ((imm >> rot) | (imm << (32-rot))) : imm;
+        return o;
+    }
+
+    const int Rm = Op2 & 0xF;
+    const int type = (Op2>>5) & 3;
+
+    if (Op2 & (1<<4)) {
+        // shift by register, in 64 bits so that counts of 32 and more
+        // behave like on ARM
+        const int Rs = (Op2>>8) & 0xF;
+        const int rm = src(Rm, RAX);
+        if (type == ASR)    movsxd(RAX, rm);
+        else                op_rr(32, 0x89, rm, RAX);
+        const int rs = src(Rs, RCX);
+        op_rr(32, 0x0FB6, RCX, rs, true);               // movzx ecx, rs8
+        if (type != ROR) {
+            alu_ri(32, xCMP, RCX, 63);
+            uint8_t* site = jcc8(xBE);
+            mov_ri(RCX, 63);
+            patch_rel8(site);
+        }
+        static const int shifts[] = { xSHL, xSHR, xSAR, xROR };
+        flags_clobbered();
+        op_rr(type == ROR ? 32 : 64, 0xD3, shifts[type], RAX);
+        mov_rr(32, RCX, RAX);
+        return o;
+    }
+
+    const int amount = (Op2>>7) & 0x1F;
+    if (type == LSL && amount == 0) {
+        o.reg = src(Rm, RCX);
+        o.arm = Rm;
+        return o;
+    }
+    if (type == LSL && amount <= 3 && scaled) {
+        o.reg = src(Rm, RCX);
+        o.scale = amount;
+        return o;
+    }
+
+    op_rr(32, 0x89, src(Rm, RCX), RCX);                 // mov ecx, rm
+    switch (type) {
+    case LSL:
+        shift_ri(32, xSHL, RCX, amount);
+        break;
+    case LSR:
+        if (amount)     shift_ri(32, xSHR, RCX, amount);
+        else            mov_ri(RCX, 0);                 // LSR #32
+        break;
+    case ASR:
+        shift_ri(32, xSAR, RCX, amount ? amount : 31);  // ASR #32
+        break;
+    case ROR:
+        if (amount) {
+            shift_ri(32, xROR, RCX, amount);
+        } else {                                        // RRX
+            flags_needed();
+            flags_clobbered();
+            if (mFlagsPolarity == FLAGS_BORROW)
+                emit8(0xF5);                            // cmc
+            shift_ri(32, xRCR, RCX, 1);
+        }
+        break;
+    }
+    return o;
+}
+
+#if 0
+#pragma mark -
+#pragma mark Flags & Conditional execution...
+#endif
+
+int X86_64Assembler::condition(int cc) const
+{
+    const bool borrow = (mFlagsPolarity == FLAGS_BORROW);
+    switch (cc) {
+    case EQ:    return xE;
+    case NE:    return xNE;
+    case HS:    return borrow ? xAE : xB;
+    case LO:    return borrow ? xB : xAE;
+    case MI:    return xS;
+    case PL:    return xNS;
+    case VS:    return xO;
+    case VC:    return xNO;
+    case HI:    return borrow ? xA : -1;
+    case LS:    return borrow ? xBE : -1;
+    case GE:    return xGE;
+    case LT:    return xL;
+    case GT:    return xG;
+    case LE:    return xLE;
+    }
+    return -1;
+}
+
+// the ARM flags are now in EFLAGS
+void X86_64Assembler::flags_set(int polarity)
+{
+    LOG_ALWAYS_FATAL_IF(mInCond && mFlagsState != FLAGS_NONE &&
+            mFlagsPolarity != polarity,
+            "conditional instruction changes the flags polarity");
+    mFlagsState = FLAGS_LIVE;
+    mFlagsPolarity = polarity;
+    mFlagsSave = 0;
+}
+
+// about to emit an instruction that destroys EFLAGS. Flags that might
+// still be needed are saved first, or rather, we leave room to save them
+// and only do it if some instruction ends up needing them.
+void X86_64Assembler::flags_clobbered()
+{
+    if (mFlagsState != FLAGS_LIVE)
+        return;
+    if (!mFlagsSave) {
+        mFlagsSave = mPC;
+        static const uint8_t nop5[] = { 0x0F, 0x1F, 0x44, 0x00, 0x00 };
+        for (size_t i=0 ; i<sizeof(nop5) ; i++)
+            emit8(nop5[i]);
+    }
+    mFlagsState = FLAGS_CLOBBERED;
+}
+
+void X86_64Assembler::flags_needed()
+{
+    LOG_ALWAYS_FATAL_IF(mFlagsState == FLAGS_NONE,
+            "instruction depends on undefined flags");
+    if (mFlagsState != FLAGS_CLOBBERED)
+        return;
+    if (mFlagsSave+5 <= mEnd) {
+        // pushfq; pop [rsp+FLAGS_SLOT]
+        static const uint8_t save[] = { 0x9C, 0x8F, 0x44, 0x24, FLAGS_SLOT };
+        memcpy(mFlagsSave, save, sizeof(save));
+    }
+    // push [rsp+FLAGS_SLOT]; popfq
+    emit8(0xFF); emit8(0x74); emit8(0x24); emit8(FLAGS_SLOT);
+    emit8(0x9D);
+    mFlagsState = FLAGS_LIVE;
+}
+
+// starts a conditional instruction. Returns false if it never executes.
+bool X86_64Assembler::cond_begin(int cc)
+{
+    if (cc == AL)
+        return true;
+    if (cc == NV)
+        return false;
+
+    flags_needed();
+    // the body may destroy the flags, make sure they can be recovered
+    // whichever way we go
+    if (!mFlagsSave) {
+        flags_clobbered();
+        mFlagsState = FLAGS_LIVE;
+    }
+
+    // the body is a whole ARM instruction plus any flags save/restore,
+    // which has no useful bound, so it is skipped with rel32 branches
+    mCondSites = 0;
+    const int x = condition(cc);
+    if (x >= 0) {
+        mCondSite[mCondSites++] = jcc32(x ^ 1);
+    } else if (cc == HI) {
+        // C set and Z clear
+        mCondSite[mCondSites++] = jcc32(xAE);
+        mCondSite[mCondSites++] = jcc32(xE);
+    } else {
+        // LS: C clear or Z set
+        uint8_t* site = jcc8(xE);
+        mCondSite[mCondSites++] = jcc32(xB);
+        patch_rel8(site);
+    }
+    mInCond = true;
+    return true;
+}
+
+void X86_64Assembler::cond_end()
+{
+    for (int i=0 ; i<mCondSites ; i++)
+        patch_rel32(mCondSite[i]);
+    mCondSites = 0;
+    mInCond = false;
+}
+
+#if 0
+#pragma mark -
+#pragma mark Data Processing...
+#endif
+
+void X86_64Assembler::dataProcessing(int opcode, int cc,
+        int s, int Rd, int Rn, uint32_t Op2)
+{
+    if (!cond_begin(cc))
+        return;
+
+    const bool carryIn = (opcode == opADC || opcode == opSBC ||
+            opcode == opRSC || (Op2 & 0x2000FF0) == (ROR<<5));
+    if (s && cc == AL && !carryIn) {
+        // the current flags are dead
+        mFlagsState = FLAGS_NONE;
+        mFlagsSave = 0;
+    }
+
+    switch (opcode) {
+    case opTST:
+    case opTEQ:
+    case opCMP:
+    case opCMN: {
+        operand_t o = operand(Op2, false);
+        const int rn = src(Rn, RAX);
+        if (opcode == opCMP) {
+            alu(32, xCMP, rn, o);
+            flags_set(FLAGS_BORROW);
+        } else if (opcode == opTST) {
+            flags_clobbered();
+            if (o.imm) {
+                op_rr(32, 0xF7, 0, rn);
+                emit32(o.value);
+            } else {
+                op_rr(32, 0x85, o.reg, rn);
+            }
+            flags_set(FLAGS_CARRY);
+        } else {
+            mov_rr(32, RAX, rn);
+            alu(32, opcode == opCMN ? xADD : xXOR, RAX, o);
+            flags_set(FLAGS_CARRY);
+        }
+        break;
+    }
+
+    case opMOV:
+    case opMVN: {
+        operand_t o = operand(Op2, false);
+        const int d = dst(Rd);
+        bool pointer = false;
+        if (o.imm) {
+            mov_ri(d, opcode == opMOV ? o.value : ~o.value);
+        } else if (o.arm >= 0 && opcode == opMOV) {
+            mov_rr(64, d, o.reg);
+            pointer = is_pointer(o.arm);
+        } else {
+            op_rr(32, 0x89, o.reg, d);
+            if (opcode == opMVN)
+                op_rr(32, 0xF7, 2, d);                  // not
+        }
+        if (s) {
+            flags_clobbered();
+            op_rr(32, 0x85, d, d);                      // test
+            flags_set(FLAGS_CARRY);
+        }
+        commit(Rd, d);
+        set_pointer(Rd, pointer);
+        break;
+    }
+
+    case opAND:
+    case opEOR:
+    case opORR:
+    case opBIC: {
+        operand_t o = operand(Op2, false);
+        const int rn = src(Rn, RAX);
+        const int d = dst(Rd);
+        if (opcode == opAND && !s && o.imm &&
+                (o.value == 0xFF || o.value == 0xFFFF)) {
+            // movzx leaves the flags alone
+            op_rr(32, o.value == 0xFF ? 0x0FB6 : 0x0FB7, d, rn, true);
+        } else {
+            int op = xAND;
+            if (opcode == opEOR)        op = xXOR;
+            else if (opcode == opORR)   op = xOR;
+            if (opcode == opBIC) {
+                if (o.imm) {
+                    o.value = ~o.value;
+                } else {
+                    op_rr(32, 0x89, o.reg, RCX);
+                    op_rr(32, 0xF7, 2, RCX);            // not
+                    o.reg = RCX;
+                }
+            }
+            load_first(32, d, rn, o);
+            alu(32, op, d, o);
+            if (s)
+                flags_set(FLAGS_CARRY);
+        }
+        commit(Rd, d);
+        set_pointer(Rd, false);
+        break;
+    }
+
+    case opADD:
+    case opSUB: {
+        operand_t o = operand(Op2, opcode == opADD && !s);
+        const bool rnPointer = is_pointer(Rn);
+        const bool opPointer = (opcode == opADD) && !o.imm &&
+                o.arm >= 0 && is_pointer(o.arm);
+        const int rn = src(Rn, RAX);
+        const int d = dst(Rd);
+        if (s) {
+            load_first(32, d, rn, o);
+            alu(32, opcode == opADD ? xADD : xSUB, d, o);
+            flags_set(opcode == opADD ? FLAGS_CARRY : FLAGS_BORROW);
+        } else if (o.imm) {
+            // lea doesn't touch the flags
+            const int32_t disp = (opcode == opADD) ?
+                    int32_t(o.value) : int32_t(0u - o.value);
+            lea(rnPointer ? 64 : 32, d, mem_t(rn, -1, 0, disp));
+        } else if (rnPointer) {
+            // pointer + signed 32-bit offset
+            movsxd(RCX, o.reg);
+            if (opcode == opADD) {
+                lea(64, d, mem_t(rn, RCX, o.scale));
+            } else {
+                mov_rr(64, d, rn);
+                alu_rr(64, xSUB, d, RCX);
+            }
+        } else if (opPointer) {
+            movsxd(RAX, rn);
+            lea(64, d, mem_t(o.reg, RAX));
+        } else if (opcode == opADD) {
+            lea(32, d, mem_t(rn, o.reg, o.scale));
+        } else {
+            load_first(32, d, rn, o);
+            alu(32, xSUB, d, o);
+        }
+        commit(Rd, d);
+        set_pointer(Rd, !s && (rnPointer || opPointer));
+        break;
+    }
+
+    case opRSB: {
+        operand_t o = operand(Op2, false);
+        if (o.imm)  mov_ri(RCX, o.value);
+        else        op_rr(32, 0x89, o.reg, RCX);
+        alu_rr(32, xSUB, RCX, src(Rn, RAX));
+        if (s)
+            flags_set(FLAGS_BORROW);
+        const int d = dst(Rd);
+        mov_rr(32, d, RCX);
+        commit(Rd, d);
+        set_pointer(Rd, false);
+        break;
+    }
+
+    case opADC:
+    case opSBC:
+    case opRSC: {
+        operand_t o = operand(Op2, false);
+        const int rn = src(Rn, RAX);
+        int d = dst(Rd);
+        if (opcode == opRSC) {
+            if (o.imm)  mov_ri(RCX, o.value);
+            else        op_rr(32, 0x89, o.reg, RCX);
+            o.imm = false;
+            o.reg = rn;
+            d = RCX;
+        } else {
+            load_first(32, d, rn, o);
+        }
+        // x86 wants the carry for adc and the borrow for sbb
+        flags_needed();
+        const int polarity = (opcode == opADC) ? FLAGS_CARRY : FLAGS_BORROW;
+        if (mFlagsPolarity != polarity) {
+            flags_clobbered();
+            emit8(0xF5);                                // cmc
+        }
+        flags_clobbered();
+        alu(32, opcode == opADC ? xADC : xSBB, d, o);
+        if (s)
+            flags_set(polarity);
+        if (opcode == opRSC) {
+            d = dst(Rd);
+            mov_rr(32, d, RCX);
+        }
+        commit(Rd, d);
+        set_pointer(Rd, false);
+        break;
+    }
+    }
+
+    cond_end();
+}
+
+#if 0
+#pragma mark -
+#pragma mark Multiply...
+#endif
+
+void X86_64Assembler::MLA(int cc, int s,
+        int Rd, int Rm, int Rs, int Rn)
+{
+    if (!cond_begin(cc))
+        return;
+    if (s && cc == AL)
+        mFlagsState = FLAGS_NONE;
+    op_rr(32, 0x89, src(Rm, RCX), RCX);
+    flags_clobbered();
+    op_rr(32, 0x0FAF, RCX, src(Rs, RAX));               // imul ecx, rs
+    alu_rr(32, xADD, RCX, src(Rn, RAX));
+    if (s)
+        flags_set(FLAGS_CARRY);
+    const int d = dst(Rd);
+    mov_rr(32, d, RCX);
+    commit(Rd, d);
+    set_pointer(Rd, false);
+    cond_end();
+}
+
+void X86_64Assembler::MUL(int cc, int s,
+        int Rd, int Rm, int Rs)
+{
+    if (!cond_begin(cc))
+        return;
+    if (s && cc == AL)
+        mFlagsState = FLAGS_NONE;
+    op_rr(32, 0x89, src(Rm, RCX), RCX);
+    flags_clobbered();
+    op_rr(32, 0x0FAF, RCX, src(Rs, RAX));               // imul ecx, rs
+    if (s) {
+        op_rr(32, 0x85, RCX, RCX);                      // test
+        flags_set(FLAGS_CARRY);
+    }
+    const int d = dst(Rd);
+    mov_rr(32, d, RCX);
+    commit(Rd, d);
+    set_pointer(Rd, false);
+    cond_end();
+}
+
+// 32x32->64 multiply, optionally accumulated into RdHi:RdLo
+void X86_64Assembler::mull(bool sign, bool acc, int s,
+        int RdLo, int RdHi, int Rm, int Rs)
+{
+    if (s && !mInCond)
+        mFlagsState = FLAGS_NONE;
+    int rm = src(Rm, RCX);
+    if (sign)   movsxd(RCX, rm);
+    else        op_rr(32, 0x89, rm, RCX);
+    int rs = src(Rs, RAX);
+    if (sign)   movsxd(RAX, rs);
+    else        op_rr(32, 0x89, rs, RAX);
+    flags_clobbered();
+    op_rr(64, 0x0FAF, RCX, RAX);                        // imul rcx, rax
+    if (acc) {
+        op_rr(32, 0x89, src(RdHi, RAX), RAX);
+        shift_ri(64, xSHL, RAX, 32);
+        alu_rr(64, xADD, RCX, RAX);
+        op_rr(32, 0x89, src(RdLo, RAX), RAX);
+        alu_rr(64, xADD, RCX, RAX);
+    }
+    if (s) {
+        op_rr(64, 0x85, RCX, RCX);                      // test
+        flags_set(FLAGS_CARRY);
+    }
+    int d = dst(RdLo);
+    mov_rr(32, d, RCX);
+    commit(RdLo, d);
+    set_pointer(RdLo, false);
+    shift_ri(64, xSHR, RCX, 32);
+    d = dst(RdHi);
+    mov_rr(32, d, RCX);
+    commit(RdHi, d);
+    set_pointer(RdHi, false);
+}
+
+void X86_64Assembler::UMULL(int cc, int s,
+        int RdLo, int RdHi, int Rm, int Rs)
+{
+    if (!cond_begin(cc))
+        return;
+    mull(false, false, s, RdLo, RdHi, Rm, Rs);
+    cond_end();
+}
+
+void X86_64Assembler::UMUAL(int cc, int s,
+        int RdLo, int RdHi, int Rm, int Rs)
+{
+    if (!cond_begin(cc))
+        return;
+    mull(false, true, s, RdLo, RdHi, Rm, Rs);
+    cond_end();
+}
+
+void X86_64Assembler::SMULL(int cc, int s,
+        int RdLo, int RdHi, int Rm, int Rs)
+{
+    if (!cond_begin(cc))
+        return;
+    mull(true, false, s, RdLo, RdHi, Rm, Rs);
+    cond_end();
+}
+
+void X86_64Assembler::SMUAL(int cc, int s,
+        int RdLo, int RdHi, int Rm, int Rs)
+{
+    if (!cond_begin(cc))
+        return;
+    mull(true, true, s, RdLo, RdHi, Rm, Rs);
+    cond_end();
+}
+
+// d = sign-extended top or bottom half of Rn
+void X86_64Assembler::half(int d, int Rn, bool top, int size)
+{
+    const int rn = src(Rn, d);
+    if (top) {
+        if (size == 64) movsxd(d, rn);
+        else            op_rr(32, 0x89, rn, d);
+        shift_ri(size, xSAR, d, 16);
+    } else {
+        op_rr(size, 0x0FBF, d, rn);                     // movsx d, rn16
+    }
+}
+
+void X86_64Assembler::SMUL(int cc, int xy,
+        int Rd, int Rm, int Rs)
+{
+    if (!cond_begin(cc))
+        return;
+    half(RCX, Rm, xy & xyTB, 32);
+    half(RAX, Rs, xy & xyBT, 32);
+    flags_clobbered();
+    op_rr(32, 0x0FAF, RCX, RAX);                        // imul ecx, eax
+    const int d = dst(Rd);
+    mov_rr(32, d, RCX);
+    commit(Rd, d);
+    set_pointer(Rd, false);
+    cond_end();
+}
+
+void X86_64Assembler::SMULW(int cc, int y,
+        int Rd, int Rm, int Rs)
+{
+    if (!cond_begin(cc))
+        return;
+    movsxd(RCX, src(Rm, RCX));
+    half(RAX, Rs, y & yT, 64);
+    flags_clobbered();
+    op_rr(64, 0x0FAF, RCX, RAX);                        // imul rcx, rax
+    shift_ri(64, xSAR, RCX, 16);
+    const int d = dst(Rd);
+    mov_rr(32, d, RCX);
+    commit(Rd, d);
+    set_pointer(Rd, false);
+    cond_end();
+}
+
+void X86_64Assembler::SMLA(int cc, int xy,
+        int Rd, int Rm, int Rs, int Rn)
+{
+    if (!cond_begin(cc))
+        return;
+    half(RCX, Rm, xy & xyTB, 32);
+    half(RAX, Rs, xy & xyBT, 32);
+    flags_clobbered();
+    op_rr(32, 0x0FAF, RCX, RAX);                        // imul ecx, eax
+    alu_rr(32, xADD, RCX, src(Rn, RAX));
+    const int d = dst(Rd);
+    mov_rr(32, d, RCX);
+    commit(Rd, d);
+    set_pointer(Rd, false);
+    cond_end();
+}
+
+void X86_64Assembler::SMLAL(int cc, int xy,
+        int RdHi, int RdLo, int Rs, int Rm)
+{
+    if (!cond_begin(cc))
+        return;
+    half(RCX, Rm, xy & xyTB, 64);
+    half(RAX, Rs, xy & xyBT, 64);
+    flags_clobbered();
+    op_rr(64, 0x0FAF, RCX, RAX);                        // imul rcx, rax
+    op_rr(32, 0x89, src(RdHi, RAX), RAX);
+    shift_ri(64, xSHL, RAX, 32);
+    alu_rr(64, xADD, RCX, RAX);
+    op_rr(32, 0x89, src(RdLo, RAX), RAX);
+    alu_rr(64, xADD, RCX, RAX);
+    int d = dst(RdLo);
+    mov_rr(32, d, RCX);
+    commit(RdLo, d);
+    set_pointer(RdLo, false);
+    shift_ri(64, xSHR, RCX, 32);
+    d = dst(RdHi);
+    mov_rr(32, d, RCX);
+    commit(RdHi, d);
+    set_pointer(RdHi, false);
+    cond_end();
+}
+
+void X86_64Assembler::SMLAW(int cc, int y,
+        int Rd, int Rm, int Rs, int Rn)
+{
+    if (!cond_begin(cc))
+        return;
+    movsxd(RCX, src(Rm, RCX));
+    half(RAX, Rs, y & yT, 64);
+    flags_clobbered();
+    op_rr(64, 0x0FAF, RCX, RAX);                        // imul rcx, rax
+    shift_ri(64, xSAR, RCX, 16);
+    alu_rr(32, xADD, RCX, src(Rn, RAX));
+    const int d = dst(Rd);
+    mov_rr(32, d, RCX);
+    commit(Rd, d);
+    set_pointer(Rd, false);
+    cond_end();
+}
+
+#if 0
+#pragma mark -
+#pragma mark Branches...
+#endif
+
+void X86_64Assembler::B(int cc, const char* label)
+{
+    if (cc == NV)
+        return;
+    if (cc == AL) {
+        jcc32(-1, label);
+        return;
+    }
+    flags_needed();
+    const int x = condition(cc);
+    if (x >= 0) {
+        jcc32(x, label);
+    } else if (cc == HI) {
+        uint8_t* site = jcc8(xE);
+        jcc32(xB, label);
+        patch_rel8(site);
+    } else {
+        jcc32(xAE, label);
+        jcc32(xE, label);
+    }
+}
+
+void X86_64Assembler::B(int cc, uint32_t* pc)
+{
+    // only used with labels resolved by pcForLabel()
+    const char* label = 0;
+    ssize_t index = mLabelsInverseMapping.indexOfKey((uint8_t*)pc);
+    LOG_ALWAYS_FATAL_IF(index < 0, "B() to an unknown address %p", pc);
+    label = mLabelsInverseMapping.valueAt(index);
+    B(cc, label);
+}
+
+void X86_64Assembler::BL(int cc, const char* label)
+{
+    LOG_ALWAYS_FATAL("BL(%s) is not supported on x86-64", label);
+}
+
+void X86_64Assembler::BL(int cc, uint32_t* pc)
+{
+    LOG_ALWAYS_FATAL("BL(%p) is not supported on x86-64", pc);
+}
+
+void X86_64Assembler::BX(int cc, int Rn)
+{
+    LOG_ALWAYS_FATAL("BX(r%d) is not supported on x86-64", Rn);
+}
+
+#if 0
+#pragma mark -
+#pragma mark Data Transfer...
+#endif
+
+void X86_64Assembler::transfer(int cc, int kind, int Rd, int Rn,
+        uint32_t offset)
+{
+    if (Rn == SP) {
+        spill(cc, kind, Rd, offset);
+        return;
+    }
+    if (!cond_begin(cc))
+        return;
+
+    const bool P = (offset & (1<<24)) != 0;
+    const bool U = (offset & (1<<23)) != 0;
+    const bool W = (offset & (1<<21)) != 0;
+
+    // the value to store is fetched first, rax and rcx are needed below
+    const int value = isStore(kind) ? src(Rd, RAX) : -1;
+
+    mem_t m(src(Rn, RAX));
+    bool immediate;
+    uint32_t disp;
+    if (isHalfwordForm(kind)) {
+        immediate = (offset & (1<<22)) != 0;
+        disp = ((offset>>4) & 0xF0) | (offset & 0xF);
+    } else {
+        immediate = (offset & (1<<25)) == 0;
+        disp = offset & 0xFFF;
+    }
+    if (immediate) {
+        m.disp = U ? int32_t(disp) : -int32_t(disp);
+    } else {
+        // register offsets are signed 32-bit values
+        const int Rm = offset & 0xF;
+        const int type = isHalfwordForm(kind) ? LSL : ((offset>>5) & 3);
+        const int amount = isHalfwordForm(kind) ? 0 : ((offset>>7) & 0x1F);
+        if (type == LSL && amount <= 3 && U) {
+            movsxd(RCX, src(Rm, RCX));
+            m.scale = amount;
+        } else {
+            operand_t o = operand(reg_imm(Rm, type, amount), false);
+            movsxd(RCX, o.reg);
+            if (!U) {
+                flags_clobbered();
+                op_rr(64, 0xF7, 3, RCX);                // neg rcx
+            }
+        }
+        m.index = RCX;
+    }
+
+    const int base = m.base;
+    mem_t address(m);
+    if (!P) {
+        address = mem_t(base);
+    } else if (W) {
+        lea(64, base, m);
+        commit(Rn, base);
+        address = mem_t(base);
+    }
+
+    switch (kind) {
+    case LDR32:     op_rm(32, 0x8B, dst(Rd), address);          break;
+    case LDR64:     op_rm(64, 0x8B, dst(Rd), address);          break;
+    case LDRB8:     op_rm(32, 0x0FB6, dst(Rd), address);        break;
+    case LDRH16:    op_rm(32, 0x0FB7, dst(Rd), address);        break;
+    case LDRSB8:    op_rm(32, 0x0FBE, dst(Rd), address);        break;
+    case LDRSH16:   op_rm(32, 0x0FBF, dst(Rd), address);        break;
+    case STR32:     mov_mr(32, address, value);                 break;
+    case STR64:     mov_mr(64, address, value);                 break;
+    case STRB8:     mov_mr(8, address, value);                  break;
+    case STRH16:    mov_mr(16, address, value);                 break;
+    }
+    if (!isStore(kind)) {
+        commit(Rd, dst(Rd));
+        set_pointer(Rd, kind == LDR64);
+    }
+
+    if (!P) {
+        lea(64, base, m);
+        commit(Rn, base);
+    }
+
+    cond_end();
+}
+
+// GGLAssembler only uses SP to spill registers, with pushes and pops.
+// Those go to dedicated slots in the frame.
+void X86_64Assembler::spill(int cc, int kind, int Rd, uint32_t offset)
+{
+    if (cc == AL && kind == STR32 && offset == immed12_pre(-4, 1)) {
+        push_spill(Rd);
+    } else if (cc == AL && kind == LDR32 && offset == immed12_post(4)) {
+        pop_spill(Rd);
+    } else {
+        // most likely the dummy register handed out when the
+        // register allocator runs dry
+        mBogusRegister = true;
+    }
+}
+
+void X86_64Assembler::push_spill(int Rd)
+{
+    LOG_ALWAYS_FATAL_IF(mSpillDepth >= SPILL_MAX, "too many spilled registers");
+    const int r = src(Rd, RAX);
+    mov_mr(64, mem_t(RSP, -1, 0, SPILL_SLOT + mSpillDepth*8), r);
+    if (is_pointer(Rd))     mSpillPointers |= 1<<mSpillDepth;
+    else                    mSpillPointers &= ~(1<<mSpillDepth);
+    mSpillDepth++;
+}
+
+void X86_64Assembler::pop_spill(int Rd)
+{
+    LOG_ALWAYS_FATAL_IF(mSpillDepth <= 0, "unbalanced register spills");
+    mSpillDepth--;
+    const int d = dst(Rd);
+    mov_rm(64, d, mem_t(RSP, -1, 0, SPILL_SLOT + mSpillDepth*8));
+    commit(Rd, d);
+    set_pointer(Rd, (mSpillPointers & (1<<mSpillDepth)) != 0);
+}
+
+void X86_64Assembler::LDR(int cc, int Rd, int Rn, uint32_t offset) {
+    transfer(cc, LDR32, Rd, Rn, offset);
+}
+void X86_64Assembler::LDRB(int cc, int Rd, int Rn, uint32_t offset) {
+    transfer(cc, LDRB8, Rd, Rn, offset);
+}
+void X86_64Assembler::STR(int cc, int Rd, int Rn, uint32_t offset) {
+    transfer(cc, STR32, Rd, Rn, offset);
+}
+void X86_64Assembler::STRB(int cc, int Rd, int Rn, uint32_t offset) {
+    transfer(cc, STRB8, Rd, Rn, offset);
+}
+void X86_64Assembler::LDRH(int cc, int Rd, int Rn, uint32_t offset) {
+    transfer(cc, LDRH16, Rd, Rn, offset);
+}
+void X86_64Assembler::LDRSB(int cc, int Rd, int Rn, uint32_t offset) {
+    transfer(cc, LDRSB8, Rd, Rn, offset);
+}
+void X86_64Assembler::LDRSH(int cc, int Rd, int Rn, uint32_t offset) {
+    transfer(cc, LDRSH16, Rd, Rn, offset);
+}
+void X86_64Assembler::STRH(int cc, int Rd, int Rn, uint32_t offset) {
+    transfer(cc, STRH16, Rd, Rn, offset);
+}
+void X86_64Assembler::ADDR_LDR(int cc, int Rd, int Rn, uint32_t offset) {
+    transfer(cc, LDR64, Rd, Rn, offset);
+}
+void X86_64Assembler::ADDR_STR(int cc, int Rd, int Rn, uint32_t offset) {
+    transfer(cc, STR64, Rd, Rn, offset);
+}
+
+void X86_64Assembler::LDM(int cc, int dir,
+        int Rn, int W, uint32_t reg_list)
+{
+    if (cc != AL || Rn != SP || !W || (dir != IA && dir != FD)) {
+        mBogusRegister = true;
+        return;
+    }
+    // lowest register comes first
+    for (int i=0 ; i<16 ; i++) {
+        if (reg_list & (1<<i))
+            pop_spill(i);
+    }
+}
+
+void X86_64Assembler::STM(int cc, int dir,
+        int Rn, int W, uint32_t reg_list)
+{
+    if (cc != AL || Rn != SP || !W || (dir != DB && dir != FD)) {
+        mBogusRegister = true;
+        return;
+    }
+    // lowest register ends up at the lowest address
+    for (int i=15 ; i>=0 ; i--) {
+        if (reg_list & (1<<i))
+            push_spill(i);
+    }
+}
+
+#if 0
+#pragma mark -
+#pragma mark Special...
+#endif
+
+void X86_64Assembler::SWP(int cc, int Rn, int Rd, int Rm)
+{
+    if (!cond_begin(cc))
+        return;
+    op_rr(32, 0x89, src(Rm, RCX), RCX);
+    op_rm(32, 0x87, RCX, mem_t(src(Rn, RAX)));         // xchg [rn], ecx
+    const int d = dst(Rd);
+    mov_rr(32, d, RCX);
+    commit(Rd, d);
+    set_pointer(Rd, false);
+    cond_end();
+}
+
+void X86_64Assembler::SWPB(int cc, int Rn, int Rd, int Rm)
+{
+    if (!cond_begin(cc))
+        return;
+    op_rr(32, 0x89, src(Rm, RCX), RCX);
+    op_rm(32, 0x86, RCX, mem_t(src(Rn, RAX)), true);   // xchg [rn], cl
+    const int d = dst(Rd);
+    op_rr(32, 0x0FB6, d, RCX, true);                    // movzx d, cl
+    commit(Rd, d);
+    set_pointer(Rd, false);
+    cond_end();
+}
+
+void X86_64Assembler::SWI(int cc, uint32_t comment)
+{
+    LOG_ALWAYS_FATAL("SWI(%08x) is not supported on x86-64", comment);
+}
+
+#if 0
+#pragma mark -
+#pragma mark DSP instructions...
+#endif
+
+void X86_64Assembler::PLD(int Rn, uint32_t offset)
+{
+    LOG_ALWAYS_FATAL_IF(!((offset&(1<<24)) && !(offset&(1<<21))),
+                        "PLD only P=1, W=0");
+    if (offset & (1<<25)) {
+        // register offsets aren't worth the trouble for a hint
+        return;
+    }
+    const int32_t disp = (offset & (1<<23)) ?
+            int32_t(offset & 0xFFF) : -int32_t(offset & 0xFFF);
+    op_rm(32, 0x0F18, 1, mem_t(src(Rn, RAX), -1, 0, disp)); // prefetcht0
+}
+
+void X86_64Assembler::CLZ(int cc, int Rd, int Rm)
+{
+    if (!cond_begin(cc))
+        return;
+    flags_clobbered();
+    op_rr(32, 0x0FBD, RAX, src(Rm, RAX));               // bsr eax, rm
+    uint8_t* site = jcc8(xNE);
+    mov_ri(RAX, 63);
+    patch_rel8(site);
+    alu_ri(32, xXOR, RAX, 31);
+    const int d = dst(Rd);
+    mov_rr(32, d, RAX);
+    commit(Rd, d);
+    set_pointer(Rd, false);
+    cond_end();
+}
+
+// clamps the signed 64-bit value in r to 32 bits
+void X86_64Assembler::saturate(int r, int tmp)
+{
+    movsxd(tmp, r);
+    alu_rr(64, xCMP, tmp, r);
+    uint8_t* site = jcc8(xE);
+    shift_ri(64, xSAR, r, 63);
+    alu_ri(32, xXOR, r, 0x7FFFFFFF);
+    patch_rel8(site);
+    movsxd(r, r);
+}
+
+void X86_64Assembler::qadd(int cc, int Rd, int Rm, int Rn, bool sub, bool dbl)
+{
+    if (!cond_begin(cc))
+        return;
+    movsxd(RCX, src(Rn, RCX));
+    if (dbl) {
+        alu_rr(64, xADD, RCX, RCX);
+        saturate(RCX, RAX);
+    }
+    movsxd(RAX, src(Rm, RAX));
+    alu_rr(64, sub ? xSUB : xADD, RAX, RCX);
+    saturate(RAX, RCX);
+    const int d = dst(Rd);
+    mov_rr(32, d, RAX);
+    commit(Rd, d);
+    set_pointer(Rd, false);
+    cond_end();
+}
+
+void X86_64Assembler::QADD(int cc, int Rd, int Rm, int Rn) {
+    qadd(cc, Rd, Rm, Rn, false, false);
+}
+void X86_64Assembler::QDADD(int cc, int Rd, int Rm, int Rn) {
+    qadd(cc, Rd, Rm, Rn, false, true);
+}
+void X86_64Assembler::QSUB(int cc, int Rd, int Rm, int Rn) {
+    qadd(cc, Rd, Rm, Rn, true, false);
+}
+void X86_64Assembler::QDSUB(int cc, int Rd, int Rm, int Rn) {
+    qadd(cc, Rd, Rm, Rn, true, true);
+}
+
+void X86_64Assembler::UXTB16(int cc, int Rd, int Rm, int rotate)
+{
+    if (!cond_begin(cc))
+        return;
+    op_rr(32, 0x89, src(Rm, RCX), RCX);
+    if (rotate)
+        shift_ri(32, xROR, RCX, rotate);
+    alu_ri(32, xAND, RCX, 0x00FF00FF);
+    const int d = dst(Rd);
+    mov_rr(32, d, RCX);
+    commit(Rd, d);
+    set_pointer(Rd, false);
+    cond_end();
+}
+
+}; // namespace android
+
@@ -0,0 +1,264 @@
+/* libs/pixelflinger/codeflinger/X86_64Assembler.h
+**
+** Copyright 2010, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef ANDROID_X86_64ASSEMBLER_H
+#define ANDROID_X86_64ASSEMBLER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "tinyutils/Vector.h"
+#include "tinyutils/KeyedVector.h"
+#include "tinyutils/smartpointer.h"
+
+#include "codeflinger/ARMAssemblerInterface.h"
+#include "codeflinger/CodeCache.h"
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+/*
+ * X86_64Assembler is a back-end for GGLAssembler: it receives the same
+ * ARM instruction stream as ARMAssembler and translates each instruction
+ * into x86-64 code as it comes.
+ *
+ * - ARM registers live in x86 registers, except R11 which lives in the
+ *   stack frame (there are only 14 usable x86 registers and rax/rcx are
+ *   needed as scratch). The context (R0) arrives in rdi.
+ * - Values are 32 bits, as on ARM. Registers holding an address (loaded
+ *   with ADDR_LDR, or derived from one with ADD/SUB/MOV) are tracked and
+ *   updated with 64-bit arithmetic, everything else uses 32-bit ops.
+ * - ARM flags are mapped onto EFLAGS. Most x86 instructions clobber them,
+ *   so they are saved lazily in the frame and reloaded only when a
+ *   conditional instruction needs them after they were destroyed.
+ *   N and Z are exact; C and V are exact after arithmetic operations,
+ *   they are not modelled for logical ones (GGLAssembler doesn't rely
+ *   on them).
+ * - SP is only usable for the push/pop forms GGLAssembler's Spill emits.
+ */
+
+class X86_64Assembler : public ARMAssemblerInterface
+{
+public:
+                X86_64Assembler(const sp<Assembly>& assembly);
+    virtual     ~X86_64Assembler();
+
+    uint8_t*    base() const;
+    uint8_t*    pc() const;
+
+
+    void        disassemble(const char* name);
+
+    // ------------------------------------------------------------------------
+    // ARMAssemblerInterface...
+    // ------------------------------------------------------------------------
+
+    virtual void    reset();
+
+    virtual int     generate(const char* name);
+
+    virtual void    prolog();
+    virtual void    epilog(uint32_t touched);
+    virtual void    comment(const char* string);
+
+    virtual void    dataProcessing(int opcode, int cc, int s,
+                                int Rd, int Rn,
+                                uint32_t Op2);
+    virtual void MLA(int cc, int s,
+                int Rd, int Rm, int Rs, int Rn);
+    virtual void MUL(int cc, int s,
+                int Rd, int Rm, int Rs);
+    virtual void UMULL(int cc, int s,
+                int RdLo, int RdHi, int Rm, int Rs);
+    virtual void UMUAL(int cc, int s,
+                int RdLo, int RdHi, int Rm, int Rs);
+    virtual void SMULL(int cc, int s,
+                int RdLo, int RdHi, int Rm, int Rs);
+    virtual void SMUAL(int cc, int s,
+                int RdLo, int RdHi, int Rm, int Rs);
+
+    virtual void B(int cc, uint32_t* pc);
+    virtual void BL(int cc, uint32_t* pc);
+    virtual void BX(int cc, int Rn);
+    virtual void label(const char* theLabel);
+    virtual void B(int cc, const char* label);
+    virtual void BL(int cc, const char* label);
+
+    virtual uint32_t* pcForLabel(const char* label);
+
+    virtual void LDR (int cc, int Rd,
+                int Rn, uint32_t offset = immed12_pre(0));
+    virtual void LDRB(int cc, int Rd,
+                int Rn, uint32_t offset = immed12_pre(0));
+    virtual void STR (int cc, int Rd,
+                int Rn, uint32_t offset = immed12_pre(0));
+    virtual void STRB(int cc, int Rd,
+                int Rn, uint32_t offset = immed12_pre(0));
+    virtual void LDRH (int cc, int Rd,
+                int Rn, uint32_t offset = immed8_pre(0));
+    virtual void LDRSB(int cc, int Rd,
+                int Rn, uint32_t offset = immed8_pre(0));
+    virtual void LDRSH(int cc, int Rd,
+                int Rn, uint32_t offset = immed8_pre(0));
+    virtual void STRH (int cc, int Rd,
+                int Rn, uint32_t offset = immed8_pre(0));
+    virtual void ADDR_LDR(int cc, int Rd,
+                int Rn, uint32_t offset = immed12_pre(0));
+    virtual void ADDR_STR(int cc, int Rd,
+                int Rn, uint32_t offset = immed12_pre(0));
+    virtual void LDM(int cc, int dir,
+                int Rn, int W, uint32_t reg_list);
+    virtual void STM(int cc, int dir,
+                int Rn, int W, uint32_t reg_list);
+
+    virtual void SWP(int cc, int Rn, int Rd, int Rm);
+    virtual void SWPB(int cc, int Rn, int Rd, int Rm);
+    virtual void SWI(int cc, uint32_t comment);
+
+    virtual void PLD(int Rn, uint32_t offset);
+    virtual void CLZ(int cc, int Rd, int Rm);
+    virtual void QADD(int cc, int Rd, int Rm, int Rn);
+    virtual void QDADD(int cc, int Rd, int Rm, int Rn);
+    virtual void QSUB(int cc, int Rd, int Rm, int Rn);
+    virtual void QDSUB(int cc, int Rd, int Rm, int Rn);
+    virtual void SMUL(int cc, int xy,
+                int Rd, int Rm, int Rs);
+    virtual void SMULW(int cc, int y,
+                int Rd, int Rm, int Rs);
+    virtual void SMLA(int cc, int xy,
+                int Rd, int Rm, int Rs, int Rn);
+    virtual void SMLAL(int cc, int xy,
+                int RdHi, int RdLo, int Rs, int Rm);
+    virtual void SMLAW(int cc, int y,
+                int Rd, int Rm, int Rs, int Rn);
+    virtual void UXTB16(int cc, int Rd, int Rm, int rotate);
+
+private:
+                X86_64Assembler(const X86_64Assembler& rhs);
+                X86_64Assembler& operator = (const X86_64Assembler& rhs);
+
+    // memory operand: [base + index<<scale + disp]
+    struct mem_t {
+        inline mem_t(int b, int i=-1, int s=0, int32_t d=0)
+            : base(b), index(i), scale(s), disp(d) { }
+        int     base;
+        int     index;
+        int     scale;
+        int32_t disp;
+    };
+
+    // decoded data-processing operand
+    struct operand_t {
+        bool        imm;    // value is an immediate
+        uint32_t    value;
+        int         reg;    // x86 register holding the value
+        int         arm;    // ARM register, when it is used unshifted
+        int         scale;  // pending LSL #0-3 (only when asked for)
+    };
+
+    // encoding
+    void        emit8(uint32_t b);
+    void        emit32(uint32_t w);
+    void        patch_rel8(uint8_t* site);
+    void        patch_rel32(uint8_t* site);
+    void        prefix(int size, int reg, int index, int base, bool byteRegs);
+    void        opcode(uint32_t op);
+    void        op_rr(int size, uint32_t op, int reg, int rm, bool byteRegs=false);
+    void        op_rm(int size, uint32_t op, int reg, const mem_t& m,
+                        bool byteReg=false);
+
+    void        mov_rr(int size, int d, int s);
+    void        mov_ri(int d, uint32_t imm);
+    void        mov_rm(int size, int d, const mem_t& m);
+    void        mov_mr(int size, const mem_t& m, int s);
+    void        lea(int size, int d, const mem_t& m);
+    void        alu_rr(int size, int op, int d, int s);
+    void        alu_ri(int size, int op, int d, uint32_t imm);
+    void        alu(int size, int op, int d, const operand_t& o);
+    void        shift_ri(int size, int op, int d, int amount);
+    void        movsxd(int d, int s);
+    uint8_t*    jcc8(int cc);
+    uint8_t*    jcc32(int cc);
+    void        jcc32(int cc, const char* label);
+
+    // ARM registers
+    int         src(int Rn, int tmp);
+    int         dst(int Rd);
+    void        commit(int Rd, int r);
+    void        load_first(int size, int d, int Rn, operand_t& o);
+    mem_t       slot(int Rn);
+    bool        is_pointer(int Rn) const;
+    void        set_pointer(int Rd, bool pointer);
+
+    operand_t   operand(uint32_t Op2, bool scaled);
+    void        half(int d, int Rn, bool top, int size);
+    void        mull(bool sign, bool acc, int s,
+                        int RdLo, int RdHi, int Rm, int Rs);
+    void        saturate(int r, int tmp);
+    void        qadd(int cc, int Rd, int Rm, int Rn, bool sub, bool dbl);
+    void        transfer(int cc, int kind, int Rd, int Rn, uint32_t offset);
+    void        spill(int cc, int kind, int Rd, uint32_t offset);
+    void        push_spill(int Rd);
+    void        pop_spill(int Rd);
+
+    // conditional execution and flags
+    int         condition(int cc) const;
+    bool        cond_begin(int cc);
+    void        cond_end();
+    void        flags_set(int polarity);
+    void        flags_clobbered();
+    void        flags_needed();
+
+    sp<Assembly>    mAssembly;
+    uint8_t*        mBase;
+    uint8_t*        mPC;
+    uint8_t*        mEnd;
+    uint8_t*        mPrologPC;
+    int64_t         mDuration;
+    bool            mOverflow;
+    bool            mBogusRegister;
+    bool            mLongBranch;
+
+    uint32_t        mPointers;
+    int             mSpillDepth;
+    uint32_t        mSpillPointers;
+
+    int             mFlagsState;
+    int             mFlagsPolarity;
+    uint8_t*        mFlagsSave;
+    bool            mInCond;
+    int             mCondSites;
+    uint8_t*        mCondSite[2];
+
+    struct branch_target_t {
+        inline branch_target_t() : label(0), pc(0) { }
+        inline branch_target_t(const char* l, uint8_t* p)
+            : label(l), pc(p) { }
+        const char* label;
+        uint8_t*    pc;
+    };
+
+    Vector<branch_target_t>                 mBranchTargets;
+    KeyedVector< const char*, uint8_t* >    mLabels;
+    KeyedVector< uint8_t*, const char* >    mLabelsInverseMapping;
+    KeyedVector< uint8_t*, const char* >    mComments;
+};
+
+}; // namespace android
+
+#endif //ANDROID_X86_64ASSEMBLER_H
@@ -25,6 +25,7 @@
 #include <pixelflinger/pixelflinger.h>
 #include <private/pixelflinger/ggl_context.h>
 
+#include "bands.h"
 #include "buffer.h"
 #include "clear.h"
 #include "picker.h"
@@ -790,6 +791,7 @@ void ggl_init_context(context_t* c)
     ggl_init_texture(c);
     ggl_init_picker(c);
     ggl_init_raster(c);
+    ggl_init_bands(c);
     c->formats = gglGetPixelFormatTable();
     c->state.blend.src = GGL_ONE;
     c->state.blend.dst = GGL_ZERO;
@@ -808,6 +810,7 @@ void ggl_init_context(context_t* c)
 
 void ggl_uninit_context(context_t* c)
 {
+    ggl_uninit_bands(c);
     ggl_uninit_scanline(c);
 }
 
@@ -842,3 +845,9 @@ ssize_t gglUninit(GGLContext* con)
 	return 0;
 }
 
+ssize_t gglSetRasterThreads(GGLContext* con, int count)
+{
+    GGL_CONTEXT(c, (void*)con);
+    return ggl_set_bands(c, count);
+}
+
@@ -23,8 +23,11 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <pthread.h>
+
 #include <cutils/memory.h>
 #include <cutils/log.h>
+#include <cutils/properties.h>
 
 #include "buffer.h"
 #include "scanline.h"
@@ -32,8 +35,19 @@
 #include "codeflinger/CodeCache.h"
 #include "codeflinger/GGLAssembler.h"
 #include "codeflinger/ARMAssembler.h"
+#include "codeflinger/X86_64Assembler.h"
 //#include "codeflinger/ARMAssemblerOptimizer.h"
 
+// Set by Android.mk on the targets that link the SSE2/AVX2 kernels
+#ifndef ANDROID_X86_SIMD
+#   define ANDROID_X86_SIMD     0
+#endif
+
+#if ANDROID_X86_SIMD
+#include <cpuid.h>
+#include "scanline_x86.h"
+#endif
+
 // ----------------------------------------------------------------------------
 
 #define ANDROID_CODEGEN_GENERIC     0   // force generic pixel pipeline
@@ -55,10 +69,25 @@
 #   define ANDROID_ARM_CODEGEN  0
 #endif
 
+#if defined(__x86_64__)
+#   define ANDROID_X86_64_CODEGEN   1
+#else
+#   define ANDROID_X86_64_CODEGEN   0
+#endif
+
+#define ANDROID_JIT_CODEGEN (ANDROID_ARM_CODEGEN || ANDROID_X86_64_CODEGEN)
+
 #define DEBUG__CODEGEN_ONLY     0
 
 
+#if ANDROID_X86_64_CODEGEN
+// each ARM instruction becomes about 3 to 4 bytes of x86 code
+#define ASSEMBLY_SCRATCH_SIZE   8192
+#define CODE_CACHE_SIZE         (48 * 1024)
+#else
 #define ASSEMBLY_SCRATCH_SIZE   2048
+#define CODE_CACHE_SIZE         (12 * 1024)
+#endif
 
 // ----------------------------------------------------------------------------
 namespace android {
@@ -81,6 +110,10 @@ static void scanline_perspective_single(context_t* c);
 static void scanline_t32cb16blend(context_t* c);
 static void scanline_t32cb16(context_t* c);
 static void scanline_col32cb16blend(context_t* c);
+#if ANDROID_X86_SIMD
+static void scanline_t32cb32blend(context_t* c);
+static void scanline_t16cb32(context_t* c);
+#endif
 static void scanline_memcpy(context_t* c);
 static void scanline_memset8(context_t* c);
 static void scanline_memset16(context_t* c);
@@ -117,6 +150,15 @@ static shortcut_t shortcuts[] = {
     { { { 0x03515104, 0x00000077, { 0x00000000, 0x00000000 } },
         { 0xFFFFFFFF, 0xFFFFFFFF, { 0xFFFFFFFF, 0xFFFFFFFF } } },
         "565 fb, 8888 fixed color", scanline_col32cb16blend, init_y_packed  },  
+#if ANDROID_X86_SIMD
+    // on ARM these are left to the code generator
+    { { { 0x03515101, 0x00000077, { 0x00000A01, 0x00000000 } },
+        { 0xFFFFFFFF, 0xFFFFFFFF, { 0xFFFFFFFF, 0x0000003F } } },
+        "8888 fb, 8888 tx, blend", scanline_t32cb32blend, init_y_noop },
+    { { { 0x03010101, 0x00000077, { 0x00000A04, 0x00000000 } },
+        { 0xFFFFFFFF, 0xFFFFFFFF, { 0xFFFFFFFF, 0x0000003F } } },
+        "8888 fb, 565 tx", scanline_t16cb32, init_y_packed },
+#endif
     { { { 0x00000000, 0x00000000, { 0x00000000, 0x00000000 } },
         { 0x00000000, 0x00000007, { 0x00000000, 0x00000000 } } },
         "(nop) alpha test", scanline_noop, init_y_noop },
@@ -154,8 +196,23 @@ static  const needs_filter_t fill16noblend = {
 
 // ----------------------------------------------------------------------------
 
-#if ANDROID_ARM_CODEGEN
-static CodeCache gCodeCache(12 * 1024);
+#if ANDROID_JIT_CODEGEN
+static CodeCache gCodeCache(CODE_CACHE_SIZE);
+static pthread_once_t gCodeCacheOnce = PTHREAD_ONCE_INIT;
+
+// debug.pf.cache.size sets the size of the code cache in KB,
+// debug.pf.cache.dir enables the persistent code cache in that directory,
+// which has to be mode 0700 and owned by the process's uid
+static void code_cache_init()
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.pf.cache.size", value, "0");
+    const int size = atoi(value);
+    if (size > 0)
+        gCodeCache.setSize(size * 1024);
+    property_get("debug.pf.cache.dir", value, "");
+    gCodeCache.setPersistentPath(value);
+}
 
 class ScanlineAssembly : public Assembly {
     AssemblyKey<needs_t> mKey;
@@ -166,10 +223,76 @@ public:
 };
 #endif
 
+#if ANDROID_X86_SIMD
+struct x86_kernels_t {
+    void (*t32cb16blend)(uint16_t*, uint32_t*, size_t);
+    void (*t32cb16)(uint16_t*, uint32_t*, size_t);
+    void (*col32cb16blend)(uint16_t*, uint32_t, size_t);
+    void (*t32cb32blend)(uint32_t*, uint32_t*, size_t);
+    void (*t16cb32)(uint32_t*, uint16_t*, size_t, uint32_t);
+};
+
+// all NULL (use the C loops) until we know the CPU can run the kernels
+static x86_kernels_t gX86Kernels;
+
+extern "C" int ggl_x86_simd_level(void)
+{
+    static int level = -1;
+    if (level >= 0)
+        return level;
+
+    int l = GGL_X86_SIMD_NONE;
+    unsigned int a, b, c, d;
+    if (__get_cpuid(1, &a, &b, &c, &d)) {
+        if (d & bit_SSE2)
+            l = GGL_X86_SIMD_SSE2;
+        // AVX2 also needs the kernel to save the ymm registers
+        if ((c & bit_OSXSAVE) && (c & bit_AVX) && __get_cpuid_max(0, 0) >= 7) {
+            uint32_t xcr0, xcr0_hi;
+            asm volatile(".byte 0x0f, 0x01, 0xd0"   // xgetbv
+                    : "=a"(xcr0), "=d"(xcr0_hi) : "c"(0));
+            if ((xcr0 & 6) == 6) {
+                __cpuid_count(7, 0, a, b, c, d);
+                if (b & (1<<5))     // AVX2
+                    l = GGL_X86_SIMD_AVX2;
+            }
+        }
+    }
+    level = l;
+    return level;
+}
+
+static void x86_pick_kernels()
+{
+    switch (ggl_x86_simd_level()) {
+    case GGL_X86_SIMD_AVX2:
+        gX86Kernels.t32cb16blend    = scanline_t32cb16blend_avx2;
+        gX86Kernels.t32cb16         = scanline_t32cb16_avx2;
+        gX86Kernels.col32cb16blend  = scanline_col32cb16blend_avx2;
+        gX86Kernels.t32cb32blend    = scanline_t32cb32blend_avx2;
+        gX86Kernels.t16cb32         = scanline_t16cb32_avx2;
+        break;
+    case GGL_X86_SIMD_SSE2:
+        gX86Kernels.t32cb16blend    = scanline_t32cb16blend_sse2;
+        gX86Kernels.t32cb16         = scanline_t32cb16_sse2;
+        gX86Kernels.col32cb16blend  = scanline_col32cb16blend_sse2;
+        gX86Kernels.t32cb32blend    = scanline_t32cb32blend_sse2;
+        gX86Kernels.t16cb32         = scanline_t16cb32_sse2;
+        break;
+    }
+}
+#endif
+
 // ----------------------------------------------------------------------------
 
 void ggl_init_scanline(context_t* c)
 {
+#if ANDROID_X86_SIMD
+    x86_pick_kernels();
+#endif
+#if ANDROID_JIT_CODEGEN
+    pthread_once(&gCodeCacheOnce, code_cache_init);
+#endif
     c->init_y = init_y;
     c->step_y = step_y__generic;
     c->scanline = scanline;
@@ -179,7 +302,7 @@ void ggl_uninit_scanline(context_t* c)
 {
     if (c->state.buffers.coverage)
         free(c->state.buffers.coverage);
-#if ANDROID_ARM_CODEGEN
+#if ANDROID_JIT_CODEGEN
     if (c->scanline_as)
         c->scanline_as->decStrong(c);
 #endif
@@ -187,6 +310,30 @@ void ggl_uninit_scanline(context_t* c)
 
 // ----------------------------------------------------------------------------
 
+// lets tests pit the generated pipeline against the generic one, see
+// ggl_test_codegen_mode()
+enum {
+    CODEGEN_TEST_DEFAULT,       // shortcuts, then generated code
+    CODEGEN_TEST_GENERIC,       // generic pipeline only
+    CODEGEN_TEST_GENERATED      // generated code only, no shortcuts
+};
+static int gCodegenTestMode = CODEGEN_TEST_DEFAULT;
+
+#if ANDROID_JIT_CODEGEN
+// used when no code could be generated for the needs
+static void pick_fallback(context_t* c)
+{
+#if ANDROID_X86_64_CODEGEN
+    // the generic pipeline is always there to fall back on
+    c->scanline = scanline;
+#else
+    c->scanline = scanline_noop;
+    c->init_y = init_y_noop;
+    c->step_y = step_y__nop;
+#endif
+}
+#endif
+
 static void pick_scanline(context_t* c)
 {
 #if (!defined(DEBUG__CODEGEN_ONLY) || (DEBUG__CODEGEN_ONLY == 0))
@@ -198,48 +345,57 @@ static void pick_scanline(context_t* c)
     return;
 #endif
 
-    //printf("*** needs [%08lx:%08lx:%08lx:%08lx]\n",
-    //    c->state.needs.n, c->state.needs.p,
-    //    c->state.needs.t[0], c->state.needs.t[1]);
-
-    // first handle the special case that we cannot test with a filter
-    const uint32_t cb_format = GGL_READ_NEEDS(CB_FORMAT, c->state.needs.n);
-    if (GGL_READ_NEEDS(T_FORMAT, c->state.needs.t[0]) == cb_format) {
-        if (c->state.needs.match(noblend1to1)) {
-            // this will match regardless of dithering state, since both
-            // src and dest have the same format anyway, there is no dithering
-            // to be done.
-            const GGLFormat* f =
-                &(c->formats[GGL_READ_NEEDS(T_FORMAT, c->state.needs.t[0])]);
-            if ((f->components == GGL_RGB) ||
-                (f->components == GGL_RGBA) ||
-                (f->components == GGL_LUMINANCE) ||
-                (f->components == GGL_LUMINANCE_ALPHA))
-            {
-                // format must have all of RGB components
-                // (so the current color doesn't show through)
-                c->scanline = scanline_memcpy;
-                c->init_y = init_y_noop;
-                return;
+    if (gCodegenTestMode == CODEGEN_TEST_GENERIC) {
+        c->init_y = init_y;
+        c->step_y = step_y__generic;
+        c->scanline = scanline;
+        return;
+    }
+
+    if (gCodegenTestMode == CODEGEN_TEST_DEFAULT) {
+        //printf("*** needs [%08lx:%08lx:%08lx:%08lx]\n",
+        //    c->state.needs.n, c->state.needs.p,
+        //    c->state.needs.t[0], c->state.needs.t[1]);
+
+        // first handle the special case that we cannot test with a filter
+        const uint32_t cb_format = GGL_READ_NEEDS(CB_FORMAT, c->state.needs.n);
+        if (GGL_READ_NEEDS(T_FORMAT, c->state.needs.t[0]) == cb_format) {
+            if (c->state.needs.match(noblend1to1)) {
+                // this will match regardless of dithering state, since
+                // both src and dest have the same format anyway, there is
+                // no dithering to be done.
+                const GGLFormat* f =
+                    &(c->formats[GGL_READ_NEEDS(T_FORMAT, c->state.needs.t[0])]);
+                if ((f->components == GGL_RGB) ||
+                    (f->components == GGL_RGBA) ||
+                    (f->components == GGL_LUMINANCE) ||
+                    (f->components == GGL_LUMINANCE_ALPHA))
+                {
+                    // format must have all of RGB components
+                    // (so the current color doesn't show through)
+                    c->scanline = scanline_memcpy;
+                    c->init_y = init_y_noop;
+                    return;
+                }
             }
         }
-    }
 
-    if (c->state.needs.match(fill16noblend)) {
-        c->init_y = init_y_packed;
-        switch (c->formats[cb_format].size) {
-        case 1: c->scanline = scanline_memset8;  return;
-        case 2: c->scanline = scanline_memset16; return;
-        case 4: c->scanline = scanline_memset32; return;
+        if (c->state.needs.match(fill16noblend)) {
+            c->init_y = init_y_packed;
+            switch (c->formats[cb_format].size) {
+            case 1: c->scanline = scanline_memset8;  return;
+            case 2: c->scanline = scanline_memset16; return;
+            case 4: c->scanline = scanline_memset32; return;
+            }
         }
-    }
 
-    const int numFilters = sizeof(shortcuts)/sizeof(shortcut_t);
-    for (int i=0 ; i<numFilters ; i++) {
-        if (c->state.needs.match(shortcuts[i].filter)) {
-            c->scanline = shortcuts[i].scanline;
-            c->init_y = shortcuts[i].init_y;
-            return;
+        const int numFilters = sizeof(shortcuts)/sizeof(shortcut_t);
+        for (int i=0 ; i<numFilters ; i++) {
+            if (c->state.needs.match(shortcuts[i].filter)) {
+                c->scanline = shortcuts[i].scanline;
+                c->init_y = shortcuts[i].init_y;
+                return;
+            }
         }
     }
 
@@ -248,30 +404,51 @@ static void pick_scanline(context_t* c)
     c->init_y = init_y;
     c->step_y = step_y__generic;
 
-#if ANDROID_ARM_CODEGEN
+#if ANDROID_JIT_CODEGEN
     // we're going to have to generate some code...
     // here, generate code for our pixel pipeline
     const AssemblyKey<needs_t> key(c->state.needs);
     sp<Assembly> assembly = gCodeCache.lookup(key);
+    if (assembly != 0 && assembly->size() == 0) {
+        // we failed to generate code for these needs before
+        pick_fallback(c);
+        return;
+    }
     if (assembly == 0) {
         // create a new assembly region
         sp<ScanlineAssembly> a = new ScanlineAssembly(c->state.needs, 
                 ASSEMBLY_SCRATCH_SIZE);
-        // initialize our assembler
-        GGLAssembler assembler( new ARMAssembler(a) );
-        //GGLAssembler assembler(
-        //        new ARMAssemblerOptimizer(new ARMAssembler(a)) );
-        // generate the scanline code for the given needs
-        int err = assembler.scanline(c->state.needs, c);
+        // another process may have generated it already
+        int err = gCodeCache.load(a->key(), a);
+        if (err) {
+            // initialize our assembler
+#if ANDROID_X86_64_CODEGEN
+            GGLAssembler assembler( new X86_64Assembler(a) );
+#else
+            GGLAssembler assembler( new ARMAssembler(a) );
+            //GGLAssembler assembler(
+            //        new ARMAssemblerOptimizer(new ARMAssembler(a)) );
+#endif
+            // generate the scanline code for the given needs
+            err = assembler.scanline(c->state.needs, c);
+            if (ggl_likely(!err)) {
+                gCodeCache.store(a->key(), a);
+            } else {
+                // the generator fails the same way every time, so cache
+                // an empty assembly to send these needs straight to the
+                // fallback from now on
+                sp<ScanlineAssembly> failed =
+                        new ScanlineAssembly(c->state.needs, 0);
+                gCodeCache.cache(failed->key(), failed);
+            }
+        }
         if (ggl_likely(!err)) {
             // finally, cache this assembly
             err = gCodeCache.cache(a->key(), a);
         }
         if (ggl_unlikely(err)) {
-            LOGE("error generating or caching assembly. Reverting to NOP.");
-            c->scanline = scanline_noop;
-            c->init_y = init_y_noop;
-            c->step_y = step_y__nop;
+            LOGE("error generating or caching assembly. Using fallback.");
+            pick_fallback(c);
             return;
         }
         assembly = a;
@@ -911,7 +1088,7 @@ void init_y(context_t* c, int32_t ys)
             gen.width   = t.surface.width;
             gen.height  = t.surface.height;
             gen.stride  = t.surface.stride;
-            gen.data    = int32_t(t.surface.data);
+            gen.data    = uintptr_t(t.surface.data);
             gen.dsdx = ti.dsdx;
             gen.dtdx = ti.dtdx;
         }
@@ -1280,6 +1457,12 @@ void scanline_col32cb16blend(context_t* c)
     scanline_col32cb16blend_arm(dst, GGL_RGBA_TO_HOST(c->packed8888), ct);
 #endif // defined(__ARM_HAVE_NEON) && BYTE_ORDER == LITTLE_ENDIAN
 #else
+#if ANDROID_X86_SIMD
+    if (gX86Kernels.col32cb16blend) {
+        gX86Kernels.col32cb16blend(dst, GGL_RGBA_TO_HOST(c->packed8888), ct);
+        return;
+    }
+#endif
     uint32_t s = GGL_RGBA_TO_HOST(c->packed8888);
     int sA = (s>>24);
     int f = 0x100 - (sA + (sA>>7));
@@ -1319,7 +1502,14 @@ void scanline_t32cb16(context_t* c)
     int sR, sG, sB;
     uint32_t s, d;
 
-    if (ct==1 || uint32_t(dst)&2) {
+#if ANDROID_X86_SIMD
+    if (gX86Kernels.t32cb16) {
+        gX86Kernels.t32cb16(dst, src, ct);
+        return;
+    }
+#endif
+
+    if (ct==1 || uintptr_t(dst)&2) {
 last_one:
         s = GGL_RGBA_TO_HOST( *src++ );
         sR = (s >> (   3))&0x1F;
@@ -1371,6 +1561,12 @@ void scanline_t32cb16blend(context_t* c)
 #if ((ANDROID_CODEGEN >= ANDROID_CODEGEN_ASM) && defined(__arm__))
     scanline_t32cb16blend_arm(dst, src, ct);
 #else
+#if ANDROID_X86_SIMD
+    if (gX86Kernels.t32cb16blend) {
+        gX86Kernels.t32cb16blend(dst, src, ct);
+        return;
+    }
+#endif
     while (ct--) {
         uint32_t s = *src++;
         if (!s) {
@@ -1395,6 +1591,57 @@ void scanline_t32cb16blend(context_t* c)
 #endif
 }
 
+#if ANDROID_X86_SIMD
+
+void scanline_t32cb32blend(context_t* c)
+{
+    int32_t x = c->iterators.xl;
+    size_t ct = c->iterators.xr - x;
+    int32_t y = c->iterators.y;
+    surface_t* cb = &(c->state.buffers.color);
+    uint32_t* dst = reinterpret_cast<uint32_t*>(cb->data) + (x+(cb->stride*y));
+
+    surface_t* tex = &(c->state.texture[0].surface);
+    const int32_t u = (c->state.texture[0].shade.is0>>16) + x;
+    const int32_t v = (c->state.texture[0].shade.it0>>16) + y;
+    uint32_t *src = reinterpret_cast<uint32_t*>(tex->data)+(u+(tex->stride*v));
+
+    if (gX86Kernels.t32cb32blend) {
+        gX86Kernels.t32cb32blend(dst, src, ct);
+        return;
+    }
+    while (ct--) {
+        *dst = ggl_blend_8888_8888(*src++, *dst);
+        dst++;
+    }
+}
+
+void scanline_t16cb32(context_t* c)
+{
+    int32_t x = c->iterators.xl;
+    size_t ct = c->iterators.xr - x;
+    int32_t y = c->iterators.y;
+    surface_t* cb = &(c->state.buffers.color);
+    uint32_t* dst = reinterpret_cast<uint32_t*>(cb->data) + (x+(cb->stride*y));
+
+    surface_t* tex = &(c->state.texture[0].surface);
+    const int32_t u = (c->state.texture[0].shade.is0>>16) + x;
+    const int32_t v = (c->state.texture[0].shade.it0>>16) + y;
+    uint16_t *src = reinterpret_cast<uint16_t*>(tex->data)+(u+(tex->stride*v));
+
+    // the texture has no alpha, so it comes from the current color
+    const uint32_t a = GGL_RGBA_TO_HOST(c->packed8888) >> 24;
+    if (gX86Kernels.t16cb32) {
+        gX86Kernels.t16cb32(dst, src, ct, a);
+        return;
+    }
+    while (ct--) {
+        *dst++ = ggl_convert_565_8888(*src++, a);
+    }
+}
+
+#endif // ANDROID_X86_SIMD
+
 void scanline_memcpy(context_t* c)
 {
     int32_t x = c->iterators.xl;
@@ -1521,7 +1768,7 @@ void rect_memcpy(context_t* c, size_t yc)
 using namespace android;
 extern "C" void ggl_test_codegen(uint32_t n, uint32_t p, uint32_t t0, uint32_t t1)
 {
-#if ANDROID_ARM_CODEGEN
+#if ANDROID_JIT_CODEGEN
     GGLContext* c;
     gglInit(&c);
     needs_t needs;
@@ -1530,14 +1777,52 @@ extern "C" void ggl_test_codegen(uint32_t n, uint32_t p, uint32_t t0, uint32_t t
     needs.t[0] = t0;
     needs.t[1] = t1;
     sp<ScanlineAssembly> a(new ScanlineAssembly(needs, ASSEMBLY_SCRATCH_SIZE));
+#if ANDROID_X86_64_CODEGEN
+    GGLAssembler assembler( new X86_64Assembler(a) );
+#else
     GGLAssembler assembler( new ARMAssembler(a) );
+#endif
     int err = assembler.scanline(needs, (context_t*)c);
     if (err != 0) {
         printf("error %08x (%s)\n", err, strerror(-err));
     }
     gglUninit(c);
 #else
-    printf("This test runs only on ARM\n");
+    printf("This test runs only on ARM and x86-64\n");
+#endif
+}
+
+extern "C" void ggl_test_codegen_mode(int mode)
+{
+    gCodegenTestMode = mode;
+}
+
+// a size of 0 empties the cache and leaves it at its current size
+extern "C" void ggl_test_code_cache(size_t size, const char* path)
+{
+#if ANDROID_JIT_CODEGEN
+    pthread_once(&gCodeCacheOnce, code_cache_init);
+    CodeCache::stats_t stats;
+    gCodeCache.getStats(&stats);
+    gCodeCache.setSize(0);
+    gCodeCache.setSize(size ? size : stats.size);
+    gCodeCache.setPersistentPath(path);
 #endif
 }
 
+// hits, misses, evictions, loads, stores, entries, bytes in use
+extern "C" void ggl_test_code_cache_stats(uint32_t* s)
+{
+    memset(s, 0, 7*sizeof(uint32_t));
+#if ANDROID_JIT_CODEGEN
+    CodeCache::stats_t stats;
+    gCodeCache.getStats(&stats);
+    s[0] = stats.hits;
+    s[1] = stats.misses;
+    s[2] = stats.evictions;
+    s[3] = stats.loads;
+    s[4] = stats.stores;
+    s[5] = stats.entries;
+    s[6] = stats.inUse;
+#endif
+}
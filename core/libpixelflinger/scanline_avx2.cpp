@@ -0,0 +1,184 @@
+/* libs/pixelflinger/scanline_avx2.cpp
+**
+** Copyright 2010, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#include <immintrin.h>
+
+#include "scanline_x86.h"
+
+using namespace android;
+
+// ----------------------------------------------------------------------------
+// Same algorithms as scanline_sse2.cpp on 256-bit registers. Unpack and
+// pack instructions work within 128-bit lanes, so whenever the pixel order
+// changes between 32-bit and 16-bit layouts it is restored with a permute.
+// ----------------------------------------------------------------------------
+
+// pack the low 16 bits of each 32-bit lane, in pixel order
+static inline __m256i pack_lo16(__m256i a, __m256i b)
+{
+    a = _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+    b = _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16);
+    return _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+}
+
+// 16 RGBA_8888 pixels to 16 RGB_565 pixels
+static inline __m256i convert_8888_565(__m256i s0, __m256i s1)
+{
+    const __m256i maskR = _mm256_set1_epi32(0xF8);
+    const __m256i maskG = _mm256_set1_epi32(0x7E0);
+    const __m256i maskB = _mm256_set1_epi32(0x1F);
+    __m256i r0 = _mm256_slli_epi32(_mm256_and_si256(s0, maskR), 8);
+    __m256i r1 = _mm256_slli_epi32(_mm256_and_si256(s1, maskR), 8);
+    r0 = _mm256_or_si256(r0, _mm256_and_si256(_mm256_srli_epi32(s0, 5), maskG));
+    r1 = _mm256_or_si256(r1, _mm256_and_si256(_mm256_srli_epi32(s1, 5), maskG));
+    r0 = _mm256_or_si256(r0, _mm256_and_si256(_mm256_srli_epi32(s0, 19), maskB));
+    r1 = _mm256_or_si256(r1, _mm256_and_si256(_mm256_srli_epi32(s1, 19), maskB));
+    return pack_lo16(r0, r1);
+}
+
+static inline __m256i blend_565(__m256i sR, __m256i sG, __m256i sB,
+        __m256i f, __m256i d)
+{
+    const __m256i mask5 = _mm256_set1_epi16(0x1F);
+    const __m256i mask6 = _mm256_set1_epi16(0x3F);
+    __m256i dR = _mm256_srli_epi16(d, 11);
+    __m256i dG = _mm256_and_si256(_mm256_srli_epi16(d, 5), mask6);
+    __m256i dB = _mm256_and_si256(d, mask5);
+    sR = _mm256_add_epi16(sR, _mm256_srli_epi16(_mm256_mullo_epi16(f, dR), 8));
+    sG = _mm256_add_epi16(sG, _mm256_srli_epi16(_mm256_mullo_epi16(f, dG), 8));
+    sB = _mm256_add_epi16(sB, _mm256_srli_epi16(_mm256_mullo_epi16(f, dB), 8));
+    return _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi16(sR, 11),
+            _mm256_slli_epi16(sG, 5)), sB);
+}
+
+static inline __m256i blend_8888(__m256i s, __m256i d)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i a = _mm256_shufflelo_epi16(s, 0xFF);
+    a = _mm256_shufflehi_epi16(a, 0xFF);
+    __m256i k = _mm256_or_si256(_mm256_slli_epi16(a, 8), a);
+    k = _mm256_add_epi16(k, _mm256_srli_epi16(a, 7));
+    __m256i f = _mm256_sub_epi16(zero, k);
+    __m256i lo = _mm256_mullo_epi16(d, f);
+    __m256i hi = _mm256_mulhi_epu16(d, f);
+    __m256i t = _mm256_add_epi16(hi, _mm256_srli_epi16(lo, 15));
+    t = _mm256_add_epi16(t, _mm256_and_si256(d, _mm256_cmpeq_epi16(a, zero)));
+    return _mm256_add_epi16(s, t);
+}
+
+// ----------------------------------------------------------------------------
+
+void scanline_t32cb16blend_avx2(uint16_t* dst, uint32_t* src, size_t ct)
+{
+    const __m256i mask5 = _mm256_set1_epi16(0x1F);
+    const __m256i mask6 = _mm256_set1_epi16(0x3F);
+    const __m256i k256 = _mm256_set1_epi16(0x100);
+    while (ct >= 16) {
+        __m256i s0 = _mm256_loadu_si256((const __m256i*)src);
+        __m256i s1 = _mm256_loadu_si256((const __m256i*)(src+8));
+        __m256i d = _mm256_loadu_si256((const __m256i*)dst);
+        __m256i s = convert_8888_565(s0, s1);
+        __m256i sA = _mm256_permute4x64_epi64(_mm256_packs_epi32(
+                _mm256_srli_epi32(s0, 24), _mm256_srli_epi32(s1, 24)), 0xD8);
+        __m256i f = _mm256_sub_epi16(k256,
+                _mm256_add_epi16(sA, _mm256_srli_epi16(sA, 7)));
+        __m256i sR = _mm256_srli_epi16(s, 11);
+        __m256i sG = _mm256_and_si256(_mm256_srli_epi16(s, 5), mask6);
+        __m256i sB = _mm256_and_si256(s, mask5);
+        _mm256_storeu_si256((__m256i*)dst, blend_565(sR, sG, sB, f, d));
+        src += 16;
+        dst += 16;
+        ct -= 16;
+    }
+    // 8..15 leftover pixels are still worth a vector pass
+    scanline_t32cb16blend_sse2(dst, src, ct);
+}
+
+void scanline_t32cb16_avx2(uint16_t* dst, uint32_t* src, size_t ct)
+{
+    while (ct >= 16) {
+        __m256i s0 = _mm256_loadu_si256((const __m256i*)src);
+        __m256i s1 = _mm256_loadu_si256((const __m256i*)(src+8));
+        _mm256_storeu_si256((__m256i*)dst, convert_8888_565(s0, s1));
+        src += 16;
+        dst += 16;
+        ct -= 16;
+    }
+    scanline_t32cb16_sse2(dst, src, ct);
+}
+
+void scanline_col32cb16blend_avx2(uint16_t* dst, uint32_t col, size_t ct)
+{
+    const int sA = (col>>24);
+    const __m256i sR = _mm256_set1_epi16((col >> (   3))&0x1F);
+    const __m256i sG = _mm256_set1_epi16((col >> ( 8+2))&0x3F);
+    const __m256i sB = _mm256_set1_epi16((col >> (16+3))&0x1F);
+    const __m256i f = _mm256_set1_epi16(0x100 - (sA + (sA>>7)));
+    while (ct >= 16) {
+        __m256i d = _mm256_loadu_si256((const __m256i*)dst);
+        _mm256_storeu_si256((__m256i*)dst, blend_565(sR, sG, sB, f, d));
+        dst += 16;
+        ct -= 16;
+    }
+    scanline_col32cb16blend_sse2(dst, col, ct);
+}
+
+void scanline_t32cb32blend_avx2(uint32_t* dst, uint32_t* src, size_t ct)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    while (ct >= 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)src);
+        __m256i d = _mm256_loadu_si256((const __m256i*)dst);
+        __m256i lo = blend_8888(_mm256_unpacklo_epi8(s, zero),
+                _mm256_unpacklo_epi8(d, zero));
+        __m256i hi = blend_8888(_mm256_unpackhi_epi8(s, zero),
+                _mm256_unpackhi_epi8(d, zero));
+        _mm256_storeu_si256((__m256i*)dst, _mm256_packus_epi16(lo, hi));
+        src += 8;
+        dst += 8;
+        ct -= 8;
+    }
+    scanline_t32cb32blend_sse2(dst, src, ct);
+}
+
+void scanline_t16cb32_avx2(uint32_t* dst, uint16_t* src, size_t ct, uint32_t a)
+{
+    const __m256i mask5 = _mm256_set1_epi16(0x1F);
+    const __m256i mask6 = _mm256_set1_epi16(0x3F);
+    const __m256i alpha = _mm256_set1_epi16(a<<8);
+    while (ct >= 16) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)src);
+        __m256i r = _mm256_srli_epi16(s, 11);
+        __m256i g = _mm256_and_si256(_mm256_srli_epi16(s, 5), mask6);
+        __m256i b = _mm256_and_si256(s, mask5);
+        r = _mm256_or_si256(_mm256_slli_epi16(r, 3), _mm256_srli_epi16(r, 2));
+        g = _mm256_or_si256(_mm256_slli_epi16(g, 2), _mm256_srli_epi16(g, 4));
+        b = _mm256_or_si256(_mm256_slli_epi16(b, 3), _mm256_srli_epi16(b, 2));
+        __m256i rg = _mm256_or_si256(r, _mm256_slli_epi16(g, 8));
+        __m256i ba = _mm256_or_si256(b, alpha);
+        __m256i lo = _mm256_unpacklo_epi16(rg, ba);   // pixels 0-3, 8-11
+        __m256i hi = _mm256_unpackhi_epi16(rg, ba);   // pixels 4-7, 12-15
+        _mm256_storeu_si256((__m256i*)dst,
+                _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*)(dst+8),
+                _mm256_permute2x128_si256(lo, hi, 0x31));
+        src += 16;
+        dst += 16;
+        ct -= 16;
+    }
+    scanline_t16cb32_sse2(dst, src, ct, a);
+}
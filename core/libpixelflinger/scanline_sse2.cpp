@@ -0,0 +1,196 @@
+/* libs/pixelflinger/scanline_sse2.cpp
+**
+** Copyright 2010, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#include <emmintrin.h>
+
+#include "scanline_x86.h"
+
+using namespace android;
+
+// ----------------------------------------------------------------------------
+
+// pack the low 16 bits of each 32-bit lane (packs_epi32 saturates, so
+// sign-extend first to keep values >= 0x8000 intact)
+static inline __m128i pack_lo16(__m128i a, __m128i b)
+{
+    a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+    b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+    return _mm_packs_epi32(a, b);
+}
+
+// 8 RGBA_8888 pixels to 8 RGB_565 pixels
+static inline __m128i convert_8888_565(__m128i s0, __m128i s1)
+{
+    const __m128i maskR = _mm_set1_epi32(0xF8);
+    const __m128i maskG = _mm_set1_epi32(0x7E0);
+    const __m128i maskB = _mm_set1_epi32(0x1F);
+    __m128i r0 = _mm_slli_epi32(_mm_and_si128(s0, maskR), 8);
+    __m128i r1 = _mm_slli_epi32(_mm_and_si128(s1, maskR), 8);
+    r0 = _mm_or_si128(r0, _mm_and_si128(_mm_srli_epi32(s0, 5), maskG));
+    r1 = _mm_or_si128(r1, _mm_and_si128(_mm_srli_epi32(s1, 5), maskG));
+    r0 = _mm_or_si128(r0, _mm_and_si128(_mm_srli_epi32(s0, 19), maskB));
+    r1 = _mm_or_si128(r1, _mm_and_si128(_mm_srli_epi32(s1, 19), maskB));
+    return pack_lo16(r0, r1);
+}
+
+// sR + (f*dR)>>8 for each component of 8 RGB_565 pixels; sR, sG, sB and
+// f are 16-bit lanes, the result is truncated to 16 bits like the C code.
+static inline __m128i blend_565(__m128i sR, __m128i sG, __m128i sB,
+        __m128i f, __m128i d)
+{
+    const __m128i mask5 = _mm_set1_epi16(0x1F);
+    const __m128i mask6 = _mm_set1_epi16(0x3F);
+    __m128i dR = _mm_srli_epi16(d, 11);
+    __m128i dG = _mm_and_si128(_mm_srli_epi16(d, 5), mask6);
+    __m128i dB = _mm_and_si128(d, mask5);
+    sR = _mm_add_epi16(sR, _mm_srli_epi16(_mm_mullo_epi16(f, dR), 8));
+    sG = _mm_add_epi16(sG, _mm_srli_epi16(_mm_mullo_epi16(f, dG), 8));
+    sB = _mm_add_epi16(sB, _mm_srli_epi16(_mm_mullo_epi16(f, dB), 8));
+    return _mm_or_si128(_mm_or_si128(_mm_slli_epi16(sR, 11),
+            _mm_slli_epi16(sG, 5)), sB);
+}
+
+// 2 pixels (one per half, 16-bit components) of 8888 over 8888
+static inline __m128i blend_8888(__m128i s, __m128i d)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = _mm_shufflelo_epi16(s, 0xFF);
+    a = _mm_shufflehi_epi16(a, 0xFF);
+    // f = 0x10000 - (expand(a, 8, 16) + a>>7), 0x10000 wraps to 0 and is
+    // fixed up below (a == 0 leaves the destination untouched)
+    __m128i k = _mm_or_si128(_mm_slli_epi16(a, 8), a);
+    k = _mm_add_epi16(k, _mm_srli_epi16(a, 7));
+    __m128i f = _mm_sub_epi16(zero, k);
+    // (d*f + 0x8000) >> 16
+    __m128i lo = _mm_mullo_epi16(d, f);
+    __m128i hi = _mm_mulhi_epu16(d, f);
+    __m128i t = _mm_add_epi16(hi, _mm_srli_epi16(lo, 15));
+    t = _mm_add_epi16(t, _mm_and_si128(d, _mm_cmpeq_epi16(a, zero)));
+    return _mm_add_epi16(s, t);
+}
+
+// ----------------------------------------------------------------------------
+
+void scanline_t32cb16blend_sse2(uint16_t* dst, uint32_t* src, size_t ct)
+{
+    const __m128i mask5 = _mm_set1_epi16(0x1F);
+    const __m128i mask6 = _mm_set1_epi16(0x3F);
+    const __m128i k256 = _mm_set1_epi16(0x100);
+    while (ct >= 8) {
+        __m128i s0 = _mm_loadu_si128((const __m128i*)src);
+        __m128i s1 = _mm_loadu_si128((const __m128i*)(src+4));
+        __m128i d = _mm_loadu_si128((const __m128i*)dst);
+        __m128i s = convert_8888_565(s0, s1);
+        __m128i sA = _mm_packs_epi32(
+                _mm_srli_epi32(s0, 24), _mm_srli_epi32(s1, 24));
+        __m128i f = _mm_sub_epi16(k256,
+                _mm_add_epi16(sA, _mm_srli_epi16(sA, 7)));
+        __m128i sR = _mm_srli_epi16(s, 11);
+        __m128i sG = _mm_and_si128(_mm_srli_epi16(s, 5), mask6);
+        __m128i sB = _mm_and_si128(s, mask5);
+        _mm_storeu_si128((__m128i*)dst, blend_565(sR, sG, sB, f, d));
+        src += 8;
+        dst += 8;
+        ct -= 8;
+    }
+    while (ct--) {
+        *dst = ggl_blend_8888_565(*src++, *dst);
+        dst++;
+    }
+}
+
+void scanline_t32cb16_sse2(uint16_t* dst, uint32_t* src, size_t ct)
+{
+    while (ct >= 8) {
+        __m128i s0 = _mm_loadu_si128((const __m128i*)src);
+        __m128i s1 = _mm_loadu_si128((const __m128i*)(src+4));
+        _mm_storeu_si128((__m128i*)dst, convert_8888_565(s0, s1));
+        src += 8;
+        dst += 8;
+        ct -= 8;
+    }
+    while (ct--) {
+        *dst++ = ggl_convert_8888_565(*src++);
+    }
+}
+
+void scanline_col32cb16blend_sse2(uint16_t* dst, uint32_t col, size_t ct)
+{
+    const int sA = (col>>24);
+    const __m128i sR = _mm_set1_epi16((col >> (   3))&0x1F);
+    const __m128i sG = _mm_set1_epi16((col >> ( 8+2))&0x3F);
+    const __m128i sB = _mm_set1_epi16((col >> (16+3))&0x1F);
+    const __m128i f = _mm_set1_epi16(0x100 - (sA + (sA>>7)));
+    while (ct >= 8) {
+        __m128i d = _mm_loadu_si128((const __m128i*)dst);
+        _mm_storeu_si128((__m128i*)dst, blend_565(sR, sG, sB, f, d));
+        dst += 8;
+        ct -= 8;
+    }
+    while (ct--) {
+        *dst = ggl_blend_8888_565(col, *dst);
+        dst++;
+    }
+}
+
+void scanline_t32cb32blend_sse2(uint32_t* dst, uint32_t* src, size_t ct)
+{
+    const __m128i zero = _mm_setzero_si128();
+    while (ct >= 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*)src);
+        __m128i d = _mm_loadu_si128((const __m128i*)dst);
+        __m128i lo = blend_8888(_mm_unpacklo_epi8(s, zero),
+                _mm_unpacklo_epi8(d, zero));
+        __m128i hi = blend_8888(_mm_unpackhi_epi8(s, zero),
+                _mm_unpackhi_epi8(d, zero));
+        // packus clamps to 0xFF, as the generic blending() does
+        _mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(lo, hi));
+        src += 4;
+        dst += 4;
+        ct -= 4;
+    }
+    while (ct--) {
+        *dst = ggl_blend_8888_8888(*src++, *dst);
+        dst++;
+    }
+}
+
+void scanline_t16cb32_sse2(uint32_t* dst, uint16_t* src, size_t ct, uint32_t a)
+{
+    const __m128i mask5 = _mm_set1_epi16(0x1F);
+    const __m128i mask6 = _mm_set1_epi16(0x3F);
+    const __m128i alpha = _mm_set1_epi16(a<<8);
+    while (ct >= 8) {
+        __m128i s = _mm_loadu_si128((const __m128i*)src);
+        __m128i r = _mm_srli_epi16(s, 11);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(s, 5), mask6);
+        __m128i b = _mm_and_si128(s, mask5);
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+        b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+        __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+        __m128i ba = _mm_or_si128(b, alpha);
+        _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i*)(dst+4), _mm_unpackhi_epi16(rg, ba));
+        src += 8;
+        dst += 8;
+        ct -= 8;
+    }
+    while (ct--) {
+        *dst++ = ggl_convert_565_8888(*src++, a);
+    }
+}
@@ -0,0 +1,116 @@
+/* libs/pixelflinger/scanline_x86.h
+**
+** Copyright 2010, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+
+#ifndef ANDROID_SCANLINE_X86_H
+#define ANDROID_SCANLINE_X86_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// ----------------------------------------------------------------------------
+// Vectorized span kernels for x86. The SSE2 and AVX2 flavors live in
+// separate static libraries (so they can be built with -msse2/-mavx2
+// without leaking those instructions into the rest of pixelflinger) and
+// are only called after ggl_x86_simd_level() has checked the CPU.
+//
+// Every kernel produces exactly the same pixels as the C loop of the
+// scanline it replaces; the scalar helpers below are used for the tails.
+// ----------------------------------------------------------------------------
+
+#define GGL_X86_SIMD_NONE   0
+#define GGL_X86_SIMD_SSE2   1
+#define GGL_X86_SIMD_AVX2   2
+
+extern "C" {
+
+int  ggl_x86_simd_level(void);
+
+void scanline_t32cb16blend_sse2(uint16_t* dst, uint32_t* src, size_t ct);
+void scanline_t32cb16_sse2(uint16_t* dst, uint32_t* src, size_t ct);
+void scanline_col32cb16blend_sse2(uint16_t* dst, uint32_t col, size_t ct);
+void scanline_t32cb32blend_sse2(uint32_t* dst, uint32_t* src, size_t ct);
+void scanline_t16cb32_sse2(uint32_t* dst, uint16_t* src, size_t ct, uint32_t a);
+
+void scanline_t32cb16blend_avx2(uint16_t* dst, uint32_t* src, size_t ct);
+void scanline_t32cb16_avx2(uint16_t* dst, uint32_t* src, size_t ct);
+void scanline_col32cb16blend_avx2(uint16_t* dst, uint32_t col, size_t ct);
+void scanline_t32cb32blend_avx2(uint32_t* dst, uint32_t* src, size_t ct);
+void scanline_t16cb32_avx2(uint32_t* dst, uint16_t* src, size_t ct, uint32_t a);
+
+};
+
+namespace android {
+
+// 8888 (premultiplied) over 565, as in scanline_t32cb16blend()
+static inline uint16_t ggl_blend_8888_565(uint32_t s, uint16_t d)
+{
+    int sR = (s >> (   3))&0x1F;
+    int sG = (s >> ( 8+2))&0x3F;
+    int sB = (s >> (16+3))&0x1F;
+    int sA = (s>>24);
+    int f = 0x100 - (sA + (sA>>7));
+    int dR = (d>>11)&0x1f;
+    int dG = (d>>5)&0x3f;
+    int dB = (d)&0x1f;
+    sR += (f*dR)>>8;
+    sG += (f*dG)>>8;
+    sB += (f*dB)>>8;
+    return uint16_t((sR<<11)|(sG<<5)|sB);
+}
+
+static inline uint16_t ggl_convert_8888_565(uint32_t s)
+{
+    int sR = (s >> (   3))&0x1F;
+    int sG = (s >> ( 8+2))&0x3F;
+    int sB = (s >> (16+3))&0x1F;
+    return uint16_t((sR<<11)|(sG<<5)|sB);
+}
+
+// 8888 (premultiplied) over 8888. This is what the generic pipeline computes
+// for GGL_ONE / GGL_ONE_MINUS_SRC_ALPHA: the alpha is expanded to a 16.16
+// blend factor and the destination is scaled with a rounded gglMulx().
+static inline uint32_t ggl_blend_8888_8888(uint32_t s, uint32_t d)
+{
+    const uint32_t sA = s>>24;
+    const uint32_t f = 0x10000 - (((sA<<8)|sA) + (sA>>7));
+    uint32_t r = 0;
+    for (int shift=0 ; shift<32 ; shift+=8) {
+        uint32_t c = ((s>>shift)&0xFF) + ((((d>>shift)&0xFF)*f + 0x8000)>>16);
+        if (c > 0xFF)
+            c = 0xFF;
+        r |= c<<shift;
+    }
+    return r;
+}
+
+// 565 to 8888, components are expanded by bit replication; the alpha
+// comes from the current (flat) color
+static inline uint32_t ggl_convert_565_8888(uint16_t s, uint32_t a)
+{
+    uint32_t r = (s>>11);
+    uint32_t g = (s>>5)&0x3F;
+    uint32_t b = (s)&0x1F;
+    r = (r<<3)|(r>>2);
+    g = (g<<2)|(g>>4);
+    b = (b<<3)|(b>>2);
+    return (a<<24) | (b<<16) | (g<<8) | r;
+}
+
+}; // namespace android
+
+#endif // ANDROID_SCANLINE_X86_H
@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <pixelflinger/pixelflinger.h>
+
+// Checks that rendering in bands on several threads gives exactly the
+// same result as rendering on one, then measures the fill rate of
+// clears and large textured quads with 1 to 8 threads.
+
+enum { W = 1024, H = 1024, TW = 64, TH = 64 };
+
+static const int gColorFormats[] = {
+    GGL_PIXEL_FORMAT_RGBA_8888, GGL_PIXEL_FORMAT_RGB_565,
+    GGL_PIXEL_FORMAT_RGBA_4444, GGL_PIXEL_FORMAT_A_8
+};
+
+static const GGLenum gBlendFuncs[][2] = {
+    { GGL_ONE,          GGL_ZERO                },
+    { GGL_SRC_ALPHA,    GGL_ONE_MINUS_SRC_ALPHA },
+    { GGL_ONE,          GGL_ONE_MINUS_SRC_ALPHA },
+    { GGL_DST_COLOR,    GGL_ZERO                },
+};
+
+#define countof(a)  (sizeof(a)/sizeof(*(a)))
+
+enum { RECT, TRIANGLE, AA_TRIANGLE, CLEAR, PRIMITIVES };
+
+static const char* const gPrimitiveNames[] = {
+    "rect", "triangle", "aa triangle", "clear"
+};
+
+struct state_t {
+    int cb;
+    int primitive;
+    bool texture;
+    bool smooth;
+    bool blend;
+    int func;
+    bool depth;
+    bool dither;
+    GGLclampx color[4];
+    GGLcolor colorGrad[12];
+    GGLfixed32 zGrad[3];
+    int32_t texGrad[8];
+    GGLint rect[4];
+    GGLcoord v[3][2];
+};
+
+static uint8_t gColor[W*H*4];
+static uint16_t gDepth[W*H];
+static uint8_t gTexels[TW*TH*4];
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int32_t rand_range(int32_t range)
+{
+    return ((uint32_t(rand()) << 16) ^ uint32_t(rand())) % range;
+}
+
+static void randomize(state_t& s)
+{
+    memset(&s, 0, sizeof(s));
+    s.cb = gColorFormats[rand() % countof(gColorFormats)];
+    s.primitive = rand() % PRIMITIVES;
+    s.texture = rand() & 1;
+    s.smooth = rand() & 1;
+    s.blend = rand() & 1;
+    s.func = rand() % countof(gBlendFuncs);
+    s.depth = rand() & 1;
+    s.dither = rand() & 1;
+    for (int i=0 ; i<4 ; i++)
+        s.color[i] = rand_range(0x10001);
+    for (int i=0 ; i<4 ; i++) {
+        s.colorGrad[i*3+0] = rand_range(0x800000);
+        s.colorGrad[i*3+1] = rand_range(0x1000) - 0x800;
+        s.colorGrad[i*3+2] = rand_range(0x1000) - 0x800;
+    }
+    s.zGrad[0] = rand_range(0x40000000);
+    s.zGrad[1] = rand_range(0x100000) - 0x80000;
+    s.zGrad[2] = rand_range(0x100000) - 0x80000;
+    s.texGrad[0] = rand_range(TW << 16);
+    s.texGrad[1] = rand_range(0x20000) - 0x10000;
+    s.texGrad[2] = rand_range(0x20000) - 0x10000;
+    s.texGrad[3] = rand_range(TH << 16);
+    s.texGrad[4] = rand_range(0x20000) - 0x10000;
+    s.texGrad[5] = rand_range(0x20000) - 0x10000;
+    s.rect[0] = rand_range(W/2);
+    s.rect[1] = rand_range(H/2);
+    s.rect[2] = s.rect[0] + 1 + rand_range(W - s.rect[0]);
+    s.rect[3] = s.rect[1] + 1 + rand_range(H - s.rect[1]);
+    for (int i=0 ; i<3 ; i++) {
+        s.v[i][0] = rand_range(W << 4);
+        s.v[i][1] = rand_range(H << 4);
+    }
+}
+
+static void setup(GGLContext* c, const state_t& s)
+{
+    GGLSurface cb, zb, tx;
+    memset(&cb, 0, sizeof(cb));
+    cb.version = sizeof(GGLSurface);
+    cb.width = W;
+    cb.height = H;
+    cb.stride = W;
+    cb.data = gColor;
+    cb.format = s.cb;
+    c->colorBuffer(c, &cb);
+    zb = cb;
+    zb.data = (GGLubyte*)gDepth;
+    zb.format = GGL_PIXEL_FORMAT_Z_16;
+    c->depthBuffer(c, &zb);
+
+    if (s.texture) {
+        tx = cb;
+        tx.width = tx.stride = TW;
+        tx.height = TH;
+        tx.data = gTexels;
+        tx.format = GGL_PIXEL_FORMAT_RGBA_8888;
+        c->activeTexture(c, 0);
+        c->bindTexture(c, &tx);
+        c->texEnvi(c, GGL_TEXTURE_ENV, GGL_TEXTURE_ENV_MODE, GGL_MODULATE);
+        c->texParameteri(c, GGL_TEXTURE_2D, GGL_TEXTURE_MIN_FILTER, GGL_LINEAR);
+        c->texParameteri(c, GGL_TEXTURE_2D, GGL_TEXTURE_MAG_FILTER, GGL_LINEAR);
+        c->texParameteri(c, GGL_TEXTURE_2D, GGL_TEXTURE_WRAP_S, GGL_REPEAT);
+        c->texParameteri(c, GGL_TEXTURE_2D, GGL_TEXTURE_WRAP_T, GGL_REPEAT);
+        c->texGeni(c, GGL_S, GGL_TEXTURE_GEN_MODE, GGL_AUTOMATIC);
+        c->texGeni(c, GGL_T, GGL_TEXTURE_GEN_MODE, GGL_AUTOMATIC);
+        c->texCoordGradScale8xv(c, 0, s.texGrad);
+        c->enable(c, GGL_TEXTURE_2D);
+    } else {
+        c->disable(c, GGL_TEXTURE_2D);
+    }
+
+    if (s.smooth) {
+        c->shadeModel(c, GGL_SMOOTH);
+        c->colorGrad12xv(c, s.colorGrad);
+    } else {
+        c->shadeModel(c, GGL_FLAT);
+        c->color4xv(c, s.color);
+    }
+    c->zGrad3xv(c, s.zGrad);
+
+    if (s.blend) {
+        c->blendFunc(c, gBlendFuncs[s.func][0], gBlendFuncs[s.func][1]);
+        c->enable(c, GGL_BLEND);
+    } else {
+        c->disable(c, GGL_BLEND);
+    }
+    if (s.depth) {
+        c->depthFunc(c, GGL_LESS);
+        c->depthMask(c, 1);
+        c->enable(c, GGL_DEPTH_TEST);
+    } else {
+        c->disable(c, GGL_DEPTH_TEST);
+    }
+    if (s.dither)
+        c->enable(c, GGL_DITHER);
+    else
+        c->disable(c, GGL_DITHER);
+    if (s.primitive == AA_TRIANGLE)
+        c->enable(c, GGL_AA);
+    else
+        c->disable(c, GGL_AA);
+    c->clearColorx(c, s.color[0], s.color[1], s.color[2], s.color[3]);
+    c->clearDepthx(c, s.color[3]);
+}
+
+static void draw(GGLContext* c, const state_t& s)
+{
+    switch (s.primitive) {
+    case RECT:
+        c->recti(c, s.rect[0], s.rect[1], s.rect[2], s.rect[3]);
+        break;
+    case TRIANGLE:
+    case AA_TRIANGLE:
+        c->trianglex(c, s.v[0], s.v[1], s.v[2]);
+        break;
+    case CLEAR:
+        c->clear(c, GGL_COLOR_BUFFER_BIT | GGL_DEPTH_BUFFER_BIT);
+        break;
+    }
+}
+
+// renders one case with the given number of threads, from the same
+// initial buffers
+static void render(const state_t& s, int threads, int seed,
+        uint8_t* color, uint16_t* depth)
+{
+    srand(seed);
+    for (size_t i=0 ; i<sizeof(gColor) ; i++)
+        gColor[i] = rand();
+    for (size_t i=0 ; i<W*H ; i++)
+        gDepth[i] = rand();
+
+    GGLContext* c;
+    gglInit(&c);
+    gglSetRasterThreads(c, threads);
+    setup(c, s);
+    draw(c, s);
+    gglUninit(c);
+    memcpy(color, gColor, sizeof(gColor));
+    memcpy(depth, gDepth, sizeof(gDepth));
+}
+
+static int check(int count)
+{
+    static uint8_t color[2][W*H*4];
+    static uint16_t depth[2][W*H];
+    int failures = 0;
+    for (int n=0 ; n<count ; n++) {
+        srand(n + 1);
+        state_t s;
+        randomize(s);
+        const int threads = 2 + n % 7;
+        render(s, 1, n, color[0], depth[0]);
+        render(s, threads, n, color[1], depth[1]);
+        if (memcmp(color[0], color[1], sizeof(color[0])) ||
+                memcmp(depth[0], depth[1], sizeof(depth[0]))) {
+            printf("case %d: %s with %d threads differs (cb=%d%s%s%s%s%s)\n",
+                    n, gPrimitiveNames[s.primitive], threads, s.cb,
+                    s.texture ? " texture" : "", s.smooth ? " smooth" : "",
+                    s.blend ? " blend" : "", s.depth ? " depth" : "",
+                    s.dither ? " dither" : "");
+            failures++;
+        }
+    }
+    printf("%d cases, %d differ\n", count, failures);
+    return failures;
+}
+
+// full-screen primitives, in Mpixels/s
+static void benchmark(int frames)
+{
+    state_t s;
+    memset(&s, 0, sizeof(s));
+    s.cb = GGL_PIXEL_FORMAT_RGB_565;
+    s.color[0] = s.color[1] = s.color[2] = s.color[3] = 0xC000;
+    s.texGrad[1] = 0x4000;
+    s.texGrad[5] = 0x4000;
+    s.func = 1;
+    for (size_t i=0 ; i<sizeof(gTexels) ; i++)
+        gTexels[i] = rand();
+
+    const GGLcoord q[4][2] = {
+        { 0, 0 }, { W << 4, 0 }, { W << 4, H << 4 }, { 0, H << 4 }
+    };
+
+    printf("%-22s", "threads");
+    for (int t=1 ; t<=8 ; t++)
+        printf(" %8d", t);
+    printf("\n");
+
+    for (int test=0 ; test<3 ; test++) {
+        static const char* const names[] = {
+            "clear", "textured quad", "blended textured quad"
+        };
+        s.texture = (test > 0);
+        s.blend = (test > 1);
+        printf("%-22s", names[test]);
+        for (int t=1 ; t<=8 ; t++) {
+            GGLContext* c;
+            gglInit(&c);
+            gglSetRasterThreads(c, t);
+            setup(c, s);
+            const double start = now();
+            for (int f=0 ; f<frames ; f++) {
+                if (test == 0) {
+                    c->clear(c, GGL_COLOR_BUFFER_BIT);
+                } else {
+                    c->trianglex(c, q[0], q[1], q[2]);
+                    c->trianglex(c, q[0], q[2], q[3]);
+                }
+            }
+            const double time = now() - start;
+            printf(" %8.1f", double(W) * H * frames / time * 1e-6);
+            gglUninit(c);
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int count = 200;
+    int frames = 20;
+    if (argc >= 2)
+        count = atoi(argv[1]);
+    if (argc >= 3)
+        frames = atoi(argv[2]);
+    if (count < 0 || frames <= 0) {
+        printf("usage: %s [cases [frames]]\n", argv[0]);
+        return 0;
+    }
+
+    const int failures = check(count);
+    benchmark(frames);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <pixelflinger/pixelflinger.h>
+
+// Cycles through a number of distinct pixel pipelines, drawing a small
+// rectangle with each, to measure what state changes cost with a given
+// code cache size. With a directory, also measures a cold start that
+// loads the pipelines from the persistent cache.
+
+extern "C" void ggl_test_codegen_mode(int mode);
+extern "C" void ggl_test_code_cache(size_t size, const char* path);
+extern "C" void ggl_test_code_cache_stats(uint32_t* stats);
+
+enum {
+    CODEGEN_TEST_DEFAULT,
+    CODEGEN_TEST_GENERIC,
+    CODEGEN_TEST_GENERATED
+};
+
+enum { W = 64, H = 4 };
+
+static const int gColorFormats[] = {
+    GGL_PIXEL_FORMAT_RGBA_8888, GGL_PIXEL_FORMAT_RGBX_8888,
+    GGL_PIXEL_FORMAT_RGB_565, GGL_PIXEL_FORMAT_RGBA_4444,
+    GGL_PIXEL_FORMAT_RGBA_5551, GGL_PIXEL_FORMAT_A_8
+};
+
+static const GGLenum gSrcFactors[] = {
+    GGL_ZERO, GGL_ONE, GGL_SRC_ALPHA, GGL_ONE_MINUS_SRC_ALPHA,
+    GGL_DST_ALPHA, GGL_ONE_MINUS_DST_ALPHA, GGL_DST_COLOR,
+    GGL_ONE_MINUS_DST_COLOR, GGL_SRC_ALPHA_SATURATE
+};
+
+static const GGLenum gDstFactors[] = {
+    GGL_ZERO, GGL_ONE, GGL_SRC_COLOR, GGL_ONE_MINUS_SRC_COLOR,
+    GGL_SRC_ALPHA, GGL_ONE_MINUS_SRC_ALPHA, GGL_DST_ALPHA,
+    GGL_ONE_MINUS_DST_ALPHA
+};
+
+#define countof(a)  (sizeof(a)/sizeof(*(a)))
+
+static const int gMaxStates =
+        countof(gColorFormats) * countof(gSrcFactors) *
+        countof(gDstFactors) * 2 * 2;
+
+static uint8_t gColor[W*H*4];
+static uint8_t gTexels[16*16*4];
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// state n gets a pipeline of its own
+static void draw(GGLContext* c, int n)
+{
+    GGLSurface cb, tx;
+    memset(&cb, 0, sizeof(cb));
+    cb.version = sizeof(GGLSurface);
+    cb.width = W;
+    cb.height = H;
+    cb.stride = W;
+    cb.data = gColor;
+    cb.format = gColorFormats[n % countof(gColorFormats)];
+    n /= countof(gColorFormats);
+    c->colorBuffer(c, &cb);
+
+    c->blendFunc(c, gSrcFactors[n % countof(gSrcFactors)],
+            gDstFactors[(n / countof(gSrcFactors)) % countof(gDstFactors)]);
+    c->enable(c, GGL_BLEND);
+    n /= countof(gSrcFactors) * countof(gDstFactors);
+
+    if (n & 1)
+        c->enable(c, GGL_DITHER);
+    else
+        c->disable(c, GGL_DITHER);
+
+    if (n & 2) {
+        tx = cb;
+        tx.width = tx.height = tx.stride = 16;
+        tx.data = gTexels;
+        tx.format = GGL_PIXEL_FORMAT_RGBA_8888;
+        c->activeTexture(c, 0);
+        c->bindTexture(c, &tx);
+        c->texGeni(c, GGL_S, GGL_TEXTURE_GEN_MODE, GGL_AUTOMATIC);
+        c->texGeni(c, GGL_T, GGL_TEXTURE_GEN_MODE, GGL_AUTOMATIC);
+        c->enable(c, GGL_TEXTURE_2D);
+    } else {
+        c->disable(c, GGL_TEXTURE_2D);
+    }
+
+    c->recti(c, 0, 0, W, H);
+}
+
+// draws every state once per round, returns the time per state in us
+static double run(GGLContext* c, int states, int rounds)
+{
+    const double start = now();
+    for (int r=0 ; r<rounds ; r++)
+        for (int n=0 ; n<states ; n++)
+            draw(c, n);
+    return (now() - start) * 1e6 / (double(states) * rounds);
+}
+
+// prints the counters accumulated since the previous report
+static void report(const char* what, double us)
+{
+    static uint32_t last[5];
+    uint32_t s[7];
+    ggl_test_code_cache_stats(s);
+    printf("%-12s %8.1f us/state  hits %6u  misses %5u  evictions %5u  "
+            "loads %5u  stores %5u  (%u entries, %u bytes)\n",
+            what, us, s[0]-last[0], s[1]-last[1], s[2]-last[2],
+            s[3]-last[3], s[4]-last[4], s[5], s[6]);
+    memcpy(last, s, sizeof(last));
+}
+
+int main(int argc, char** argv)
+{
+    int states = 64;
+    int rounds = 20;
+    size_t size = 0;
+    const char* path = NULL;
+    if (argc >= 2)  states = atoi(argv[1]);
+    if (argc >= 3)  rounds = atoi(argv[2]);
+    if (argc >= 4)  size = atoi(argv[3]) * 1024;
+    if (argc >= 5)  path = argv[4];
+    if (states <= 0 || states > gMaxStates || rounds <= 0) {
+        printf("usage: %s [states (1-%d) [rounds [cache KB [directory]]]]\n",
+                argv[0], gMaxStates);
+        return 0;
+    }
+
+    static const GGLclampx color[4] = { 0x8000, 0x4000, 0xC000, 0x9000 };
+    GGLContext* c;
+    gglInit(&c);
+    c->color4xv(c, color);
+    ggl_test_codegen_mode(CODEGEN_TEST_GENERATED);
+
+    // start from an empty cache so that the first round generates
+    // everything (or loads it, if the directory was filled before)
+    ggl_test_code_cache(size, path);
+    report("first round", run(c, states, 1));
+    report("steady state", run(c, states, rounds));
+
+    if (path) {
+        // what the next process would see
+        ggl_test_code_cache(size, path);
+        report("cold start", run(c, states, 1));
+    }
+
+    ggl_test_codegen_mode(CODEGEN_TEST_DEFAULT);
+    gglUninit(c);
+    return 0;
+}
@@ -0,0 +1,15 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	crosscheck.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+    libpixelflinger
+
+LOCAL_MODULE:= test-pixelflinger-crosscheck
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
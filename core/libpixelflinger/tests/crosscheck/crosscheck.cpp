@@ -0,0 +1,540 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pixelflinger/pixelflinger.h>
+#include <pixelflinger/format.h>
+
+// Renders the same primitives with the generic pixel pipeline and with the
+// generated one, and compares the results.
+//
+// The two pipelines don't round the same way at every stage, and the
+// differences add up when several stages are enabled, or get amplified
+// by alpha and logic ops. So each case enables a single stage of the
+// pipeline (on top of the depth test), and only the configurations both
+// pipelines compute the same way are used: no antialiasing, alpha test,
+// linear filtering or 1:1 texturing, and a subset of the blend functions
+// and texture environments. These must match to one LSB.
+//
+// On x86, the states picked up by the SIMD shortcuts in scanline.cpp are
+// then rendered with the shortcuts and with the generic pipeline. These
+// use 1:1 texturing, so they are not compared with the generated code,
+// but the shortcuts must match the generic pipeline bit for bit.
+
+extern "C" void ggl_test_codegen_mode(int mode);
+
+enum {
+    CODEGEN_TEST_DEFAULT,
+    CODEGEN_TEST_GENERIC,
+    CODEGEN_TEST_GENERATED
+};
+
+enum { W = 61, H = 23, TW = 16, TH = 8 };
+
+// channel layout of the formats we render to, as (shift, bits) for
+// A, R, G, B; bits == 0 means the channel doesn't exist
+struct format_t {
+    int format;
+    int size;
+    int channels[4][2];
+    const char* name;
+};
+
+static const format_t gColorFormats[] = {
+    { GGL_PIXEL_FORMAT_RGBA_8888, 4, {{24,8},{ 0,8},{ 8,8},{16,8}}, "8888" },
+    { GGL_PIXEL_FORMAT_RGBX_8888, 4, {{ 0,0},{ 0,8},{ 8,8},{16,8}}, "X888" },
+    { GGL_PIXEL_FORMAT_RGB_565,   2, {{ 0,0},{11,5},{ 5,6},{ 0,5}}, "565"  },
+    { GGL_PIXEL_FORMAT_RGBA_4444, 2, {{ 0,4},{12,4},{ 8,4},{ 4,4}}, "4444" },
+    { GGL_PIXEL_FORMAT_RGBA_5551, 2, {{ 0,1},{11,5},{ 6,5},{ 1,5}}, "5551" },
+    { GGL_PIXEL_FORMAT_A_8,       1, {{ 0,8},{ 0,0},{ 0,0},{ 0,0}}, "A8"   },
+};
+
+struct texture_format_t {
+    int format;
+    int size;
+};
+
+static const texture_format_t gTextureFormats[] = {
+    { GGL_PIXEL_FORMAT_RGBA_8888, 4 },
+    { GGL_PIXEL_FORMAT_RGBX_8888, 4 },
+    { GGL_PIXEL_FORMAT_RGB_565,   2 },
+    { GGL_PIXEL_FORMAT_RGBA_4444, 2 },
+    { GGL_PIXEL_FORMAT_RGBA_5551, 2 },
+    { GGL_PIXEL_FORMAT_A_8,       1 },
+    { GGL_PIXEL_FORMAT_L_8,       1 },
+    { GGL_PIXEL_FORMAT_LA_88,     2 },
+};
+
+static const GGLenum gBlendFuncs[][2] = {
+    { GGL_ONE,          GGL_ZERO        },
+    { GGL_ONE,          GGL_ONE         },
+    { GGL_SRC_ALPHA,    GGL_ONE         },
+    { GGL_ONE,          GGL_SRC_ALPHA   },
+    { GGL_ONE,          GGL_SRC_COLOR   },
+};
+
+static const GGLenum gEnvModes[] = {
+    GGL_REPLACE, GGL_MODULATE
+};
+
+#define countof(a)  (sizeof(a)/sizeof(*(a)))
+
+// everything needed to render one test case, chosen at random
+struct state_t {
+    const format_t* cb;
+    const texture_format_t* tx;
+    bool texture;
+    bool repeat;
+    GGLenum env;
+    bool smooth;
+    bool blend;
+    GGLenum src, dst;
+    bool depthTest;
+    GGLenum depthFunc;
+    bool depthMask;
+    bool dither;
+    bool logicOp;
+    GGLenum op;
+    bool mask[4];
+    bool fog;
+    bool triangle;
+    GGLclampx color[4];
+    GGLcolor colorGrad[12];
+    GGLfixed32 zGrad[3];
+    GGLfixed fogGrad[3];
+    GGLclampx fogColor[3];
+    int32_t texGrad[8];
+    GGLint rect[4];
+    GGLcoord v[3][2];
+};
+
+static uint32_t rand32()
+{
+    return (uint32_t(rand() & 0xFFFF) << 16) | uint32_t(rand() & 0xFFFF);
+}
+
+static bool coin()
+{
+    return rand() & 1;
+}
+
+// v0 + dvdx*x + dvdy*y stays within [0, range] over the whole surface
+static void gradient(int32_t* g, int64_t range)
+{
+    int64_t v0 = (int64_t(rand32()) * range) >> 32;
+    int64_t total = (coin() ? range - v0 : -v0) * (rand() & 0xFF) / 0xFF;
+    int64_t tx = total * (rand() & 0xFF) / 0xFF;
+    g[0] = int32_t(v0);
+    g[1] = int32_t(tx / W);
+    g[2] = int32_t((total - tx) / H);
+}
+
+static void randomize(state_t& s)
+{
+    memset(&s, 0, sizeof(s));
+    s.cb = &gColorFormats[rand() % countof(gColorFormats)];
+    s.tx = &gTextureFormats[rand() % countof(gTextureFormats)];
+    s.smooth = coin();
+    s.triangle = coin();
+    s.depthTest = coin();
+    s.depthFunc = GGL_NEVER + (rand() & 7);
+    s.depthMask = coin();
+    for (int i=0 ; i<4 ; i++)
+        s.mask[i] = true;
+
+    switch (rand() % 7) {
+    case 0:
+        s.texture = true;
+        s.repeat = coin();
+        s.env = gEnvModes[rand() % countof(gEnvModes)];
+        // the generated code modulates a 1-bit alpha differently
+        if (s.tx->format == GGL_PIXEL_FORMAT_RGBA_5551)
+            s.env = GGL_REPLACE;
+        break;
+    case 1: {
+        const int b = rand() % countof(gBlendFuncs);
+        s.blend = true;
+        s.src = gBlendFuncs[b][0];
+        s.dst = gBlendFuncs[b][1];
+        break;
+    }
+    case 2:
+        s.dither = true;
+        break;
+    case 3:
+        s.logicOp = true;
+        s.op = GGL_CLEAR + (rand() & 0xF);
+        break;
+    case 4:
+        for (int i=0 ; i<4 ; i++)
+            s.mask[i] = (rand() % 3) != 0;
+        break;
+    case 5:
+        s.fog = true;
+        break;
+    }
+
+    for (int i=0 ; i<4 ; i++)
+        s.color[i] = rand() % 0x10001;
+    for (int i=0 ; i<4 ; i++)
+        gradient(&s.colorGrad[i*3], 0xFF0000);
+    int32_t z[3];
+    gradient(z, 0xFFFF0000LL);
+    s.zGrad[0] = z[0];
+    s.zGrad[1] = z[1];
+    s.zGrad[2] = z[2];
+    gradient(s.fogGrad, 0x10000);
+    for (int i=0 ; i<3 ; i++)
+        s.fogColor[i] = rand() % 0x10001;
+
+    // texture coordinates go well outside of the texture to exercise
+    // the wrap modes
+    s.texGrad[0] = int32_t(rand32() % (TW*4 << 16)) - (TW*2 << 16);
+    s.texGrad[1] = int32_t(rand32() % 0x30000) - 0x18000;
+    s.texGrad[2] = int32_t(rand32() % 0x30000) - 0x18000;
+    s.texGrad[3] = int32_t(rand32() % (TH*4 << 16)) - (TH*2 << 16);
+    s.texGrad[4] = int32_t(rand32() % 0x30000) - 0x18000;
+    s.texGrad[5] = int32_t(rand32() % 0x30000) - 0x18000;
+
+    s.rect[0] = rand() % W;
+    s.rect[1] = rand() % H;
+    s.rect[2] = s.rect[0] + 1 + rand() % (W - s.rect[0]);
+    s.rect[3] = s.rect[1] + 1 + rand() % (H - s.rect[1]);
+    for (int i=0 ; i<3 ; i++) {
+        s.v[i][0] = rand() % (W << 4);
+        s.v[i][1] = rand() % (H << 4);
+    }
+
+}
+
+static void render(const state_t& s, GGLSurface* cb, GGLSurface* zb,
+        GGLSurface* tx)
+{
+    GGLContext* c;
+    gglInit(&c);
+    c->colorBuffer(c, cb);
+    c->depthBuffer(c, zb);
+
+    if (s.texture) {
+        c->activeTexture(c, 0);
+        c->bindTexture(c, tx);
+        c->texEnvi(c, GGL_TEXTURE_ENV, GGL_TEXTURE_ENV_MODE, s.env);
+        c->texParameteri(c, GGL_TEXTURE_2D, GGL_TEXTURE_MIN_FILTER,
+                GGL_NEAREST);
+        c->texParameteri(c, GGL_TEXTURE_2D, GGL_TEXTURE_MAG_FILTER,
+                GGL_NEAREST);
+        c->texParameteri(c, GGL_TEXTURE_2D, GGL_TEXTURE_WRAP_S,
+                s.repeat ? GGL_REPEAT : GGL_CLAMP_TO_EDGE);
+        c->texParameteri(c, GGL_TEXTURE_2D, GGL_TEXTURE_WRAP_T,
+                s.repeat ? GGL_REPEAT : GGL_CLAMP_TO_EDGE);
+        c->texGeni(c, GGL_S, GGL_TEXTURE_GEN_MODE, GGL_AUTOMATIC);
+        c->texGeni(c, GGL_T, GGL_TEXTURE_GEN_MODE, GGL_AUTOMATIC);
+        c->texCoordGradScale8xv(c, 0, s.texGrad);
+        c->enable(c, GGL_TEXTURE_2D);
+    }
+
+    if (s.smooth) {
+        c->shadeModel(c, GGL_SMOOTH);
+        c->colorGrad12xv(c, s.colorGrad);
+    } else {
+        c->shadeModel(c, GGL_FLAT);
+        c->color4xv(c, s.color);
+    }
+    c->zGrad3xv(c, s.zGrad);
+
+    if (s.blend) {
+        c->blendFunc(c, s.src, s.dst);
+        c->enable(c, GGL_BLEND);
+    }
+    if (s.depthTest) {
+        c->depthFunc(c, s.depthFunc);
+        c->depthMask(c, s.depthMask);
+        c->enable(c, GGL_DEPTH_TEST);
+    }
+    if (s.dither)
+        c->enable(c, GGL_DITHER);
+    else
+        c->disable(c, GGL_DITHER);
+    if (s.logicOp) {
+        c->logicOp(c, s.op);
+        c->enable(c, GGL_COLOR_LOGIC_OP);
+    }
+    c->colorMask(c, s.mask[1], s.mask[2], s.mask[3], s.mask[0]);
+    if (s.fog) {
+        c->fogGrad3xv(c, s.fogGrad);
+        c->fogColor3xv(c, s.fogColor);
+        c->enable(c, GGL_FOG);
+    }
+
+    if (s.triangle) {
+        c->trianglex(c, s.v[0], s.v[1], s.v[2]);
+    } else {
+        c->recti(c, s.rect[0], s.rect[1], s.rect[2], s.rect[3]);
+    }
+    gglUninit(c);
+}
+
+static void describe(const state_t& s)
+{
+    printf("  cb=%s", s.cb->name);
+    if (s.texture)
+        printf(" tex=%d%s env=%04x", s.tx->format,
+                s.repeat ? " repeat" : "", s.env);
+    printf(" %s", s.smooth ? "smooth" : "flat");
+    if (s.blend)        printf(" blend=%x/%x", s.src, s.dst);
+    if (s.depthTest)    printf(" depth=%x%s", s.depthFunc,
+                                s.depthMask ? "" : " (ro)");
+    if (s.dither)       printf(" dither");
+    if (s.logicOp)      printf(" op=%x", s.op);
+    if (!(s.mask[0] && s.mask[1] && s.mask[2] && s.mask[3]))
+        printf(" mask=%d%d%d%d", s.mask[0], s.mask[1], s.mask[2], s.mask[3]);
+    if (s.fog)          printf(" fog");
+    printf(" %s\n", s.triangle ? "triangle" : "rect");
+}
+
+// largest difference between two pixels, in LSBs of the channel
+static int difference(const format_t* f, uint32_t a, uint32_t b)
+{
+    int worst = 0;
+    for (int i=0 ; i<4 ; i++) {
+        const int shift = f->channels[i][0];
+        const int bits = f->channels[i][1];
+        if (!bits)
+            continue;
+        const int mask = (1<<bits) - 1;
+        int d = int((a >> shift) & mask) - int((b >> shift) & mask);
+        if (d < 0) d = -d;
+        if (d > worst)
+            worst = d;
+    }
+    return worst;
+}
+
+static uint32_t pixel(const uint8_t* p, int size)
+{
+    switch (size) {
+    case 1: return p[0];
+    case 2: return *(const uint16_t*)p;
+    }
+    return *(const uint32_t*)p;
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+
+// states matching the filters of the x86 shortcuts: 1:1 texturing, flat
+// shading, no dithering, no depth test, and either a plain copy or
+// (ONE, ONE_MINUS_SRC_ALPHA) blending
+struct shortcut_t {
+    int cb;
+    int tx;
+    int txsize;
+    bool blend;
+    const char* name;
+};
+
+static const shortcut_t gShortcuts[] = {
+    { GGL_PIXEL_FORMAT_RGBA_8888, GGL_PIXEL_FORMAT_RGBA_8888, 4, true,
+            "8888 fb, 8888 tx, blend" },
+    { GGL_PIXEL_FORMAT_RGBA_8888, GGL_PIXEL_FORMAT_RGB_565,   2, false,
+            "8888 fb, 565 tx" },
+};
+
+enum { STW = W*2, STH = H*2 };
+
+static void renderShortcut(const shortcut_t& s, GGLSurface* cb,
+        GGLSurface* tx, const GGLclampx* color, const GGLint* rect,
+        const GGLint* origin)
+{
+    GGLContext* c;
+    gglInit(&c);
+    c->colorBuffer(c, cb);
+    c->activeTexture(c, 0);
+    c->bindTexture(c, tx);
+    c->texEnvi(c, GGL_TEXTURE_ENV, GGL_TEXTURE_ENV_MODE, GGL_REPLACE);
+    c->texParameteri(c, GGL_TEXTURE_2D, GGL_TEXTURE_MIN_FILTER, GGL_NEAREST);
+    c->texParameteri(c, GGL_TEXTURE_2D, GGL_TEXTURE_MAG_FILTER, GGL_NEAREST);
+    c->texGeni(c, GGL_S, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
+    c->texGeni(c, GGL_T, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
+    c->enable(c, GGL_TEXTURE_2D);
+    c->texCoord2i(c, origin[0], origin[1]);
+    c->shadeModel(c, GGL_FLAT);
+    c->color4xv(c, color);
+    c->disable(c, GGL_DITHER);
+    if (s.blend) {
+        c->blendFunc(c, GGL_ONE, GGL_ONE_MINUS_SRC_ALPHA);
+        c->enable(c, GGL_BLEND);
+    }
+    c->recti(c, rect[0], rect[1], rect[2], rect[3]);
+    gglUninit(c);
+}
+
+static int checkShortcuts(int count)
+{
+    static uint32_t color[2][W*H];
+    static uint32_t texels[STW*STH];
+
+    int failures = 0;
+    for (int n=0 ; n<count ; n++) {
+        srand(n + 1);
+        const shortcut_t& s = gShortcuts[n % countof(gShortcuts)];
+
+        for (size_t i=0 ; i<countof(texels) ; i++)
+            texels[i] = rand32();
+        for (size_t i=0 ; i<W*H ; i++)
+            color[0][i] = color[1][i] = rand32();
+        GGLclampx c[4];
+        for (int i=0 ; i<4 ; i++)
+            c[i] = rand() % 0x10001;
+        GGLint rect[4];
+        rect[0] = rand() % W;
+        rect[1] = rand() % H;
+        rect[2] = rect[0] + 1 + rand() % (W - rect[0]);
+        rect[3] = rect[1] + 1 + rand() % (H - rect[1]);
+        // keeps every texel fetched inside the texture
+        GGLint origin[2];
+        origin[0] = rand() % (STW - W + 1);
+        origin[1] = rand() % (STH - H + 1);
+
+        GGLSurface tx;
+        memset(&tx, 0, sizeof(tx));
+        tx.version = sizeof(GGLSurface);
+        tx.width = STW;
+        tx.height = STH;
+        tx.stride = STW;
+        tx.data = (GGLubyte*)texels;
+        tx.format = s.tx;
+
+        for (int mode=0 ; mode<2 ; mode++) {
+            GGLSurface cb;
+            memset(&cb, 0, sizeof(cb));
+            cb.version = sizeof(GGLSurface);
+            cb.width = W;
+            cb.height = H;
+            cb.stride = W;
+            cb.data = (GGLubyte*)color[mode];
+            cb.format = s.cb;
+            ggl_test_codegen_mode(mode == 0 ?
+                    CODEGEN_TEST_GENERIC : CODEGEN_TEST_DEFAULT);
+            renderShortcut(s, &cb, &tx, c, rect, origin);
+        }
+
+        int diff = 0, pixels = 0;
+        for (int i=0 ; i<W*H ; i++) {
+            if (color[0][i] != color[1][i]) {
+                int d = difference(&gColorFormats[0], color[0][i], color[1][i]);
+                if (d > diff)
+                    diff = d;
+                pixels++;
+            }
+        }
+        if (pixels) {
+            printf("shortcut case %d: %d pixels differ (max %d)\n",
+                    n, pixels, diff);
+            printf("  %s, color=%05x/%05x/%05x/%05x\n", s.name,
+                    c[0], c[1], c[2], c[3]);
+            failures++;
+        }
+    }
+
+    ggl_test_codegen_mode(CODEGEN_TEST_DEFAULT);
+
+    printf("%d shortcut cases, %d failed\n", count, failures);
+    return failures;
+}
+
+#endif
+
+int main(int argc, char** argv)
+{
+    int count = 2000;
+    int tolerance = 1;
+    if (argc >= 2)
+        count = atoi(argv[1]);
+    if (argc >= 3)
+        tolerance = atoi(argv[2]);
+    if (count <= 0 || tolerance < 0) {
+        printf("usage: %s [count [tolerance]]\n", argv[0]);
+        return 0;
+    }
+
+    static uint8_t color[2][W*H*4];
+    static uint16_t depth[2][W*H];
+    static uint8_t texels[TW*TH*4];
+
+    int exact = 0, failures = 0, worst = 0;
+    for (int n=0 ; n<count ; n++) {
+        srand(n + 1);
+        state_t s;
+        randomize(s);
+
+        for (size_t i=0 ; i<sizeof(texels) ; i++)
+            texels[i] = rand();
+        for (size_t i=0 ; i<sizeof(color[0]) ; i++)
+            color[0][i] = color[1][i] = rand();
+        for (size_t i=0 ; i<W*H ; i++)
+            depth[0][i] = depth[1][i] = rand();
+
+        GGLSurface tx;
+        memset(&tx, 0, sizeof(tx));
+        tx.version = sizeof(GGLSurface);
+        tx.width = TW;
+        tx.height = TH;
+        tx.stride = TW;
+        tx.data = texels;
+        tx.format = s.tx->format;
+
+        for (int mode=0 ; mode<2 ; mode++) {
+            GGLSurface cb, zb;
+            memset(&cb, 0, sizeof(cb));
+            cb.version = sizeof(GGLSurface);
+            cb.width = W;
+            cb.height = H;
+            cb.stride = W;
+            cb.data = color[mode];
+            cb.format = s.cb->format;
+            zb = cb;
+            zb.data = (GGLubyte*)depth[mode];
+            zb.format = GGL_PIXEL_FORMAT_Z_16;
+            ggl_test_codegen_mode(mode == 0 ?
+                    CODEGEN_TEST_GENERIC : CODEGEN_TEST_GENERATED);
+            render(s, &cb, &zb, &tx);
+        }
+
+        int diff = 0, pixels = 0;
+        for (int i=0 ; i<W*H ; i++) {
+            const int size = s.cb->size;
+            uint32_t a = pixel(color[0] + i*size, size);
+            uint32_t b = pixel(color[1] + i*size, size);
+            if (a != b) {
+                int d = difference(s.cb, a, b);
+                if (d > diff)
+                    diff = d;
+                pixels++;
+            }
+        }
+        const bool depthOk = !memcmp(depth[0], depth[1], sizeof(depth[0]));
+        if (!pixels && depthOk) {
+            exact++;
+        }
+        if (diff > worst) {
+            worst = diff;
+        }
+        if (diff > tolerance || !depthOk) {
+            printf("case %d: %d pixels differ (max %d)%s\n", n, pixels, diff,
+                    depthOk ? "" : ", depth buffer differs");
+            describe(s);
+            failures++;
+        }
+    }
+
+    ggl_test_codegen_mode(CODEGEN_TEST_DEFAULT);
+
+    printf("%d cases, %d identical, %d failed, max difference %d\n",
+            count, exact, failures, worst);
+
+#if defined(__i386__) || defined(__x86_64__)
+    failures += checkShortcuts(count / 4 + 2);
+#endif
+    return failures ? 1 : 0;
+}
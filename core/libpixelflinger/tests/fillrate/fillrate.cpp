@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+
+extern "C" int ggl_x86_simd_level(void);
+
+extern "C" void scanline_t32cb16blend_sse2(uint16_t*, uint32_t*, size_t);
+extern "C" void scanline_t32cb16_sse2(uint16_t*, uint32_t*, size_t);
+extern "C" void scanline_col32cb16blend_sse2(uint16_t*, uint32_t, size_t);
+extern "C" void scanline_t32cb32blend_sse2(uint32_t*, uint32_t*, size_t);
+extern "C" void scanline_t16cb32_sse2(uint32_t*, uint16_t*, size_t, uint32_t);
+
+extern "C" void scanline_t32cb16blend_avx2(uint16_t*, uint32_t*, size_t);
+extern "C" void scanline_t32cb16_avx2(uint16_t*, uint32_t*, size_t);
+extern "C" void scanline_col32cb16blend_avx2(uint16_t*, uint32_t, size_t);
+extern "C" void scanline_t32cb32blend_avx2(uint32_t*, uint32_t*, size_t);
+extern "C" void scanline_t16cb32_avx2(uint32_t*, uint16_t*, size_t, uint32_t);
+
+// ----------------------------------------------------------------------------
+// Reference implementations. The 565 ones are the C loops of scanline.cpp,
+// the 8888 ones follow the generic pipeline (blend_factor(), gglMulx() and
+// the write_pixel() expansion) step by step.
+// ----------------------------------------------------------------------------
+
+static void ref_t32cb16blend(uint16_t* dst, uint32_t* src, size_t ct)
+{
+    while (ct--) {
+        uint32_t s = *src++;
+        if (!s) {
+            dst++;
+            continue;
+        }
+        uint16_t d = *dst;
+        int sR = (s >> (   3))&0x1F;
+        int sG = (s >> ( 8+2))&0x3F;
+        int sB = (s >> (16+3))&0x1F;
+        int sA = (s>>24);
+        int f = 0x100 - (sA + (sA>>7));
+        int dR = (d>>11)&0x1f;
+        int dG = (d>>5)&0x3f;
+        int dB = (d)&0x1f;
+        sR += (f*dR)>>8;
+        sG += (f*dG)>>8;
+        sB += (f*dB)>>8;
+        *dst++ = uint16_t((sR<<11)|(sG<<5)|sB);
+    }
+}
+
+static void ref_t32cb16(uint16_t* dst, uint32_t* src, size_t ct)
+{
+    while (ct--) {
+        uint32_t s = *src++;
+        int sR = (s >> (   3))&0x1F;
+        int sG = (s >> ( 8+2))&0x3F;
+        int sB = (s >> (16+3))&0x1F;
+        *dst++ = uint16_t((sR<<11)|(sG<<5)|sB);
+    }
+}
+
+static void ref_col32cb16blend(uint16_t* dst, uint32_t s, size_t ct)
+{
+    int sA = (s>>24);
+    int f = 0x100 - (sA + (sA>>7));
+    while (ct--) {
+        uint16_t d = *dst;
+        int dR = (d>>11)&0x1f;
+        int dG = (d>>5)&0x3f;
+        int dB = (d)&0x1f;
+        int sR = (s >> (   3))&0x1F;
+        int sG = (s >> ( 8+2))&0x3F;
+        int sB = (s >> (16+3))&0x1F;
+        sR += (f*dR)>>8;
+        sG += (f*dG)>>8;
+        sB += (f*dB)>>8;
+        *dst++ = uint16_t((sR<<11)|(sG<<5)|sB);
+    }
+}
+
+static void ref_t32cb32blend(uint32_t* dst, uint32_t* src, size_t ct)
+{
+    while (ct--) {
+        uint32_t s = *src++;
+        uint32_t d = *dst;
+        // GGL_ONE_MINUS_SRC_ALPHA
+        uint32_t sA = s>>24;
+        int32_t x = sA*0x101;       // ggl_expand(sA, 8, 16)
+        x += x >> 15;
+        int32_t df = 0x10000 - x;
+        uint32_t r = 0;
+        for (int i=0 ; i<4 ; i++) {
+            uint32_t sc = (s >> (i*8)) & 0xFF;
+            uint32_t dc = (d >> (i*8)) & 0xFF;
+            // gglMulAddx(sc, FIXED_ONE, gglMulx(dc, df))
+            int32_t m = int32_t((int64_t(dc)*df + 0x8000) >> 16);
+            uint32_t c = uint32_t((int64_t(sc)*0x10000) >> 16) + m;
+            if (c >= 0x100)
+                c = 0xFF;
+            r |= c << (i*8);
+        }
+        *dst++ = r;
+    }
+}
+
+static void ref_t16cb32(uint32_t* dst, uint16_t* src, size_t ct, uint32_t a)
+{
+    while (ct--) {
+        uint16_t s = *src++;
+        uint32_t r = s>>11;
+        uint32_t g = (s>>5)&0x3F;
+        uint32_t b = s&0x1F;
+        // expand(r, 5, 8) etc.
+        r = (r<<3); r |= r>>5;
+        g = (g<<2); g |= g>>6;
+        b = (b<<3); b |= b>>5;
+        *dst++ = (a<<24) | (b<<16) | (g<<8) | r;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+struct kernels_t {
+    const char* name;
+    void (*t32cb16blend)(uint16_t*, uint32_t*, size_t);
+    void (*t32cb16)(uint16_t*, uint32_t*, size_t);
+    void (*col32cb16blend)(uint16_t*, uint32_t, size_t);
+    void (*t32cb32blend)(uint32_t*, uint32_t*, size_t);
+    void (*t16cb32)(uint32_t*, uint16_t*, size_t, uint32_t);
+};
+
+static const kernels_t gKernels[] = {
+    { "C",
+      ref_t32cb16blend, ref_t32cb16, ref_col32cb16blend,
+      ref_t32cb32blend, ref_t16cb32 },
+    { "SSE2",
+      scanline_t32cb16blend_sse2, scanline_t32cb16_sse2,
+      scanline_col32cb16blend_sse2, scanline_t32cb32blend_sse2,
+      scanline_t16cb32_sse2 },
+    { "AVX2",
+      scanline_t32cb16blend_avx2, scanline_t32cb16_avx2,
+      scanline_col32cb16blend_avx2, scanline_t32cb32blend_avx2,
+      scanline_t16cb32_avx2 },
+};
+
+enum { MAX_SPAN = 1024, GUARD = 16 };
+
+static uint32_t rand32()
+{
+    return (uint32_t(rand() & 0xFFFF) << 16) | uint32_t(rand() & 0xFFFF);
+}
+
+// premultiplied pixel, with a good share of the alpha values that take
+// special paths (0, 127, 128, 255)
+static uint32_t randPremultiplied()
+{
+    static const uint32_t specials[] = { 0, 0x7F, 0x80, 0xFF };
+    uint32_t a = rand() & 0xFF;
+    if ((rand() & 3) == 0)
+        a = specials[rand() & 3];
+    uint32_t p = a << 24;
+    for (int i=0 ; i<3 ; i++)
+        p |= (a ? uint32_t(rand() % (a+1)) : 0) << (i*8);
+    return p;
+}
+
+static int check(const kernels_t& k)
+{
+    static uint32_t src32[MAX_SPAN + GUARD];
+    static uint16_t src16[MAX_SPAN + GUARD];
+    static uint16_t dst16[2][MAX_SPAN + GUARD];
+    static uint32_t dst32[2][MAX_SPAN + GUARD];
+    int errors = 0;
+
+    for (int iter=0 ; iter<2000 ; iter++) {
+        // odd lengths and misaligned pointers to exercise the tails
+        const size_t ct = (iter < 100) ? iter : (rand() % (MAX_SPAN - 8));
+        const size_t off = rand() & 7;
+        // mostly premultiplied sources, but make sure garbage in still
+        // gives the same garbage out
+        const bool premultiplied = (iter & 1);
+        for (size_t i=0 ; i<MAX_SPAN + GUARD ; i++) {
+            src32[i] = premultiplied ? randPremultiplied() : rand32();
+            src16[i] = rand();
+            dst16[0][i] = dst16[1][i] = rand();
+            dst32[0][i] = dst32[1][i] = rand32();
+        }
+        const uint32_t col = premultiplied ? randPremultiplied() : rand32();
+        const uint32_t a = rand() & 0xFF;
+
+#define CHECK(what, buf)                                                    \
+        if (memcmp(buf[0], buf[1], sizeof(buf[0]))) {                       \
+            printf("%s: %s mismatch (ct=%u, off=%u)\n",                     \
+                    k.name, what, unsigned(ct), unsigned(off));             \
+            errors++;                                                       \
+        }
+
+        ref_t32cb16blend(dst16[0]+off, src32+off, ct);
+        k.t32cb16blend(dst16[1]+off, src32+off, ct);
+        CHECK("t32cb16blend", dst16);
+
+        ref_t32cb16(dst16[0]+off, src32+off, ct);
+        k.t32cb16(dst16[1]+off, src32+off, ct);
+        CHECK("t32cb16", dst16);
+
+        ref_col32cb16blend(dst16[0]+off, col, ct);
+        k.col32cb16blend(dst16[1]+off, col, ct);
+        CHECK("col32cb16blend", dst16);
+
+        ref_t32cb32blend(dst32[0]+off, src32+off, ct);
+        k.t32cb32blend(dst32[1]+off, src32+off, ct);
+        CHECK("t32cb32blend", dst32);
+
+        ref_t16cb32(dst32[0]+off, src16+off, ct, a);
+        k.t16cb32(dst32[1]+off, src16+off, ct, a);
+        CHECK("t16cb32", dst32);
+
+#undef CHECK
+        if (errors)
+            break;
+    }
+    return errors;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// fill a 1024x1024 surface one scanline at a time, as pixelflinger does
+static void benchmark(const kernels_t& k, int frames)
+{
+    const size_t w = 1024, h = 1024;
+    uint32_t* src32 = new uint32_t[w*h];
+    uint16_t* src16 = new uint16_t[w*h];
+    uint32_t* dst32 = new uint32_t[w*h];
+    uint16_t* dst16 = new uint16_t[w*h];
+    for (size_t i=0 ; i<w*h ; i++) {
+        src32[i] = randPremultiplied();
+        src16[i] = rand();
+        dst32[i] = rand32();
+        dst16[i] = rand();
+    }
+    const double mpix = double(w*h*frames) / 1e6;
+    double t, rates[5];
+
+#define BENCH(n, call)                                                      \
+    t = now();                                                              \
+    for (int f=0 ; f<frames ; f++)                                          \
+        for (size_t y=0 ; y<h ; y++) { call; }                              \
+    rates[n] = mpix / (now() - t);
+
+    BENCH(0, k.t32cb16blend(dst16 + y*w, src32 + y*w, w));
+    BENCH(1, k.t32cb16(dst16 + y*w, src32 + y*w, w));
+    BENCH(2, k.col32cb16blend(dst16 + y*w, 0x80402010, w));
+    BENCH(3, k.t32cb32blend(dst32 + y*w, src32 + y*w, w));
+    BENCH(4, k.t16cb32(dst32 + y*w, src16 + y*w, w, 0xFF));
+#undef BENCH
+
+    printf("%-6s %12.1f %12.1f %12.1f %12.1f %12.1f\n", k.name,
+            rates[0], rates[1], rates[2], rates[3], rates[4]);
+
+    delete [] src32;
+    delete [] src16;
+    delete [] dst32;
+    delete [] dst16;
+}
+
+int main(int argc, char** argv)
+{
+    int frames = 20;
+    if (argc == 2) {
+        frames = atoi(argv[1]);
+        if (frames <= 0) {
+            printf("usage: %s [frames]\n", argv[0]);
+            return 0;
+        }
+    }
+
+    const int level = ggl_x86_simd_level();
+    const int count = level + 1;
+    printf("cpu supports: %s\n", gKernels[level].name);
+
+    int errors = 0;
+    for (int i=1 ; i<count ; i++) {
+        int e = check(gKernels[i]);
+        printf("%s: %s\n", gKernels[i].name, e ? "FAILED" : "bit-exact");
+        errors += e;
+    }
+
+    printf("\nfill rate (Mpixels/s)\n");
+    printf("%-6s %12s %12s %12s %12s %12s\n", "",
+            "t32cb16blend", "t32cb16", "col32cb16bl", "t32cb32blend", "t16cb32");
+    for (int i=0 ; i<count ; i++)
+        benchmark(gKernels[i], frames);
+
+    return errors ? 1 : 0;
+}
+
+#else
+
+int main(int argc, char** argv)
+{
+    printf("This test runs only on x86\n");
+    return 0;
+}
+
+#endif
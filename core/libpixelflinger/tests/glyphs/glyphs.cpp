@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <pixelflinger/pixelflinger.h>
+
+// Blits small glyphs from an A_8 atlas with 1:1 texturing and blending,
+// once with a texCoord2i()/recti() pair per glyph and once with a single
+// gglRectsi() call, checks that both give the same pixels and compares
+// their throughput. Small flat triangles are measured the same way with
+// trianglex() and gglTrianglesx().
+
+enum { W = 480, H = 800, AW = 256, AH = 256, GW = 8, GH = 12 };
+
+static uint16_t gColor[W*H];
+static uint8_t gAtlas[AW*AH];
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static GGLContext* setup(bool texture)
+{
+    GGLContext* c;
+    gglInit(&c);
+
+    GGLSurface cb;
+    memset(&cb, 0, sizeof(cb));
+    cb.version = sizeof(GGLSurface);
+    cb.width = W;
+    cb.height = H;
+    cb.stride = W;
+    cb.data = (GGLubyte*)gColor;
+    cb.format = GGL_PIXEL_FORMAT_RGB_565;
+    c->colorBuffer(c, &cb);
+
+    if (texture) {
+        GGLSurface tx = cb;
+        tx.width = tx.stride = AW;
+        tx.height = AH;
+        tx.data = gAtlas;
+        tx.format = GGL_PIXEL_FORMAT_A_8;
+        c->activeTexture(c, 0);
+        c->bindTexture(c, &tx);
+        c->texEnvi(c, GGL_TEXTURE_ENV, GGL_TEXTURE_ENV_MODE, GGL_MODULATE);
+        c->texParameteri(c, GGL_TEXTURE_2D, GGL_TEXTURE_MIN_FILTER, GGL_NEAREST);
+        c->texParameteri(c, GGL_TEXTURE_2D, GGL_TEXTURE_MAG_FILTER, GGL_NEAREST);
+        c->texGeni(c, GGL_S, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
+        c->texGeni(c, GGL_T, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
+        c->enable(c, GGL_TEXTURE_2D);
+    }
+    c->shadeModel(c, GGL_FLAT);
+    const GGLclampx color[4] = { 0xFFFF, 0x8000, 0x4000, 0xFFFF };
+    c->color4xv(c, color);
+    c->blendFunc(c, GGL_SRC_ALPHA, GGL_ONE_MINUS_SRC_ALPHA);
+    c->enable(c, GGL_BLEND);
+    return c;
+}
+
+// glyph rectangles and their texCoord2i() origins
+static void layout(GGLint* rects, GGLint* texcoords, int count)
+{
+    for (int i=0 ; i<count ; i++) {
+        const GGLint x = rand() % (W - GW);
+        const GGLint y = rand() % (H - GH);
+        const GGLint u = (rand() % (AW / GW)) * GW;
+        const GGLint v = (rand() % (AH / GH)) * GH;
+        rects[i*4+0] = x;
+        rects[i*4+1] = y;
+        rects[i*4+2] = x + GW;
+        rects[i*4+3] = y + GH;
+        texcoords[i*2+0] = u - x;
+        texcoords[i*2+1] = v - y;
+    }
+}
+
+static void glyphs_per_call(GGLContext* c,
+        const GGLint* rects, const GGLint* texcoords, int count)
+{
+    for (int i=0 ; i<count ; i++) {
+        c->texCoord2i(c, texcoords[i*2+0], texcoords[i*2+1]);
+        c->recti(c, rects[i*4+0], rects[i*4+1], rects[i*4+2], rects[i*4+3]);
+    }
+}
+
+static void triangles_per_call(GGLContext* c, const GGLcoord* v, int count)
+{
+    for (int i=0 ; i<count ; i++, v += 6)
+        c->trianglex(c, v, v+2, v+4);
+}
+
+static int check(const GGLint* rects, const GGLint* texcoords, int count)
+{
+    static uint16_t reference[W*H];
+    GGLContext* c;
+
+    memset(gColor, 0, sizeof(gColor));
+    c = setup(true);
+    glyphs_per_call(c, rects, texcoords, count);
+    gglUninit(c);
+    memcpy(reference, gColor, sizeof(gColor));
+
+    memset(gColor, 0, sizeof(gColor));
+    c = setup(true);
+    gglRectsi(c, rects, texcoords, count);
+    gglUninit(c);
+
+    const int differ = memcmp(reference, gColor, sizeof(gColor)) != 0;
+    printf("%d glyphs, batched result %s\n", count,
+            differ ? "DIFFERS" : "matches");
+    return differ;
+}
+
+int main(int argc, char** argv)
+{
+    int count = 20000;
+    int loops = 10;
+    if (argc >= 2)
+        count = atoi(argv[1]);
+    if (argc >= 3)
+        loops = atoi(argv[2]);
+    if (count <= 0 || loops <= 0) {
+        printf("usage: %s [glyphs [loops]]\n", argv[0]);
+        return 0;
+    }
+
+    for (int i=0 ; i<AW*AH ; i++)
+        gAtlas[i] = rand();
+
+    GGLint* rects = new GGLint[count*4];
+    GGLint* texcoords = new GGLint[count*2];
+    GGLcoord* vertices = new GGLcoord[count*6];
+    layout(rects, texcoords, count);
+    for (int i=0 ; i<count ; i++) {
+        // a glyph-sized triangle, in 28.4
+        const GGLcoord x = rects[i*4+0] << 4;
+        const GGLcoord y = rects[i*4+1] << 4;
+        vertices[i*6+0] = x;            vertices[i*6+1] = y;
+        vertices[i*6+2] = x + (GW<<4);  vertices[i*6+3] = y;
+        vertices[i*6+4] = x;            vertices[i*6+5] = y + (GH<<4);
+    }
+
+    const int failures = check(rects, texcoords, count);
+
+    printf("%-12s %12s %12s %8s\n", "", "per-call/s", "batched/s", "speedup");
+    for (int test=0 ; test<2 ; test++) {
+        double rate[2];
+        for (int batched=0 ; batched<2 ; batched++) {
+            GGLContext* c = setup(test == 0);
+            // validate once, outside of the measurement
+            c->recti(c, 0, 0, 1, 1);
+            const double start = now();
+            for (int l=0 ; l<loops ; l++) {
+                if (test == 0) {
+                    if (batched)
+                        gglRectsi(c, rects, texcoords, count);
+                    else
+                        glyphs_per_call(c, rects, texcoords, count);
+                } else {
+                    if (batched)
+                        gglTrianglesx(c, vertices, count);
+                    else
+                        triangles_per_call(c, vertices, count);
+                }
+            }
+            rate[batched] = double(count) * loops / (now() - start);
+            gglUninit(c);
+        }
+        printf("%-12s %12.0f %12.0f %7.2fx\n",
+                test == 0 ? "glyphs" : "triangles",
+                rate[0], rate[1], rate[1] / rate[0]);
+    }
+
+    delete [] rects;
+    delete [] texcoords;
+    delete [] vertices;
+    return failures ? 1 : 0;
+}
@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "bands.h"
 #include "trap.h"
 #include "picker.h"
 
@@ -416,6 +417,12 @@ void recti_validate(void *con, GGLint l, GGLint t, GGLint r, GGLint b)
     c->procs.recti(con, l, t, r, b);
 }
 
+static void recti_band(context_t* c, const void* arg, int32_t, int32_t)
+{
+    const GGLint* rect = (const GGLint*)arg;
+    recti(c, rect[0], rect[1], rect[2], rect[3]);
+}
+
 void recti(void* con, GGLint l, GGLint t, GGLint r, GGLint b)
 {
     GGL_CONTEXT(c, con);
@@ -433,6 +440,9 @@ void recti(void* con, GGLint l, GGLint t, GGLint r, GGLint b)
     int xc = r - l;
     int yc = b - t;
     if (xc>0 && yc>0) {
+        const GGLint rect[4] = { l, t, r, b };
+        if (ggl_draw_bands(c, t, b, size_t(xc)*yc, recti_band, rect))
+            return;
         c->iterators.xl = l;
         c->iterators.xr = r;
         c->init_y(c, t);
@@ -757,11 +767,29 @@ triangle_sweep_edges( Edge*  left,
 }
 
 
+static void trianglex_band(context_t* c, const void* arg, int32_t, int32_t)
+{
+    const GGLcoord* const* v = (const GGLcoord* const*)arg;
+    trianglex_big(c, v[0], v[1], v[2]);
+}
+
 void trianglex_big(void* con,
         const GGLcoord* v0, const GGLcoord* v1, const GGLcoord* v2)
 {
     GGL_CONTEXT(c, con);
 
+    if (ggl_unlikely(c->bands)) {
+        // the bounding box is a good enough estimate of the work
+        const int32_t top = min(v0[1], v1[1], v2[1]) >> TRI_FRACTION_BITS;
+        const int32_t bot = (max(v0[1], v1[1], v2[1]) >> TRI_FRACTION_BITS) + 1;
+        const int32_t w = (max(v0[0], v1[0], v2[0]) -
+                min(v0[0], v1[0], v2[0])) >> TRI_FRACTION_BITS;
+        const GGLcoord* v[3] = { v0, v1, v2 };
+        if (ggl_draw_bands(c, top, bot, size_t(w)*(bot-top)/2,
+                trianglex_band, v))
+            return;
+    }
+
     Edge edges[3];
 	int num_edges = 0;
 	int32_t ymin = TRI_FROM_INT(c->state.scissor.top)    + TRI_HALF;
@@ -939,6 +967,17 @@ void SUB_COVERAGE(int16_t*& p, int32_t value)
     *p++ = value;
 }
 
+struct aapoly_t {
+    const GGLcoord* pts;
+    int             count;
+};
+
+static void aapolyx_band(context_t* c, const void* arg, int32_t, int32_t)
+{
+    const aapoly_t* poly = (const aapoly_t*)arg;
+    aapolyx(c, poly->pts, poly->count);
+}
+
 void aapolyx(void* con,
         const GGLcoord* pts, int count)
 {
@@ -954,6 +993,23 @@ void aapolyx(void* con,
     // we do only quads for now (it's used for thick lines)
     if ((count>4) || (count<2)) return;
 
+    if (ggl_unlikely(c->bands)) {
+        int32_t top = pts[1], bot = pts[1];
+        int32_t left = pts[0], right = pts[0];
+        for (int i=1 ; i<count ; i++) {
+            top   = min(top,   pts[i*2+1]);
+            bot   = max(bot,   pts[i*2+1]);
+            left  = min(left,  pts[i*2]);
+            right = max(right, pts[i*2]);
+        }
+        top >>= TRI_FRACTION_BITS;
+        bot = (bot >> TRI_FRACTION_BITS) + 1;
+        const size_t w = (right - left) >> TRI_FRACTION_BITS;
+        const aapoly_t poly = { pts, count };
+        if (ggl_draw_bands(c, top, bot, w*(bot-top)/2, aapolyx_band, &poly))
+            return;
+    }
+
     // take scissor into account
     const int xmin = c->state.scissor.left;
     const int xmax = c->state.scissor.right;
@@ -1170,4 +1226,105 @@ void aapolyx(void* con,
         c->scanline(c);
 }
 
+// ----------------------------------------------------------------------------
+#if 0
+#pragma mark -
+#pragma mark Batches
+#endif
+
+// The batch entry points validate the state once, then call the rasterizers
+// directly; the state (and the texture) can't change in the middle of a
+// batch, so there is no point going through c->procs for each primitive.
+
+void ggl_rectsi(context_t* c,
+        const GGLint* rects, const GGLint* texcoords, size_t count)
+{
+    if (!count)
+        return;
+    ggl_pick(c);
+
+    const GGLint sl = GGLint(c->state.scissor.left);
+    const GGLint st = GGLint(c->state.scissor.top);
+    const GGLint sr = GGLint(c->state.scissor.right);
+    const GGLint sb = GGLint(c->state.scissor.bottom);
+    const bool bands = c->bands != 0;
+    texture_t* const tmu = c->activeTMU;
+    if (texcoords) {
+        // 1:1 texturing, as with texCoord2i(), one origin per rectangle
+        tmu->shade.sscale = 0;
+        tmu->shade.tscale = 0;
+    }
+    do {
+        if (texcoords) {
+            tmu->shade.is0 = texcoords[0] << 16;
+            tmu->shade.it0 = texcoords[1] << 16;
+            texcoords += 2;
+        }
+        if (ggl_unlikely(bands)) {
+            // large rectangles may be split in bands, let recti() decide
+            recti(c, rects[0], rects[1], rects[2], rects[3]);
+        } else {
+            const GGLint l = max(rects[0], sl);
+            const GGLint t = max(rects[1], st);
+            const GGLint r = min(rects[2], sr);
+            const GGLint b = min(rects[3], sb);
+            if (l<r && t<b) {
+                c->iterators.xl = l;
+                c->iterators.xr = r;
+                c->init_y(c, t);
+                c->rect(c, b - t);
+            }
+        }
+        rects += 4;
+    } while (--count);
+}
+
+void ggl_trianglesx(context_t* c, const GGLcoord* v, size_t count)
+{
+    if (!count)
+        return;
+    ggl_pick(c);
+    if (DEBUG_TRANGLES) {
+        do {
+            trianglex_debug(c, v, v+2, v+4);
+            v += 6;
+        } while (--count);
+    } else if (c->state.needs.p & GGL_NEED_MASK(P_AA)) {
+        do {
+            aa_trianglex(c, v, v+2, v+4);
+            v += 6;
+        } while (--count);
+    } else {
+        do {
+            trianglex_big(c, v, v+2, v+4);
+            v += 6;
+        } while (--count);
+    }
+}
+
 }; // namespace android
+
+// ----------------------------------------------------------------------------
+
+using namespace android;
+
+void gglRectsi(GGLContext* con,
+        const GGLint* rects, const GGLint* texcoords, GGLsizei count)
+{
+    GGL_CONTEXT(c, (void*)con);
+    if (count < 0) {
+        ggl_error(c, GGL_INVALID_VALUE);
+        return;
+    }
+    ggl_rectsi(c, rects, texcoords, size_t(count));
+}
+
+void gglTrianglesx(GGLContext* con, const GGLcoord* vertices, GGLsizei count)
+{
+    GGL_CONTEXT(c, (void*)con);
+    if (count < 0) {
+        ggl_error(c, GGL_INVALID_VALUE);
+        return;
+    }
+    ggl_trianglesx(c, vertices, size_t(count));
+}
@@ -26,6 +26,10 @@ namespace android {
 void ggl_init_trap(context_t* c);
 void ggl_state_changed(context_t* c, int flags);
 
+void ggl_rectsi(context_t* c,
+        const GGLint* rects, const GGLint* texcoords, size_t count);
+void ggl_trianglesx(context_t* c, const GGLcoord* v, size_t count);
+
 }; // namespace android
 
 #endif
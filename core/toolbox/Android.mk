@@ -58,6 +58,7 @@ TOOLS := \
 
 LOCAL_SRC_FILES:= \
 	toolbox.c \
+	procstat.c \
 	$(patsubst %,%.c,$(TOOLS))
 
 LOCAL_SHARED_LIBRARIES := libcutils libc
@@ -93,3 +94,5 @@ ALL_DEFAULT_INSTALLED_MODULES += $(SYMLINKS)
 # local module name
 ALL_MODULES.$(LOCAL_MODULE).INSTALLED := \
     $(ALL_MODULES.$(LOCAL_MODULE).INSTALLED) $(SYMLINKS)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -56,6 +56,8 @@ __RCSID("$NetBSD: dd.c,v 1.37 2004/01/17 21:00:16 dbj Exp $");
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <malloc.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -99,10 +101,13 @@ extern u_char		casetab[];
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
+static void *dballoc(size_t);
 static void dd_close(void);
+static int dd_copy(void);
 static void dd_in(void);
 static void getfdtype(IO *);
 static int redup_clean_fd(int);
+static void setdirect(IO *, int);
 static void setup(void);
 
 
@@ -144,8 +149,9 @@ dd_main(int argc, char *argv[])
 
 	(void)atexit(summary);
 
-	while (files_cnt--)
-		dd_in();
+	if (!dd_copy())
+		while (files_cnt--)
+			dd_in();
 
 	dd_close();
 	exit(0);
@@ -173,6 +179,8 @@ setup(void)
 	}
 
 	getfdtype(&in);
+	if (ddflags & C_IDIRECT)
+		setdirect(&in, 1);
 
 	if (files_cnt > 1 && !(in.flags & ISTAPE)) {
 		fprintf(stderr,
@@ -210,20 +218,22 @@ setup(void)
 	}
 
 	getfdtype(&out);
+	if (ddflags & C_ODIRECT)
+		setdirect(&out, 1);
 
 	/*
 	 * Allocate space for the input and output buffers.  If not doing
 	 * record oriented I/O, only need a single buffer.
 	 */
 	if (!(ddflags & (C_BLOCK|C_UNBLOCK))) {
-		if ((in.db = malloc(out.dbsz + in.dbsz - 1)) == NULL) {
+		if ((in.db = dballoc(out.dbsz + in.dbsz - 1)) == NULL) {
 			exit(1);
 			/* NOTREACHED */
 		}
 		out.db = in.db;
 	} else if ((in.db =
-	    malloc((u_int)(MAX(in.dbsz, cbsz) + cbsz))) == NULL ||
-	    (out.db = malloc((u_int)(out.dbsz + cbsz))) == NULL) {
+	    dballoc((u_int)(MAX(in.dbsz, cbsz) + cbsz))) == NULL ||
+	    (out.db = dballoc((u_int)(out.dbsz + cbsz))) == NULL) {
 		exit(1);
 		/* NOTREACHED */
 	}
@@ -332,6 +342,38 @@ redup_clean_fd(int fd)
 	return newfd;
 }
 
+/*
+ * Turn O_DIRECT on or off for a stream.  Direct I/O needs the buffer, the
+ * transfer size and the file offset aligned to the device's block size;
+ * buffers come from dballoc, and the block sizes are the user's business.
+ */
+static void
+setdirect(IO *io, int on)
+{
+	int flags;
+
+	flags = fcntl(io->fd, F_GETFL);
+	if (flags == -1 || fcntl(io->fd, F_SETFL,
+	    on ? flags | O_DIRECT : flags & ~O_DIRECT) == -1) {
+		fprintf(stderr, "%s: cannot %s direct I/O: %s\n",
+			io->name, on ? "use" : "stop", strerror(errno));
+		exit(1);
+		/* NOTREACHED */
+	}
+}
+
+/*
+ * Allocate an I/O buffer, page aligned if either stream does direct I/O.
+ */
+static void *
+dballoc(size_t size)
+{
+
+	if (ddflags & (C_IDIRECT|C_ODIRECT))
+		return memalign(getpagesize(), size);
+	return malloc(size);
+}
+
 static void
 dd_in(void)
 {
@@ -436,6 +478,182 @@ dd_in(void)
 	}
 }
 
+/*
+ * Fast path for a plain copy: a reader thread fills buffers while the main
+ * thread writes them out, so the input and output devices are kept busy at
+ * the same time instead of taking turns.  Each input block is still read
+ * with its own read and written as one output block through dd_out, which
+ * does the sparse handling and the output statistics just as dd_in would;
+ * a buffer holds enough blocks to make handing it over cheap next to the
+ * I/O.
+ *
+ * Only direct I/O and blocks of BUFSZ or more take this path.  Through the
+ * page cache, reads and writes of smaller blocks are mostly memory copies
+ * with no device latency to hide, and handing buffers between the threads
+ * costs more than the overlap gains.
+ */
+#define	NBUFS	2			/* double buffering */
+#define	BUFSZ	(1024 * 1024)		/* bytes of blocks per buffer */
+#define	MAXBUFBLOCKS	1024		/* at most, whatever the block size */
+
+static struct {
+	u_char		*db;
+	int64_t		*dbrcnt;	/* bytes read into each block */
+	u_int		dbcnt;		/* blocks read */
+	int		full;		/* waiting to be written */
+	int		eof;		/* the last buffer of the input */
+	int		error;		/* errno of the read that ended it */
+} bufs[NBUFS];
+static u_int		bufblocks;	/* blocks per buffer */
+static pthread_mutex_t	bufs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	bufs_cond = PTHREAD_COND_INITIALIZER;
+
+static void *
+dd_reader(void *notused)
+{
+	int i, eof, error;
+	u_int cnt;
+	int64_t n;
+
+	for (i = 0, eof = 0, error = 0; !eof; i = (i + 1) % NBUFS) {
+		pthread_mutex_lock(&bufs_lock);
+		while (bufs[i].full)
+			pthread_cond_wait(&bufs_cond, &bufs_lock);
+		pthread_mutex_unlock(&bufs_lock);
+
+		/*
+		 * Stop filling the buffer at a short read, as there may not
+		 * be more to read for a while.
+		 */
+		for (cnt = 0, n = in.dbsz; cnt < bufblocks && n == in.dbsz;
+		    cnt++) {
+			if (cpy_cnt && (st.in_full + st.in_part) >= cpy_cnt) {
+				eof = 1;
+				break;
+			}
+			n = read(in.fd, bufs[i].db + cnt * in.dbsz, in.dbsz);
+			if (n == 0) {
+				eof = 1;
+				break;
+			}
+			/*
+			 * Leave the error to the main thread, which may be in
+			 * the middle of dd_out, and which runs the summary.
+			 */
+			if (n < 0) {
+				error = errno;
+				eof = 1;
+				break;
+			}
+			if (n == in.dbsz)
+				++st.in_full;
+			else
+				++st.in_part;
+			bufs[i].dbrcnt[cnt] = n;
+		}
+
+		pthread_mutex_lock(&bufs_lock);
+		bufs[i].dbcnt = cnt;
+		bufs[i].eof = eof;
+		bufs[i].error = error;
+		bufs[i].full = 1;
+		pthread_cond_broadcast(&bufs_cond);
+		pthread_mutex_unlock(&bufs_lock);
+	}
+	return NULL;
+}
+
+/*
+ * Returns 0, having done nothing, if the fast path does not apply: it only
+ * does what dd_in does when each input block becomes one output block with
+ * no conversion, padding or error recovery in between.
+ */
+static int
+dd_copy(void)
+{
+	pthread_t reader;
+	u_char *db;
+	u_int cnt;
+	int64_t n;
+	int i, copied;
+
+	if (cfunc != def || ctab != NULL || files_cnt > 1)
+		return 0;
+	if (ddflags & (C_NOERROR|C_OSYNC|C_SWAB|C_SYNC))
+		return 0;
+	if (!(ddflags & (C_IDIRECT|C_ODIRECT)) && in.dbsz < BUFSZ)
+		return 0;
+	/* Without bs, partial input blocks are gathered into full ones. */
+	if (!(ddflags & C_BS) && (in.dbsz != out.dbsz ||
+	    in.flags & (ISCHR|ISPIPE|ISTAPE)))
+		return 0;
+
+	/*
+	 * Don't hold back what comes in from a pipe or a terminal, where
+	 * even full blocks may arrive slowly.
+	 */
+	if (in.flags & (ISPIPE|ISTAPE) || isatty(in.fd) || in.dbsz >= BUFSZ)
+		bufblocks = 1;
+	else
+		bufblocks = MIN(BUFSZ / in.dbsz, MAXBUFBLOCKS);
+	if (cpy_cnt && cpy_cnt < bufblocks)
+		bufblocks = cpy_cnt;
+
+	copied = 0;
+	for (i = 0; i < NBUFS; i++) {
+		bufs[i].db = dballoc(bufblocks * in.dbsz);
+		bufs[i].dbrcnt = malloc(bufblocks * sizeof(int64_t));
+		if (bufs[i].db == NULL || bufs[i].dbrcnt == NULL)
+			goto free_bufs;
+	}
+	if (pthread_create(&reader, NULL, dd_reader, NULL))
+		goto free_bufs;
+
+	db = out.db;
+	for (i = 0;; i = (i + 1) % NBUFS) {
+		pthread_mutex_lock(&bufs_lock);
+		while (!bufs[i].full)
+			pthread_cond_wait(&bufs_cond, &bufs_lock);
+		pthread_mutex_unlock(&bufs_lock);
+
+		for (cnt = 0; cnt < bufs[i].dbcnt; cnt++) {
+			n = bufs[i].dbrcnt[cnt];
+			out.db = bufs[i].db + cnt * in.dbsz;
+			out.dbp = out.db + n;
+			out.dbcnt = n;
+			dd_out(ddflags & C_BS || n < out.dbsz);
+		}
+		if (bufs[i].eof)
+			break;
+
+		pthread_mutex_lock(&bufs_lock);
+		bufs[i].full = 0;
+		pthread_cond_broadcast(&bufs_cond);
+		pthread_mutex_unlock(&bufs_lock);
+	}
+	pthread_join(reader, NULL);
+
+	/* What dd_in does without noerror; with it, dd_copy is not used. */
+	if (bufs[i].error) {
+		fprintf(stderr, "%s: read error: %s\n",
+			in.name, strerror(bufs[i].error));
+		exit(1);
+		/* NOTREACHED */
+	}
+
+	/* dd_close may still write a block out of the usual buffer. */
+	out.db = out.dbp = db;
+	out.dbcnt = 0;
+	copied = 1;
+
+free_bufs:
+	for (i = 0; i < NBUFS; i++) {
+		free(bufs[i].db);
+		free(bufs[i].dbrcnt);
+	}
+	return copied;
+}
+
 /*
  * Cleanup any remaining I/O and flush output.  If necesssary, output file
  * is truncated.
@@ -508,6 +726,12 @@ dd_out(int force)
 	 * One special case is if we're forced to do the write -- in that case
 	 * we play games with the buffer size, and it's usually a partial write.
 	 */
+	/* A short last block can't be written with direct I/O. */
+	if (force && out.dbcnt < out.dbsz && ddflags & C_ODIRECT) {
+		setdirect(&out, 0);
+		ddflags &= ~C_ODIRECT;
+	}
+
 	outp = out.db;
 	for (n = force ? out.dbcnt : out.dbsz;; n = out.dbsz) {
 		for (cnt = n;; cnt -= nw) {
@@ -1046,9 +1270,7 @@ terminate(int notused)
 }
 
 static int	c_arg(const void *, const void *);
-#ifndef	NO_CONV
 static int	c_conv(const void *, const void *);
-#endif
 static void	f_bs(char *);
 static void	f_cbs(char *);
 static void	f_conv(char *);
@@ -1056,8 +1278,10 @@ static void	f_count(char *);
 static void	f_files(char *);
 static void	f_ibs(char *);
 static void	f_if(char *);
+static void	f_iflag(char *);
 static void	f_obs(char *);
 static void	f_of(char *);
+static void	f_oflag(char *);
 static void	f_seek(char *);
 static void	f_skip(char *);
 static void	f_progress(char *);
@@ -1076,8 +1300,10 @@ static const struct arg {
 	{ "files",	f_files,	C_FILES, C_FILES },
 	{ "ibs",	f_ibs,		C_IBS,	 C_BS|C_IBS },
 	{ "if",		f_if,		C_IF,	 C_IF },
+	{ "iflag",	f_iflag,	0,	 0 },
 	{ "obs",	f_obs,		C_OBS,	 C_BS|C_OBS },
 	{ "of",		f_of,		C_OF,	 C_OF },
+	{ "oflag",	f_oflag,	0,	 0 },
 	{ "progress",	f_progress,	0,	 0 },
 	{ "seek",	f_seek,		C_SEEK,	 C_SEEK },
 	{ "skip",	f_skip,		C_SKIP,	 C_SKIP },
@@ -1247,6 +1473,34 @@ f_if(char *arg)
 	in.name = arg;
 }
 
+/*
+ * Parse iflag= and oflag=.  The only flag is "direct", for O_DIRECT.
+ */
+static u_int
+ioflags(char *arg, u_int direct)
+{
+	char *flag;
+	u_int flags;
+
+	for (flags = 0; (flag = strsep(&arg, ",")) != NULL;) {
+		if (strcmp(flag, "direct") == 0)
+			flags |= direct;
+		else {
+			fprintf(stderr, "unknown flag %s\n", flag);
+			exit(1);
+			/* NOTREACHED */
+		}
+	}
+	return flags;
+}
+
+static void
+f_iflag(char *arg)
+{
+
+	ddflags |= ioflags(arg, C_IDIRECT);
+}
+
 static void
 f_obs(char *arg)
 {
@@ -1262,6 +1516,13 @@ f_of(char *arg)
 	out.name = arg;
 }
 
+static void
+f_oflag(char *arg)
+{
+
+	ddflags |= ioflags(arg, C_ODIRECT);
+}
+
 static void
 f_seek(char *arg)
 {
@@ -1284,39 +1545,39 @@ f_progress(char *arg)
 		progress = 1;
 }
 
-#ifdef	NO_CONV
-/* Build a small version (i.e. for a ramdisk root) */
-static void
-f_conv(char *arg)
-{
-
-	fprintf(stderr, "conv option disabled\n");
-	exit(1);
-	/* NOTREACHED */
-}
-#else	/* NO_CONV */
-
+/*
+ * A small version (i.e. for a ramdisk root) has no conversion tables or
+ * record functions, but still does the conversions that need neither.
+ */
 static const struct conv {
 	const char *name;
 	u_int set, noset;
 	const u_char *ctab;
 } clist[] = {
+#ifndef	NO_CONV
 	{ "ascii",	C_ASCII,	C_EBCDIC,	e2a_POSIX },
 	{ "block",	C_BLOCK,	C_UNBLOCK,	NULL },
 	{ "ebcdic",	C_EBCDIC,	C_ASCII,	a2e_POSIX },
 	{ "ibm",	C_EBCDIC,	C_ASCII,	a2ibm_POSIX },
 	{ "lcase",	C_LCASE,	C_UCASE,	NULL },
+#endif	/* NO_CONV */
 	{ "noerror",	C_NOERROR,	0,		NULL },
 	{ "notrunc",	C_NOTRUNC,	0,		NULL },
+#ifndef	NO_CONV
 	{ "oldascii",	C_ASCII,	C_EBCDIC,	e2a_32V },
 	{ "oldebcdic",	C_EBCDIC,	C_ASCII,	a2e_32V },
 	{ "oldibm",	C_EBCDIC,	C_ASCII,	a2ibm_32V },
+#endif	/* NO_CONV */
 	{ "osync",	C_OSYNC,	C_BS,		NULL },
 	{ "sparse",	C_SPARSE,	0,		NULL },
+#ifndef	NO_CONV
 	{ "swab",	C_SWAB,		0,		NULL },
+#endif	/* NO_CONV */
 	{ "sync",	C_SYNC,		0,		NULL },
+#ifndef	NO_CONV
 	{ "ucase",	C_UCASE,	C_LCASE,	NULL },
 	{ "unblock",	C_UNBLOCK,	C_BLOCK,	NULL },
+#endif	/* NO_CONV */
 	/* If you add items to this table, be sure to add the
 	 * conversions to the C_BS check in the jcl routine above.
 	 */
@@ -1352,7 +1613,3 @@ c_conv(const void *a, const void *b)
 	return (strcmp(((const struct conv *)a)->name,
 	    ((const struct conv *)b)->name));
 }
-
-#endif	/* NO_CONV */
-
-
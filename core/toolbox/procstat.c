@@ -0,0 +1,464 @@
+/*
+ * Copyright (c) 2010, The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of Google, Inc. nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "procstat.h"
+
+#define INIT_BUCKETS 256
+#define INIT_ENTRIES 128
+
+static struct procstat_entry *lookup(struct procstat *ps, pid_t pid, pid_t tid);
+static void free_entry(struct procstat *ps, struct procstat_entry *e);
+static int append(struct procstat_entry ***array, size_t *num, size_t *size,
+                  struct procstat_entry *e);
+static ssize_t read_kept(struct procstat *ps, int *fd, const char *path);
+static ssize_t read_once(struct procstat *ps, const char *path);
+static int read_entry(struct procstat *ps, struct procstat_entry *e, const char *dir);
+static int update_process(struct procstat *ps, pid_t pid);
+
+int procstat_init(struct procstat *ps, const char *root, unsigned flags) {
+    struct rlimit rl;
+
+    memset(ps, 0, sizeof(*ps));
+    ps->flags = flags;
+
+    ps->root_fd = open(root, O_RDONLY | O_DIRECTORY);
+    if (ps->root_fd < 0)
+        return -1;
+    ps->root_dir = opendir(root);
+    if (!ps->root_dir) {
+        close(ps->root_fd);
+        return -1;
+    }
+
+    ps->buckets = calloc(INIT_BUCKETS, sizeof(ps->buckets[0]));
+    if (!ps->buckets) {
+        closedir(ps->root_dir);
+        close(ps->root_fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    ps->num_buckets = INIT_BUCKETS;
+
+    /*
+     * Keeping stat files open saves an open and a close per entry per update,
+     * so use up to half of the descriptors the soft limit allows for that.
+     * The limit is the caller's to set; it is not raised here.
+     */
+    if (!getrlimit(RLIMIT_NOFILE, &rl))
+        ps->max_fds = rl.rlim_cur > 65536 ? 32768 : (int)rl.rlim_cur / 2;
+
+    return 0;
+}
+
+int procstat_update(struct procstat *ps) {
+    struct dirent *de;
+    struct procstat_entry **prev;
+    size_t num_prev, prev_size, i;
+    pid_t pid;
+
+    ps->generation++;
+
+    /* what died last time has been reported */
+    for (i = 0; i < ps->num_dead; i++)
+        free_entry(ps, ps->dead[i]);
+    ps->num_dead = 0;
+
+    prev = ps->entries;
+    num_prev = ps->num_entries;
+    prev_size = ps->entries_size;
+    ps->entries = ps->spare;
+    ps->entries_size = ps->spare_size;
+    ps->num_entries = 0;
+
+    rewinddir(ps->root_dir);
+    while ((de = readdir(ps->root_dir))) {
+        if (!isdigit(de->d_name[0]))
+            continue;
+        pid = atoi(de->d_name);
+        if (ps->pid_filter && pid != ps->pid_filter)
+            continue;
+        if (update_process(ps, pid)) {
+            ps->spare = prev;
+            ps->spare_size = prev_size;
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    /* whatever was found last time but not now has died */
+    for (i = 0; i < num_prev; i++) {
+        if (prev[i]->seen == ps->generation)
+            continue;
+        if (append(&ps->dead, &ps->num_dead, &ps->dead_size, prev[i])) {
+            free_entry(ps, prev[i]);
+            continue;
+        }
+    }
+
+    ps->spare = prev;
+    ps->spare_size = prev_size;
+
+    return 0;
+}
+
+void procstat_destroy(struct procstat *ps) {
+    struct procstat_entry *e, *next;
+    size_t i;
+
+    for (i = 0; i < ps->num_buckets; i++) {
+        for (e = ps->buckets[i]; e; e = next) {
+            next = e->hash_next;
+            if (e->stat_fd >= 0)
+                close(e->stat_fd);
+            if (e->schedstat_fd >= 0)
+                close(e->schedstat_fd);
+            free(e);
+        }
+    }
+    free(ps->buckets);
+    free(ps->entries);
+    free(ps->dead);
+    free(ps->spare);
+    closedir(ps->root_dir);
+    close(ps->root_fd);
+}
+
+static size_t hash(struct procstat *ps, pid_t pid, pid_t tid) {
+    return ((unsigned)pid * 31 + (unsigned)tid) & (ps->num_buckets - 1);
+}
+
+static struct procstat_entry *lookup(struct procstat *ps, pid_t pid, pid_t tid) {
+    struct procstat_entry *e, *next, **buckets;
+    size_t num_buckets, i;
+
+    for (e = ps->buckets[hash(ps, pid, tid)]; e; e = e->hash_next)
+        if (e->pid == pid && e->tid == tid)
+            return e;
+
+    if (ps->num_hashed >= ps->num_buckets) {
+        buckets = calloc(2 * ps->num_buckets, sizeof(buckets[0]));
+        if (!buckets)
+            return NULL;
+        num_buckets = ps->num_buckets;
+        ps->num_buckets *= 2;
+        for (i = 0; i < num_buckets; i++) {
+            for (e = ps->buckets[i]; e; e = next) {
+                next = e->hash_next;
+                e->hash_next = buckets[hash(ps, e->pid, e->tid)];
+                buckets[hash(ps, e->pid, e->tid)] = e;
+            }
+        }
+        free(ps->buckets);
+        ps->buckets = buckets;
+    }
+
+    e = calloc(1, sizeof(*e));
+    if (!e)
+        return NULL;
+    e->pid = pid;
+    e->tid = tid;
+    e->process = e;
+    e->stat_fd = e->schedstat_fd = -1;
+
+    e->hash_next = ps->buckets[hash(ps, pid, tid)];
+    ps->buckets[hash(ps, pid, tid)] = e;
+    ps->num_hashed++;
+
+    return e;
+}
+
+static void free_entry(struct procstat *ps, struct procstat_entry *e) {
+    struct procstat_entry **link;
+
+    for (link = &ps->buckets[hash(ps, e->pid, e->tid)]; *link; link = &(*link)->hash_next) {
+        if (*link == e) {
+            *link = e->hash_next;
+            break;
+        }
+    }
+    ps->num_hashed--;
+
+    if (e->stat_fd >= 0) {
+        close(e->stat_fd);
+        ps->num_fds--;
+    }
+    if (e->schedstat_fd >= 0) {
+        close(e->schedstat_fd);
+        ps->num_fds--;
+    }
+    free(e);
+}
+
+static int append(struct procstat_entry ***array, size_t *num, size_t *size,
+                  struct procstat_entry *e) {
+    struct procstat_entry **new_array;
+    size_t new_size;
+
+    if (*num >= *size) {
+        new_size = *size ? 2 * *size : INIT_ENTRIES;
+        new_array = realloc(*array, new_size * sizeof(new_array[0]));
+        if (!new_array)
+            return -1;
+        *array = new_array;
+        *size = new_size;
+    }
+    (*array)[(*num)++] = e;
+    return 0;
+}
+
+/*
+ * Read a file into the buffer through *fd, which is opened if it is not yet
+ * and kept open afterwards if there are descriptors to spare. A kept file
+ * that can no longer be read belonged to a task that has exited, so it is
+ * opened again in case the pid is in use once more.
+ */
+static ssize_t read_kept(struct procstat *ps, int *fd, const char *path) {
+    ssize_t len;
+    int new_fd;
+
+    if (*fd >= 0) {
+        len = pread(*fd, ps->buf, sizeof(ps->buf) - 1, 0);
+        if (len > 0) {
+            ps->buf[len] = '\0';
+            return len;
+        }
+        close(*fd);
+        *fd = -1;
+        ps->num_fds--;
+    }
+
+    new_fd = openat(ps->root_fd, path, O_RDONLY);
+    if (new_fd < 0)
+        return -1;
+    len = pread(new_fd, ps->buf, sizeof(ps->buf) - 1, 0);
+    if (len > 0 && ps->num_fds < ps->max_fds) {
+        *fd = new_fd;
+        ps->num_fds++;
+    } else {
+        close(new_fd);
+    }
+    if (len <= 0)
+        return -1;
+    ps->buf[len] = '\0';
+    return len;
+}
+
+static ssize_t read_once(struct procstat *ps, const char *path) {
+    ssize_t len;
+    int fd;
+
+    fd = openat(ps->root_fd, path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    len = pread(fd, ps->buf, sizeof(ps->buf) - 1, 0);
+    close(fd);
+    if (len < 0)
+        return -1;
+    ps->buf[len] = '\0';
+    return len;
+}
+
+/*
+ * Read the files of the process or thread in dir, relative to the root.
+ * Returns 0, or 1 if it has gone.
+ */
+static int read_entry(struct procstat *ps, struct procstat_entry *e, const char *dir) {
+    char path[64];
+    char *open_paren, *close_paren, *line;
+    unsigned long long start_time, exec_time, delay_time;
+    unsigned int run_count, uid, euid, gid;
+    size_t len;
+    int fresh, renamed;
+
+    snprintf(path, sizeof(path), "%s/stat", dir);
+    if (read_kept(ps, &e->stat_fd, path) < 0)
+        return 1;
+
+    /* Split at first '(' and last ')' to get the name. */
+    open_paren = strchr(ps->buf, '(');
+    close_paren = strrchr(ps->buf, ')');
+    if (!open_paren || !close_paren || close_paren < open_paren)
+        return 1;
+    *close_paren = '\0';
+
+    start_time = 0;
+    sscanf(close_paren + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u "
+                            "%*d %*d %*d %*d %*d %*d %llu", &start_time);
+
+    /* a new task, or a pid in use again since the last update */
+    fresh = !e->seen || start_time != e->start_time;
+    e->has_prev = !fresh;
+    e->start_time = start_time;
+
+    if (!fresh) {
+        e->prev_utime = e->utime;
+        e->prev_stime = e->stime;
+        e->prev_exec_time = e->exec_time;
+        e->prev_delay_time = e->delay_time;
+        e->prev_run_count = e->run_count;
+    }
+
+    len = close_paren - open_paren - 1;
+    if (len >= sizeof(e->comm))
+        len = sizeof(e->comm) - 1;
+    renamed = fresh || strncmp(e->comm, open_paren + 1, len) || e->comm[len];
+    memcpy(e->comm, open_paren + 1, len);
+    e->comm[len] = '\0';
+
+    sscanf(close_paren + 1, " %c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu "
+                            "%*d %*d %ld %ld %ld %*d %*u %lu %ld %*u %*u %*u %*u %*u %lu "
+                            "%*u %*u %*u %*u %lu %*u %*u %*d %*d %lu %lu",
+           &e->state, &e->ppid, &e->utime, &e->stime, &e->prio, &e->nice,
+           &e->num_threads, &e->vss, &e->rss, &e->eip, &e->wchan,
+           &e->rtprio, &e->policy);
+
+    /* names and ids change with exec, and zygote's children are renamed */
+    if (!e->tid && renamed) {
+        snprintf(path, sizeof(path), "%s/cmdline", dir);
+        if (read_once(ps, path) >= 0) {
+            len = strlen(ps->buf);
+            if (len >= sizeof(e->cmdline))
+                len = sizeof(e->cmdline) - 1;
+            memcpy(e->cmdline, ps->buf, len);
+            e->cmdline[len] = '\0';
+        } else {
+            e->cmdline[0] = '\0';
+        }
+
+        snprintf(path, sizeof(path), "%s/status", dir);
+        if (read_once(ps, path) >= 0) {
+            uid = euid = gid = 0;
+            line = strstr(ps->buf, "\nUid:");
+            if (line)
+                sscanf(line, "\nUid: %u %u", &uid, &euid);
+            line = strstr(ps->buf, "\nGid:");
+            if (line)
+                sscanf(line, "\nGid: %u", &gid);
+            e->uid = uid;
+            e->euid = euid;
+            e->gid = gid;
+        }
+    }
+
+    if (ps->flags & PROCSTAT_SCHEDSTAT) {
+        e->exec_time = e->delay_time = 0;
+        e->run_count = 0;
+        /* a process's is added up from its threads' by update_process */
+        if (e->tid || !(ps->flags & PROCSTAT_THREADS)) {
+            snprintf(path, sizeof(path), "%s/schedstat", dir);
+            if (read_kept(ps, &e->schedstat_fd, path) >= 0 &&
+                sscanf(ps->buf, "%llu %llu %u", &exec_time, &delay_time, &run_count) == 3) {
+                e->exec_time = exec_time;
+                e->delay_time = delay_time;
+                e->run_count = run_count;
+            }
+        }
+    }
+
+    e->seen = ps->generation;
+    return 0;
+}
+
+/* Returns 0, or -1 if out of memory. */
+static int update_process(struct procstat *ps, pid_t pid) {
+    struct procstat_entry *proc, *thread;
+    struct dirent *de;
+    DIR *task_dir;
+    char dir[32];
+    pid_t tid;
+    int fd;
+
+    proc = lookup(ps, pid, 0);
+    if (!proc)
+        return -1;
+    snprintf(dir, sizeof(dir), "%d", pid);
+    if (read_entry(ps, proc, dir)) {
+        if (!proc->seen)
+            free_entry(ps, proc);
+        return 0;
+    }
+    if (append(&ps->entries, &ps->num_entries, &ps->entries_size, proc))
+        return -1;
+
+    if (!(ps->flags & PROCSTAT_THREADS))
+        return 0;
+
+    snprintf(dir, sizeof(dir), "%d/task", pid);
+    fd = openat(ps->root_fd, dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        return 0;
+    task_dir = fdopendir(fd);
+    if (!task_dir) {
+        close(fd);
+        return 0;
+    }
+
+    while ((de = readdir(task_dir))) {
+        if (!isdigit(de->d_name[0]))
+            continue;
+        tid = atoi(de->d_name);
+
+        thread = lookup(ps, pid, tid);
+        if (!thread) {
+            closedir(task_dir);
+            return -1;
+        }
+        snprintf(dir, sizeof(dir), "%d/task/%d", pid, tid);
+        if (read_entry(ps, thread, dir)) {
+            if (!thread->seen)
+                free_entry(ps, thread);
+            continue;
+        }
+        thread->process = proc;
+        if (append(&ps->entries, &ps->num_entries, &ps->entries_size, thread)) {
+            closedir(task_dir);
+            return -1;
+        }
+
+        proc->exec_time += thread->exec_time;
+        proc->delay_time += thread->delay_time;
+        proc->run_count += thread->run_count;
+    }
+
+    closedir(task_dir);
+    return 0;
+}
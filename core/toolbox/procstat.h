@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2010, The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of Google, Inc. nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _TOOLBOX_PROCSTAT_H
+#define _TOOLBOX_PROCSTAT_H
+
+#include <dirent.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Samples the processes (and threads) in /proc for top, ps and schedtop.
+ *
+ * Entries are kept in a hash by pid and tid from one update to the next, so
+ * each one carries its previous times and nothing has to be matched up by
+ * the caller. Files are read with pread into one buffer; the stat and
+ * schedstat files of known entries stay open while there are descriptors to
+ * spare, and cmdline and status are only read again when the name in stat
+ * changes, as it does after a fork and exec or when zygote renames a child.
+ */
+
+#define PROCSTAT_CMDLINE_LEN 256
+#define PROCSTAT_NAME_LEN 64
+
+/* What procstat_update reads. */
+#define PROCSTAT_THREADS   1  /* an entry per thread, after its process's */
+#define PROCSTAT_SCHEDSTAT 2  /* schedstat; with PROCSTAT_THREADS a process's
+                                 is the sum of its threads' */
+
+struct procstat_entry {
+    struct procstat_entry *hash_next;
+    pid_t pid;
+    pid_t tid;                          /* 0 for a process */
+    struct procstat_entry *process;     /* itself, or the thread's process */
+    unsigned seen;                      /* the last update to find it */
+    int has_prev;                       /* the prev_ fields are valid */
+    int stat_fd, schedstat_fd;
+
+    /* cmdline and status, of processes only */
+    char cmdline[PROCSTAT_CMDLINE_LEN]; /* the first argument */
+    uid_t uid, euid;
+    gid_t gid;
+
+    /* stat */
+    char comm[PROCSTAT_NAME_LEN];
+    char state;
+    pid_t ppid;
+    unsigned long utime, stime;
+    long prio, nice;
+    long num_threads;
+    unsigned long vss;                  /* bytes */
+    long rss;                           /* pages */
+    unsigned long eip, wchan;
+    unsigned long rtprio, policy;
+    unsigned long long start_time;      /* tells a reused pid apart */
+    unsigned long prev_utime, prev_stime;
+
+    /* schedstat */
+    uint64_t exec_time, delay_time;
+    uint32_t run_count;
+    uint64_t prev_exec_time, prev_delay_time;
+    uint32_t prev_run_count;
+};
+
+struct procstat {
+    int root_fd;
+    DIR *root_dir;
+    unsigned flags;
+    pid_t pid_filter;                   /* if not 0, only this process */
+    unsigned generation;
+
+    /* found by the last update, in /proc order; callers may reorder them */
+    struct procstat_entry **entries;
+    size_t num_entries;
+    /* found by the update before but not the last */
+    struct procstat_entry **dead;
+    size_t num_dead;
+
+    struct procstat_entry **buckets;
+    size_t num_buckets, num_hashed;
+    struct procstat_entry **spare;      /* for the next entries array */
+    size_t entries_size, dead_size, spare_size;
+    int num_fds, max_fds;
+    char buf[1024];
+};
+
+/* Returns 0, or -1 with errno set. root is normally "/proc". */
+int procstat_init(struct procstat *ps, const char *root, unsigned flags);
+
+/* Reads every process again. Returns 0, or -1 with errno set. */
+int procstat_update(struct procstat *ps);
+
+void procstat_destroy(struct procstat *ps);
+
+#endif
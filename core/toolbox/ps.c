@@ -13,16 +13,8 @@
 
 #include <cutils/sched_policy.h>
 
+#include "procstat.h"
 
-static char *nexttoksep(char **strp, char *sep)
-{
-    char *p = strsep(strp,sep);
-    return (p == 0) ? "" : p;
-}
-static char *nexttok(char **strp)
-{
-    return nexttoksep(strp, " ");
-}
 
 #define SHOW_PRIO 1
 #define SHOW_TIME 2
@@ -30,120 +22,35 @@ static char *nexttok(char **strp)
 
 static int display_flags = 0;
 
-static int ps_line(int pid, int tid, char *namefilter)
+static void ps_line(struct procstat_entry *e, char *namefilter)
 {
-    char statline[1024];
-    char cmdline[1024];
     char user[32];
-    struct stat stats;
-    int fd, r;
-    char *ptr, *name, *state;
-    int ppid, tty;
-    unsigned wchan, rss, vss, eip;
-    unsigned utime, stime;
-    int prio, nice, rtprio, sched;
+    char *name, *cmdline;
+    int pid, ppid;
     struct passwd *pw;
-    
-    sprintf(statline, "/proc/%d", pid);
-    stat(statline, &stats);
 
-    if(tid) {
-        sprintf(statline, "/proc/%d/task/%d/stat", pid, tid);
-        cmdline[0] = 0;
+    if(e->tid) {
+        pid = e->tid;
+        ppid = e->pid;
+        cmdline = "";
     } else {
-        sprintf(statline, "/proc/%d/stat", pid);
-        sprintf(cmdline, "/proc/%d/cmdline", pid);    
-        fd = open(cmdline, O_RDONLY);
-        if(fd == 0) {
-            r = 0;
-        } else {
-            r = read(fd, cmdline, 1023);
-            close(fd);
-            if(r < 0) r = 0;
-        }
-        cmdline[r] = 0;
-    }
-    
-    fd = open(statline, O_RDONLY);
-    if(fd == 0) return -1;
-    r = read(fd, statline, 1023);
-    close(fd);
-    if(r < 0) return -1;
-    statline[r] = 0;
-
-    ptr = statline;
-    nexttok(&ptr); // skip pid
-    ptr++;          // skip "("
-
-    name = ptr;
-    ptr = strrchr(ptr, ')'); // Skip to *last* occurence of ')',
-    *ptr++ = '\0';           // and null-terminate name.
-
-    ptr++;          // skip " "
-    state = nexttok(&ptr);
-    ppid = atoi(nexttok(&ptr));
-    nexttok(&ptr); // pgrp
-    nexttok(&ptr); // sid
-    tty = atoi(nexttok(&ptr));
-    
-    nexttok(&ptr); // tpgid
-    nexttok(&ptr); // flags
-    nexttok(&ptr); // minflt
-    nexttok(&ptr); // cminflt
-    nexttok(&ptr); // majflt
-    nexttok(&ptr); // cmajflt
-#if 1
-    utime = atoi(nexttok(&ptr));
-    stime = atoi(nexttok(&ptr));
-#else
-    nexttok(&ptr); // utime
-    nexttok(&ptr); // stime
-#endif
-    nexttok(&ptr); // cutime
-    nexttok(&ptr); // cstime
-    prio = atoi(nexttok(&ptr));
-    nice = atoi(nexttok(&ptr));
-    nexttok(&ptr); // threads
-    nexttok(&ptr); // itrealvalue
-    nexttok(&ptr); // starttime
-    vss = strtoul(nexttok(&ptr), 0, 10); // vsize
-    rss = strtoul(nexttok(&ptr), 0, 10); // rss
-    nexttok(&ptr); // rlim
-    nexttok(&ptr); // startcode
-    nexttok(&ptr); // endcode
-    nexttok(&ptr); // startstack
-    nexttok(&ptr); // kstkesp
-    eip = strtoul(nexttok(&ptr), 0, 10); // kstkeip
-    nexttok(&ptr); // signal
-    nexttok(&ptr); // blocked
-    nexttok(&ptr); // sigignore
-    nexttok(&ptr); // sigcatch
-    wchan = strtoul(nexttok(&ptr), 0, 10); // wchan
-    nexttok(&ptr); // nswap
-    nexttok(&ptr); // cnswap
-    nexttok(&ptr); // exit signal
-    nexttok(&ptr); // processor
-    rtprio = atoi(nexttok(&ptr)); // rt_priority
-    sched = atoi(nexttok(&ptr)); // scheduling policy
-    
-    tty = atoi(nexttok(&ptr));
-    
-    if(tid != 0) {
-        ppid = pid;
-        pid = tid;
+        pid = e->pid;
+        ppid = e->ppid;
+        cmdline = e->cmdline;
     }
+    name = e->comm;
 
-    pw = getpwuid(stats.st_uid);
+    pw = getpwuid(e->process->euid);
     if(pw == 0) {
-        sprintf(user,"%d",(int)stats.st_uid);
+        sprintf(user,"%d",(int)e->process->euid);
     } else {
         strcpy(user,pw->pw_name);
     }
-    
+
     if(!namefilter || !strncmp(name, namefilter, strlen(namefilter))) {
-        printf("%-9s %-5d %-5d %-6d %-5d", user, pid, ppid, vss / 1024, rss * 4);
+        printf("%-9s %-5d %-5d %-6lu %-5ld", user, pid, ppid, e->vss / 1024, e->rss * 4);
         if(display_flags&SHOW_PRIO)
-            printf(" %-5d %-5d %-5d %-5d", prio, nice, rtprio, sched);
+            printf(" %-5ld %-5ld %-5lu %-5lu", e->prio, e->nice, e->rtprio, e->policy);
         if (display_flags & SHOW_POLICY) {
             SchedPolicy p;
             if (get_sched_policy(pid, &p) < 0)
@@ -157,46 +64,22 @@ static int ps_line(int pid, int tid, char *namefilter)
                     printf(" er ");
             }
         }
-        printf(" %08x %08x %s %s", wchan, eip, state, cmdline[0] ? cmdline : name);
+        printf(" %08lx %08lx %c %s", e->wchan, e->eip, e->state, cmdline[0] ? cmdline : name);
         if(display_flags&SHOW_TIME)
-            printf(" (u:%d, s:%d)", utime, stime);
+            printf(" (u:%lu, s:%lu)", e->utime, e->stime);
 
         printf("\n");
     }
-    return 0;
-}
-
-
-void ps_threads(int pid, char *namefilter)
-{
-    char tmp[128];
-    DIR *d;
-    struct dirent *de;
-
-    sprintf(tmp,"/proc/%d/task",pid);
-    d = opendir(tmp);
-    if(d == 0) return;
-    
-    while((de = readdir(d)) != 0){
-        if(isdigit(de->d_name[0])){
-            int tid = atoi(de->d_name);
-            if(tid == pid) continue;
-            ps_line(pid, tid, namefilter);
-        }
-    }
-    closedir(d);    
 }
 
 int ps_main(int argc, char **argv)
 {
-    DIR *d;
-    struct dirent *de;
+    struct procstat ps;
+    struct procstat_entry *e;
     char *namefilter = 0;
     int pidfilter = 0;
     int threads = 0;
-    
-    d = opendir("/proc");
-    if(d == 0) return -1;
+    size_t i;
 
     while(argc > 1){
         if(!strcmp(argv[1],"-t")) {
@@ -216,19 +99,19 @@ int ps_main(int argc, char **argv)
         argv++;
     }
 
+    if(procstat_init(&ps, "/proc", threads ? PROCSTAT_THREADS : 0)) return -1;
+    ps.pid_filter = pidfilter;
+    if(procstat_update(&ps)) return -1;
+
     printf("USER     PID   PPID  VSIZE  RSS   %s %s WCHAN    PC         NAME\n", 
            (display_flags&SHOW_PRIO)?"PRIO  NICE  RTPRI SCHED ":"",
            (display_flags&SHOW_POLICY)?"PCY " : "");
-    while((de = readdir(d)) != 0){
-        if(isdigit(de->d_name[0])){
-            int pid = atoi(de->d_name);
-            if(!pidfilter || (pidfilter == pid)) {
-                ps_line(pid, 0, namefilter);
-                if(threads) ps_threads(pid, namefilter);
-            }
-        }
+    for(i = 0; i < ps.num_entries; i++){
+        e = ps.entries[i];
+        /* the main thread is the process */
+        if(e->tid == e->pid) continue;
+        ps_line(e, namefilter);
     }
-    closedir(d);
+    procstat_destroy(&ps);
     return 0;
 }
-
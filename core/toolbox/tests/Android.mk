@@ -0,0 +1,14 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	procstatbench.c \
+	../procstat.c
+
+LOCAL_MODULE:= procstatbench
+
+LOCAL_MODULE_TAGS := eng
+
+LOCAL_MODULE_PATH := $(TARGET_OUT_OPTIONAL_EXECUTABLES)
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,92 @@
+#!/bin/bash
+# Copyright (c) 2010, The Android Open Source Project
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in
+#    the documentation and/or other materials provided with the
+#    distribution.
+#  * Neither the name of Google, Inc. nor the names of its contributors
+#    may be used to endorse or promote products derived from this
+#    software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+# FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+# COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+# INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+# OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+# AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+# OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+
+# Measure dd throughput writing and reading a block device, with and
+# without direct I/O, at a few block sizes. A loop device over a file in
+# /data, or a spare partition, is enough to compare two versions of dd:
+#
+#   ddbench.sh /dev/block/loop0 128
+#   ddbench.sh -d /data/local/tmp/dd.old /dev/block/loop0 128
+#
+# Everything on the device is overwritten. The page cache is dropped
+# before each run, which needs adb root.
+
+usage() {
+  echo "usage: ddbench.sh [-l] [-d dd] device [megabytes]"
+  echo "  -l     run on this machine instead of through adb shell"
+  echo "  -d dd  the dd command to measure (default: dd)"
+  exit 1
+}
+
+local_run=0
+dd=dd
+while getopts "ld:" opt; do
+  case $opt in
+    l) local_run=1 ;;
+    d) dd=$OPTARG ;;
+    *) usage ;;
+  esac
+done
+shift $((OPTIND - 1))
+[ $# -ge 1 ] || usage
+device=$1
+megabytes=${2:-64}
+
+run() {
+  if [ $local_run -eq 1 ]; then
+    sh -c "$1"
+  else
+    adb shell "$1" | tr -d '\r'
+  fi
+}
+
+# Print the bytes/sec from dd's summary, on a cold cache.
+rate() {
+  run "sync; echo 3 > /proc/sys/vm/drop_caches" > /dev/null 2>&1
+  run "$dd $* 2>&1" | sed -n 's/.*(\([0-9]*\) bytes\/sec)$/\1/p'
+}
+
+printf "%-8s %-7s %10s %10s\n" bs direct "write MB/s" "read MB/s"
+for bs in 4096 65536 1048576; do
+  count=$((megabytes * 1048576 / bs))
+  for direct in no yes; do
+    if [ $direct = yes ]; then
+      oflag=oflag=direct
+      iflag=iflag=direct
+    else
+      oflag=
+      iflag=
+    fi
+    write=$(rate if=/dev/zero of=$device bs=$bs count=$count $oflag)
+    read=$(rate if=$device of=/dev/null bs=$bs count=$count $iflag)
+    printf "%-8s %-7s %10s %10s\n" $bs $direct \
+        $((${write:-0} / 1048576)) $((${read:-0} / 1048576))
+  done
+done
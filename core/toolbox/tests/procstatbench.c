@@ -0,0 +1,401 @@
+/*
+ * Copyright (c) 2010, The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of Google, Inc. nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Times top -t's sampling of a synthetic /proc, of so many processes with so
+ * many threads each, the way top used to do it (fopen of every file on every
+ * update and a linear search for each thread's previous sample) and with
+ * procstat. Between updates a few threads exit and are replaced, and a few
+ * processes are renamed.
+ *
+ *     procstatbench [ processes [ threads [ updates ] ] ]
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "../procstat.h"
+
+#define die(...) { fprintf(stderr, __VA_ARGS__); exit(EXIT_FAILURE); }
+
+static char root[] = "/data/local/tmp/procstatbench.XXXXXX";
+static int num_procs, num_threads;
+
+static double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void write_file(const char *path, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void write_file(const char *path, const char *fmt, ...) {
+    char full[256];
+    va_list ap;
+    FILE *file;
+
+    snprintf(full, sizeof(full), "%s/%s", root, path);
+    file = fopen(full, "w");
+    if (!file) die("Could not create %s: %s\n", full, strerror(errno));
+    va_start(ap, fmt);
+    vfprintf(file, fmt, ap);
+    va_end(ap);
+    fclose(file);
+}
+
+static void make_dir(const char *path) {
+    char full[256];
+
+    snprintf(full, sizeof(full), "%s/%s", root, path);
+    if (mkdir(full, 0700) && errno != EEXIST)
+        die("Could not create %s: %s\n", full, strerror(errno));
+}
+
+static void write_stat(const char *path, int tid, const char *name, unsigned long utime,
+                       unsigned long long start_time) {
+    write_file(path, "%d (%s) S 1 %d %d 0 -1 4194624 1000 0 0 0 %lu %lu 0 0 20 0 %d 0 %llu "
+               "104857600 2048 4294967295 32768 40960 3204447264 3204446880 2952790016 "
+               "0 4612 0 38136 3221637684 0 0 17 0 0 0\n",
+               tid, name, tid, tid, utime, utime / 2, num_threads, start_time);
+}
+
+static void make_thread(int pid, int tid, unsigned long long start_time) {
+    char path[64], name[16];
+
+    snprintf(path, sizeof(path), "%d/task/%d", pid, tid);
+    make_dir(path);
+    snprintf(name, sizeof(name), "Thread-%d", tid);
+    snprintf(path, sizeof(path), "%d/task/%d/stat", pid, tid);
+    write_stat(path, tid, name, tid % 100, start_time);
+    snprintf(path, sizeof(path), "%d/task/%d/schedstat", pid, tid);
+    write_file(path, "%llu %llu %d\n", 1000000ULL * tid, 1000ULL * tid, tid);
+}
+
+static void remove_thread(int pid, int tid) {
+    char path[256];
+
+    snprintf(path, sizeof(path), "%s/%d/task/%d/stat", root, pid, tid);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/%d/task/%d/schedstat", root, pid, tid);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/%d/task/%d", root, pid, tid);
+    rmdir(path);
+}
+
+static void rename_process(int pid, int generation) {
+    char path[64], name[32];
+
+    snprintf(name, sizeof(name), "com.example.app%d.%d", pid, generation);
+    snprintf(path, sizeof(path), "%d/cmdline", pid);
+    write_file(path, "%s%c", name, 0);
+    snprintf(path, sizeof(path), "%d/stat", pid);
+    write_stat(path, pid, name + strlen(name) - 15, pid % 100, pid);
+}
+
+static void make_root(void) {
+    char path[64];
+    int i, j, pid;
+
+    if (!mkdtemp(root)) {
+        strcpy(root, "/tmp/procstatbench.XXXXXX");
+        if (!mkdtemp(root)) die("mkdtemp: %s\n", strerror(errno));
+    }
+
+    for (i = 0; i < num_procs; i++) {
+        pid = 1000 + i * num_threads * 2;
+        snprintf(path, sizeof(path), "%d", pid);
+        make_dir(path);
+        snprintf(path, sizeof(path), "%d/task", pid);
+        make_dir(path);
+        snprintf(path, sizeof(path), "%d/cmdline", pid);
+        write_file(path, "/system/bin/process%d%c-flag%c", pid, 0, 0);
+        snprintf(path, sizeof(path), "%d/status", pid);
+        write_file(path, "Name:\tprocess%d\nState:\tS (sleeping)\nTgid:\t%d\nPid:\t%d\n"
+                   "PPid:\t1\nTracerPid:\t0\nUid:\t%d\t%d\t%d\t%d\nGid:\t%d\t%d\t%d\t%d\n",
+                   pid, pid, pid, 10000 + i, 10000 + i, 10000 + i, 10000 + i,
+                   10000 + i, 10000 + i, 10000 + i, 10000 + i);
+        snprintf(path, sizeof(path), "%d/stat", pid);
+        write_stat(path, pid, "process", pid % 100, pid);
+        for (j = 0; j < num_threads; j++)
+            make_thread(pid, pid + j, pid + j);
+    }
+}
+
+static void remove_root(void) {
+    char path[256];
+    DIR *task_dir;
+    struct dirent *de;
+    int i, pid;
+
+    for (i = 0; i < num_procs; i++) {
+        pid = 1000 + i * num_threads * 2;
+        snprintf(path, sizeof(path), "%s/%d/task", root, pid);
+        task_dir = opendir(path);
+        while (task_dir && (de = readdir(task_dir)))
+            if (isdigit(de->d_name[0]))
+                remove_thread(pid, atoi(de->d_name));
+        if (task_dir)
+            closedir(task_dir);
+        rmdir(path);
+        snprintf(path, sizeof(path), "%s/%d/cmdline", root, pid);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/%d/status", root, pid);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/%d/stat", root, pid);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/%d", root, pid);
+        rmdir(path);
+    }
+    rmdir(root);
+}
+
+/*
+ * Between updates, replace one thread in every tenth process with a new one
+ * and rename every twentieth process.
+ */
+static void churn(int update) {
+    int i, pid, old_tid, new_tid;
+
+    for (i = 0; i < num_procs; i += 10) {
+        pid = 1000 + i * num_threads * 2;
+        old_tid = pid + 1 + (update - 1) % (num_threads - 1);
+        new_tid = pid + num_threads + 1 + (update - 1) % (num_threads - 1);
+        if (update > num_threads - 1)
+            break;
+        remove_thread(pid, old_tid);
+        make_thread(pid, new_tid, 100000 + update);
+    }
+    for (i = 0; i < num_procs; i += 20)
+        rename_process(1000 + i * num_threads * 2, update);
+}
+
+/* top -t's sampling before procstat, with the same files and structures. */
+
+#define MAX_LINE 256
+
+struct proc_info {
+    pid_t pid, tid;
+    uid_t uid;
+    gid_t gid;
+    char name[64];
+    char tname[32];
+    char state;
+    unsigned long utime, stime, delta_time;
+    long vss, rss;
+};
+
+static struct proc_info **old_procs, **new_procs;
+static int num_old_procs, num_new_procs, num_found;
+
+static void old_read_stat(char *filename, struct proc_info *proc) {
+    FILE *file;
+    char buf[MAX_LINE], *open_paren, *close_paren;
+
+    file = fopen(filename, "r");
+    if (!file) return;
+    fgets(buf, MAX_LINE, file);
+    fclose(file);
+    open_paren = strchr(buf, '(');
+    close_paren = strrchr(buf, ')');
+    if (!open_paren || !close_paren) return;
+    *open_paren = *close_paren = '\0';
+    strncpy(proc->tname, open_paren + 1, sizeof(proc->tname));
+    proc->tname[sizeof(proc->tname) - 1] = 0;
+    sscanf(close_paren + 1, " %c %*d %*d %*d %*d %*d %*d %*d %*d %*d %*d "
+           "%lu %lu %*d %*d %*d %*d %*d %*d %*d %lu %ld",
+           &proc->state, &proc->utime, &proc->stime, &proc->vss, &proc->rss);
+}
+
+static void old_read_procs(void) {
+    DIR *proc_dir, *task_dir;
+    struct dirent *pid_dir, *tid_dir;
+    char filename[PATH_MAX], line[MAX_LINE];
+    struct proc_info cur_proc, *proc;
+    unsigned int uid, gid;
+    FILE *file;
+    int n, i;
+
+    proc_dir = opendir(root);
+    new_procs = calloc(num_procs * num_threads + 16, sizeof(new_procs[0]));
+    n = 0;
+    while ((pid_dir = readdir(proc_dir))) {
+        if (!isdigit(pid_dir->d_name[0]))
+            continue;
+        snprintf(filename, sizeof(filename), "%s/%s/cmdline", root, pid_dir->d_name);
+        line[0] = 0;
+        if ((file = fopen(filename, "r"))) {
+            fgets(line, MAX_LINE, file);
+            fclose(file);
+        }
+        strncpy(cur_proc.name, line, sizeof(cur_proc.name));
+        cur_proc.name[sizeof(cur_proc.name) - 1] = 0;
+        snprintf(filename, sizeof(filename), "%s/%s/status", root, pid_dir->d_name);
+        uid = gid = 0;
+        if ((file = fopen(filename, "r"))) {
+            while (fgets(line, MAX_LINE, file)) {
+                sscanf(line, "Uid: %u", &uid);
+                sscanf(line, "Gid: %u", &gid);
+            }
+            fclose(file);
+        }
+
+        snprintf(filename, sizeof(filename), "%s/%s/task", root, pid_dir->d_name);
+        task_dir = opendir(filename);
+        if (!task_dir) continue;
+        while ((tid_dir = readdir(task_dir))) {
+            if (!isdigit(tid_dir->d_name[0]))
+                continue;
+            proc = malloc(sizeof(*proc));
+            proc->pid = atoi(pid_dir->d_name);
+            proc->tid = atoi(tid_dir->d_name);
+            snprintf(filename, sizeof(filename), "%s/%s/task/%s/stat", root,
+                     pid_dir->d_name, tid_dir->d_name);
+            old_read_stat(filename, proc);
+            strcpy(proc->name, cur_proc.name);
+            proc->uid = uid;
+            proc->gid = gid;
+            new_procs[n++] = proc;
+        }
+        closedir(task_dir);
+    }
+    closedir(proc_dir);
+    num_new_procs = n;
+
+    /* find_old_proc */
+    num_found = 0;
+    for (n = 0; n < num_new_procs; n++) {
+        proc = new_procs[n];
+        proc->delta_time = 0;
+        for (i = 0; i < num_old_procs; i++) {
+            if (old_procs[i]->pid == proc->pid && old_procs[i]->tid == proc->tid) {
+                proc->delta_time = (proc->utime - old_procs[i]->utime)
+                                 + (proc->stime - old_procs[i]->stime);
+                num_found++;
+                break;
+            }
+        }
+    }
+}
+
+static void old_free_procs(void) {
+    int i;
+
+    for (i = 0; i < num_old_procs; i++)
+        free(old_procs[i]);
+    free(old_procs);
+}
+
+int main(int argc, char *argv[]) {
+    struct procstat ps;
+    double start, old_time, new_time;
+    unsigned long old_sum, new_sum;
+    size_t num_entries, i;
+    int updates, update, new_found;
+
+    num_procs = argc > 1 ? atoi(argv[1]) : 100;
+    num_threads = argc > 2 ? atoi(argv[2]) : 20;
+    updates = argc > 3 ? atoi(argv[3]) : 10;
+    if (num_procs < 1 || num_threads < 2 || updates < 1)
+        die("usage: %s [ processes [ threads [ updates ] ] ]\n", argv[0]);
+
+    make_root();
+    if (procstat_init(&ps, root, PROCSTAT_THREADS))
+        die("procstat_init: %s\n", strerror(errno));
+
+    printf("%d processes of %d threads, %d updates\n", num_procs, num_threads, updates);
+
+    old_time = new_time = 0;
+    num_old_procs = 0;
+    old_procs = NULL;
+    old_read_procs();
+    if (procstat_update(&ps))
+        die("procstat_update: %s\n", strerror(errno));
+    for (update = 1; update <= updates; update++) {
+        churn(update);
+
+        old_procs = new_procs;
+        num_old_procs = num_new_procs;
+        start = now();
+        old_read_procs();
+        old_free_procs();
+        old_time += now() - start;
+
+        start = now();
+        if (procstat_update(&ps))
+            die("procstat_update: %s\n", strerror(errno));
+        new_time += now() - start;
+
+        /* both must see the same threads, and find the same ones again */
+        old_sum = new_sum = 0;
+        for (i = 0; i < (size_t)num_new_procs; i++)
+            old_sum += new_procs[i]->utime + new_procs[i]->delta_time;
+        num_entries = 0;
+        new_found = 0;
+        for (i = 0; i < ps.num_entries; i++) {
+            if (!ps.entries[i]->tid)
+                continue;
+            num_entries++;
+            new_sum += ps.entries[i]->utime;
+            if (ps.entries[i]->has_prev) {
+                new_sum += (ps.entries[i]->utime - ps.entries[i]->prev_utime)
+                         + (ps.entries[i]->stime - ps.entries[i]->prev_stime);
+                new_found++;
+            }
+        }
+        if (num_entries != (size_t)num_new_procs || new_found != num_found ||
+            old_sum != new_sum)
+            die("update %d: %d threads, %d found again, summing %lu before; "
+                "%u, %d, %lu with procstat\n", update, num_new_procs, num_found, old_sum,
+                (unsigned)num_entries, new_found, new_sum);
+    }
+
+    printf("before:   %8.3f ms per update\n", old_time * 1000 / updates);
+    printf("procstat: %8.3f ms per update (%d files kept open)\n", new_time * 1000 / updates,
+           ps.num_fds);
+
+    old_procs = new_procs;
+    num_old_procs = num_new_procs;
+    old_free_procs();
+    procstat_destroy(&ps);
+    remove_root();
+    return 0;
+}
@@ -29,8 +29,6 @@
  * SUCH DAMAGE.
  */
 
-#include <ctype.h>
-#include <dirent.h>
 #include <grp.h>
 #include <pwd.h>
 #include <stdio.h>
@@ -41,63 +39,27 @@
 
 #include <cutils/sched_policy.h>
 
+#include "procstat.h"
+
 struct cpu_info {
     long unsigned utime, ntime, stime, itime;
     long unsigned iowtime, irqtime, sirqtime;
 };
 
-#define PROC_NAME_LEN 64
-#define THREAD_NAME_LEN 32
-
-struct proc_info {
-    struct proc_info *next;
-    pid_t pid;
-    pid_t tid;
-    uid_t uid;
-    gid_t gid;
-    char name[PROC_NAME_LEN];
-    char tname[THREAD_NAME_LEN];
-    char state;
-    long unsigned utime;
-    long unsigned stime;
-    long unsigned delta_utime;
-    long unsigned delta_stime;
-    long unsigned delta_time;
-    long vss;
-    long rss;
-    int num_threads;
-    char policy[32];
-};
-
-struct proc_list {
-    struct proc_info **array;
-    int size;
-};
-
 #define die(...) { fprintf(stderr, __VA_ARGS__); exit(EXIT_FAILURE); }
 
-#define INIT_PROCS 50
-#define THREAD_MULT 8
-static struct proc_info **old_procs, **new_procs;
-static int num_old_procs, num_new_procs;
-static struct proc_info *free_procs;
-static int num_used_procs, num_free_procs;
+static struct procstat procstat;
+static struct procstat_entry **procs;
+static int num_procs, procs_size;
 
 static int max_procs, delay, iterations, threads;
 
 static struct cpu_info old_cpu, new_cpu;
 
-static struct proc_info *alloc_proc(void);
-static void free_proc(struct proc_info *proc);
 static void read_procs(void);
-static int read_stat(char *filename, struct proc_info *proc);
-static void read_policy(int pid, struct proc_info *proc);
-static void add_proc(int proc_num, struct proc_info *proc);
-static int read_cmdline(char *filename, struct proc_info *proc);
-static int read_status(char *filename, struct proc_info *proc);
+static void read_policy(int pid, char *policy);
 static void print_procs(void);
-static struct proc_info *find_old_proc(pid_t pid, pid_t tid);
-static void free_old_procs(void);
+static long unsigned delta_time(struct procstat_entry *proc);
 static int (*proc_cmp)(const void *a, const void *b);
 static int proc_cpu_cmp(const void *a, const void *b);
 static int proc_vss_cmp(const void *a, const void *b);
@@ -109,8 +71,6 @@ static void usage(char *cmd);
 int top_main(int argc, char *argv[]) {
     int i;
 
-    num_used_procs = num_free_procs = 0;
-
     max_procs = 0;
     delay = 3;
     iterations = -1;
@@ -172,68 +132,23 @@ int top_main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    free_procs = NULL;
-
-    num_new_procs = num_old_procs = 0;
-    new_procs = old_procs = NULL;
+    if (procstat_init(&procstat, "/proc", threads ? PROCSTAT_THREADS : 0))
+        die("Could not open /proc.\n");
 
     read_procs();
     while ((iterations == -1) || (iterations-- > 0)) {
-        old_procs = new_procs;
-        num_old_procs = num_new_procs;
         memcpy(&old_cpu, &new_cpu, sizeof(old_cpu));
         sleep(delay);
         read_procs();
         print_procs();
-        free_old_procs();
     }
 
     return 0;
 }
 
-static struct proc_info *alloc_proc(void) {
-    struct proc_info *proc;
-
-    if (free_procs) {
-        proc = free_procs;
-        free_procs = free_procs->next;
-        num_free_procs--;
-    } else {
-        proc = malloc(sizeof(*proc));
-        if (!proc) die("Could not allocate struct process_info.\n");
-    }
-
-    num_used_procs++;
-
-    return proc;
-}
-
-static void free_proc(struct proc_info *proc) {
-    proc->next = free_procs;
-    free_procs = proc;
-
-    num_used_procs--;
-    num_free_procs++;
-}
-
-#define MAX_LINE 256
-
 static void read_procs(void) {
-    DIR *proc_dir, *task_dir;
-    struct dirent *pid_dir, *tid_dir;
-    char filename[64];
     FILE *file;
-    int proc_num;
-    struct proc_info *proc;
-    pid_t pid, tid;
-
-    int i;
-
-    proc_dir = opendir("/proc");
-    if (!proc_dir) die("Could not open /proc.\n");
-
-    new_procs = calloc(INIT_PROCS * (threads ? THREAD_MULT : 1), sizeof(struct proc_info *));
-    num_new_procs = INIT_PROCS * (threads ? THREAD_MULT : 1);
+    size_t i;
 
     file = fopen("/proc/stat", "r");
     if (!file) die("Could not open /proc/stat.\n");
@@ -241,200 +156,52 @@ static void read_procs(void) {
             &new_cpu.itime, &new_cpu.iowtime, &new_cpu.irqtime, &new_cpu.sirqtime);
     fclose(file);
 
-    proc_num = 0;
-    while ((pid_dir = readdir(proc_dir))) {
-        if (!isdigit(pid_dir->d_name[0]))
-            continue;
-
-        pid = atoi(pid_dir->d_name);
-        
-        struct proc_info cur_proc;
-        
-        if (!threads) {
-            proc = alloc_proc();
-
-            proc->pid = proc->tid = pid;
-
-            sprintf(filename, "/proc/%d/stat", pid);
-            read_stat(filename, proc);
-
-            sprintf(filename, "/proc/%d/cmdline", pid);
-            read_cmdline(filename, proc);
-
-            sprintf(filename, "/proc/%d/status", pid);
-            read_status(filename, proc);
-
-            read_policy(pid, proc);
-
-            proc->num_threads = 0;
-        } else {
-            sprintf(filename, "/proc/%d/cmdline", pid);
-            read_cmdline(filename, &cur_proc);
-
-            sprintf(filename, "/proc/%d/status", pid);
-            read_status(filename, &cur_proc);
-            
-            proc = NULL;
-        }
-
-        sprintf(filename, "/proc/%d/task", pid);
-        task_dir = opendir(filename);
-        if (!task_dir) continue;
-
-        while ((tid_dir = readdir(task_dir))) {
-            if (!isdigit(tid_dir->d_name[0]))
-                continue;
-
-            if (threads) {
-                tid = atoi(tid_dir->d_name);
-
-                proc = alloc_proc();
-
-                proc->pid = pid; proc->tid = tid;
-
-                sprintf(filename, "/proc/%d/task/%d/stat", pid, tid);
-                read_stat(filename, proc);
-
-                read_policy(tid, proc);
-
-                strcpy(proc->name, cur_proc.name);
-                proc->uid = cur_proc.uid;
-                proc->gid = cur_proc.gid;
-
-                add_proc(proc_num++, proc);
-            } else {
-                proc->num_threads++;
-            }
-        }
-
-        closedir(task_dir);
-        
-        if (!threads)
-            add_proc(proc_num++, proc);
-    }
-
-    for (i = proc_num; i < num_new_procs; i++)
-        new_procs[i] = NULL;
-
-    closedir(proc_dir);
-}
-
-static int read_stat(char *filename, struct proc_info *proc) {
-    FILE *file;
-    char buf[MAX_LINE], *open_paren, *close_paren;
-    int res, idx;
-
-    file = fopen(filename, "r");
-    if (!file) return 1;
-    fgets(buf, MAX_LINE, file);
-    fclose(file);
-
-    /* Split at first '(' and last ')' to get process name. */
-    open_paren = strchr(buf, '(');
-    close_paren = strrchr(buf, ')');
-    if (!open_paren || !close_paren) return 1;
-
-    *open_paren = *close_paren = '\0';
-    strncpy(proc->tname, open_paren + 1, THREAD_NAME_LEN);
-    proc->tname[THREAD_NAME_LEN-1] = 0;
-    
-    /* Scan rest of string. */
-    sscanf(close_paren + 1, " %c %*d %*d %*d %*d %*d %*d %*d %*d %*d %*d "
-                 "%lu %lu %*d %*d %*d %*d %*d %*d %*d %lu %ld",
-                 &proc->state, &proc->utime, &proc->stime, &proc->vss, &proc->rss);
+    if (procstat_update(&procstat))
+        die("Could not read processes.\n");
 
-    return 0;
-}
-
-static void add_proc(int proc_num, struct proc_info *proc) {
-    int i;
-
-    if (proc_num >= num_new_procs) {
-        new_procs = realloc(new_procs, 2 * num_new_procs * sizeof(struct proc_info *));
-        if (!new_procs) die("Could not expand procs array.\n");
-        for (i = num_new_procs; i < 2 * num_new_procs; i++)
-            new_procs[i] = NULL;
-        num_new_procs = 2 * num_new_procs;
+    if ((int)procstat.num_entries > procs_size) {
+        procs_size = procstat.num_entries;
+        procs = realloc(procs, procs_size * sizeof(procs[0]));
+        if (!procs) die("Could not expand procs array.\n");
     }
-    new_procs[proc_num] = proc;
-}
 
-static int read_cmdline(char *filename, struct proc_info *proc) {
-    FILE *file;
-    char line[MAX_LINE];
-
-    line[0] = '\0';
-    file = fopen(filename, "r");
-    if (!file) return 1;
-    fgets(line, MAX_LINE, file);
-    fclose(file);
-    if (strlen(line) > 0) {
-        strncpy(proc->name, line, PROC_NAME_LEN);
-        proc->name[PROC_NAME_LEN-1] = 0;
-    } else
-        proc->name[0] = 0;
-    return 0;
+    /* with -t, the threads rather than the processes */
+    num_procs = 0;
+    for (i = 0; i < procstat.num_entries; i++)
+        if (!procstat.entries[i]->tid == !threads)
+            procs[num_procs++] = procstat.entries[i];
 }
 
-static void read_policy(int pid, struct proc_info *proc) {
+static void read_policy(int pid, char *policy) {
     SchedPolicy p;
     if (get_sched_policy(pid, &p) < 0)
-        strcpy(proc->policy, "unk");
+        strcpy(policy, "unk");
     else {
         if (p == SP_BACKGROUND)
-            strcpy(proc->policy, "bg");
+            strcpy(policy, "bg");
         else if (p == SP_FOREGROUND)
-            strcpy(proc->policy, "fg");
+            strcpy(policy, "fg");
         else
-            strcpy(proc->policy, "er");
-    }
-}
-
-static int read_status(char *filename, struct proc_info *proc) {
-    FILE *file;
-    char line[MAX_LINE];
-    unsigned int uid, gid;
-
-    file = fopen(filename, "r");
-    if (!file) return 1;
-    while (fgets(line, MAX_LINE, file)) {
-        sscanf(line, "Uid: %u", &uid);
-        sscanf(line, "Gid: %u", &gid);
+            strcpy(policy, "er");
     }
-    fclose(file);
-    proc->uid = uid; proc->gid = gid;
-    return 0;
 }
 
 static void print_procs(void) {
     int i;
-    struct proc_info *old_proc, *proc;
+    struct procstat_entry *proc;
     long unsigned total_delta_time;
     struct passwd *user;
     struct group *group;
     char *user_str, user_buf[20];
     char *group_str, group_buf[20];
-
-    for (i = 0; i < num_new_procs; i++) {
-        if (new_procs[i]) {
-            old_proc = find_old_proc(new_procs[i]->pid, new_procs[i]->tid);
-            if (old_proc) {
-                new_procs[i]->delta_utime = new_procs[i]->utime - old_proc->utime;
-                new_procs[i]->delta_stime = new_procs[i]->stime - old_proc->stime;
-            } else {
-                new_procs[i]->delta_utime = 0;
-                new_procs[i]->delta_stime = 0;
-            }
-            new_procs[i]->delta_time = new_procs[i]->delta_utime + new_procs[i]->delta_stime;
-        }
-    }
+    char policy[32];
 
     total_delta_time = (new_cpu.utime + new_cpu.ntime + new_cpu.stime + new_cpu.itime
                         + new_cpu.iowtime + new_cpu.irqtime + new_cpu.sirqtime)
                      - (old_cpu.utime + old_cpu.ntime + old_cpu.stime + old_cpu.itime
                         + old_cpu.iowtime + old_cpu.irqtime + old_cpu.sirqtime);
 
-    qsort(new_procs, num_new_procs, sizeof(struct proc_info *), proc_cmp);
+    qsort(procs, num_procs, sizeof(procs[0]), proc_cmp);
 
     printf("\n\n\n");
     printf("User %ld%%, System %ld%%, IOW %ld%%, IRQ %ld%%\n",
@@ -458,98 +225,71 @@ static void print_procs(void) {
     else
         printf("%5s %5s %4s %1s %7s %7s %3s %-8s %-15s %s\n", "PID", "TID", "CPU%", "S", "VSS", "RSS", "PCY", "UID", "Thread", "Proc");
 
-    for (i = 0; i < num_new_procs; i++) {
-        proc = new_procs[i];
+    for (i = 0; i < num_procs; i++) {
+        proc = procs[i];
 
-        if (!proc || (max_procs && (i >= max_procs)))
+        if (max_procs && (i >= max_procs))
             break;
-        user  = getpwuid(proc->uid);
-        group = getgrgid(proc->gid);
+        /* only for what is shown, as it opens a file per task */
+        read_policy(proc->tid ? proc->tid : proc->pid, policy);
+        user  = getpwuid(proc->process->uid);
+        group = getgrgid(proc->process->gid);
         if (user && user->pw_name) {
             user_str = user->pw_name;
         } else {
-            snprintf(user_buf, 20, "%d", proc->uid);
+            snprintf(user_buf, 20, "%d", proc->process->uid);
             user_str = user_buf;
         }
         if (group && group->gr_name) {
             group_str = group->gr_name;
         } else {
-            snprintf(group_buf, 20, "%d", proc->gid);
+            snprintf(group_buf, 20, "%d", proc->process->gid);
             group_str = group_buf;
         }
         if (!threads) 
-            printf("%5d %3ld%% %c %5d %6ldK %6ldK %3s %-8.8s %s\n", proc->pid, proc->delta_time * 100 / total_delta_time, proc->state, proc->num_threads,
-                proc->vss / 1024, proc->rss * getpagesize() / 1024, proc->policy, user_str, proc->name[0] != 0 ? proc->name : proc->tname);
+            printf("%5d %3ld%% %c %5ld %6ldK %6ldK %3s %-8.8s %s\n", proc->pid, delta_time(proc) * 100 / total_delta_time, proc->state, proc->num_threads,
+                proc->vss / 1024, proc->rss * getpagesize() / 1024, policy, user_str, proc->cmdline[0] != 0 ? proc->cmdline : proc->comm);
         else
-            printf("%5d %5d %3ld%% %c %6ldK %6ldK %3s %-8.8s %-15s %s\n", proc->pid, proc->tid, proc->delta_time * 100 / total_delta_time, proc->state,
-                proc->vss / 1024, proc->rss * getpagesize() / 1024, proc->policy, user_str, proc->tname, proc->name);
+            printf("%5d %5d %3ld%% %c %6ldK %6ldK %3s %-8.8s %-15s %s\n", proc->pid, proc->tid, delta_time(proc) * 100 / total_delta_time, proc->state,
+                proc->vss / 1024, proc->rss * getpagesize() / 1024, policy, user_str, proc->comm, proc->process->cmdline);
     }
 }
 
-static struct proc_info *find_old_proc(pid_t pid, pid_t tid) {
-    int i;
-
-    for (i = 0; i < num_old_procs; i++)
-        if (old_procs[i] && (old_procs[i]->pid == pid) && (old_procs[i]->tid == tid))
-            return old_procs[i];
-
-    return NULL;
-}
-
-static void free_old_procs(void) {
-    int i;
-
-    for (i = 0; i < num_old_procs; i++)
-        if (old_procs[i])
-            free_proc(old_procs[i]);
-
-    free(old_procs);
+/* Ticks used since the last update, or 0 for a task new since then. */
+static long unsigned delta_time(struct procstat_entry *proc) {
+    if (!proc->has_prev)
+        return 0;
+    return (proc->utime - proc->prev_utime) + (proc->stime - proc->prev_stime);
 }
 
 static int proc_cpu_cmp(const void *a, const void *b) {
-    struct proc_info *pa, *pb;
-
-    pa = *((struct proc_info **)a); pb = *((struct proc_info **)b);
+    struct procstat_entry *pa, *pb;
 
-    if (!pa && !pb) return 0;
-    if (!pa) return 1;
-    if (!pb) return -1;
+    pa = *((struct procstat_entry **)a); pb = *((struct procstat_entry **)b);
 
-    return -numcmp(pa->delta_time, pb->delta_time);
+    return -numcmp(delta_time(pa), delta_time(pb));
 }
 
 static int proc_vss_cmp(const void *a, const void *b) {
-    struct proc_info *pa, *pb;
-
-    pa = *((struct proc_info **)a); pb = *((struct proc_info **)b);
+    struct procstat_entry *pa, *pb;
 
-    if (!pa && !pb) return 0;
-    if (!pa) return 1;
-    if (!pb) return -1;
+    pa = *((struct procstat_entry **)a); pb = *((struct procstat_entry **)b);
 
     return -numcmp(pa->vss, pb->vss);
 }
 
 static int proc_rss_cmp(const void *a, const void *b) {
-    struct proc_info *pa, *pb;
+    struct procstat_entry *pa, *pb;
 
-    pa = *((struct proc_info **)a); pb = *((struct proc_info **)b);
-
-    if (!pa && !pb) return 0;
-    if (!pa) return 1;
-    if (!pb) return -1;
+    pa = *((struct procstat_entry **)a); pb = *((struct procstat_entry **)b);
 
     return -numcmp(pa->rss, pb->rss);
 }
 
 static int proc_thr_cmp(const void *a, const void *b) {
-    struct proc_info *pa, *pb;
-
-    pa = *((struct proc_info **)a); pb = *((struct proc_info **)b);
+    struct procstat_entry *pa, *pb;
 
-    if (!pa && !pb) return 0;
-    if (!pa) return 1;
-    if (!pb) return -1;
+    pa = *((struct procstat_entry **)a); pb = *((struct procstat_entry **)b);
 
     return -numcmp(pa->num_threads, pb->num_threads);
 }
@@ -40,6 +40,8 @@ typedef struct pm_kernel   pm_kernel_t;
 typedef struct pm_process  pm_process_t;
 typedef struct pm_map      pm_map_t;
 
+typedef struct pm_kernel_cache pm_kernel_cache_t;
+
 /* pm_kernel_t holds the state necessary to interface to the kernel's pagemap
  * system on a global level. */
 struct pm_kernel {
@@ -47,6 +49,14 @@ struct pm_kernel {
     int kpageflags_fd;
 
     int pagesize;
+
+    /* Directory read in place of /proc, for testing against synthetic files. */
+    char *proc_root;
+
+    /* What has been read of kpagecount and kpageflags so far, shared by all
+     * the processes of this pm_kernel_t. Private to pm_kernel.c. */
+    pm_kernel_cache_t *count_cache;
+    pm_kernel_cache_t *flags_cache;
 };
 
 /* pm_process_t holds the state necessary to interface to a particular process'
@@ -78,6 +88,10 @@ struct pm_map {
 /* Create a pm_kernel_t. */
 int pm_kernel_create(pm_kernel_t **ker_out);
 
+/* Create a pm_kernel_t that reads kpagecount, kpageflags and the per-process
+ * files (<pid>/maps, <pid>/pagemap, ...) from proc_root instead of /proc. */
+int pm_kernel_create_root(const char *proc_root, pm_kernel_t **ker_out);
+
 #define pm_kernel_pagesize(ker) ((ker)->pagesize)
 
 /* Get a list of probably-existing PIDs (returned through *pids_out).
@@ -86,13 +100,29 @@ int pm_kernel_create(pm_kernel_t **ker_out);
 int pm_kernel_pids(pm_kernel_t *ker, pid_t **pids_out, size_t *len);
 
 /* Get the map count (from /proc/kpagecount) of a physical frame.
- * The count is returned through *count_out. */
+ * The count is returned through *count_out.
+ * kpagecount is read in aligned blocks of PFNs and each block is read only
+ * once per pm_kernel_t, so counts are as of the first lookup in the block. */
 int pm_kernel_count(pm_kernel_t *ker, unsigned long pfn, uint64_t *count_out);
 
 /* Get the page flags (from /proc/kpageflags) of a physical frame.
- * The count is returned through *flags_out. */
+ * The count is returned through *flags_out. Cached like pm_kernel_count. */
 int pm_kernel_flags(pm_kernel_t *ker, unsigned long pfn, uint64_t *flags_out);
 
+/* Read all of kpagecount at once, so later counts cost no system calls.
+ * Takes 8 bytes per physical frame; worth it when most processes are
+ * examined, as by procrank and librank.
+ * Lookups in a snapshot only read memory, so once counts (and flags, if they
+ * are needed) are snapshotted, threads may share the pm_kernel_t, each with
+ * its own pm_process_t. Without a snapshot a pm_kernel_t is not thread-safe. */
+int pm_kernel_snapshot(pm_kernel_t *ker);
+
+/* Read all of kpageflags at once, like pm_kernel_snapshot. */
+int pm_kernel_snapshot_flags(pm_kernel_t *ker);
+
+/* Forget the cached counts and flags, so the next lookups read them again. */
+void pm_kernel_flush(pm_kernel_t *ker);
+
 #define PM_PAGE_LOCKED     (1 <<  0)
 #define PM_PAGE_ERROR      (1 <<  1)
 #define PM_PAGE_REFERENCED (1 <<  2)
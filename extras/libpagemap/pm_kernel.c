@@ -18,44 +18,121 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <pagemap/pagemap.h>
 
+/* kpagecount and kpageflags are read in aligned blocks of this many PFNs, one
+ * pread per block, and each block is kept for the life of the pm_kernel_t. */
+#define CACHE_BLOCK 512
+#define INIT_BUCKETS 256
+/* pm_kernel_snapshot reads kpagecount in pieces of at least this many PFNs. */
+#define SNAPSHOT_READ (64 * 1024)
+
+typedef struct pm_kernel_block pm_kernel_block_t;
+
+struct pm_kernel_block {
+    pm_kernel_block_t *next;
+    unsigned long index; /* first PFN / CACHE_BLOCK */
+    size_t len;          /* number of PFNs the file has in this block */
+    uint64_t data[CACHE_BLOCK];
+};
+
+struct pm_kernel_cache {
+    int fd;
+
+    pm_kernel_block_t **buckets;
+    size_t num_buckets;
+    size_t num_blocks;
+    /* PFNs of neighboring pages are usually consecutive, so most lookups are
+     * in the block of the previous one. */
+    pm_kernel_block_t *last;
+
+    /* The whole file, once pm_kernel_snapshot has been called. */
+    uint64_t *snapshot;
+    size_t snapshot_len;
+};
+
+static int cache_create(int fd, pm_kernel_cache_t **cache_out);
+static void cache_flush(pm_kernel_cache_t *cache);
+static void cache_destroy(pm_kernel_cache_t *cache);
+static int cache_lookup(pm_kernel_cache_t *cache, unsigned long pfn,
+                        uint64_t *value_out);
+static int cache_snapshot(pm_kernel_cache_t *cache);
+
+#define MAX_FILENAME 256
+
 int pm_kernel_create(pm_kernel_t **ker_out) {
+    return pm_kernel_create_root("/proc", ker_out);
+}
+
+int pm_kernel_create_root(const char *proc_root, pm_kernel_t **ker_out) {
     pm_kernel_t *ker;
+    char filename[MAX_FILENAME];
     int error;
 
-    if (!ker_out)
+    if (!proc_root || !ker_out)
         return 1;
     
     ker = calloc(1, sizeof(*ker));
     if (!ker)
         return errno;
 
-    ker->kpagecount_fd = open("/proc/kpagecount", O_RDONLY);
-    if (ker->kpagecount_fd < 0) {
+    ker->proc_root = strdup(proc_root);
+    if (!ker->proc_root) {
         error = errno;
         free(ker);
         return error;
     }
 
-    ker->kpageflags_fd = open("/proc/kpageflags", O_RDONLY);
+    error = snprintf(filename, MAX_FILENAME, "%s/kpagecount", proc_root);
+    if (error < 0 || error >= MAX_FILENAME) {
+        error = (error < 0) ? (errno) : (-1);
+        goto err_root;
+    }
+    ker->kpagecount_fd = open(filename, O_RDONLY);
+    if (ker->kpagecount_fd < 0) {
+        error = errno;
+        goto err_root;
+    }
+
+    error = snprintf(filename, MAX_FILENAME, "%s/kpageflags", proc_root);
+    if (error < 0 || error >= MAX_FILENAME) {
+        error = (error < 0) ? (errno) : (-1);
+        goto err_count;
+    }
+    ker->kpageflags_fd = open(filename, O_RDONLY);
     if (ker->kpageflags_fd < 0) {
         error = errno;
-        close(ker->kpagecount_fd);
-        free(ker);
-        return error;
+        goto err_count;
     }
 
+    error = cache_create(ker->kpagecount_fd, &ker->count_cache);
+    if (error) goto err_flags;
+    error = cache_create(ker->kpageflags_fd, &ker->flags_cache);
+    if (error) goto err_count_cache;
+
     ker->pagesize = getpagesize();
 
     *ker_out = ker;
 
     return 0;
+
+err_count_cache:
+    cache_destroy(ker->count_cache);
+err_flags:
+    close(ker->kpageflags_fd);
+err_count:
+    close(ker->kpagecount_fd);
+err_root:
+    free(ker->proc_root);
+    free(ker);
+    return error;
 }
 
 #define INIT_PIDS 20
@@ -66,7 +143,7 @@ int pm_kernel_pids(pm_kernel_t *ker, pid_t **pids_out, size_t *len) {
     size_t pids_count, pids_size;
     int error;
 
-    proc = opendir("/proc");
+    proc = opendir(ker->proc_root);
     if (!proc)
         return errno;
 
@@ -114,45 +191,228 @@ int pm_kernel_pids(pm_kernel_t *ker, pid_t **pids_out, size_t *len) {
 }
 
 int pm_kernel_count(pm_kernel_t *ker, unsigned long pfn, uint64_t *count_out) {
-    off_t off;
-
     if (!ker || !count_out)
         return -1;
 
-    off = lseek(ker->kpagecount_fd, pfn * sizeof(uint64_t), SEEK_SET);
-    if (off == (off_t)-1)
-        return errno;
-    if (read(ker->kpagecount_fd, count_out, sizeof(uint64_t)) <
-        (ssize_t)sizeof(uint64_t))
-        return errno;
-
-    return 0;
+    return cache_lookup(ker->count_cache, pfn, count_out);
 }
 
 int pm_kernel_flags(pm_kernel_t *ker, unsigned long pfn, uint64_t *flags_out) {
-    off_t off;
-
     if (!ker || !flags_out)
         return -1;
 
-    off = lseek(ker->kpageflags_fd, pfn * sizeof(uint64_t), SEEK_SET);
-    if (off == (off_t)-1)
-        return errno;
-    if (read(ker->kpageflags_fd, flags_out, sizeof(uint64_t)) <
-        (ssize_t)sizeof(uint64_t))
-        return errno;
+    return cache_lookup(ker->flags_cache, pfn, flags_out);
+}
 
-    return 0;
+int pm_kernel_snapshot(pm_kernel_t *ker) {
+    if (!ker)
+        return -1;
+
+    return cache_snapshot(ker->count_cache);
+}
+
+int pm_kernel_snapshot_flags(pm_kernel_t *ker) {
+    if (!ker)
+        return -1;
+
+    return cache_snapshot(ker->flags_cache);
+}
+
+void pm_kernel_flush(pm_kernel_t *ker) {
+    if (!ker)
+        return;
+
+    cache_flush(ker->count_cache);
+    cache_flush(ker->flags_cache);
 }
 
 int pm_kernel_destroy(pm_kernel_t *ker) {
     if (!ker)
         return -1;
 
+    cache_destroy(ker->count_cache);
+    cache_destroy(ker->flags_cache);
+
     close(ker->kpagecount_fd);
     close(ker->kpageflags_fd);
 
+    free(ker->proc_root);
     free(ker);
 
     return 0;
 }
+
+static int cache_create(int fd, pm_kernel_cache_t **cache_out) {
+    pm_kernel_cache_t *cache;
+    int error;
+
+    cache = calloc(1, sizeof(*cache));
+    if (!cache)
+        return errno;
+
+    cache->buckets = calloc(INIT_BUCKETS, sizeof(pm_kernel_block_t*));
+    if (!cache->buckets) {
+        error = errno;
+        free(cache);
+        return error;
+    }
+    cache->num_buckets = INIT_BUCKETS;
+    cache->fd = fd;
+
+    *cache_out = cache;
+
+    return 0;
+}
+
+static void cache_flush(pm_kernel_cache_t *cache) {
+    pm_kernel_block_t *block, *next;
+    size_t i;
+
+    for (i = 0; i < cache->num_buckets; i++) {
+        for (block = cache->buckets[i]; block; block = next) {
+            next = block->next;
+            free(block);
+        }
+        cache->buckets[i] = NULL;
+    }
+    cache->num_blocks = 0;
+    cache->last = NULL;
+
+    free(cache->snapshot);
+    cache->snapshot = NULL;
+    cache->snapshot_len = 0;
+}
+
+static void cache_destroy(pm_kernel_cache_t *cache) {
+    cache_flush(cache);
+    free(cache->buckets);
+    free(cache);
+}
+
+/* Double the hash table, keeping the load factor at most one block per bucket.
+ * Failure to grow only makes the chains longer. */
+static void cache_grow(pm_kernel_cache_t *cache) {
+    pm_kernel_block_t **buckets, *block, *next;
+    size_t num_buckets, i;
+
+    num_buckets = 2 * cache->num_buckets;
+    buckets = calloc(num_buckets, sizeof(pm_kernel_block_t*));
+    if (!buckets)
+        return;
+
+    for (i = 0; i < cache->num_buckets; i++) {
+        for (block = cache->buckets[i]; block; block = next) {
+            next = block->next;
+            block->next = buckets[block->index & (num_buckets - 1)];
+            buckets[block->index & (num_buckets - 1)] = block;
+        }
+    }
+
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->num_buckets = num_buckets;
+}
+
+static int cache_lookup(pm_kernel_cache_t *cache, unsigned long pfn,
+                        uint64_t *value_out) {
+    unsigned long index;
+    pm_kernel_block_t *block;
+    ssize_t bytes;
+
+    if (cache->snapshot) {
+        if (pfn >= cache->snapshot_len)
+            return -1;
+        *value_out = cache->snapshot[pfn];
+        return 0;
+    }
+
+    index = pfn / CACHE_BLOCK;
+    block = cache->last;
+    if (!block || block->index != index) {
+        for (block = cache->buckets[index & (cache->num_buckets - 1)];
+             block; block = block->next) {
+            if (block->index == index)
+                break;
+        }
+
+        if (!block) {
+            block = malloc(sizeof(*block));
+            if (!block)
+                return errno;
+
+            bytes = pread(cache->fd, block->data, sizeof(block->data),
+                          (off_t)index * sizeof(block->data));
+            if (bytes < 0) {
+                free(block);
+                return errno;
+            }
+            block->index = index;
+            block->len = bytes / sizeof(uint64_t);
+
+            if (cache->num_blocks >= cache->num_buckets)
+                cache_grow(cache);
+            block->next = cache->buckets[index & (cache->num_buckets - 1)];
+            cache->buckets[index & (cache->num_buckets - 1)] = block;
+            cache->num_blocks++;
+        }
+
+        cache->last = block;
+    }
+
+    /* past the end of the file */
+    if (pfn % CACHE_BLOCK >= block->len)
+        return -1;
+
+    *value_out = block->data[pfn % CACHE_BLOCK];
+
+    return 0;
+}
+
+static int cache_snapshot(pm_kernel_cache_t *cache) {
+    uint64_t *data, *new_data;
+    size_t len, size;
+    ssize_t bytes;
+    int error;
+
+    data = NULL;
+    len = size = 0;
+
+    /* The file size is not known in advance, so read until the end. */
+    for (;;) {
+        if (size - len < SNAPSHOT_READ) {
+            size = size ? 2 * size : SNAPSHOT_READ;
+            new_data = realloc(data, size * sizeof(uint64_t));
+            if (!new_data) {
+                error = errno;
+                free(data);
+                return error;
+            }
+            data = new_data;
+        }
+
+        bytes = pread(cache->fd, data + len, (size - len) * sizeof(uint64_t),
+                      (off_t)len * sizeof(uint64_t));
+        if (bytes < 0) {
+            error = errno;
+            free(data);
+            return error;
+        }
+        if (bytes < (ssize_t)sizeof(uint64_t))
+            break;
+
+        len += bytes / sizeof(uint64_t);
+    }
+
+    /* give back what the doubling over-allocated */
+    if (len) {
+        new_data = realloc(data, len * sizeof(uint64_t));
+        if (new_data)
+            data = new_data;
+    }
+
+    cache_flush(cache);
+    cache->snapshot = data;
+    cache->snapshot_len = len;
+
+    return 0;
+}
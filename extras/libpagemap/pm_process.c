@@ -27,7 +27,7 @@
 
 static int read_maps(pm_process_t *proc);
 
-#define MAX_FILENAME 64
+#define MAX_FILENAME 256
 
 int pm_process_create(pm_kernel_t *ker, pid_t pid, pm_process_t **proc_out) {
     pm_process_t *proc;
@@ -44,7 +44,7 @@ int pm_process_create(pm_kernel_t *ker, pid_t pid, pm_process_t **proc_out) {
     proc->ker = ker;
     proc->pid = pid;
 
-    error = snprintf(filename, MAX_FILENAME, "/proc/%d/pagemap", pid);
+    error = snprintf(filename, MAX_FILENAME, "%s/%d/pagemap", ker->proc_root, pid);
     if (error < 0 || error >= MAX_FILENAME) {
         error = (error < 0) ? (errno) : (-1);
         free(proc);
@@ -94,9 +94,9 @@ int pm_process_usage(pm_process_t *proc, pm_memusage_t *usage_out) {
 int pm_process_pagemap_range(pm_process_t *proc,
                              unsigned long low, unsigned long high,
                              uint64_t **range_out, size_t *len) {
-    int firstpage, numpages;
+    unsigned long firstpage, numpages;
     uint64_t *range;
-    off_t off;
+    ssize_t bytes;
     int error;
 
     if (!proc || (low >= high) || !range_out || !len)
@@ -109,15 +109,10 @@ int pm_process_pagemap_range(pm_process_t *proc,
     if (!range)
         return errno;
 
-    off = lseek(proc->pagemap_fd, firstpage * sizeof(uint64_t), SEEK_SET);
-    if (off == (off_t)-1) {
-        error = errno;
-        free(range);
-        return error;
-    }
-    error = read(proc->pagemap_fd, (char*)range, numpages * sizeof(uint64_t));
-    if (error < numpages * sizeof(uint64_t)) {
-        error = (error < 0) ? errno : -1;
+    bytes = pread(proc->pagemap_fd, range, numpages * sizeof(uint64_t),
+                  (off_t)firstpage * sizeof(uint64_t));
+    if (bytes < (ssize_t)(numpages * sizeof(uint64_t))) {
+        error = (bytes < 0) ? errno : -1;
         free(range);
         return error;
     }
@@ -174,8 +169,8 @@ int pm_process_workingset(pm_process_t *proc,
     }
 
     if (reset) {
-        error = snprintf(filename, MAX_FILENAME, "/proc/%d/clear_refs",
-                         proc->pid);
+        error = snprintf(filename, MAX_FILENAME, "%s/%d/clear_refs",
+                         proc->ker->proc_root, proc->pid);
         if (error < 0 || error >= MAX_FILENAME) {
             return (error < 0) ? (errno) : (-1);
         }
@@ -187,6 +182,9 @@ int pm_process_workingset(pm_process_t *proc,
         write(fd, "1\n", strlen("1\n"));
 
         close(fd);
+
+        /* the referenced flags just changed */
+        pm_kernel_flush(proc->ker);
     }
 
     return 0;
@@ -230,7 +228,8 @@ static int read_maps(pm_process_t *proc) {
         return errno;
     maps_count = 0; maps_size = INITIAL_MAPS;
 
-    error = snprintf(filename, MAX_FILENAME, "/proc/%d/maps", proc->pid);
+    error = snprintf(filename, MAX_FILENAME, "%s/%d/maps", proc->ker->proc_root,
+                     proc->pid);
     if (error < 0 || error >= MAX_FILENAME)
         return (error < 0) ? (errno) : (-1);
 
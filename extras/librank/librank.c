@@ -17,6 +17,7 @@
 #include <assert.h>
 #include <dirent.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
@@ -45,8 +46,44 @@ struct library_info {
     pm_memusage_t total_usage;
 };
 
+/* What a worker found in one process, for the main thread to merge. */
+struct process_scan {
+    pid_t pid;
+    pm_process_t *proc;
+    struct process_info *pi;
+    pm_map_t **maps;
+    size_t num_maps;
+    pm_memusage_t *usages;  /* one per map */
+    int error;
+    size_t error_map;       /* the map whose usage could not be read */
+};
+
+#define SCAN_OK         0
+#define SCAN_NO_PROCESS 1
+#define SCAN_NO_MAPS    2
+#define SCAN_NO_USAGE   3
+
+/* The processes to examine, shared by the workers. */
+struct scan {
+    pm_kernel_t *ker;
+    struct process_scan *procs;
+    size_t num_procs;
+    char *prefix;
+    size_t prefix_len;
+    volatile size_t next;   /* next process for a worker to take */
+};
+
+#define FORMAT_TABLE 0
+#define FORMAT_CSV   1
+#define FORMAT_JSON  2
+
+#define MAX_WORKERS 64
+
 static void usage(char *myname);
+static void *scan_processes(void *arg);
 static int getprocname(pid_t pid, char *buf, size_t len);
+static void print_csv_string(const char *s);
+static void print_json_string(const char *s);
 static int numcmp(long long a, long long b);
 static int licmp(const void *a, const void *b);
 
@@ -69,13 +106,28 @@ struct library_info **libraries;
 int libraries_count;
 int libraries_size;
 
-struct library_info *get_library(char *name) {
+static int is_blacklisted(const char *name) {
     int i;
-    struct library_info *library;
 
     for (i = 0; library_name_blacklist[i]; i++)
         if (!strcmp(name, library_name_blacklist[i]))
-            return NULL;
+            return 1;
+    return 0;
+}
+
+/* Whether a map is one of the libraries to be listed. */
+static int is_wanted(struct scan *scan, const char *name) {
+    if (scan->prefix && strncmp(name, scan->prefix, scan->prefix_len))
+        return 0;
+    return !is_blacklisted(name);
+}
+
+struct library_info *get_library(char *name) {
+    int i;
+    struct library_info *library;
+
+    if (is_blacklisted(name))
+        return NULL;
 
     for (i = 0; i < libraries_count; i++) {
         if (!strcmp(libraries[i]->name, name))
@@ -169,14 +221,17 @@ int main(int argc, char *argv[]) {
     int (*compfn)(const void *a, const void *b);
 
     pm_kernel_t *ker;
-    pm_process_t *proc;
 
     pid_t *pids;
     size_t num_procs;
 
-    pm_map_t **maps;
-    size_t num_maps;
-    pm_memusage_t map_usage;
+    struct scan scan;
+    struct process_scan *ps;
+    int format;
+    int workers;
+    pthread_t threads[MAX_WORKERS];
+    int num_threads;
+    int first_library, first_mapping;
 
     struct library_info *li, **lis;
     struct mapping_info *mi, **mis;
@@ -188,8 +243,32 @@ int main(int argc, char *argv[]) {
     order = -1;
     prefix = NULL;
     prefix_len = 0;
+    format = FORMAT_TABLE;
+    workers = 0;
 
     for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-j")) {
+            if (i + 1 >= argc || (workers = atoi(argv[++i])) < 1 || workers > MAX_WORKERS) {
+                fprintf(stderr, "Option -j requires a number of workers from 1 to %d.\n",
+                        MAX_WORKERS);
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            continue;
+        }
+        if (!strcmp(argv[i], "-o")) {
+            if (i + 1 < argc && !strcmp(argv[i + 1], "csv")) {
+                format = FORMAT_CSV;
+            } else if (i + 1 < argc && !strcmp(argv[i + 1], "json")) {
+                format = FORMAT_JSON;
+            } else {
+                fprintf(stderr, "Option -o requires csv or json.\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            i++;
+            continue;
+        }
         if (!strcmp(argv[i], "-P")) {
             if (i + 1 >= argc) {
                 fprintf(stderr, "Option -P requires an argument.\n");
@@ -221,62 +300,150 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
+    /*
+     * Workers share the kernel interface, which is only safe once kpagecount
+     * has been read at once; reading it at once also makes every process's
+     * PSS come from the same instant.
+     */
+    if (workers) {
+        error = pm_kernel_snapshot(ker);
+        if (error) {
+            fprintf(stderr, "Error reading kpagecount: %s\n",
+                    strerror(error > 0 ? error : EINVAL));
+            exit(EXIT_FAILURE);
+        }
+    }
+
     error = pm_kernel_pids(ker, &pids, &num_procs);
     if (error) {
         fprintf(stderr, "Error listing processes.\n");
         exit(EXIT_FAILURE);
     }
 
+    scan.procs = calloc(num_procs, sizeof(scan.procs[0]));
+    if (num_procs && !scan.procs) {
+        fprintf(stderr, "Couldn't allocate space for process scans: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < num_procs; i++)
+        scan.procs[i].pid = pids[i];
+    free(pids);
+
+    scan.ker = ker;
+    scan.num_procs = num_procs;
+    scan.prefix = prefix;
+    scan.prefix_len = prefix_len;
+    scan.next = 0;
+
+    /* this thread is one of the workers */
+    num_threads = 0;
+    while (num_threads < workers - 1 &&
+           !pthread_create(&threads[num_threads], NULL, scan_processes, &scan))
+        num_threads++;
+    scan_processes(&scan);
+    while (num_threads > 0)
+        pthread_join(threads[--num_threads], NULL);
+
+    /* merge in process order, as if the processes had been examined one by one */
     for (i = 0; i < num_procs; i++) {
-        error = pm_process_create(ker, pids[i], &proc);
-        if (error) {
-            fprintf(stderr, "warning: could not create process interface for %d\n", pids[i]);
+        ps = &scan.procs[i];
+        if (ps->error == SCAN_NO_PROCESS) {
+            fprintf(stderr, "warning: could not create process interface for %d\n", ps->pid);
             continue;
         }
-        
-        pi = get_process(pids[i]);
-
-        error = pm_process_maps(proc, &maps, &num_maps);
-        if (error) {
-            fprintf(stderr, "Error listing maps for process %d.\n", proc->pid);
+        if (ps->error == SCAN_NO_MAPS) {
+            fprintf(stderr, "Error listing maps for process %d.\n", ps->pid);
             exit(EXIT_FAILURE);
         }
 
-        for (j = 0; j < num_maps; j++) {
-            if (prefix && (strncmp(pm_map_name(maps[j]), prefix, prefix_len)))
-                continue;
+        pi = ps->pi;
 
-            li = get_library(pm_map_name(maps[j]));
-            if (!li)
-                continue;
-
-            mi = get_mapping(li, pi);
-            
-            error = pm_map_usage(maps[j], &map_usage);
-            if (error) {
+        for (j = 0; j < ps->num_maps; j++) {
+            if (ps->error == SCAN_NO_USAGE && j == ps->error_map) {
                 fprintf(stderr, "Error getting map memory usage of "
                                 "map %s in process %d.\n",
-                        pm_map_name(maps[j]), proc->pid);
+                        pm_map_name(ps->maps[j]), ps->pid);
                 exit(EXIT_FAILURE);
             }
-            pm_memusage_add(&mi->usage, &map_usage);
-            pm_memusage_add(&li->total_usage, &map_usage);
+
+            if (!is_wanted(&scan, pm_map_name(ps->maps[j])))
+                continue;
+
+            li = get_library(pm_map_name(ps->maps[j]));
+            mi = get_mapping(li, pi);
+
+            pm_memusage_add(&mi->usage, &ps->usages[j]);
+            pm_memusage_add(&li->total_usage, &ps->usages[j]);
         }
-    }
 
-    printf(          " %6s   %6s   %6s   %6s   %6s  %s\n", "RSStot", "VSS", "RSS", "PSS", "USS", "Name/PID");
+        free(ps->usages);
+        pm_process_destroy(ps->proc);
+    }
+    free(scan.procs);
+
+    switch (format) {
+    case FORMAT_CSV:
+        printf("library,pid,cmdline,vss_kb,rss_kb,pss_kb,uss_kb\n");
+        break;
+    case FORMAT_JSON:
+        printf("[");
+        break;
+    default:
+        printf(          " %6s   %6s   %6s   %6s   %6s  %s\n", "RSStot", "VSS", "RSS", "PSS", "USS", "Name/PID");
+        break;
+    }
     fflush(stdout);
 
     qsort(libraries, libraries_count, sizeof(libraries[0]), &licmp);
 
+    first_library = 1;
     for (i = 0; i < libraries_count; i++) {
         li = libraries[i];
 
+        qsort(li->mappings, li->mappings_count, sizeof(li->mappings[0]), compfn);
+
+        if (format == FORMAT_CSV) {
+            for (j = 0; j < li->mappings_count; j++) {
+                mi = li->mappings[j];
+                pi = mi->proc;
+                print_csv_string(li->name);
+                printf(",%d,", pi->pid);
+                print_csv_string(pi->cmdline);
+                printf(",%zu,%zu,%zu,%zu\n",
+                    mi->usage.vss / 1024,
+                    mi->usage.rss / 1024,
+                    mi->usage.pss / 1024,
+                    mi->usage.uss / 1024);
+            }
+            continue;
+        }
+
+        if (format == FORMAT_JSON) {
+            printf("%s\n  {\"name\": ", first_library ? "" : ",");
+            print_json_string(li->name);
+            printf(", \"pss_kb\": %zu, \"processes\": [", li->total_usage.pss / 1024);
+            first_mapping = 1;
+            for (j = 0; j < li->mappings_count; j++) {
+                mi = li->mappings[j];
+                pi = mi->proc;
+                printf("%s\n    {\"pid\": %d, \"cmdline\": ", first_mapping ? "" : ",",
+                       pi->pid);
+                print_json_string(pi->cmdline);
+                printf(", \"vss_kb\": %zu, \"rss_kb\": %zu, \"pss_kb\": %zu, \"uss_kb\": %zu}",
+                    mi->usage.vss / 1024,
+                    mi->usage.rss / 1024,
+                    mi->usage.pss / 1024,
+                    mi->usage.uss / 1024);
+                first_mapping = 0;
+            }
+            printf("%s]}", first_mapping ? "" : "\n  ");
+            first_library = 0;
+            continue;
+        }
+
         printf("%6dK   %6s   %6s   %6s   %6s  %s\n", li->total_usage.pss / 1024, "", "", "", "", li->name);
         fflush(stdout);
 
-        qsort(li->mappings, li->mappings_count, sizeof(li->mappings[0]), compfn);
-
         for (j = 0; j < li->mappings_count; j++) {
             mi = li->mappings[j];
             pi = mi->proc;
@@ -292,11 +459,59 @@ int main(int argc, char *argv[]) {
         fflush(stdout);
     }
 
+    if (format == FORMAT_JSON)
+        printf("%s]\n", first_library ? "" : "\n");
+
     return 0;
 }
 
+/*
+ * Worker: take processes from the scan until there are none left, reading
+ * the usage of each map that will be listed.  Errors are recorded for the
+ * main thread to report, in order.
+ */
+static void *scan_processes(void *arg) {
+    struct scan *scan = arg;
+    struct process_scan *ps;
+    size_t i, j;
+
+    while ((i = __sync_fetch_and_add(&scan->next, 1)) < scan->num_procs) {
+        ps = &scan->procs[i];
+
+        if (pm_process_create(scan->ker, ps->pid, &ps->proc)) {
+            ps->error = SCAN_NO_PROCESS;
+            continue;
+        }
+
+        ps->pi = get_process(ps->pid);
+
+        if (pm_process_maps(ps->proc, &ps->maps, &ps->num_maps)) {
+            ps->error = SCAN_NO_MAPS;
+            continue;
+        }
+
+        ps->usages = calloc(ps->num_maps, sizeof(ps->usages[0]));
+        if (ps->num_maps && !ps->usages) {
+            fprintf(stderr, "Couldn't allocate space for map usage: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        for (j = 0; j < ps->num_maps; j++) {
+            if (!is_wanted(scan, pm_map_name(ps->maps[j])))
+                continue;
+            if (pm_map_usage(ps->maps[j], &ps->usages[j])) {
+                ps->error = SCAN_NO_USAGE;
+                ps->error_map = j;
+                break;
+            }
+        }
+    }
+
+    return NULL;
+}
+
 static void usage(char *myname) {
-    fprintf(stderr, "Usage: %s [ -P | -L ] [ -v | -r | -p | -u | -h ]\n"
+    fprintf(stderr, "Usage: %s [ -P | -L ] [ -v | -r | -p | -u | -h ] [ -j N ] [ -o csv|json ]\n"
                     "\n"
                     "Sort options:\n"
                     "    -v  Sort processes by VSS.\n"
@@ -306,6 +521,9 @@ static void usage(char *myname) {
                     "        (Default sort order is PSS.)\n"
                     "    -P /path  Limit libraries displayed to those in path.\n"
                     "    -R  Reverse sort order (default is descending).\n"
+                    "    -j N  Examine processes with N workers, reading all of\n"
+                    "          kpagecount first.\n"
+                    "    -o csv|json  Print in a machine-readable format.\n"
                     "    -h  Display this help screen.\n",
     myname);
 }
@@ -322,6 +540,35 @@ static int getprocname(pid_t pid, char *buf, size_t len) {
     return 0;
 }
 
+/* Print a CSV field, quoted if it contains a separator or a quote. */
+static void print_csv_string(const char *s) {
+    if (!strpbrk(s, ",\"\n")) {
+        fputs(s, stdout);
+        return;
+    }
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"')
+            putchar('"');
+        putchar(*s);
+    }
+    putchar('"');
+}
+
+/* Print a JSON string literal. */
+static void print_json_string(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            printf("\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            printf("\\u%04x", (unsigned char)*s);
+        else
+            putchar(*s);
+    }
+    putchar('"');
+}
+
 static int numcmp(long long a, long long b) {
     if (a < b) return -1;
     if (a > b) return 1;
@@ -16,7 +16,9 @@
 
 #include <dirent.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -28,8 +30,30 @@ struct proc_info {
     unsigned long wss;
 };
 
+#define WS_OFF   0
+#define WS_ONLY  1
+#define WS_RESET 2
+
+/* The processes to examine, shared by the workers. */
+struct scan {
+    pm_kernel_t *ker;
+    struct proc_info **procs;
+    size_t num_procs;
+    int ws;
+    volatile size_t next; /* next process for a worker to take */
+};
+
+#define FORMAT_TABLE 0
+#define FORMAT_CSV   1
+#define FORMAT_JSON  2
+
+#define MAX_WORKERS 64
+
 static void usage(char *myname);
+static void *scan_procs(void *arg);
 static int getprocname(pid_t pid, char *buf, int len);
+static void print_csv_string(const char *s);
+static void print_json_string(const char *s);
 static int numcmp(long long a, long long b);
 
 #define declare_sort(field) \
@@ -45,17 +69,18 @@ static int order;
 
 int main(int argc, char *argv[]) {
     pm_kernel_t *ker;
-    pm_process_t *proc;
     pid_t *pids;
     struct proc_info **procs;
     size_t num_procs;
     char cmdline[256]; // this must be within the range of int
     int error;
-
-    #define WS_OFF   0
-    #define WS_ONLY  1
-    #define WS_RESET 2
     int ws;
+    int format;
+    int workers;
+    pthread_t threads[MAX_WORKERS];
+    int num_threads;
+    struct scan scan;
+    int first;
 
     int arg;
     size_t i, j;
@@ -63,8 +88,33 @@ int main(int argc, char *argv[]) {
     compfn = &sort_by_pss;
     order = -1;
     ws = WS_OFF;
+    format = FORMAT_TABLE;
+    workers = 0;
 
     for (arg = 1; arg < argc; arg++) {
+        if (!strcmp(argv[arg], "-j")) {
+            if (arg + 1 >= argc || (workers = atoi(argv[++arg])) < 1 ||
+                workers > MAX_WORKERS) {
+                fprintf(stderr, "Option -j requires a number of workers from 1 to %d.\n",
+                        MAX_WORKERS);
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            continue;
+        }
+        if (!strcmp(argv[arg], "-o")) {
+            if (arg + 1 < argc && !strcmp(argv[arg + 1], "csv")) {
+                format = FORMAT_CSV;
+            } else if (arg + 1 < argc && !strcmp(argv[arg + 1], "json")) {
+                format = FORMAT_JSON;
+            } else {
+                fprintf(stderr, "Option -o requires csv or json.\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            arg++;
+            continue;
+        }
         if (!strcmp(argv[arg], "-v")) { compfn = &sort_by_vss; continue; }
         if (!strcmp(argv[arg], "-r")) { compfn = &sort_by_rss; continue; }
         if (!strcmp(argv[arg], "-p")) { compfn = &sort_by_pss; continue; }
@@ -85,6 +135,22 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
+    /*
+     * Workers share the kernel interface, which is only safe once what they
+     * look up has been read at once; reading it at once also makes every
+     * process's PSS come from the same instant.
+     */
+    if (workers && ws != WS_RESET) {
+        error = pm_kernel_snapshot(ker);
+        if (!error && ws == WS_ONLY)
+            error = pm_kernel_snapshot_flags(ker);
+        if (error) {
+            fprintf(stderr, "Error reading kpagecount or kpageflags: %s\n",
+                    strerror(error > 0 ? error : EINVAL));
+            exit(EXIT_FAILURE);
+        }
+    }
+
     error = pm_kernel_pids(ker, &pids, &num_procs);
     if (error) {
         fprintf(stderr, "Error listing processes.\n");
@@ -104,28 +170,28 @@ int main(int argc, char *argv[]) {
             exit(EXIT_FAILURE);
         }
         procs[i]->pid = pids[i];
-        error = pm_process_create(ker, pids[i], &proc);
-        if (!error) {
-            switch (ws) {
-            case WS_OFF:
-                pm_process_usage(proc, &procs[i]->usage);
-                break;
-            case WS_ONLY:
-                pm_process_workingset(proc, &procs[i]->usage, 0);
-                break;
-            case WS_RESET:
-                pm_process_workingset(proc, NULL, 1);
-                break;
-            }
-            pm_process_destroy(proc);
-        } else {
-            fprintf(stderr, "warning: could not create process interface for %d\n", pids[i]);
-            pm_memusage_zero(&procs[i]->usage);
-        }
+        pm_memusage_zero(&procs[i]->usage);
     }
 
     free(pids);
 
+    scan.ker = ker;
+    scan.procs = procs;
+    scan.num_procs = num_procs;
+    scan.ws = ws;
+    scan.next = 0;
+
+    /* this thread is one of the workers; resetting is cheap, so not shared */
+    num_threads = 0;
+    if (ws != WS_RESET) {
+        while (num_threads < workers - 1 &&
+               !pthread_create(&threads[num_threads], NULL, scan_procs, &scan))
+            num_threads++;
+    }
+    scan_procs(&scan);
+    while (num_threads > 0)
+        pthread_join(threads[--num_threads], NULL);
+
     if (ws == WS_RESET) exit(0);
 
     j = 0;
@@ -140,11 +206,25 @@ int main(int argc, char *argv[]) {
 
     qsort(procs, num_procs, sizeof(procs[0]), compfn);
 
-    if (ws)
-        printf("%5s  %7s  %7s  %7s  %s\n", "PID", "WRss", "WPss", "WUss", "cmdline");
-    else
-        printf("%5s  %7s  %7s  %7s  %7s  %s\n", "PID", "Vss", "Rss", "Pss", "Uss", "cmdline");
+    switch (format) {
+    case FORMAT_CSV:
+        if (ws)
+            printf("pid,wrss_kb,wpss_kb,wuss_kb,cmdline\n");
+        else
+            printf("pid,vss_kb,rss_kb,pss_kb,uss_kb,cmdline\n");
+        break;
+    case FORMAT_JSON:
+        printf("[");
+        break;
+    default:
+        if (ws)
+            printf("%5s  %7s  %7s  %7s  %s\n", "PID", "WRss", "WPss", "WUss", "cmdline");
+        else
+            printf("%5s  %7s  %7s  %7s  %7s  %s\n", "PID", "Vss", "Rss", "Pss", "Uss", "cmdline");
+        break;
+    }
 
+    first = 1;
     for (i = 0; i < num_procs; i++) {
         if (getprocname(procs[i]->pid, cmdline, (int)sizeof(cmdline)) < 0) {
             /*
@@ -155,7 +235,33 @@ int main(int argc, char *argv[]) {
             continue;
         }
 
-        if (ws)
+        if (format == FORMAT_CSV) {
+            printf("%d,", procs[i]->pid);
+            if (!ws)
+                printf("%zu,", procs[i]->usage.vss / 1024);
+            printf("%zu,%zu,%zu,",
+                procs[i]->usage.rss / 1024,
+                procs[i]->usage.pss / 1024,
+                procs[i]->usage.uss / 1024);
+            print_csv_string(cmdline);
+            printf("\n");
+        } else if (format == FORMAT_JSON) {
+            printf("%s\n  {\"pid\": %d, ", first ? "" : ",", procs[i]->pid);
+            if (ws)
+                printf("\"wrss_kb\": %zu, \"wpss_kb\": %zu, \"wuss_kb\": %zu, ",
+                    procs[i]->usage.rss / 1024,
+                    procs[i]->usage.pss / 1024,
+                    procs[i]->usage.uss / 1024);
+            else
+                printf("\"vss_kb\": %zu, \"rss_kb\": %zu, \"pss_kb\": %zu, \"uss_kb\": %zu, ",
+                    procs[i]->usage.vss / 1024,
+                    procs[i]->usage.rss / 1024,
+                    procs[i]->usage.pss / 1024,
+                    procs[i]->usage.uss / 1024);
+            printf("\"cmdline\": ");
+            print_json_string(cmdline);
+            printf("}");
+        } else if (ws)
             printf("%5d  %6dK  %6dK  %6dK  %s\n",
                 procs[i]->pid,
                 procs[i]->usage.rss / 1024,
@@ -174,14 +280,18 @@ int main(int argc, char *argv[]) {
             );
 
         free(procs[i]);
+        first = 0;
     }
 
+    if (format == FORMAT_JSON)
+        printf("%s]\n", first ? "" : "\n");
+
     free(procs);
     return 0;
 }
 
 static void usage(char *myname) {
-    fprintf(stderr, "Usage: %s [ -W ] [ -v | -r | -p | -u | -h ]\n"
+    fprintf(stderr, "Usage: %s [ -W ] [ -v | -r | -p | -u | -h ] [ -j N ] [ -o csv|json ]\n"
                     "    -v  Sort by VSS.\n"
                     "    -r  Sort by RSS.\n"
                     "    -p  Sort by PSS.\n"
@@ -190,10 +300,47 @@ static void usage(char *myname) {
                     "    -R  Reverse sort order (default is descending).\n"
                     "    -w  Display statistics for working set only.\n"
                     "    -W  Reset working set of all processes.\n"
+                    "    -j N  Examine processes with N workers, reading all of\n"
+                    "          kpagecount (and kpageflags for -w) first.\n"
+                    "    -o csv|json  Print in a machine-readable format.\n"
                     "    -h  Display this help screen.\n",
     myname);
 }
 
+/*
+ * Worker: take processes from the scan until there are none left, storing
+ * each one's usage in its proc_info.
+ */
+static void *scan_procs(void *arg) {
+    struct scan *scan = arg;
+    pm_process_t *proc;
+    size_t i;
+    int error;
+
+    while ((i = __sync_fetch_and_add(&scan->next, 1)) < scan->num_procs) {
+        error = pm_process_create(scan->ker, scan->procs[i]->pid, &proc);
+        if (error) {
+            fprintf(stderr, "warning: could not create process interface for %d\n",
+                    scan->procs[i]->pid);
+            continue;
+        }
+        switch (scan->ws) {
+        case WS_OFF:
+            pm_process_usage(proc, &scan->procs[i]->usage);
+            break;
+        case WS_ONLY:
+            pm_process_workingset(proc, &scan->procs[i]->usage, 0);
+            break;
+        case WS_RESET:
+            pm_process_workingset(proc, NULL, 1);
+            break;
+        }
+        pm_process_destroy(proc);
+    }
+
+    return NULL;
+}
+
 /*
  * Get the process name for a given PID. Inserts the process name into buffer
  * buf of length len. The size of the buffer must be greater than zero to get
@@ -253,6 +400,35 @@ exit:
     return rc;
 }
 
+/* Print a CSV field, quoted if it contains a separator or a quote. */
+static void print_csv_string(const char *s) {
+    if (!strpbrk(s, ",\"\n")) {
+        fputs(s, stdout);
+        return;
+    }
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"')
+            putchar('"');
+        putchar(*s);
+    }
+    putchar('"');
+}
+
+/* Print a JSON string literal. */
+static void print_json_string(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            printf("\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            printf("\\u%04x", (unsigned char)*s);
+        else
+            putchar(*s);
+    }
+    putchar('"');
+}
+
 static int numcmp(long long a, long long b) {
     if (a < b) return -1;
     if (a > b) return 1;
@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Checks libpagemap against a synthetic /proc: kpagecount, kpageflags and
+ * the maps and pagemap of two processes are written to a temporary
+ * directory, and the usage and working set libpagemap computes from them are
+ * compared with the values computed here, with the block cache and with
+ * snapshots of kpagecount and kpageflags.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <pagemap/pagemap.h>
+
+#define NUM_PFNS 4096
+#define NUM_PROCS 2
+
+#define PAGEMAP_PRESENT (1ULL << 63)
+
+static const struct {
+    pid_t pid;
+    unsigned long start;
+    int pages;
+    unsigned long first_pfn;
+    int stride;
+} procs[NUM_PROCS] = {
+    /* scattered PFNs, every third page not present */
+    { 100, 0x10000000, 300, 1000, 7 },
+    /* a run across a block boundary */
+    { 200, 0x20000000, 100, 480, 1 },
+};
+
+static uint64_t counts[NUM_PFNS];
+static uint64_t flags[NUM_PFNS];
+static char root[] = "/data/local/tmp/pagemaptest.XXXXXX";
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static int present(int proc, int page) {
+    return procs[proc].stride == 1 || page % 3 != 2;
+}
+
+static unsigned long pfn_of(int proc, int page) {
+    return procs[proc].first_pfn + page * procs[proc].stride;
+}
+
+static void write_file(const char *name, const void *data, size_t len, off_t off) {
+    char path[256];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    fd = open(path, O_WRONLY | O_CREAT, 0600);
+    if (fd < 0 || pwrite(fd, data, len, off) != (ssize_t)len) {
+        fprintf(stderr, "write %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+}
+
+static void make_root(void) {
+    char name[64], line[128];
+    uint64_t pagemap[512];
+    int pagesize = getpagesize();
+    int i, j;
+
+    if (!mkdtemp(root)) {
+        strcpy(root, "/tmp/pagemaptest.XXXXXX");
+        if (!mkdtemp(root)) {
+            fprintf(stderr, "mkdtemp: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (i = 0; i < NUM_PFNS; i++) {
+        counts[i] = i % 4;
+        flags[i] = (i & 1) ? PM_PAGE_REFERENCED : 0;
+    }
+    write_file("kpagecount", counts, sizeof(counts), 0);
+    write_file("kpageflags", flags, sizeof(flags), 0);
+
+    for (i = 0; i < NUM_PROCS; i++) {
+        snprintf(name, sizeof(name), "%d", procs[i].pid);
+        snprintf(line, sizeof(line), "%s/%s", root, name);
+        mkdir(line, 0700);
+
+        snprintf(name, sizeof(name), "%d/maps", procs[i].pid);
+        snprintf(line, sizeof(line), "%08lx-%08lx rw-p 00000000 00:00 0          /synthetic\n",
+                 procs[i].start, procs[i].start + procs[i].pages * pagesize);
+        write_file(name, line, strlen(line), 0);
+
+        for (j = 0; j < procs[i].pages; j++)
+            pagemap[j] = present(i, j) ? (PAGEMAP_PRESENT | pfn_of(i, j)) : 0;
+        snprintf(name, sizeof(name), "%d/pagemap", procs[i].pid);
+        write_file(name, pagemap, procs[i].pages * sizeof(uint64_t),
+                   (procs[i].start / pagesize) * sizeof(uint64_t));
+    }
+}
+
+static void remove_root(void) {
+    char path[256];
+    int i;
+
+    for (i = 0; i < NUM_PROCS; i++) {
+        snprintf(path, sizeof(path), "%s/%d/maps", root, procs[i].pid);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/%d/pagemap", root, procs[i].pid);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/%d", root, procs[i].pid);
+        rmdir(path);
+    }
+    snprintf(path, sizeof(path), "%s/kpagecount", root);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/kpageflags", root);
+    unlink(path);
+    rmdir(root);
+}
+
+/* Usage as libpagemap defines it, from the arrays rather than the files. */
+static void expected_usage(int proc, int ws, pm_memusage_t *mu) {
+    int pagesize = getpagesize();
+    uint64_t count;
+    int i;
+
+    pm_memusage_zero(mu);
+    for (i = 0; i < procs[proc].pages; i++) {
+        if (!present(proc, i))
+            continue;
+        if (ws && !(flags[pfn_of(proc, i)] & PM_PAGE_REFERENCED))
+            continue;
+        count = counts[pfn_of(proc, i)];
+        mu->vss += pagesize;
+        mu->rss += (count >= 1) ? pagesize : 0;
+        mu->pss += (count >= 1) ? pagesize / count : 0;
+        mu->uss += (count == 1) ? pagesize : 0;
+    }
+}
+
+static void check_procs(pm_kernel_t *ker) {
+    pm_process_t *proc;
+    pm_memusage_t usage, expected;
+    int i;
+
+    for (i = 0; i < NUM_PROCS; i++) {
+        CHECK(pm_process_create(ker, procs[i].pid, &proc) == 0);
+
+        CHECK(pm_process_usage(proc, &usage) == 0);
+        expected_usage(i, 0, &expected);
+        CHECK(!memcmp(&usage, &expected, sizeof(usage)));
+
+        CHECK(pm_process_workingset(proc, &usage, 0) == 0);
+        expected_usage(i, 1, &expected);
+        CHECK(!memcmp(&usage, &expected, sizeof(usage)));
+
+        pm_process_destroy(proc);
+    }
+}
+
+int main(void) {
+    pm_kernel_t *ker;
+    pid_t *pids;
+    size_t num_pids, i;
+    uint64_t value, new_count;
+    int found;
+
+    make_root();
+
+    CHECK(pm_kernel_create_root(root, &ker) == 0);
+
+    CHECK(pm_kernel_pids(ker, &pids, &num_pids) == 0);
+    found = 0;
+    for (i = 0; i < num_pids; i++)
+        found += (pids[i] == procs[0].pid || pids[i] == procs[1].pid);
+    CHECK(found == NUM_PROCS);
+    free(pids);
+
+    /* with the block cache, twice to use what the first pass cached */
+    check_procs(ker);
+    check_procs(ker);
+
+    CHECK(pm_kernel_count(ker, NUM_PFNS - 1, &value) == 0 && value == counts[NUM_PFNS - 1]);
+    CHECK(pm_kernel_count(ker, NUM_PFNS, &value) != 0);
+    CHECK(pm_kernel_flags(ker, NUM_PFNS + 1000, &value) != 0);
+
+    /* counts are as of the first read until flushed */
+    new_count = 9;
+    write_file("kpagecount", &new_count, sizeof(new_count), 1000 * sizeof(uint64_t));
+    CHECK(pm_kernel_count(ker, 1000, &value) == 0 && value == counts[1000]);
+    pm_kernel_flush(ker);
+    CHECK(pm_kernel_count(ker, 1000, &value) == 0 && value == new_count);
+    counts[1000] = new_count;
+
+    /* with a snapshot of kpagecount */
+    CHECK(pm_kernel_snapshot(ker) == 0);
+    check_procs(ker);
+    CHECK(pm_kernel_count(ker, NUM_PFNS - 1, &value) == 0 && value == counts[NUM_PFNS - 1]);
+    CHECK(pm_kernel_count(ker, NUM_PFNS, &value) != 0);
+
+    /* and of kpageflags, as procrank -j -w takes them */
+    CHECK(pm_kernel_snapshot_flags(ker) == 0);
+    check_procs(ker);
+    CHECK(pm_kernel_flags(ker, NUM_PFNS - 1, &value) == 0 && value == flags[NUM_PFNS - 1]);
+    CHECK(pm_kernel_flags(ker, NUM_PFNS, &value) != 0);
+
+    pm_kernel_destroy(ker);
+
+    remove_root();
+
+    if (failures) {
+        printf("pagemaptest: %d checks FAILED\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("pagemaptest: all checks passed\n");
+    return EXIT_SUCCESS;
+}
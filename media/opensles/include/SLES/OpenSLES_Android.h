@@ -203,6 +203,53 @@ struct SLAndroidSimpleBufferQueueItf_ {
 };
 
 
+/*---------------------------------------------------------------------------*/
+/* Android Mix Statistics Interface                                          */
+/*---------------------------------------------------------------------------*/
+
+extern SLAPIENTRY const SLInterfaceID SL_IID_ANDROIDMIXSTATS;
+
+/** Number of buckets in the mix time histogram: bucket i counts the periods that took
+ *  [2^i, 2^(i+1)) microseconds to mix, the first bucket also counts shorter ones and the
+ *  last bucket also counts longer ones */
+#define SL_ANDROID_MIXSTATS_BUCKETS 16
+
+/** Mixer statistics of an output mix since creation or the last ResetStats; times are in
+ *  microseconds, and totals wrap around */
+
+typedef struct SLAndroidMixStats_ {
+	SLuint32	periods;
+	SLuint32	mixTimeHistogram[SL_ANDROID_MIXSTATS_BUCKETS];
+	SLuint32	totalMixTime;
+	SLuint32	maxMixTime;
+	SLuint32	underruns;
+	SLuint32	lockContentions;
+	SLuint32	totalLockWaitTime;
+	SLuint32	maxLockWaitTime;
+	SLuint32	threadPoolDepth;
+	SLuint32	maxThreadPoolDepth;
+	SLuint32	threadPoolCapacity;
+} SLAndroidMixStats;
+
+struct SLAndroidMixStatsItf_;
+typedef const struct SLAndroidMixStatsItf_ * const * SLAndroidMixStatsItf;
+
+struct SLAndroidMixStatsItf_ {
+	SLresult (*GetStats) (
+		SLAndroidMixStatsItf self,
+		SLAndroidMixStats *pStats
+	);
+	SLresult (*GetPlayerUnderruns) (
+		SLAndroidMixStatsItf self,
+		SLObjectItf player,
+		SLuint32 *pUnderruns
+	);
+	SLresult (*ResetStats) (
+		SLAndroidMixStatsItf self
+	);
+};
+
+
 /*---------------------------------------------------------------------------*/
 /* Android File Descriptor Data Locator                                      */
 /*---------------------------------------------------------------------------*/
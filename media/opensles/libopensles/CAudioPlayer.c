@@ -70,6 +70,10 @@ void CAudioPlayer_Destroy(void *self)
 
 bool CAudioPlayer_PreDestroy(void *self)
 {
+#ifdef USE_SNDFILE
+    // Stop decoding ahead before the track goes away
+    SndFile_PreDestroy((CAudioPlayer *) self);
+#endif
 #ifdef USE_OUTPUTMIXEXT
     CAudioPlayer *this = (CAudioPlayer *) self;
     // Safe to proceed immediately if a track has not yet been assigned
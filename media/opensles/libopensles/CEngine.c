@@ -35,7 +35,12 @@ SLresult CEngine_Realize(void *self, SLboolean async)
     // initialize the thread pool for asynchronous operations
     result = ThreadPool_init(&this->mEngine.mThreadPool, 0, 0);
     if (SL_RESULT_SUCCESS != result) {
+        object_lock_exclusive(&this->mObject);
         this->mEngine.mShutdown = SL_BOOLEAN_TRUE;
+#ifndef ANDROID
+        (void) pthread_cond_signal(&this->mEngine.mSyncCond);
+#endif
+        object_unlock_exclusive(&this->mObject);
         (void) pthread_join(this->mSyncThread, (void **) NULL);
         return result;
     }
@@ -80,8 +85,11 @@ void CEngine_Destroy(void *self)
     memset(&zero, 0, sizeof(pthread_t));
     if (0 != memcmp(&zero, &this->mSyncThread, sizeof(pthread_t))) {
 
-        // Announce to the sync thread that engine is shutting down; it polls so should see it soon
+        // Announce to the sync thread that engine is shutting down, and wake it up
         this->mEngine.mShutdown = SL_BOOLEAN_TRUE;
+#ifndef ANDROID
+        (void) pthread_cond_signal(&this->mEngine.mSyncCond);
+#endif
         // Wait for the sync thread to acknowledge the shutdown
         while (!this->mEngine.mShutdownAck) {
             object_cond_wait(&this->mObject);
@@ -30,6 +30,12 @@ static SLresult I3DCommit_Commit(SL3DCommitItf self)
         SLuint32 myGeneration = this->mGeneration;
         do {
             ++this->mWaiting;
+#ifndef ANDROID
+            // 3DCommit is only on the engine, so wake up the engine's own sync thread
+            int ok;
+            ok = pthread_cond_signal(&((CEngine *) thisObject)->mEngine.mSyncCond);
+            assert(0 == ok);
+#endif
             object_cond_wait(thisObject);
         } while (this->mGeneration == myGeneration);
     }
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* AndroidMixStats implementation */
+
+#include "sles_allinclusive.h"
+#ifndef ANDROID
+#include "SLES/OpenSLES_Android.h"
+#endif
+#include <time.h>
+
+#if MIXSTATS_BUCKETS != SL_ANDROID_MIXSTATS_BUCKETS
+#error MIXSTATS_BUCKETS must match SL_ANDROID_MIXSTATS_BUCKETS
+#endif
+
+
+/** \brief Return a monotonic time in microseconds, which wraps around after about 71 minutes */
+
+SLuint32 IAndroidMixStats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (SLuint32) ts.tv_sec * 1000000 + (SLuint32) (ts.tv_nsec / 1000);
+}
+
+
+/** \brief Record the time taken by one call to the mixer, with the output mix locked */
+
+void IAndroidMixStats_addMixTime(IAndroidMixStats *this, SLuint32 micros)
+{
+    unsigned bucket = 0 == micros ? 0 : 31 - __builtin_clz(micros);
+    if (MIXSTATS_BUCKETS <= bucket) {
+        bucket = MIXSTATS_BUCKETS - 1;
+    }
+    ++this->mHistogram[bucket];
+    ++this->mPeriods;
+    this->mTotalMixTime += micros;
+    if (micros > this->mMaxMixTime) {
+        this->mMaxMixTime = micros;
+    }
+}
+
+
+/** \brief Record a contended object lock, from any thread and without a lock */
+
+void LockStats_addWait(LockStats *stats, SLuint32 micros)
+{
+    __sync_fetch_and_add(&stats->mContentions, 1);
+    __sync_fetch_and_add(&stats->mTotalWait, micros);
+    SLuint32 maxWait;
+    while (micros > (maxWait = stats->mMaxWait)) {
+        if (maxWait == __sync_val_compare_and_swap(&stats->mMaxWait, maxWait, micros))
+            break;
+    }
+}
+
+
+static SLresult IAndroidMixStats_GetStats(SLAndroidMixStatsItf self, SLAndroidMixStats *pStats)
+{
+    SL_ENTER_INTERFACE
+
+    if (NULL == pStats) {
+        result = SL_RESULT_PARAMETER_INVALID;
+    } else {
+        IAndroidMixStats *this = (IAndroidMixStats *) self;
+        interface_lock_exclusive(this);
+        pStats->periods = this->mPeriods;
+        memcpy(pStats->mixTimeHistogram, this->mHistogram, sizeof(pStats->mixTimeHistogram));
+        pStats->totalMixTime = this->mTotalMixTime;
+        pStats->maxMixTime = this->mMaxMixTime;
+        pStats->underruns = this->mUnderruns;
+        interface_unlock_exclusive(this);
+        IEngine *thisEngine = this->mThis->mEngine;
+        pStats->lockContentions = thisEngine->mLockStats.mContentions;
+        pStats->totalLockWaitTime = thisEngine->mLockStats.mTotalWait;
+        pStats->maxLockWaitTime = thisEngine->mLockStats.mMaxWait;
+        ThreadPool *tp = &thisEngine->mThreadPool;
+        pStats->threadPoolDepth = ThreadPool_depth(tp);
+        pStats->maxThreadPoolDepth = tp->mMaxDepth;
+        pStats->threadPoolCapacity = tp->mMaxClosures;
+        result = SL_RESULT_SUCCESS;
+    }
+
+    SL_LEAVE_INTERFACE
+}
+
+
+static SLresult IAndroidMixStats_GetPlayerUnderruns(SLAndroidMixStatsItf self, SLObjectItf player,
+    SLuint32 *pUnderruns)
+{
+    SL_ENTER_INTERFACE
+
+    if (NULL == player || NULL == pUnderruns) {
+        result = SL_RESULT_PARAMETER_INVALID;
+    } else if (SL_OBJECTID_AUDIOPLAYER != IObjectToObjectID((IObject *) player)) {
+        result = SL_RESULT_PARAMETER_INVALID;
+    } else {
+#ifdef USE_OUTPUTMIXEXT
+        IAndroidMixStats *this = (IAndroidMixStats *) self;
+        COutputMix *outputMix = (COutputMix *) this->mThis;
+        const CAudioPlayer *audioPlayer = (const CAudioPlayer *) player;
+        // the per-track counters are updated by the mixer with the output mix locked
+        object_lock_exclusive(&outputMix->mObject);
+        result = SL_RESULT_PARAMETER_INVALID;
+        unsigned i;
+        for (i = 0; i < MAX_TRACK; ++i) {
+            const Track *track = &outputMix->mOutputMixExt.mTracks[i];
+            if (audioPlayer == track->mAudioPlayer) {
+                *pUnderruns = track->mUnderruns;
+                result = SL_RESULT_SUCCESS;
+                break;
+            }
+        }
+        object_unlock_exclusive(&outputMix->mObject);
+#else
+        // underruns of players that do not play through our own mixer are not visible here
+        result = SL_RESULT_FEATURE_UNSUPPORTED;
+#endif
+    }
+
+    SL_LEAVE_INTERFACE
+}
+
+
+static SLresult IAndroidMixStats_ResetStats(SLAndroidMixStatsItf self)
+{
+    SL_ENTER_INTERFACE
+
+    IAndroidMixStats *this = (IAndroidMixStats *) self;
+    COutputMix *outputMix = (COutputMix *) this->mThis;
+    object_lock_exclusive(&outputMix->mObject);
+    this->mPeriods = 0;
+    memset(this->mHistogram, 0, sizeof(this->mHistogram));
+    this->mTotalMixTime = 0;
+    this->mMaxMixTime = 0;
+    this->mUnderruns = 0;
+#ifdef USE_OUTPUTMIXEXT
+    unsigned i;
+    for (i = 0; i < MAX_TRACK; ++i) {
+        outputMix->mOutputMixExt.mTracks[i].mUnderruns = 0;
+    }
+#endif
+    object_unlock_exclusive(&outputMix->mObject);
+    // these are only approximately zero if other threads are busy
+    IEngine *thisEngine = this->mThis->mEngine;
+    thisEngine->mLockStats.mContentions = 0;
+    thisEngine->mLockStats.mTotalWait = 0;
+    thisEngine->mLockStats.mMaxWait = 0;
+    thisEngine->mThreadPool.mMaxDepth = 0;
+    result = SL_RESULT_SUCCESS;
+
+    SL_LEAVE_INTERFACE
+}
+
+
+static const struct SLAndroidMixStatsItf_ IAndroidMixStats_Itf = {
+    IAndroidMixStats_GetStats,
+    IAndroidMixStats_GetPlayerUnderruns,
+    IAndroidMixStats_ResetStats
+};
+
+void IAndroidMixStats_init(void *self)
+{
+    IAndroidMixStats *this = (IAndroidMixStats *) self;
+    this->mItf = &IAndroidMixStats_Itf;
+    this->mEnabled = SL_BOOLEAN_FALSE;
+    this->mPeriods = 0;
+    memset(this->mHistogram, 0, sizeof(this->mHistogram));
+    this->mTotalMixTime = 0;
+    this->mMaxMixTime = 0;
+    this->mUnderruns = 0;
+}
+
+/** \brief The statistics cost a little per period and per contended lock, so they are
+ *  collected only while the application has the interface. Lock contention is counted
+ *  engine-wide, for as long as any output mix of the engine exposes it.
+ */
+
+bool IAndroidMixStats_Expose(void *self)
+{
+    IAndroidMixStats *this = (IAndroidMixStats *) self;
+    if (!this->mEnabled) {
+        this->mEnabled = SL_BOOLEAN_TRUE;
+        // expose hooks run without the object lock, and each output mix has its own
+        __sync_fetch_and_add(&this->mThis->mEngine->mLockStats.mExposed, 1);
+    }
+    return true;
+}
+
+void IAndroidMixStats_Remove(void *self)
+{
+    IAndroidMixStats *this = (IAndroidMixStats *) self;
+    if (this->mEnabled) {
+        this->mEnabled = SL_BOOLEAN_FALSE;
+        __sync_fetch_and_sub(&this->mThis->mEngine->mLockStats.mExposed, 1);
+    }
+}
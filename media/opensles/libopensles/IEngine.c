@@ -151,9 +151,15 @@ static SLresult IEngine_CreateAudioPlayer(SLEngineItf self, SLObjectItf *pPlayer
                     this->mSndFile.mPathname = NULL;
                     this->mSndFile.mSNDFILE = NULL;
                     memset(&this->mSndFile.mSfInfo, 0, sizeof(SF_INFO));
+                    memset(&this->mSndFile.mDecodeMutex, 0, sizeof(pthread_mutex_t));
+                    this->mSndFile.mWhich = 0;
                     memset(&this->mSndFile.mMutex, 0, sizeof(pthread_mutex_t));
+                    memset(&this->mSndFile.mCond, 0, sizeof(pthread_cond_t));
                     this->mSndFile.mEOF = SL_BOOLEAN_FALSE;
-                    this->mSndFile.mWhich = 0;
+                    this->mSndFile.mShutdown = SL_BOOLEAN_FALSE;
+                    this->mSndFile.mDecodeRequests = 0;
+                    this->mSndFile.mUnderruns = 0;
+                    this->mSndFile.mReportedLevel = 0;
                     memset(this->mSndFile.mBuffer, 0, sizeof(this->mSndFile.mBuffer));
 #endif
 #ifdef ANDROID
@@ -851,8 +857,17 @@ void IEngine_init(void *self)
     }
     this->mShutdown = SL_BOOLEAN_FALSE;
     this->mShutdownAck = SL_BOOLEAN_FALSE;
+#ifndef ANDROID
+    int ok;
+    ok = pthread_cond_init(&this->mSyncCond, (const pthread_condattr_t *) NULL);
+    assert(0 == ok);
+#endif
     // mThreadPool is initialized in CEngine_Realize
     memset(&this->mThreadPool, 0, sizeof(ThreadPool));
+    this->mLockStats.mExposed = 0;
+    this->mLockStats.mContentions = 0;
+    this->mLockStats.mTotalWait = 0;
+    this->mLockStats.mMaxWait = 0;
 #if defined(ANDROID) && !defined(USE_BACKPORT)
     this->mEqNumPresets = 0;
     this->mEqPresetNames = NULL;
@@ -876,4 +891,10 @@ void IEngine_deinit(void *self)
     }
     this->mEqNumPresets = 0;
 #endif
+#ifndef ANDROID
+    IEngine *this = (IEngine *) self;
+    int ok;
+    ok = pthread_cond_destroy(&this->mSyncCond);
+    assert(0 == ok);
+#endif
 }
@@ -22,10 +22,10 @@
 
 #if !defined(ANDROID) || defined(USE_BACKPORT)
 static const struct EqualizerBand EqualizerBands[MAX_EQ_BANDS] = {
-    {1000, 1500, 2000},
-    {2000, 3000, 4000},
-    {4000, 5500, 7000},
-    {7000, 8000, 9000}
+    {60000, 120000, 250000},
+    {250000, 500000, 1000000},
+    {1000000, 2000000, 4000000},
+    {4000000, 8000000, 16000000}
 };
 
 static const struct EqualizerPreset {
@@ -483,14 +483,25 @@ void IEqualizer_init(void *self)
         this->mLevels[band] = 0;
 #endif
     // const fields
+#ifdef USE_OUTPUTMIXEXT
+    // the OutputMixExt mixer implements the bands in software
+    this->mNumPresets = MAX_EQ_PRESETS;
+    this->mNumBands = MAX_EQ_BANDS;
+#else
     this->mNumPresets = 0;
     this->mNumBands = 0;
+#endif
 #if !defined(ANDROID) || defined(USE_BACKPORT)
     this->mBands = EqualizerBands;
     this->mPresets = EqualizerPresets;
 #endif
+#ifdef USE_OUTPUTMIXEXT
+    this->mBandLevelRangeMin = -1500;
+    this->mBandLevelRangeMax = 1500;
+#else
     this->mBandLevelRangeMin = 0;
     this->mBandLevelRangeMax = 0;
+#endif
 #if defined(ANDROID) && !defined(USE_BACKPORT)
     memset(&this->mEqDescriptor, 0, sizeof(effect_descriptor_t));
     // placement new (explicit constructor)
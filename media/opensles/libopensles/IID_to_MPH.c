@@ -115,7 +115,7 @@ int IID_to_MPH(const SLInterfaceID iid)
         -1,
         MPH_PITCH,
         MPH_PRESETREVERB,
-        -1,
+        MPH_ANDROIDMIXSTATS,
         -1,
         -1,
         MPH_METADATATRAVERSAL,
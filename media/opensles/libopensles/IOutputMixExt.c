@@ -22,13 +22,17 @@
 
 // OutputMixExt is used by SDL, but is not specific to or dependent on SDL
 
+// The mix is 16-bit stereo at 44.1 kHz; other tracks go through a Resampler
+#define MIX_RATE_MILLIHZ SL_SAMPLINGRATE_44_1
 
-// stereo is a frame consisting of a pair of 16-bit PCM samples
+// Number of frames resampled at a time, sized for the stack
+#define RESAMPLE_CHUNK 256
 
-typedef struct {
-    short left;
-    short right;
-} stereo;
+// The main mix is followed in mMixBuffer by one effect send bus per aux effect
+#define MIX_BUSES (1 + AUX_MAX)
+
+// A reverb whose total room and reverb level is below this is not fed; its tail still rings
+#define REVERB_AUDIBLE_MILLIBEL (-9000)
 
 
 /** \brief Summary of the gain, as an optimization for the mixer */
@@ -40,6 +44,68 @@ typedef enum {
 } Summary;
 
 
+/** \brief One accumulator a track is mixed into, and the gains of the track for it */
+
+typedef struct {
+    int32_t *mBuffer;
+    uint16_t mGains[STEREO_CHANNELS];
+} Bus;
+
+
+/** \brief Convert float gains to mixer gains, and return whether any channel is audible */
+
+static SLboolean bus_setGains(Bus *bus, const float gains[STEREO_CHANNELS], float scale)
+{
+    SLboolean audible = SL_BOOLEAN_FALSE;
+    unsigned channel;
+    for (channel = 0; channel < STEREO_CHANNELS; ++channel) {
+        float gain = gains[channel] * scale;
+        Summary summary;
+        if (gain <= 0.001) {
+            summary = GAIN_MUTE;
+            bus->mGains[channel] = 0;
+        } else if (gain >= 0.999) {
+            summary = GAIN_UNITY;
+            bus->mGains[channel] = MIXER_UNITY_GAIN;
+        } else {
+            summary = GAIN_OTHER;
+            bus->mGains[channel] = mixer_gain(gain);
+        }
+        if (GAIN_MUTE != summary) {
+            audible = SL_BOOLEAN_TRUE;
+        }
+    }
+    return audible;
+}
+
+
+/** \brief Mix samples of a track into each of its buses, starting offset samples in */
+
+static void bus_mix(const MixerKernels *kernels, const Bus *buses, unsigned numBuses,
+    unsigned offset, const short *src, unsigned samples)
+{
+    unsigned i;
+    for (i = 0; i < numBuses; ++i) {
+        (*kernels->mAccumulate)(&buses[i].mBuffer[offset], src, samples, buses[i].mGains);
+    }
+}
+
+
+/** \brief Copy the direct level and effect send levels from audio player to track */
+
+static void track_copyLevels(Track *track, const CAudioPlayer *audioPlayer)
+{
+    track->mDirectGain = 0 != audioPlayer->mDirectLevel ?
+        powf(10.0f, audioPlayer->mDirectLevel / 2000.0f) : 1.0f;
+    unsigned aux;
+    for (aux = 0; aux < AUX_MAX; ++aux) {
+        const struct EnableLevel *enableLevel = &audioPlayer->mEffectSend.mEnableLevels[aux];
+        track->mSendGains[aux] = enableLevel->mEnable ?
+            powf(10.0f, enableLevel->mSendLevel / 2000.0f) : 0.0f;
+    }
+}
+
+
 /** \brief Check whether a track has any data for us to read */
 
 static SLboolean track_check(Track *track)
@@ -77,6 +143,9 @@ static SLboolean track_check(Track *track)
             audioPlayer->mBufferQueue.mClearRequested = SL_BOOLEAN_FALSE;
             track->mReader = NULL;
             track->mAvail = 0;
+            if (NULL != track->mResampler) {
+                Resampler_reset(track->mResampler);
+            }
             doBroadcast = SL_BOOLEAN_TRUE;
         }
 
@@ -88,6 +157,8 @@ static SLboolean track_check(Track *track)
             assert( /* 0 <= i && */ i < MAX_TRACK);
             unsigned mask = 1 << i;
             track->mAudioPlayer = NULL;
+            Resampler_destroy(track->mResampler);
+            track->mResampler = NULL;
             assert(outputMix->mOutputMixExt.mActiveMask & mask);
             outputMix->mOutputMixExt.mActiveMask &= ~mask;
             audioPlayer->mTrack = NULL;
@@ -113,15 +184,26 @@ static SLboolean track_check(Track *track)
                 // note that the buffer stays on the queue while we are reading
                 audioPlayer->mPlay.mState = SL_PLAYSTATE_PLAYING;
                 trackHasData = SL_BOOLEAN_TRUE;
+                track->mStarved = SL_BOOLEAN_FALSE;
             } else {
                 // no buffers on queue, so playable but not playing
                 // NTH should be able to call a desperation callback when completely starved,
                 // or call less often than every buffer based on high/low water-marks
+                if (!track->mStarved) {
+                    // count each starvation once; the output mix is locked by the mixer
+                    track->mStarved = SL_BOOLEAN_TRUE;
+                    ++track->mUnderruns;
+                    ++CAudioPlayer_GetOutputMix(audioPlayer)->mAndroidMixStats.mUnderruns;
+                }
             }
 
-            // copy gains from audio player to track
+            // copy gains and format from audio player to track
             track->mGains[0] = audioPlayer->mGains[0];
             track->mGains[1] = audioPlayer->mGains[1];
+            track->mSampleRateMilliHz = audioPlayer->mSampleRateMilliHz;
+            track->mNumChannels = audioPlayer->mNumChannels;
+            track->mRate = audioPlayer->mPlaybackRate.mRate;
+            track_copyLevels(track, audioPlayer);
             break;
 
         case SL_PLAYSTATE_STOPPING: // application thread(s) called Play::SetPlayState(STOPPED)
@@ -138,6 +220,11 @@ static SLboolean track_check(Track *track)
                 track->mReader = oldFront->mBuffer;
                 track->mAvail = oldFront->mSize;
             }
+            if (NULL != track->mResampler) {
+                Resampler_reset(track->mResampler);
+            }
+            // an empty queue when play resumes is not an underrun
+            track->mStarved = SL_BOOLEAN_TRUE;
             doBroadcast = SL_BOOLEAN_TRUE;
             break;
 
@@ -164,6 +251,264 @@ broadcast:
 }
 
 
+/** \brief Consume size bytes from the front buffer of a playing track, and when the buffer
+ *  is finished, advance the queue and call the application's callback
+ */
+
+static void track_advance(Track *track, unsigned size, unsigned frameSize)
+{
+    track->mReader = (char *) track->mReader + size;
+    track->mAvail -= size;
+    if (track->mAvail == 0) {
+        IBufferQueue *bufferQueue = &track->mAudioPlayer->mBufferQueue;
+        interface_lock_exclusive(bufferQueue);
+        const BufferHeader *oldFront, *newFront, *rear;
+        oldFront = bufferQueue->mFront;
+        rear = bufferQueue->mRear;
+        // a buffer stays on queue while playing, so it better still be there
+        assert(oldFront != rear);
+        newFront = oldFront;
+        if (++newFront == &bufferQueue->mArray[bufferQueue->mNumBuffers + 1]) {
+            newFront = bufferQueue->mArray;
+        }
+        bufferQueue->mFront = (BufferHeader *) newFront;
+        assert(0 < bufferQueue->mState.count);
+        --bufferQueue->mState.count;
+        if (newFront != rear) {
+            // we don't acknowledge application requests between buffers
+            // within the same mixer frame
+            assert(0 < bufferQueue->mState.count);
+            track->mReader = newFront->mBuffer;
+            track->mAvail = newFront->mSize;
+        }
+        // else we would set play state to playable but not playing during next mixer
+        // frame if the queue is still empty at that time
+        ++bufferQueue->mState.playIndex;
+        slBufferQueueCallback callback = bufferQueue->mCallback;
+        void *context = bufferQueue->mContext;
+        interface_unlock_exclusive(bufferQueue);
+        // The callback function is called on each buffer completion
+        if (NULL != callback) {
+            (*callback)((SLBufferQueueItf) bufferQueue, context);
+            // Maybe it enqueued another buffer, or maybe it didn't.
+            // We will find out later during the next mixer frame.
+        }
+    }
+    // no lock, but safe because noone else updates this field
+    track->mFramesMixed += size / frameSize;
+}
+
+
+/** \brief Create or update the resampler of a track, and return false if it needs one but
+ *  there is not enough memory
+ */
+
+static SLboolean track_configure(Track *track, const MixerKernels *kernels)
+{
+    SLuint32 sampleRateMilliHz = track->mSampleRateMilliHz;
+    if (0 == sampleRateMilliHz) {
+        sampleRateMilliHz = MIX_RATE_MILLIHZ;
+    }
+    SLpermille rate = 0 < track->mRate ? track->mRate : 1000;
+    if (NULL != track->mResampler) {
+        // once created, a resampler stays with the track so that rate changes are seamless
+        Resampler_setRate(track->mResampler, sampleRateMilliHz, MIX_RATE_MILLIHZ, rate);
+    } else if (MIX_RATE_MILLIHZ != sampleRateMilliHz || STEREO_CHANNELS != track->mNumChannels
+            || 1000 != rate) {
+        track->mResampler = Resampler_create(kernels, sampleRateMilliHz, MIX_RATE_MILLIHZ, rate);
+        if (NULL == track->mResampler) {
+            SL_LOGE("OutputMixExt: no memory for resampler");
+            return SL_BOOLEAN_FALSE;
+        }
+    }
+    return SL_BOOLEAN_TRUE;
+}
+
+
+/** \brief Resample and mix frames of a playing track into its buses, or only resample if
+ *  there are none.  Stops early if the track underflows.
+ */
+
+static void track_resample(Track *track, const MixerKernels *kernels, const Bus *buses,
+    unsigned numBuses, unsigned frames)
+{
+    Resampler *resampler = track->mResampler;
+    unsigned channels = STEREO_CHANNELS == track->mNumChannels ? STEREO_CHANNELS : 1;
+    unsigned frameSize = sizeof(short) * channels;
+    short resampled[RESAMPLE_CHUNK * STEREO_CHANNELS];
+    unsigned offset = 0;
+    while (frames > 0) {
+        unsigned chunk = frames < RESAMPLE_CHUNK ? frames : RESAMPLE_CHUNK;
+        unsigned needed = Resampler_framesNeeded(resampler, chunk);
+        if (0 < needed) {
+            // underflow leaves the filter history in place, so the next buffer continues it
+            if (0 == track->mAvail && !track_check(track)) {
+                break;
+            }
+            unsigned avail = track->mAvail / frameSize;
+            if (needed > avail) {
+                needed = avail;
+            }
+            if (0 < needed) {
+                assert(NULL != track->mReader);
+                if (0 != Resampler_write(resampler, (const short *) track->mReader, needed,
+                        channels)) {
+                    SL_LOGE("OutputMixExt: no memory for resampler history");
+                    break;
+                }
+                track_advance(track, needed * frameSize, frameSize);
+            } else {
+                // a partial frame at the end of a buffer is dropped
+                track_advance(track, track->mAvail, frameSize);
+            }
+            continue;
+        }
+        unsigned actual = Resampler_read(resampler, resampled, chunk);
+        assert(actual == chunk);
+        bus_mix(kernels, buses, numBuses, offset, resampled, actual * STEREO_CHANNELS);
+        offset += actual * STEREO_CHANNELS;
+        frames -= actual;
+    }
+}
+
+
+/** \brief Environmental settings for each SLPresetReverbItf preset, indexed by preset */
+
+static const SLEnvironmentalReverbSettings reverbPresets[] = {
+    SL_I3DL2_ENVIRONMENT_PRESET_DEFAULT,    // SL_REVERBPRESET_NONE is silent
+    SL_I3DL2_ENVIRONMENT_PRESET_SMALLROOM,
+    SL_I3DL2_ENVIRONMENT_PRESET_MEDIUMROOM,
+    SL_I3DL2_ENVIRONMENT_PRESET_LARGEROOM,
+    SL_I3DL2_ENVIRONMENT_PRESET_MEDIUMHALL,
+    SL_I3DL2_ENVIRONMENT_PRESET_LARGEHALL,
+    SL_I3DL2_ENVIRONMENT_PRESET_PLATE
+};
+
+
+/** \brief Give a reverb new settings if they changed, and return whether input to it would be
+ *  audible
+ */
+
+static SLboolean fx_setReverb(FxReverb *reverb, const SLEnvironmentalReverbSettings *properties)
+{
+    FxReverbSettings settings;
+    // cleared so that padding compares equal
+    memset(&settings, 0, sizeof(settings));
+    settings.mRoomLevel = properties->roomLevel;
+    settings.mRoomHFLevel = properties->roomHFLevel;
+    settings.mDecayTime = properties->decayTime;
+    settings.mDecayHFRatio = properties->decayHFRatio;
+    settings.mReflectionsLevel = properties->reflectionsLevel;
+    settings.mReflectionsDelay = properties->reflectionsDelay;
+    settings.mReverbLevel = properties->reverbLevel;
+    settings.mReverbDelay = properties->reverbDelay;
+    settings.mDiffusion = properties->diffusion;
+    // redesigning costs several powf per delay line, so only do it on a change
+    if (memcmp(&settings, &reverb->mSettings, sizeof(settings))) {
+        FxReverb_setSettings(reverb, &settings);
+    }
+    SLmillibel level = properties->reflectionsLevel > properties->reverbLevel ?
+        properties->reflectionsLevel : properties->reverbLevel;
+    return properties->roomLevel + level > REVERB_AUDIBLE_MILLIBEL;
+}
+
+
+/** \brief Copy effect parameters from the output mix interfaces, whose lock the caller holds.
+ *  Return whether any effect could change the mix, and which sends should be fed.
+ */
+
+static SLboolean fx_update(IOutputMixExt *this, const COutputMix *outputMix,
+    SLboolean sendsOpen[AUX_MAX])
+{
+    const IEqualizer *equalizer = &outputMix->mEqualizer;
+    FxEqualizer_setEnabled(&this->mEqualizer, equalizer->mEnabled);
+    unsigned band;
+    for (band = 0; band < equalizer->mNumBands && band < FX_EQ_BANDS; ++band) {
+        const struct EqualizerBand *bands = &equalizer->mBands[band];
+        FxEqualizer_setBand(&this->mEqualizer, band, bands->mCenter / 1000.0f,
+            (bands->mMax - bands->mMin) / 1000.0f);
+        FxEqualizer_setLevel(&this->mEqualizer, band, equalizer->mLevels[band]);
+    }
+    FxBassBoost_setEnabled(&this->mBassBoost, outputMix->mBassBoost.mEnabled);
+    FxBassBoost_setStrength(&this->mBassBoost, outputMix->mBassBoost.mStrength);
+    FxVirtualizer_setEnabled(&this->mVirtualizer, outputMix->mVirtualizer.mEnabled);
+    FxVirtualizer_setStrength(&this->mVirtualizer, outputMix->mVirtualizer.mStrength);
+    SLboolean active = FxEqualizer_isActive(&this->mEqualizer) ||
+        FxBassBoost_isActive(&this->mBassBoost) || FxVirtualizer_isActive(&this->mVirtualizer);
+    if (!this->mReverbsOk) {
+        sendsOpen[AUX_ENVIRONMENTALREVERB] = SL_BOOLEAN_FALSE;
+        sendsOpen[AUX_PRESETREVERB] = SL_BOOLEAN_FALSE;
+        return active;
+    }
+    sendsOpen[AUX_ENVIRONMENTALREVERB] = fx_setReverb(&this->mReverbs[AUX_ENVIRONMENTALREVERB],
+        &outputMix->mEnvironmentalReverb.mProperties);
+    SLuint16 preset = outputMix->mPresetReverb.mPreset;
+    if (preset >= sizeof(reverbPresets) / sizeof(reverbPresets[0])) {
+        preset = SL_REVERBPRESET_NONE;
+    }
+    sendsOpen[AUX_PRESETREVERB] = fx_setReverb(&this->mReverbs[AUX_PRESETREVERB],
+        &reverbPresets[preset]);
+    unsigned aux;
+    for (aux = 0; aux < AUX_MAX; ++aux) {
+        if (sendsOpen[aux] || FxReverb_isActive(&this->mReverbs[aux])) {
+            active = SL_BOOLEAN_TRUE;
+        }
+    }
+    return active;
+}
+
+
+/** \brief Apply the effects to the main mix, adding the reverb of each send bus that has data
+ *  or a tail.  Each send bus lies stride samples after the previous one.  Return whether the
+ *  main mix has data afterwards.
+ */
+
+static SLboolean fx_apply(IOutputMixExt *this, unsigned frames, unsigned stride,
+    const SLboolean busHasData[MIX_BUSES])
+{
+    unsigned samples = frames * STEREO_CHANNELS;
+    unsigned aux;
+    SLboolean reverberating = SL_BOOLEAN_FALSE;
+    for (aux = 0; aux < AUX_MAX; ++aux) {
+        if (busHasData[1 + aux] || (this->mReverbsOk && FxReverb_isActive(&this->mReverbs[aux]))) {
+            reverberating = SL_BOOLEAN_TRUE;
+        }
+    }
+    // the filters leave silence silent
+    if (!busHasData[0] && !reverberating) {
+        return SL_BOOLEAN_FALSE;
+    }
+    float *mix = this->mFxBuffer;
+    float *send = &this->mFxBuffer[samples];
+    if (busHasData[0]) {
+        fx_int32ToFloat(mix, this->mMixBuffer, samples);
+    } else {
+        memset(mix, 0, samples * sizeof(float));
+    }
+    for (aux = 0; aux < AUX_MAX; ++aux) {
+        FxReverb *reverb = &this->mReverbs[aux];
+        if (busHasData[1 + aux]) {
+            fx_int32ToFloat(send, &this->mMixBuffer[(1 + aux) * stride], samples);
+            FxReverb_process(reverb, send, mix, frames);
+        } else if (this->mReverbsOk && FxReverb_isActive(reverb)) {
+            FxReverb_process(reverb, NULL, mix, frames);
+        }
+    }
+    // the filters are linear, so the order only matters for rounding
+    if (FxEqualizer_isActive(&this->mEqualizer)) {
+        FxEqualizer_process(&this->mEqualizer, mix, frames);
+    }
+    if (FxBassBoost_isActive(&this->mBassBoost)) {
+        FxBassBoost_process(&this->mBassBoost, mix, frames);
+    }
+    if (FxVirtualizer_isActive(&this->mVirtualizer)) {
+        FxVirtualizer_process(&this->mVirtualizer, mix, frames);
+    }
+    fx_floatToInt32(this->mMixBuffer, mix, samples);
+    return SL_BOOLEAN_TRUE;
+}
+
+
 /** \brief This is the track mixer: fill the specified 16-bit stereo PCM buffer */
 
 void IOutputMixExt_FillBuffer(SLOutputMixExtItf self, void *pBuffer, SLuint32 size)
@@ -172,12 +517,15 @@ void IOutputMixExt_FillBuffer(SLOutputMixExtItf self, void *pBuffer, SLuint32 si
 
     // Force to be a multiple of a frame, assumes stereo 16-bit PCM
     size &= ~3;
-    SLboolean mixBufferHasData = SL_BOOLEAN_FALSE;
     IOutputMixExt *this = (IOutputMixExt *) self;
     IObject *thisObject = this->mThis;
+    IAndroidMixStats *stats = &((COutputMix *) thisObject)->mAndroidMixStats;
+    SLuint32 startTime = stats->mEnabled ? IAndroidMixStats_now() : 0;
     // This lock should never block, except when the application destroys the output mix object
     object_lock_exclusive(thisObject);
     unsigned activeMask;
+    SLboolean fxActive;
+    SLboolean sendsOpen[AUX_MAX] = { SL_BOOLEAN_FALSE, SL_BOOLEAN_FALSE };
     // If the output mix is marked for destruction, then acknowledge the request
     if (this->mDestroyRequested) {
         IEngine *thisEngine = thisObject->mEngine;
@@ -190,9 +538,36 @@ void IOutputMixExt_FillBuffer(SLOutputMixExtItf self, void *pBuffer, SLuint32 si
         this->mDestroyRequested = SL_BOOLEAN_FALSE;
         object_cond_broadcast(thisObject);
         activeMask = 0;
+        fxActive = SL_BOOLEAN_FALSE;
     } else {
         activeMask = this->mActiveMask;
+        fxActive = fx_update(this, (COutputMix *) thisObject, sendsOpen);
     }
+    // Tracks are summed at 32 bits into the main mix and the send buses, effects are applied
+    // in float, and the result is saturated to 16 bits once at the end
+    unsigned samples = size >> 1;
+    if ((activeMask || fxActive) && this->mMixBufferSamples < samples) {
+        int32_t *mixBuffer = (int32_t *) realloc(this->mMixBuffer,
+            samples * MIX_BUSES * sizeof(int32_t));
+        if (NULL != mixBuffer) {
+            this->mMixBuffer = mixBuffer;
+        }
+        float *fxBuffer = (float *) realloc(this->mFxBuffer, samples * 2 * sizeof(float));
+        if (NULL != fxBuffer) {
+            this->mFxBuffer = fxBuffer;
+        }
+        if (NULL != mixBuffer && NULL != fxBuffer) {
+            this->mMixBufferSamples = samples;
+        } else {
+            SL_LOGE("OutputMixExt: no memory for %u sample mix buffer", samples);
+            activeMask = 0;
+            fxActive = SL_BOOLEAN_FALSE;
+        }
+    }
+    const MixerKernels *kernels = this->mKernels;
+    const unsigned stride = this->mMixBufferSamples;
+    SLboolean busHasData[MIX_BUSES];
+    memset(busHasData, 0, sizeof(busHasData));
     while (activeMask) {
         unsigned i = ctz(activeMask);
         assert(MAX_TRACK > i);
@@ -201,30 +576,39 @@ void IOutputMixExt_FillBuffer(SLOutputMixExtItf self, void *pBuffer, SLuint32 si
 
         // track is allocated
 
-        if (!track_check(track)) {
+        if (!track_check(track) || !track_configure(track, kernels)) {
             continue;
         }
 
-        // track is playing
-        void *dstWriter = pBuffer;
-        unsigned desired = size;
-        SLboolean trackContributedToMix = SL_BOOLEAN_FALSE;
-        float gains[STEREO_CHANNELS];
-        Summary summaries[STEREO_CHANNELS];
-        unsigned channel;
-        for (channel = 0; channel < STEREO_CHANNELS; ++channel) {
-            float gain = track->mGains[channel];
-            gains[channel] = gain;
-            Summary summary;
-            if (gain <= 0.001) {
-                summary = GAIN_MUTE;
-            } else if (gain >= 0.999) {
-                summary = GAIN_UNITY;
+        // track is playing: collect the buses it is audible on
+        Bus buses[MIX_BUSES];
+        unsigned numBuses = 0;
+        unsigned bus;
+        for (bus = 0; bus < MIX_BUSES; ++bus) {
+            float scale;
+            if (0 == bus) {
+                scale = track->mDirectGain;
+            } else if (sendsOpen[bus - 1]) {
+                scale = track->mSendGains[bus - 1];
             } else {
-                summary = GAIN_OTHER;
+                continue;
+            }
+            if (!bus_setGains(&buses[numBuses], track->mGains, scale)) {
+                continue;
+            }
+            buses[numBuses++].mBuffer = &this->mMixBuffer[bus * stride];
+            if (!busHasData[bus]) {
+                // first track to contribute, so clear the whole accumulator once
+                memset(&this->mMixBuffer[bus * stride], 0, samples * sizeof(int32_t));
+                busHasData[bus] = SL_BOOLEAN_TRUE;
             }
-            summaries[channel] = summary;
         }
+        if (NULL != track->mResampler) {
+            track_resample(track, kernels, buses, numBuses, size >> 2);
+            continue;
+        }
+        unsigned offset = 0;
+        unsigned desired = size;
         while (desired > 0) {
             unsigned actual = desired;
             if (track->mAvail < actual) {
@@ -233,94 +617,29 @@ void IOutputMixExt_FillBuffer(SLOutputMixExtItf self, void *pBuffer, SLuint32 si
             // force actual to be a frame multiple
             if (actual > 0) {
                 assert(NULL != track->mReader);
-                stereo *mixBuffer = (stereo *) dstWriter;
-                const stereo *source = (const stereo *) track->mReader;
-                unsigned j;
-                if (GAIN_MUTE != summaries[0] || GAIN_MUTE != summaries[1]) {
-                    if (mixBufferHasData) {
-                        // apply gain during add
-                        if (GAIN_UNITY != summaries[0] || GAIN_UNITY != summaries[1]) {
-                            for (j = 0; j < actual; j += sizeof(stereo), ++mixBuffer, ++source) {
-                                mixBuffer->left += (short) (source->left * track->mGains[0]);
-                                mixBuffer->right += (short) (source->right * track->mGains[1]);
-                            }
-                        // no gain adjustment needed, so do a simple add
-                        } else {
-                            for (j = 0; j < actual; j += sizeof(stereo), ++mixBuffer, ++source) {
-                                mixBuffer->left += source->left;
-                                mixBuffer->right += source->right;
-                            }
-                        }
-                    } else {
-                        // apply gain during copy
-                        if (GAIN_UNITY != summaries[0] || GAIN_UNITY != summaries[1]) {
-                            for (j = 0; j < actual; j += sizeof(stereo), ++mixBuffer, ++source) {
-                                mixBuffer->left = (short) (source->left * track->mGains[0]);
-                                mixBuffer->right = (short) (source->right * track->mGains[1]);
-                            }
-                        // no gain adjustment needed, so do a simple copy
-                        } else {
-                            memcpy(dstWriter, track->mReader, actual);
-                        }
-                    }
-                    trackContributedToMix = SL_BOOLEAN_TRUE;
-                }
-                dstWriter = (char *) dstWriter + actual;
+                // only whole frames are mixed
+                bus_mix(kernels, buses, numBuses, offset, (const short *) track->mReader,
+                    (actual >> 2) * STEREO_CHANNELS);
+                offset += actual >> 1;
                 desired -= actual;
-                track->mReader = (char *) track->mReader + actual;
-                track->mAvail -= actual;
-                if (track->mAvail == 0) {
-                    IBufferQueue *bufferQueue = &track->mAudioPlayer->mBufferQueue;
-                    interface_lock_exclusive(bufferQueue);
-                    const BufferHeader *oldFront, *newFront, *rear;
-                    oldFront = bufferQueue->mFront;
-                    rear = bufferQueue->mRear;
-                    // a buffer stays on queue while playing, so it better still be there
-                    assert(oldFront != rear);
-                    newFront = oldFront;
-                    if (++newFront == &bufferQueue->mArray[bufferQueue->mNumBuffers + 1]) {
-                        newFront = bufferQueue->mArray;
-                    }
-                    bufferQueue->mFront = (BufferHeader *) newFront;
-                    assert(0 < bufferQueue->mState.count);
-                    --bufferQueue->mState.count;
-                    if (newFront != rear) {
-                        // we don't acknowledge application requests between buffers
-                        // within the same mixer frame
-                        assert(0 < bufferQueue->mState.count);
-                        track->mReader = newFront->mBuffer;
-                        track->mAvail = newFront->mSize;
-                    }
-                    // else we would set play state to playable but not playing during next mixer
-                    // frame if the queue is still empty at that time
-                    ++bufferQueue->mState.playIndex;
-                    slBufferQueueCallback callback = bufferQueue->mCallback;
-                    void *context = bufferQueue->mContext;
-                    interface_unlock_exclusive(bufferQueue);
-                    // The callback function is called on each buffer completion
-                    if (NULL != callback) {
-                        (*callback)((SLBufferQueueItf) bufferQueue, context);
-                        // Maybe it enqueued another buffer, or maybe it didn't.
-                        // We will find out later during the next mixer frame.
-                    }
-                }
-                // no lock, but safe because noone else updates this field
-                track->mFramesMixed += actual >> 2;    // sizeof(short) * STEREO_CHANNELS
+                track_advance(track, actual, sizeof(short) * STEREO_CHANNELS);
                 continue;
             }
             // we need more data: desired > 0 but actual == 0
             if (track_check(track)) {
                 continue;
             }
-            // underflow: clear out rest of partial buffer (NTH synthesize comfort noise)
-            if (!mixBufferHasData && trackContributedToMix) {
-                memset(dstWriter, 0, actual);
-            }
+            // underflow: the rest of the accumulator is already zero (NTH comfort noise)
             break;
         }
-        if (trackContributedToMix) {
-            mixBufferHasData = SL_BOOLEAN_TRUE;
-        }
+    }
+    SLboolean mixBufferHasData = fxActive ? fx_apply(this, size >> 2, stride, busHasData) :
+        busHasData[0];
+    if (mixBufferHasData) {
+        (*kernels->mSaturate)((short *) pBuffer, this->mMixBuffer, samples);
+    }
+    if (stats->mEnabled) {
+        IAndroidMixStats_addMixTime(stats, IAndroidMixStats_now() - startTime);
     }
     object_unlock_exclusive(thisObject);
     // No active tracks, so output silence
@@ -345,8 +664,44 @@ void IOutputMixExt_init(void *self)
     unsigned i;
     for (i = 0; i < MAX_TRACK; ++i, ++track) {
         track->mAudioPlayer = NULL;
+        track->mResampler = NULL;
     }
     this->mDestroyRequested = SL_BOOLEAN_FALSE;
+    this->mKernels = mixer_getKernels(0);
+    this->mMixBuffer = NULL;
+    this->mMixBufferSamples = 0;
+    this->mFxBuffer = NULL;
+    FxEqualizer_init(&this->mEqualizer, MIX_RATE_MILLIHZ / 1000, MAX_EQ_BANDS);
+    FxBassBoost_init(&this->mBassBoost, MIX_RATE_MILLIHZ / 1000);
+    FxVirtualizer_init(&this->mVirtualizer);
+    // without memory for the delay lines the reverbs are silent, but the mix still plays
+    this->mReverbsOk = SL_BOOLEAN_TRUE;
+    unsigned aux;
+    for (aux = 0; aux < AUX_MAX; ++aux) {
+        if (0 != FxReverb_init(&this->mReverbs[aux], MIX_RATE_MILLIHZ / 1000)) {
+            SL_LOGE("OutputMixExt: no memory for reverb");
+            this->mReverbsOk = SL_BOOLEAN_FALSE;
+        }
+    }
+}
+
+void IOutputMixExt_deinit(void *self)
+{
+    IOutputMixExt *this = (IOutputMixExt *) self;
+    unsigned i;
+    for (i = 0; i < MAX_TRACK; ++i) {
+        Resampler_destroy(this->mTracks[i].mResampler);
+        this->mTracks[i].mResampler = NULL;
+    }
+    free(this->mMixBuffer);
+    this->mMixBuffer = NULL;
+    this->mMixBufferSamples = 0;
+    free(this->mFxBuffer);
+    this->mFxBuffer = NULL;
+    unsigned aux;
+    for (aux = 0; aux < AUX_MAX; ++aux) {
+        FxReverb_deinit(&this->mReverbs[aux]);
+    }
 }
 
 
@@ -364,11 +719,9 @@ SLresult IOutputMixExt_checkAudioPlayerSourceSink(CAudioPlayer *this)
 #endif
         switch (this->mDataSource.mFormat.mFormatType) {
         case SL_DATAFORMAT_PCM:
-#ifdef USE_SDL
-            // SDL is hard-coded to 44.1 kHz, and there is no sample rate converter
-            if (SL_SAMPLINGRATE_44_1 != this->mDataSource.mFormat.mPCM.samplesPerSec)
+            // any sample rate is converted to the mix rate, but only mono and stereo are mixed
+            if (STEREO_CHANNELS < this->mDataSource.mFormat.mPCM.numChannels)
                 return SL_RESULT_CONTENT_UNSUPPORTED;
-#endif
             break;
         default:
             break;
@@ -419,6 +772,14 @@ SLresult IOutputMixExt_checkAudioPlayerSourceSink(CAudioPlayer *this)
     track->mGains[0] = 1.0f;
     track->mGains[1] = 1.0f;
     track->mFramesMixed = 0;
+    track->mSampleRateMilliHz = this->mSampleRateMilliHz;
+    track->mNumChannels = this->mNumChannels;
+    track->mRate = 1000;
+    track->mStarved = SL_BOOLEAN_TRUE;
+    track->mUnderruns = 0;
+    track_copyLevels(track, this);
+    // a previous user of this slot released its resampler when it was unlinked
+    assert(NULL == track->mResampler);
     return SL_RESULT_SUCCESS;
 }
 
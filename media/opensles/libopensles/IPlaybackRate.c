@@ -197,9 +197,14 @@ void IPlaybackRate_init(void *self)
 #ifdef ANDROID
     // for an AudioPlayer, mCapabilities will be initialized in sles_to_android_audioPlayerCreate
 #endif
+#ifdef USE_OUTPUTMIXEXT
+    // The track mixer resamples, which changes the rate without pitch correction
+    this->mCapabilities = SL_RATEPROP_NOPITCHCORAUDIO;
+#else
     // The generic implementation sets no capabilities because the generic
     // implementation alone doesn't support any.
     this->mCapabilities = 0;
+#endif
     // SL_RATEPROP_SILENTAUDIO | SL_RATEPROP_STAGGEREDAUDIO | SL_RATEPROP_NOPITCHCORAUDIO |
     // SL_RATEPROP_PITCHCORAUDIO
 }
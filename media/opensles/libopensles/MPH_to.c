@@ -67,7 +67,8 @@ const signed char MPH_to_3DGroup[MPH_MAX] = {
     -1, // MPH_ANDROIDEFFECTCAPABILITIES
     -1, // MPH_ANDROIDEFFECTSEND
     -1, // MPH_ANDROIDCONFIGURATION
-    -1  // MPH_ANDROIDSIMPLEBUFFERQUEUE
+    -1, // MPH_ANDROIDSIMPLEBUFFERQUEUE
+    -1  // MPH_ANDROIDMIXSTATS
     END
 #endif
 };
@@ -151,14 +152,15 @@ const signed char MPH_to_AudioPlayer[MPH_MAX] = {
     -1, // MPH_ANDROIDEFFECTCAPABILITIES
     27, // MPH_ANDROIDEFFECTSEND
     28, // MPH_ANDROIDCONFIGURATION
-    7   // MPH_SIMPLEBUFFERQUEUE    // alias for [MPH_BUFFERQUEUE]
+    7,  // MPH_SIMPLEBUFFERQUEUE    // alias for [MPH_BUFFERQUEUE]
 #else
     -1, // not using MPH_ANDROIDEFFECT
     -1, // not using MPH_ANDROIDEFFECTCAPABILITIES
     -1, // not using MPH_ANDROIDEFFECTSEND
     -1, // not using MPH_ANDROIDCONFIGURATION
-    -1  // not using MPH_ANDROIDSIMPLEBUFFERQUEUE
+    -1, // not using MPH_ANDROIDSIMPLEBUFFERQUEUE
 #endif
+    -1  // MPH_ANDROIDMIXSTATS
     END
 #endif
 };
@@ -204,11 +206,12 @@ const signed char MPH_to_AudioRecorder[MPH_MAX] = {
     -1, // not using MPH_ANDROIDEFFECTSEND
 #ifdef ANDROID
     10, // MPH_ANDROIDCONFIGURATION
-    9   // MPH_ANDROIDSIMPLEBUFFERQUEUE (this is not an alias)
+    9,  // MPH_ANDROIDSIMPLEBUFFERQUEUE (this is not an alias)
 #else
     -1, // not using MPH_ANDROIDCONFIGURATION
-    -1  // not using MPH_ANDROIDSIMPLEBUFFERQUEUE
+    -1, // not using MPH_ANDROIDSIMPLEBUFFERQUEUE
 #endif
+    -1  // MPH_ANDROIDMIXSTATS
     END
 #endif
 };
@@ -254,14 +257,15 @@ const signed char MPH_to_Engine[MPH_MAX] = {
     10, // MPH_ANDROIDEFFECTCAPABILITIES
     -1, // MPH_ANDROIDEFFECTSEND
     -1, // MPH_ANDROIDCONFIGURATION
-    -1  // MPH_ANDROIDSIMPLEBUFFERQUEUE
+    -1, // MPH_ANDROIDSIMPLEBUFFERQUEUE
 #else
     -1, // MPH_ANDROIDEFFECT
     -1, // MPH_ANDROIDEFFECTCAPABILITIES
     -1, // MPH_ANDROIDEFFECTSEND
     -1, // MPH_ANDROIDCONFIGURATION
-    -1  // MPH_ANDROIDSIMPLEBUFFERQUEUE
+    -1, // MPH_ANDROIDSIMPLEBUFFERQUEUE
 #endif
+    -1  // MPH_ANDROIDMIXSTATS
     END
 #endif
 };
@@ -286,7 +290,8 @@ const signed char MPH_to_LEDDevice[MPH_MAX] = {
     -1, // MPH_ANDROIDEFFECTCAPABILITIES
     -1, // MPH_ANDROIDEFFECTSEND
     -1, // MPH_ANDROIDCONFIGURATION
-    -1  // MPH_ANDROIDSIMPLEBUFFERQUEUE
+    -1, // MPH_ANDROIDSIMPLEBUFFERQUEUE
+    -1  // MPH_ANDROIDMIXSTATS
     END
 #endif
 };
@@ -315,7 +320,8 @@ const signed char MPH_to_Listener[MPH_MAX] = {
     -1, // MPH_ANDROIDEFFECTCAPABILITIES
     -1, // MPH_ANDROIDEFFECTSEND
     -1, // MPH_ANDROIDCONFIGURATION
-    -1  // MPH_ANDROIDSIMPLEBUFFERQUEUE
+    -1, // MPH_ANDROIDSIMPLEBUFFERQUEUE
+    -1  // MPH_ANDROIDMIXSTATS
     END
 #endif
 };
@@ -345,7 +351,8 @@ const signed char MPH_to_MetadataExtractor[MPH_MAX] = {
     -1, // MPH_ANDROIDEFFECTCAPABILITIES
     -1, // MPH_ANDROIDEFFECTSEND
     -1, // MPH_ANDROIDCONFIGURATION
-    -1  // MPH_ANDROIDSIMPLEBUFFERQUEUE
+    -1, // MPH_ANDROIDSIMPLEBUFFERQUEUE
+    -1  // MPH_ANDROIDMIXSTATS
     END
 #endif
 };
@@ -428,7 +435,8 @@ const signed char MPH_to_MidiPlayer[MPH_MAX] = {
     -1, // MPH_ANDROIDEFFECTCAPABILITIES
     -1, // MPH_ANDROIDEFFECTSEND
     -1, // MPH_ANDROIDCONFIGURATION
-    -1  // MPH_ANDROIDSIMPLEBUFFERQUEUE
+    -1, // MPH_ANDROIDSIMPLEBUFFERQUEUE
+    -1  // MPH_ANDROIDMIXSTATS
     END
 #endif
 };
@@ -450,8 +458,9 @@ const signed char MPH_to_OutputMix[MPH_MAX] = {
     [MPH_VOLUME] = 8,
     [MPH_BASSBOOST] = 9,
     [MPH_VISUALIZATION] = 10,
+    [MPH_ANDROIDMIXSTATS] = 11,
 #ifdef ANDROID
-    [MPH_ANDROIDEFFECT] = 11
+    [MPH_ANDROIDEFFECT] = 12
 #endif
 #else
     -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
@@ -476,14 +485,15 @@ const signed char MPH_to_OutputMix[MPH_MAX] = {
     -1,
 #endif
 #ifdef ANDROID
-    11, // MPH_ANDROIDEFFECT
+    12, // MPH_ANDROIDEFFECT
 #else
     -1,
 #endif
     -1, // MPH_ANDROIDEFFECTCAPABILITIES
     -1, // MPH_ANDROIDEFFECTSEND
     -1, // MPH_ANDROIDCONFIGURATION
-    -1  // MPH_ANDROIDSIMPLEBUFFERQUEUE
+    -1, // MPH_ANDROIDSIMPLEBUFFERQUEUE
+    11  // MPH_ANDROIDMIXSTATS
     END
 #endif
 };
@@ -508,7 +518,8 @@ const signed char MPH_to_Vibra[MPH_MAX] = {
     -1, // MPH_ANDROIDEFFECTCAPABILITIES
     -1, // MPH_ANDROIDEFFECTSEND
     -1, // MPH_ANDROIDCONFIGURATION
-    -1  // MPH_ANDROIDSIMPLEBUFFERQUEUE
+    -1, // MPH_ANDROIDSIMPLEBUFFERQUEUE
+    -1  // MPH_ANDROIDMIXSTATS
     END
 #endif
 };
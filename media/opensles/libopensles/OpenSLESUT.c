@@ -93,7 +93,8 @@ static Pair pairs[] = {
     _(ANDROIDEFFECTCAPABILITIES),
     _(ANDROIDEFFECTSEND),
     _(ANDROIDCONFIGURATION),
-    _(ANDROIDSIMPLEBUFFERQUEUE)
+    _(ANDROIDSIMPLEBUFFERQUEUE),
+    _(ANDROIDMIXSTATS)
 #endif
 };
 
@@ -144,7 +144,9 @@ const struct SLInterfaceID_ SL_IID_array[MPH_MAX] = {
     // SL_IID_ANDROIDCONFIGURATION (the lack of ifdef is intentional)
     { 0x89f6a7e0, 0xbeac, 0x11df, 0x8b5c, { 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b } },
     // SL_IID_ANDROIDSIMPLEBUFERQUEUE (the lack of ifdef is intentional)
-    { 0x198e4940, 0xc5d7, 0x11df, 0xa2a6, { 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b } }
+    { 0x198e4940, 0xc5d7, 0x11df, 0xa2a6, { 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b } },
+    // SL_IID_ANDROIDMIXSTATS (the lack of ifdef is intentional)
+    { 0x37b2d640, 0xd1a8, 0x11e0, 0x9c3e, { 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b } }
 };
 
 #ifdef __cplusplus
@@ -203,6 +205,7 @@ const SLInterfaceID SL_IID_ANDROIDEFFECTCAPABILITIES = &SL_IID_array[MPH_ANDROID
 const SLInterfaceID SL_IID_ANDROIDEFFECTSEND = &SL_IID_array[MPH_ANDROIDEFFECTSEND];
 const SLInterfaceID SL_IID_ANDROIDCONFIGURATION = &SL_IID_array[MPH_ANDROIDCONFIGURATION];
 const SLInterfaceID SL_IID_ANDROIDSIMPLEBUFFERQUEUE = &SL_IID_array[MPH_ANDROIDSIMPLEBUFFERQUEUE];
+const SLInterfaceID SL_IID_ANDROIDMIXSTATS = &SL_IID_array[MPH_ANDROIDMIXSTATS];
 #ifdef __cplusplus
 }
 #endif
@@ -40,7 +40,15 @@ typedef struct {
     const void *mReader;    ///< Pointer to next frame in BufferHeader.mBuffer
     SLuint32 mAvail;        ///< Number of available bytes in the current buffer
     float mGains[STEREO_CHANNELS]; ///< Copied from CAudioPlayer::mGains
-    SLuint32 mFramesMixed;  ///< Number of sample frames mixed from track; reset periodically
+    SLuint32 mFramesMixed;  ///< Number of source frames mixed from track; reset periodically
+    SLuint32 mSampleRateMilliHz;   ///< Copied from CAudioPlayer::mSampleRateMilliHz
+    SLuint8 mNumChannels;   ///< Copied from CAudioPlayer::mNumChannels
+    SLpermille mRate;       ///< Copied from CAudioPlayer::mPlaybackRate.mRate
+    Resampler *mResampler;  ///< Non-NULL once the track is not 44.1 kHz stereo at normal rate
+    float mDirectGain;      ///< From CAudioPlayer::mDirectLevel, applies to the main mix only
+    float mSendGains[AUX_MAX];  ///< From CAudioPlayer::mEffectSend, 0.0f when not enabled
+    SLboolean mStarved;     ///< Ran out of data while playing, and has had none since
+    SLuint32 mUnderruns;    ///< Number of times the track starved while playing
 } Track;
 
 #ifndef this
@@ -48,10 +48,11 @@ void SDL_open(IEngine *thisEngine)
     fmt.freq = 44100;
     fmt.format = AUDIO_S16;
     fmt.channels = STEREO_CHANNELS;
+    // The device period is independent of the libsndfile decode buffer size
 #ifdef _WIN32 // FIXME Either a bug or a serious misunderstanding
-    fmt.samples = SndFile_BUFSIZE;
+    fmt.samples = 512;
 #else
-    fmt.samples = SndFile_BUFSIZE / sizeof(short);
+    fmt.samples = 256;
 #endif
     fmt.callback = SDL_callback;
     fmt.userdata = (void *) thisEngine;
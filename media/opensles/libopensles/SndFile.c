@@ -19,74 +19,237 @@
 #include "sles_allinclusive.h"
 
 
-/** \brief Called by SndFile.c:audioPlayerTransportUpdate after a play state change or seek,
- *  and by IOutputMixExt::FillBuffer after each buffer is consumed.
+/** \brief Report the fill level and prefetch status, which are derived from the number of
+ *  decoded buffers on the buffer queue, and call the application's prefetch callback if the
+ *  change is one that it asked to hear about
  */
 
-void SndFile_Callback(SLBufferQueueItf caller, void *pContext)
+static void SndFile_updatePrefetch(CAudioPlayer *thisAP, SLboolean eof)
 {
-    CAudioPlayer *thisAP = (CAudioPlayer *) pContext;
-    object_lock_peek(&thisAP->mObject);
-    SLuint32 state = thisAP->mPlay.mState;
-    object_unlock_peek(&thisAP->mObject);
-    if (SL_PLAYSTATE_PLAYING != state) {
-        return;
+    IPrefetchStatus *thisPS = &thisAP->mPrefetchStatus;
+    SLuint32 events = 0;
+    object_lock_exclusive(&thisAP->mObject);
+    SLuint32 count = thisAP->mBufferQueue.mState.count;
+    // once the whole file has been decoded, whatever is left is by definition enough
+    SLpermille level = eof ? 1000 : (SLpermille) ((count * 1000) / SndFile_NUMBUFS);
+    SLuint32 status = (eof || (0 < count)) ? SL_PREFETCHSTATUS_SUFFICIENTDATA :
+        SL_PREFETCHSTATUS_UNDERFLOW;
+    thisPS->mLevel = level;
+    if (status != thisPS->mStatus) {
+        thisPS->mStatus = status;
+        events |= SL_PREFETCHEVENT_STATUSCHANGE;
+    }
+    SLpermille delta = level > thisAP->mSndFile.mReportedLevel ?
+        level - thisAP->mSndFile.mReportedLevel : thisAP->mSndFile.mReportedLevel - level;
+    if ((0 != delta) && ((delta >= thisPS->mFillUpdatePeriod) || (0 == level) ||
+            (1000 == level))) {
+        thisAP->mSndFile.mReportedLevel = level;
+        events |= SL_PREFETCHEVENT_FILLLEVELCHANGE;
     }
+    events &= thisPS->mCallbackEventsMask;
+    slPrefetchCallback callback = thisPS->mCallback;
+    void *context = thisPS->mContext;
+    object_unlock_exclusive(&thisAP->mObject);
+    // callbacks are called with mutex unlocked
+    if ((NULL != callback) && (0 != events)) {
+        (*callback)(&thisPS->mItf, context, events);
+    }
+}
+
+
+/** \brief Decode up to maxBuffers buffers directly into the free slots of mBuffer, and enqueue
+ *  each one in place as soon as it is ready.  Called with mDecodeMutex locked.
+ *  Returns whether the end of file has been reached.
+ */
+
+static SLboolean SndFile_decode(CAudioPlayer *thisAP, SLuint32 maxBuffers)
+{
     struct SndFile *this = &thisAP->mSndFile;
-    SLresult result;
     pthread_mutex_lock(&this->mMutex);
-    if (this->mEOF) {
+    SLboolean eof = this->mEOF;
+    SLboolean shutdown = this->mShutdown;
+    pthread_mutex_unlock(&this->mMutex);
+    while (!eof && !shutdown && (0 < maxBuffers)) {
+        // buffers are consumed in the order they were enqueued, so while fewer than
+        // SndFile_NUMBUFS are queued, the slot at mWhich is no longer in use by the mixer
+        object_lock_peek(&thisAP->mObject);
+        SLuint32 count = thisAP->mBufferQueue.mState.count;
+        object_unlock_peek(&thisAP->mObject);
+        if (count >= SndFile_NUMBUFS) {
+            break;
+        }
+        short *pBuffer = &this->mBuffer[this->mWhich * SndFile_BUFSIZE];
+        // this is where the time goes on a slow file system, so no other locks are held
+        sf_count_t frames = sf_read_short(this->mSNDFILE, pBuffer, (sf_count_t) SndFile_BUFSIZE);
+        if (0 < frames) {
+            if (++this->mWhich >= SndFile_NUMBUFS) {
+                this->mWhich = 0;
+            }
+            SLresult result = IBufferQueue_Enqueue(&thisAP->mBufferQueue.mItf, pBuffer,
+                (SLuint32) (frames * sizeof(short)));
+            // not much we can do if the Enqueue fails, so we'll just drop the decoded data
+            if (SL_RESULT_SUCCESS != result) {
+                SL_LOGE("enqueue failed 0x%lx", result);
+            }
+        } else {
+            eof = SL_BOOLEAN_TRUE;
+        }
+        pthread_mutex_lock(&this->mMutex);
+        if (eof) {
+            this->mEOF = SL_BOOLEAN_TRUE;
+        }
+        shutdown = this->mShutdown;
+        pthread_mutex_unlock(&this->mMutex);
+        SndFile_updatePrefetch(thisAP, eof);
+        --maxBuffers;
+    }
+    return eof;
+}
+
+
+/** \brief Pause a playing player whose buffer queue has drained after the end of file */
+
+static void SndFile_checkEnd(CAudioPlayer *thisAP)
+{
+    object_lock_exclusive(&thisAP->mObject);
+    if ((SL_PLAYSTATE_PLAYING == thisAP->mPlay.mState) &&
+            (0 == thisAP->mBufferQueue.mState.count)) {
+        thisAP->mPlay.mState = SL_PLAYSTATE_PAUSED;
+        // this would result in a non-monotonically increasing position, so don't do it
+        // thisAP->mPlay.mPosition = thisAP->mPlay.mDuration;
+        object_unlock_exclusive_attributes(&thisAP->mObject, ATTR_TRANSPORT);
+    } else {
+        object_unlock_exclusive(&thisAP->mObject);
+    }
+}
+
+
+/** \brief Thread pool closure that fills the buffer queue, and keeps going for as long as
+ *  more decode requests arrive while it runs
+ */
+
+static void SndFile_DecodeClosure(void *context, int parameter)
+{
+    CAudioPlayer *thisAP = (CAudioPlayer *) context;
+    struct SndFile *this = &thisAP->mSndFile;
+    for (;;) {
+        pthread_mutex_lock(&this->mMutex);
+        SLuint32 requests = this->mDecodeRequests;
+        pthread_mutex_unlock(&this->mMutex);
+        pthread_mutex_lock(&this->mDecodeMutex);
+        SLboolean eof = SndFile_decode(thisAP, SndFile_NUMBUFS);
+        pthread_mutex_unlock(&this->mDecodeMutex);
+        if (eof) {
+            SndFile_checkEnd(thisAP);
+        }
+        pthread_mutex_lock(&this->mMutex);
+        this->mDecodeRequests -= requests;
+        if (0 == this->mDecodeRequests) {
+            // the player must not be touched after this, as it may be destroyed at any time
+            pthread_cond_broadcast(&this->mCond);
+            pthread_mutex_unlock(&this->mMutex);
+            break;
+        }
+        pthread_mutex_unlock(&this->mMutex);
+    }
+}
+
+
+/** \brief Ask for the buffer queue to be topped up, without blocking the caller.
+ *  Requests are coalesced so at most one decode closure per player is pending at a time.
+ */
+
+static void SndFile_requestDecode(CAudioPlayer *thisAP)
+{
+    struct SndFile *this = &thisAP->mSndFile;
+    pthread_mutex_lock(&this->mMutex);
+    if (this->mShutdown || this->mEOF) {
+        pthread_mutex_unlock(&this->mMutex);
+        return;
+    }
+    if (1 != ++this->mDecodeRequests) {
         pthread_mutex_unlock(&this->mMutex);
         return;
     }
-    short *pBuffer = &this->mBuffer[this->mWhich * SndFile_BUFSIZE];
-    if (++this->mWhich >= SndFile_NUMBUFS) {
-        this->mWhich = 0;
+    pthread_mutex_unlock(&this->mMutex);
+    SLresult result = ThreadPool_tryAdd(&thisAP->mObject.mEngine->mThreadPool,
+        SndFile_DecodeClosure, thisAP, 0);
+    if (SL_RESULT_SUCCESS == result) {
+        return;
     }
-    sf_count_t count;
-    count = sf_read_short(this->mSNDFILE, pBuffer, (sf_count_t) SndFile_BUFSIZE);
+    pthread_mutex_lock(&this->mMutex);
+    this->mDecodeRequests = 0;
+    pthread_cond_broadcast(&this->mCond);
+    pthread_mutex_unlock(&this->mMutex);
+    // The thread pool is saturated, so the next buffer completion will ask again.  But if the
+    // queue is already empty there won't be one, so decode a buffer here instead, unless another
+    // thread is already decoding or seeking for this player.
+    object_lock_peek(&thisAP->mObject);
+    SLuint32 count = thisAP->mBufferQueue.mState.count;
+    object_unlock_peek(&thisAP->mObject);
+    if ((0 == count) && (0 == pthread_mutex_trylock(&this->mDecodeMutex))) {
+        SLboolean eof = SndFile_decode(thisAP, 1);
+        pthread_mutex_unlock(&this->mDecodeMutex);
+        if (eof) {
+            SndFile_checkEnd(thisAP);
+        }
+    }
+}
+
+
+/** \brief Called by IOutputMixExt::FillBuffer after each buffer is consumed */
+
+void SndFile_Callback(SLBufferQueueItf caller, void *pContext)
+{
+    CAudioPlayer *thisAP = (CAudioPlayer *) pContext;
+    struct SndFile *this = &thisAP->mSndFile;
+    // refill the slot that was just released before anything else
+    SndFile_requestDecode(thisAP);
+    pthread_mutex_lock(&this->mMutex);
+    SLboolean eof = this->mEOF;
     pthread_mutex_unlock(&this->mMutex);
     bool headAtNewPos = false;
     object_lock_exclusive(&thisAP->mObject);
     slPlayCallback callback = thisAP->mPlay.mCallback;
     void *context = thisAP->mPlay.mContext;
-    // make a copy of sample rate so we are absolutely sure we will not divide by zero
-    SLuint32 sampleRateMilliHz = thisAP->mSampleRateMilliHz;
-    if (0 != sampleRateMilliHz) {
-        // this will overflow after 49 days, but no fix possible as it's part of the API
-        thisAP->mPlay.mPosition = (SLuint32) (((long long) thisAP->mPlay.mFramesSinceLastSeek *
-            1000000LL) / sampleRateMilliHz) + thisAP->mPlay.mLastSeekPosition;
-        // make a good faith effort for the mean time between "head at new position" callbacks to
-        // occur at the requested update period, but there will be jitter
-        SLuint32 frameUpdatePeriod = thisAP->mPlay.mFrameUpdatePeriod;
-        if ((0 != frameUpdatePeriod) &&
-            (thisAP->mPlay.mFramesSincePositionUpdate >= frameUpdatePeriod) &&
-            (SL_PLAYEVENT_HEADATNEWPOS & thisAP->mPlay.mEventFlags)) {
-            // if we overrun a requested update period, then reset the clock modulo the
-            // update period so that it appears to the application as one or more lost callbacks,
-            // but no additional jitter
-            if ((thisAP->mPlay.mFramesSincePositionUpdate -= thisAP->mPlay.mFrameUpdatePeriod) >=
-                    frameUpdatePeriod) {
-                thisAP->mPlay.mFramesSincePositionUpdate %= frameUpdatePeriod;
+    unsigned attr = ATTR_NONE;
+    if (SL_PLAYSTATE_PLAYING == thisAP->mPlay.mState) {
+        // make a copy of sample rate so we are absolutely sure we will not divide by zero
+        SLuint32 sampleRateMilliHz = thisAP->mSampleRateMilliHz;
+        if (0 != sampleRateMilliHz) {
+            // this will overflow after 49 days, but no fix possible as it's part of the API
+            thisAP->mPlay.mPosition = (SLuint32) (((long long) thisAP->mPlay.mFramesSinceLastSeek
+                * 1000000LL) / sampleRateMilliHz) + thisAP->mPlay.mLastSeekPosition;
+            // make a good faith effort for the mean time between "head at new position"
+            // callbacks to occur at the requested update period, but there will be jitter
+            SLuint32 frameUpdatePeriod = thisAP->mPlay.mFrameUpdatePeriod;
+            if ((0 != frameUpdatePeriod) &&
+                (thisAP->mPlay.mFramesSincePositionUpdate >= frameUpdatePeriod) &&
+                (SL_PLAYEVENT_HEADATNEWPOS & thisAP->mPlay.mEventFlags)) {
+                // if we overrun a requested update period, then reset the clock modulo the
+                // update period so that it appears to the application as one or more lost
+                // callbacks, but no additional jitter
+                if ((thisAP->mPlay.mFramesSincePositionUpdate -=
+                        thisAP->mPlay.mFrameUpdatePeriod) >= frameUpdatePeriod) {
+                    thisAP->mPlay.mFramesSincePositionUpdate %= frameUpdatePeriod;
+                }
+                headAtNewPos = true;
             }
-            headAtNewPos = true;
         }
-    }
-    if (0 < count) {
-        object_unlock_exclusive(&thisAP->mObject);
-        SLuint32 size = (SLuint32) (count * sizeof(short));
-        result = IBufferQueue_Enqueue(caller, pBuffer, size);
-        // not much we can do if the Enqueue fails, so we'll just drop the decoded data
-        if (SL_RESULT_SUCCESS != result) {
-            SL_LOGE("enqueue failed 0x%lx", result);
+        if (0 == thisAP->mBufferQueue.mState.count) {
+            if (eof) {
+                thisAP->mPlay.mState = SL_PLAYSTATE_PAUSED;
+                // this would result in a non-monotonically increasing position, so don't do it
+                // thisAP->mPlay.mPosition = thisAP->mPlay.mDuration;
+                attr = ATTR_TRANSPORT;
+            } else {
+                // the decoder fell behind
+                ++this->mUnderruns;
+            }
         }
-    } else {
-        thisAP->mPlay.mState = SL_PLAYSTATE_PAUSED;
-        this->mEOF = SL_BOOLEAN_TRUE;
-        // this would result in a non-monotonically increasing position, so don't do it
-        // thisAP->mPlay.mPosition = thisAP->mPlay.mDuration;
-        object_unlock_exclusive_attributes(&thisAP->mObject, ATTR_TRANSPORT);
     }
+    object_unlock_exclusive_attributes(&thisAP->mObject, attr);
+    SndFile_updatePrefetch(thisAP, eof);
     // callbacks are called with mutex unlocked
     if (NULL != callback) {
         if (headAtNewPos) {
@@ -113,12 +276,8 @@ SLboolean SndFile_IsSupported(const SF_INFO *sfinfo)
     default:
         return SL_BOOLEAN_FALSE;
     }
-    switch (sfinfo->samplerate) {
-    case 11025:
-    case 22050:
-    case 44100:
-        break;
-    default:
+    // the mixer resamples, so any plausible rate will do
+    if (!(1 <= sfinfo->samplerate && sfinfo->samplerate <= 192000)) {
         return SL_BOOLEAN_FALSE;
     }
     switch (sfinfo->channels) {
@@ -171,8 +330,12 @@ SLresult SndFile_checkAudioPlayerSourceSink(CAudioPlayer *this)
     }
     this->mSndFile.mWhich = 0;
     this->mSndFile.mSNDFILE = NULL;
-    // this->mSndFile.mMutex is initialized only when there is a valid mSNDFILE
+    // the mutexes and condition are initialized only when there is a valid mSNDFILE
     this->mSndFile.mEOF = SL_BOOLEAN_FALSE;
+    this->mSndFile.mShutdown = SL_BOOLEAN_FALSE;
+    this->mSndFile.mDecodeRequests = 0;
+    this->mSndFile.mUnderruns = 0;
+    this->mSndFile.mReportedLevel = 0;
 
     return SL_RESULT_SUCCESS;
 }
@@ -186,9 +349,6 @@ void audioPlayerTransportUpdate(CAudioPlayer *audioPlayer)
     if (NULL != audioPlayer->mSndFile.mSNDFILE) {
 
         object_lock_exclusive(&audioPlayer->mObject);
-        SLboolean empty = 0 == audioPlayer->mBufferQueue.mState.count;
-        // FIXME a made-up number that should depend on player state and prefetch status
-        audioPlayer->mPrefetchStatus.mLevel = 1000;
         SLmillisecond pos = audioPlayer->mSeek.mPos;
         if (SL_TIME_UNKNOWN != pos) {
             audioPlayer->mSeek.mPos = SL_TIME_UNKNOWN;
@@ -205,24 +365,29 @@ void audioPlayerTransportUpdate(CAudioPlayer *audioPlayer)
 
         if (SL_TIME_UNKNOWN != pos) {
 
+            // wait for any decode in progress, so that nothing for the old position is
+            // enqueued after the queue is cleared
+            pthread_mutex_lock(&audioPlayer->mSndFile.mDecodeMutex);
             // discard any enqueued buffers for the old position
             IBufferQueue_Clear(&audioPlayer->mBufferQueue.mItf);
-            empty = SL_BOOLEAN_TRUE;
-
-            pthread_mutex_lock(&audioPlayer->mSndFile.mMutex);
             // FIXME why void?
             (void) sf_seek(audioPlayer->mSndFile.mSNDFILE, (sf_count_t) (((long long) pos *
                 audioPlayer->mSndFile.mSfInfo.samplerate) / 1000LL), SEEK_SET);
-            audioPlayer->mSndFile.mEOF = SL_BOOLEAN_FALSE;
             audioPlayer->mSndFile.mWhich = 0;
+            pthread_mutex_lock(&audioPlayer->mSndFile.mMutex);
+            audioPlayer->mSndFile.mEOF = SL_BOOLEAN_FALSE;
             pthread_mutex_unlock(&audioPlayer->mSndFile.mMutex);
+            pthread_mutex_unlock(&audioPlayer->mSndFile.mDecodeMutex);
 
         }
 
-        // FIXME only on seek or play state change (STOPPED, PAUSED) -> PLAYING
-        if (empty) {
-            SndFile_Callback(&audioPlayer->mBufferQueue.mItf, audioPlayer);
-        }
+        // decoding continues in the background whatever the play state, so this is only needed
+        // after a seek or if the queue was drained, but is harmless otherwise
+        SndFile_requestDecode(audioPlayer);
+        pthread_mutex_lock(&audioPlayer->mSndFile.mMutex);
+        SLboolean eof = audioPlayer->mSndFile.mEOF;
+        pthread_mutex_unlock(&audioPlayer->mSndFile.mMutex);
+        SndFile_updatePrefetch(audioPlayer, eof);
 
     }
 
@@ -246,12 +411,19 @@ SLresult SndFile_Realize(CAudioPlayer *this)
             result = SL_RESULT_CONTENT_UNSUPPORTED;
         } else {
             int ok;
+            ok = pthread_mutex_init(&this->mSndFile.mDecodeMutex,
+                (const pthread_mutexattr_t *) NULL);
+            assert(0 == ok);
             ok = pthread_mutex_init(&this->mSndFile.mMutex, (const pthread_mutexattr_t *) NULL);
             assert(0 == ok);
+            ok = pthread_cond_init(&this->mSndFile.mCond, (const pthread_condattr_t *) NULL);
+            assert(0 == ok);
             SLBufferQueueItf bufferQueue = &this->mBufferQueue.mItf;
             IBufferQueue *thisBQ = (IBufferQueue *) bufferQueue;
             IBufferQueue_RegisterCallback(&thisBQ->mItf, SndFile_Callback, this);
-            this->mPrefetchStatus.mStatus = SL_PREFETCHSTATUS_SUFFICIENTDATA;
+            // the status becomes SL_PREFETCHSTATUS_SUFFICIENTDATA once the first buffer is queued
+            this->mPrefetchStatus.mStatus = SL_PREFETCHSTATUS_UNDERFLOW;
+            this->mPrefetchStatus.mLevel = 0;
             // this is the initial duration; will update when a new maximum position is detected
             this->mPlay.mDuration = (SLmillisecond) (((long long) this->mSndFile.mSfInfo.frames *
                 1000LL) / this->mSndFile.mSfInfo.samplerate);
@@ -261,21 +433,51 @@ SLresult SndFile_Realize(CAudioPlayer *this)
             this->mPlay.mFrameUpdatePeriod = ((long long) this->mPlay.mPositionUpdatePeriod *
                 (long long) this->mSampleRateMilliHz) / 1000000LL;
 #endif
+            // start filling the buffer queue now, so that playback can begin without waiting
+            SndFile_requestDecode(this);
         }
     }
     return result;
 }
 
 
+/** \brief Called by CAudioPlayer_PreDestroy with the object locked, to stop decoding and wait
+ *  for any decode closure still queued or running on the thread pool
+ */
+
+void SndFile_PreDestroy(CAudioPlayer *this)
+{
+    if (NULL != this->mSndFile.mSNDFILE) {
+        // the decode closure needs the object lock to enqueue
+        object_unlock_exclusive(&this->mObject);
+        pthread_mutex_lock(&this->mSndFile.mMutex);
+        this->mSndFile.mShutdown = SL_BOOLEAN_TRUE;
+        while (0 != this->mSndFile.mDecodeRequests) {
+            pthread_cond_wait(&this->mSndFile.mCond, &this->mSndFile.mMutex);
+        }
+        pthread_mutex_unlock(&this->mSndFile.mMutex);
+        object_lock_exclusive(&this->mObject);
+    }
+}
+
+
 /** \brief Called by CAudioPlayer_Destroy */
 
 void SndFile_Destroy(CAudioPlayer *this)
 {
     if (NULL != this->mSndFile.mSNDFILE) {
+        if (0 != this->mSndFile.mUnderruns) {
+            SL_LOGW("AudioPlayer %p: %lu underruns", this,
+                (unsigned long) this->mSndFile.mUnderruns);
+        }
         sf_close(this->mSndFile.mSNDFILE);
         this->mSndFile.mSNDFILE = NULL;
         int ok;
+        ok = pthread_cond_destroy(&this->mSndFile.mCond);
+        assert(0 == ok);
         ok = pthread_mutex_destroy(&this->mSndFile.mMutex);
         assert(0 == ok);
+        ok = pthread_mutex_destroy(&this->mSndFile.mDecodeMutex);
+        assert(0 == ok);
     }
 }
@@ -17,6 +17,143 @@
 /* ThreadPool */
 
 #include "sles_allinclusive.h"
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+// The ring buffer is the bounded multi-producer multi-consumer queue described by Dmitry Vyukov.
+// Each slot carries a sequence number: a slot at ring position pos is free for the producer
+// that claims pos when its sequence is pos, and holds a closure for the consumer that claims
+// pos when its sequence is pos + 1.  Producers and consumers claim positions with a
+// compare-and-swap on mEnqueuePos or mDequeuePos, so they only contend with their own kind.
+
+// Threads that find the ring buffer full or empty sleep on an EventCount: announce yourself
+// in mWaiters, re-check the condition, then futex wait on mSequence.  Whoever changes the
+// condition bumps mSequence and wakes a sleeper only if mWaiters is non-zero, so the
+// uncontended paths make no system calls.
+
+static void futex_wait(volatile int *addr, int value)
+{
+    (void) syscall(__NR_futex, addr, FUTEX_WAIT, value, NULL, NULL, 0);
+}
+
+static void futex_wake(volatile int *addr, int count)
+{
+    (void) syscall(__NR_futex, addr, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+// Called after making a waited-for condition true, to wake up to count sleepers
+
+static void EventCount_notify(EventCount *ec, int count)
+{
+    // order the caller's update to the ring buffer before the read of mWaiters
+    __sync_synchronize();
+    if (0 < ec->mWaiters) {
+        (void) __sync_fetch_and_add(&ec->mSequence, 1);
+        futex_wake(&ec->mSequence, count);
+    }
+}
+
+// Wake up all sleepers unconditionally
+
+static void EventCount_broadcast(EventCount *ec)
+{
+    (void) __sync_fetch_and_add(&ec->mSequence, 1);
+    futex_wake(&ec->mSequence, INT_MAX);
+}
+
+// Number of closures waiting for a worker thread.  This is only a snapshot, as producers and
+// consumers may be active, so it is suitable for statistics but not for synchronization.
+
+unsigned ThreadPool_depth(ThreadPool *tp)
+{
+    // read the dequeue position first, so that the difference can't be negative
+    unsigned dequeuePos = tp->mDequeuePos;
+    __sync_synchronize();
+    unsigned depth = tp->mEnqueuePos - dequeuePos;
+    return depth < tp->mMaxClosures ? depth : tp->mMaxClosures;
+}
+
+// Try to enqueue a closure, and return whether there was room
+
+static SLboolean ThreadPool_enqueue(ThreadPool *tp, void (*handler)(void *, int), void *context,
+    int parameter)
+{
+    unsigned mask = tp->mMaxClosures - 1;
+    unsigned pos = tp->mEnqueuePos;
+    ClosureSlot *slot;
+    for (;;) {
+        slot = &tp->mSlotArray[pos & mask];
+        int diff = (int) (slot->mSequence - pos);
+        if (0 == diff) {
+            // the compare-and-swap is a full barrier, so the slot isn't written too early
+            unsigned oldPos = __sync_val_compare_and_swap(&tp->mEnqueuePos, pos, pos + 1);
+            if (oldPos == pos)
+                break;
+            pos = oldPos;
+        } else if (0 > diff) {
+            // slot still holds the closure from one lap ago, so the ring buffer is full
+            return SL_BOOLEAN_FALSE;
+        } else {
+            // another producer claimed this position first
+            pos = tp->mEnqueuePos;
+        }
+    }
+    slot->mClosure.mHandler = handler;
+    slot->mClosure.mContext = context;
+    slot->mClosure.mParameter = parameter;
+    // publish the closure before handing the slot to consumers
+    __sync_synchronize();
+    slot->mSequence = pos + 1;
+    unsigned depth = ThreadPool_depth(tp);
+    unsigned maxDepth;
+    while (depth > (maxDepth = tp->mMaxDepth)) {
+        if (maxDepth == __sync_val_compare_and_swap(&tp->mMaxDepth, maxDepth, depth))
+            break;
+    }
+    return SL_BOOLEAN_TRUE;
+}
+
+// Try to dequeue a closure, and return whether there was one
+
+static SLboolean ThreadPool_dequeue(ThreadPool *tp, Closure *pClosure)
+{
+    unsigned mask = tp->mMaxClosures - 1;
+    unsigned pos = tp->mDequeuePos;
+    ClosureSlot *slot;
+    for (;;) {
+        slot = &tp->mSlotArray[pos & mask];
+        int diff = (int) (slot->mSequence - (pos + 1));
+        if (0 == diff) {
+            unsigned oldPos = __sync_val_compare_and_swap(&tp->mDequeuePos, pos, pos + 1);
+            if (oldPos == pos)
+                break;
+            pos = oldPos;
+        } else if (0 > diff) {
+            // ring buffer is empty
+            return SL_BOOLEAN_FALSE;
+        } else {
+            pos = tp->mDequeuePos;
+        }
+    }
+    *pClosure = slot->mClosure;
+    // finish reading the closure before handing the slot back to producers for the next lap
+    __sync_synchronize();
+    slot->mSequence = pos + mask + 1;
+    return SL_BOOLEAN_TRUE;
+}
+
+static SLboolean ThreadPool_isFull(ThreadPool *tp)
+{
+    unsigned pos = tp->mEnqueuePos;
+    return 0 > (int) (tp->mSlotArray[pos & (tp->mMaxClosures - 1)].mSequence - pos);
+}
+
+static SLboolean ThreadPool_isEmpty(ThreadPool *tp)
+{
+    unsigned pos = tp->mDequeuePos;
+    return 0 > (int) (tp->mSlotArray[pos & (tp->mMaxClosures - 1)].mSequence - (pos + 1));
+}
 
 // Entry point for each worker thread
 
@@ -24,32 +161,19 @@ static void *ThreadPool_start(void *context)
 {
     ThreadPool *tp = (ThreadPool *) context;
     assert(NULL != tp);
-    for (;;) {
-        Closure *pClosure = ThreadPool_remove(tp);
-        // closure is NULL when thread pool is being destroyed
-        if (NULL == pClosure)
-            break;
-        void (*handler)(void *, int);
-        handler = pClosure->mHandler;
-        void *context = pClosure->mContext;
-        int parameter = pClosure->mParameter;
-        free(pClosure);
-        assert(NULL != handler);
-        (*handler)(context, parameter);
+    Closure closure;
+    // closure is not available when thread pool is being destroyed
+    while (ThreadPool_remove(tp, &closure)) {
+        assert(NULL != closure.mHandler);
+        (*closure.mHandler)(closure.mContext, closure.mParameter);
     }
     return NULL;
 }
 
-#define INITIALIZED_NONE         0
-#define INITIALIZED_MUTEX        1
-#define INITIALIZED_CONDNOTFULL  2
-#define INITIALIZED_CONDNOTEMPTY 4
-#define INITIALIZED_ALL          7
-
-static void ThreadPool_deinit_internal(ThreadPool *tp, unsigned initialized, unsigned nThreads);
+static void ThreadPool_deinit_internal(ThreadPool *tp, unsigned nThreads);
 
 // Initialize a ThreadPool
-// maxClosures defaults to CLOSURE_TYPICAL if 0
+// maxClosures defaults to CLOSURE_TYPICAL if 0, and is rounded up to a power of 2
 // maxThreads defaults to THREAD_TYPICAL if 0
 
 SLresult ThreadPool_init(ThreadPool *tp, unsigned maxClosures, unsigned maxThreads)
@@ -57,50 +181,42 @@ SLresult ThreadPool_init(ThreadPool *tp, unsigned maxClosures, unsigned maxThrea
     assert(NULL != tp);
     memset(tp, 0, sizeof(ThreadPool));
     tp->mShutdown = SL_BOOLEAN_FALSE;
-    unsigned initialized = INITIALIZED_NONE;    // which objects were successfully initialized
     unsigned nThreads = 0;                      // number of threads successfully created
-    int err;
     SLresult result;
 
-    // initialize mutex and condition variables
-    err = pthread_mutex_init(&tp->mMutex, (const pthread_mutexattr_t *) NULL);
-    result = err_to_result(err);
-    if (SL_RESULT_SUCCESS != result)
-        goto fail;
-    initialized |= INITIALIZED_MUTEX;
-    err = pthread_cond_init(&tp->mCondNotFull, (const pthread_condattr_t *) NULL);
-    result = err_to_result(err);
-    if (SL_RESULT_SUCCESS != result)
-        goto fail;
-    initialized |= INITIALIZED_CONDNOTFULL;
-    err = pthread_cond_init(&tp->mCondNotEmpty, (const pthread_condattr_t *) NULL);
-    result = err_to_result(err);
-    if (SL_RESULT_SUCCESS != result)
-        goto fail;
-    initialized |= INITIALIZED_CONDNOTEMPTY;
-
     // use default values for parameters, if not specified explicitly
-    tp->mWaitingNotFull = 0;
-    tp->mWaitingNotEmpty = 0;
     if (0 == maxClosures)
         maxClosures = CLOSURE_TYPICAL;
-    tp->mMaxClosures = maxClosures;
+    unsigned size = 2;
+    while (size < maxClosures) {
+        size <<= 1;
+        if (0 == size) {
+            result = SL_RESULT_PARAMETER_INVALID;
+            goto fail;
+        }
+    }
+    tp->mMaxClosures = size;
     if (0 == maxThreads)
         maxThreads = THREAD_TYPICAL;
     tp->mMaxThreads = maxThreads;
 
-    // initialize circular buffer for closures
-    if (CLOSURE_TYPICAL >= maxClosures) {
-        tp->mClosureArray = tp->mClosureTypical;
+    // initialize ring buffer for closures
+    if (CLOSURE_TYPICAL >= size) {
+        tp->mSlotArray = tp->mSlotTypical;
     } else {
-        tp->mClosureArray = (Closure **) malloc((maxClosures + 1) * sizeof(Closure *));
-        if (NULL == tp->mClosureArray) {
+        tp->mSlotArray = (ClosureSlot *) malloc(size * sizeof(ClosureSlot));
+        if (NULL == tp->mSlotArray) {
             result = SL_RESULT_RESOURCE_ERROR;
             goto fail;
         }
     }
-    tp->mClosureFront = tp->mClosureArray;
-    tp->mClosureRear = tp->mClosureArray;
+    unsigned i;
+    for (i = 0; i < size; ++i) {
+        tp->mSlotArray[i].mSequence = i;
+    }
+    tp->mEnqueuePos = 0;
+    tp->mDequeuePos = 0;
+    tp->mMaxDepth = 0;
 
     // initialize thread pool
     if (THREAD_TYPICAL >= maxThreads) {
@@ -112,7 +228,6 @@ SLresult ThreadPool_init(ThreadPool *tp, unsigned maxClosures, unsigned maxThrea
             goto fail;
         }
     }
-    unsigned i;
     for (i = 0; i < maxThreads; ++i) {
         int err = pthread_create(&tp->mThreadArray[i], (const pthread_attr_t *) NULL,
             ThreadPool_start, tp);
@@ -121,83 +236,43 @@ SLresult ThreadPool_init(ThreadPool *tp, unsigned maxClosures, unsigned maxThrea
             goto fail;
         ++nThreads;
     }
-    tp->mInitialized = initialized;
+    tp->mInitialized = SL_BOOLEAN_TRUE;
 
     // done
     return SL_RESULT_SUCCESS;
 
     // here on any kind of error
 fail:
-    ThreadPool_deinit_internal(tp, initialized, nThreads);
+    ThreadPool_deinit_internal(tp, nThreads);
     return result;
 }
 
-static void ThreadPool_deinit_internal(ThreadPool *tp, unsigned initialized, unsigned nThreads)
+static void ThreadPool_deinit_internal(ThreadPool *tp, unsigned nThreads)
 {
     int ok;
 
     assert(NULL != tp);
     // Destroy all threads
     if (0 < nThreads) {
-        assert(INITIALIZED_ALL == initialized);
-        ok = pthread_mutex_lock(&tp->mMutex);
-        assert(0 == ok);
         tp->mShutdown = SL_BOOLEAN_TRUE;
-        ok = pthread_cond_broadcast(&tp->mCondNotEmpty);
-        assert(0 == ok);
-        ok = pthread_cond_broadcast(&tp->mCondNotFull);
-        assert(0 == ok);
-        ok = pthread_mutex_unlock(&tp->mMutex);
-        assert(0 == ok);
+        // order the store to mShutdown before the wakeups, see EventCount_notify
+        __sync_synchronize();
+        EventCount_broadcast(&tp->mNotEmpty);
+        EventCount_broadcast(&tp->mNotFull);
         unsigned i;
         for (i = 0; i < nThreads; ++i) {
             ok = pthread_join(tp->mThreadArray[i], (void **) NULL);
             assert(ok == 0);
         }
-
-        // Empty out the circular buffer of closures
-        ok = pthread_mutex_lock(&tp->mMutex);
-        assert(0 == ok);
-        assert(0 == tp->mWaitingNotEmpty);
-        Closure **oldFront = tp->mClosureFront;
-        while (oldFront != tp->mClosureRear) {
-            Closure **newFront = oldFront;
-            if (++newFront == &tp->mClosureArray[tp->mMaxClosures + 1])
-                newFront = tp->mClosureArray;
-            Closure *pClosure = *oldFront;
-            assert(NULL != pClosure);
-            *oldFront = NULL;
-            tp->mClosureFront = newFront;
-            ok = pthread_mutex_unlock(&tp->mMutex);
-            assert(0 == ok);
-            free(pClosure);
-            ok = pthread_mutex_lock(&tp->mMutex);
-            assert(0 == ok);
-        }
-        ok = pthread_mutex_unlock(&tp->mMutex);
-        assert(0 == ok);
-        // Note that we can't be sure when mWaitingNotFull will drop to zero
+        // Closures still in the ring buffer are discarded with it
+        // Note that we can't be sure when client threads waiting in ThreadPool_add will return
     }
+    tp->mInitialized = SL_BOOLEAN_FALSE;
 
-    // destroy the mutex and condition variables
-    if (initialized & INITIALIZED_CONDNOTEMPTY) {
-        ok = pthread_cond_destroy(&tp->mCondNotEmpty);
-        assert(0 == ok);
-    }
-    if (initialized & INITIALIZED_CONDNOTFULL) {
-        ok = pthread_cond_destroy(&tp->mCondNotFull);
-        assert(0 == ok);
-    }
-    if (initialized & INITIALIZED_MUTEX) {
-        ok = pthread_mutex_destroy(&tp->mMutex);
-        assert(0 == ok);
-    }
-    tp->mInitialized = INITIALIZED_NONE;
-
-    // release the closure circular buffer
-    if (tp->mClosureTypical != tp->mClosureArray && NULL != tp->mClosureArray) {
-        free(tp->mClosureArray);
-        tp->mClosureArray = NULL;
+    // release the closure ring buffer
+    if (tp->mSlotTypical != tp->mSlotArray && NULL != tp->mSlotArray) {
+        free(tp->mSlotArray);
+        tp->mSlotArray = NULL;
     }
 
     // release the thread pool
@@ -210,7 +285,7 @@ static void ThreadPool_deinit_internal(ThreadPool *tp, unsigned initialized, uns
 
 void ThreadPool_deinit(ThreadPool *tp)
 {
-    ThreadPool_deinit_internal(tp, tp->mInitialized, tp->mMaxThreads);
+    ThreadPool_deinit_internal(tp, tp->mInitialized ? tp->mMaxThreads : 0);
 }
 
 // Enqueue a closure to be executed later by a worker thread
@@ -218,100 +293,59 @@ SLresult ThreadPool_add(ThreadPool *tp, void (*handler)(void *, int), void *cont
 {
     assert(NULL != tp);
     assert(NULL != handler);
-    Closure *closure = (Closure *) malloc(sizeof(Closure));
-    if (NULL == closure)
-        return SL_RESULT_RESOURCE_ERROR;
-    closure->mHandler = handler;
-    closure->mContext = context;
-    closure->mParameter = parameter;
-    int ok;
-    ok = pthread_mutex_lock(&tp->mMutex);
-    assert(0 == ok);
-    // can't enqueue while thread pool shutting down
-    if (tp->mShutdown) {
-        ok = pthread_mutex_unlock(&tp->mMutex);
-        assert(0 == ok);
-        free(closure);
-        return SL_RESULT_PRECONDITIONS_VIOLATED;
-    }
     for (;;) {
-        Closure **oldRear = tp->mClosureRear;
-        Closure **newRear = oldRear;
-        if (++newRear == &tp->mClosureArray[tp->mMaxClosures + 1])
-            newRear = tp->mClosureArray;
-        // if closure circular buffer is full, then wait for it to become non-full
-        if (newRear == tp->mClosureFront) {
-            ++tp->mWaitingNotFull;
-            ok = pthread_cond_wait(&tp->mCondNotFull, &tp->mMutex);
-            assert(0 == ok);
-            // can't enqueue while thread pool shutting down
-            if (tp->mShutdown) {
-                assert(0 < tp->mWaitingNotFull);
-                --tp->mWaitingNotFull;
-                ok = pthread_mutex_unlock(&tp->mMutex);
-                assert(0 == ok);
-                free(closure);
-                return SL_RESULT_PRECONDITIONS_VIOLATED;
-            }
-            continue;
-        }
-        assert(NULL == *oldRear);
-        *oldRear = closure;
-        tp->mClosureRear = newRear;
-        // if a worker thread was waiting to dequeue, then suggest that it try again
-        if (0 < tp->mWaitingNotEmpty) {
-            --tp->mWaitingNotEmpty;
-            ok = pthread_cond_signal(&tp->mCondNotEmpty);
-            assert(0 == ok);
-        }
-        break;
+        // can't enqueue while thread pool shutting down
+        if (tp->mShutdown)
+            return SL_RESULT_PRECONDITIONS_VIOLATED;
+        if (ThreadPool_enqueue(tp, handler, context, parameter))
+            break;
+        // if closure ring buffer is full, then wait for it to become non-full
+        int seen = tp->mNotFull.mSequence;
+        (void) __sync_fetch_and_add(&tp->mNotFull.mWaiters, 1);
+        if (!tp->mShutdown && ThreadPool_isFull(tp))
+            futex_wait(&tp->mNotFull.mSequence, seen);
+        (void) __sync_fetch_and_sub(&tp->mNotFull.mWaiters, 1);
     }
-    ok = pthread_mutex_unlock(&tp->mMutex);
-    assert(0 == ok);
+    // if a worker thread was waiting to dequeue, then suggest that it try again
+    EventCount_notify(&tp->mNotEmpty, 1);
     return SL_RESULT_SUCCESS;
 }
 
-// Called by a worker thread when it is ready to accept the next closure to execute
-Closure *ThreadPool_remove(ThreadPool *tp)
+// Enqueue a closure without waiting, for callers such as the mixer that must not block.
+// Fails with SL_RESULT_RESOURCE_ERROR if the closure ring buffer is full.
+SLresult ThreadPool_tryAdd(ThreadPool *tp, void (*handler)(void *, int), void *context,
+    int parameter)
 {
-    Closure *pClosure;
-    int ok;
-    ok = pthread_mutex_lock(&tp->mMutex);
-    assert(0 == ok);
+    assert(NULL != tp);
+    assert(NULL != handler);
+    if (tp->mShutdown)
+        return SL_RESULT_PRECONDITIONS_VIOLATED;
+    if (!ThreadPool_enqueue(tp, handler, context, parameter))
+        return SL_RESULT_RESOURCE_ERROR;
+    EventCount_notify(&tp->mNotEmpty, 1);
+    return SL_RESULT_SUCCESS;
+}
+
+// Called by a worker thread when it is ready to accept the next closure to execute.
+// Returns false if the thread pool is being destroyed.
+SLboolean ThreadPool_remove(ThreadPool *tp, Closure *pClosure)
+{
+    assert(NULL != tp);
+    assert(NULL != pClosure);
     for (;;) {
-        Closure **oldFront = tp->mClosureFront;
-        // if closure circular buffer is empty, then wait for it to become non-empty
-        if (oldFront == tp->mClosureRear) {
-            ++tp->mWaitingNotEmpty;
-            ok = pthread_cond_wait(&tp->mCondNotEmpty, &tp->mMutex);
-            assert(0 == ok);
-            // fail if thread pool is shutting down
-            if (tp->mShutdown) {
-                assert(0 < tp->mWaitingNotEmpty);
-                --tp->mWaitingNotEmpty;
-                pClosure = NULL;
-                break;
-            }
-            // try again
-            continue;
-        }
-        // dequeue the closure at front of circular buffer
-        Closure **newFront = oldFront;
-        if (++newFront == &tp->mClosureArray[tp->mMaxClosures + 1])
-            newFront = tp->mClosureArray;
-        pClosure = *oldFront;
-        assert(NULL != pClosure);
-        *oldFront = NULL;
-        tp->mClosureFront = newFront;
-        // if a client thread was waiting to enqueue, then suggest that it try again
-        if (0 < tp->mWaitingNotFull) {
-            --tp->mWaitingNotFull;
-            ok = pthread_cond_signal(&tp->mCondNotFull);
-            assert(0 == ok);
-        }
-        break;
+        // fail if thread pool is shutting down; any remaining closures are discarded
+        if (tp->mShutdown)
+            return SL_BOOLEAN_FALSE;
+        if (ThreadPool_dequeue(tp, pClosure))
+            break;
+        // if closure ring buffer is empty, then wait for it to become non-empty
+        int seen = tp->mNotEmpty.mSequence;
+        (void) __sync_fetch_and_add(&tp->mNotEmpty.mWaiters, 1);
+        if (!tp->mShutdown && ThreadPool_isEmpty(tp))
+            futex_wait(&tp->mNotEmpty.mSequence, seen);
+        (void) __sync_fetch_and_sub(&tp->mNotEmpty.mWaiters, 1);
     }
-    ok = pthread_mutex_unlock(&tp->mMutex);
-    assert(0 == ok);
-    return pClosure;
+    // if a client thread was waiting to enqueue, then suggest that it try again
+    EventCount_notify(&tp->mNotFull, 1);
+    return SL_BOOLEAN_TRUE;
 }
@@ -24,23 +24,39 @@ typedef struct {
     int mParameter;
 } Closure;
 
-/** \brief ThreadPool manages a pool of worker threads that execute Closures */
+/** \brief ClosureSlot is one preallocated entry of the closure ring buffer */
 
 typedef struct {
-    unsigned mInitialized; ///< Indicates which of the following 3 fields are initialized
-    pthread_mutex_t mMutex;
-    pthread_cond_t mCondNotFull;    ///< Signalled when a client thread could be unblocked
-    pthread_cond_t mCondNotEmpty;   ///< Signalled when a worker thread could be unblocked
-    SLboolean mShutdown;   ///< Whether shutdown of thread pool has been requested
-    unsigned mWaitingNotFull;   ///< Number of client threads waiting to enqueue
-    unsigned mWaitingNotEmpty;  ///< Number of worker threads waiting to dequeue
-    unsigned mMaxClosures;  ///< Number of slots in circular buffer for closures, not counting spare
+    volatile unsigned mSequence;    ///< Ring position this slot is next ready to be enqueued at
+    Closure mClosure;
+} ClosureSlot;
+
+/** \brief EventCount lets threads sleep until a condition might have changed, without a mutex */
+
+typedef struct {
+    volatile int mSequence; ///< Bumped on every notification; also the futex word
+    volatile int mWaiters;  ///< Number of threads that are about to sleep, or sleeping
+} EventCount;
+
+/** \brief ThreadPool manages a pool of worker threads that execute Closures.
+ *  Closures are kept in a bounded lock-free multi-producer multi-consumer ring buffer;
+ *  clients wait when it is full, and workers wait when it is empty.
+ */
+
+typedef struct {
+    SLboolean mInitialized; ///< Whether the worker threads were started
+    volatile SLboolean mShutdown;   ///< Whether shutdown of thread pool has been requested
+    unsigned mMaxClosures;  ///< Number of slots in the ring buffer, a power of 2
     unsigned mMaxThreads;   ///< Number of worker threads
-    Closure **mClosureArray;    ///< The circular buffer of closures
-    Closure **mClosureFront, **mClosureRear;
+    ClosureSlot *mSlotArray;    ///< The ring buffer of closures
+    volatile unsigned mEnqueuePos;  ///< Ring position of next closure to be added
+    volatile unsigned mDequeuePos;  ///< Ring position of next closure to be removed
+    volatile unsigned mMaxDepth;    ///< Most closures ever waiting at once, for statistics
+    EventCount mNotFull;    ///< Notified when a client thread could be unblocked
+    EventCount mNotEmpty;   ///< Notified when a worker thread could be unblocked
     /// Saves a malloc in the typical case
-#define CLOSURE_TYPICAL 15
-    Closure *mClosureTypical[CLOSURE_TYPICAL+1];
+#define CLOSURE_TYPICAL 16
+    ClosureSlot mSlotTypical[CLOSURE_TYPICAL];
     pthread_t *mThreadArray;    ///< The worker threads
 #ifdef ANDROID
 #define THREAD_TYPICAL 0
@@ -54,4 +70,7 @@ extern SLresult ThreadPool_init(ThreadPool *tp, unsigned maxClosures, unsigned m
 extern void ThreadPool_deinit(ThreadPool *tp);
 extern SLresult ThreadPool_add(ThreadPool *tp, void (*handler)(void *, int), void *context,
     int parameter);
-extern Closure *ThreadPool_remove(ThreadPool *tp);
+extern SLresult ThreadPool_tryAdd(ThreadPool *tp, void (*handler)(void *, int), void *context,
+    int parameter);
+extern SLboolean ThreadPool_remove(ThreadPool *tp, Closure *pClosure);
+extern unsigned ThreadPool_depth(ThreadPool *tp);
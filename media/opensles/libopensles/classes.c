@@ -340,6 +340,7 @@ static const struct iid_vtable OutputMix_interfaces[INTERFACES_OutputMix] = {
     {MPH_VOLUME, INTERFACE_OPTIONAL, offsetof(COutputMix, mVolume)},
     {MPH_BASSBOOST, INTERFACE_DYNAMIC, offsetof(COutputMix, mBassBoost)},
     {MPH_VISUALIZATION, INTERFACE_OPTIONAL, offsetof(COutputMix, mVisualization)},
+    {MPH_ANDROIDMIXSTATS, INTERFACE_DYNAMIC, offsetof(COutputMix, mAndroidMixStats)},
 #ifdef ANDROID
     {MPH_ANDROIDEFFECT, INTERFACE_EXPLICIT, offsetof(COutputMix, mAndroidEffect)},
 #endif
@@ -0,0 +1,527 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Software audio effects */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "effects.h"
+
+// Blocks are processed in slices of FX_SLICE frames.  Ramped parameters take one step
+// towards their target per slice, and filter coefficients are only redesigned between slices.
+// Gains are also interpolated linearly within a slice.  The inner loops keep both channels,
+// or all reverb lines, in small arrays so that the compiler can process them as vectors.
+
+#define FX_SLICE 32
+// Fraction of the remaining distance to the target covered per slice, about 6 ms at 44.1 kHz
+#define FX_RAMP_RATE 0.125f
+#define BASSBOOST_FREQUENCY 120.0f
+#define BASSBOOST_MAX_DB 12.0f
+// Side gain at full virtualizer strength, less one
+#define VIRTUALIZER_MAX_WIDTH 1.0f
+#define MAX_REFLECTIONS_DELAY_MS 300
+#define MAX_REVERB_DELAY_MS 100
+
+// Delay line lengths in frames at 44.1 kHz, mutually prime so the echoes don't line up
+static const unsigned reverbLineLengths[FX_REVERB_LINES] = { 1687, 1601, 2053, 2251 };
+static const unsigned reverbAllpassLengths[2] = { 142, 379 };
+
+
+/** \brief Take one step towards the target, and return the value for the end of the slice */
+
+static float ramp_step(FxRamp *ramp, float epsilon)
+{
+    float diff = ramp->mTarget - ramp->mValue;
+    if (fabsf(diff) <= epsilon) {
+        ramp->mValue = ramp->mTarget;
+    } else {
+        ramp->mValue += diff * FX_RAMP_RATE;
+    }
+    return ramp->mValue;
+}
+
+static void ramp_set(FxRamp *ramp, float value)
+{
+    ramp->mValue = ramp->mTarget = value;
+}
+
+static float millibelToGain(int millibel)
+{
+    return powf(10.0f, millibel / 2000.0f);
+}
+
+
+static void biquad_reset(FxBiquad *bq)
+{
+    bq->mZ1[0] = bq->mZ1[1] = bq->mZ2[0] = bq->mZ2[1] = 0.0f;
+}
+
+static void biquad_setCoefs(FxBiquad *bq, double b0, double b1, double b2, double a0, double a1,
+    double a2)
+{
+    bq->mB0 = (float) (b0 / a0);
+    bq->mB1 = (float) (b1 / a0);
+    bq->mB2 = (float) (b2 / a0);
+    bq->mA1 = (float) (a1 / a0);
+    bq->mA2 = (float) (a2 / a0);
+}
+
+/** \brief Design a peaking filter, from the Audio EQ Cookbook by Robert Bristow-Johnson */
+
+static void biquad_peaking(FxBiquad *bq, double sampleRate, double center, double q, double db)
+{
+    double A = pow(10.0, db / 40.0);
+    double w0 = 2.0 * M_PI * center / sampleRate;
+    double alpha = sin(w0) / (2.0 * q);
+    double cosw0 = cos(w0);
+    biquad_setCoefs(bq, 1.0 + alpha * A, -2.0 * cosw0, 1.0 - alpha * A,
+        1.0 + alpha / A, -2.0 * cosw0, 1.0 - alpha / A);
+}
+
+/** \brief Design a low shelving filter with a slope of 1, from the same cookbook */
+
+static void biquad_lowShelf(FxBiquad *bq, double sampleRate, double corner, double db)
+{
+    double A = pow(10.0, db / 40.0);
+    double w0 = 2.0 * M_PI * corner / sampleRate;
+    double cosw0 = cos(w0);
+    // alpha = sin(w0) / 2 * sqrt(2) for a shelf slope of 1
+    double twoSqrtAAlpha = sqrt(A) * sin(w0) * M_SQRT2;
+    biquad_setCoefs(bq,
+        A * ((A + 1.0) - (A - 1.0) * cosw0 + twoSqrtAAlpha),
+        2.0 * A * ((A - 1.0) - (A + 1.0) * cosw0),
+        A * ((A + 1.0) - (A - 1.0) * cosw0 - twoSqrtAAlpha),
+        (A + 1.0) + (A - 1.0) * cosw0 + twoSqrtAAlpha,
+        -2.0 * ((A - 1.0) + (A + 1.0) * cosw0),
+        (A + 1.0) + (A - 1.0) * cosw0 - twoSqrtAAlpha);
+}
+
+static void biquad_process(FxBiquad *bq, float *buffer, unsigned frames)
+{
+    const float b0 = bq->mB0, b1 = bq->mB1, b2 = bq->mB2, a1 = bq->mA1, a2 = bq->mA2;
+    float z1[2] = { bq->mZ1[0], bq->mZ1[1] };
+    float z2[2] = { bq->mZ2[0], bq->mZ2[1] };
+    unsigned i, c;
+    for (i = 0; i < frames; ++i, buffer += 2) {
+        for (c = 0; c < 2; ++c) {
+            float x = buffer[c];
+            float y = b0 * x + z1[c];
+            z1[c] = b1 * x - a1 * y + z2[c];
+            z2[c] = b2 * x - a2 * y;
+            buffer[c] = y;
+        }
+    }
+    // flush state that has decayed to denormals, which are very slow on some CPUs
+    for (c = 0; c < 2; ++c) {
+        bq->mZ1[c] = fabsf(z1[c]) < 1e-15f ? 0.0f : z1[c];
+        bq->mZ2[c] = fabsf(z2[c]) < 1e-15f ? 0.0f : z2[c];
+    }
+}
+
+
+void FxEqualizer_init(FxEqualizer *eq, unsigned sampleRate, unsigned numBands)
+{
+    memset(eq, 0, sizeof(FxEqualizer));
+    eq->mSampleRate = sampleRate;
+    eq->mNumBands = numBands < FX_EQ_BANDS ? numBands : FX_EQ_BANDS;
+    unsigned band;
+    for (band = 0; band < FX_EQ_BANDS; ++band) {
+        eq->mCenter[band] = 1000.0f;
+        eq->mQ[band] = 1.0f;
+        // a peaking filter at 0 dB is the identity
+        biquad_setCoefs(&eq->mSections[band], 1.0, 0.0, 0.0, 1.0, 0.0, 0.0);
+    }
+}
+
+void FxEqualizer_setBand(FxEqualizer *eq, unsigned band, float centerHz, float bandwidthHz)
+{
+    if (band < eq->mNumBands) {
+        // keep clear of the Nyquist frequency, where the design degenerates
+        float nyquist = eq->mSampleRate * 0.5f;
+        float center = centerHz < nyquist * 0.9f ? centerHz : nyquist * 0.9f;
+        float q = bandwidthHz > 0.0f ? centerHz / bandwidthHz : 1.0f;
+        if (center != eq->mCenter[band] || q != eq->mQ[band]) {
+            eq->mCenter[band] = center;
+            eq->mQ[band] = q;
+            // force a redesign
+            eq->mDesignedDb[band] = -1000.0f;
+        }
+    }
+}
+
+void FxEqualizer_setLevel(FxEqualizer *eq, unsigned band, int16_t millibel)
+{
+    if (band < eq->mNumBands) {
+        // levels set while disabled are dropped, so set them again after enabling
+        eq->mGainDb[band].mTarget = eq->mEnabled ? millibel / 100.0f : 0.0f;
+    }
+}
+
+void FxEqualizer_setEnabled(FxEqualizer *eq, int enabled)
+{
+    if (!enabled) {
+        unsigned band;
+        for (band = 0; band < eq->mNumBands; ++band) {
+            eq->mGainDb[band].mTarget = 0.0f;
+        }
+    }
+    eq->mEnabled = enabled;
+}
+
+int FxEqualizer_isActive(const FxEqualizer *eq)
+{
+    unsigned band;
+    for (band = 0; band < eq->mNumBands; ++band) {
+        if (0.0f != eq->mGainDb[band].mValue || 0.0f != eq->mGainDb[band].mTarget) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void FxEqualizer_process(FxEqualizer *eq, float *buffer, unsigned frames)
+{
+    while (frames > 0) {
+        unsigned slice = frames < FX_SLICE ? frames : FX_SLICE;
+        unsigned band;
+        for (band = 0; band < eq->mNumBands; ++band) {
+            FxBiquad *section = &eq->mSections[band];
+            float db = ramp_step(&eq->mGainDb[band], 0.01f);
+            if (db != eq->mDesignedDb[band]) {
+                biquad_peaking(section, eq->mSampleRate, eq->mCenter[band], eq->mQ[band], db);
+                eq->mDesignedDb[band] = db;
+            }
+            if (0.0f != db) {
+                biquad_process(section, buffer, slice);
+            } else {
+                // a flat band is skipped, so start afresh when it is next used
+                biquad_reset(section);
+            }
+        }
+        buffer += slice * 2;
+        frames -= slice;
+    }
+}
+
+
+void FxBassBoost_init(FxBassBoost *bb, unsigned sampleRate)
+{
+    memset(bb, 0, sizeof(FxBassBoost));
+    bb->mSampleRate = sampleRate;
+    biquad_setCoefs(&bb->mShelf, 1.0, 0.0, 0.0, 1.0, 0.0, 0.0);
+}
+
+void FxBassBoost_setStrength(FxBassBoost *bb, int16_t permille)
+{
+    bb->mGainDb.mTarget = bb->mEnabled ? permille * (BASSBOOST_MAX_DB / 1000.0f) : 0.0f;
+}
+
+void FxBassBoost_setEnabled(FxBassBoost *bb, int enabled)
+{
+    if (!enabled) {
+        bb->mGainDb.mTarget = 0.0f;
+    }
+    bb->mEnabled = enabled;
+}
+
+int FxBassBoost_isActive(const FxBassBoost *bb)
+{
+    return 0.0f != bb->mGainDb.mValue || 0.0f != bb->mGainDb.mTarget;
+}
+
+void FxBassBoost_process(FxBassBoost *bb, float *buffer, unsigned frames)
+{
+    while (frames > 0) {
+        unsigned slice = frames < FX_SLICE ? frames : FX_SLICE;
+        float db = ramp_step(&bb->mGainDb, 0.01f);
+        if (db != bb->mDesignedDb) {
+            biquad_lowShelf(&bb->mShelf, bb->mSampleRate, BASSBOOST_FREQUENCY, db);
+            bb->mDesignedDb = db;
+        }
+        if (0.0f != db) {
+            biquad_process(&bb->mShelf, buffer, slice);
+        } else {
+            biquad_reset(&bb->mShelf);
+        }
+        buffer += slice * 2;
+        frames -= slice;
+    }
+}
+
+
+void FxVirtualizer_init(FxVirtualizer *virt)
+{
+    memset(virt, 0, sizeof(FxVirtualizer));
+}
+
+void FxVirtualizer_setStrength(FxVirtualizer *virt, int16_t permille)
+{
+    virt->mWidth.mTarget = virt->mEnabled ? permille * (VIRTUALIZER_MAX_WIDTH / 1000.0f) : 0.0f;
+}
+
+void FxVirtualizer_setEnabled(FxVirtualizer *virt, int enabled)
+{
+    if (!enabled) {
+        virt->mWidth.mTarget = 0.0f;
+    }
+    virt->mEnabled = enabled;
+}
+
+int FxVirtualizer_isActive(const FxVirtualizer *virt)
+{
+    return 0.0f != virt->mWidth.mValue || 0.0f != virt->mWidth.mTarget;
+}
+
+void FxVirtualizer_process(FxVirtualizer *virt, float *buffer, unsigned frames)
+{
+    while (frames > 0) {
+        unsigned slice = frames < FX_SLICE ? frames : FX_SLICE;
+        float start = virt->mWidth.mValue;
+        float end = ramp_step(&virt->mWidth, 0.0001f);
+        float width = start, step = (end - start) / slice;
+        unsigned i;
+        for (i = 0; i < slice; ++i, buffer += 2) {
+            width += step;
+            float mid = (buffer[0] + buffer[1]) * 0.5f;
+            float side = (buffer[0] - buffer[1]) * 0.5f * (1.0f + width);
+            buffer[0] = mid + side;
+            buffer[1] = mid - side;
+        }
+        frames -= slice;
+    }
+}
+
+
+int FxReverb_init(FxReverb *rev, unsigned sampleRate)
+{
+    memset(rev, 0, sizeof(FxReverb));
+    rev->mSampleRate = sampleRate;
+    double scale = sampleRate / 44100.0;
+    int ok = 1;
+    rev->mPreDelayLength = (MAX_REFLECTIONS_DELAY_MS + MAX_REVERB_DELAY_MS) * sampleRate / 1000
+        + 2;
+    rev->mPreDelay = (float *) calloc(rev->mPreDelayLength * 2, sizeof(float));
+    ok = ok && NULL != rev->mPreDelay;
+    unsigned i;
+    for (i = 0; i < 2; ++i) {
+        rev->mAllpassLength[i] = (unsigned) (reverbAllpassLengths[i] * scale) + 1;
+        rev->mAllpass[i] = (float *) calloc(rev->mAllpassLength[i], sizeof(float));
+        ok = ok && NULL != rev->mAllpass[i];
+    }
+    for (i = 0; i < FX_REVERB_LINES; ++i) {
+        rev->mLineLength[i] = (unsigned) (reverbLineLengths[i] * scale) + 1;
+        rev->mLines[i] = (float *) calloc(rev->mLineLength[i], sizeof(float));
+        ok = ok && NULL != rev->mLines[i];
+    }
+    if (!ok) {
+        FxReverb_deinit(rev);
+        return -1;
+    }
+    // start silent, with the default I3DL2 settings
+    static const FxReverbSettings defaults = { -10000, 0, 1000, 500, -10000, 20, -10000, 40, 1000 };
+    FxReverb_setSettings(rev, &defaults);
+    ramp_set(&rev->mReflectionsGain, rev->mReflectionsGain.mTarget);
+    ramp_set(&rev->mReverbGain, rev->mReverbGain.mTarget);
+    ramp_set(&rev->mInputLowpass, rev->mInputLowpass.mTarget);
+    ramp_set(&rev->mDiffusion, rev->mDiffusion.mTarget);
+    ramp_set(&rev->mReflectionsDelay, rev->mReflectionsDelay.mTarget);
+    ramp_set(&rev->mReverbDelay, rev->mReverbDelay.mTarget);
+    for (i = 0; i < FX_REVERB_LINES; ++i) {
+        ramp_set(&rev->mFeedback[i], rev->mFeedback[i].mTarget);
+        ramp_set(&rev->mDamping[i], rev->mDamping[i].mTarget);
+    }
+    return 0;
+}
+
+void FxReverb_deinit(FxReverb *rev)
+{
+    free(rev->mPreDelay);
+    rev->mPreDelay = NULL;
+    unsigned i;
+    for (i = 0; i < 2; ++i) {
+        free(rev->mAllpass[i]);
+        rev->mAllpass[i] = NULL;
+    }
+    for (i = 0; i < FX_REVERB_LINES; ++i) {
+        free(rev->mLines[i]);
+        rev->mLines[i] = NULL;
+    }
+}
+
+void FxReverb_setSettings(FxReverb *rev, const FxReverbSettings *settings)
+{
+    rev->mSettings = *settings;
+    float fs = (float) rev->mSampleRate;
+    rev->mReflectionsGain.mTarget =
+        millibelToGain(settings->mRoomLevel + settings->mReflectionsLevel);
+    rev->mReverbGain.mTarget = millibelToGain(settings->mRoomLevel + settings->mReverbLevel);
+    // roomHFLevel is the attenuation of high frequencies going into the room
+    float hfGain = millibelToGain(settings->mRoomHFLevel);
+    rev->mInputLowpass.mTarget = hfGain < 0.05f ? 0.95f : 1.0f - hfGain;
+    rev->mDiffusion.mTarget = settings->mDiffusion * (0.7f / 1000.0f);
+    unsigned reflectionsDelay = settings->mReflectionsDelay < MAX_REFLECTIONS_DELAY_MS ?
+        settings->mReflectionsDelay : MAX_REFLECTIONS_DELAY_MS;
+    unsigned reverbDelay = settings->mReverbDelay < MAX_REVERB_DELAY_MS ?
+        settings->mReverbDelay : MAX_REVERB_DELAY_MS;
+    rev->mReflectionsDelay.mTarget = reflectionsDelay * fs / 1000.0f;
+    rev->mReverbDelay.mTarget = reverbDelay * fs / 1000.0f;
+    // per line gains for a decay of 60 dB in decayTime, and in decayTime * decayHFRatio at
+    // high frequencies; the lowpass can only make high frequencies decay faster
+    float decay = (settings->mDecayTime > 100 ? settings->mDecayTime : 100) / 1000.0f;
+    float hfRatio = settings->mDecayHFRatio / 1000.0f;
+    if (hfRatio > 1.0f) {
+        hfRatio = 1.0f;
+    } else if (hfRatio < 0.1f) {
+        hfRatio = 0.1f;
+    }
+    unsigned i;
+    for (i = 0; i < FX_REVERB_LINES; ++i) {
+        float length = (float) rev->mLineLength[i];
+        float g = powf(10.0f, -3.0f * length / (decay * fs));
+        float gHF = powf(10.0f, -3.0f * length / (decay * hfRatio * fs));
+        rev->mFeedback[i].mTarget = g;
+        rev->mDamping[i].mTarget = (g - gHF) / (g + gHF);
+    }
+}
+
+int FxReverb_isActive(const FxReverb *rev)
+{
+    return 0 < rev->mTailFrames;
+}
+
+/** \brief Read the stereo pre-delay line delay frames ago, with linear interpolation */
+
+static void preDelay_read(const FxReverb *rev, float delay, float out[2])
+{
+    unsigned whole = (unsigned) delay;
+    float frac = delay - whole;
+    unsigned length = rev->mPreDelayLength;
+    unsigned pos0 = (rev->mPreDelayPos + length - whole) % length;
+    unsigned pos1 = (pos0 + length - 1) % length;
+    const float *line = rev->mPreDelay;
+    out[0] = line[2 * pos0] + (line[2 * pos1] - line[2 * pos0]) * frac;
+    out[1] = line[2 * pos0 + 1] + (line[2 * pos1 + 1] - line[2 * pos0 + 1]) * frac;
+}
+
+void FxReverb_process(FxReverb *rev, const float *input, float *output, unsigned frames)
+{
+    if (NULL != input) {
+        // the tail lasts the pre-delay plus the time to decay by 60 dB
+        rev->mTailFrames = (unsigned) (rev->mReflectionsDelay.mTarget + rev->mReverbDelay.mTarget)
+            + (rev->mSettings.mDecayTime > 100 ? rev->mSettings.mDecayTime : 100)
+            * rev->mSampleRate / 1000 + frames;
+    }
+    rev->mTailFrames = rev->mTailFrames > frames ? rev->mTailFrames - frames : 0;
+    static const float lineSigns[FX_REVERB_LINES] = { 1.0f, -1.0f, 1.0f, -1.0f };
+    while (frames > 0) {
+        unsigned slice = frames < FX_SLICE ? frames : FX_SLICE;
+        float reflectionsGain = rev->mReflectionsGain.mValue;
+        float reverbGain = rev->mReverbGain.mValue;
+        float reflectionsStep = (ramp_step(&rev->mReflectionsGain, 1e-6f) - reflectionsGain)
+            / slice;
+        float reverbStep = (ramp_step(&rev->mReverbGain, 1e-6f) - reverbGain) / slice;
+        float lowpass = ramp_step(&rev->mInputLowpass, 1e-4f);
+        float diffusion = ramp_step(&rev->mDiffusion, 1e-4f);
+        float reflectionsDelay = ramp_step(&rev->mReflectionsDelay, 0.01f);
+        float tailDelay = reflectionsDelay + ramp_step(&rev->mReverbDelay, 0.01f);
+        float feedback[FX_REVERB_LINES], damping[FX_REVERB_LINES], inGain[FX_REVERB_LINES];
+        unsigned i, j;
+        for (j = 0; j < FX_REVERB_LINES; ++j) {
+            feedback[j] = ramp_step(&rev->mFeedback[j], 1e-6f);
+            damping[j] = ramp_step(&rev->mDamping[j], 1e-5f);
+            // the damping lowpass has unity gain at DC once scaled by (1 - damping)
+            inGain[j] = feedback[j] * (1.0f - damping[j]);
+        }
+        for (i = 0; i < slice; ++i, output += 2) {
+            // input filter, then into the pre-delay line
+            float in[2] = { 0.0f, 0.0f };
+            if (NULL != input) {
+                in[0] = input[0];
+                in[1] = input[1];
+                input += 2;
+            }
+            rev->mInputState[0] += (in[0] - rev->mInputState[0]) * (1.0f - lowpass);
+            rev->mInputState[1] += (in[1] - rev->mInputState[1]) * (1.0f - lowpass);
+            rev->mPreDelayPos = rev->mPreDelayPos + 1 < rev->mPreDelayLength ?
+                rev->mPreDelayPos + 1 : 0;
+            rev->mPreDelay[2 * rev->mPreDelayPos] = rev->mInputState[0];
+            rev->mPreDelay[2 * rev->mPreDelayPos + 1] = rev->mInputState[1];
+
+            // one early reflection
+            float early[2], late[2];
+            preDelay_read(rev, reflectionsDelay, early);
+            reflectionsGain += reflectionsStep;
+
+            // diffuse the late input with two allpass filters in series
+            preDelay_read(rev, tailDelay, late);
+            float x = (late[0] + late[1]) * 0.5f;
+            for (j = 0; j < 2; ++j) {
+                float *ap = &rev->mAllpass[j][rev->mAllpassPos[j]];
+                float y = *ap - diffusion * x;
+                *ap = x + diffusion * y;
+                rev->mAllpassPos[j] = rev->mAllpassPos[j] + 1 < rev->mAllpassLength[j] ?
+                    rev->mAllpassPos[j] + 1 : 0;
+                x = y;
+            }
+
+            // feedback delay network: damp each line, then mix with a Householder reflection
+            float state[FX_REVERB_LINES], sum = 0.0f;
+            for (j = 0; j < FX_REVERB_LINES; ++j) {
+                float delayed = rev->mLines[j][rev->mLinePos[j]];
+                // adding and removing a tiny offset flushes denormals to zero
+                state[j] = inGain[j] * delayed + damping[j] * rev->mLineState[j] + 1e-18f;
+                state[j] -= 1e-18f;
+                rev->mLineState[j] = state[j];
+                sum += state[j];
+            }
+            sum *= 2.0f / FX_REVERB_LINES;
+            for (j = 0; j < FX_REVERB_LINES; ++j) {
+                rev->mLines[j][rev->mLinePos[j]] = state[j] - sum + x * lineSigns[j];
+                rev->mLinePos[j] = rev->mLinePos[j] + 1 < rev->mLineLength[j] ?
+                    rev->mLinePos[j] + 1 : 0;
+            }
+            reverbGain += reverbStep;
+            output[0] += early[0] * reflectionsGain + (state[0] + state[2]) * 0.5f * reverbGain;
+            output[1] += early[1] * reflectionsGain - (state[1] + state[3]) * 0.5f * reverbGain;
+        }
+        frames -= slice;
+    }
+}
+
+
+void fx_int32ToFloat(float *dst, const int32_t *src, unsigned count)
+{
+    unsigned i;
+    for (i = 0; i < count; ++i) {
+        dst[i] = (float) src[i];
+    }
+}
+
+void fx_floatToInt32(int32_t *dst, const float *src, unsigned count)
+{
+    unsigned i;
+    for (i = 0; i < count; ++i) {
+        // the mixer saturates to 16 bits afterwards, so only overflow of 32 bits matters here
+        float sample = src[i];
+        if (sample > 1073741824.0f) {
+            sample = 1073741824.0f;
+        } else if (sample < -1073741824.0f) {
+            sample = -1073741824.0f;
+        }
+        dst[i] = (int32_t) lrintf(sample);
+    }
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** \file effects.h Software audio effects used by the OutputMixExt track mixer.
+ *  All effects process interleaved stereo float blocks in place, at full scale 32768.
+ *  Parameter changes only set a target; each effect ramps towards it while processing,
+ *  so that changes do not click.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \brief Maximum number of equalizer bands */
+
+#define FX_EQ_BANDS 4
+
+/** \brief A parameter that moves smoothly from its current value towards a target */
+
+typedef struct {
+    float mValue;
+    float mTarget;
+} FxRamp;
+
+/** \brief One second order section, in transposed direct form II, for both channels */
+
+typedef struct {
+    float mB0, mB1, mB2, mA1, mA2;
+    float mZ1[2], mZ2[2];
+} FxBiquad;
+
+/** \brief Equalizer is a cascade of peaking filters, one per band */
+
+typedef struct {
+    unsigned mSampleRate;
+    unsigned mNumBands;
+    int mEnabled;
+    float mCenter[FX_EQ_BANDS];     ///< Hz
+    float mQ[FX_EQ_BANDS];
+    FxRamp mGainDb[FX_EQ_BANDS];    ///< Ramps to 0 dB when disabled
+    float mDesignedDb[FX_EQ_BANDS]; ///< Gain the section coefficients were designed for
+    FxBiquad mSections[FX_EQ_BANDS];
+} FxEqualizer;
+
+/** \brief BassBoost is a low shelving filter */
+
+typedef struct {
+    unsigned mSampleRate;
+    int mEnabled;
+    FxRamp mGainDb;                 ///< Ramps to 0 dB when disabled
+    float mDesignedDb;
+    FxBiquad mShelf;
+} FxBassBoost;
+
+/** \brief Virtualizer widens the stereo image by boosting the side signal */
+
+typedef struct {
+    int mEnabled;
+    FxRamp mWidth;                  ///< Side gain minus 1, ramps to 0 when disabled
+} FxVirtualizer;
+
+/** \brief Number of delay lines in the reverb feedback network */
+
+#define FX_REVERB_LINES 4
+
+/** \brief Reverb parameters, in the units of SLEnvironmentalReverbSettings */
+
+typedef struct {
+    int16_t mRoomLevel;             ///< mB
+    int16_t mRoomHFLevel;           ///< mB
+    uint32_t mDecayTime;            ///< ms
+    int16_t mDecayHFRatio;          ///< permille
+    int16_t mReflectionsLevel;      ///< mB
+    uint32_t mReflectionsDelay;     ///< ms
+    int16_t mReverbLevel;           ///< mB
+    uint32_t mReverbDelay;          ///< ms
+    int16_t mDiffusion;             ///< permille
+} FxReverbSettings;
+
+/** \brief Reverb is a feedback delay network with a Householder matrix, damped per line,
+ *  preceded by a delay line that provides the early reflection and the pre-delay
+ */
+
+typedef struct {
+    unsigned mSampleRate;
+    FxReverbSettings mSettings;
+    // ramped gains, all linear
+    FxRamp mReflectionsGain;
+    FxRamp mReverbGain;
+    FxRamp mInputLowpass;           ///< Coefficient of the roomHFLevel input filter
+    FxRamp mDiffusion;              ///< Allpass coefficient
+    FxRamp mFeedback[FX_REVERB_LINES];  ///< Per line gain at DC
+    FxRamp mDamping[FX_REVERB_LINES];   ///< Per line lowpass coefficient
+    FxRamp mReflectionsDelay;       ///< frames, read with linear interpolation
+    FxRamp mReverbDelay;            ///< frames, after the reflections
+    // state
+    float mInputState[2];
+    float *mPreDelay;               ///< Stereo, mPreDelayLength frames
+    unsigned mPreDelayLength;
+    unsigned mPreDelayPos;
+    float *mAllpass[2];
+    unsigned mAllpassLength[2];
+    unsigned mAllpassPos[2];
+    float *mLines[FX_REVERB_LINES];
+    unsigned mLineLength[FX_REVERB_LINES];
+    unsigned mLinePos[FX_REVERB_LINES];
+    float mLineState[FX_REVERB_LINES];
+    unsigned mTailFrames;           ///< Frames of output left after the input went silent
+} FxReverb;
+
+extern void FxEqualizer_init(FxEqualizer *eq, unsigned sampleRate, unsigned numBands);
+/** \brief Set the center frequency and bandwidth of a band, which are not ramped; cheap to
+ *  call again with the same values
+ */
+extern void FxEqualizer_setBand(FxEqualizer *eq, unsigned band, float centerHz,
+    float bandwidthHz);
+/** \brief Set the target gain of a band; only takes effect while enabled */
+extern void FxEqualizer_setLevel(FxEqualizer *eq, unsigned band, int16_t millibel);
+extern void FxEqualizer_setEnabled(FxEqualizer *eq, int enabled);
+/** \brief Return whether processing would change the signal, including any ramp to bypass */
+extern int FxEqualizer_isActive(const FxEqualizer *eq);
+extern void FxEqualizer_process(FxEqualizer *eq, float *buffer, unsigned frames);
+
+extern void FxBassBoost_init(FxBassBoost *bb, unsigned sampleRate);
+extern void FxBassBoost_setStrength(FxBassBoost *bb, int16_t permille);
+extern void FxBassBoost_setEnabled(FxBassBoost *bb, int enabled);
+extern int FxBassBoost_isActive(const FxBassBoost *bb);
+extern void FxBassBoost_process(FxBassBoost *bb, float *buffer, unsigned frames);
+
+extern void FxVirtualizer_init(FxVirtualizer *virt);
+extern void FxVirtualizer_setStrength(FxVirtualizer *virt, int16_t permille);
+extern void FxVirtualizer_setEnabled(FxVirtualizer *virt, int enabled);
+extern int FxVirtualizer_isActive(const FxVirtualizer *virt);
+extern void FxVirtualizer_process(FxVirtualizer *virt, float *buffer, unsigned frames);
+
+/** \brief Returns 0 on success, or -1 if out of memory */
+extern int FxReverb_init(FxReverb *rev, unsigned sampleRate);
+extern void FxReverb_deinit(FxReverb *rev);
+extern void FxReverb_setSettings(FxReverb *rev, const FxReverbSettings *settings);
+/** \brief Return whether the reverb is still producing a tail from earlier input */
+extern int FxReverb_isActive(const FxReverb *rev);
+/** \brief Reverberate frames of input and add the result to output; input may be NULL for
+ *  silence
+ */
+extern void FxReverb_process(FxReverb *rev, const float *input, float *output,
+    unsigned frames);
+
+/** \brief Convert between the mixer's 32-bit accumulator and float blocks */
+extern void fx_int32ToFloat(float *dst, const int32_t *src, unsigned count);
+extern void fx_floatToInt32(int32_t *dst, const float *src, unsigned count);
+
+#ifdef __cplusplus
+}
+#endif
@@ -69,5 +69,6 @@ const char * const interface_names[MPH_MAX] = {
     "ANDROIDEFFECTCAPABILITIES",
     "ANDROIDEFFECTSEND",
     "ANDROIDCONFIGURATION",
-    "ANDROIDSIMPLEBUFFERQUEUE"
+    "ANDROIDSIMPLEBUFFERQUEUE",
+    "ANDROIDMIXSTATS"
 };
@@ -25,6 +25,9 @@ void object_lock_exclusive_(IObject *this, const char *file, int line)
     int ok;
     ok = pthread_mutex_trylock(&this->mMutex);
     if (0 != ok) {
+        LockStats *stats = NULL != this->mEngine && 0 != this->mEngine->mLockStats.mExposed ?
+            &this->mEngine->mLockStats : NULL;
+        SLuint32 startTime = NULL != stats ? IAndroidMixStats_now() : 0;
         // pthread_mutex_timedlock_np is not available, but wait up to 100 ms
         static const useconds_t backoffs[] = {1, 10000, 20000, 30000, 40000};
         unsigned i = 0;
@@ -42,6 +45,9 @@ void object_lock_exclusive_(IObject *this, const char *file, int line)
                 break;
             }
         }
+        if (NULL != stats) {
+            LockStats_addWait(stats, IAndroidMixStats_now() - startTime);
+        }
     }
     pthread_t zero;
     memset(&zero, 0, sizeof(pthread_t));
@@ -63,8 +69,18 @@ void object_lock_exclusive_(IObject *this, const char *file, int line)
 void object_lock_exclusive(IObject *this)
 {
     int ok;
-    ok = pthread_mutex_lock(&this->mMutex);
-    assert(0 == ok);
+    ok = pthread_mutex_trylock(&this->mMutex);
+    if (0 != ok) {
+        // contended, so time the wait if anyone is collecting mix statistics
+        if (NULL != this->mEngine && 0 != this->mEngine->mLockStats.mExposed) {
+            SLuint32 startTime = IAndroidMixStats_now();
+            ok = pthread_mutex_lock(&this->mMutex);
+            LockStats_addWait(&this->mEngine->mLockStats, IAndroidMixStats_now() - startTime);
+        } else {
+            ok = pthread_mutex_lock(&this->mMutex);
+        }
+        assert(0 == ok);
+    }
 }
 #endif
 
@@ -219,7 +235,16 @@ void object_unlock_exclusive_attributes(IObject *this, unsigned attributes)
             assert(MAX_INSTANCE > id);
             IEngine *thisEngine = this->mEngine;
             interface_lock_exclusive(thisEngine);
-            thisEngine->mChangedMask |= 1 << id;
+            unsigned oldChangedMask = thisEngine->mChangedMask;
+            thisEngine->mChangedMask = oldChangedMask | (1 << id);
+#ifndef ANDROID
+            // first object to change since previous sync, so wake up the sync thread;
+            // later changes are picked up in the same batch without another wakeup
+            if (0 == oldChangedMask) {
+                ok = pthread_cond_signal(&thisEngine->mSyncCond);
+                assert(0 == ok);
+            }
+#endif
             interface_unlock_exclusive(thisEngine);
         }
     }
@@ -257,6 +282,42 @@ void object_cond_wait(IObject *this)
 #endif
 
 
+/** \brief Wait on a condition variable protected by the object's mutex, but not necessarily
+ *  the one associated with the object, until abstime; see pthread_cond_timedwait.
+ *  Returns 0 or ETIMEDOUT.
+ */
+
+#ifdef USE_DEBUG
+int object_cond_timedwait_(IObject *this, pthread_cond_t *cond, const struct timespec *abstime,
+    const char *file, int line)
+{
+    // note that this will unlock the mutex, so we have to clear the owner
+    assert(pthread_equal(pthread_self(), this->mOwner));
+    assert(NULL != this->mFile);
+    assert(0 != this->mLine);
+    memset(&this->mOwner, 0, sizeof(pthread_t));
+    this->mFile = file;
+    this->mLine = line;
+    int err;
+    err = pthread_cond_timedwait(cond, &this->mMutex, abstime);
+    assert(0 == err || ETIMEDOUT == err);
+    // restore my ownership
+    this->mOwner = pthread_self();
+    this->mFile = file;
+    this->mLine = line;
+    return err;
+}
+#else
+int object_cond_timedwait(IObject *this, pthread_cond_t *cond, const struct timespec *abstime)
+{
+    int err;
+    err = pthread_cond_timedwait(cond, &this->mMutex, abstime);
+    assert(0 == err || ETIMEDOUT == err);
+    return err;
+}
+#endif
+
+
 /** \brief Signal the condition variable associated with the object; see pthread_cond_signal */
 
 void object_cond_signal(IObject *this)
@@ -22,11 +22,15 @@ extern void object_unlock_exclusive_(IObject *this, const char *file, int line);
 extern void object_unlock_exclusive_attributes_(IObject *this, unsigned attr,
     const char *file, int line);
 extern void object_cond_wait_(IObject *this, const char *file, int line);
+extern int object_cond_timedwait_(IObject *this, pthread_cond_t *cond,
+    const struct timespec *abstime, const char *file, int line);
 #else
 extern void object_lock_exclusive(IObject *this);
 extern void object_unlock_exclusive(IObject *this);
 extern void object_unlock_exclusive_attributes(IObject *this, unsigned attr);
 extern void object_cond_wait(IObject *this);
+extern int object_cond_timedwait(IObject *this, pthread_cond_t *cond,
+    const struct timespec *abstime);
 #endif
 extern void object_cond_signal(IObject *this);
 extern void object_cond_broadcast(IObject *this);
@@ -37,6 +41,8 @@ extern void object_cond_broadcast(IObject *this);
 #define object_unlock_exclusive_attributes(this, attr) \
     object_unlock_exclusive_attributes_((this), (attr), __FILE__, __LINE__)
 #define object_cond_wait(this) object_cond_wait_((this), __FILE__, __LINE__)
+#define object_cond_timedwait(this, cond, abstime) \
+    object_cond_timedwait_((this), (cond), (abstime), __FILE__, __LINE__)
 #endif
 
 // Currently shared locks are implemented as exclusive, but don't count on it
@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Mix kernels: 32-bit accumulation with Q1.15 gains, then saturation to 16-bit PCM */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "mixer.h"
+
+// Every implementation must produce bit-identical results to the portable C kernels,
+// so that the choice of kernels is not audible and the reference test can be exact.
+
+#if defined(__SSE2__) || ((defined(__i386__) || defined(__x86_64__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define USE_SSE2
+#include <emmintrin.h>
+#if defined(__i386__)
+#include <cpuid.h>
+#endif
+// Allows the SSE2 kernels to be built even when the rest of the file targets plain i386
+#define SSE2_TARGET __attribute__((target("sse2")))
+#endif
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define USE_NEON
+#include <arm_neon.h>
+#endif
+
+
+/** \brief Portable C accumulate, also used for the tails of the vector kernels */
+
+static void c_accumulate(int32_t *acc, const short *src, unsigned count, const uint16_t gains[2])
+{
+    int32_t gainL = gains[0];
+    int32_t gainR = gains[1];
+    unsigned i;
+    for (i = 0; i < count; i += 2) {
+        // The product fits in 32 bits because gains are at most MIXER_MAX_GAIN
+        acc[i] += (src[i] * gainL) >> 15;
+        acc[i + 1] += (src[i + 1] * gainR) >> 15;
+    }
+}
+
+
+static short saturate16(int32_t sample)
+{
+    if (sample > 32767) {
+        return 32767;
+    } else if (sample < -32768) {
+        return -32768;
+    }
+    return (short) sample;
+}
+
+
+/** \brief Portable C saturate */
+
+static void c_saturate(short *dst, const int32_t *acc, unsigned count)
+{
+    unsigned i;
+    for (i = 0; i < count; ++i) {
+        dst[i] = saturate16(acc[i]);
+    }
+}
+
+
+/** \brief Portable C convolve */
+
+static void c_convolve(short dst[2], const short *left, const short *right, const short *coefs)
+{
+    int32_t sumL = 0, sumR = 0;
+    unsigned k;
+    for (k = 0; k < MIXER_CONVOLVE_TAPS; ++k) {
+        sumL += left[k] * coefs[k];
+        sumR += right[k] * coefs[k];
+    }
+    dst[0] = saturate16(sumL >> 15);
+    dst[1] = saturate16(sumR >> 15);
+}
+
+
+static const MixerKernels c_kernels = {
+    "c",
+    c_accumulate,
+    c_saturate,
+    c_convolve
+};
+
+
+#ifdef USE_SSE2
+
+/** \brief SSE2 accumulate, 4 stereo frames per iteration.
+ *  There is no 32-bit multiply in SSE2 and a unity gain doesn't fit in a signed 16-bit lane,
+ *  so each sample is duplicated and multiplied by two halves of the gain with pmaddwd:
+ *  s * (g - g/2) + s * (g/2) == s * g, exactly.
+ */
+
+static SSE2_TARGET void sse2_accumulate(int32_t *acc, const short *src, unsigned count,
+    const uint16_t gains[2])
+{
+    short gainL1 = (short) (gains[0] >> 1), gainL2 = (short) (gains[0] - gainL1);
+    short gainR1 = (short) (gains[1] >> 1), gainR2 = (short) (gains[1] - gainR1);
+    __m128i g = _mm_set_epi16(gainR2, gainR1, gainL2, gainL1, gainR2, gainR1, gainL2, gainL1);
+    unsigned vectorCount = count & ~7;
+    unsigned i;
+    for (i = 0; i < vectorCount; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i *) &src[i]);
+        __m128i lo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(s, s), g), 15);
+        __m128i hi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(s, s), g), 15);
+        __m128i *a = (__m128i *) &acc[i];
+        _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), lo));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), hi));
+    }
+    if (i < count) {
+        c_accumulate(&acc[i], &src[i], count - i, gains);
+    }
+}
+
+
+/** \brief SSE2 saturate, packssdw does the clamping */
+
+static SSE2_TARGET void sse2_saturate(short *dst, const int32_t *acc, unsigned count)
+{
+    unsigned vectorCount = count & ~7;
+    unsigned i;
+    for (i = 0; i < vectorCount; i += 8) {
+        const __m128i *a = (const __m128i *) &acc[i];
+        __m128i packed = _mm_packs_epi32(_mm_loadu_si128(a), _mm_loadu_si128(a + 1));
+        _mm_storeu_si128((__m128i *) &dst[i], packed);
+    }
+    if (i < count) {
+        c_saturate(&dst[i], &acc[i], count - i);
+    }
+}
+
+
+/** \brief SSE2 convolve, pmaddwd does 8 taps at a time */
+
+static SSE2_TARGET void sse2_convolve(short dst[2], const short *left, const short *right,
+    const short *coefs)
+{
+    __m128i sumL = _mm_setzero_si128(), sumR = _mm_setzero_si128();
+    unsigned k;
+    for (k = 0; k < MIXER_CONVOLVE_TAPS; k += 8) {
+        __m128i c = _mm_loadu_si128((const __m128i *) &coefs[k]);
+        __m128i l = _mm_loadu_si128((const __m128i *) &left[k]);
+        __m128i r = _mm_loadu_si128((const __m128i *) &right[k]);
+        sumL = _mm_add_epi32(sumL, _mm_madd_epi16(l, c));
+        sumR = _mm_add_epi32(sumR, _mm_madd_epi16(r, c));
+    }
+    // horizontal add: lanes are (L0+L2, R0+R2, L1+L3, R1+R3), then (L, R, ...)
+    __m128i sum = _mm_add_epi32(_mm_unpacklo_epi32(sumL, sumR), _mm_unpackhi_epi32(sumL, sumR));
+    sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 8));
+    sum = _mm_srai_epi32(sum, 15);
+    sum = _mm_packs_epi32(sum, sum);
+    int32_t frame = _mm_cvtsi128_si32(sum);
+    memcpy(dst, &frame, sizeof(frame));
+}
+
+
+static const MixerKernels sse2_kernels = {
+    "sse2",
+    sse2_accumulate,
+    sse2_saturate,
+    sse2_convolve
+};
+
+
+static int cpu_has_sse2(void)
+{
+#if defined(__x86_64__)
+    // part of the base x86-64 instruction set
+    return 1;
+#else
+    unsigned eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (edx & bit_SSE2);
+#endif
+}
+
+#endif // USE_SSE2
+
+
+#ifdef USE_NEON
+
+/** \brief NEON accumulate, 4 stereo frames per iteration */
+
+static void neon_accumulate(int32_t *acc, const short *src, unsigned count,
+    const uint16_t gains[2])
+{
+    int32_t gainPair[4] = {gains[0], gains[1], gains[0], gains[1]};
+    int32x4_t g = vld1q_s32(gainPair);
+    unsigned vectorCount = count & ~7;
+    unsigned i;
+    for (i = 0; i < vectorCount; i += 8) {
+        int16x8_t s = vld1q_s16(&src[i]);
+        int32x4_t lo = vshrq_n_s32(vmulq_s32(vmovl_s16(vget_low_s16(s)), g), 15);
+        int32x4_t hi = vshrq_n_s32(vmulq_s32(vmovl_s16(vget_high_s16(s)), g), 15);
+        vst1q_s32(&acc[i], vaddq_s32(vld1q_s32(&acc[i]), lo));
+        vst1q_s32(&acc[i + 4], vaddq_s32(vld1q_s32(&acc[i + 4]), hi));
+    }
+    if (i < count) {
+        c_accumulate(&acc[i], &src[i], count - i, gains);
+    }
+}
+
+
+/** \brief NEON saturate, vqmovn does the clamping */
+
+static void neon_saturate(short *dst, const int32_t *acc, unsigned count)
+{
+    unsigned vectorCount = count & ~7;
+    unsigned i;
+    for (i = 0; i < vectorCount; i += 8) {
+        int16x8_t packed = vcombine_s16(vqmovn_s32(vld1q_s32(&acc[i])),
+            vqmovn_s32(vld1q_s32(&acc[i + 4])));
+        vst1q_s16(&dst[i], packed);
+    }
+    if (i < count) {
+        c_saturate(&dst[i], &acc[i], count - i);
+    }
+}
+
+
+/** \brief NEON convolve, widening multiply-accumulate 4 taps at a time */
+
+static void neon_convolve(short dst[2], const short *left, const short *right,
+    const short *coefs)
+{
+    int32x4_t sumL = vdupq_n_s32(0), sumR = vdupq_n_s32(0);
+    unsigned k;
+    for (k = 0; k < MIXER_CONVOLVE_TAPS; k += 8) {
+        int16x8_t c = vld1q_s16(&coefs[k]);
+        int16x8_t l = vld1q_s16(&left[k]);
+        int16x8_t r = vld1q_s16(&right[k]);
+        sumL = vmlal_s16(sumL, vget_low_s16(l), vget_low_s16(c));
+        sumL = vmlal_s16(sumL, vget_high_s16(l), vget_high_s16(c));
+        sumR = vmlal_s16(sumR, vget_low_s16(r), vget_low_s16(c));
+        sumR = vmlal_s16(sumR, vget_high_s16(r), vget_high_s16(c));
+    }
+    int32x2_t pairL = vadd_s32(vget_low_s32(sumL), vget_high_s32(sumL));
+    int32x2_t pairR = vadd_s32(vget_low_s32(sumR), vget_high_s32(sumR));
+    int32x2_t sum = vpadd_s32(pairL, pairR);
+    int16x4_t frame = vqmovn_s32(vcombine_s32(vshr_n_s32(sum, 15), vdup_n_s32(0)));
+    dst[0] = vget_lane_s16(frame, 0);
+    dst[1] = vget_lane_s16(frame, 1);
+}
+
+
+static const MixerKernels neon_kernels = {
+    "neon",
+    neon_accumulate,
+    neon_saturate,
+    neon_convolve
+};
+
+
+static int cpu_has_neon(void)
+{
+#if defined(__aarch64__)
+    return 1;
+#else
+    // The toolchain was told NEON is available; confirm with the kernel before relying on it
+    int hasNeon = 0;
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+    if (NULL != cpuinfo) {
+        char line[512];
+        while (!hasNeon && NULL != fgets(line, sizeof(line), cpuinfo)) {
+            if (!strncmp(line, "Features", 8) && NULL != strstr(line, " neon")) {
+                hasNeon = 1;
+            }
+        }
+        fclose(cpuinfo);
+    }
+    return hasNeon;
+#endif
+}
+
+#endif // USE_NEON
+
+
+// Usable kernels in order of preference, NULL terminated
+static const MixerKernels *kernels[4];
+static pthread_once_t kernelsOnce = PTHREAD_ONCE_INIT;
+
+static void probe_kernels(void)
+{
+    unsigned n = 0;
+#ifdef USE_SSE2
+    if (cpu_has_sse2()) {
+        kernels[n++] = &sse2_kernels;
+    }
+#endif
+#ifdef USE_NEON
+    if (cpu_has_neon()) {
+        kernels[n++] = &neon_kernels;
+    }
+#endif
+    kernels[n++] = &c_kernels;
+    kernels[n] = NULL;
+}
+
+
+const MixerKernels *mixer_getKernels(unsigned index)
+{
+    (void) pthread_once(&kernelsOnce, probe_kernels);
+    unsigned i;
+    for (i = 0; i < index; ++i) {
+        if (NULL == kernels[i]) {
+            return NULL;
+        }
+    }
+    return kernels[index];
+}
+
+
+uint16_t mixer_gain(float gain)
+{
+    if (gain <= 0.0f) {
+        return 0;
+    }
+    if (gain >= MIXER_MAX_GAIN / 32768.0f) {
+        return MIXER_MAX_GAIN;
+    }
+    return (uint16_t) (gain * 32768.0f + 0.5f);
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** \file mixer.h Mix kernels used by the OutputMixExt track mixer */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \brief Gains are unsigned Q1.15 fixed point, so this is a gain of 1.0 */
+
+#define MIXER_UNITY_GAIN 0x8000
+
+/** \brief Largest gain accepted by the kernels, just under 2.0 */
+
+#define MIXER_MAX_GAIN 0xFFFE
+
+/** \brief Number of taps in each phase of a resampler filter, see resampler.h */
+
+#define MIXER_CONVOLVE_TAPS 32
+
+/** \brief MixerKernels is one implementation of the inner loops of the track mixer.
+ *  Samples are interleaved 16-bit stereo, and counts are in samples (not frames or bytes).
+ *  There are no alignment requirements on any of the buffers.
+ */
+
+typedef struct {
+    const char *mName;
+    /** Add (src[i] * gains[i & 1]) >> 15 to acc[i], for 0 <= i < count; count is even */
+    void (*mAccumulate)(int32_t *acc, const short *src, unsigned count, const uint16_t gains[2]);
+    /** Store acc[i] saturated to 16 bits into dst[i], for 0 <= i < count */
+    void (*mSaturate)(short *dst, const int32_t *acc, unsigned count);
+    /** Store one stereo frame, the sums of left[k] * coefs[k] and right[k] * coefs[k]
+     *  over MIXER_CONVOLVE_TAPS taps, shifted right by 15 and saturated to 16 bits.
+     *  The sums are 32-bit, which is enough if the absolute coefficients sum to under 2.0 */
+    void (*mConvolve)(short dst[2], const short *left, const short *right, const short *coefs);
+} MixerKernels;
+
+/** \brief Return the index'th set of kernels usable on this CPU, fastest first and ending with
+ *  the portable C kernels, or NULL if index is past the end.  The CPU is probed only once.
+ */
+
+extern const MixerKernels *mixer_getKernels(unsigned index);
+
+/** \brief Convert a float gain to the fixed point representation used by the kernels */
+
+extern uint16_t mixer_gain(float gain);
+
+#ifdef __cplusplus
+}
+#endif
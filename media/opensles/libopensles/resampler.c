@@ -0,0 +1,303 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Polyphase sample rate converter */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mixer.h"
+#include "resampler.h"
+
+// Each output frame is the dot product of MIXER_CONVOLVE_TAPS consecutive history frames with
+// one phase of a Kaiser windowed sinc.  The phase is the fractional input position rounded to
+// the nearest 1/RESAMPLER_PHASES of a frame, so the extra row is the last phase shifted by one
+// frame.  Output frame time lines up with history frame mIndex + CENTER_TAP.
+
+#define TAPS MIXER_CONVOLVE_TAPS
+#define CENTER_TAP (MIXER_CONVOLVE_TAPS / 2 - 1)
+#define KAISER_BETA 7.5
+// Passband edge as a fraction of the lower of the input and output Nyquist frequencies
+#define CUTOFF 0.85
+// Cutoffs are quantized to 1/CUTOFF_STEPS so that similar ratios share a bank
+#define CUTOFF_STEPS 256
+// Unreferenced banks are kept for reuse up to this many banks in total
+#define FILTER_CACHE_MAX 8
+#define HISTORY_TYPICAL 1024
+
+struct FilterBank_struct {
+    FilterBank *mNext;
+    unsigned mKey;          ///< Cutoff times CUTOFF_STEPS
+    unsigned mRefCount;
+    short mCoefs[(RESAMPLER_PHASES + 1) * TAPS];
+};
+
+static pthread_mutex_t cacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static FilterBank *cacheHead;
+static unsigned cacheCount;
+
+
+/** \brief Zeroth order modified Bessel function of the first kind, for the Kaiser window */
+
+static double bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    unsigned k;
+    for (k = 1; k < 50 && term > sum * 1e-12; ++k) {
+        double half = x / (2.0 * k);
+        term *= half * half;
+        sum += term;
+    }
+    return sum;
+}
+
+static void FilterBank_compute(FilterBank *bank)
+{
+    double cutoff = (double) bank->mKey / CUTOFF_STEPS;
+    double i0beta = bessel_i0(KAISER_BETA);
+    unsigned phase, k;
+    for (phase = 0; phase <= RESAMPLER_PHASES; ++phase) {
+        double h[TAPS], sum = 0.0;
+        for (k = 0; k < TAPS; ++k) {
+            // time of tap k relative to the output frame, in input frames
+            double t = (double) k - CENTER_TAP - (double) phase / RESAMPLER_PHASES;
+            double x = M_PI * cutoff * t;
+            double sinc = fabs(x) < 1e-9 ? 1.0 : sin(x) / x;
+            double w = t / (TAPS / 2);
+            double window = w * w < 1.0 ? bessel_i0(KAISER_BETA * sqrt(1.0 - w * w)) / i0beta :
+                0.0;
+            h[k] = sinc * window;
+            sum += h[k];
+        }
+        // unity gain at DC for every phase, so a constant input has no phase-dependent ripple
+        short *coefs = &bank->mCoefs[phase * TAPS];
+        for (k = 0; k < TAPS; ++k) {
+            long coef = lrint(h[k] / sum * 32768.0);
+            if (coef > 32767) {
+                coef = 32767;
+            } else if (coef < -32768) {
+                coef = -32768;
+            }
+            coefs[k] = (short) coef;
+        }
+    }
+}
+
+/** \brief Return a referenced bank for the given quantized cutoff, computing it if needed */
+
+static const FilterBank *FilterBank_acquire(unsigned key)
+{
+    FilterBank *bank;
+    (void) pthread_mutex_lock(&cacheMutex);
+    for (bank = cacheHead; NULL != bank; bank = bank->mNext) {
+        if (key == bank->mKey) {
+            ++bank->mRefCount;
+            (void) pthread_mutex_unlock(&cacheMutex);
+            return bank;
+        }
+    }
+    (void) pthread_mutex_unlock(&cacheMutex);
+    // compute outside the lock; if another thread races us, the cache holds a duplicate
+    bank = (FilterBank *) malloc(sizeof(FilterBank));
+    if (NULL == bank) {
+        return NULL;
+    }
+    bank->mKey = key;
+    bank->mRefCount = 1;
+    FilterBank_compute(bank);
+    (void) pthread_mutex_lock(&cacheMutex);
+    bank->mNext = cacheHead;
+    cacheHead = bank;
+    ++cacheCount;
+    (void) pthread_mutex_unlock(&cacheMutex);
+    return bank;
+}
+
+static void FilterBank_release(const FilterBank *constBank)
+{
+    if (NULL == constBank) {
+        return;
+    }
+    (void) pthread_mutex_lock(&cacheMutex);
+    FilterBank *bank = (FilterBank *) constBank;
+    if (0 == --bank->mRefCount && FILTER_CACHE_MAX < cacheCount) {
+        FilterBank **link;
+        for (link = &cacheHead; *link != bank; link = &(*link)->mNext)
+            ;
+        *link = bank->mNext;
+        --cacheCount;
+        free(bank);
+    }
+    (void) pthread_mutex_unlock(&cacheMutex);
+}
+
+
+void Resampler_setRate(Resampler *r, uint32_t srcMilliHz, uint32_t dstMilliHz,
+    unsigned ratePermille)
+{
+    double step = (double) srcMilliHz * ratePermille / ((double) dstMilliHz * 1000.0);
+    r->mStep = (uint64_t) (step * 4294967296.0 + 0.5);
+    if (0 == r->mStep) {
+        r->mStep = 1;
+    }
+    // when decimating, the passband must also be below the output Nyquist frequency
+    unsigned key = (unsigned) (CUTOFF * CUTOFF_STEPS / (step > 1.0 ? step : 1.0) + 0.5);
+    if (0 == key) {
+        key = 1;
+    }
+    if (NULL == r->mBank || key != r->mBank->mKey) {
+        const FilterBank *bank = FilterBank_acquire(key);
+        // on failure keep the old filter, which is better than none
+        if (NULL != bank) {
+            FilterBank_release(r->mBank);
+            r->mBank = bank;
+        }
+    }
+}
+
+void Resampler_reset(Resampler *r)
+{
+    memset(r->mLeft, 0, CENTER_TAP * sizeof(short));
+    memset(r->mRight, 0, CENTER_TAP * sizeof(short));
+    r->mFrames = CENTER_TAP;
+    r->mIndex = 0;
+    r->mFraction = 0;
+}
+
+Resampler *Resampler_create(const MixerKernels *kernels, uint32_t srcMilliHz,
+    uint32_t dstMilliHz, unsigned ratePermille)
+{
+    Resampler *r = (Resampler *) calloc(1, sizeof(Resampler));
+    if (NULL == r) {
+        return NULL;
+    }
+    r->mKernels = kernels;
+    r->mCapacity = HISTORY_TYPICAL;
+    r->mLeft = (short *) malloc(r->mCapacity * sizeof(short));
+    r->mRight = (short *) malloc(r->mCapacity * sizeof(short));
+    if (NULL != r->mLeft && NULL != r->mRight) {
+        Resampler_setRate(r, srcMilliHz, dstMilliHz, ratePermille);
+        if (NULL != r->mBank) {
+            Resampler_reset(r);
+            return r;
+        }
+    }
+    Resampler_destroy(r);
+    return NULL;
+}
+
+void Resampler_destroy(Resampler *r)
+{
+    if (NULL != r) {
+        FilterBank_release(r->mBank);
+        free(r->mLeft);
+        free(r->mRight);
+        free(r);
+    }
+}
+
+unsigned Resampler_framesNeeded(const Resampler *r, unsigned frames)
+{
+    if (0 == frames) {
+        return 0;
+    }
+    uint64_t last = r->mIndex + ((r->mFraction + (frames - 1) * r->mStep) >> 32);
+    uint64_t needed = last + TAPS;
+    return needed > r->mFrames ? (unsigned) (needed - r->mFrames) : 0;
+}
+
+int Resampler_write(Resampler *r, const short *src, unsigned frames, unsigned channels)
+{
+    // discard history that no future output frame can reach
+    // (when decimating, mIndex can be past the end of the history)
+    unsigned discard = r->mIndex < r->mFrames ? r->mIndex : r->mFrames;
+    if (0 < discard) {
+        memmove(r->mLeft, &r->mLeft[discard], (r->mFrames - discard) * sizeof(short));
+        memmove(r->mRight, &r->mRight[discard], (r->mFrames - discard) * sizeof(short));
+        r->mFrames -= discard;
+        r->mIndex -= discard;
+    }
+    if (r->mFrames + frames > r->mCapacity) {
+        unsigned capacity = r->mCapacity;
+        while (capacity < r->mFrames + frames) {
+            capacity *= 2;
+        }
+        short *left = (short *) realloc(r->mLeft, capacity * sizeof(short));
+        if (NULL == left) {
+            return -1;
+        }
+        r->mLeft = left;
+        short *right = (short *) realloc(r->mRight, capacity * sizeof(short));
+        if (NULL == right) {
+            return -1;
+        }
+        r->mRight = right;
+        r->mCapacity = capacity;
+    }
+    short *left = &r->mLeft[r->mFrames];
+    short *right = &r->mRight[r->mFrames];
+    unsigned i;
+    if (1 == channels) {
+        memcpy(left, src, frames * sizeof(short));
+        memcpy(right, src, frames * sizeof(short));
+    } else {
+        for (i = 0; i < frames; ++i) {
+            left[i] = src[2 * i];
+            right[i] = src[2 * i + 1];
+        }
+    }
+    r->mFrames += frames;
+    return 0;
+}
+
+unsigned Resampler_read(Resampler *r, short *dst, unsigned frames)
+{
+    unsigned produced = 0;
+    if ((1ULL << 32) == r->mStep && 0 == r->mFraction) {
+        // unity ratio on a frame boundary: the filter would only cost time and treble
+        unsigned avail = r->mIndex + TAPS <= r->mFrames ? r->mFrames - TAPS + 1 - r->mIndex : 0;
+        produced = frames < avail ? frames : avail;
+        const short *left = &r->mLeft[r->mIndex + CENTER_TAP];
+        const short *right = &r->mRight[r->mIndex + CENTER_TAP];
+        unsigned i;
+        for (i = 0; i < produced; ++i) {
+            dst[2 * i] = left[i];
+            dst[2 * i + 1] = right[i];
+        }
+        r->mIndex += produced;
+        return produced;
+    }
+    void (*convolve)(short *, const short *, const short *, const short *) =
+        r->mKernels->mConvolve;
+    const short *coefs = r->mBank->mCoefs;
+    unsigned index = r->mIndex;
+    uint32_t fraction = r->mFraction;
+    const uint32_t stepWhole = (uint32_t) (r->mStep >> 32);
+    const uint32_t stepFraction = (uint32_t) r->mStep;
+    while (produced < frames && index + TAPS <= r->mFrames) {
+        unsigned phase = (unsigned) (((uint64_t) fraction * RESAMPLER_PHASES + (1U << 31)) >> 32);
+        (*convolve)(&dst[2 * produced], &r->mLeft[index], &r->mRight[index],
+            &coefs[phase * TAPS]);
+        ++produced;
+        uint32_t next = fraction + stepFraction;
+        index += stepWhole + (next < fraction);
+        fraction = next;
+    }
+    r->mIndex = index;
+    r->mFraction = fraction;
+    return produced;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** \file resampler.h Polyphase sample rate converter used by the OutputMixExt track mixer.
+ *  Requires mixer.h to be included first.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \brief Number of filter phases between two input frames */
+
+#define RESAMPLER_PHASES 256
+
+/** \brief FilterBank is a shared, read-only table of (RESAMPLER_PHASES + 1) phases of
+ *  MIXER_CONVOLVE_TAPS Q15 coefficients each.  Banks are cached by cutoff frequency.
+ */
+
+typedef struct FilterBank_struct FilterBank;
+
+/** \brief Resampler converts one track of 16-bit mono or stereo PCM at an arbitrary rate
+ *  to 16-bit stereo PCM at the mixer rate.  It is not thread-safe.
+ */
+
+typedef struct {
+    const MixerKernels *mKernels;
+    const FilterBank *mBank;
+    uint64_t mStep;         ///< Input frames per output frame, in 32.32 fixed point
+    uint32_t mFraction;     ///< Position between mIndex and the next input frame, 0.32
+    unsigned mIndex;        ///< First history frame used by the next output frame
+    unsigned mFrames;       ///< Number of valid frames in the history
+    unsigned mCapacity;     ///< Capacity of the history in frames
+    short *mLeft;           ///< Deinterleaved history
+    short *mRight;
+} Resampler;
+
+/** \brief Return a new resampler from srcMilliHz to dstMilliHz, with the playback rate scaled
+ *  by ratePermille, or NULL if out of memory
+ */
+
+extern Resampler *Resampler_create(const MixerKernels *kernels, uint32_t srcMilliHz,
+    uint32_t dstMilliHz, unsigned ratePermille);
+
+/** \brief Change the conversion ratio, keeping the history so there is no discontinuity */
+
+extern void Resampler_setRate(Resampler *r, uint32_t srcMilliHz, uint32_t dstMilliHz,
+    unsigned ratePermille);
+
+/** \brief Discard the history, as after a seek or buffer queue clear */
+
+extern void Resampler_reset(Resampler *r);
+
+extern void Resampler_destroy(Resampler *r);
+
+/** \brief Return the number of input frames still needed to produce the next frames output */
+
+extern unsigned Resampler_framesNeeded(const Resampler *r, unsigned frames);
+
+/** \brief Append frames of interleaved input with 1 or 2 channels to the history.
+ *  Returns 0 on success, or -1 if out of memory.
+ */
+
+extern int Resampler_write(Resampler *r, const short *src, unsigned frames, unsigned channels);
+
+/** \brief Produce at most frames of interleaved stereo output, and return how many were
+ *  produced before the history ran out
+ */
+
+extern unsigned Resampler_read(Resampler *r, short *dst, unsigned frames);
+
+#ifdef __cplusplus
+}
+#endif
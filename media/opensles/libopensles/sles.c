@@ -864,6 +864,7 @@ extern void
     IAndroidEffect_init(void *),
     IAndroidEffectCapabilities_init(void *),
     IAndroidEffectSend_init(void *),
+    IAndroidMixStats_init(void *),
     IAudioDecoderCapabilities_init(void *),
     IAudioEncoder_init(void *),
     IAudioEncoderCapabilities_init(void *),
@@ -907,18 +908,21 @@ extern void
     I3DGrouping_deinit(void *),
     IAndroidEffect_deinit(void *),
     IAndroidEffectCapabilities_deinit(void *),
+    IAndroidMixStats_Remove(void *),
     IBassBoost_deinit(void *),
     IBufferQueue_deinit(void *),
     IEngine_deinit(void *),
     IEnvironmentalReverb_deinit(void *),
     IEqualizer_deinit(void *),
     IObject_deinit(void *),
+    IOutputMixExt_deinit(void *),
     IPresetReverb_deinit(void *),
     IThreadSync_deinit(void *),
     IVirtualizer_deinit(void *);
 
 extern bool
     IAndroidEffectCapabilities_Expose(void *),
+    IAndroidMixStats_Expose(void *),
     IBassBoost_Expose(void *),
     IEnvironmentalReverb_Expose(void *),
     IEqualizer_Expose(void *),
@@ -976,6 +980,7 @@ extern bool
 
 #ifndef USE_OUTPUTMIXEXT
 #define IOutputMixExt_init  NULL
+#define IOutputMixExt_deinit NULL
 #endif
 
 
@@ -1029,13 +1034,15 @@ extern bool
         NULL },
     { /* MPH_VISUALIZATION, */ IVisualization_init, NULL, NULL, NULL, NULL },
     { /* MPH_VOLUME, */ IVolume_init, NULL, NULL, NULL, NULL },
-    { /* MPH_OUTPUTMIXEXT, */ IOutputMixExt_init, NULL, NULL, NULL, NULL },
+    { /* MPH_OUTPUTMIXEXT, */ IOutputMixExt_init, NULL, IOutputMixExt_deinit, NULL, NULL },
     { /* MPH_ANDROIDEFFECT */ IAndroidEffect_init, NULL, IAndroidEffect_deinit, NULL, NULL },
     { /* MPH_ANDROIDEFFECTCAPABILITIES */ IAndroidEffectCapabilities_init, NULL,
         IAndroidEffectCapabilities_deinit, IAndroidEffectCapabilities_Expose, NULL },
     { /* MPH_ANDROIDEFFECTSEND */ IAndroidEffectSend_init, NULL, NULL, NULL, NULL },
     { /* MPH_ANDROIDCONFIGURATION */ IAndroidConfiguration_init, NULL, NULL, NULL, NULL },
-    { /* MPH_ANDROIDSIMPLEBUFFERQUEUE, */ IBufferQueue_init /* alias */, NULL, NULL, NULL, NULL }
+    { /* MPH_ANDROIDSIMPLEBUFFERQUEUE, */ IBufferQueue_init /* alias */, NULL, NULL, NULL, NULL },
+    { /* MPH_ANDROIDMIXSTATS */ IAndroidMixStats_init, NULL, NULL, IAndroidMixStats_Expose,
+        IAndroidMixStats_Remove }
 };
 
 
@@ -101,7 +101,16 @@ typedef struct COutputMix_struct COutputMix;
 
 #define STEREO_CHANNELS 2
 
+// indexes into IEffectSend.mEnableLevels, and the effect send buses of OutputMixExt
+
+#define AUX_ENVIRONMENTALREVERB 0
+#define AUX_PRESETREVERB        1
+#define AUX_MAX                 2
+
 #ifdef USE_OUTPUTMIXEXT
+#include "mixer.h"
+#include "resampler.h"
+#include "effects.h"
 #include "OutputMixExt.h"
 #endif
 
@@ -226,17 +235,28 @@ typedef struct {
 
 #ifdef USE_SNDFILE
 
-#define SndFile_BUFSIZE 512     // in 16-bit samples
-#define SndFile_NUMBUFS 2
+#define SndFile_BUFSIZE 2048    // in 16-bit samples
+// Number of buffers decoded ahead of the mixer, about 190 ms of 44.1 kHz stereo by default
+#ifndef SndFile_NUMBUFS
+#define SndFile_NUMBUFS 8
+#endif
 
 struct SndFile {
     // save URI also?
     SLchar *mPathname;
     SNDFILE *mSNDFILE;
     SF_INFO mSfInfo;
-    pthread_mutex_t mMutex; // protects mSNDFILE only
+    pthread_mutex_t mDecodeMutex;   // protects mSNDFILE and mWhich, held to decode or seek
+    SLuint32 mWhich;        // which buffer to decode into next
+    pthread_mutex_t mMutex; // protects mEOF, mShutdown and mDecodeRequests
+    pthread_cond_t mCond;   // signalled when mDecodeRequests drops to zero
     SLboolean mEOF;         // sf_read returned zero sample frames
-    SLuint32 mWhich;        // which buffer to use next
+    SLboolean mShutdown;    // no more decoding, as the player is being destroyed
+    SLuint32 mDecodeRequests;   // non-zero while a decode closure is queued or running
+    // The object lock protects these two instead
+    SLuint32 mUnderruns;    // times the buffer queue ran dry while playing, before end of file
+    SLpermille mReportedLevel;  // fill level at the last SL_PREFETCHEVENT_FILLLEVELCHANGE
+    // Decoded buffers are enqueued in place, and reused once the buffer queue is done with them
     short mBuffer[SndFile_BUFSIZE * SndFile_NUMBUFS];
 };
 
@@ -523,18 +543,21 @@ struct EnableLevel {
     SLmillibel mSendLevel;
 };
 
-// indexes into IEffectSend.mEnableLevels
-
-#define AUX_ENVIRONMENTALREVERB 0
-#define AUX_PRESETREVERB        1
-#define AUX_MAX                 2
-
 typedef struct {
     const struct SLEffectSendItf_ *mItf;
     IObject *mThis;
     struct EnableLevel mEnableLevels[AUX_MAX];  // wet enable and volume per effect type
 } IEffectSend;
 
+/** \brief Contention on the object locks of an engine, updated without a lock */
+
+typedef struct {
+    volatile SLuint32 mExposed;     ///< Number of output mixes exposing the mix statistics
+    volatile SLuint32 mContentions; ///< Lock acquisitions that had to wait
+    volatile SLuint32 mTotalWait;   ///< Total time spent waiting, in microseconds
+    volatile SLuint32 mMaxWait;     ///< Longest wait, in microseconds
+} LockStats;
+
 typedef struct Engine_interface {
     const struct SLEngineItf_ *mItf;
     IObject *mThis;
@@ -550,7 +573,11 @@ typedef struct Engine_interface {
     IObject *mInstances[MAX_INSTANCE];
     SLboolean mShutdown;
     SLboolean mShutdownAck;
+#ifndef ANDROID
+    pthread_cond_t mSyncCond;   // signalled when the sync thread has work to do
+#endif
     ThreadPool mThreadPool; // for asynchronous operations
+    LockStats mLockStats;
 #if defined(ANDROID) && !defined(USE_BACKPORT)
     // FIXME number of presets will only be saved in IEqualizer, preset names will not be stored
     SLuint32 mEqNumPresets;
@@ -703,9 +730,33 @@ typedef struct {
     unsigned mActiveMask;   // 1 bit per active track
     Track mTracks[MAX_TRACK];
     SLboolean mDestroyRequested;    ///< Mixer to acknowledge application's call to Object::Destroy
+    const MixerKernels *mKernels;   ///< Mix kernels chosen for this CPU
+    int32_t *mMixBuffer;    ///< 32-bit accumulators for one mixer frame, grown on demand:
+                            ///< the main mix followed by one bus per effect send
+    SLuint32 mMixBufferSamples; ///< Capacity of each accumulator in samples
+    float *mFxBuffer;       ///< Main mix and one send, as float for the effects
+    FxEqualizer mEqualizer; ///< Software effects, with parameters copied from the output mix
+    FxBassBoost mBassBoost;
+    FxVirtualizer mVirtualizer;
+    FxReverb mReverbs[AUX_MAX];
+    SLboolean mReverbsOk;   ///< Whether the reverbs have their delay lines
 } IOutputMixExt;
 #endif
 
+/** \brief Mixer statistics of an output mix, updated by the mixer with the output mix locked */
+
+typedef struct {
+    const struct SLAndroidMixStatsItf_ *mItf;
+    IObject *mThis;
+    SLboolean mEnabled;     ///< Whether the application asked for the interface
+    SLuint32 mPeriods;      ///< Number of calls to the mixer
+#define MIXSTATS_BUCKETS 16 // == SL_ANDROID_MIXSTATS_BUCKETS
+    SLuint32 mHistogram[MIXSTATS_BUCKETS];  ///< Mix time, by power of 2 microseconds
+    SLuint32 mTotalMixTime; ///< In microseconds
+    SLuint32 mMaxMixTime;   ///< In microseconds
+    SLuint32 mUnderruns;    ///< Times any playing track ran out of data
+} IAndroidMixStats;
+
 typedef struct {
     const struct SLPitchItf_ *mItf;
     IObject *mThis;
@@ -1153,9 +1204,9 @@ typedef struct {
     // mandated interfaces
     IObject mObject;
 #ifdef ANDROID
-#define INTERFACES_OutputMix 12 // see MPH_to_OutputMix in MPH_to.c for list of interfaces
+#define INTERFACES_OutputMix 13 // see MPH_to_OutputMix in MPH_to.c for list of interfaces
 #else
-#define INTERFACES_OutputMix 11 // see MPH_to_OutputMix in MPH_to.c for list of interfaces
+#define INTERFACES_OutputMix 12 // see MPH_to_OutputMix in MPH_to.c for list of interfaces
 #endif
     SLuint8 mInterfaceStates2[INTERFACES_OutputMix - INTERFACES_Default];
     IDynamicInterfaceManagement mDynamicInterfaceManagement;
@@ -1171,6 +1222,7 @@ typedef struct {
     // optional interfaces
     IBassBoost mBassBoost;
     IVisualization mVisualization;
+    IAndroidMixStats mAndroidMixStats;
 #ifdef ANDROID
     IAndroidEffect mAndroidEffect;
 #endif
@@ -1365,3 +1417,6 @@ extern void ReleaseStrongRef(IObject *object);
 extern void ReleaseStrongRefAndUnlockExclusive(IObject *object);
 
 extern COutputMix *CAudioPlayer_GetOutputMix(CAudioPlayer *audioPlayer);
+extern SLuint32 IAndroidMixStats_now(void);
+extern void IAndroidMixStats_addMixTime(IAndroidMixStats *this, SLuint32 micros);
+extern void LockStats_addWait(LockStats *stats, SLuint32 micros);
@@ -17,12 +17,20 @@
 /* sync */
 
 #include "sles_allinclusive.h"
+#include <sys/time.h>
+
+
+/** \brief Sync thread fallback period in milliseconds; see sync_start */
+
+#define SYNC_FALLBACK_MS 1000
 
 
 /** \brief Sync thread.
- *  The sync thread runs periodically to synchronize audio state between
- *  the application and platform-specific device driver; for best results
- *  it should run about every graphics frame (e.g. 20 Hz to 50 Hz).
+ *  The sync thread synchronizes audio state between the application and
+ *  platform-specific device driver.  It sleeps on mSyncCond, which is signalled
+ *  when the first object changes since the previous sync, on a 3DCommit, and on
+ *  shutdown; changes made while it is busy are coalesced into the next batch.
+ *  It also wakes every SYNC_FALLBACK_MS in case a change was made without a signal.
  */
 
 void *sync_start(void *arg)
@@ -30,11 +38,23 @@ void *sync_start(void *arg)
     CEngine *this = (CEngine *) arg;
     for (;;) {
 
-        // FIXME should be driven by cond_signal rather than polling,
-        // or at least make the poll interval longer or configurable
-        usleep(20000*5);
-
         object_lock_exclusive(&this->mObject);
+        struct timeval now;
+        (void) gettimeofday(&now, NULL);
+        struct timespec deadline;
+        deadline.tv_sec = now.tv_sec + SYNC_FALLBACK_MS / 1000;
+        deadline.tv_nsec = (now.tv_usec + (SYNC_FALLBACK_MS % 1000) * 1000) * 1000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_nsec -= 1000000000;
+            ++deadline.tv_sec;
+        }
+        while (!this->mEngine.mShutdown && !this->m3DCommit.mWaiting &&
+                !this->mEngine.mChangedMask) {
+            if (ETIMEDOUT == object_cond_timedwait(&this->mObject, &this->mEngine.mSyncCond,
+                    &deadline)) {
+                break;
+            }
+        }
         if (this->mEngine.mShutdown) {
             this->mEngine.mShutdownAck = SL_BOOLEAN_TRUE;
             // broadcast not signal, because this condition is also used for other purposes
@@ -36,6 +36,66 @@ LOCAL_MODULE_PATH := $(TARGET_OUT_DATA)/nativetest
 
 include $(BUILD_EXECUTABLE)
 
+# The mix kernels and resampler have hidden visibility in the library, so build them into the
+# test directly
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_C_INCLUDES:= \
+    bionic \
+    bionic/libstdc++/include \
+    external/gtest/include \
+    system/media/opensles/libopensles \
+    external/stlport/stlport
+
+LOCAL_SRC_FILES:= \
+    mixer_test.cpp \
+    ../../libopensles/mixer.c \
+    ../../libopensles/resampler.c
+
+LOCAL_SHARED_LIBRARIES := \
+    libstlport
+
+LOCAL_STATIC_LIBRARIES := \
+    libgtest
+
+LOCAL_MODULE:= mixer_test
+
+LOCAL_MODULE_PATH := $(TARGET_OUT_DATA)/nativetest
+
+include $(BUILD_EXECUTABLE)
+
+# The software effects, also built directly into the test
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_C_INCLUDES:= \
+    bionic \
+    bionic/libstdc++/include \
+    external/gtest/include \
+    system/media/opensles/libopensles \
+    external/stlport/stlport
+
+LOCAL_SRC_FILES:= \
+    effects_test.cpp \
+    ../../libopensles/effects.c
+
+LOCAL_SHARED_LIBRARIES := \
+    libstlport
+
+LOCAL_STATIC_LIBRARIES := \
+    libgtest
+
+LOCAL_MODULE:= effects_test
+
+LOCAL_MODULE_PATH := $(TARGET_OUT_DATA)/nativetest
+
+include $(BUILD_EXECUTABLE)
+
 endif
 # Build the manual test programs.
 include $(call all-subdir-makefiles)
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** \file effects_test.cpp Check the software effects of the OutputMixExt mixer on sines */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "effects.h"
+#include <gtest/gtest.h>
+
+#define RATE 44100
+#define FRAMES 44100
+// Long enough for every ramp to settle
+#define SETTLE 8192
+
+static float buffer[FRAMES * 2];
+
+static void fillSine(double frequency, float amplitude)
+{
+    unsigned i;
+    for (i = 0; i < FRAMES; ++i) {
+        float sample = (float) (amplitude * sin(2.0 * M_PI * frequency * i / RATE));
+        buffer[2 * i] = sample;
+        buffer[2 * i + 1] = sample;
+    }
+}
+
+/** Root mean square of one channel after the ramps have settled */
+
+static double rms(unsigned channel)
+{
+    double sum = 0.0;
+    unsigned i;
+    for (i = SETTLE; i < FRAMES; ++i) {
+        sum += buffer[2 * i + channel] * buffer[2 * i + channel];
+    }
+    return sqrt(sum / (FRAMES - SETTLE));
+}
+
+static double db(double ratio)
+{
+    return 20.0 * log10(ratio);
+}
+
+/** Largest change between consecutive samples of one channel, to catch clicks */
+
+static float maxStep(unsigned channel)
+{
+    float step = 0.0f;
+    unsigned i;
+    for (i = 1; i < FRAMES; ++i) {
+        float diff = fabsf(buffer[2 * i + channel] - buffer[2 * (i - 1) + channel]);
+        if (diff > step) {
+            step = diff;
+        }
+    }
+    return step;
+}
+
+class EffectsTest : public ::testing::Test {
+};
+
+TEST_F(EffectsTest, FlatEqualizerIsTransparent) {
+    FxEqualizer eq;
+    FxEqualizer_init(&eq, RATE, FX_EQ_BANDS);
+    FxEqualizer_setBand(&eq, 0, 120.0f, 190.0f);
+    FxEqualizer_setEnabled(&eq, 1);
+    unsigned band;
+    for (band = 0; band < FX_EQ_BANDS; ++band) {
+        FxEqualizer_setLevel(&eq, band, 0);
+    }
+    ASSERT_FALSE(FxEqualizer_isActive(&eq));
+    fillSine(1000.0, 10000.0f);
+    static float original[FRAMES * 2];
+    memcpy(original, buffer, sizeof(buffer));
+    FxEqualizer_process(&eq, buffer, FRAMES);
+    ASSERT_EQ(0, memcmp(original, buffer, sizeof(buffer)));
+}
+
+TEST_F(EffectsTest, EqualizerBoostsOnlyItsBand) {
+    FxEqualizer eq;
+    FxEqualizer_init(&eq, RATE, 2);
+    FxEqualizer_setBand(&eq, 0, 500.0f, 750.0f);
+    FxEqualizer_setBand(&eq, 1, 8000.0f, 12000.0f);
+    FxEqualizer_setEnabled(&eq, 1);
+    FxEqualizer_setLevel(&eq, 0, 1200);
+    fillSine(500.0, 1000.0f);
+    FxEqualizer_process(&eq, buffer, FRAMES);
+    ASSERT_NEAR(12.0, db(rms(0) / (1000.0 / sqrt(2.0))), 0.1);
+    fillSine(8000.0, 1000.0f);
+    FxEqualizer_process(&eq, buffer, FRAMES);
+    ASSERT_NEAR(0.0, db(rms(1) / (1000.0 / sqrt(2.0))), 0.5);
+    // disabling ramps back to flat, then bypasses
+    FxEqualizer_setEnabled(&eq, 0);
+    fillSine(500.0, 1000.0f);
+    FxEqualizer_process(&eq, buffer, FRAMES);
+    ASSERT_NEAR(0.0, db(rms(0) / (1000.0 / sqrt(2.0))), 0.01);
+    ASSERT_FALSE(FxEqualizer_isActive(&eq));
+}
+
+TEST_F(EffectsTest, BassBoostRaisesLowFrequencies) {
+    FxBassBoost bb;
+    FxBassBoost_init(&bb, RATE);
+    FxBassBoost_setEnabled(&bb, 1);
+    FxBassBoost_setStrength(&bb, 1000);
+    fillSine(40.0, 1000.0f);
+    FxBassBoost_process(&bb, buffer, FRAMES);
+    double low = db(rms(0) / (1000.0 / sqrt(2.0)));
+    fillSine(5000.0, 1000.0f);
+    FxBassBoost_process(&bb, buffer, FRAMES);
+    double high = db(rms(0) / (1000.0 / sqrt(2.0)));
+    ASSERT_LT(10.0, low);
+    ASSERT_NEAR(0.0, high, 0.2);
+}
+
+TEST_F(EffectsTest, VirtualizerWidensOnlySide) {
+    FxVirtualizer virt;
+    FxVirtualizer_init(&virt);
+    FxVirtualizer_setEnabled(&virt, 1);
+    FxVirtualizer_setStrength(&virt, 1000);
+    // a centered source is left alone
+    fillSine(1000.0, 1000.0f);
+    FxVirtualizer_process(&virt, buffer, FRAMES);
+    ASSERT_NEAR(1000.0 / sqrt(2.0), rms(0), 0.01);
+    ASSERT_NEAR(1000.0 / sqrt(2.0), rms(1), 0.01);
+    // a source in one channel spreads out of phase into the other
+    fillSine(1000.0, 1000.0f);
+    unsigned i;
+    for (i = 0; i < FRAMES; ++i) {
+        buffer[2 * i + 1] = 0.0f;
+    }
+    FxVirtualizer_process(&virt, buffer, FRAMES);
+    ASSERT_NEAR(1.5 * 1000.0 / sqrt(2.0), rms(0), 0.1);
+    ASSERT_NEAR(0.5 * 1000.0 / sqrt(2.0), rms(1), 0.1);
+}
+
+TEST_F(EffectsTest, ParameterChangesDoNotClick) {
+    // a sine's largest step is 2 pi f / fs times its amplitude, so a jump in gain of one
+    // sample would be far larger than twice the step at the loudest setting
+    FxEqualizer eq;
+    FxEqualizer_init(&eq, RATE, FX_EQ_BANDS);
+    FxEqualizer_setBand(&eq, 0, 100.0f, 100.0f);
+    FxEqualizer_setEnabled(&eq, 1);
+    FxVirtualizer virt;
+    FxVirtualizer_init(&virt);
+    FxVirtualizer_setEnabled(&virt, 1);
+    fillSine(100.0, 10000.0f);
+    unsigned i;
+    for (i = 0; i < FRAMES; ++i) {
+        buffer[2 * i + 1] = 0.0f;
+    }
+    float limit = (float) (2.0 * M_PI * 100.0 / RATE * 10000.0 * pow(10.0, 15.0 / 20.0) * 2.0);
+    unsigned offset;
+    for (offset = 0; offset < FRAMES; offset += 1024) {
+        // jump between extremes every block
+        int up = (offset / 1024) & 1;
+        FxEqualizer_setLevel(&eq, 0, up ? 1500 : -1500);
+        FxVirtualizer_setStrength(&virt, up ? 1000 : 0);
+        unsigned frames = FRAMES - offset < 1024 ? FRAMES - offset : 1024;
+        FxEqualizer_process(&eq, &buffer[2 * offset], frames);
+        FxVirtualizer_process(&virt, &buffer[2 * offset], frames);
+    }
+    ASSERT_GT(limit, maxStep(0));
+    ASSERT_GT(limit, maxStep(1));
+}
+
+TEST_F(EffectsTest, ReverbDecaysAtDecayTime) {
+    FxReverb *rev = new FxReverb;
+    ASSERT_EQ(0, FxReverb_init(rev, RATE));
+    FxReverbSettings settings;
+    memset(&settings, 0, sizeof(settings));
+    settings.mRoomLevel = 0;
+    settings.mRoomHFLevel = 0;
+    settings.mDecayTime = 2000;
+    settings.mDecayHFRatio = 1000;
+    settings.mReflectionsLevel = -10000;
+    settings.mReflectionsDelay = 20;
+    settings.mReverbLevel = 0;
+    settings.mReverbDelay = 40;
+    settings.mDiffusion = 1000;
+    FxReverb_setSettings(rev, &settings);
+    // a burst of noise, then silence
+    static float input[FRAMES * 2];
+    memset(input, 0, sizeof(input));
+    unsigned i;
+    srand(1);
+    for (i = 0; i < 4410 * 2; ++i) {
+        input[i] = (float) (rand() % 20001 - 10000);
+    }
+    memset(buffer, 0, sizeof(buffer));
+    FxReverb_process(rev, input, buffer, FRAMES);
+    // a 2 second decay time is 30 dB per second, so 15 dB between these half second windows
+    double energy[2] = { 0.0, 0.0 };
+    unsigned window;
+    for (window = 0; window < 2; ++window) {
+        unsigned start = 8820 + window * 22050;
+        for (i = start; i < start + 11025 / 2; ++i) {
+            energy[window] += buffer[2 * i] * buffer[2 * i] + buffer[2 * i + 1] * buffer[2 * i + 1];
+        }
+    }
+    ASSERT_NEAR(-15.0, 10.0 * log10(energy[1] / energy[0]), 3.0);
+    ASSERT_TRUE(FxReverb_isActive(rev));
+    // without input the tail ends, and then the reverb may be skipped
+    unsigned blocks;
+    for (blocks = 0; FxReverb_isActive(rev) && blocks < 100; ++blocks) {
+        FxReverb_process(rev, NULL, buffer, FRAMES);
+    }
+    ASSERT_GT(100U, blocks);
+    FxReverb_deinit(rev);
+    delete rev;
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
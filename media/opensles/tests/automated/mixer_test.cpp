@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** \file mixer_test.cpp Compare each set of mix kernels against a reference mixer, and check
+ *  the resampler built on them */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mixer.h"
+#include "resampler.h"
+#include <gtest/gtest.h>
+
+#define MAX_TRACKS 32
+// Not a multiple of any vector width, so every kernel runs its tail loop
+#define SAMPLES (2 * 1001)
+// Room to offset the buffers from their natural alignment
+#define SLOP 8
+
+static short tracks[MAX_TRACKS][SAMPLES + SLOP];
+static uint16_t trackGains[MAX_TRACKS][2];
+
+/** Straightforward 64-bit mixer that the kernels must match exactly */
+
+static void referenceMix(short *dst, unsigned numTracks, unsigned offset, unsigned count)
+{
+    unsigned i, t;
+    for (i = 0; i < count; ++i) {
+        int64_t sum = 0;
+        for (t = 0; t < numTracks; ++t) {
+            sum += ((int32_t) tracks[t][offset + i] * trackGains[t][i & 1]) >> 15;
+        }
+        if (sum > 32767) {
+            sum = 32767;
+        } else if (sum < -32768) {
+            sum = -32768;
+        }
+        dst[i] = (short) sum;
+    }
+}
+
+static void kernelMix(const MixerKernels *kernels, short *dst, unsigned numTracks,
+    unsigned offset, unsigned count)
+{
+    int32_t acc[SAMPLES + SLOP];
+    int32_t *a = &acc[offset];
+    memset(a, 0, count * sizeof(int32_t));
+    unsigned t;
+    for (t = 0; t < numTracks; ++t) {
+        (*kernels->mAccumulate)(a, &tracks[t][offset], count, trackGains[t]);
+    }
+    (*kernels->mSaturate)(dst, a, count);
+}
+
+class MixerTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        srand(1);
+        unsigned t, i;
+        for (t = 0; t < MAX_TRACKS; ++t) {
+            for (i = 0; i < SAMPLES + SLOP; ++i) {
+                tracks[t][i] = (short) (rand() & 0xFFFF);
+            }
+        }
+    }
+
+    // Mix with every set of kernels available on this CPU and compare against the reference
+    void check(unsigned numTracks, unsigned offset, unsigned count) {
+        short expected[SAMPLES + SLOP];
+        short actual[SAMPLES + SLOP];
+        referenceMix(expected, numTracks, offset, count);
+        const MixerKernels *kernels;
+        unsigned k;
+        for (k = 0; NULL != (kernels = mixer_getKernels(k)); ++k) {
+            memset(actual, 0x55, sizeof(actual));
+            kernelMix(kernels, &actual[offset], numTracks, offset, count);
+            unsigned i;
+            for (i = 0; i < count; ++i) {
+                ASSERT_EQ(expected[i], actual[offset + i]) << "kernels " << kernels->mName
+                        << ", tracks " << numTracks << ", offset " << offset
+                        << ", count " << count << ", sample " << i;
+            }
+            // nothing past the end may be touched
+            ASSERT_EQ((short) 0x5555, actual[offset + count]) << "kernels " << kernels->mName;
+        }
+    }
+};
+
+TEST_F(MixerTest, KernelsAvailable) {
+    const MixerKernels *kernels = mixer_getKernels(0);
+    ASSERT_TRUE(NULL != kernels);
+    unsigned k;
+    for (k = 0; NULL != mixer_getKernels(k); ++k) {
+        printf("mixer kernels %u: %s\n", k, mixer_getKernels(k)->mName);
+    }
+    // the portable kernels are always last
+    ASSERT_STREQ("c", mixer_getKernels(k - 1)->mName);
+}
+
+TEST_F(MixerTest, GainConversion) {
+    ASSERT_EQ(0, mixer_gain(0.0f));
+    ASSERT_EQ(0, mixer_gain(-1.0f));
+    ASSERT_EQ(MIXER_UNITY_GAIN, mixer_gain(1.0f));
+    ASSERT_EQ(MIXER_UNITY_GAIN / 2, mixer_gain(0.5f));
+    ASSERT_EQ(MIXER_MAX_GAIN, mixer_gain(2.0f));
+    ASSERT_EQ(MIXER_MAX_GAIN, mixer_gain(100.0f));
+}
+
+TEST_F(MixerTest, UnityGainSaturates) {
+    unsigned t;
+    for (t = 0; t < MAX_TRACKS; ++t) {
+        trackGains[t][0] = trackGains[t][1] = MIXER_UNITY_GAIN;
+    }
+    // full scale random tracks clip almost everywhere
+    check(MAX_TRACKS, 0, SAMPLES);
+    check(2, 0, SAMPLES);
+    check(1, 0, SAMPLES);
+}
+
+TEST_F(MixerTest, ExtremeGains) {
+    static const uint16_t extremes[] = { 0, 1, 0x4000, 0x7FFF, MIXER_UNITY_GAIN, 0x8001,
+        MIXER_MAX_GAIN };
+    const unsigned numExtremes = sizeof(extremes) / sizeof(extremes[0]);
+    unsigned left, right;
+    for (left = 0; left < numExtremes; ++left) {
+        for (right = 0; right < numExtremes; ++right) {
+            trackGains[0][0] = extremes[left];
+            trackGains[0][1] = extremes[right];
+            check(1, 0, SAMPLES);
+        }
+    }
+}
+
+TEST_F(MixerTest, RandomGainsAndAlignment) {
+    unsigned iteration;
+    for (iteration = 0; iteration < 200; ++iteration) {
+        unsigned t;
+        for (t = 0; t < MAX_TRACKS; ++t) {
+            trackGains[t][0] = (uint16_t) (rand() % (MIXER_MAX_GAIN + 1));
+            trackGains[t][1] = (uint16_t) (rand() % (MIXER_MAX_GAIN + 1));
+        }
+        unsigned numTracks = 1 + rand() % MAX_TRACKS;
+        // offsets and counts in whole frames, but otherwise unaligned
+        unsigned offset = 2 * (rand() % (SLOP / 2));
+        unsigned count = 2 * (rand() % (SAMPLES / 2 + 1));
+        check(numTracks, offset, count);
+    }
+}
+
+/** Straightforward convolution that the convolve kernels must match exactly */
+
+static void referenceConvolve(short dst[2], const short *left, const short *right,
+    const short *coefs)
+{
+    int64_t sumL = 0, sumR = 0;
+    unsigned k;
+    for (k = 0; k < MIXER_CONVOLVE_TAPS; ++k) {
+        sumL += (int32_t) left[k] * coefs[k];
+        sumR += (int32_t) right[k] * coefs[k];
+    }
+    sumL >>= 15;
+    sumR >>= 15;
+    dst[0] = (short) (sumL > 32767 ? 32767 : sumL < -32768 ? -32768 : sumL);
+    dst[1] = (short) (sumR > 32767 ? 32767 : sumR < -32768 ? -32768 : sumR);
+}
+
+TEST_F(MixerTest, Convolve) {
+    unsigned iteration;
+    for (iteration = 0; iteration < 1000; ++iteration) {
+        // small coefficients are realistic, the largest allowed ones exercise saturation
+        short coefs[MIXER_CONVOLVE_TAPS + SLOP];
+        unsigned k;
+        for (k = 0; k < MIXER_CONVOLVE_TAPS + SLOP; ++k) {
+            coefs[k] = (short) (iteration & 1 ? rand() % 4095 - 2047 : rand() % 512 - 256);
+        }
+        unsigned offset = rand() % SLOP;
+        short expected[2];
+        referenceConvolve(expected, &tracks[0][offset], &tracks[1][offset], &coefs[offset]);
+        const MixerKernels *kernels;
+        for (k = 0; NULL != (kernels = mixer_getKernels(k)); ++k) {
+            short actual[2];
+            (*kernels->mConvolve)(actual, &tracks[0][offset], &tracks[1][offset],
+                    &coefs[offset]);
+            ASSERT_EQ(expected[0], actual[0]) << "kernels " << kernels->mName
+                    << ", iteration " << iteration;
+            ASSERT_EQ(expected[1], actual[1]) << "kernels " << kernels->mName
+                    << ", iteration " << iteration;
+        }
+    }
+}
+
+/** Resample one second of a sine wave and return the signal to noise ratio in dB */
+
+static double resampleSine(const MixerKernels *kernels, unsigned srcHz, unsigned ratePermille,
+    unsigned channels, double frequency)
+{
+    static short in[96000 * 2];
+    static short out[44100 * 4 * 2];
+    unsigned i, c;
+    for (i = 0; i < srcHz; ++i) {
+        short sample = (short) lrint(16000.0 * sin(2.0 * M_PI * frequency * i / srcHz));
+        for (c = 0; c < channels; ++c) {
+            in[i * channels + c] = c ? -sample : sample;
+        }
+    }
+    Resampler *r = Resampler_create(kernels, srcHz * 1000, 44100000, ratePermille);
+    EXPECT_TRUE(NULL != r);
+    if (NULL == r) {
+        return 0.0;
+    }
+    // feed in odd sized pieces, asking for only as much input as is needed
+    unsigned written = 0, produced = 0;
+    for (;;) {
+        unsigned want = 1 + rand() % 500;
+        unsigned needed = Resampler_framesNeeded(r, want);
+        if (needed > srcHz - written) {
+            needed = srcHz - written;
+        }
+        EXPECT_EQ(0, Resampler_write(r, &in[written * channels], needed, channels));
+        written += needed;
+        unsigned got = Resampler_read(r, &out[produced * 2], want);
+        produced += got;
+        if (got < want) {
+            // only possible once the input is exhausted
+            EXPECT_EQ(srcHz, written);
+            break;
+        }
+    }
+    Resampler_destroy(r);
+    // output rate is 44.1 kHz, and the playback rate scales the frequency and the duration
+    double outFrequency = frequency * ratePermille / 1000.0;
+    // less the frames held back for the second half of the filter
+    double expectedFrames = 44100.0 * 1000.0 / ratePermille;
+    EXPECT_NEAR(expectedFrames, (double) produced,
+            (MIXER_CONVOLVE_TAPS / 2 + 1) * expectedFrames / srcHz + 2.0);
+    double signal = 0.0, noise = 0.0;
+    // skip the start and end, which are filtered against the implicit silence around the input
+    for (i = 100; i + 100 < produced; ++i) {
+        double expected = 16000.0 * sin(2.0 * M_PI * outFrequency * i / 44100.0);
+        double left = out[2 * i] - expected;
+        double right = (channels == 1 ? out[2 * i + 1] : -out[2 * i + 1]) - expected;
+        signal += 2.0 * expected * expected;
+        noise += left * left + right * right;
+    }
+    return 10.0 * log10(signal / noise);
+}
+
+TEST_F(MixerTest, ResampleSine) {
+    static const unsigned rates[] = { 8000, 11025, 22050, 32000, 44100, 48000, 96000 };
+    const MixerKernels *kernels;
+    unsigned k, i;
+    for (k = 0; NULL != (kernels = mixer_getKernels(k)); ++k) {
+        for (i = 0; i < sizeof(rates) / sizeof(rates[0]); ++i) {
+            ASSERT_LT(55.0, resampleSine(kernels, rates[i], 1000, 2, 1000.0))
+                    << "kernels " << kernels->mName << ", rate " << rates[i];
+            ASSERT_LT(55.0, resampleSine(kernels, rates[i], 1000, 1, 1000.0))
+                    << "kernels " << kernels->mName << ", mono rate " << rates[i];
+        }
+        ASSERT_LT(55.0, resampleSine(kernels, 22050, 2000, 2, 1000.0)) << kernels->mName;
+        ASSERT_LT(55.0, resampleSine(kernels, 44100, 500, 2, 1000.0)) << kernels->mName;
+        ASSERT_LT(55.0, resampleSine(kernels, 44100, 1333, 1, 1000.0)) << kernels->mName;
+    }
+}
+
+TEST_F(MixerTest, ResampleUnityIsExact) {
+    Resampler *r = Resampler_create(mixer_getKernels(0), 44100000, 44100000, 1000);
+    ASSERT_TRUE(NULL != r);
+    short out[SAMPLES];
+    ASSERT_EQ(0, Resampler_write(r, tracks[0], SAMPLES / 2, 2));
+    unsigned got = Resampler_read(r, out, SAMPLES / 2);
+    // the output is a copy, less the frames held back for the second half of the filter
+    ASSERT_EQ(SAMPLES / 2 - MIXER_CONVOLVE_TAPS / 2, got);
+    ASSERT_EQ(0, memcmp(out, tracks[0], got * 2 * sizeof(short)));
+    Resampler_destroy(r);
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
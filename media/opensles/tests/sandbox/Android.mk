@@ -371,3 +371,166 @@ LOCAL_CFLAGS += -UNDEBUG
 LOCAL_MODULE:= slesTest_monkey
 
 include $(BUILD_EXECUTABLE)
+
+# mixbench
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_C_INCLUDES:= \
+	system/media/opensles/libopensles
+
+LOCAL_SRC_FILES:= \
+	mixbench.c \
+	../../libopensles/mixer.c
+
+LOCAL_CFLAGS += -O2 -UNDEBUG
+
+LOCAL_MODULE:= slesTest_mixbench
+
+include $(BUILD_EXECUTABLE)
+
+# resamplebench
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_C_INCLUDES:= \
+	system/media/opensles/libopensles
+
+LOCAL_SRC_FILES:= \
+	resamplebench.c \
+	../../libopensles/mixer.c \
+	../../libopensles/resampler.c
+
+LOCAL_CFLAGS += -O2 -UNDEBUG
+
+LOCAL_MODULE:= slesTest_resamplebench
+
+include $(BUILD_EXECUTABLE)
+
+# fxbench
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_C_INCLUDES:= \
+	system/media/opensles/libopensles
+
+LOCAL_SRC_FILES:= \
+	fxbench.c \
+	../../libopensles/effects.c
+
+LOCAL_CFLAGS += -O2 -UNDEBUG
+
+LOCAL_MODULE:= slesTest_fxbench
+
+include $(BUILD_EXECUTABLE)
+
+# poolbench
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_C_INCLUDES:= \
+	system/media/opensles/include \
+	system/media/opensles/libopensles \
+	frameworks/base/media/libstagefright \
+	frameworks/base/media/libstagefright/include \
+	frameworks/base/include/media/stagefright/openmax
+
+LOCAL_SRC_FILES:= \
+	poolbench.c \
+	../../libopensles/ThreadPool.c
+
+LOCAL_SHARED_LIBRARIES := \
+	libutils
+
+# same language and options as the library, since sles_allinclusive.h is shared with it
+LOCAL_CFLAGS += -x c++ -Wno-multichar -Wno-invalid-offsetof -DUSE_PROFILES=0 -UNDEBUG
+
+LOCAL_MODULE:= slesTest_poolbench
+
+include $(BUILD_EXECUTABLE)
+
+# synclatency
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_C_INCLUDES:= \
+	system/media/opensles/include
+
+LOCAL_SRC_FILES:= \
+	synclatency.c
+
+LOCAL_SHARED_LIBRARIES := \
+	libutils \
+	libOpenSLES
+
+ifeq ($(TARGET_OS),linux)
+	LOCAL_CFLAGS += -DXP_UNIX
+endif
+
+LOCAL_CFLAGS += -UNDEBUG
+
+LOCAL_MODULE:= slesTest_synclatency
+
+include $(BUILD_EXECUTABLE)
+
+# prefetchstress
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_C_INCLUDES:= \
+	system/media/opensles/include
+
+LOCAL_SRC_FILES:= \
+	prefetchstress.c
+
+LOCAL_SHARED_LIBRARIES := \
+	libutils \
+	libOpenSLES
+
+ifeq ($(TARGET_OS),linux)
+	LOCAL_CFLAGS += -DXP_UNIX
+endif
+
+LOCAL_CFLAGS += -UNDEBUG
+
+LOCAL_MODULE:= slesTest_prefetchstress
+
+include $(BUILD_EXECUTABLE)
+
+# mixstats
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_C_INCLUDES:= \
+	system/media/opensles/include
+
+LOCAL_SRC_FILES:= \
+	mixstats.c
+
+LOCAL_SHARED_LIBRARIES := \
+	libutils \
+	libOpenSLES
+
+ifeq ($(TARGET_OS),linux)
+	LOCAL_CFLAGS += -DXP_UNIX
+endif
+
+LOCAL_CFLAGS += -UNDEBUG
+
+LOCAL_MODULE:= slesTest_mixstats
+
+include $(BUILD_EXECUTABLE)
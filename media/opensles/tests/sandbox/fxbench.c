@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmark the OutputMixExt software effects: run each effect on 60 seconds of stereo noise
+// at 44.1 kHz in blocks the size of a mixer frame, and report the time per block and the CPU
+// load.  Parameters change every block so the cost of ramping is included.
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "effects.h"
+
+#define SECONDS 60
+#define RATE 44100
+#define BLOCK 1024                      // frames per mixer frame
+#define BLOCKS (SECONDS * RATE / BLOCK)
+
+static float input[BLOCK * 2];
+static float output[BLOCK * 2];
+
+static FxEqualizer eq;
+static FxBassBoost bassBoost;
+static FxVirtualizer virtualizer;
+static FxReverb reverb;
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void equalizer(unsigned block)
+{
+    FxEqualizer_setLevel(&eq, block & 3, (block & 4) ? 1200 : -1200);
+    FxEqualizer_process(&eq, output, BLOCK);
+}
+
+static void bassboost(unsigned block)
+{
+    FxBassBoost_setStrength(&bassBoost, (block & 1) ? 1000 : 500);
+    FxBassBoost_process(&bassBoost, output, BLOCK);
+}
+
+static void virtualize(unsigned block)
+{
+    FxVirtualizer_setStrength(&virtualizer, (block & 1) ? 1000 : 500);
+    FxVirtualizer_process(&virtualizer, output, BLOCK);
+}
+
+static void reverberate(unsigned block)
+{
+    (void) block;
+    FxReverb_process(&reverb, input, output, BLOCK);
+}
+
+static const struct {
+    const char *mName;
+    void (*mProcess)(unsigned block);
+} effects[] = {
+    { "Equalizer", equalizer },
+    { "BassBoost", bassboost },
+    { "Virtualizer", virtualize },
+    { "Reverb", reverberate }
+};
+
+int main(int argc, char **argv)
+{
+    unsigned i;
+    srand(1);
+    for (i = 0; i < BLOCK * 2; ++i) {
+        input[i] = (float) (rand() % 20001 - 10000);
+    }
+    FxEqualizer_init(&eq, RATE, FX_EQ_BANDS);
+    static const float centers[FX_EQ_BANDS] = { 120.0f, 500.0f, 2000.0f, 8000.0f };
+    for (i = 0; i < FX_EQ_BANDS; ++i) {
+        FxEqualizer_setBand(&eq, i, centers[i], centers[i] * 1.5f);
+    }
+    FxEqualizer_setEnabled(&eq, 1);
+    FxBassBoost_init(&bassBoost, RATE);
+    FxBassBoost_setEnabled(&bassBoost, 1);
+    FxVirtualizer_init(&virtualizer);
+    FxVirtualizer_setEnabled(&virtualizer, 1);
+    int ok = FxReverb_init(&reverb, RATE);
+    assert(0 == ok);
+    static const FxReverbSettings hall = { -1000, -600, 1800, 700, -2000, 30, -1400, 60, 1000 };
+    FxReverb_setSettings(&reverb, &hall);
+
+    printf("%d seconds of stereo at %d Hz, %d frames per block\n", SECONDS, RATE, BLOCK);
+    for (i = 0; i < sizeof(effects) / sizeof(effects[0]); ++i) {
+        unsigned block;
+        double start = now();
+        for (block = 0; block < BLOCKS; ++block) {
+            memcpy(output, input, sizeof(output));
+            (*effects[i].mProcess)(block);
+        }
+        double elapsed = now() - start;
+        printf("%-12s %8.2f us per block  %6.3f%% CPU\n", effects[i].mName,
+            elapsed * 1000000.0 / BLOCKS, elapsed * 100.0 / SECONDS);
+    }
+
+    FxReverb_deinit(&reverb);
+    return EXIT_SUCCESS;
+}
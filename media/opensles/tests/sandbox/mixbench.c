@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmark the OutputMixExt mix kernels: mix 32 tracks of 10 seconds each,
+// one mixer frame at a time, with each set of kernels available on this CPU.
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "mixer.h"
+
+#define TRACKS 32
+#define SECONDS 10
+#define RATE 44100
+#define SAMPLES (SECONDS * RATE * 2)    // stereo
+#define PERIOD 1024                     // samples per mixer frame, as used with SDL
+
+static short *tracks[TRACKS];
+static uint16_t gains[TRACKS][2];
+static short output[PERIOD];
+static int32_t acc[PERIOD];
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// The mixer this replaces: float gains applied per sample, no saturation
+static void floatMix(void)
+{
+    unsigned base, t, i;
+    for (base = 0; base < SAMPLES; base += PERIOD) {
+        unsigned count = SAMPLES - base < PERIOD ? SAMPLES - base : PERIOD;
+        for (t = 0; t < TRACKS; ++t) {
+            const short *src = &tracks[t][base];
+            float gainL = gains[t][0] / 32768.0f, gainR = gains[t][1] / 32768.0f;
+            if (0 == t) {
+                for (i = 0; i < count; i += 2) {
+                    output[i] = (short) (src[i] * gainL);
+                    output[i + 1] = (short) (src[i + 1] * gainR);
+                }
+            } else {
+                for (i = 0; i < count; i += 2) {
+                    output[i] += (short) (src[i] * gainL);
+                    output[i + 1] += (short) (src[i + 1] * gainR);
+                }
+            }
+        }
+    }
+}
+
+static void kernelMix(const MixerKernels *kernels)
+{
+    unsigned base, t;
+    for (base = 0; base < SAMPLES; base += PERIOD) {
+        // the last mixer frame is partial
+        unsigned count = SAMPLES - base < PERIOD ? SAMPLES - base : PERIOD;
+        memset(acc, 0, count * sizeof(int32_t));
+        for (t = 0; t < TRACKS; ++t) {
+            (*kernels->mAccumulate)(acc, &tracks[t][base], count, gains[t]);
+        }
+        (*kernels->mSaturate)(output, acc, count);
+    }
+}
+
+static void report(const char *name, double seconds)
+{
+    printf("%-6s %8.3f s  %7.1fx realtime\n", name, seconds, SECONDS / seconds);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned t, i;
+    srand(1);
+    for (t = 0; t < TRACKS; ++t) {
+        tracks[t] = (short *) malloc(SAMPLES * sizeof(short));
+        assert(NULL != tracks[t]);
+        for (i = 0; i < SAMPLES; ++i) {
+            tracks[t][i] = (short) (rand() & 0xFFFF);
+        }
+        // mostly attenuated, with a few tracks at unity
+        gains[t][0] = (t & 3) ? mixer_gain(0.1f + t / 64.0f) : MIXER_UNITY_GAIN;
+        gains[t][1] = (t & 3) ? mixer_gain(0.6f - t / 64.0f) : MIXER_UNITY_GAIN;
+    }
+    printf("mixing %d tracks of %d seconds at %d Hz, %d samples per mixer frame\n", TRACKS,
+        SECONDS, RATE, PERIOD);
+
+    double start = now();
+    floatMix();
+    report("float", now() - start);
+
+    const MixerKernels *kernels;
+    unsigned k;
+    for (k = 0; NULL != (kernels = mixer_getKernels(k)); ++k) {
+        start = now();
+        kernelMix(kernels);
+        report(kernels->mName, now() - start);
+    }
+
+    for (t = 0; t < TRACKS; ++t) {
+        free(tracks[t]);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Read the mixer statistics of an output mix while two buffer queue players play: one is
+// refilled from its callback and should never underrun, the other is fed late on purpose from
+// the main thread and should underrun about once per buffer.  A third thread changes the
+// volume of the players continuously, to contend for their locks with the mixer.
+
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "SLES/OpenSLES.h"
+#include "SLES/OpenSLES_Android.h"
+
+#define SECONDS 5
+#define RATE 44100
+#define FRAMES (RATE / 10)      // 100 ms per buffer
+#define LATE_US 150000          // the starved player gets a 100 ms buffer every 150 ms
+
+static short sine[FRAMES * 2];
+static SLVolumeItf volumes[2];
+static volatile int running = 1;
+
+static void callback(SLBufferQueueItf caller, void *context)
+{
+    (void) context;
+    SLresult result = (*caller)->Enqueue(caller, sine, sizeof(sine));
+    assert(SL_RESULT_SUCCESS == result);
+}
+
+static void *contend(void *context)
+{
+    (void) context;
+    SLmillibel level = 0;
+    while (running) {
+        unsigned i;
+        for (i = 0; i < 2; ++i) {
+            (*volumes[i])->SetVolumeLevel(volumes[i], level);
+        }
+        level = 0 == level ? -600 : 0;
+    }
+    return NULL;
+}
+
+static SLObjectItf createPlayer(SLEngineItf engine, SLObjectItf outputMix, unsigned i,
+    SLPlayItf *play, SLBufferQueueItf *bufferQueue)
+{
+    SLDataLocator_BufferQueue locator = {SL_DATALOCATOR_BUFFERQUEUE, 2};
+    SLDataFormat_PCM format = {SL_DATAFORMAT_PCM, 2, SL_SAMPLINGRATE_44_1,
+        SL_PCMSAMPLEFORMAT_FIXED_16, 16, SL_SPEAKER_FRONT_LEFT | SL_SPEAKER_FRONT_RIGHT,
+        SL_BYTEORDER_LITTLEENDIAN};
+    SLDataSource source = {&locator, &format};
+    SLDataLocator_OutputMix locatorOutputMix = {SL_DATALOCATOR_OUTPUTMIX, outputMix};
+    SLDataSink sink = {&locatorOutputMix, NULL};
+    SLInterfaceID ids[2] = {SL_IID_BUFFERQUEUE, SL_IID_VOLUME};
+    SLboolean flags[2] = {SL_BOOLEAN_TRUE, SL_BOOLEAN_TRUE};
+    SLObjectItf playerObject;
+    SLresult result;
+    result = (*engine)->CreateAudioPlayer(engine, &playerObject, &source, &sink, 2, ids, flags);
+    assert(SL_RESULT_SUCCESS == result);
+    result = (*playerObject)->Realize(playerObject, SL_BOOLEAN_FALSE);
+    assert(SL_RESULT_SUCCESS == result);
+    result = (*playerObject)->GetInterface(playerObject, SL_IID_PLAY, play);
+    assert(SL_RESULT_SUCCESS == result);
+    result = (*playerObject)->GetInterface(playerObject, SL_IID_BUFFERQUEUE, bufferQueue);
+    assert(SL_RESULT_SUCCESS == result);
+    result = (*playerObject)->GetInterface(playerObject, SL_IID_VOLUME, &volumes[i]);
+    assert(SL_RESULT_SUCCESS == result);
+    return playerObject;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 1) {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    unsigned i;
+    for (i = 0; i < FRAMES; ++i) {
+        sine[i * 2] = sine[i * 2 + 1] = (short) (8000.0 * sin(2.0 * M_PI * 441.0 * i / RATE));
+    }
+
+    SLresult result;
+    SLObjectItf engineObject;
+    result = slCreateEngine(&engineObject, 0, NULL, 0, NULL, NULL);
+    assert(SL_RESULT_SUCCESS == result);
+    result = (*engineObject)->Realize(engineObject, SL_BOOLEAN_FALSE);
+    assert(SL_RESULT_SUCCESS == result);
+    SLEngineItf engine;
+    result = (*engineObject)->GetInterface(engineObject, SL_IID_ENGINE, &engine);
+    assert(SL_RESULT_SUCCESS == result);
+
+    // the statistics are only collected when the interface is requested
+    SLObjectItf outputMixObject;
+    SLInterfaceID ids[1] = {SL_IID_ANDROIDMIXSTATS};
+    SLboolean flags[1] = {SL_BOOLEAN_TRUE};
+    result = (*engine)->CreateOutputMix(engine, &outputMixObject, 1, ids, flags);
+    if (SL_RESULT_FEATURE_UNSUPPORTED == result) {
+        printf("AndroidMixStats is not supported\n");
+        return EXIT_SUCCESS;
+    }
+    assert(SL_RESULT_SUCCESS == result);
+    result = (*outputMixObject)->Realize(outputMixObject, SL_BOOLEAN_FALSE);
+    assert(SL_RESULT_SUCCESS == result);
+    SLAndroidMixStatsItf mixStats;
+    result = (*outputMixObject)->GetInterface(outputMixObject, SL_IID_ANDROIDMIXSTATS,
+        &mixStats);
+    assert(SL_RESULT_SUCCESS == result);
+
+    SLObjectItf players[2];
+    SLPlayItf plays[2];
+    SLBufferQueueItf bufferQueues[2];
+    for (i = 0; i < 2; ++i) {
+        players[i] = createPlayer(engine, outputMixObject, i, &plays[i], &bufferQueues[i]);
+    }
+    result = (*bufferQueues[0])->RegisterCallback(bufferQueues[0], callback, NULL);
+    assert(SL_RESULT_SUCCESS == result);
+    for (i = 0; i < 2; ++i) {
+        result = (*bufferQueues[0])->Enqueue(bufferQueues[0], sine, sizeof(sine));
+        assert(SL_RESULT_SUCCESS == result);
+    }
+    result = (*bufferQueues[1])->Enqueue(bufferQueues[1], sine, sizeof(sine));
+    assert(SL_RESULT_SUCCESS == result);
+    result = (*mixStats)->ResetStats(mixStats);
+    assert(SL_RESULT_SUCCESS == result);
+    for (i = 0; i < 2; ++i) {
+        result = (*plays[i])->SetPlayState(plays[i], SL_PLAYSTATE_PLAYING);
+        assert(SL_RESULT_SUCCESS == result);
+    }
+
+    pthread_t thread;
+    int ok = pthread_create(&thread, (const pthread_attr_t *) NULL, contend, NULL);
+    assert(0 == ok);
+    unsigned feeds;
+    for (feeds = 0; feeds < SECONDS * 1000000 / LATE_US; ++feeds) {
+        usleep(LATE_US);
+        result = (*bufferQueues[1])->Enqueue(bufferQueues[1], sine, sizeof(sine));
+        assert(SL_RESULT_SUCCESS == result || SL_RESULT_BUFFER_INSUFFICIENT == result);
+    }
+    running = 0;
+    ok = pthread_join(thread, NULL);
+    assert(0 == ok);
+
+    SLAndroidMixStats stats;
+    result = (*mixStats)->GetStats(mixStats, &stats);
+    assert(SL_RESULT_SUCCESS == result);
+    printf("periods %u, mix time average %.1f us, max %u us\n", (unsigned) stats.periods,
+        stats.periods ? (double) stats.totalMixTime / stats.periods : 0.0,
+        (unsigned) stats.maxMixTime);
+    for (i = 0; i < SL_ANDROID_MIXSTATS_BUCKETS; ++i) {
+        if (stats.mixTimeHistogram[i]) {
+            printf("  %6u us %8u\n", 1 << i, (unsigned) stats.mixTimeHistogram[i]);
+        }
+    }
+    printf("underruns %u\n", (unsigned) stats.underruns);
+    printf("lock contentions %u, wait average %.1f us, max %u us\n",
+        (unsigned) stats.lockContentions,
+        stats.lockContentions ? (double) stats.totalLockWaitTime / stats.lockContentions : 0.0,
+        (unsigned) stats.maxLockWaitTime);
+    printf("thread pool depth %u, max %u of %u\n", (unsigned) stats.threadPoolDepth,
+        (unsigned) stats.maxThreadPoolDepth, (unsigned) stats.threadPoolCapacity);
+
+    for (i = 0; i < 2; ++i) {
+        SLuint32 underruns;
+        result = (*mixStats)->GetPlayerUnderruns(mixStats, players[i], &underruns);
+        if (SL_RESULT_FEATURE_UNSUPPORTED == result) {
+            printf("per-player underruns are not supported\n");
+            break;
+        }
+        assert(SL_RESULT_SUCCESS == result);
+        printf("player %u underruns %u\n", i, (unsigned) underruns);
+        // the first player is refilled from its callback, the second is fed late
+        if (0 == i) {
+            assert(0 == underruns);
+        } else {
+            assert(0 < underruns);
+        }
+    }
+    SLuint32 underruns;
+    result = (*mixStats)->GetPlayerUnderruns(mixStats, outputMixObject, &underruns);
+    assert(SL_RESULT_PARAMETER_INVALID == result);
+
+    for (i = 0; i < 2; ++i) {
+        (*players[i])->Destroy(players[i]);
+    }
+    (*outputMixObject)->Destroy(outputMixObject);
+    (*engineObject)->Destroy(engineObject);
+
+    return EXIT_SUCCESS;
+}
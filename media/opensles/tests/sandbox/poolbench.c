@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Contention benchmark for the ThreadPool: 8 client threads add closures as fast as they can
+// while 4 worker threads run them.  ThreadPool.c is built into this program directly.
+
+#include "sles_allinclusive.h"
+#include <sys/time.h>
+
+#define PRODUCERS 8
+#define WORKERS 4
+#define CLOSURES_PER_PRODUCER 250000
+
+static ThreadPool tp;
+static volatile int executed;
+static volatile int parameterSum;
+
+// ThreadPool.c needs this from sles.c, which isn't part of the benchmark
+SLresult err_to_result(int err)
+{
+    return 0 == err ? SL_RESULT_SUCCESS : SL_RESULT_RESOURCE_ERROR;
+}
+
+static void handler(void *context, int parameter)
+{
+    (void) __sync_fetch_and_add(&parameterSum, parameter);
+    (void) __sync_fetch_and_add(&executed, 1);
+}
+
+static void *producer(void *context)
+{
+    int i;
+    for (i = 0; i < CLOSURES_PER_PRODUCER; ++i) {
+        SLresult result = ThreadPool_add(&tp, handler, context, i & 1);
+        assert(SL_RESULT_SUCCESS == result);
+    }
+    return NULL;
+}
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int main(int argc, char **argv)
+{
+    SLresult result = ThreadPool_init(&tp, 0, WORKERS);
+    assert(SL_RESULT_SUCCESS == result);
+    pthread_t producers[PRODUCERS];
+    const int total = PRODUCERS * CLOSURES_PER_PRODUCER;
+
+    double start = now();
+    int i, ok;
+    for (i = 0; i < PRODUCERS; ++i) {
+        ok = pthread_create(&producers[i], (const pthread_attr_t *) NULL, producer, NULL);
+        assert(0 == ok);
+    }
+    for (i = 0; i < PRODUCERS; ++i) {
+        ok = pthread_join(producers[i], (void **) NULL);
+        assert(0 == ok);
+    }
+    while (executed < total) {
+        usleep(1000);
+    }
+    double elapsed = now() - start;
+
+    printf("%d producers, %d workers, %d closures in %.3f s: %.0f closures/s\n", PRODUCERS,
+        WORKERS, total, elapsed, total / elapsed);
+    // every closure ran exactly once
+    assert(total == executed);
+    assert(total / 2 == parameterSum);
+
+    ThreadPool_deinit(&tp);
+    // can't add once the pool has been destroyed
+    result = ThreadPool_add(&tp, handler, NULL, 0);
+    assert(SL_RESULT_PRECONDITIONS_VIOLATED == result);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Play many URI players at once from sources that are slow and bursty, like a file system in
+// user space, and count how often each one runs out of prefetched data.  Each source is a named
+// pipe fed by a thread that writes a 44.1 kHz stereo WAV stream at a limited bandwidth with
+// random stalls.  Exits with failure if any player underflowed while playing.
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "SLES/OpenSLES.h"
+
+#define RATE 44100
+#define CHANNELS 2
+#define CHUNK_MS 10
+
+// Describes one player and the writer thread that feeds it
+
+typedef struct {
+    char mPathname[256];
+    pthread_t mWriter;
+    unsigned mSeconds;
+    unsigned mBytesPerSecond;
+    unsigned mMaxStallMs;
+    unsigned mSeed;
+    SLObjectItf mPlayerObject;
+    SLPlayItf mPlayerPlay;
+    SLPrefetchStatusItf mPlayerPrefetchStatus;
+    volatile SLboolean mPlaying;    // set just before the play state is set to playing
+    volatile unsigned mUnderflows;
+    volatile SLpermille mLevel;     // last fill level reported
+    volatile SLpermille mMinLevel;  // lowest fill level reported while playing
+} Player;
+
+static void sleepMs(unsigned ms)
+{
+    usleep(ms * 1000);
+}
+
+static void putLE(unsigned char *p, unsigned value, unsigned bytes)
+{
+    while (bytes-- > 0) {
+        *p++ = (unsigned char) value;
+        value >>= 8;
+    }
+}
+
+static int writeAll(int fd, const void *buffer, size_t size)
+{
+    const char *p = (const char *) buffer;
+    while (size > 0) {
+        ssize_t actual = write(fd, p, size);
+        if (actual < 0 && EINTR == errno) {
+            continue;
+        }
+        if (actual <= 0) {
+            return -1;
+        }
+        p += actual;
+        size -= actual;
+    }
+    return 0;
+}
+
+// Writer thread: a WAV header, then a sine a chunk at a time at the configured bandwidth,
+// occasionally stalling for a random time as a slow file system would
+
+static void *writer(void *context)
+{
+    Player *p = (Player *) context;
+    int fd = open(p->mPathname, O_WRONLY);
+    if (fd < 0) {
+        perror(p->mPathname);
+        return NULL;
+    }
+    unsigned frames = p->mSeconds * RATE;
+    unsigned dataSize = frames * CHANNELS * sizeof(short);
+    unsigned char header[44];
+    memcpy(&header[0], "RIFF", 4);
+    putLE(&header[4], 36 + dataSize, 4);
+    memcpy(&header[8], "WAVEfmt ", 8);
+    putLE(&header[16], 16, 4);
+    putLE(&header[20], 1, 2);
+    putLE(&header[22], CHANNELS, 2);
+    putLE(&header[24], RATE, 4);
+    putLE(&header[28], RATE * CHANNELS * sizeof(short), 4);
+    putLE(&header[32], CHANNELS * sizeof(short), 2);
+    putLE(&header[34], 16, 2);
+    memcpy(&header[36], "data", 4);
+    putLE(&header[40], dataSize, 4);
+    if (writeAll(fd, header, sizeof(header))) {
+        close(fd);
+        return NULL;
+    }
+    unsigned chunkFrames = p->mBytesPerSecond * CHUNK_MS / 1000 / (CHANNELS * sizeof(short));
+    if (chunkFrames == 0) {
+        chunkFrames = 1;
+    }
+    short *chunk = (short *) malloc(chunkFrames * CHANNELS * sizeof(short));
+    assert(NULL != chunk);
+    double frequency = 220.0 * (1 + (p->mSeed % 8));
+    unsigned written = 0;
+    while (written < frames) {
+        unsigned count = frames - written < chunkFrames ? frames - written : chunkFrames;
+        unsigned i;
+        for (i = 0; i < count; ++i) {
+            short sample = (short) (1000.0 * sin(2.0 * M_PI * frequency * (written + i) / RATE));
+            chunk[2 * i] = sample;
+            chunk[2 * i + 1] = sample;
+        }
+        if (writeAll(fd, chunk, count * CHANNELS * sizeof(short))) {
+            break;
+        }
+        written += count;
+        sleepMs(CHUNK_MS);
+        // stall about once a second
+        if (0 < p->mMaxStallMs && 0 == rand_r(&p->mSeed) % (1000 / CHUNK_MS)) {
+            sleepMs(rand_r(&p->mSeed) % p->mMaxStallMs);
+        }
+    }
+    free(chunk);
+    close(fd);
+    return NULL;
+}
+
+// Called by the engine on prefetch status and fill level changes
+
+static void prefetchCallback(SLPrefetchStatusItf caller, void *context, SLuint32 event)
+{
+    Player *p = (Player *) context;
+    SLresult result;
+    if (event & SL_PREFETCHEVENT_STATUSCHANGE) {
+        SLuint32 status;
+        result = (*caller)->GetPrefetchStatus(caller, &status);
+        assert(SL_RESULT_SUCCESS == result);
+        if (SL_PREFETCHSTATUS_UNDERFLOW == status && p->mPlaying) {
+            ++p->mUnderflows;
+        }
+    }
+    if (event & SL_PREFETCHEVENT_FILLLEVELCHANGE) {
+        SLpermille level;
+        result = (*caller)->GetFillLevel(caller, &level);
+        assert(SL_RESULT_SUCCESS == result);
+        p->mLevel = level;
+        if (p->mPlaying && level < p->mMinLevel) {
+            p->mMinLevel = level;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned numPlayers = 16;
+    unsigned seconds = 10;
+    unsigned bytesPerSecond = 2 * RATE * CHANNELS * sizeof(short);
+    unsigned maxStallMs = 100;
+    const char *directory = ".";
+    int i;
+    for (i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (arg[0] != '-')
+            break;
+        if (!strncmp(arg, "-n", 2))
+            numPlayers = atoi(&arg[2]);
+        else if (!strncmp(arg, "-t", 2))
+            seconds = atoi(&arg[2]);
+        else if (!strncmp(arg, "-b", 2))
+            bytesPerSecond = atoi(&arg[2]) * 1024;
+        else if (!strncmp(arg, "-s", 2))
+            maxStallMs = atoi(&arg[2]);
+        else if (!strncmp(arg, "-d", 2))
+            directory = &arg[2];
+        else
+            fprintf(stderr, "unknown option: %s\n", arg);
+    }
+    if (i < argc || 0 == numPlayers || 0 == seconds || 0 == bytesPerSecond) {
+        fprintf(stderr, "usage: %s [-n#players] [-t#seconds] [-b#KiB/s] [-s#max_stall_ms] "
+            "[-ddirectory]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    // a player that is destroyed early closes its end of the pipe
+    signal(SIGPIPE, SIG_IGN);
+    printf("%u players, %u seconds each, %u KiB/s per source, stalls up to %u ms\n",
+        numPlayers, seconds, bytesPerSecond / 1024, maxStallMs);
+
+    SLresult result;
+    SLObjectItf engineObject;
+    result = slCreateEngine(&engineObject, 0, NULL, 0, NULL, NULL);
+    assert(SL_RESULT_SUCCESS == result);
+    result = (*engineObject)->Realize(engineObject, SL_BOOLEAN_FALSE);
+    assert(SL_RESULT_SUCCESS == result);
+    SLEngineItf engineEngine;
+    result = (*engineObject)->GetInterface(engineObject, SL_IID_ENGINE, &engineEngine);
+    assert(SL_RESULT_SUCCESS == result);
+    SLObjectItf mixObject;
+    result = (*engineEngine)->CreateOutputMix(engineEngine, &mixObject, 0, NULL, NULL);
+    assert(SL_RESULT_SUCCESS == result);
+    result = (*mixObject)->Realize(mixObject, SL_BOOLEAN_FALSE);
+    assert(SL_RESULT_SUCCESS == result);
+
+    Player *players = (Player *) calloc(numPlayers, sizeof(Player));
+    assert(NULL != players);
+    unsigned j;
+    for (j = 0; j < numPlayers; ++j) {
+        Player *p = &players[j];
+        snprintf(p->mPathname, sizeof(p->mPathname), "%s/prefetchstress-%u-%u.wav", directory,
+            (unsigned) getpid(), j);
+        if (mkfifo(p->mPathname, 0600)) {
+            perror(p->mPathname);
+            return EXIT_FAILURE;
+        }
+        p->mSeconds = seconds;
+        p->mBytesPerSecond = bytesPerSecond;
+        p->mMaxStallMs = maxStallMs;
+        p->mSeed = j + 1;
+        p->mMinLevel = 1000;
+        int ok = pthread_create(&p->mWriter, (const pthread_attr_t *) NULL, writer, p);
+        assert(0 == ok);
+
+        SLDataLocator_URI locURI = {SL_DATALOCATOR_URI, (SLchar *) p->mPathname};
+        SLDataFormat_MIME formatMIME = {SL_DATAFORMAT_MIME, (SLchar *) "audio/x-wav",
+            SL_CONTAINERTYPE_WAV};
+        SLDataSource audioSrc = {&locURI, &formatMIME};
+        SLDataLocator_OutputMix locOutputMix = {SL_DATALOCATOR_OUTPUTMIX, mixObject};
+        SLDataSink audioSnk = {&locOutputMix, NULL};
+        SLInterfaceID ids[2] = {SL_IID_PLAY, SL_IID_PREFETCHSTATUS};
+        SLboolean flags[2] = {SL_BOOLEAN_TRUE, SL_BOOLEAN_TRUE};
+        result = (*engineEngine)->CreateAudioPlayer(engineEngine, &p->mPlayerObject, &audioSrc,
+            &audioSnk, 2, ids, flags);
+        assert(SL_RESULT_SUCCESS == result);
+        // opening the pipe waits for the writer, and the first buffers are decoded from here on
+        result = (*p->mPlayerObject)->Realize(p->mPlayerObject, SL_BOOLEAN_FALSE);
+        assert(SL_RESULT_SUCCESS == result);
+        result = (*p->mPlayerObject)->GetInterface(p->mPlayerObject, SL_IID_PLAY,
+            &p->mPlayerPlay);
+        assert(SL_RESULT_SUCCESS == result);
+        result = (*p->mPlayerObject)->GetInterface(p->mPlayerObject, SL_IID_PREFETCHSTATUS,
+            &p->mPlayerPrefetchStatus);
+        assert(SL_RESULT_SUCCESS == result);
+        result = (*p->mPlayerPrefetchStatus)->RegisterCallback(p->mPlayerPrefetchStatus,
+            prefetchCallback, p);
+        assert(SL_RESULT_SUCCESS == result);
+        result = (*p->mPlayerPrefetchStatus)->SetFillUpdatePeriod(p->mPlayerPrefetchStatus, 50);
+        assert(SL_RESULT_SUCCESS == result);
+        result = (*p->mPlayerPrefetchStatus)->SetCallbackEventsMask(p->mPlayerPrefetchStatus,
+            SL_PREFETCHEVENT_STATUSCHANGE | SL_PREFETCHEVENT_FILLLEVELCHANGE);
+        assert(SL_RESULT_SUCCESS == result);
+    }
+
+    // as an application would, wait until the players have prefetched all they can
+    unsigned elapsedMs;
+    unsigned filling = numPlayers;
+    for (elapsedMs = 0; 0 < filling && elapsedMs < 5000; elapsedMs += 10) {
+        sleepMs(10);
+        filling = 0;
+        for (j = 0; j < numPlayers; ++j) {
+            if (1000 > players[j].mLevel) {
+                ++filling;
+            }
+        }
+    }
+    printf("prefetched in %u ms\n", elapsedMs);
+
+    // start them all together, then wait for each to pause itself at end of file
+    for (j = 0; j < numPlayers; ++j) {
+        players[j].mPlaying = SL_BOOLEAN_TRUE;
+        result = (*players[j].mPlayerPlay)->SetPlayState(players[j].mPlayerPlay,
+            SL_PLAYSTATE_PLAYING);
+        assert(SL_RESULT_SUCCESS == result);
+    }
+    unsigned playing = numPlayers;
+    for (elapsedMs = 0; 0 < playing && elapsedMs < seconds * 3000; elapsedMs += 100) {
+        sleepMs(100);
+        playing = 0;
+        for (j = 0; j < numPlayers; ++j) {
+            SLuint32 state;
+            result = (*players[j].mPlayerPlay)->GetPlayState(players[j].mPlayerPlay, &state);
+            assert(SL_RESULT_SUCCESS == result);
+            if (SL_PLAYSTATE_PLAYING == state) {
+                ++playing;
+            }
+        }
+    }
+    if (0 < playing) {
+        printf("%u players were still playing after %u seconds\n", playing, elapsedMs / 1000);
+    }
+
+    unsigned totalUnderflows = 0;
+    for (j = 0; j < numPlayers; ++j) {
+        Player *p = &players[j];
+        printf("player %2u: %u underflows, lowest fill level %u\n", j, p->mUnderflows,
+            (unsigned) p->mMinLevel);
+        totalUnderflows += p->mUnderflows;
+        (*p->mPlayerObject)->Destroy(p->mPlayerObject);
+        pthread_join(p->mWriter, NULL);
+        unlink(p->mPathname);
+    }
+    printf("total underflows: %u\n", totalUnderflows);
+
+    free(players);
+    (*mixObject)->Destroy(mixObject);
+    (*engineObject)->Destroy(engineObject);
+    return 0 == totalUnderflows && 0 == playing ? EXIT_SUCCESS : EXIT_FAILURE;
+}
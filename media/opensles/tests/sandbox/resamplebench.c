@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmark the OutputMixExt resampler: convert 60 seconds of stereo at several input rates
+// to 44.1 kHz, one mixer frame at a time, with each set of kernels available on this CPU,
+// and report the CPU load of one track.
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "mixer.h"
+#include "resampler.h"
+
+#define SECONDS 60
+#define OUTPUT_RATE 44100
+#define PERIOD 512                      // frames per mixer frame, as used with SDL
+
+static short output[PERIOD * 2];
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// Resample SECONDS of input, feeding only as much input as each mixer frame needs
+static double resample(const MixerKernels *kernels, const short *input, unsigned rate,
+    unsigned ratePermille)
+{
+    Resampler *r = Resampler_create(kernels, rate * 1000, OUTPUT_RATE * 1000, ratePermille);
+    assert(NULL != r);
+    unsigned frames = SECONDS * rate, written = 0;
+    double start = now();
+    for (;;) {
+        unsigned needed = Resampler_framesNeeded(r, PERIOD);
+        if (needed > frames - written) {
+            needed = frames - written;
+        }
+        int ok = Resampler_write(r, &input[written * 2], needed, 2);
+        assert(0 == ok);
+        written += needed;
+        if (Resampler_read(r, output, PERIOD) < PERIOD) {
+            break;
+        }
+    }
+    double elapsed = now() - start;
+    Resampler_destroy(r);
+    return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    static const unsigned rates[] = { 8000, 22050, 48000 };
+    static const unsigned ratePermilles[] = { 1000, 1500 };
+    short *input = (short *) malloc(SECONDS * 48000 * 2 * sizeof(short));
+    assert(NULL != input);
+    unsigned i, j, k;
+    srand(1);
+    for (i = 0; i < SECONDS * 48000 * 2; ++i) {
+        input[i] = (short) (rand() & 0xFFFF);
+    }
+    printf("resampling %d seconds of stereo to %d Hz, %d frames per mixer frame\n", SECONDS,
+        OUTPUT_RATE, PERIOD);
+
+    const MixerKernels *kernels;
+    for (k = 0; NULL != (kernels = mixer_getKernels(k)); ++k) {
+        for (i = 0; i < sizeof(rates) / sizeof(rates[0]); ++i) {
+            for (j = 0; j < sizeof(ratePermilles) / sizeof(ratePermilles[0]); ++j) {
+                // the playback rate shortens the output, so scale to realtime at that rate
+                double seconds = resample(kernels, input, rates[i], ratePermilles[j]);
+                double played = SECONDS * 1000.0 / ratePermilles[j];
+                printf("%-6s %5u Hz rate %4u  %7.3f s  %6.3f%% CPU per track\n", kernels->mName,
+                    rates[i], ratePermilles[j], seconds, seconds * 100.0 / played);
+            }
+        }
+    }
+
+    free(input);
+    return EXIT_SUCCESS;
+}
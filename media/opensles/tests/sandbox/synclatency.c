@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measure how long a change takes to be applied by the engine's sync thread.
+// 3DCommit::Commit in deferred mode blocks until the sync thread has run, so it measures the
+// change-to-apply latency; Object::Destroy on the engine measures the shutdown latency.
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "SLES/OpenSLES.h"
+
+#define COMMITS 20
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 1) {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    SLresult result;
+    SLObjectItf engineObject;
+    SLInterfaceID ids[1] = {SL_IID_3DCOMMIT};
+    SLboolean flags[1] = {SL_BOOLEAN_TRUE};
+
+    // create engine
+    result = slCreateEngine(&engineObject, 0, NULL, 1, ids, flags);
+    if (SL_RESULT_FEATURE_UNSUPPORTED == result) {
+        printf("3DCommit is not supported, so latency can't be measured\n");
+        return EXIT_SUCCESS;
+    }
+    assert(SL_RESULT_SUCCESS == result);
+    result = (*engineObject)->Realize(engineObject, SL_BOOLEAN_FALSE);
+    assert(SL_RESULT_SUCCESS == result);
+    SL3DCommitItf engine3DCommit;
+    result = (*engineObject)->GetInterface(engineObject, SL_IID_3DCOMMIT, &engine3DCommit);
+    assert(SL_RESULT_SUCCESS == result);
+    result = (*engine3DCommit)->SetDeferred(engine3DCommit, SL_BOOLEAN_TRUE);
+    assert(SL_RESULT_SUCCESS == result);
+
+    double min = 1e9, max = 0.0, sum = 0.0;
+    unsigned i;
+    for (i = 0; i < COMMITS; ++i) {
+        // vary the phase relative to any periodic activity of the sync thread
+        usleep(1000 + (i * 7919) % 50000);
+        double start = now();
+        result = (*engine3DCommit)->Commit(engine3DCommit);
+        assert(SL_RESULT_SUCCESS == result);
+        double latency = now() - start;
+        if (latency < min)
+            min = latency;
+        if (latency > max)
+            max = latency;
+        sum += latency;
+    }
+    printf("commit latency over %u commits: min %.3f ms, average %.3f ms, max %.3f ms\n",
+        COMMITS, min * 1000.0, sum * 1000.0 / COMMITS, max * 1000.0);
+
+    double start = now();
+    (*engineObject)->Destroy(engineObject);
+    printf("engine destroy: %.3f ms\n", (now() - start) * 1000.0);
+
+    return EXIT_SUCCESS;
+}
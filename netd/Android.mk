@@ -22,7 +22,8 @@ LOCAL_SRC_FILES:=                                      \
                   PanController.cpp                    \
                   SoftapController.cpp                 \
                   UsbController.cpp                    \
-                  ThrottleController.cpp
+                  ThrottleController.cpp               \
+                  InterfaceStatsController.cpp
 
 LOCAL_MODULE:= netd
 
@@ -48,6 +48,7 @@ PppController *CommandListener::sPppCtrl = NULL;
 PanController *CommandListener::sPanCtrl = NULL;
 SoftapController *CommandListener::sSoftapCtrl = NULL;
 UsbController *CommandListener::sUsbCtrl = NULL;
+InterfaceStatsController *CommandListener::sStatsCtrl = NULL;
 
 CommandListener::CommandListener() :
                  FrameworkListener("netd") {
@@ -73,6 +74,10 @@ CommandListener::CommandListener() :
         sSoftapCtrl = new SoftapController();
     if (!sUsbCtrl)
         sUsbCtrl = new UsbController();
+    if (!sStatsCtrl) {
+        sStatsCtrl = new InterfaceStatsController();
+        sStatsCtrl->setBroadcaster(this);
+    }
 }
 
 CommandListener::InterfaceCmd::InterfaceCmd() :
@@ -138,6 +143,62 @@ int CommandListener::InterfaceCmd::runCommand(SocketClient *cli,
         cli->sendMsg(ResponseCode::InterfaceTxCounterResult, msg, false);
         free(msg);
         return 0;
+    } else if (!strcmp(argv[1], "snapshot")) {
+        InterfaceStatsCollection stats;
+
+        if (sStatsCtrl->getSnapshot(&stats)) {
+            cli->sendMsg(ResponseCode::OperationFailed, "Failed to read counters", true);
+            return 0;
+        }
+
+        char *msg = InterfaceStatsController::formatStats(&stats);
+        if (!msg) {
+            cli->sendMsg(ResponseCode::OperationFailed, "Failed to format counters", true);
+            return 0;
+        }
+        cli->sendMsg(ResponseCode::InterfaceStatsResult, msg, false);
+        free(msg);
+        return 0;
+    } else if (!strcmp(argv[1], "statspoll")) {
+        if (argc < 3) {
+            cli->sendMsg(ResponseCode::CommandSyntaxError,
+                    "Usage: interface statspoll <start [interval_ms]|stop|status>", false);
+            return 0;
+        }
+
+        int rc = 0;
+        if (!strcmp(argv[2], "start")) {
+            int interval = InterfaceStatsController::DEFAULT_INTERVAL_MS;
+            if (argc > 3)
+                interval = atoi(argv[3]);
+            if (interval < InterfaceStatsController::MIN_INTERVAL_MS) {
+                cli->sendMsg(ResponseCode::CommandParameterError, "Invalid interval", false);
+                return 0;
+            }
+            rc = sStatsCtrl->startPolling(interval);
+        } else if (!strcmp(argv[2], "stop")) {
+            rc = sStatsCtrl->stopPolling();
+        } else if (!strcmp(argv[2], "status")) {
+            char *msg = NULL;
+            if (sStatsCtrl->isPolling()) {
+                asprintf(&msg, "Interface stats polling started %d", sStatsCtrl->getIntervalMs());
+            } else {
+                asprintf(&msg, "Interface stats polling stopped");
+            }
+            cli->sendMsg(ResponseCode::InterfaceStatsPollResult, msg, false);
+            free(msg);
+            return 0;
+        } else {
+            cli->sendMsg(ResponseCode::CommandSyntaxError, "Unknown statspoll cmd", false);
+            return 0;
+        }
+
+        if (!rc) {
+            cli->sendMsg(ResponseCode::CommandOkay, "Interface stats polling updated", false);
+        } else {
+            cli->sendMsg(ResponseCode::OperationFailed, "Failed to update stats polling", true);
+        }
+        return 0;
     } else if (!strcmp(argv[1], "getthrottle")) {
         if (argc != 4 || (argc == 4 && (strcmp(argv[3], "rx") && (strcmp(argv[3], "tx"))))) {
             cli->sendMsg(ResponseCode::CommandSyntaxError,
@@ -672,6 +733,18 @@ int CommandListener::UsbCmd::runCommand(SocketClient *cli, int argc, char **argv
 }
 
 int CommandListener::readInterfaceCounters(const char *iface, unsigned long *rx, unsigned long *tx) {
+    InterfaceStats stats;
+
+    if (!sStatsCtrl->getInterfaceStats(iface, &stats)) {
+        *rx = stats.rxBytes;
+        *tx = stats.txBytes;
+        return 0;
+    }
+
+    /*
+     * Fall back to /proc/net/dev if the interface was not found in the
+     * rtnetlink dump or the dump itself failed.
+     */
     FILE *fp = fopen("/proc/net/dev", "r");
     if (!fp) {
         LOGE("Failed to open /proc/net/dev (%s)", strerror(errno));
@@ -26,6 +26,7 @@
 #include "PanController.h"
 #include "SoftapController.h"
 #include "UsbController.h"
+#include "InterfaceStatsController.h"
 
 class CommandListener : public FrameworkListener {
     static TetherController *sTetherCtrl;
@@ -34,6 +35,7 @@ class CommandListener : public FrameworkListener {
     static PanController *sPanCtrl;
     static SoftapController *sSoftapCtrl;
     static UsbController *sUsbCtrl;
+    static InterfaceStatsController *sStatsCtrl;
 
 public:
     CommandListener();
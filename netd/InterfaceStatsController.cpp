@@ -0,0 +1,367 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+
+#define LOG_TAG "InterfaceStatsController"
+#include <cutils/log.h>
+
+#include "InterfaceStatsController.h"
+#include "ResponseCode.h"
+
+InterfaceStatsController::InterfaceStatsController() {
+    mBroadcaster = NULL;
+    mSock = -1;
+    mSeq = 0;
+    mPolling = false;
+    mStopRequested = false;
+    mIntervalMs = DEFAULT_INTERVAL_MS;
+    mLast = NULL;
+    pthread_mutex_init(&mLock, NULL);
+    pthread_mutex_init(&mSockLock, NULL);
+    pthread_cond_init(&mCond, NULL);
+}
+
+InterfaceStatsController::~InterfaceStatsController() {
+    stopPolling();
+    if (mSock != -1)
+        close(mSock);
+    delete mLast;
+    pthread_cond_destroy(&mCond);
+    pthread_mutex_destroy(&mSockLock);
+    pthread_mutex_destroy(&mLock);
+}
+
+int InterfaceStatsController::openSocket() {
+    struct sockaddr_nl nladdr;
+
+    if (mSock != -1)
+        return 0;
+
+    if ((mSock = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_ROUTE)) < 0) {
+        LOGE("Unable to create rtnetlink socket (%s)", strerror(errno));
+        mSock = -1;
+        return -1;
+    }
+
+    memset(&nladdr, 0, sizeof(nladdr));
+    nladdr.nl_family = AF_NETLINK;
+
+    if (bind(mSock, (struct sockaddr *) &nladdr, sizeof(nladdr)) < 0) {
+        LOGE("Unable to bind rtnetlink socket (%s)", strerror(errno));
+        close(mSock);
+        mSock = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Issue one RTM_GETLINK dump and collect IFLA_STATS for every link.
+ * Must be called with mSockLock held.
+ */
+int InterfaceStatsController::dumpLinks(InterfaceStatsCollection *stats) {
+    struct {
+        struct nlmsghdr  n;
+        struct ifinfomsg i;
+    } req;
+    struct sockaddr_nl nladdr;
+    char buf[16 * 1024];
+    unsigned int seq;
+
+    if (openSocket())
+        return -1;
+
+    memset(&req, 0, sizeof(req));
+    req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    req.n.nlmsg_type = RTM_GETLINK;
+    req.n.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.n.nlmsg_seq = seq = ++mSeq;
+    req.i.ifi_family = AF_UNSPEC;
+
+    memset(&nladdr, 0, sizeof(nladdr));
+    nladdr.nl_family = AF_NETLINK;
+
+    if (sendto(mSock, &req, req.n.nlmsg_len, 0,
+               (struct sockaddr *) &nladdr, sizeof(nladdr)) < 0) {
+        LOGE("Unable to send RTM_GETLINK dump request (%s)", strerror(errno));
+        close(mSock);
+        mSock = -1;
+        return -1;
+    }
+
+    while (1) {
+        int len = recv(mSock, buf, sizeof(buf), 0);
+
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            LOGE("Error reading RTM_GETLINK dump (%s)", strerror(errno));
+            close(mSock);
+            mSock = -1;
+            return -1;
+        }
+
+        struct nlmsghdr *nh = (struct nlmsghdr *) buf;
+        for (; NLMSG_OK(nh, (unsigned int) len); nh = NLMSG_NEXT(nh, len)) {
+            if (nh->nlmsg_seq != seq)
+                continue;
+            if (nh->nlmsg_type == NLMSG_DONE)
+                return 0;
+            if (nh->nlmsg_type == NLMSG_ERROR) {
+                struct nlmsgerr *err = (struct nlmsgerr *) NLMSG_DATA(nh);
+                errno = -err->error;
+                LOGE("RTM_GETLINK dump failed (%s)", strerror(errno));
+                return -1;
+            }
+            if (nh->nlmsg_type != RTM_NEWLINK)
+                continue;
+
+            struct ifinfomsg *ifi = (struct ifinfomsg *) NLMSG_DATA(nh);
+            struct rtattr *rta = IFLA_RTA(ifi);
+            int rtalen = IFLA_PAYLOAD(nh);
+            InterfaceStats s;
+            bool haveName = false, haveStats = false;
+
+            memset(&s, 0, sizeof(s));
+            for (; RTA_OK(rta, rtalen); rta = RTA_NEXT(rta, rtalen)) {
+                if (rta->rta_type == IFLA_IFNAME) {
+                    strncpy(s.name, (char *) RTA_DATA(rta), sizeof(s.name) - 1);
+                    haveName = true;
+                } else if (rta->rta_type == IFLA_STATS) {
+                    struct rtnl_link_stats *ls = (struct rtnl_link_stats *) RTA_DATA(rta);
+                    s.rxBytes = ls->rx_bytes;
+                    s.rxPackets = ls->rx_packets;
+                    s.rxErrors = ls->rx_errors;
+                    s.txBytes = ls->tx_bytes;
+                    s.txPackets = ls->tx_packets;
+                    s.txErrors = ls->tx_errors;
+                    haveStats = true;
+                }
+            }
+            if (haveName && haveStats)
+                stats->push_back(s);
+        }
+    }
+    return 0;
+}
+
+int InterfaceStatsController::getSnapshot(InterfaceStatsCollection *stats) {
+    pthread_mutex_lock(&mSockLock);
+    int rc = dumpLinks(stats);
+    pthread_mutex_unlock(&mSockLock);
+    return rc;
+}
+
+int InterfaceStatsController::getInterfaceStats(const char *iface, InterfaceStats *stats) {
+    InterfaceStatsCollection all;
+    InterfaceStatsCollection::iterator it;
+
+    if (getSnapshot(&all))
+        return -1;
+
+    for (it = all.begin(); it != all.end(); ++it) {
+        if (!strcmp((*it).name, iface)) {
+            *stats = *it;
+            return 0;
+        }
+    }
+    errno = ENODEV;
+    return -1;
+}
+
+/*
+ * Formats a collection as a single space separated list of
+ * "<iface>:<rxbytes>,<rxpkts>,<rxerrs>,<txbytes>,<txpkts>,<txerrs>" tuples.
+ * Caller must free() the result.
+ */
+char *InterfaceStatsController::formatStats(const InterfaceStatsCollection *stats) {
+    InterfaceStatsCollection::const_iterator it;
+    size_t len = 1;
+    char *msg, *p;
+
+    for (it = stats->begin(); it != stats->end(); ++it)
+        len += IFNAMSIZ + 6 * 21 + 8;
+
+    if (!(msg = (char *) malloc(len)))
+        return NULL;
+
+    p = msg;
+    *p = '\0';
+    for (it = stats->begin(); it != stats->end(); ++it) {
+        p += sprintf(p, "%s%s:%lu,%lu,%lu,%lu,%lu,%lu",
+                     (p == msg ? "" : " "), (*it).name,
+                     (*it).rxBytes, (*it).rxPackets, (*it).rxErrors,
+                     (*it).txBytes, (*it).txPackets, (*it).txErrors);
+    }
+    return msg;
+}
+
+int InterfaceStatsController::startPolling(int intervalMs) {
+    if (intervalMs < MIN_INTERVAL_MS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&mLock);
+    mIntervalMs = intervalMs;
+    if (mPolling) {
+        // Running thread picks up the new interval on its next wakeup
+        pthread_cond_signal(&mCond);
+        pthread_mutex_unlock(&mLock);
+        return 0;
+    }
+
+    delete mLast;
+    mLast = NULL;
+    mStopRequested = false;
+    if (pthread_create(&mThread, NULL, InterfaceStatsController::threadStart, this)) {
+        LOGE("pthread_create (%s)", strerror(errno));
+        pthread_mutex_unlock(&mLock);
+        return -1;
+    }
+    mPolling = true;
+    pthread_mutex_unlock(&mLock);
+    return 0;
+}
+
+int InterfaceStatsController::stopPolling() {
+    pthread_mutex_lock(&mLock);
+    if (!mPolling) {
+        pthread_mutex_unlock(&mLock);
+        return 0;
+    }
+    mStopRequested = true;
+    pthread_cond_signal(&mCond);
+    pthread_mutex_unlock(&mLock);
+
+    void *ret;
+    if (pthread_join(mThread, &ret)) {
+        LOGE("Error joining to stats thread (%s)", strerror(errno));
+        return -1;
+    }
+
+    pthread_mutex_lock(&mLock);
+    mPolling = false;
+    pthread_mutex_unlock(&mLock);
+    return 0;
+}
+
+bool InterfaceStatsController::isPolling() {
+    pthread_mutex_lock(&mLock);
+    bool polling = mPolling;
+    pthread_mutex_unlock(&mLock);
+    return polling;
+}
+
+int InterfaceStatsController::getIntervalMs() {
+    pthread_mutex_lock(&mLock);
+    int interval = mIntervalMs;
+    pthread_mutex_unlock(&mLock);
+    return interval;
+}
+
+void *InterfaceStatsController::threadStart(void *obj) {
+    InterfaceStatsController *me = reinterpret_cast<InterfaceStatsController *>(obj);
+
+    me->run();
+    pthread_exit(NULL);
+    return NULL;
+}
+
+void InterfaceStatsController::run() {
+    pthread_mutex_lock(&mLock);
+    while (!mStopRequested) {
+        struct timeval now;
+        struct timespec ts;
+
+        gettimeofday(&now, NULL);
+        ts.tv_sec = now.tv_sec + mIntervalMs / 1000;
+        ts.tv_nsec = now.tv_usec * 1000 + (mIntervalMs % 1000) * 1000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+
+        if (pthread_cond_timedwait(&mCond, &mLock, &ts) != ETIMEDOUT)
+            continue;
+
+        pthread_mutex_unlock(&mLock);
+        broadcastDeltas();
+        pthread_mutex_lock(&mLock);
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+static unsigned long counterDelta(unsigned long cur, unsigned long prev) {
+    // Kernel IFLA_STATS counters are 32 bits wide and wrap
+    if (cur >= prev)
+        return cur - prev;
+    return (unsigned long) ((unsigned int) cur - (unsigned int) prev);
+}
+
+void InterfaceStatsController::broadcastDeltas() {
+    InterfaceStatsCollection *cur = new InterfaceStatsCollection();
+
+    if (getSnapshot(cur)) {
+        delete cur;
+        return;
+    }
+
+    if (mLast && mBroadcaster) {
+        InterfaceStatsCollection deltas;
+        InterfaceStatsCollection::iterator it, prev;
+
+        for (it = cur->begin(); it != cur->end(); ++it) {
+            InterfaceStats d = *it;
+
+            for (prev = mLast->begin(); prev != mLast->end(); ++prev) {
+                if (!strcmp((*prev).name, d.name))
+                    break;
+            }
+            // Interfaces that appeared since the last tick report their full counters
+            if (prev != mLast->end()) {
+                d.rxBytes = counterDelta(d.rxBytes, (*prev).rxBytes);
+                d.rxPackets = counterDelta(d.rxPackets, (*prev).rxPackets);
+                d.rxErrors = counterDelta(d.rxErrors, (*prev).rxErrors);
+                d.txBytes = counterDelta(d.txBytes, (*prev).txBytes);
+                d.txPackets = counterDelta(d.txPackets, (*prev).txPackets);
+                d.txErrors = counterDelta(d.txErrors, (*prev).txErrors);
+            }
+            deltas.push_back(d);
+        }
+
+        char *msg = formatStats(&deltas);
+        if (msg) {
+            mBroadcaster->sendBroadcast(ResponseCode::InterfaceStatsDelta, msg, false);
+            free(msg);
+        }
+    }
+
+    delete mLast;
+    mLast = cur;
+}
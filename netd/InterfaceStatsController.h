@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INTERFACE_STATS_CONTROLLER_H
+#define _INTERFACE_STATS_CONTROLLER_H
+
+#include <pthread.h>
+#include <linux/if.h>
+
+#include <utils/List.h>
+
+#include <sysutils/SocketListener.h>
+
+struct InterfaceStats {
+    char          name[IFNAMSIZ];
+    unsigned long rxBytes;
+    unsigned long rxPackets;
+    unsigned long rxErrors;
+    unsigned long txBytes;
+    unsigned long txPackets;
+    unsigned long txErrors;
+};
+
+typedef android::List<InterfaceStats> InterfaceStatsCollection;
+
+/*
+ * Reads per-interface traffic counters with a single RTM_GETLINK dump
+ * over a persistent rtnetlink socket, and optionally broadcasts the
+ * per-interface deltas to all netd clients at a fixed interval.
+ */
+class InterfaceStatsController {
+    SocketListener           *mBroadcaster;
+    int                       mSock;
+    unsigned int              mSeq;
+    pthread_mutex_t           mLock;
+    pthread_mutex_t           mSockLock;
+    pthread_cond_t            mCond;
+    pthread_t                 mThread;
+    bool                      mPolling;
+    bool                      mStopRequested;
+    int                       mIntervalMs;
+    InterfaceStatsCollection *mLast;
+
+public:
+    static const int DEFAULT_INTERVAL_MS = 1000;
+    static const int MIN_INTERVAL_MS     = 100;
+
+    InterfaceStatsController();
+    virtual ~InterfaceStatsController();
+
+    void setBroadcaster(SocketListener *sl) { mBroadcaster = sl; }
+
+    int getSnapshot(InterfaceStatsCollection *stats);
+    int getInterfaceStats(const char *iface, InterfaceStats *stats);
+
+    int startPolling(int intervalMs);
+    int stopPolling();
+    bool isPolling();
+    int getIntervalMs();
+
+    static char *formatStats(const InterfaceStatsCollection *stats);
+
+private:
+    int openSocket();
+    int dumpLinks(InterfaceStatsCollection *stats);
+    void broadcastDeltas();
+
+    static void *threadStart(void *obj);
+    void run();
+};
+
+#endif
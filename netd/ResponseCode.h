@@ -40,6 +40,8 @@ public:
     static const int InterfaceTxCounterResult  = 217;
     static const int InterfaceRxThrottleResult = 218;
     static const int InterfaceTxThrottleResult = 219;
+    static const int InterfaceStatsResult      = 220;
+    static const int InterfaceStatsPollResult  = 221;
 
     // 400 series - The command was accepted but the requested action
     // did not take place.
@@ -52,5 +54,6 @@ public:
 
     // 600 series - Unsolicited broadcasts
     static const int InterfaceChange        = 600;
+    static const int InterfaceStatsDelta    = 601;
 };
 #endif
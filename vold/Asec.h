@@ -37,6 +37,12 @@ struct asec_superblock {
 
 #define ASEC_SB_C_MODE_NONE 0
     unsigned char c_mode;
+
+    /*
+     * Creation time in seconds since the epoch. Containers made before
+     * this field existed have zero here, since image files start zeroed.
+     */
+    unsigned int c_time;
 } __attribute__((packed));
 
 #endif
@@ -35,6 +35,7 @@
 #include "Xwarp.h"
 #include "Loop.h"
 #include "Devmapper.h"
+#include "MountTable.h"
 
 CommandListener::CommandListener() :
                  FrameworkListener("vold") {
@@ -90,14 +91,8 @@ int CommandListener::DumpCmd::runCommand(SocketClient *cli,
         cli->sendMsg(ResponseCode::CommandOkay, "Devmapper dump failed", true);
     }
     cli->sendMsg(0, "Dumping mounted filesystems", false);
-    FILE *fp = fopen("/proc/mounts", "r");
-    if (fp) {
-        char line[1024];
-        while (fgets(line, sizeof(line), fp)) {
-            line[strlen(line)-1] = '\0';
-            cli->sendMsg(0, line, false);;
-        }
-        fclose(fp);
+    if (MountTable::Instance()->dumpState(cli)) {
+        cli->sendMsg(ResponseCode::CommandOkay, "Mount table dump failed", true);
     }
 
     cli->sendMsg(ResponseCode::CommandOkay, "dump complete", false);
@@ -244,36 +239,25 @@ int CommandListener::StorageCmd::runCommand(SocketClient *cli,
     }
 
     if (!strcmp(argv[1], "users")) {
-        DIR *dir;
-        struct dirent *de;
-
-        if (!(dir = opendir("/proc"))) {
-            cli->sendMsg(ResponseCode::OperationFailed, "Failed to open /proc", true);
+        if (argc < 3) {
+            cli->sendMsg(ResponseCode::CommandSyntaxError, "Usage: storage users <mountpoint>", false);
             return 0;
         }
 
-        while ((de = readdir(dir))) {
-            int pid = Process::getPid(de->d_name);
-
-            if (pid < 0) {
-                continue;
-            }
-
-            char processName[255];
-            Process::getProcessName(pid, processName, sizeof(processName));
+        ProcessOpenFileCollection users;
+        ProcessOpenFileCollection::iterator it;
 
-            if (Process::checkFileDescriptorSymLinks(pid, argv[2]) ||
-                Process::checkFileMaps(pid, argv[2]) ||
-                Process::checkSymLink(pid, argv[2], "cwd") ||
-                Process::checkSymLink(pid, argv[2], "root") ||
-                Process::checkSymLink(pid, argv[2], "exe")) {
+        if (Process::findProcessesWithOpenFiles(argv[2], &users) < 0) {
+            cli->sendMsg(ResponseCode::OperationFailed, "Failed to open /proc", true);
+            return 0;
+        }
 
-                char msg[1024];
-                snprintf(msg, sizeof(msg), "%d %s", pid, processName);
-                cli->sendMsg(ResponseCode::StorageUsersListResult, msg, false);
-            }
+        for (it = users.begin(); it != users.end(); ++it) {
+            char msg[1024];
+            snprintf(msg, sizeof(msg), "%d %s", (*it)->pid, (*it)->name);
+            cli->sendMsg(ResponseCode::StorageUsersListResult, msg, false);
         }
-        closedir(dir);
+        Process::freeOpenFiles(&users);
         cli->sendMsg(ResponseCode::CommandOkay, "Storage user list complete", false);
     } else {
         cli->sendMsg(ResponseCode::CommandSyntaxError, "Unknown storage cmd", false);
@@ -297,25 +281,12 @@ int CommandListener::AsecCmd::runCommand(SocketClient *cli,
 
     if (!strcmp(argv[1], "list")) {
         dumpArgs(argc, argv, -1);
-        DIR *d = opendir(Volume::SEC_ASECDIR);
+        bool details = (argc > 2 && !strcmp(argv[2], "details"));
 
-        if (!d) {
+        if (vm->listAsecs(cli, details)) {
             cli->sendMsg(ResponseCode::OperationFailed, "Failed to open asec dir", true);
             return 0;
         }
-
-        struct dirent *dent;
-        while ((dent = readdir(d))) {
-            if (dent->d_name[0] == '.')
-                continue;
-            if (!strcmp(&dent->d_name[strlen(dent->d_name)-5], ".asec")) {
-                char id[255];
-                memset(id, 0, sizeof(id));
-                strncpy(id, dent->d_name, strlen(dent->d_name) -5);
-                cli->sendMsg(ResponseCode::AsecListResult, id, false);
-            }
-        }
-        closedir(d);
     } else if (!strcmp(argv[1], "create")) {
         dumpArgs(argc, argv, 5);
         if (argc != 7) {
@@ -352,6 +323,39 @@ int CommandListener::AsecCmd::runCommand(SocketClient *cli,
             return 0;
         }
         rc = vm->mountAsec(argv[2], argv[3], atoi(argv[4]));
+    } else if (!strcmp(argv[1], "mountall")) {
+        if (argc < 6 || ((argc - 3) % 3)) {
+            cli->sendMsg(ResponseCode::CommandSyntaxError,
+                    "Usage: asec mountall <max_parallel> <id> <key> <ownerUid> [...]", false);
+            return 0;
+        }
+        int maxParallel = atoi(argv[2]);
+        if (maxParallel < 1) {
+            cli->sendMsg(ResponseCode::CommandParameterError, "Invalid parallelism", false);
+            return 0;
+        }
+
+        int count = (argc - 3) / 3;
+        AsecMountRequest *reqs = (AsecMountRequest *) calloc(count, sizeof(AsecMountRequest));
+        if (!reqs) {
+            cli->sendMsg(ResponseCode::OperationFailed, "Out of memory", true);
+            return 0;
+        }
+        for (int i = 0; i < count; i++) {
+            reqs[i].id = argv[3 + (i * 3)];
+            reqs[i].key = argv[4 + (i * 3)];
+            reqs[i].ownerUid = atoi(argv[5 + (i * 3)]);
+        }
+        SLOGD("asec mountall %d containers, %d parallel", count, maxParallel);
+
+        int failed = vm->mountAsecs(reqs, count, maxParallel, cli);
+        free(reqs);
+
+        char msg[255];
+        snprintf(msg, sizeof(msg), "asec mountall completed (%d of %d failed)", failed, count);
+        cli->sendMsg(failed ? ResponseCode::OperationFailed : ResponseCode::CommandOkay,
+                     msg, false);
+        return 0;
     } else if (!strcmp(argv[1], "unmount")) {
         dumpArgs(argc, argv, -1);
         if (argc < 3) {
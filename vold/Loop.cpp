@@ -15,15 +15,21 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <pthread.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
 
 #include <linux/kdev_t.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
 
 #define LOG_TAG "Vold"
 
@@ -120,7 +126,20 @@ int Loop::lookupActive(const char *id, char *buffer, size_t len) {
     return 0;
 }
 
+/*
+ * Finding a free loop device and binding it are separate steps, so
+ * concurrent creators must not interleave.
+ */
+static pthread_mutex_t sCreateLock = PTHREAD_MUTEX_INITIALIZER;
+
 int Loop::create(const char *id, const char *loopFile, char *loopDeviceBuffer, size_t len) {
+    pthread_mutex_lock(&sCreateLock);
+    int rc = createLocked(id, loopFile, loopDeviceBuffer, len);
+    pthread_mutex_unlock(&sCreateLock);
+    return rc;
+}
+
+int Loop::createLocked(const char *id, const char *loopFile, char *loopDeviceBuffer, size_t len) {
     int i;
     int fd;
     char filename[256];
@@ -244,3 +263,121 @@ int Loop::createImageFile(const char *file, unsigned int numSectors) {
     close(fd);
     return 0;
 }
+
+/*
+ * fallocate() is not exported by every libc we build against, so issue the
+ * syscall directly. On 32-bit targets the 64-bit offset and length are
+ * passed as (low, high) register pairs.
+ */
+static int allocateRange(int fd, off64_t len) {
+#ifdef __NR_fallocate
+#if defined(__LP64__)
+    return syscall(__NR_fallocate, fd, 0, (off64_t) 0, len);
+#else
+    return syscall(__NR_fallocate, fd, 0, 0, 0,
+                   (unsigned int) len, (unsigned int) (len >> 32));
+#endif
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+#define IMAGE_FILL_CHUNK (128 * 1024)
+
+/*
+ * Fallback for filesystems without fallocate() support (vfat on older
+ * kernels): write out the whole image so its clusters are allocated up
+ * front, in large chunks so the allocator can keep them contiguous.
+ */
+static int fillRange(int fd, off64_t len) {
+    char *zeroes = (char *) calloc(1, IMAGE_FILL_CHUNK);
+    off64_t written = 0;
+
+    if (!zeroes)
+        return -1;
+
+    while (written < len) {
+        size_t chunk = IMAGE_FILL_CHUNK;
+        if ((off64_t) chunk > len - written)
+            chunk = len - written;
+
+        ssize_t rc = write(fd, zeroes, chunk);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            free(zeroes);
+            return -1;
+        }
+        written += rc;
+    }
+    free(zeroes);
+    return 0;
+}
+
+/*
+ * Creates an image file whose blocks are all allocated at creation time,
+ * so that filling the container later neither fragments it nor pays for
+ * block allocation on first write.
+ */
+int Loop::createPreallocatedImageFile(const char *file, unsigned int numSectors) {
+    off64_t len = (off64_t) numSectors * 512;
+    int fd;
+
+    if ((fd = open(file, O_CREAT | O_EXCL | O_WRONLY, 0600)) < 0) {
+        SLOGE("Error creating imagefile (%s)", strerror(errno));
+        return -1;
+    }
+
+    if (allocateRange(fd, len) < 0) {
+        if (errno != EOPNOTSUPP && errno != ENOSYS) {
+            SLOGE("Error preallocating imagefile (%s)", strerror(errno));
+            goto fail;
+        }
+        SLOGI("fallocate unsupported for %s, zero-filling instead", file);
+        if (fillRange(fd, len) < 0) {
+            SLOGE("Error zero-filling imagefile (%s)", strerror(errno));
+            goto fail;
+        }
+    }
+
+    if (fsync(fd) < 0) {
+        SLOGE("Error syncing imagefile (%s)", strerror(errno));
+        goto fail;
+    }
+    close(fd);
+    return 0;
+
+fail:
+    int saved_errno = errno;
+    close(fd);
+    unlink(file);
+    errno = saved_errno;
+    return -1;
+}
+
+/*
+ * Returns the number of extents backing the file, or -1 if the
+ * filesystem does not support FIEMAP. Dirty pages are not flushed first,
+ * so blocks still waiting for delayed allocation are not counted.
+ */
+int Loop::getExtentCount(const char *file) {
+    struct fiemap fm;
+    int fd;
+
+    if ((fd = open(file, O_RDONLY)) < 0)
+        return -1;
+
+    memset(&fm, 0, sizeof(fm));
+    fm.fm_start = 0;
+    fm.fm_length = ~0ULL;
+    fm.fm_flags = 0;
+    fm.fm_extent_count = 0;
+
+    if (ioctl(fd, FS_IOC_FIEMAP, &fm) < 0) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return fm.fm_mapped_extents;
+}
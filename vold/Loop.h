@@ -31,8 +31,14 @@ public:
     static int destroyByDevice(const char *loopDevice);
     static int destroyByFile(const char *loopFile);
     static int createImageFile(const char *file, unsigned int numSectors);
+    static int createPreallocatedImageFile(const char *file, unsigned int numSectors);
+    static int getExtentCount(const char *file);
 
     static int dumpState(SocketClient *c);
+
+private:
+    static int createLocked(const char *id, const char *loopFile, char *loopDeviceBuffer,
+                            size_t len);
 };
 
 #endif
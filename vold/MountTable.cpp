@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#define LOG_TAG "Vold"
+
+#include <cutils/log.h>
+
+#include <sysutils/SocketClient.h>
+
+#include "MountTable.h"
+
+MountTable *MountTable::sInstance = NULL;
+pthread_once_t MountTable::sInstanceOnce = PTHREAD_ONCE_INIT;
+
+void MountTable::createInstance() {
+    sInstance = new MountTable("/proc/mounts");
+}
+
+/*
+ * Asec containers are mounted from several threads at once, so the
+ * instance can't be created lazily without synchronization.
+ */
+MountTable *MountTable::Instance() {
+    pthread_once(&sInstanceOnce, createInstance);
+    return sInstance;
+}
+
+MountTable::MountTable(const char *path) {
+    mPath = path;
+    mFd = -1;
+    mValid = false;
+    mBuffer = NULL;
+    mBufferSize = 0;
+    mEntries = NULL;
+    mNumEntries = 0;
+    mRefreshCount = 0;
+    memset(mByMountpoint, 0, sizeof(mByMountpoint));
+    pthread_mutex_init(&mLock, NULL);
+}
+
+MountTable::~MountTable() {
+    if (mFd >= 0)
+        close(mFd);
+    free(mBuffer);
+    free(mEntries);
+    pthread_mutex_destroy(&mLock);
+}
+
+unsigned int MountTable::hash(const char *s) {
+    unsigned int h = 5381;
+
+    while (*s)
+        h = ((h << 5) + h) + (unsigned char) *s++;
+    return h % NUM_BUCKETS;
+}
+
+/*
+ * /proc/mounts escapes space, tab, newline and backslash as \ooo.
+ */
+void MountTable::unescape(char *s) {
+    char *d = s;
+
+    while (*s) {
+        if (s[0] == '\\' && s[1] >= '0' && s[1] <= '7' && s[2] >= '0' && s[2] <= '7' &&
+            s[3] >= '0' && s[3] <= '7') {
+            *d++ = ((s[1] - '0') << 6) | ((s[2] - '0') << 3) | (s[3] - '0');
+            s += 4;
+        } else {
+            *d++ = *s++;
+        }
+    }
+    *d = 0;
+}
+
+char *MountTable::nextField(char **p) {
+    char *s = *p;
+
+    while (*s == ' ')
+        s++;
+    if (!*s)
+        return NULL;
+
+    char *start = s;
+    while (*s && *s != ' ')
+        s++;
+    if (*s)
+        *s++ = 0;
+    *p = s;
+    return start;
+}
+
+/*
+ * Reads the whole table into mBuffer, growing it as needed.
+ * Returns the number of bytes read or -1.
+ */
+int MountTable::readTable() {
+    if (mFd < 0) {
+        if ((mFd = open(mPath, O_RDONLY)) < 0) {
+            SLOGE("Error opening %s (%s)", mPath, strerror(errno));
+            return -1;
+        }
+    }
+
+    if (!mBuffer) {
+        mBufferSize = 16 * 1024;
+        if (!(mBuffer = (char *) malloc(mBufferSize)))
+            return -1;
+    }
+
+    while (1) {
+        size_t len = 0;
+
+        if (lseek(mFd, 0, SEEK_SET) < 0) {
+            SLOGE("Error seeking %s (%s)", mPath, strerror(errno));
+            return -1;
+        }
+
+        while (len < mBufferSize - 1) {
+            ssize_t rc = read(mFd, mBuffer + len, mBufferSize - 1 - len);
+            if (rc < 0) {
+                if (errno == EINTR)
+                    continue;
+                SLOGE("Error reading %s (%s)", mPath, strerror(errno));
+                return -1;
+            }
+            if (rc == 0)
+                break;
+            len += rc;
+        }
+
+        if (len < mBufferSize - 1) {
+            mBuffer[len] = 0;
+            return len;
+        }
+
+        // Table did not fit, grow and read it again from the start
+        char *tmp = (char *) realloc(mBuffer, mBufferSize * 2);
+        if (!tmp)
+            return -1;
+        mBuffer = tmp;
+        mBufferSize *= 2;
+    }
+}
+
+void MountTable::parseTable(size_t len) {
+    int lines = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        if (mBuffer[i] == '\n')
+            lines++;
+    }
+
+    free(mEntries);
+    mEntries = (MountEntry *) calloc(lines + 1, sizeof(MountEntry));
+    mNumEntries = 0;
+    memset(mByMountpoint, 0, sizeof(mByMountpoint));
+    if (!mEntries)
+        return;
+
+    char *p = mBuffer;
+    while (*p) {
+        MountEntry *e = &mEntries[mNumEntries];
+        char *eol = strchr(p, '\n');
+
+        if (eol)
+            *eol = 0;
+
+        char *cur = p;
+        e->source = nextField(&cur);
+        e->mountpoint = nextField(&cur);
+        e->fstype = nextField(&cur);
+        e->options = nextField(&cur);
+
+        if (e->source && e->mountpoint) {
+            unescape(e->source);
+            unescape(e->mountpoint);
+
+            // Later mounts shadow earlier ones, so insert at the head
+            unsigned int h = hash(e->mountpoint);
+            e->nextByMountpoint = mByMountpoint[h];
+            mByMountpoint[h] = e;
+            mNumEntries++;
+        }
+
+        if (!eol)
+            break;
+        p = eol + 1;
+    }
+}
+
+/*
+ * Must be called with mLock held.
+ */
+int MountTable::refreshLocked() {
+    if (mValid && mFd >= 0) {
+        struct pollfd pfd;
+
+        pfd.fd = mFd;
+        pfd.events = POLLPRI;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 0) == 0)
+            return 0;
+    }
+
+    int len = readTable();
+    if (len < 0) {
+        mValid = false;
+        return -1;
+    }
+    parseTable(len);
+    mValid = true;
+    mRefreshCount++;
+    return 0;
+}
+
+MountEntry *MountTable::lookupMountpointLocked(const char *mountpoint) {
+    MountEntry *e;
+
+    for (e = mByMountpoint[hash(mountpoint)]; e; e = e->nextByMountpoint) {
+        if (!strcmp(e->mountpoint, mountpoint))
+            return e;
+    }
+    return NULL;
+}
+
+bool MountTable::isMountpointMounted(const char *mountpoint) {
+    bool mounted = false;
+
+    pthread_mutex_lock(&mLock);
+    if (!refreshLocked())
+        mounted = (lookupMountpointLocked(mountpoint) != NULL);
+    pthread_mutex_unlock(&mLock);
+    return mounted;
+}
+
+/*
+ * Appends a strdup()ed copy of the source of every mount directly or
+ * indirectly below 'dir' to 'sources'. The caller frees the strings.
+ */
+int MountTable::getSourcesUnder(const char *dir, MountSourceCollection *sources) {
+    size_t dirLen = strlen(dir);
+
+    while (dirLen > 1 && dir[dirLen - 1] == '/')
+        dirLen--;
+
+    pthread_mutex_lock(&mLock);
+    if (refreshLocked()) {
+        pthread_mutex_unlock(&mLock);
+        return -1;
+    }
+
+    for (int i = 0; i < mNumEntries; i++) {
+        MountEntry *e = &mEntries[i];
+        if (!strncmp(e->mountpoint, dir, dirLen) && e->mountpoint[dirLen] == '/')
+            sources->push_back(strdup(e->source));
+    }
+    pthread_mutex_unlock(&mLock);
+    return 0;
+}
+
+/*
+ * Sends one line per mount, in /proc/mounts order.
+ */
+int MountTable::dumpState(SocketClient *c) {
+    char line[1024];
+
+    pthread_mutex_lock(&mLock);
+    if (refreshLocked()) {
+        pthread_mutex_unlock(&mLock);
+        return -1;
+    }
+
+    for (int i = 0; i < mNumEntries; i++) {
+        MountEntry *e = &mEntries[i];
+        snprintf(line, sizeof(line), "%s %s %s %s", e->source, e->mountpoint,
+                 e->fstype ? e->fstype : "", e->options ? e->options : "");
+        c->sendMsg(0, line, false);
+    }
+    pthread_mutex_unlock(&mLock);
+    return 0;
+}
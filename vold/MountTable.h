@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _MOUNTTABLE_H
+#define _MOUNTTABLE_H
+
+#include <pthread.h>
+
+#include <utils/List.h>
+
+class SocketClient;
+
+class MountEntry {
+public:
+    char       *source;
+    char       *mountpoint;
+    char       *fstype;
+    char       *options;
+
+    MountEntry *nextByMountpoint;
+};
+
+typedef android::List<char *> MountSourceCollection;
+
+/*
+ * Cached, indexed copy of /proc/mounts.
+ *
+ * The table is only re-read when poll() on /proc/mounts reports that the
+ * kernel mount table changed (POLLPRI/POLLERR), so repeated queries from
+ * the mount, unmount, ASEC and OBB paths cost a hash lookup instead of a
+ * full parse each.
+ */
+class MountTable {
+private:
+    static MountTable *sInstance;
+    static pthread_once_t sInstanceOnce;
+
+    static const int NUM_BUCKETS = 256;
+
+private:
+    const char      *mPath;
+    int              mFd;
+    bool             mValid;
+    pthread_mutex_t  mLock;
+
+    char            *mBuffer;
+    size_t           mBufferSize;
+    MountEntry      *mEntries;
+    int              mNumEntries;
+    MountEntry      *mByMountpoint[NUM_BUCKETS];
+
+    unsigned int     mRefreshCount;
+
+public:
+    MountTable(const char *path);
+    virtual ~MountTable();
+
+    static MountTable *Instance();
+
+    bool isMountpointMounted(const char *mountpoint);
+    int getSourcesUnder(const char *dir, MountSourceCollection *sources);
+    int dumpState(SocketClient *c);
+
+    unsigned int getRefreshCount() { return mRefreshCount; }
+
+private:
+    static void createInstance();
+    int refreshLocked();
+    int readTable();
+    void parseTable(size_t len);
+    MountEntry *lookupMountpointLocked(const char *mountpoint);
+
+    static unsigned int hash(const char *s);
+    static char *nextField(char **p);
+    static void unescape(char *s);
+};
+
+#endif
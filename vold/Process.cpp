@@ -24,6 +24,7 @@
 #include <pwd.h>
 #include <stdlib.h>
 #include <poll.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <signal.h>
 
@@ -126,28 +127,69 @@ int Process::checkFileMaps(int pid, const char *mountPoint) {
 }
 
 int Process::checkFileMaps(int pid, const char *mountPoint, char *openFilename, size_t max) {
-    FILE *file;
     char buffer[PATH_MAX + 100];
 
-    sprintf(buffer, "/proc/%d/maps", pid);
-    file = fopen(buffer, "r");
-    if (!file)
+    return scanFileMaps(pid, mountPoint, buffer, sizeof(buffer), openFilename, max);
+}
+
+/*
+ * Reads /proc/<pid>/maps in large chunks rather than one fgets() per line,
+ * using the caller supplied buffer as scratch space.
+ */
+int Process::scanFileMaps(int pid, const char *mountPoint, char *buffer, size_t len,
+                          char *openFilename, size_t max) {
+    int fd;
+    size_t used = 0;
+
+    snprintf(buffer, len, "/proc/%d/maps", pid);
+    if ((fd = open(buffer, O_RDONLY)) < 0)
         return 0;
-    
-    while (fgets(buffer, sizeof(buffer), file)) {
-        // skip to the path
-        const char* path = strchr(buffer, '/');
-        if (path && pathMatchesMountPoint(path, mountPoint)) {
-            if (openFilename) {
-                memset(openFilename, 0, max);
-                strncpy(openFilename, path, max-1);
+
+    while (1) {
+        int n = read(fd, buffer + used, len - 1 - used);
+        bool eof = (n <= 0);
+
+        if (!eof)
+            used += n;
+        buffer[used] = 0;
+
+        char *start = buffer;
+        char *end = buffer + used;
+        while (start < end) {
+            char *nl = (char *) memchr(start, '\n', end - start);
+            if (!nl) {
+                // Keep the partial line unless it fills the whole buffer
+                if (!eof && (start != buffer || used < len - 1))
+                    break;
+                nl = end;
             }
-            fclose(file);
-            return 1;
+            *nl = 0;
+
+            // skip to the path
+            const char* path = strchr(start, '/');
+            if (path && pathMatchesMountPoint(path, mountPoint)) {
+                if (openFilename) {
+                    memset(openFilename, 0, max);
+                    strncpy(openFilename, path, max-1);
+                }
+                close(fd);
+                return 1;
+            }
+            start = nl + 1;
+        }
+
+        if (eof)
+            break;
+
+        if (start < end) {
+            used = end - start;
+            memmove(buffer, start, used);
+        } else {
+            used = 0;
         }
     }
-    
-    fclose(file);
+
+    close(fd);
     return 0;
 }
 
@@ -170,53 +212,311 @@ int Process::getPid(const char *s) {
     return result;
 }
 
+const char *ProcessOpenFile::typeString() const {
+    switch (type) {
+    case OpenFd:
+        return "open file";
+    case FileMap:
+        return "open filemap";
+    case Cwd:
+        return "cwd";
+    case Root:
+        return "chroot";
+    case Exe:
+        return "executable path";
+    }
+    return "unknown";
+}
+
+struct NameCacheEntry {
+    int  pid;
+    char name[256];
+};
+
+typedef android::List<NameCacheEntry *> NameCache;
+
+static pthread_mutex_t sNameCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static NameCache *sNameCache = NULL;
+
 /*
- * Hunt down processes that have files open at the given mount point.
- * action = 0 to just warn,
- * action = 1 to SIGHUP,
- * action = 2 to SIGKILL
+ * Only processes that actually hold the mount point busy need a name, and
+ * vold scans the same mount point several times while retrying an unmount,
+ * so the names are cached until the pid disappears from /proc.
  */
-// hunt down and kill processes that have files open on the given mount point
-void Process::killProcessesWithOpenFiles(const char *path, int action) {
-    DIR*    dir;
-    struct dirent* de;
+void Process::getCachedProcessName(int pid, char *buffer, size_t max) {
+    NameCache::iterator it;
+
+    pthread_mutex_lock(&sNameCacheLock);
+    if (!sNameCache)
+        sNameCache = new NameCache();
+    for (it = sNameCache->begin(); it != sNameCache->end(); ++it) {
+        if ((*it)->pid == pid) {
+            strncpy(buffer, (*it)->name, max - 1);
+            buffer[max - 1] = 0;
+            pthread_mutex_unlock(&sNameCacheLock);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&sNameCacheLock);
+
+    NameCacheEntry *e = (NameCacheEntry *) malloc(sizeof(NameCacheEntry));
+    if (!e) {
+        getProcessName(pid, buffer, max);
+        return;
+    }
+    e->pid = pid;
+    getProcessName(pid, e->name, sizeof(e->name));
+    strncpy(buffer, e->name, max - 1);
+    buffer[max - 1] = 0;
+
+    pthread_mutex_lock(&sNameCacheLock);
+    sNameCache->push_back(e);
+    pthread_mutex_unlock(&sNameCacheLock);
+}
+
+void Process::pruneNameCache(const int *pids, int count) {
+    NameCache::iterator it;
+
+    pthread_mutex_lock(&sNameCacheLock);
+    if (!sNameCache) {
+        pthread_mutex_unlock(&sNameCacheLock);
+        return;
+    }
+    it = sNameCache->begin();
+    while (it != sNameCache->end()) {
+        int i;
+        for (i = 0; i < count; i++) {
+            if (pids[i] == (*it)->pid)
+                break;
+        }
+        if (i == count) {
+            free(*it);
+            it = sNameCache->erase(it);
+        } else {
+            ++it;
+        }
+    }
+    pthread_mutex_unlock(&sNameCacheLock);
+}
+
+/*
+ * Checks a single process against the mount point, cheapest checks first,
+ * and stops at the first reference found.
+ */
+bool Process::inspectProcess(int pid, const char *mountPoint, char *scratch, size_t len,
+                             ProcessOpenFile *result) {
+    char path[PATH_MAX];
+
+    result->pid = pid;
+    result->path[0] = 0;
+
+    static const struct {
+        const char           *name;
+        ProcessOpenFile::Type type;
+    } links[] = {
+        { "cwd",  ProcessOpenFile::Cwd },
+        { "root", ProcessOpenFile::Root },
+        { "exe",  ProcessOpenFile::Exe },
+    };
+
+    for (size_t i = 0; i < sizeof(links) / sizeof(links[0]); i++) {
+        snprintf(path, sizeof(path), "/proc/%d/%s", pid, links[i].name);
+        if (readSymLink(path, result->path, sizeof(result->path)) &&
+            pathMatchesMountPoint(result->path, mountPoint)) {
+            result->type = links[i].type;
+            return true;
+        }
+    }
+
+    if (checkFileDescriptorSymLinks(pid, mountPoint, result->path, sizeof(result->path))) {
+        result->type = ProcessOpenFile::OpenFd;
+        return true;
+    }
+
+    if (scanFileMaps(pid, mountPoint, scratch, len, result->path, sizeof(result->path))) {
+        result->type = ProcessOpenFile::FileMap;
+        return true;
+    }
+    return false;
+}
+
+struct ScanState {
+    const char       *mountPoint;
+    const int        *pids;
+    int               count;
+    int               next;
+    ProcessOpenFile **slots;
+    pthread_mutex_t   lock;
+};
+
+#define SCAN_BUFFER_SIZE (16 * 1024)
+
+void *Process::scanThreadStart(void *obj) {
+    ScanState *state = reinterpret_cast<ScanState *>(obj);
+    char *scratch = (char *) malloc(SCAN_BUFFER_SIZE);
+    ProcessOpenFile *result = NULL;
+
+    if (!scratch)
+        return NULL;
+
+    while (1) {
+        pthread_mutex_lock(&state->lock);
+        int idx = state->next++;
+        pthread_mutex_unlock(&state->lock);
+
+        if (idx >= state->count)
+            break;
+
+        if (!result && !(result = (ProcessOpenFile *) malloc(sizeof(ProcessOpenFile))))
+            break;
+
+        if (inspectProcess(state->pids[idx], state->mountPoint, scratch,
+                           SCAN_BUFFER_SIZE, result)) {
+            state->slots[idx] = result;
+            result = NULL;
+        }
+    }
+
+    free(result);
+    free(scratch);
+    return NULL;
+}
+
+/*
+ * Collects every process with a reference to the given mount point.
+ * /proc is walked once to collect candidate pids, which are then
+ * inspected by a small pool of threads. Results are appended to
+ * 'results' in /proc order and must be released with freeOpenFiles().
+ * Returns the number of processes found, or -1 on error.
+ */
+int Process::findProcessesWithOpenFiles(const char *path, ProcessOpenFileCollection *results) {
+    DIR *dir;
+    struct dirent *de;
+    int *pids = NULL;
+    int count = 0, capacity = 0;
 
     if (!(dir = opendir("/proc"))) {
         SLOGE("opendir failed (%s)", strerror(errno));
-        return;
+        return -1;
     }
 
     while ((de = readdir(dir))) {
-        int killed = 0;
         int pid = getPid(de->d_name);
-        char name[PATH_MAX];
 
         if (pid == -1)
             continue;
-        getProcessName(pid, name, sizeof(name));
-
-        char openfile[PATH_MAX];
-
-        if (checkFileDescriptorSymLinks(pid, path, openfile, sizeof(openfile))) {
-            SLOGE("Process %s (%d) has open file %s", name, pid, openfile);
-        } else if (checkFileMaps(pid, path, openfile, sizeof(openfile))) {
-            SLOGE("Process %s (%d) has open filemap for %s", name, pid, openfile);
-        } else if (checkSymLink(pid, path, "cwd")) {
-            SLOGE("Process %s (%d) has cwd within %s", name, pid, path);
-        } else if (checkSymLink(pid, path, "root")) {
-            SLOGE("Process %s (%d) has chroot within %s", name, pid, path);
-        } else if (checkSymLink(pid, path, "exe")) {
-            SLOGE("Process %s (%d) has executable path within %s", name, pid, path);
-        } else {
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            int *tmp = (int *) realloc(pids, capacity * sizeof(int));
+            if (!tmp) {
+                SLOGE("Failed to allocate pid list (%s)", strerror(errno));
+                free(pids);
+                closedir(dir);
+                return -1;
+            }
+            pids = tmp;
+        }
+        pids[count++] = pid;
+    }
+    closedir(dir);
+
+    pruneNameCache(pids, count);
+
+    ScanState state;
+    state.mountPoint = path;
+    state.pids = pids;
+    state.count = count;
+    state.next = 0;
+    state.slots = (ProcessOpenFile **) calloc(count ? count : 1, sizeof(ProcessOpenFile *));
+    pthread_mutex_init(&state.lock, NULL);
+
+    if (!state.slots) {
+        SLOGE("Failed to allocate scan results (%s)", strerror(errno));
+        pthread_mutex_destroy(&state.lock);
+        free(pids);
+        return -1;
+    }
+
+    int nthreads = count / MIN_PIDS_PER_THREAD;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > MAX_SCAN_THREADS)
+        nthreads = MAX_SCAN_THREADS;
+    if (ncpus > 0 && nthreads > ncpus)
+        nthreads = ncpus;
+
+    // The calling thread always takes part in the scan
+    pthread_t threads[MAX_SCAN_THREADS];
+    int started = 0;
+    for (int i = 1; i < nthreads; i++) {
+        if (pthread_create(&threads[started], NULL, Process::scanThreadStart, &state)) {
+            SLOGW("Failed to start scan thread (%s)", strerror(errno));
+            break;
+        }
+        started++;
+    }
+    scanThreadStart(&state);
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    int found = 0;
+    for (int i = 0; i < count; i++) {
+        ProcessOpenFile *pof = state.slots[i];
+        if (!pof)
             continue;
+        getCachedProcessName(pof->pid, pof->name, sizeof(pof->name));
+        results->push_back(pof);
+        found++;
+    }
+
+    pthread_mutex_destroy(&state.lock);
+    free(state.slots);
+    free(pids);
+    return found;
+}
+
+void Process::freeOpenFiles(ProcessOpenFileCollection *results) {
+    ProcessOpenFileCollection::iterator it = results->begin();
+
+    while (it != results->end()) {
+        free(*it);
+        it = results->erase(it);
+    }
+}
+
+/*
+ * Hunt down processes that have files open at the given mount point.
+ * action = 0 to just warn,
+ * action = 1 to SIGHUP,
+ * action = 2 to SIGKILL
+ * Returns the number of processes found.
+ */
+// hunt down and kill processes that have files open on the given mount point
+int Process::killProcessesWithOpenFiles(const char *path, int action) {
+    ProcessOpenFileCollection users;
+    ProcessOpenFileCollection::iterator it;
+
+    int found = findProcessesWithOpenFiles(path, &users);
+    if (found <= 0)
+        return found;
+
+    for (it = users.begin(); it != users.end(); ++it) {
+        ProcessOpenFile *pof = *it;
+
+        if (pof->type == ProcessOpenFile::OpenFd || pof->type == ProcessOpenFile::FileMap) {
+            SLOGE("Process %s (%d) has %s %s", pof->name, pof->pid, pof->typeString(), pof->path);
+        } else {
+            SLOGE("Process %s (%d) has %s within %s", pof->name, pof->pid, pof->typeString(), path);
         }
+
         if (action == 1) {
-            SLOGW("Sending SIGHUP to process %d", pid);
-            kill(pid, SIGTERM);
+            SLOGW("Sending SIGHUP to process %d", pof->pid);
+            kill(pof->pid, SIGTERM);
         } else if (action == 2) {
-            SLOGE("Sending SIGKILL to process %d", pid);
-            kill(pid, SIGKILL);
+            SLOGE("Sending SIGKILL to process %d", pof->pid);
+            kill(pof->pid, SIGKILL);
         }
     }
-    closedir(dir);
+
+    freeOpenFiles(&users);
+    return found;
 }
@@ -17,9 +17,45 @@
 #ifndef _PROCESS_H
 #define _PROCESS_H
 
+#include <limits.h>
+#include <sys/types.h>
+
+#include <utils/List.h>
+
+/*
+ * Describes why a process is holding a mount point busy.
+ */
+class ProcessOpenFile {
+public:
+    enum Type {
+        OpenFd   = 0,
+        FileMap  = 1,
+        Cwd      = 2,
+        Root     = 3,
+        Exe      = 4,
+    };
+
+    pid_t pid;
+    Type  type;
+    char  name[256];
+    char  path[PATH_MAX];
+
+    const char *typeString() const;
+};
+
+typedef android::List<ProcessOpenFile *> ProcessOpenFileCollection;
+
 class Process {
 public:
-    static void killProcessesWithOpenFiles(const char *path, int action);
+    /* Maximum number of threads used to inspect candidate processes */
+    static const int MAX_SCAN_THREADS = 4;
+
+    /* Below this many candidate pids the scan is done on the calling thread */
+    static const int MIN_PIDS_PER_THREAD = 16;
+
+    static int killProcessesWithOpenFiles(const char *path, int action);
+    static int findProcessesWithOpenFiles(const char *path, ProcessOpenFileCollection *results);
+    static void freeOpenFiles(ProcessOpenFileCollection *results);
     static int getPid(const char *s);
     static int checkSymLink(int pid, const char *path, const char *name);
     static int checkFileMaps(int pid, const char *path);
@@ -30,6 +66,13 @@ public:
 private:
     static int readSymLink(const char *path, char *link, size_t max);
     static int pathMatchesMountPoint(const char *path, const char *mountPoint);
+    static int scanFileMaps(int pid, const char *mountPoint, char *buffer, size_t len,
+                            char *openFilename, size_t max);
+    static bool inspectProcess(int pid, const char *mountPoint, char *scratch, size_t len,
+                               ProcessOpenFile *result);
+    static void getCachedProcessName(int pid, char *buffer, size_t max);
+    static void pruneNameCache(const int *pids, int count);
+    static void *scanThreadStart(void *obj);
 };
 
 #endif
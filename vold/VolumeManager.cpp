@@ -20,8 +20,10 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/mount.h>
+#include <dirent.h>
 
 #include <linux/kdev_t.h>
 
@@ -41,6 +43,7 @@
 #include "Devmapper.h"
 #include "Process.h"
 #include "Asec.h"
+#include "MountTable.h"
 
 //#define NETLINK_DEBUG
 
@@ -56,6 +59,7 @@ VolumeManager::VolumeManager() {
     mDebug = false;
     mVolumes = new VolumeCollection();
     mActiveContainers = new AsecIdCollection();
+    pthread_mutex_init(&mContainersLock, NULL);
     mBroadcaster = NULL;
     mUsbMassStorageEnabled = false;
     mUsbConnected = false;
@@ -298,6 +302,7 @@ int VolumeManager::createAsec(const char *id, unsigned int numSectors,
 
     sb.magic = ASEC_SB_MAGIC;
     sb.ver = ASEC_SB_VER;
+    sb.c_time = time(NULL);
 
     if (numSectors < ((1024*1024)/512)) {
         SLOGE("Invalid container size specified (%d sectors)", numSectors);
@@ -332,9 +337,26 @@ int VolumeManager::createAsec(const char *id, unsigned int numSectors,
     }
 
     // Add +1 for our superblock which is at the end
-    if (Loop::createImageFile(asecFileName, numImgSectors + 1)) {
-        SLOGE("ASEC image file creation failed (%s)", strerror(errno));
-        return -1;
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    if (Loop::createPreallocatedImageFile(asecFileName, numImgSectors + 1)) {
+        if (errno == ENOSPC || errno == EEXIST) {
+            SLOGE("ASEC image file creation failed (%s)", strerror(errno));
+            return -1;
+        }
+        SLOGW("ASEC image preallocation failed (%s), creating sparse image", strerror(errno));
+        if (Loop::createImageFile(asecFileName, numImgSectors + 1)) {
+            SLOGE("ASEC image file creation failed (%s)", strerror(errno));
+            return -1;
+        }
+    }
+    gettimeofday(&end, NULL);
+
+    int extents = Loop::getExtentCount(asecFileName);
+    if (mDebug || extents > ASEC_MAX_EXTENTS) {
+        SLOGD("ASEC image %s created in %ld ms (%d extents)", id,
+              (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000,
+              extents);
     }
 
     char idHash[33];
@@ -451,7 +473,7 @@ int VolumeManager::createAsec(const char *id, unsigned int numSectors,
         SLOGI("Created raw secure container %s (no filesystem)", id);
     }
 
-    mActiveContainers->push_back(new ContainerData(strdup(id), ASEC));
+    addActiveContainer(id, ASEC);
     return 0;
 }
 
@@ -629,6 +651,7 @@ int VolumeManager::unmountLoopImage(const char *id, const char *idHash,
     }
 
     AsecIdCollection::iterator it;
+    pthread_mutex_lock(&mContainersLock);
     for (it = mActiveContainers->begin(); it != mActiveContainers->end(); ++it) {
         ContainerData* cd = *it;
         if (!strcmp(cd->id, id)) {
@@ -640,9 +663,16 @@ int VolumeManager::unmountLoopImage(const char *id, const char *idHash,
     if (it == mActiveContainers->end()) {
         SLOGW("mActiveContainers is inconsistent!");
     }
+    pthread_mutex_unlock(&mContainersLock);
     return 0;
 }
 
+void VolumeManager::addActiveContainer(const char *id, container_type_t type) {
+    pthread_mutex_lock(&mContainersLock);
+    mActiveContainers->push_back(new ContainerData(strdup(id), type));
+    pthread_mutex_unlock(&mContainersLock);
+}
+
 int VolumeManager::destroyAsec(const char *id, bool force) {
     char asecFileName[255];
     char mountPoint[255];
@@ -786,6 +816,15 @@ int VolumeManager::mountAsec(const char *id, const char *key, int ownerUid) {
         }
     }
 
+    if (Fat::check(dmDevice)) {
+        SLOGE("ASEC FAT check failed (%s)", strerror(errno));
+        if (cleanupDm) {
+            Devmapper::destroy(idHash);
+        }
+        Loop::destroyByDevice(loopDevice);
+        return -1;
+    }
+
     if (Fat::doMount(dmDevice, mountPoint, true, false, true, ownerUid, 0,
                      0222, false)) {
 //                     0227, false)) {
@@ -797,13 +836,125 @@ int VolumeManager::mountAsec(const char *id, const char *key, int ownerUid) {
         return -1;
     }
 
-    mActiveContainers->push_back(new ContainerData(strdup(id), ASEC));
+    addActiveContainer(id, ASEC);
     if (mDebug) {
         SLOGD("ASEC %s mounted", id);
     }
     return 0;
 }
 
+struct AsecMountAllState {
+    VolumeManager        *vm;
+    const AsecMountRequest *requests;
+    const bool           *duplicate;
+    int                   count;
+    int                   next;
+    int                   failed;
+    SocketClient         *cli;
+    pthread_mutex_t       lock;
+};
+
+void *VolumeManager::mountAsecsThreadStart(void *obj) {
+    AsecMountAllState *state = reinterpret_cast<AsecMountAllState *>(obj);
+
+    while (1) {
+        pthread_mutex_lock(&state->lock);
+        int idx = state->next++;
+        pthread_mutex_unlock(&state->lock);
+
+        if (idx >= state->count)
+            break;
+
+        const AsecMountRequest *req = &state->requests[idx];
+        char msg[255];
+
+        if (state->duplicate[idx]) {
+            snprintf(msg, sizeof(msg), "%s %d %s", req->id,
+                     ResponseCode::OperationFailed, "Duplicate id in batch");
+            pthread_mutex_lock(&state->lock);
+            state->failed++;
+            pthread_mutex_unlock(&state->lock);
+        } else if (state->vm->mountAsec(req->id, req->key, req->ownerUid)) {
+            snprintf(msg, sizeof(msg), "%s %d %s", req->id,
+                     ResponseCode::convertFromErrno(), strerror(errno));
+            pthread_mutex_lock(&state->lock);
+            state->failed++;
+            pthread_mutex_unlock(&state->lock);
+        } else {
+            snprintf(msg, sizeof(msg), "%s %d", req->id, ResponseCode::CommandOkay);
+        }
+
+        if (state->cli) {
+            state->cli->sendMsg(ResponseCode::AsecMountAllResult, msg, false);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Mounts a batch of independent ASEC containers using up to 'maxParallel'
+ * threads, so that one container's fsck or mount does not hold up the
+ * others. Loop device allocation is serialized inside Loop::create() and
+ * dm minors are allocated by the kernel per device name. Only the first
+ * request for an id is mounted; two threads mounting the same container
+ * would both find no active loop device and each create one.
+ * As each container completes an AsecMountAllResult of the form
+ * "<id> <code> [error]" is sent to 'cli'.
+ * Returns the number of containers that failed to mount.
+ */
+int VolumeManager::mountAsecs(const AsecMountRequest *requests, int count, int maxParallel,
+                              SocketClient *cli) {
+    AsecMountAllState state;
+
+    bool *duplicate = (bool *) calloc(count, sizeof(bool));
+    if (!duplicate) {
+        SLOGE("Failed to allocate ASEC mount batch (%s)", strerror(errno));
+        return count;
+    }
+    for (int i = 1; i < count; i++) {
+        for (int j = 0; j < i; j++) {
+            if (!strcmp(requests[i].id, requests[j].id)) {
+                duplicate[i] = true;
+                break;
+            }
+        }
+    }
+
+    state.vm = this;
+    state.requests = requests;
+    state.duplicate = duplicate;
+    state.count = count;
+    state.next = 0;
+    state.failed = 0;
+    state.cli = cli;
+    pthread_mutex_init(&state.lock, NULL);
+
+    if (maxParallel > ASEC_MOUNTALL_MAX_THREADS)
+        maxParallel = ASEC_MOUNTALL_MAX_THREADS;
+    if (maxParallel > count)
+        maxParallel = count;
+
+    // The calling thread mounts containers too
+    pthread_t threads[ASEC_MOUNTALL_MAX_THREADS];
+    int started = 0;
+    for (int i = 1; i < maxParallel; i++) {
+        if (pthread_create(&threads[started], NULL,
+                           VolumeManager::mountAsecsThreadStart, &state)) {
+            SLOGW("Failed to start ASEC mount thread (%s)", strerror(errno));
+            break;
+        }
+        started++;
+    }
+    mountAsecsThreadStart(&state);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&state.lock);
+    free(duplicate);
+    return state.failed;
+}
+
 /**
  * Mounts an image file <code>img</code>.
  */
@@ -901,7 +1052,7 @@ int VolumeManager::mountObb(const char *img, const char *key, int ownerUid) {
         return -1;
     }
 
-    mActiveContainers->push_back(new ContainerData(strdup(img), OBB));
+    addActiveContainer(img, OBB);
     if (mDebug) {
         SLOGD("Image %s mounted", img);
     }
@@ -919,48 +1070,95 @@ int VolumeManager::mountVolume(const char *label) {
     return v->mountVol();
 }
 
-int VolumeManager::listMountedObbs(SocketClient* cli) {
-    char device[256];
-    char mount_path[256];
-    char rest[256];
-    FILE *fp;
-    char line[1024];
+/*
+ * Lists ASEC containers. With 'details', each entry also carries the
+ * image size in KB, the creation time recorded in its superblock
+ * (0 if unknown) and the number of extents backing it (-1 if the
+ * filesystem cannot report extents).
+ */
+int VolumeManager::listAsecs(SocketClient *cli, bool details) {
+    DIR *d = opendir(Volume::SEC_ASECDIR);
 
-    if (!(fp = fopen("/proc/mounts", "r"))) {
-        SLOGE("Error opening /proc/mounts (%s)", strerror(errno));
+    if (!d) {
+        SLOGE("Failed to open asec dir (%s)", strerror(errno));
         return -1;
     }
 
-    // Create a string to compare against that has a trailing slash
-    int loopDirLen = sizeof(Volume::LOOPDIR);
-    char loopDir[loopDirLen + 2];
-    strcpy(loopDir, Volume::LOOPDIR);
-    loopDir[loopDirLen++] = '/';
-    loopDir[loopDirLen] = '\0';
+    struct dirent *dent;
+    while ((dent = readdir(d))) {
+        if (dent->d_name[0] == '.')
+            continue;
+        int len = strlen(dent->d_name);
+        if (len <= 5 || strcmp(&dent->d_name[len - 5], ".asec"))
+            continue;
 
-    while(fgets(line, sizeof(line), fp)) {
-        line[strlen(line)-1] = '\0';
+        char id[255];
+        memset(id, 0, sizeof(id));
+        strncpy(id, dent->d_name, len - 5);
+
+        if (!details) {
+            cli->sendMsg(ResponseCode::AsecListResult, id, false);
+            continue;
+        }
+
+        char path[512];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", Volume::SEC_ASECDIR, dent->d_name);
+        if (stat(path, &st) < 0) {
+            SLOGW("Failed to stat %s (%s)", path, strerror(errno));
+            continue;
+        }
 
         /*
-         * Should look like:
-         * /dev/block/loop0 /mnt/obb/fc99df1323fd36424f864dcb76b76d65 ...
+         * The superblock sits in the last sector of the image file, and
+         * is not covered by the cipher, so it can be read in place.
          */
-        sscanf(line, "%255s %255s %255s\n", device, mount_path, rest);
-
-        if (!strncmp(mount_path, loopDir, loopDirLen)) {
-            int fd = open(device, O_RDONLY);
-            if (fd >= 0) {
-                struct loop_info64 li;
-                if (ioctl(fd, LOOP_GET_STATUS64, &li) >= 0) {
-                    cli->sendMsg(ResponseCode::AsecListResult,
-                            (const char*) li.lo_file_name, false);
-                }
-                close(fd);
+        struct asec_superblock sb;
+        memset(&sb, 0, sizeof(sb));
+        int fd = open(path, O_RDONLY);
+        if (fd >= 0) {
+            if (pread(fd, &sb, sizeof(sb), st.st_size - 512) != sizeof(sb) ||
+                    sb.magic != ASEC_SB_MAGIC) {
+                memset(&sb, 0, sizeof(sb));
             }
+            close(fd);
         }
+
+        char msg[512];
+        snprintf(msg, sizeof(msg), "%s %llu %lu %d", id,
+                 (unsigned long long) st.st_size / 1024,
+                 (unsigned long) sb.c_time,
+                 Loop::getExtentCount(path));
+        cli->sendMsg(ResponseCode::AsecListResult, msg, false);
+    }
+    closedir(d);
+    return 0;
+}
+
+int VolumeManager::listMountedObbs(SocketClient* cli) {
+    MountSourceCollection devices;
+    MountSourceCollection::iterator it;
+
+    if (MountTable::Instance()->getSourcesUnder(Volume::LOOPDIR, &devices)) {
+        return -1;
     }
 
-    fclose(fp);
+    /*
+     * Sources should look like /dev/block/loop0 for mounts under
+     * /mnt/obb/fc99df1323fd36424f864dcb76b76d65
+     */
+    for (it = devices.begin(); it != devices.end(); ++it) {
+        int fd = open(*it, O_RDONLY);
+        if (fd >= 0) {
+            struct loop_info64 li;
+            if (ioctl(fd, LOOP_GET_STATUS64, &li) >= 0) {
+                cli->sendMsg(ResponseCode::AsecListResult,
+                        (const char*) li.lo_file_name, false);
+            }
+            close(fd);
+        }
+        free(*it);
+    }
     return 0;
 }
 
@@ -1189,28 +1387,7 @@ Volume *VolumeManager::lookupVolume(const char *label) {
 
 bool VolumeManager::isMountpointMounted(const char *mp)
 {
-    char device[256];
-    char mount_path[256];
-    char rest[256];
-    FILE *fp;
-    char line[1024];
-
-    if (!(fp = fopen("/proc/mounts", "r"))) {
-        SLOGE("Error opening /proc/mounts (%s)", strerror(errno));
-        return false;
-    }
-
-    while(fgets(line, sizeof(line), fp)) {
-        line[strlen(line)-1] = '\0';
-        sscanf(line, "%255s %255s %255s\n", device, mount_path, rest);
-        if (!strcmp(mount_path, mp)) {
-            fclose(fp);
-            return true;
-        }
-    }
-
-    fclose(fp);
-    return false;
+    return MountTable::Instance()->isMountpointMounted(mp);
 }
 
 int VolumeManager::cleanupAsec(Volume *v, bool force) {
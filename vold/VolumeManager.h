@@ -24,6 +24,9 @@
 
 #include "Volume.h"
 
+/* Preallocated ASEC images backed by more extents than this are logged */
+#define ASEC_MAX_EXTENTS 16
+
 /* The length of an MD5 hash when encoded into ASCII hex characters */
 #define MD5_ASCII_LENGTH_PLUS_NULL ((MD5_DIGEST_LENGTH*2)+1)
 
@@ -49,6 +52,15 @@ public:
 
 typedef android::List<ContainerData*> AsecIdCollection;
 
+/* Upper bound on containers mounted concurrently by 'asec mountall' */
+#define ASEC_MOUNTALL_MAX_THREADS 8
+
+struct AsecMountRequest {
+    const char *id;
+    const char *key;
+    int         ownerUid;
+};
+
 class VolumeManager {
 private:
     static VolumeManager *sInstance;
@@ -58,6 +70,7 @@ private:
 
     VolumeCollection      *mVolumes;
     AsecIdCollection      *mActiveContainers;
+    pthread_mutex_t        mContainersLock;
     bool                   mUsbMassStorageEnabled;
     bool                   mUsbConnected;
     bool                   mDebug;
@@ -95,9 +108,12 @@ public:
     int finalizeAsec(const char *id);
     int destroyAsec(const char *id, bool force);
     int mountAsec(const char *id, const char *key, int ownerUid);
+    int mountAsecs(const AsecMountRequest *requests, int count, int maxParallel,
+                   SocketClient *cli);
     int unmountAsec(const char *id, bool force);
     int renameAsec(const char *id1, const char *id2);
     int getAsecMountPath(const char *id, char *buffer, int maxlen);
+    int listAsecs(SocketClient *cli, bool details);
 
     /* Loopback images */
     int listMountedObbs(SocketClient* cli);
@@ -126,6 +142,8 @@ private:
     void readInitialState();
     Volume *lookupVolume(const char *label);
     bool isMountpointMounted(const char *mp);
+    void addActiveContainer(const char *id, container_type_t type);
+    static void *mountAsecsThreadStart(void *obj);
 
     inline bool massStorageAvailable() const { return mUsbMassStorageEnabled && mUsbConnected; }
     void notifyUmsAvailable(bool available);
@@ -22,11 +22,15 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 #include "private/android_filesystem_config.h"
 #include "cutils/log.h"
 
-int parent(const char *tag, int parent_read) {
+/* ptsname() returns a static buffer, and vold runs fsck from several threads */
+static pthread_mutex_t ptsname_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int parent(const char *tag, int parent_read, pid_t pid) {
     int status;
     char buffer[4096];
 
@@ -70,7 +74,7 @@ int parent(const char *tag, int parent_read) {
         LOG(LOG_INFO, tag, "%s", &buffer[a]);
     }
     status = 0xAAAA;
-    if (wait(&status) != -1) {  // Wait for child
+    if (waitpid(pid, &status, 0) != -1) {  // Wait for child
         if (WIFEXITED(status)) {
             if (WEXITSTATUS(status) != 0) {
                 LOG(LOG_INFO, "logwrapper", "%s terminated by exit(%d)", tag,
@@ -109,7 +113,8 @@ int logwrap(int argc, const char* argv[], int background)
 
     int parent_ptty;
     int child_ptty;
-    char *child_devname = NULL;
+    char child_devname[64];
+    char *name;
 
     /* Use ptty instead of socketpair so that STDOUT is not buffered */
     parent_ptty = open("/dev/ptmx", O_RDWR);
@@ -118,12 +123,20 @@ int logwrap(int argc, const char* argv[], int background)
 	return -errno;
     }
 
+    /* Don't leak it into children forked by other threads */
+    fcntl(parent_ptty, F_SETFD, FD_CLOEXEC);
+
+    pthread_mutex_lock(&ptsname_lock);
     if (grantpt(parent_ptty) || unlockpt(parent_ptty) ||
-            ((child_devname = (char*)ptsname(parent_ptty)) == 0)) {
+            ((name = (char*)ptsname(parent_ptty)) == 0)) {
+        pthread_mutex_unlock(&ptsname_lock);
         close(parent_ptty);
 	LOG(LOG_ERROR, "logwrapper", "Problem with /dev/ptmx");
 	return -1;
     }
+    strncpy(child_devname, name, sizeof(child_devname) - 1);
+    child_devname[sizeof(child_devname) - 1] = '\0';
+    pthread_mutex_unlock(&ptsname_lock);
 
     pid = fork();
     if (pid < 0) {
@@ -169,7 +182,7 @@ int logwrap(int argc, const char* argv[], int background)
         /*
          * Parent
          */
-        int rc = parent(argv[0], parent_ptty);
+        int rc = parent(argv[0], parent_ptty, pid);
         close(parent_ptty);
         return rc;
     }
@@ -3,7 +3,8 @@ LOCAL_PATH := $(call my-dir)
 include $(CLEAR_VARS)
 
 test_src_files := \
-	VolumeManager_test.cpp
+	VolumeManager_test.cpp \
+	Process_test.cpp
 
 shared_libraries := \
 	liblog \
@@ -34,3 +35,20 @@ $(foreach file,$(test_src_files), \
     $(eval LOCAL_MODULE_TAGS := $(module_tags)) \
     $(eval include $(BUILD_EXECUTABLE)) \
 )
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := AsecImage_benchmark.cpp
+LOCAL_MODULE := AsecImage_benchmark
+LOCAL_SHARED_LIBRARIES := libcutils libsysutils
+LOCAL_STATIC_LIBRARIES := libvold
+LOCAL_C_INCLUDES := $(KERNEL_HEADERS)
+LOCAL_MODULE_TAGS := $(module_tags)
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := MountTable_benchmark.cpp
+LOCAL_MODULE := MountTable_benchmark
+LOCAL_SHARED_LIBRARIES := libcutils libsysutils
+LOCAL_STATIC_LIBRARIES := libvold
+LOCAL_MODULE_TAGS := $(module_tags)
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compares random-read throughput through a loop device backed by a
+ * sparse image against one backed by a preallocated image.
+ *
+ * Each image is attached to a loop device, filled sequentially through
+ * the loop device (as installing into an ASEC would), then read back at
+ * random 4K offsets with the page cache dropped.
+ *
+ * usage: AsecImage_benchmark [dir] [size_mb] [reads]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "../Loop.h"
+
+#define FILL_CHUNK  (64 * 1024)
+#define READ_SIZE   4096
+
+static double now_ms() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+static void drop_caches() {
+    int fd;
+
+    sync();
+    if ((fd = open("/proc/sys/vm/drop_caches", O_WRONLY)) >= 0) {
+        write(fd, "3\n", 2);
+        close(fd);
+    }
+}
+
+static int run(const char *dir, const char *mode, bool preallocate,
+               unsigned int sizeMb, unsigned int reads) {
+    char file[256];
+    char loopDevice[255];
+    unsigned int numSectors = sizeMb * ((1024 * 1024) / 512);
+    double start, end;
+    int fd, rc = -1;
+
+    snprintf(file, sizeof(file), "%s/asecbench_%s.img", dir, mode);
+    unlink(file);
+
+    start = now_ms();
+    if (preallocate) {
+        rc = Loop::createPreallocatedImageFile(file, numSectors);
+    } else {
+        rc = Loop::createImageFile(file, numSectors);
+    }
+    end = now_ms();
+    if (rc) {
+        fprintf(stderr, "%s: image creation failed (%s)\n", mode, strerror(errno));
+        return -1;
+    }
+    printf("%-8s create %8.1f ms\n", mode, end - start);
+    rc = -1;
+
+    if (Loop::create(mode, file, loopDevice, sizeof(loopDevice))) {
+        fprintf(stderr, "%s: loop setup failed (%s)\n", mode, strerror(errno));
+        unlink(file);
+        return -1;
+    }
+
+    char *buf = (char *) malloc(FILL_CHUNK);
+    memset(buf, 0xa5, FILL_CHUNK);
+
+    if ((fd = open(loopDevice, O_RDWR)) < 0) {
+        fprintf(stderr, "%s: open %s failed (%s)\n", mode, loopDevice, strerror(errno));
+        goto out;
+    }
+
+    start = now_ms();
+    for (unsigned long long off = 0; off < (unsigned long long) sizeMb * 1024 * 1024;
+         off += FILL_CHUNK) {
+        if (write(fd, buf, FILL_CHUNK) != FILL_CHUNK) {
+            fprintf(stderr, "%s: fill failed (%s)\n", mode, strerror(errno));
+            close(fd);
+            goto out;
+        }
+    }
+    fsync(fd);
+    end = now_ms();
+    printf("%-8s fill   %8.1f ms (%.1f MB/s), %d extents\n", mode, end - start,
+           sizeMb / ((end - start) / 1000.0), Loop::getExtentCount(file));
+
+    drop_caches();
+    srand(1);
+    start = now_ms();
+    for (unsigned int i = 0; i < reads; i++) {
+        off64_t blocks = ((off64_t) sizeMb * 1024 * 1024) / READ_SIZE;
+        off64_t off = ((off64_t) rand() % blocks) * READ_SIZE;
+        if (pread64(fd, buf, READ_SIZE, off) != READ_SIZE) {
+            fprintf(stderr, "%s: read failed (%s)\n", mode, strerror(errno));
+            close(fd);
+            goto out;
+        }
+    }
+    end = now_ms();
+    printf("%-8s random read %u x %d: %8.1f ms (%.2f MB/s, %.0f IOPS)\n", mode, reads,
+           READ_SIZE, end - start,
+           ((double) reads * READ_SIZE / (1024 * 1024)) / ((end - start) / 1000.0),
+           reads / ((end - start) / 1000.0));
+    close(fd);
+    rc = 0;
+
+out:
+    free(buf);
+    Loop::destroyByDevice(loopDevice);
+    unlink(file);
+    return rc;
+}
+
+int main(int argc, char **argv) {
+    const char *dir = argc > 1 ? argv[1] : "/mnt/secure/asec";
+    unsigned int sizeMb = argc > 2 ? atoi(argv[2]) : 64;
+    unsigned int reads = argc > 3 ? atoi(argv[3]) : 4096;
+
+    if (run(dir, "sparse", false, sizeMb, reads))
+        return 1;
+    if (run(dir, "prealloc", true, sizeMb, reads))
+        return 1;
+    return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LOG_TAG "Process_test"
+#include <utils/Log.h>
+#include "../Process.h"
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+class ProcessTest : public testing::Test {
+protected:
+    char mDir[PATH_MAX];
+    char mFile[PATH_MAX];
+
+    virtual void SetUp() {
+        snprintf(mDir, sizeof(mDir), "/data/local/tmp/vold_process_test.%d", getpid());
+        snprintf(mFile, sizeof(mFile), "%s/file", mDir);
+        mkdir(mDir, 0700);
+    }
+
+    virtual void TearDown() {
+        unlink(mFile);
+        rmdir(mDir);
+    }
+
+    const ProcessOpenFile *findSelf(ProcessOpenFileCollection *users) {
+        ProcessOpenFileCollection::iterator it;
+        for (it = users->begin(); it != users->end(); ++it) {
+            if ((*it)->pid == getpid())
+                return *it;
+        }
+        return NULL;
+    }
+};
+
+TEST_F(ProcessTest, FindsOpenFileDescriptor) {
+    int fd = open(mFile, O_CREAT | O_RDWR, 0600);
+    ASSERT_GE(fd, 0) << "Failed to create test file";
+
+    ProcessOpenFileCollection users;
+    EXPECT_GE(Process::findProcessesWithOpenFiles(mDir, &users), 1);
+
+    const ProcessOpenFile *self = findSelf(&users);
+    ASSERT_TRUE(self != NULL) << "Should report the test process as a user";
+    EXPECT_EQ(ProcessOpenFile::OpenFd, self->type);
+    EXPECT_STREQ(mFile, self->path);
+
+    Process::freeOpenFiles(&users);
+    EXPECT_TRUE(users.empty());
+    close(fd);
+}
+
+TEST_F(ProcessTest, FindsFileMap) {
+    int fd = open(mFile, O_CREAT | O_RDWR, 0600);
+    ASSERT_GE(fd, 0) << "Failed to create test file";
+    ASSERT_EQ(4, write(fd, "vold", 4));
+
+    void *map = mmap(NULL, 4, PROT_READ, MAP_SHARED, fd, 0);
+    ASSERT_NE(MAP_FAILED, map);
+    close(fd);
+
+    ProcessOpenFileCollection users;
+    EXPECT_GE(Process::findProcessesWithOpenFiles(mDir, &users), 1);
+
+    const ProcessOpenFile *self = findSelf(&users);
+    ASSERT_TRUE(self != NULL) << "Should report the test process as a user";
+    EXPECT_EQ(ProcessOpenFile::FileMap, self->type);
+
+    Process::freeOpenFiles(&users);
+    munmap(map, 4);
+}
+
+TEST_F(ProcessTest, IgnoresUnrelatedMountPoint) {
+    char other[PATH_MAX];
+    snprintf(other, sizeof(other), "%s-other", mDir);
+
+    int fd = open(mFile, O_CREAT | O_RDWR, 0600);
+    ASSERT_GE(fd, 0) << "Failed to create test file";
+
+    ProcessOpenFileCollection users;
+    EXPECT_GE(Process::findProcessesWithOpenFiles(other, &users), 0);
+    EXPECT_TRUE(findSelf(&users) == NULL)
+            << "Should not match paths that only share a prefix with the mount point";
+
+    Process::freeOpenFiles(&users);
+    close(fd);
+}
+
+}